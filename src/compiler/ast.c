@@ -10,6 +10,8 @@ static ASTNode* make_node(ASTNodeType type, int line, int column) {
     node->type = type;
     node->line = line;
     node->column = column;
+    node->flags = 0;
+    node->inferred_type = NULL;
     return node;
 }
 
@@ -276,6 +278,9 @@ ASTNode* ast_function_def(const char* name, ASTNode* return_type,
     node->as.function_def.decorators = NULL;
     node->as.function_def.decorator_count = 0;
     node->as.function_def.decorator_capacity = 0;
+    node->as.function_def.captures = NULL;
+    node->as.function_def.capture_count = 0;
+    node->as.function_def.capture_capacity = 0;
     return node;
 }
 
@@ -290,6 +295,7 @@ void ast_function_def_add_param(ASTNode* func_def, const char* param_name,
     }
     f->params[f->param_count].name = strdup(param_name);
     f->params[f->param_count].type_annotation = type_annotation;
+    f->params[f->param_count].owned = 0;
     f->param_count++;
 }
 ASTNode* ast_lambda(ASTNode* body, int line, int column) {
@@ -299,6 +305,9 @@ ASTNode* ast_lambda(ASTNode* body, int line, int column) {
     node->as.lambda.param_count = 0;
     node->as.lambda.param_capacity = 0;
     node->as.lambda.body = body;
+    node->as.lambda.captures = NULL;
+    node->as.lambda.capture_count = 0;
+    node->as.lambda.capture_capacity = 0;
     return node;
 }
 
@@ -373,6 +382,66 @@ void ast_class_def_add_decorator(ASTNode* class_def, ASTNode* decorator) {
     c->decorators[c->decorator_count++] = decorator;
 }
 
+// ===== Captures =====
+
+static ASTCapture** capture_list(ASTNode* func, int** count, int** capacity) {
+    if (!func) return NULL;
+    if (func->type == AST_FUNCTION_DEF) {
+        *count = &func->as.function_def.capture_count;
+        *capacity = &func->as.function_def.capture_capacity;
+        return &func->as.function_def.captures;
+    }
+    if (func->type == AST_LAMBDA) {
+        *count = &func->as.lambda.capture_count;
+        *capacity = &func->as.lambda.capture_capacity;
+        return &func->as.lambda.captures;
+    }
+    return NULL;
+}
+
+void ast_add_capture(ASTNode* func, const char* name, int mutated) {
+    int* count;
+    int* capacity;
+    ASTCapture** list = capture_list(func, &count, &capacity);
+    if (!list || !name) return;
+    int existing = ast_find_capture(func, name);
+    if (existing >= 0) {
+        if (mutated) (*list)[existing].mutated = 1;
+        return;
+    }
+    if (*count >= *capacity) {
+        int new_cap = *capacity == 0 ? 4 : *capacity * 2;
+        *list = (ASTCapture*)realloc(*list, sizeof(ASTCapture) * new_cap);
+        *capacity = new_cap;
+    }
+    (*list)[*count].name = strdup(name);
+    (*list)[*count].mutated = mutated ? 1 : 0;
+    (*count)++;
+}
+
+const ASTCapture* ast_captures(const ASTNode* func, int* count) {
+    *count = 0;
+    if (!func) return NULL;
+    if (func->type == AST_FUNCTION_DEF) {
+        *count = func->as.function_def.capture_count;
+        return func->as.function_def.captures;
+    }
+    if (func->type == AST_LAMBDA) {
+        *count = func->as.lambda.capture_count;
+        return func->as.lambda.captures;
+    }
+    return NULL;
+}
+
+int ast_find_capture(const ASTNode* func, const char* name) {
+    int count;
+    const ASTCapture* captures = ast_captures(func, &count);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(captures[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
 // ===== Module =====
 
 ASTNode* ast_module(int line, int column) {
@@ -509,6 +578,10 @@ void ast_destroy(ASTNode* node) {
                 ast_destroy(node->as.function_def.decorators[i]);
             }
             free(node->as.function_def.decorators);
+            for (int i = 0; i < node->as.function_def.capture_count; i++) {
+                free(node->as.function_def.captures[i].name);
+            }
+            free(node->as.function_def.captures);
             break;
       case AST_LAMBDA:
           for (int i = 0; i < node->as.lambda.param_count; i++) {
@@ -516,6 +589,10 @@ void ast_destroy(ASTNode* node) {
           }
           free(node->as.lambda.param_names);
           ast_destroy(node->as.lambda.body);
+          for (int i = 0; i < node->as.lambda.capture_count; i++) {
+              free(node->as.lambda.captures[i].name);
+          }
+          free(node->as.lambda.captures);
           break;
       case AST_TERNARY:
         ast_destroy(node->as.ternary.then_expr);
@@ -587,6 +664,18 @@ static void print_indent(int indent) {
     for (int i = 0; i < indent; i++) printf("  ");
 }
 
+static void print_captures(const ASTNode* func, int indent) {
+    int count;
+    const ASTCapture* captures = ast_captures(func, &count);
+    if (count == 0) return;
+    print_indent(indent);
+    printf("Captures(%d):", count);
+    for (int i = 0; i < count; i++) {
+        printf(" %s%s", captures[i].name, captures[i].mutated ? " (cell)" : "");
+    }
+    printf("\n");
+}
+
 void ast_print(ASTNode* node, int indent) {
     if (!node) {
         print_indent(indent);
@@ -777,7 +866,8 @@ void ast_print(ASTNode* node, int indent) {
             printf("Params(%d):\n", node->as.function_def.param_count);
             for (int i = 0; i < node->as.function_def.param_count; i++) {
                 print_indent(indent + 2);
-                printf("Param(%s)\n", node->as.function_def.params[i].name);
+                printf("Param(%s%s)\n", node->as.function_def.params[i].name,
+                       node->as.function_def.params[i].owned ? ", owned" : "");
                 if (node->as.function_def.params[i].type_annotation) {
                     print_indent(indent + 3);
                     printf("Type:\n");
@@ -790,6 +880,7 @@ void ast_print(ASTNode* node, int indent) {
                 printf("ReturnType:\n");
                 ast_print(node->as.function_def.return_type, indent + 2);
             }
+            print_captures(node, indent + 1);
             print_indent(indent + 1);
             printf("Body:\n");
             ast_print(node->as.function_def.body, indent + 2);
@@ -802,6 +893,7 @@ void ast_print(ASTNode* node, int indent) {
               print_indent(indent + 2);
               printf("Param(%s)\n", node->as.lambda.param_names[i]);
           }
+          print_captures(node, indent + 1);
           print_indent(indent + 1);
           printf("Body:\n");
           ast_print(node->as.lambda.body, indent + 2);
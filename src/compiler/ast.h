@@ -5,6 +5,7 @@
 #include "token.h"
 
 typedef struct ASTNode ASTNode;
+struct Type;
 
 typedef enum {
     // Expressions
@@ -165,8 +166,16 @@ typedef struct {
 typedef struct {
     char* name;
     ASTNode* type_annotation;
+    int owned;           // Declared 'owned': the callee takes the caller's reference
 } ASTParam;
 
+// A name a function or lambda reads from an enclosing function. Read-only
+// captures are copied into the closure record; mutated ones share a cell.
+typedef struct {
+    char* name;
+    int mutated;         // Rebound after the closure may have been created
+} ASTCapture;
+
 typedef struct {
     char* name;
     ASTParam* params;
@@ -177,6 +186,9 @@ typedef struct {
     ASTNode** decorators;        // Dynamic array of decorator expressions
     int decorator_count;
     int decorator_capacity;
+    ASTCapture* captures;        // Free variables, filled in by the analyzer
+    int capture_count;
+    int capture_capacity;
 } ASTFunctionDef;
 
 typedef struct {
@@ -184,6 +196,9 @@ typedef struct {
     int param_count;
     int param_capacity;
     ASTNode* body;       // Single expression (lambdas are expression-bodied)
+    ASTCapture* captures;        // Free variables, filled in by the analyzer
+    int capture_count;
+    int capture_capacity;
 } ASTLambda;
 
 // Ternary conditional expression: then_expr if condition else else_expr
@@ -215,12 +230,25 @@ typedef struct {
     int capacity;
 } ASTModule;
 
+// === Analysis annotations ===
+//
+// Semantic passes record per-node decisions for the backend in
+// ASTNode.flags. Constructors zero the field; the parser never sets it.
+#define AST_FLAG_ARENA_ALLOC    0x0001  // Allocation stays in the enclosing @arena
+#define AST_FLAG_HEAP_PROMOTED  0x0002  // Escapes its @arena; allocate on the refcounted heap
+#define AST_FLAG_STACK_ALLOC    0x0004  // Never leaves its function; allocate in the frame
+#define AST_FLAG_PARALLEL_LOOP  0x0008  // For loop with independent iterations; run in chunks
+#define AST_FLAG_CAPTURES       0x0010  // Function or lambda whose capture list is computed
+#define AST_FLAG_SELF_CLOSURE   0x0020  // Nested def reading its own name as the running closure
+
 // === The tagged union ===
 
 struct ASTNode {
     ASTNodeType type;
     int line;
     int column;
+    unsigned int flags;  // AST_FLAG_* annotations from semantic passes
+    struct Type* inferred_type;  // Set by the type checker; owned by its TypeTable
     union {
         ASTLiteralInt literal_int;
         ASTLiteralFloat literal_float;
@@ -315,6 +343,12 @@ void ast_class_def_add_base(ASTNode* class_def, const char* base_name,
 void ast_function_def_add_decorator(ASTNode* func_def, ASTNode* decorator);
 void ast_class_def_add_decorator(ASTNode* class_def, ASTNode* decorator);
 
+// Capture lists of functions and lambdas. Adding a name already captured
+// only upgrades it to mutated; lookup returns the capture's index or -1.
+void ast_add_capture(ASTNode* func, const char* name, int mutated);
+int ast_find_capture(const ASTNode* func, const char* name);
+const ASTCapture* ast_captures(const ASTNode* func, int* count);
+
 // === Module ===
 
 ASTNode* ast_module(int line, int column);
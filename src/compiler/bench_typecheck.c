@@ -0,0 +1,130 @@
+// bench_typecheck.c - Type checker time on a large module
+//
+// Run with `make bench`. Generates a module of about 50k lines of
+// annotated functions, each with loops, locals joined across branches,
+// list subscripts, calls to the previous function and a lambda, then
+// times the front end in stages: lexing and parsing, the semantic walk
+// (name resolution, escape and parallel analyses) with type checking
+// off, and typecheck_module on its own over the analyzed tree.
+#include "lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include "typecheck.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TARGET_LINES 50000
+#define LINES_PER_FUNCTION 14
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// One function, LINES_PER_FUNCTION lines long
+static int append_function(char* out, int i) {
+    if (i == 0) {
+        return sprintf(out,
+            "def f0(xs: List[int], n: int) -> float:\n"
+            "    return 0.5\n"
+            "\n\n\n\n\n\n\n\n\n\n\n\n");
+    }
+    return sprintf(out,
+        "def f%d(xs: List[int], n: int) -> float:\n"
+        "    total = 0\n"
+        "    count = n\n"
+        "    for x in xs:\n"
+        "        if x > count:\n"
+        "            total = total + x * 2\n"
+        "        else:\n"
+        "            total = total + x / 3\n"
+        "    first = xs[0] + xs[n - 1]\n"
+        "    label = \"f%d\"\n"
+        "    scale = k => k * first\n"
+        "    prev = f%d(xs, first)\n"
+        "    count += 1\n"
+        "    return total + prev\n",
+        i, i, i - 1);
+}
+
+static ASTNode* parse(const char* source) {
+    Lexer* lexer = lexer_create(source);
+    Token** tokens = NULL;
+    int token_count = 0;
+    int token_capacity = 0;
+    Token* tok;
+    do {
+        tok = lexer_next_token(lexer);
+        if (!tok) break;
+        if (token_count >= token_capacity) {
+            token_capacity = token_capacity == 0 ? 1024 : token_capacity * 2;
+            tokens = (Token**)realloc(tokens, sizeof(Token*) * token_capacity);
+        }
+        tokens[token_count++] = tok;
+    } while (tok->type != TOKEN_EOF);
+
+    Parser* parser = parser_create(tokens, token_count);
+    ASTNode* module = parser_parse_module(parser);
+    if (module && parser->had_error) {
+        printf("  parse failed: %s\n", parser->error_message);
+        ast_destroy(module);
+        module = NULL;
+    }
+    parser_destroy(parser);
+    for (int i = 0; i < token_count; i++) token_destroy(tokens[i]);
+    free(tokens);
+    lexer_destroy(lexer);
+    return module;
+}
+
+int main(void) {
+    printf("=== RHelix Type Checker Benchmark ===\n\n");
+
+    int functions = TARGET_LINES / LINES_PER_FUNCTION;
+    char* source = (char*)malloc((size_t)functions * 1024);
+    size_t length = 0;
+    for (int i = 0; i < functions; i++) length += append_function(source + length, i);
+    int lines = 0;
+    for (size_t i = 0; i < length; i++) lines += source[i] == '\n';
+    printf("Module: %d functions, %d lines, %zu bytes\n", functions, lines, length);
+
+    double start = now_seconds();
+    ASTNode* module = parse(source);
+    double parse_time = now_seconds() - start;
+    if (!module) return 1;
+
+    SemanticAnalyzer* sem = semantic_create();
+    sem->check_types = false;
+    start = now_seconds();
+    bool ok = semantic_analyze(sem, module);
+    double walk_time = now_seconds() - start;
+    if (!ok) {
+        printf("  semantic analysis failed\n");
+        return 1;
+    }
+
+    start = now_seconds();
+    typecheck_module(sem, module);
+    double check_time = now_seconds() - start;
+    if (sem->had_error) {
+        printf("  type checking reported %d errors\n", sem->error_count);
+        return 1;
+    }
+
+    printf("  %-34s %9.1f ms\n", "lex + parse", parse_time * 1e3);
+    printf("  %-34s %9.1f ms\n", "semantic walk (types off)", walk_time * 1e3);
+    printf("  %-34s %9.1f ms %9.0f lines/ms\n", "type checking", check_time * 1e3,
+           lines / (check_time * 1e3));
+    printf("  Inferred %d of %d expressions (%.1f%%), %d interned types\n\n",
+           sem->typed_expression_count, sem->expression_count,
+           100.0 * sem->typed_expression_count / sem->expression_count,
+           type_table_count(sem->types));
+
+    semantic_destroy(sem);
+    ast_destroy(module);
+    free(source);
+    return 0;
+}
@@ -0,0 +1,850 @@
+// escape.c - Intraprocedural escape analysis for RHelix
+//
+// See escape.h for the model. The walk below is a straightforward abstract
+// interpretation over the AST: expressions evaluate to the set of sites
+// they may point to, statements update the per-name sets and the per-site
+// "contents" sets, and escaping flows tag sites with EscapeKind bits. The
+// whole body is re-walked until nothing grows, then escape bits are pushed
+// from containers to their contents (a list that escapes takes everything
+// stored in it along).
+
+#include "escape.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Safety net for the fixed-point loop. The lattice is finite (sites x
+// names) so the loop always terminates; this only bounds pathological
+// inputs.
+#define ESCAPE_MAX_ITERATIONS 64
+
+// === Site sets ===
+
+static bool set_contains(const SiteSet* set, int id) {
+    for (int i = 0; i < set->count; i++) {
+        if (set->ids[i] == id) return true;
+    }
+    return false;
+}
+
+// Returns true if 'id' was not already present.
+static bool set_add(SiteSet* set, int id) {
+    if (set_contains(set, id)) return false;
+    if (set->count >= set->capacity) {
+        int new_cap = set->capacity == 0 ? 4 : set->capacity * 2;
+        int* ids = (int*)realloc(set->ids, sizeof(int) * new_cap);
+        if (!ids) return false;
+        set->ids = ids;
+        set->capacity = new_cap;
+    }
+    set->ids[set->count++] = id;
+    return true;
+}
+
+// dst |= src. Returns true if dst grew.
+static bool set_union(SiteSet* dst, const SiteSet* src) {
+    bool grew = false;
+    if (src->external && !dst->external) {
+        dst->external = true;
+        grew = true;
+    }
+    for (int i = 0; i < src->count; i++) {
+        if (set_add(dst, src->ids[i])) grew = true;
+    }
+    return grew;
+}
+
+static void set_free(SiteSet* set) {
+    free(set->ids);
+    set->ids = NULL;
+    set->count = 0;
+    set->capacity = 0;
+    set->external = false;
+}
+
+// === Sites and variables ===
+
+// Return the index of the site for 'node', creating it on first sight.
+// Sites are keyed by node so repeated walks reuse the same records.
+static int site_intern(EscapeInfo* info, ASTNode* node, SiteKind kind) {
+    for (int i = 0; i < info->site_count; i++) {
+        if (info->sites[i].node == node) return i;
+    }
+    if (info->site_count >= info->site_capacity) {
+        int new_cap = info->site_capacity == 0 ? 8 : info->site_capacity * 2;
+        EscapeSite* sites = (EscapeSite*)realloc(info->sites,
+                                                 sizeof(EscapeSite) * new_cap);
+        if (!sites) return -1;
+        info->sites = sites;
+        info->site_capacity = new_cap;
+    }
+    EscapeSite* site = &info->sites[info->site_count];
+    memset(site, 0, sizeof(EscapeSite));
+    site->node = node;
+    site->kind = kind;
+    site->loop_depth = info->loop_depth;
+    info->changed = true;
+    return info->site_count++;
+}
+
+static EscapeVar* var_lookup(EscapeInfo* info, const char* name) {
+    if (!name) return NULL;
+    for (int i = 0; i < info->var_count; i++) {
+        if (strcmp(info->vars[i].name, name) == 0) return &info->vars[i];
+    }
+    return NULL;
+}
+
+static EscapeVar* var_get(EscapeInfo* info, const char* name) {
+    EscapeVar* var = var_lookup(info, name);
+    if (var || !name) return var;
+    if (info->var_count >= info->var_capacity) {
+        int new_cap = info->var_capacity == 0 ? 8 : info->var_capacity * 2;
+        EscapeVar* vars = (EscapeVar*)realloc(info->vars,
+                                              sizeof(EscapeVar) * new_cap);
+        if (!vars) return NULL;
+        info->vars = vars;
+        info->var_capacity = new_cap;
+    }
+    var = &info->vars[info->var_count++];
+    memset(var, 0, sizeof(EscapeVar));
+    var->name = name;
+    return var;
+}
+
+// Bind 'values' into local 'name' (union - the analysis is flow-insensitive).
+static void var_assign(EscapeInfo* info, const char* name, const SiteSet* values) {
+    EscapeVar* var = var_get(info, name);
+    if (var && set_union(&var->sites, values)) info->changed = true;
+}
+
+// Tag every site in 'values' with 'kind'.
+static void mark_escape(EscapeInfo* info, const SiteSet* values, unsigned kind,
+                        ASTNode* where) {
+    for (int i = 0; i < values->count; i++) {
+        EscapeSite* site = &info->sites[values->ids[i]];
+        if ((site->escapes & kind) != kind) {
+            site->escapes |= kind;
+            if (!site->escape_node) site->escape_node = where;
+            info->changed = true;
+        }
+    }
+}
+
+// Model 'container.field = values' / 'container[i] = values'. Values
+// stored into a local site become its contents; values stored into
+// anything external escape.
+static void store_into(EscapeInfo* info, const SiteSet* containers,
+                       const SiteSet* values, ASTNode* where) {
+    if (containers->external) {
+        mark_escape(info, values, ESCAPE_STORE, where);
+    }
+    for (int i = 0; i < containers->count; i++) {
+        if (set_union(&info->sites[containers->ids[i]].contents, values)) {
+            info->changed = true;
+        }
+    }
+}
+
+// Model 'container.field' / 'container[i]' as a load of its contents.
+static void load_from(EscapeInfo* info, const SiteSet* containers, SiteSet* out) {
+    if (containers->external) out->external = true;
+    for (int i = 0; i < containers->count; i++) {
+        set_union(out, &info->sites[containers->ids[i]].contents);
+    }
+}
+
+// Builtin container methods that store their arguments into the receiver.
+static bool is_mutator_method(const char* name) {
+    static const char* mutators[] = {
+        "append", "extend", "insert", "add", "update", "setdefault",
+        "push", "put", NULL
+    };
+    if (!name) return false;
+    for (int i = 0; mutators[i]; i++) {
+        if (strcmp(name, mutators[i]) == 0) return true;
+    }
+    return false;
+}
+
+// Builtin container methods. Called on a literal of this function they
+// keep no reference to it, and at most hand out what it holds.
+static bool is_container_method(const char* name) {
+    static const char* methods[] = {
+        "pop", "get", "copy", "keys", "values", "items", "index", "count",
+        "remove", "clear", "reverse", "sort", NULL
+    };
+    if (!name) return false;
+    if (is_mutator_method(name)) return true;
+    for (int i = 0; methods[i]; i++) {
+        if (strcmp(name, methods[i]) == 0) return true;
+    }
+    return false;
+}
+
+// Is 'callee' the builtin 'name' refers to? Only while no local of the
+// function and no definition the client knows about shadows it.
+static bool is_builtin_callee(EscapeInfo* info, ASTNode* callee, const char* const* names) {
+    if (!callee || callee->type != AST_IDENTIFIER) return false;
+    const char* name = callee->as.identifier.name;
+    bool listed = false;
+    for (int i = 0; names[i] && !listed; i++) listed = strcmp(name, names[i]) == 0;
+    if (!listed || var_lookup(info, name)) return false;
+    return !info->is_defined || !info->is_defined(info->resolver, name);
+}
+
+// Builtins known to return a scalar, so their call is not an allocation.
+static bool returns_scalar(EscapeInfo* info, ASTNode* callee) {
+    static const char* scalars[] = { "len", "int", "float", "bool", NULL };
+    return is_builtin_callee(info, callee, scalars);
+}
+
+// Builtins that only read their arguments during the call and return
+// something new, so passing a value to them is not an ESCAPE_ARG. 'min'
+// and 'max' are not among them: they return one of their arguments.
+static bool borrows_arguments(EscapeInfo* info, ASTNode* callee) {
+    static const char* borrowers[] = {
+        "len", "print", "sum", "any", "all", "sorted",
+        "str", "int", "float", "bool", "abs", NULL
+    };
+    return is_builtin_callee(info, callee, borrowers);
+}
+
+// Borrowing builtins whose result holds their argument's elements
+static bool returns_elements(EscapeInfo* info, ASTNode* callee) {
+    static const char* carriers[] = { "sorted", "sum", NULL };
+    return is_builtin_callee(info, callee, carriers);
+}
+
+// === Closure captures ===
+
+// Names bound by the closure being scanned (and any closures nested in
+// it). References to these are not captures of the analyzed function.
+typedef struct {
+    const char** names;
+    int count;
+    int capacity;
+} BoundNames;
+
+static void bound_push(BoundNames* bound, const char* name) {
+    if (!name) return;
+    if (bound->count >= bound->capacity) {
+        int new_cap = bound->capacity == 0 ? 8 : bound->capacity * 2;
+        const char** names = (const char**)realloc(bound->names,
+                                                   sizeof(char*) * new_cap);
+        if (!names) return;
+        bound->names = names;
+        bound->capacity = new_cap;
+    }
+    bound->names[bound->count++] = name;
+}
+
+static bool bound_contains(BoundNames* bound, const char* name) {
+    for (int i = bound->count - 1; i >= 0; i--) {
+        if (strcmp(bound->names[i], name) == 0) return true;
+    }
+    return false;
+}
+
+// Walk a closure body and treat every reference to an outer local as a
+// capture: the local's sites escape and become contents of the closure.
+static void capture_walk(EscapeInfo* info, ASTNode* node, BoundNames* bound,
+                         int closure_id, ASTNode* where) {
+    if (!node) return;
+
+    switch (node->type) {
+        case AST_LITERAL_INT:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_BOOL:
+        case AST_LITERAL_NONE:
+        case AST_PASS:
+        case AST_BREAK:
+        case AST_CONTINUE:
+            break;
+
+        case AST_IDENTIFIER: {
+            const char* name = node->as.identifier.name;
+            if (!name || bound_contains(bound, name)) break;
+            EscapeVar* var = var_lookup(info, name);
+            if (!var) break;
+            mark_escape(info, &var->sites, ESCAPE_CAPTURE, where);
+            if (set_union(&info->sites[closure_id].contents, &var->sites)) {
+                info->changed = true;
+            }
+            break;
+        }
+
+        case AST_BINARY:
+            capture_walk(info, node->as.binary.left, bound, closure_id, where);
+            capture_walk(info, node->as.binary.right, bound, closure_id, where);
+            break;
+        case AST_UNARY:
+            capture_walk(info, node->as.unary.operand, bound, closure_id, where);
+            break;
+        case AST_GROUPING:
+            capture_walk(info, node->as.grouping.expression, bound, closure_id, where);
+            break;
+        case AST_CALL:
+            capture_walk(info, node->as.call.callee, bound, closure_id, where);
+            for (int i = 0; i < node->as.call.arg_count; i++) {
+                capture_walk(info, node->as.call.args[i], bound, closure_id, where);
+            }
+            break;
+        case AST_SUBSCRIPT:
+            capture_walk(info, node->as.subscript.object, bound, closure_id, where);
+            capture_walk(info, node->as.subscript.index, bound, closure_id, where);
+            break;
+        case AST_ATTRIBUTE:
+            capture_walk(info, node->as.attribute.object, bound, closure_id, where);
+            break;
+        case AST_LIST_LITERAL:
+            for (int i = 0; i < node->as.list_literal.count; i++) {
+                capture_walk(info, node->as.list_literal.elements[i],
+                             bound, closure_id, where);
+            }
+            break;
+        case AST_DICT_LITERAL:
+            for (int i = 0; i < node->as.dict_literal.count; i++) {
+                capture_walk(info, node->as.dict_literal.entries[i].key,
+                             bound, closure_id, where);
+                capture_walk(info, node->as.dict_literal.entries[i].value,
+                             bound, closure_id, where);
+            }
+            break;
+        case AST_TERNARY:
+            capture_walk(info, node->as.ternary.condition, bound, closure_id, where);
+            capture_walk(info, node->as.ternary.then_expr, bound, closure_id, where);
+            capture_walk(info, node->as.ternary.else_expr, bound, closure_id, where);
+            break;
+
+        case AST_EXPRESSION_STMT:
+            capture_walk(info, node->as.expression_stmt.expression,
+                         bound, closure_id, where);
+            break;
+        case AST_ASSIGNMENT:
+            // A plain-name target inside the closure is the closure's own
+            // local (Python scoping), so it shadows rather than captures.
+            if (node->as.assignment.target &&
+                node->as.assignment.target->type == AST_IDENTIFIER) {
+                bound_push(bound, node->as.assignment.target->as.identifier.name);
+            } else {
+                capture_walk(info, node->as.assignment.target,
+                             bound, closure_id, where);
+            }
+            capture_walk(info, node->as.assignment.value, bound, closure_id, where);
+            break;
+        case AST_AUGMENTED_ASSIGNMENT:
+            capture_walk(info, node->as.augmented_assignment.target,
+                         bound, closure_id, where);
+            capture_walk(info, node->as.augmented_assignment.value,
+                         bound, closure_id, where);
+            break;
+        case AST_RETURN:
+            capture_walk(info, node->as.ret.value, bound, closure_id, where);
+            break;
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                capture_walk(info, node->as.block.statements[i],
+                             bound, closure_id, where);
+            }
+            break;
+        case AST_IF:
+            capture_walk(info, node->as.if_stmt.condition, bound, closure_id, where);
+            capture_walk(info, node->as.if_stmt.then_block, bound, closure_id, where);
+            capture_walk(info, node->as.if_stmt.else_block, bound, closure_id, where);
+            break;
+        case AST_WHILE:
+            capture_walk(info, node->as.while_stmt.condition, bound, closure_id, where);
+            capture_walk(info, node->as.while_stmt.body, bound, closure_id, where);
+            break;
+        case AST_FOR:
+            capture_walk(info, node->as.for_stmt.iterable, bound, closure_id, where);
+            bound_push(bound, node->as.for_stmt.var_name);
+            capture_walk(info, node->as.for_stmt.body, bound, closure_id, where);
+            break;
+        case AST_WITH:
+            capture_walk(info, node->as.with_stmt.context, bound, closure_id, where);
+            bound_push(bound, node->as.with_stmt.var_name);
+            capture_walk(info, node->as.with_stmt.body, bound, closure_id, where);
+            break;
+
+        case AST_FUNCTION_DEF:
+            bound_push(bound, node->as.function_def.name);
+            for (int i = 0; i < node->as.function_def.param_count; i++) {
+                bound_push(bound, node->as.function_def.params[i].name);
+            }
+            capture_walk(info, node->as.function_def.body, bound, closure_id, where);
+            break;
+        case AST_LAMBDA:
+            for (int i = 0; i < node->as.lambda.param_count; i++) {
+                bound_push(bound, node->as.lambda.param_names[i]);
+            }
+            capture_walk(info, node->as.lambda.body, bound, closure_id, where);
+            break;
+        case AST_CLASS_DEF:
+            bound_push(bound, node->as.class_def.name);
+            capture_walk(info, node->as.class_def.body, bound, closure_id, where);
+            break;
+        case AST_MODULE:
+            break;
+    }
+}
+
+// Scan a lambda, nested def, or nested class body for captures.
+static void capture_closure(EscapeInfo* info, ASTNode* closure, int closure_id) {
+    BoundNames bound = { NULL, 0, 0 };
+    if (closure->type == AST_LAMBDA) {
+        for (int i = 0; i < closure->as.lambda.param_count; i++) {
+            bound_push(&bound, closure->as.lambda.param_names[i]);
+        }
+        capture_walk(info, closure->as.lambda.body, &bound, closure_id, closure);
+    } else if (closure->type == AST_FUNCTION_DEF) {
+        for (int i = 0; i < closure->as.function_def.param_count; i++) {
+            bound_push(&bound, closure->as.function_def.params[i].name);
+        }
+        capture_walk(info, closure->as.function_def.body, &bound, closure_id, closure);
+    } else if (closure->type == AST_CLASS_DEF) {
+        capture_walk(info, closure->as.class_def.body, &bound, closure_id, closure);
+    }
+    free(bound.names);
+}
+
+// === Expressions ===
+
+static void eval(EscapeInfo* info, ASTNode* node, SiteSet* out);
+
+// Evaluate for side effects only (the value itself is not tracked).
+static void eval_discard(EscapeInfo* info, ASTNode* node) {
+    SiteSet scratch = { NULL, 0, 0, false };
+    eval(info, node, &scratch);
+    set_free(&scratch);
+}
+
+// Does 'set' hold only list and dict literals of this function?
+static bool literal_sites(EscapeInfo* info, const SiteSet* set) {
+    if (set->external || set->count == 0) return false;
+    for (int i = 0; i < set->count; i++) {
+        SiteKind kind = info->sites[set->ids[i]].kind;
+        if (kind != SITE_LIST && kind != SITE_DICT) return false;
+    }
+    return true;
+}
+
+static void eval_call(EscapeInfo* info, ASTNode* node, SiteSet* out) {
+    ASTNode* callee = node->as.call.callee;
+    SiteSet receiver = { NULL, 0, 0, false };
+    SiteSet carried = { NULL, 0, 0, false };  // What the result may hold
+    bool mutator = false;
+
+    if (callee && callee->type == AST_ATTRIBUTE) {
+        // The receiver is passed to the method like an argument, unless it
+        // is a literal of this function and the method a builtin one,
+        // which at most returns the literal's contents.
+        eval(info, callee->as.attribute.object, &receiver);
+        mutator = is_mutator_method(callee->as.attribute.name);
+        if (is_container_method(callee->as.attribute.name) && literal_sites(info, &receiver)) {
+            load_from(info, &receiver, &carried);
+        } else {
+            mark_escape(info, &receiver, ESCAPE_ARG, node);
+        }
+    } else {
+        eval_discard(info, callee);
+    }
+
+    // A container method storing into a literal of this function is
+    // modeled by store_into; any other receiver may be an alias of
+    // something else, so the argument is handed over like to any callee.
+    bool borrowed = borrows_arguments(info, callee) || (mutator && literal_sites(info, &receiver));
+    bool carries = returns_elements(info, callee);
+    for (int i = 0; i < node->as.call.arg_count; i++) {
+        SiteSet arg = { NULL, 0, 0, false };
+        eval(info, node->as.call.args[i], &arg);
+        if (!borrowed) mark_escape(info, &arg, ESCAPE_ARG, node);
+        if (mutator) store_into(info, &receiver, &arg, node);
+        if (carries) load_from(info, &arg, &carried);
+        set_free(&arg);
+    }
+    set_free(&receiver);
+
+    if (!returns_scalar(info, callee)) {
+        int id = site_intern(info, node, SITE_CALL);
+        if (id >= 0) {
+            set_add(out, id);
+            if (set_union(&info->sites[id].contents, &carried)) info->changed = true;
+        }
+        // 'a.pop()' is one of the elements itself
+        set_union(out, &carried);
+    }
+    set_free(&carried);
+}
+
+static void eval(EscapeInfo* info, ASTNode* node, SiteSet* out) {
+    if (!node) return;
+
+    switch (node->type) {
+        case AST_LITERAL_INT:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_BOOL:
+        case AST_LITERAL_NONE:
+            break;
+
+        case AST_IDENTIFIER: {
+            EscapeVar* var = var_lookup(info, node->as.identifier.name);
+            if (var) {
+                set_union(out, &var->sites);
+            } else {
+                out->external = true;  // Global, builtin, or unknown
+            }
+            break;
+        }
+
+        case AST_BINARY:
+            if (node->as.binary.op == TOKEN_PIPELINE) {
+                // 'data |> stage' passes data to the stage like a call.
+                SiteSet data = { NULL, 0, 0, false };
+                eval(info, node->as.binary.left, &data);
+                mark_escape(info, &data, ESCAPE_ARG, node);
+                set_free(&data);
+                eval_discard(info, node->as.binary.right);
+                int id = site_intern(info, node, SITE_CALL);
+                if (id >= 0) set_add(out, id);
+            } else if (node->as.binary.op == TOKEN_AND ||
+                       node->as.binary.op == TOKEN_OR) {
+                // 'and'/'or' yield one of their operands.
+                eval(info, node->as.binary.left, out);
+                eval(info, node->as.binary.right, out);
+            } else {
+                eval_discard(info, node->as.binary.left);
+                eval_discard(info, node->as.binary.right);
+            }
+            break;
+        case AST_UNARY:
+            // 'move x' hands over x's value; '-' and 'not' yield scalars.
+            if (node->as.unary.op == TOKEN_MOVE) {
+                eval(info, node->as.unary.operand, out);
+            } else {
+                eval_discard(info, node->as.unary.operand);
+            }
+            break;
+        case AST_GROUPING:
+            eval(info, node->as.grouping.expression, out);
+            break;
+        case AST_CALL:
+            eval_call(info, node, out);
+            break;
+        case AST_SUBSCRIPT: {
+            SiteSet object = { NULL, 0, 0, false };
+            eval(info, node->as.subscript.object, &object);
+            eval_discard(info, node->as.subscript.index);
+            load_from(info, &object, out);
+            set_free(&object);
+            break;
+        }
+        case AST_ATTRIBUTE: {
+            SiteSet object = { NULL, 0, 0, false };
+            eval(info, node->as.attribute.object, &object);
+            load_from(info, &object, out);
+            set_free(&object);
+            break;
+        }
+
+        case AST_LIST_LITERAL: {
+            int id = site_intern(info, node, SITE_LIST);
+            if (id < 0) break;
+            SiteSet self = { NULL, 0, 0, false };
+            set_add(&self, id);
+            for (int i = 0; i < node->as.list_literal.count; i++) {
+                SiteSet element = { NULL, 0, 0, false };
+                eval(info, node->as.list_literal.elements[i], &element);
+                store_into(info, &self, &element, node);
+                set_free(&element);
+            }
+            set_free(&self);
+            set_add(out, id);
+            break;
+        }
+        case AST_DICT_LITERAL: {
+            int id = site_intern(info, node, SITE_DICT);
+            if (id < 0) break;
+            SiteSet self = { NULL, 0, 0, false };
+            set_add(&self, id);
+            for (int i = 0; i < node->as.dict_literal.count; i++) {
+                SiteSet entry = { NULL, 0, 0, false };
+                eval(info, node->as.dict_literal.entries[i].key, &entry);
+                eval(info, node->as.dict_literal.entries[i].value, &entry);
+                store_into(info, &self, &entry, node);
+                set_free(&entry);
+            }
+            set_free(&self);
+            set_add(out, id);
+            break;
+        }
+
+        case AST_LAMBDA: {
+            int id = site_intern(info, node, SITE_CLOSURE);
+            if (id < 0) break;
+            capture_closure(info, node, id);
+            set_add(out, id);
+            break;
+        }
+
+        case AST_TERNARY:
+            eval_discard(info, node->as.ternary.condition);
+            eval(info, node->as.ternary.then_expr, out);
+            eval(info, node->as.ternary.else_expr, out);
+            break;
+
+        // Statements never appear in expression position.
+        case AST_EXPRESSION_STMT:
+        case AST_ASSIGNMENT:
+        case AST_AUGMENTED_ASSIGNMENT:
+        case AST_RETURN:
+        case AST_PASS:
+        case AST_BREAK:
+        case AST_CONTINUE:
+        case AST_BLOCK:
+        case AST_IF:
+        case AST_WHILE:
+        case AST_FOR:
+        case AST_WITH:
+        case AST_FUNCTION_DEF:
+        case AST_CLASS_DEF:
+        case AST_MODULE:
+            break;
+    }
+}
+
+// === Statements ===
+
+// Assignment-like store of 'values' into 'target'.
+static void assign_to(EscapeInfo* info, ASTNode* target, const SiteSet* values,
+                      ASTNode* where) {
+    if (!target) return;
+    if (target->type == AST_IDENTIFIER) {
+        var_assign(info, target->as.identifier.name, values);
+    } else if (target->type == AST_ATTRIBUTE) {
+        SiteSet object = { NULL, 0, 0, false };
+        eval(info, target->as.attribute.object, &object);
+        store_into(info, &object, values, where);
+        set_free(&object);
+    } else if (target->type == AST_SUBSCRIPT) {
+        SiteSet object = { NULL, 0, 0, false };
+        eval(info, target->as.subscript.object, &object);
+        eval_discard(info, target->as.subscript.index);
+        store_into(info, &object, values, where);
+        set_free(&object);
+    }
+}
+
+static void walk(EscapeInfo* info, ASTNode* node) {
+    if (!node) return;
+
+    switch (node->type) {
+        case AST_PASS:
+        case AST_BREAK:
+        case AST_CONTINUE:
+        case AST_MODULE:
+            break;
+
+        case AST_EXPRESSION_STMT:
+            eval_discard(info, node->as.expression_stmt.expression);
+            break;
+
+        case AST_ASSIGNMENT: {
+            SiteSet value = { NULL, 0, 0, false };
+            eval(info, node->as.assignment.value, &value);
+            assign_to(info, node->as.assignment.target, &value, node);
+            set_free(&value);
+            break;
+        }
+        case AST_AUGMENTED_ASSIGNMENT: {
+            SiteSet value = { NULL, 0, 0, false };
+            eval(info, node->as.augmented_assignment.value, &value);
+            assign_to(info, node->as.augmented_assignment.target, &value, node);
+            set_free(&value);
+            break;
+        }
+
+        case AST_RETURN: {
+            SiteSet value = { NULL, 0, 0, false };
+            eval(info, node->as.ret.value, &value);
+            mark_escape(info, &value, ESCAPE_RETURN, node);
+            set_free(&value);
+            break;
+        }
+
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                walk(info, node->as.block.statements[i]);
+            }
+            break;
+
+        case AST_IF:
+            eval_discard(info, node->as.if_stmt.condition);
+            walk(info, node->as.if_stmt.then_block);
+            walk(info, node->as.if_stmt.else_block);
+            break;
+
+        case AST_WHILE:
+            eval_discard(info, node->as.while_stmt.condition);
+            info->loop_depth++;
+            walk(info, node->as.while_stmt.body);
+            info->loop_depth--;
+            break;
+
+        case AST_FOR: {
+            SiteSet iterable = { NULL, 0, 0, false };
+            SiteSet element = { NULL, 0, 0, false };
+            eval(info, node->as.for_stmt.iterable, &iterable);
+            load_from(info, &iterable, &element);
+            var_assign(info, node->as.for_stmt.var_name, &element);
+            set_free(&iterable);
+            set_free(&element);
+            info->loop_depth++;
+            walk(info, node->as.for_stmt.body);
+            info->loop_depth--;
+            break;
+        }
+
+        case AST_WITH: {
+            SiteSet context = { NULL, 0, 0, false };
+            eval(info, node->as.with_stmt.context, &context);
+            if (node->as.with_stmt.var_name) {
+                var_assign(info, node->as.with_stmt.var_name, &context);
+            }
+            set_free(&context);
+            walk(info, node->as.with_stmt.body);
+            break;
+        }
+
+        case AST_FUNCTION_DEF:
+        case AST_CLASS_DEF: {
+            // A nested def or class is a closure bound to its name.
+            int id = site_intern(info, node, SITE_CLOSURE);
+            if (id < 0) break;
+            ASTNode** decorators = node->type == AST_FUNCTION_DEF
+                ? node->as.function_def.decorators
+                : node->as.class_def.decorators;
+            int decorator_count = node->type == AST_FUNCTION_DEF
+                ? node->as.function_def.decorator_count
+                : node->as.class_def.decorator_count;
+            for (int i = 0; i < decorator_count; i++) {
+                eval_discard(info, decorators[i]);
+            }
+            capture_closure(info, node, id);
+            SiteSet self = { NULL, 0, 0, false };
+            set_add(&self, id);
+            var_assign(info, node->type == AST_FUNCTION_DEF
+                                 ? node->as.function_def.name
+                                 : node->as.class_def.name,
+                       &self);
+            set_free(&self);
+            break;
+        }
+
+        // Bare expressions in statement position (not produced by the
+        // parser today, but harmless to evaluate).
+        case AST_LITERAL_INT:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_BOOL:
+        case AST_LITERAL_NONE:
+        case AST_IDENTIFIER:
+        case AST_BINARY:
+        case AST_UNARY:
+        case AST_GROUPING:
+        case AST_CALL:
+        case AST_SUBSCRIPT:
+        case AST_ATTRIBUTE:
+        case AST_LIST_LITERAL:
+        case AST_DICT_LITERAL:
+        case AST_LAMBDA:
+        case AST_TERNARY:
+            eval_discard(info, node);
+            break;
+    }
+}
+
+// Push escape bits from every container to everything stored in it.
+static void propagate(EscapeInfo* info) {
+    for (int i = 0; i < info->site_count; i++) {
+        EscapeSite* site = &info->sites[i];
+        if (!site->escapes) continue;
+        for (int j = 0; j < site->contents.count; j++) {
+            EscapeSite* inner = &info->sites[site->contents.ids[j]];
+            if ((inner->escapes | site->escapes) != inner->escapes) {
+                inner->escapes |= site->escapes;
+                if (!inner->escape_node) inner->escape_node = site->escape_node;
+                info->changed = true;
+            }
+        }
+    }
+}
+
+// === Public API ===
+
+EscapeInfo* escape_analyze_function(ASTNode* func_def, EscapeIsDefined is_defined,
+                                    void* resolver) {
+    if (!func_def || func_def->type != AST_FUNCTION_DEF) return NULL;
+
+    EscapeInfo* info = (EscapeInfo*)calloc(1, sizeof(EscapeInfo));
+    if (!info) return NULL;
+    info->is_defined = is_defined;
+    info->resolver = resolver;
+
+    // Parameters hold values allocated by the caller.
+    for (int i = 0; i < func_def->as.function_def.param_count; i++) {
+        EscapeVar* var = var_get(info, func_def->as.function_def.params[i].name);
+        if (var) var->sites.external = true;
+    }
+
+    int iterations = 0;
+    do {
+        info->changed = false;
+        info->loop_depth = 0;
+        walk(info, func_def->as.function_def.body);
+        propagate(info);
+    } while (info->changed && ++iterations < ESCAPE_MAX_ITERATIONS);
+
+    return info;
+}
+
+void escape_info_destroy(EscapeInfo* info) {
+    if (!info) return;
+    for (int i = 0; i < info->site_count; i++) {
+        set_free(&info->sites[i].contents);
+    }
+    for (int i = 0; i < info->var_count; i++) {
+        set_free(&info->vars[i].sites);
+    }
+    free(info->sites);
+    free(info->vars);
+    free(info);
+}
+
+EscapeSite* escape_site_for(EscapeInfo* info, ASTNode* node) {
+    if (!info || !node) return NULL;
+    for (int i = 0; i < info->site_count; i++) {
+        if (info->sites[i].node == node) return &info->sites[i];
+    }
+    return NULL;
+}
+
+const char* escape_kind_to_string(unsigned escapes) {
+    if (escapes & ESCAPE_RETURN) return "return";
+    if (escapes & ESCAPE_STORE) return "store";
+    if (escapes & ESCAPE_CAPTURE) return "capture";
+    if (escapes & ESCAPE_ARG) return "argument";
+    return "none";
+}
+
+const char* site_kind_to_string(SiteKind kind) {
+    switch (kind) {
+        case SITE_LIST: return "list";
+        case SITE_DICT: return "dict";
+        case SITE_CALL: return "call";
+        case SITE_CLOSURE: return "closure";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,105 @@
+// escape.h - Intraprocedural escape analysis for RHelix
+//
+// Tracks where values allocated inside one function body can flow. Every
+// list literal, dict literal, call result and closure is an allocation
+// site; the analysis records, per site, the ways its value may outlive the
+// function's frame. Clients differ only in which escape kinds they can
+// tolerate.
+//
+// The analysis is flow-insensitive within the function: each local name
+// maps to the union of every site ever assigned to it, and the walk is
+// repeated until those sets stop growing, so loop back-edges are covered.
+// There are no interprocedural summaries yet: a callee may return or keep
+// anything passed to it, so every argument of a call is tagged ESCAPE_ARG,
+// except for builtins known only to read their arguments (when nothing
+// shadows the name) and container
+// methods storing into a literal of the function (which make the argument
+// part of that literal's contents). The object a method is called on is
+// an argument too, unless it is such a literal and the method a builtin
+// container method. Results of those methods, and of 'sorted' and 'sum',
+// may hold the elements of the container they read.
+
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include "ast.h"
+#include <stdbool.h>
+
+typedef enum {
+    ESCAPE_NONE    = 0,
+    ESCAPE_RETURN  = 1 << 0,  // Flows to a return statement
+    ESCAPE_STORE   = 1 << 1,  // Stored into an object the function doesn't own (self.x = v)
+    ESCAPE_CAPTURE = 1 << 2,  // Captured by a lambda or nested def
+    ESCAPE_ARG     = 1 << 3   // Passed as a call argument
+} EscapeKind;
+
+typedef enum {
+    SITE_LIST,     // [...] literal
+    SITE_DICT,     // {...} literal
+    SITE_CALL,     // Result of a call or pipeline stage
+    SITE_CLOSURE   // Lambda or nested def
+} SiteKind;
+
+// A set of allocation-site indices. 'external' means the value may also
+// be something allocated outside the function (a parameter, a global, or
+// anything loaded from one).
+typedef struct {
+    int* ids;
+    int count;
+    int capacity;
+    bool external;
+} SiteSet;
+
+typedef struct {
+    ASTNode* node;          // The allocating expression
+    SiteKind kind;
+    unsigned escapes;       // EscapeKind bitmask after propagation
+    ASTNode* escape_node;   // Where the first escape was observed
+    int loop_depth;         // Loops enclosing the site within its function
+    SiteSet contents;       // Sites whose values may be stored inside this one
+} EscapeSite;
+
+// Local name -> sites it may hold.
+typedef struct {
+    const char* name;       // Borrowed from the AST
+    SiteSet sites;
+} EscapeVar;
+
+// Does the program define 'name' outside the analyzed function (a module
+// function, say)? Such a definition shadows the builtin of that name.
+typedef bool (*EscapeIsDefined)(void* resolver, const char* name);
+
+typedef struct {
+    EscapeSite* sites;
+    int site_count;
+    int site_capacity;
+
+    EscapeVar* vars;
+    int var_count;
+    int var_capacity;
+
+    EscapeIsDefined is_defined;  // May be NULL: only locals shadow builtins
+    void* resolver;
+
+    // Walk state
+    int loop_depth;
+    bool changed;           // Set whenever a set or escape mask grows
+} EscapeInfo;
+
+// Analyze the body of an AST_FUNCTION_DEF, resolving names it does not
+// bind with 'is_defined' (called with 'resolver'). Returns NULL on
+// allocation failure or if 'func_def' is not a function definition. Caller
+// owns the result and frees it with escape_info_destroy.
+EscapeInfo* escape_analyze_function(ASTNode* func_def, EscapeIsDefined is_defined,
+                                    void* resolver);
+void escape_info_destroy(EscapeInfo* info);
+
+// Find the site record for an allocating expression, or NULL if the node
+// is not an allocation site of the analyzed function.
+EscapeSite* escape_site_for(EscapeInfo* info, ASTNode* node);
+
+// Debug names. escape_kind_to_string names the lowest set bit of a mask.
+const char* escape_kind_to_string(unsigned escapes);
+const char* site_kind_to_string(SiteKind kind);
+
+#endif // ESCAPE_H
@@ -0,0 +1,832 @@
+// fold.c - Constant folding, propagation and dead branch pruning
+//
+// One walk per function (the "unit"; the module and each class body are
+// units too). Before the walk, every binding in the unit is counted:
+// assignments and augmented assignments to a name, for and with
+// variables, nested def and class names, and parameters. The walk then
+// folds statements in order, and a statement directly in the unit's body
+// that assigns a literal to a name bound only there makes that name a
+// constant for everything after it. Nested units are folded when the walk
+// reaches their definition, so they see exactly the constants established
+// before it; a name the nested unit binds itself hides the outer one.
+
+#include "fold.h"
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char* name;                  // Owned: pruning may free the node that bound it
+    int count;
+} Binding;
+
+typedef struct {
+    const char* name;
+    ASTNode* value;              // The literal assigned (owned by the assignment)
+} Constant;
+
+typedef struct Folder {
+    FoldStats* stats;
+    struct Folder* outer;        // Enclosing unit whose constants are visible, or NULL
+    bool is_class;               // A class body: its names are not visible in its methods
+    Binding* bindings;
+    int binding_count;
+    int binding_capacity;
+    Constant* constants;
+    int constant_count;
+    int constant_capacity;
+} Folder;
+
+static ASTNode* fold_expr(Folder* F, ASTNode* node);
+static void fold_stmt(Folder* F, ASTNode* node);
+static void fold_body(Folder* F, ASTNode* body);
+static void fold_unit(Folder* outer, ASTNode* node, FoldStats* stats);
+
+// ============================================================
+// Bindings and constants
+// ============================================================
+
+static void bind(Folder* F, const char* name) {
+    if (!name) return;
+    for (int i = 0; i < F->binding_count; i++) {
+        if (strcmp(F->bindings[i].name, name) == 0) {
+            F->bindings[i].count++;
+            return;
+        }
+    }
+    if (F->binding_count == F->binding_capacity) {
+        int cap = F->binding_capacity == 0 ? 16 : F->binding_capacity * 2;
+        Binding* b = (Binding*)realloc(F->bindings, sizeof(Binding) * cap);
+        if (!b) return;
+        F->bindings = b;
+        F->binding_capacity = cap;
+    }
+    F->bindings[F->binding_count].name = strdup(name);
+    if (!F->bindings[F->binding_count].name) return;
+    F->bindings[F->binding_count].count = 1;
+    F->binding_count++;
+}
+
+static int binding_count(Folder* F, const char* name) {
+    for (int i = 0; i < F->binding_count; i++) {
+        if (strcmp(F->bindings[i].name, name) == 0) return F->bindings[i].count;
+    }
+    return 0;
+}
+
+// Names bound by the statements of one unit (not inside nested units)
+static void count_bindings(Folder* F, ASTNode* node) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                count_bindings(F, node->as.block.statements[i]);
+            }
+            break;
+        case AST_MODULE:
+            for (int i = 0; i < node->as.module.count; i++) {
+                count_bindings(F, node->as.module.statements[i]);
+            }
+            break;
+        case AST_ASSIGNMENT:
+            if (node->as.assignment.target->type == AST_IDENTIFIER) {
+                bind(F, node->as.assignment.target->as.identifier.name);
+            }
+            break;
+        case AST_AUGMENTED_ASSIGNMENT:
+            if (node->as.augmented_assignment.target->type == AST_IDENTIFIER) {
+                bind(F, node->as.augmented_assignment.target->as.identifier.name);
+            }
+            break;
+        case AST_IF:
+            count_bindings(F, node->as.if_stmt.then_block);
+            count_bindings(F, node->as.if_stmt.else_block);
+            break;
+        case AST_WHILE:
+            count_bindings(F, node->as.while_stmt.body);
+            break;
+        case AST_FOR:
+            bind(F, node->as.for_stmt.var_name);
+            count_bindings(F, node->as.for_stmt.body);
+            break;
+        case AST_WITH:
+            bind(F, node->as.with_stmt.var_name);
+            count_bindings(F, node->as.with_stmt.body);
+            break;
+        case AST_FUNCTION_DEF:
+            bind(F, node->as.function_def.name);
+            break;
+        case AST_CLASS_DEF:
+            bind(F, node->as.class_def.name);
+            break;
+        default:
+            break;
+    }
+}
+
+// The literal 'name' is known to hold here, or NULL
+static ASTNode* lookup(Folder* F, const char* name) {
+    for (; F; F = F->outer) {
+        if (binding_count(F, name) == 0) continue;  // Not this unit's name
+        for (int i = 0; i < F->constant_count; i++) {
+            if (strcmp(F->constants[i].name, name) == 0) return F->constants[i].value;
+        }
+        return NULL;
+    }
+    return NULL;
+}
+
+static bool is_literal(ASTNode* node) {
+    if (!node) return false;
+    switch (node->type) {
+        case AST_LITERAL_INT:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_BOOL:
+        case AST_LITERAL_NONE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// After a statement directly in the unit's body: 'name = literal' makes
+// 'name' a constant if that is its only binding.
+static void record_constant(Folder* F, ASTNode* stmt) {
+    if (stmt->type != AST_ASSIGNMENT) return;
+    ASTNode* target = stmt->as.assignment.target;
+    if (target->type != AST_IDENTIFIER || !is_literal(stmt->as.assignment.value) ||
+        binding_count(F, target->as.identifier.name) != 1) return;
+    if (F->constant_count == F->constant_capacity) {
+        int cap = F->constant_capacity == 0 ? 8 : F->constant_capacity * 2;
+        Constant* c = (Constant*)realloc(F->constants, sizeof(Constant) * cap);
+        if (!c) return;
+        F->constants = c;
+        F->constant_capacity = cap;
+    }
+    F->constants[F->constant_count].name = target->as.identifier.name;
+    F->constants[F->constant_count].value = stmt->as.assignment.value;
+    F->constant_count++;
+}
+
+// ============================================================
+// Literals
+// ============================================================
+
+static ASTNode* copy_literal(ASTNode* lit, ASTNode* at) {
+    ASTNode* n = NULL;
+    switch (lit->type) {
+        case AST_LITERAL_INT:
+            n = ast_literal_int(lit->as.literal_int.value, at->line, at->column);
+            break;
+        case AST_LITERAL_FLOAT:
+            n = ast_literal_float(lit->as.literal_float.value, at->line, at->column);
+            break;
+        case AST_LITERAL_STRING:
+            n = ast_literal_string(lit->as.literal_string.value, at->line, at->column);
+            break;
+        case AST_LITERAL_BOOL:
+            n = ast_literal_bool(lit->as.literal_bool.value, at->line, at->column);
+            break;
+        default:
+            n = ast_literal_none(at->line, at->column);
+            break;
+    }
+    if (n) n->inferred_type = lit->inferred_type;
+    return n;
+}
+
+// Replace 'old' by 'lit' (a fresh literal, or NULL if allocation failed,
+// in which case 'old' stays)
+static ASTNode* replace(Folder* F, ASTNode* old, ASTNode* lit) {
+    if (!lit) return old;
+    lit->inferred_type = old->inferred_type;
+    ast_destroy(old);
+    F->stats->folded++;
+    return lit;
+}
+
+static bool truthy(ASTNode* lit) {
+    switch (lit->type) {
+        case AST_LITERAL_INT: return lit->as.literal_int.value != 0;
+        case AST_LITERAL_FLOAT: return lit->as.literal_float.value != 0.0;
+        case AST_LITERAL_STRING:
+            return lit->as.literal_string.value && lit->as.literal_string.value[0];
+        case AST_LITERAL_BOOL: return lit->as.literal_bool.value != 0;
+        default: return false;
+    }
+}
+
+// Bools are not numbers to the runtime's arithmetic
+static bool is_number(ASTNode* lit) {
+    return lit->type == AST_LITERAL_INT || lit->type == AST_LITERAL_FLOAT;
+}
+
+static double as_double(ASTNode* lit) {
+    return lit->type == AST_LITERAL_INT ? (double)lit->as.literal_int.value
+                                        : lit->as.literal_float.value;
+}
+
+static bool compare_doubles(TokenType op, double a, double b) {
+    switch (op) {
+        case TOKEN_LESS: return a < b;
+        case TOKEN_GREATER: return a > b;
+        case TOKEN_LESS_EQUALS: return a <= b;
+        case TOKEN_GREATER_EQUALS: return a >= b;
+        case TOKEN_EQUALS_EQUALS: return a == b;
+        default: return a != b;
+    }
+}
+
+static bool compare_ints(TokenType op, long a, long b) {
+    switch (op) {
+        case TOKEN_LESS: return a < b;
+        case TOKEN_GREATER: return a > b;
+        case TOKEN_LESS_EQUALS: return a <= b;
+        case TOKEN_GREATER_EQUALS: return a >= b;
+        case TOKEN_EQUALS_EQUALS: return a == b;
+        default: return a != b;
+    }
+}
+
+// 'a == b' for two literals, as value_equals decides it. False if the
+// runtime paths disagree (a bool against a number), so it stays unfolded.
+static bool literals_equal(ASTNode* a, ASTNode* b, bool* equal) {
+    if (is_number(a) && is_number(b)) {
+        *equal = a->type == AST_LITERAL_INT && b->type == AST_LITERAL_INT
+               ? a->as.literal_int.value == b->as.literal_int.value
+               : as_double(a) == as_double(b);
+        return true;
+    }
+    if ((a->type == AST_LITERAL_BOOL && is_number(b)) ||
+        (b->type == AST_LITERAL_BOOL && is_number(a))) return false;
+    if (a->type != b->type) {
+        *equal = false;
+        return true;
+    }
+    switch (a->type) {
+        case AST_LITERAL_STRING:
+            *equal = strcmp(a->as.literal_string.value ? a->as.literal_string.value : "",
+                            b->as.literal_string.value ? b->as.literal_string.value : "") == 0;
+            return true;
+        case AST_LITERAL_BOOL:
+            *equal = a->as.literal_bool.value == b->as.literal_bool.value;
+            return true;
+        default:
+            *equal = true;  // None == None
+            return true;
+    }
+}
+
+static long floor_mod(long a, long b) {
+    long r = a % b;
+    return (r != 0 && ((r < 0) != (b < 0))) ? r + b : r;
+}
+
+// The literal 'a op b' computes, or NULL if it is not folded
+static ASTNode* fold_arithmetic(TokenType op, ASTNode* a, ASTNode* b, ASTNode* at) {
+    switch (op) {
+        case TOKEN_EQUALS_EQUALS:
+        case TOKEN_NOT_EQUALS: {
+            bool equal;
+            if (!literals_equal(a, b, &equal)) return NULL;
+            return ast_literal_bool(op == TOKEN_EQUALS_EQUALS ? equal : !equal,
+                                    at->line, at->column);
+        }
+        case TOKEN_LESS:
+        case TOKEN_GREATER:
+        case TOKEN_LESS_EQUALS:
+        case TOKEN_GREATER_EQUALS:
+            if (!is_number(a) || !is_number(b)) return NULL;
+            if (a->type == AST_LITERAL_INT && b->type == AST_LITERAL_INT) {
+                return ast_literal_bool(compare_ints(op, a->as.literal_int.value,
+                                                     b->as.literal_int.value),
+                                        at->line, at->column);
+            }
+            return ast_literal_bool(compare_doubles(op, as_double(a), as_double(b)),
+                                    at->line, at->column);
+        case TOKEN_PLUS:
+        case TOKEN_MINUS:
+        case TOKEN_STAR:
+        case TOKEN_SLASH:
+        case TOKEN_PERCENT:
+            break;
+        default:
+            return NULL;
+    }
+    if (!is_number(a) || !is_number(b)) return NULL;
+
+    if (a->type == AST_LITERAL_INT && b->type == AST_LITERAL_INT && op != TOKEN_SLASH) {
+        long x = a->as.literal_int.value, y = b->as.literal_int.value, r;
+        bool overflow = false;
+        switch (op) {
+            case TOKEN_PLUS: overflow = __builtin_add_overflow(x, y, &r); break;
+            case TOKEN_MINUS: overflow = __builtin_sub_overflow(x, y, &r); break;
+            case TOKEN_STAR: overflow = __builtin_mul_overflow(x, y, &r); break;
+            default:
+                if (y == 0 || (x == LONG_MIN && y == -1)) return NULL;
+                r = floor_mod(x, y);
+                break;
+        }
+        return overflow ? NULL : ast_literal_int(r, at->line, at->column);
+    }
+
+    double x = as_double(a), y = as_double(b), r;
+    switch (op) {
+        case TOKEN_PLUS: r = x + y; break;
+        case TOKEN_MINUS: r = x - y; break;
+        case TOKEN_STAR: r = x * y; break;
+        case TOKEN_SLASH:
+            if (y == 0) return NULL;
+            r = x / y;
+            break;
+        default:
+            if (y == 0) return NULL;
+            r = fmod(x, y);
+            if (r != 0 && ((r < 0) != (y < 0))) r += y;
+            break;
+    }
+    // A literal the source could not spell is left to the runtime
+    return isfinite(r) ? ast_literal_float(r, at->line, at->column) : NULL;
+}
+
+// ============================================================
+// Expressions
+// ============================================================
+
+// Detach 'child' from its parent, destroying the parent
+static ASTNode* keep_child(Folder* F, ASTNode* parent, ASTNode** child) {
+    ASTNode* kept = *child;
+    *child = NULL;
+    ast_destroy(parent);
+    F->stats->folded++;
+    return kept;
+}
+
+static ASTNode* fold_binary(Folder* F, ASTNode* node) {
+    TokenType op = node->as.binary.op;
+    node->as.binary.left = fold_expr(F, node->as.binary.left);
+    ASTNode* left = node->as.binary.left;
+
+    if (op == TOKEN_AND || op == TOKEN_OR) {
+        // Only a constant left operand decides: the right one runs or not
+        if (is_literal(left)) {
+            bool taken = truthy(left) == (op == TOKEN_AND);
+            if (!taken) return keep_child(F, node, &node->as.binary.left);
+            node->as.binary.right = fold_expr(F, node->as.binary.right);
+            return keep_child(F, node, &node->as.binary.right);
+        }
+        node->as.binary.right = fold_expr(F, node->as.binary.right);
+        return node;
+    }
+
+    node->as.binary.right = fold_expr(F, node->as.binary.right);
+    ASTNode* right = node->as.binary.right;
+    if (!is_literal(left) || !is_literal(right)) return node;
+    return replace(F, node, fold_arithmetic(op, left, right, node));
+}
+
+static ASTNode* fold_unary(Folder* F, ASTNode* node) {
+    TokenType op = node->as.unary.op;
+    if (op == TOKEN_MOVE) return node;  // Names a local; nothing to fold
+    node->as.unary.operand = fold_expr(F, node->as.unary.operand);
+    ASTNode* a = node->as.unary.operand;
+    if (!is_literal(a)) return node;
+
+    if (op == TOKEN_NOT) return replace(F, node, ast_literal_bool(!truthy(a), node->line, node->column));
+    if (!is_number(a)) return node;
+    if (op == TOKEN_PLUS) return keep_child(F, node, &node->as.unary.operand);
+    if (op != TOKEN_MINUS) return node;
+    if (a->type == AST_LITERAL_FLOAT) {
+        return replace(F, node, ast_literal_float(-a->as.literal_float.value,
+                                                  node->line, node->column));
+    }
+    if (a->as.literal_int.value == LONG_MIN) return node;
+    return replace(F, node, ast_literal_int(-a->as.literal_int.value, node->line, node->column));
+}
+
+static ASTNode* fold_expr(Folder* F, ASTNode* node) {
+    if (!node) return NULL;
+    switch (node->type) {
+        case AST_IDENTIFIER: {
+            ASTNode* c = lookup(F, node->as.identifier.name);
+            if (!c) return node;
+            ASTNode* lit = copy_literal(c, node);
+            if (!lit) return node;
+            ast_destroy(node);
+            F->stats->propagated++;
+            return lit;
+        }
+        case AST_BINARY:
+            return fold_binary(F, node);
+        case AST_UNARY:
+            return fold_unary(F, node);
+        case AST_GROUPING:
+            node->as.grouping.expression = fold_expr(F, node->as.grouping.expression);
+            if (!is_literal(node->as.grouping.expression)) return node;
+            return keep_child(F, node, &node->as.grouping.expression);
+        case AST_CALL:
+            // A callee is looked up, never computed; only the arguments fold
+            for (int i = 0; i < node->as.call.arg_count; i++) {
+                node->as.call.args[i] = fold_expr(F, node->as.call.args[i]);
+            }
+            if (node->as.call.callee->type != AST_IDENTIFIER) {
+                node->as.call.callee = fold_expr(F, node->as.call.callee);
+            }
+            return node;
+        case AST_SUBSCRIPT:
+            node->as.subscript.object = fold_expr(F, node->as.subscript.object);
+            node->as.subscript.index = fold_expr(F, node->as.subscript.index);
+            return node;
+        case AST_ATTRIBUTE:
+            node->as.attribute.object = fold_expr(F, node->as.attribute.object);
+            return node;
+        case AST_LIST_LITERAL:
+            for (int i = 0; i < node->as.list_literal.count; i++) {
+                node->as.list_literal.elements[i] = fold_expr(F, node->as.list_literal.elements[i]);
+            }
+            return node;
+        case AST_DICT_LITERAL:
+            for (int i = 0; i < node->as.dict_literal.count; i++) {
+                ASTDictEntry* e = &node->as.dict_literal.entries[i];
+                e->key = fold_expr(F, e->key);
+                e->value = fold_expr(F, e->value);
+            }
+            return node;
+        case AST_TERNARY:
+            node->as.ternary.condition = fold_expr(F, node->as.ternary.condition);
+            if (is_literal(node->as.ternary.condition)) {
+                ASTNode** arm = truthy(node->as.ternary.condition) ? &node->as.ternary.then_expr
+                                                                   : &node->as.ternary.else_expr;
+                *arm = fold_expr(F, *arm);
+                return keep_child(F, node, arm);
+            }
+            node->as.ternary.then_expr = fold_expr(F, node->as.ternary.then_expr);
+            node->as.ternary.else_expr = fold_expr(F, node->as.ternary.else_expr);
+            return node;
+        case AST_LAMBDA:
+            fold_unit(F, node, F->stats);
+            return node;
+        default:
+            return node;
+    }
+}
+
+// ============================================================
+// Statements
+// ============================================================
+
+// The object of a store is where the store goes, so it is never replaced
+// by a constant; its index and the object's own subexpressions still fold.
+static void fold_target(Folder* F, ASTNode* target) {
+    switch (target->type) {
+        case AST_SUBSCRIPT:
+            if (target->as.subscript.object->type != AST_IDENTIFIER) {
+                target->as.subscript.object = fold_expr(F, target->as.subscript.object);
+            }
+            target->as.subscript.index = fold_expr(F, target->as.subscript.index);
+            break;
+        case AST_ATTRIBUTE:
+            if (target->as.attribute.object->type != AST_IDENTIFIER) {
+                target->as.attribute.object = fold_expr(F, target->as.attribute.object);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static bool splice(ASTNode*** stmts, int* count, int* capacity, int at,
+                   ASTNode** items, int n) {
+    if (*count - 1 + n > *capacity) {
+        int cap = *count - 1 + n;
+        ASTNode** grown = (ASTNode**)realloc(*stmts, sizeof(ASTNode*) * cap);
+        if (!grown) return false;
+        *stmts = grown;
+        *capacity = cap;
+    }
+    memmove(&(*stmts)[at + n], &(*stmts)[at + 1], sizeof(ASTNode*) * (*count - at - 1));
+    for (int i = 0; i < n; i++) (*stmts)[at + i] = items[i];
+    *count += n - 1;
+    return true;
+}
+
+// Replace the if at 'stmts[at]' by the branch its literal condition
+// takes: a block's statements, an elif's if, or nothing.
+static bool prune_if(Folder* F, ASTNode*** stmts, int* count, int* capacity, int at) {
+    ASTNode* s = (*stmts)[at];
+    ASTNode** branch = truthy(s->as.if_stmt.condition) ? &s->as.if_stmt.then_block
+                                                       : &s->as.if_stmt.else_block;
+    ASTNode* kept = *branch;
+    ASTNode** items = &kept;
+    int n = kept ? 1 : 0;
+    if (kept && kept->type == AST_BLOCK) {
+        items = kept->as.block.statements;
+        n = kept->as.block.count;
+    }
+    if (!splice(stmts, count, capacity, at, items, n)) return false;
+    *branch = NULL;
+    if (kept && kept->type == AST_BLOCK) {
+        kept->as.block.count = 0;  // The statements moved out
+        ast_destroy(kept);
+    }
+    ast_destroy(s);
+    F->stats->pruned++;
+    return true;
+}
+
+// Fold a statement list. 'unit_body' marks the unit's own body, where
+// assignments establish constants; 'needs_statement' a body that must
+// not end up empty.
+static void fold_statements(Folder* F, ASTNode*** stmts, int* count, int* capacity,
+                            bool unit_body, bool needs_statement) {
+    int i = 0;
+    while (i < *count) {
+        ASTNode* s = (*stmts)[i];
+        if (s->type == AST_IF) {
+            s->as.if_stmt.condition = fold_expr(F, s->as.if_stmt.condition);
+            // Look again at whatever took its place
+            if (is_literal(s->as.if_stmt.condition) && prune_if(F, stmts, count, capacity, i)) {
+                continue;
+            }
+        }
+        fold_stmt(F, s);
+        if (unit_body) record_constant(F, s);
+        i++;
+    }
+    if (*count == 0 && needs_statement) {
+        ASTNode* pass = ast_pass(0, 0);
+        if (!pass) return;
+        if (*capacity == 0) {
+            ASTNode** grown = (ASTNode**)realloc(*stmts, sizeof(ASTNode*));
+            if (!grown) {
+                ast_destroy(pass);
+                return;
+            }
+            *stmts = grown;
+            *capacity = 1;
+        }
+        (*stmts)[(*count)++] = pass;
+    }
+}
+
+static void fold_body(Folder* F, ASTNode* body) {
+    if (!body) return;
+    if (body->type != AST_BLOCK) {
+        fold_stmt(F, body);
+        return;
+    }
+    fold_statements(F, &body->as.block.statements, &body->as.block.count,
+                    &body->as.block.capacity, false, true);
+}
+
+// The else of an if: a block, or the if of an elif, which is pruned the
+// same way (to its taken branch, or away)
+static void fold_else(Folder* F, ASTNode** slot) {
+    while (*slot && (*slot)->type == AST_IF) {
+        ASTNode* s = *slot;
+        s->as.if_stmt.condition = fold_expr(F, s->as.if_stmt.condition);
+        if (!is_literal(s->as.if_stmt.condition)) break;
+        ASTNode** branch = truthy(s->as.if_stmt.condition) ? &s->as.if_stmt.then_block
+                                                           : &s->as.if_stmt.else_block;
+        *slot = *branch;
+        *branch = NULL;
+        ast_destroy(s);
+        F->stats->pruned++;
+    }
+    if (!*slot) return;
+    if ((*slot)->type == AST_IF) {
+        fold_body(F, (*slot)->as.if_stmt.then_block);
+        fold_else(F, &(*slot)->as.if_stmt.else_block);
+    } else {
+        fold_body(F, *slot);
+    }
+}
+
+static void fold_stmt(Folder* F, ASTNode* node) {
+    switch (node->type) {
+        case AST_EXPRESSION_STMT:
+            node->as.expression_stmt.expression = fold_expr(F, node->as.expression_stmt.expression);
+            break;
+        case AST_ASSIGNMENT:
+            fold_target(F, node->as.assignment.target);
+            node->as.assignment.value = fold_expr(F, node->as.assignment.value);
+            break;
+        case AST_AUGMENTED_ASSIGNMENT:
+            fold_target(F, node->as.augmented_assignment.target);
+            node->as.augmented_assignment.value = fold_expr(F, node->as.augmented_assignment.value);
+            break;
+        case AST_RETURN:
+            node->as.ret.value = fold_expr(F, node->as.ret.value);
+            break;
+        case AST_IF:
+            // Condition already folded, and not constant
+            fold_body(F, node->as.if_stmt.then_block);
+            fold_else(F, &node->as.if_stmt.else_block);
+            break;
+        case AST_WHILE:
+            node->as.while_stmt.condition = fold_expr(F, node->as.while_stmt.condition);
+            fold_body(F, node->as.while_stmt.body);
+            break;
+        case AST_FOR:
+            node->as.for_stmt.iterable = fold_expr(F, node->as.for_stmt.iterable);
+            fold_body(F, node->as.for_stmt.body);
+            break;
+        case AST_WITH:
+            node->as.with_stmt.context = fold_expr(F, node->as.with_stmt.context);
+            fold_body(F, node->as.with_stmt.body);
+            break;
+        case AST_BLOCK:
+            fold_body(F, node);
+            break;
+        case AST_FUNCTION_DEF:
+        case AST_CLASS_DEF:
+            fold_unit(F, node, F->stats);
+            break;
+        default:
+            break;
+    }
+}
+
+// ============================================================
+// Captures
+// ============================================================
+
+// Does 'node' still read the enclosing function's 'name'? Nested defs
+// and lambdas read it if they capture it themselves.
+static bool reads_capture(ASTNode* node, const char* name) {
+    if (!node) return false;
+    switch (node->type) {
+        case AST_IDENTIFIER:
+            return strcmp(node->as.identifier.name, name) == 0;
+        case AST_BINARY:
+            return reads_capture(node->as.binary.left, name) ||
+                   reads_capture(node->as.binary.right, name);
+        case AST_UNARY:
+            return reads_capture(node->as.unary.operand, name);
+        case AST_GROUPING:
+            return reads_capture(node->as.grouping.expression, name);
+        case AST_CALL:
+            if (reads_capture(node->as.call.callee, name)) return true;
+            for (int i = 0; i < node->as.call.arg_count; i++) {
+                if (reads_capture(node->as.call.args[i], name)) return true;
+            }
+            return false;
+        case AST_SUBSCRIPT:
+            return reads_capture(node->as.subscript.object, name) ||
+                   reads_capture(node->as.subscript.index, name);
+        case AST_ATTRIBUTE:
+            return reads_capture(node->as.attribute.object, name);
+        case AST_LIST_LITERAL:
+            for (int i = 0; i < node->as.list_literal.count; i++) {
+                if (reads_capture(node->as.list_literal.elements[i], name)) return true;
+            }
+            return false;
+        case AST_DICT_LITERAL:
+            for (int i = 0; i < node->as.dict_literal.count; i++) {
+                if (reads_capture(node->as.dict_literal.entries[i].key, name) ||
+                    reads_capture(node->as.dict_literal.entries[i].value, name)) return true;
+            }
+            return false;
+        case AST_TERNARY:
+            return reads_capture(node->as.ternary.condition, name) ||
+                   reads_capture(node->as.ternary.then_expr, name) ||
+                   reads_capture(node->as.ternary.else_expr, name);
+        case AST_LAMBDA:
+            return ast_find_capture(node, name) >= 0;
+        case AST_FUNCTION_DEF:
+            for (int i = 0; i < node->as.function_def.decorator_count; i++) {
+                if (reads_capture(node->as.function_def.decorators[i], name)) return true;
+            }
+            return ast_find_capture(node, name) >= 0;
+        case AST_CLASS_DEF:
+            return reads_capture(node->as.class_def.body, name);
+        case AST_EXPRESSION_STMT:
+            return reads_capture(node->as.expression_stmt.expression, name);
+        case AST_ASSIGNMENT:
+            return reads_capture(node->as.assignment.target, name) ||
+                   reads_capture(node->as.assignment.value, name);
+        case AST_AUGMENTED_ASSIGNMENT:
+            return reads_capture(node->as.augmented_assignment.target, name) ||
+                   reads_capture(node->as.augmented_assignment.value, name);
+        case AST_RETURN:
+            return reads_capture(node->as.ret.value, name);
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                if (reads_capture(node->as.block.statements[i], name)) return true;
+            }
+            return false;
+        case AST_IF:
+            return reads_capture(node->as.if_stmt.condition, name) ||
+                   reads_capture(node->as.if_stmt.then_block, name) ||
+                   reads_capture(node->as.if_stmt.else_block, name);
+        case AST_WHILE:
+            return reads_capture(node->as.while_stmt.condition, name) ||
+                   reads_capture(node->as.while_stmt.body, name);
+        case AST_FOR:
+            return reads_capture(node->as.for_stmt.iterable, name) ||
+                   reads_capture(node->as.for_stmt.body, name);
+        case AST_WITH:
+            return reads_capture(node->as.with_stmt.context, name) ||
+                   reads_capture(node->as.with_stmt.body, name);
+        default:
+            return false;
+    }
+}
+
+// Drop the captures of a def or lambda that propagation or pruning left
+// unread, so the closure record holds only what the body still loads.
+// Nested units are folded (and pruned) first.
+static void prune_captures(ASTNode* func) {
+    ASTCapture* captures;
+    int* count;
+    ASTNode* body;
+    if (func->type == AST_FUNCTION_DEF) {
+        captures = func->as.function_def.captures;
+        count = &func->as.function_def.capture_count;
+        body = func->as.function_def.body;
+    } else {
+        captures = func->as.lambda.captures;
+        count = &func->as.lambda.capture_count;
+        body = func->as.lambda.body;
+    }
+    int kept = 0;
+    for (int i = 0; i < *count; i++) {
+        if (reads_capture(body, captures[i].name)) {
+            captures[kept++] = captures[i];
+        } else {
+            free(captures[i].name);
+        }
+    }
+    *count = kept;
+}
+
+// ============================================================
+// Units
+// ============================================================
+
+// Fold a module, def, class body or lambda as its own unit. A class
+// body's names are not visible in its methods, so they look past it.
+static void fold_unit(Folder* outer, ASTNode* node, FoldStats* stats) {
+    Folder F = {0};
+    F.stats = stats;
+    F.outer = outer;
+
+    switch (node->type) {
+        case AST_MODULE:
+            count_bindings(&F, node);
+            fold_statements(&F, &node->as.module.statements, &node->as.module.count,
+                            &node->as.module.capacity, true, false);
+            break;
+        case AST_FUNCTION_DEF: {
+            // Methods see the scope around their class, not the class body
+            if (outer && outer->is_class) F.outer = outer->outer;
+            for (int i = 0; i < node->as.function_def.param_count; i++) {
+                bind(&F, node->as.function_def.params[i].name);
+            }
+            ASTNode* body = node->as.function_def.body;
+            count_bindings(&F, body);
+            if (body && body->type == AST_BLOCK) {
+                fold_statements(&F, &body->as.block.statements, &body->as.block.count,
+                                &body->as.block.capacity, true, true);
+            }
+            prune_captures(node);
+            break;
+        }
+        case AST_LAMBDA:
+            for (int i = 0; i < node->as.lambda.param_count; i++) {
+                bind(&F, node->as.lambda.param_names[i]);
+            }
+            node->as.lambda.body = fold_expr(&F, node->as.lambda.body);
+            prune_captures(node);
+            break;
+        case AST_CLASS_DEF: {
+            // Class attributes are read through the class or its instances,
+            // so the body's own assignments establish nothing
+            ASTNode* body = node->as.class_def.body;
+            F.is_class = true;
+            count_bindings(&F, body);
+            if (body && body->type == AST_BLOCK) {
+                fold_statements(&F, &body->as.block.statements, &body->as.block.count,
+                                &body->as.block.capacity, false, true);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+
+    for (int i = 0; i < F.binding_count; i++) free(F.bindings[i].name);
+    free(F.bindings);
+    free(F.constants);
+}
+
+void fold_module(ASTNode* module, FoldStats* stats) {
+    FoldStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    if (!module || module->type != AST_MODULE) return;
+    fold_unit(NULL, module, stats);
+}
@@ -0,0 +1,41 @@
+// fold.h - Constant folding, propagation and dead branch pruning
+//
+// An optimization pass over the AST, run once semantic_analyze has
+// succeeded (and before lowering). It rewrites the tree in place:
+//   - folding: arithmetic (+ - * / %), comparisons, 'not' and unary
+//     minus/plus whose operands are literals become one literal, as do
+//     groupings around a literal. Folding computes exactly what the
+//     runtime would: '/' is float division and '%' floors, int results
+//     that would overflow int64 stay unfolded (the runtime turns them
+//     float), and anything the runtime rejects - division by zero, bools
+//     or strings in arithmetic, orderings of non-numbers - is left for it
+//     to report. 'a and b' / 'a or b' fold on a constant left operand
+//     only, keeping the right operand whenever it would have run, and a
+//     ternary with a constant condition becomes the arm it picks;
+//   - propagation: a name bound exactly once in its function (or module),
+//     by an assignment of a literal directly in the function body, is
+//     replaced by that literal wherever it is read after the assignment:
+//     in later statements, and in lambdas and nested defs defined after
+//     it that do not rebind the name. The assignment itself stays;
+//   - pruning: an if (or elif) with a constant condition is replaced by
+//     the branch it takes, which may be nothing. A block left empty gets
+//     a 'pass'.
+// New literals keep the line, column and inferred_type of the expression
+// they replace. Captures a def or lambda no longer reads after folding
+// are dropped from its capture list.
+
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "ast.h"
+
+typedef struct {
+    int folded;          // Expressions replaced by the literal they compute
+    int propagated;      // Reads of single-assignment locals replaced by their literal
+    int pruned;          // if statements replaced by the branch they take
+} FoldStats;
+
+// Fold every statement of 'module' in place. 'stats' may be NULL.
+void fold_module(ASTNode* module, FoldStats* stats);
+
+#endif // FOLD_H
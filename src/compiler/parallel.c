@@ -0,0 +1,1402 @@
+// parallel.c - Loop parallelization analysis for RHelix
+//
+// See parallel.h for the rules. Three walks do the work: one over the loop
+// body counting how each name is used and recording every store, one over
+// the rest of the function collecting names whose values could be
+// observed after the loop, and a definite-assignment walk over the body
+// that catches reads of privately written names before their first write
+// in an iteration (values carried from the previous iteration). The
+// function-level check needs only a walk over the stores and one over
+// the assignments that may make a local alias shared state.
+
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Enclosing-loop bindings tracked by the outside walk. Deeper nests are
+// treated as unbound, which only makes the analysis more conservative.
+#define MAX_BOUND_NAMES 32
+
+// === Name sets ===
+
+typedef struct {
+    const char** names;     // Borrowed from the AST
+    int count;
+    int capacity;
+} NameSet;
+
+static bool names_contains(const NameSet* set, const char* name) {
+    for (int i = 0; i < set->count; i++) {
+        if (strcmp(set->names[i], name) == 0) return true;
+    }
+    return false;
+}
+
+// Returns false only on allocation failure.
+static bool names_add(NameSet* set, const char* name) {
+    if (names_contains(set, name)) return true;
+    if (set->count >= set->capacity) {
+        int new_cap = set->capacity == 0 ? 8 : set->capacity * 2;
+        const char** names = (const char**)realloc(set->names, sizeof(char*) * new_cap);
+        if (!names) return false;
+        set->names = names;
+        set->capacity = new_cap;
+    }
+    set->names[set->count++] = name;
+    return true;
+}
+
+static bool names_copy(NameSet* dst, const NameSet* src) {
+    for (int i = 0; i < src->count; i++) {
+        if (!names_add(dst, src->names[i])) return false;
+    }
+    return true;
+}
+
+static void names_free(NameSet* set) {
+    free(set->names);
+    set->names = NULL;
+    set->count = 0;
+    set->capacity = 0;
+}
+
+// === Callees ===
+
+// What a callee name resolves to: a module-level def or class, unless
+// the function binds the name itself (a local, a parameter or a capture).
+typedef struct {
+    ASTNode* module;
+    ASTNode* func;
+    const NameSet* locals;
+} Bindings;
+
+static ASTNode* global_def(const Bindings* b, const char* name) {
+    if (!b->module || names_contains(b->locals, name) || ast_find_capture(b->func, name) >= 0) {
+        return NULL;
+    }
+    for (int i = 0; i < b->module->as.module.count; i++) {
+        ASTNode* s = b->module->as.module.statements[i];
+        if (s->type == AST_FUNCTION_DEF && strcmp(s->as.function_def.name, name) == 0) return s;
+        if (s->type == AST_CLASS_DEF && strcmp(s->as.class_def.name, name) == 0) return s;
+    }
+    return NULL;
+}
+
+// Does 'name' refer to the builtin of that name? (See is_builtin in
+// ir_lower.c.)
+static bool is_builtin(const Bindings* b, const char* name) {
+    return !names_contains(b->locals, name) && ast_find_capture(b->func, name) < 0 &&
+           !global_def(b, name);
+}
+
+static bool is_param(ASTNode* func, const char* name) {
+    for (int i = 0; i < func->as.function_def.param_count; i++) {
+        if (strcmp(func->as.function_def.params[i].name, name) == 0) return true;
+    }
+    return false;
+}
+
+// Does 'call' return an object no one else holds? Only constructors of
+// module-level classes are known to; any other callee may hand back one
+// of its arguments or something it keeps.
+static bool fresh_call(const Bindings* b, ASTNode* call) {
+    ASTNode* callee = call->as.call.callee;
+    if (!callee || callee->type != AST_IDENTIFIER) return false;
+    ASTNode* def = global_def(b, callee->as.identifier.name);
+    return def && def->type == AST_CLASS_DEF;
+}
+
+// === Loop body uses ===
+
+typedef struct {
+    const char* name;
+    int reads;              // Outside its own updates
+    int writes;             // Plain assignments and loop/with bindings
+    int sum_updates;        // += and -=
+    int product_updates;    // *=
+    int other_updates;      // Any other augmented operator
+    int appends;            // name.append(e) statements
+    int stores;             // name.attr = v, name[i] = v and augmented forms
+    int fresh_writes;       // Assignments of a value no one else can reach
+    int indexed_reads;      // name[v] with v the loop variable
+    int element_reads;      // Other reads of its elements or attributes, or passed to a call
+    int indexed_stores;     // name[v] = e with v the loop variable
+    ASTNode* first;         // First use seen in the body
+    ASTNode* carried;       // First read of a value from the previous iteration
+} NameUse;
+
+// An attribute or subscript store in the loop body
+typedef struct {
+    const char* base;       // Root name of the stored-into object, or NULL
+    ASTNode* target;
+    bool rmw;               // Reads the location it writes
+    bool indexed;           // name[v] = e with v the loop variable
+    ASTNode* node;
+} StoreSite;
+
+typedef struct {
+    LoopAnalysis* out;
+    const Bindings* bindings;
+    const char* loop_var;
+    const NameSet* shared;  // Parameters and locals that may alias them
+    NameUse* uses;
+    int use_count;
+    int use_capacity;
+    StoreSite* stores;
+    int store_count;
+    int store_capacity;
+    int loop_depth;         // Loops nested inside the analyzed one
+    ASTNode* lambda;        // Innermost lambda whose body is being walked
+    bool failed;            // Allocation failure
+} BodyWalk;
+
+static void reject(LoopAnalysis* out, const char* reason, const char* name, ASTNode* at) {
+    if (!out->independent) return;  // Report the first problem only
+    out->independent = false;
+    out->reason = reason;
+    out->reason_name = name;
+    out->reason_node = at;
+}
+
+static NameUse* find_use(BodyWalk* w, const char* name) {
+    for (int i = 0; i < w->use_count; i++) {
+        if (strcmp(w->uses[i].name, name) == 0) return &w->uses[i];
+    }
+    return NULL;
+}
+
+static NameUse* use_of(BodyWalk* w, const char* name, ASTNode* at) {
+    NameUse* use = find_use(w, name);
+    if (use) return use;
+    if (w->use_count >= w->use_capacity) {
+        int new_cap = w->use_capacity == 0 ? 8 : w->use_capacity * 2;
+        NameUse* uses = (NameUse*)realloc(w->uses, sizeof(NameUse) * new_cap);
+        if (!uses) {
+            w->failed = true;
+            return NULL;
+        }
+        w->uses = uses;
+        w->use_capacity = new_cap;
+    }
+    use = &w->uses[w->use_count++];
+    memset(use, 0, sizeof(*use));
+    use->name = name;
+    use->first = at;
+    return use;
+}
+
+static bool lambda_param(ASTNode* lambda, const char* name) {
+    if (!lambda) return false;
+    for (int i = 0; i < lambda->as.lambda.param_count; i++) {
+        if (strcmp(lambda->as.lambda.param_names[i], name) == 0) return true;
+    }
+    return false;
+}
+
+// 'name.append(e)' as a statement: returns the receiver's name.
+static const char* append_receiver(ASTNode* expr) {
+    if (!expr || expr->type != AST_CALL || expr->as.call.arg_count != 1) return NULL;
+    ASTNode* callee = expr->as.call.callee;
+    if (!callee || callee->type != AST_ATTRIBUTE) return NULL;
+    if (strcmp(callee->as.attribute.name, "append") != 0) return NULL;
+    ASTNode* obj = callee->as.attribute.object;
+    return obj && obj->type == AST_IDENTIFIER ? obj->as.identifier.name : NULL;
+}
+
+// The expression an attribute/subscript chain starts at: 'a' for a.b[i].c.
+static ASTNode* chain_root(ASTNode* node) {
+    while (node) {
+        switch (node->type) {
+            case AST_ATTRIBUTE: node = node->as.attribute.object; break;
+            case AST_SUBSCRIPT: node = node->as.subscript.object; break;
+            case AST_GROUPING: node = node->as.grouping.expression; break;
+            default: return node;
+        }
+    }
+    return NULL;
+}
+
+// The name an attribute/subscript chain is rooted at, or NULL when the
+// chain starts at a call or literal.
+static const char* root_name(ASTNode* node) {
+    ASTNode* root = chain_root(node);
+    return root && root->type == AST_IDENTIFIER ? root->as.identifier.name : NULL;
+}
+
+// Is the object a chain without a root name starts at one no one else
+// holds? Literals are; call results only when fresh_call says so.
+static bool fresh_root(const Bindings* b, ASTNode* target) {
+    ASTNode* root = chain_root(target);
+    return !root || root->type != AST_CALL || fresh_call(b, root);
+}
+
+// Structural equality of two location expressions
+static bool same_location(ASTNode* a, ASTNode* b) {
+    if (!a || !b) return false;
+    if (a->type == AST_GROUPING) return same_location(a->as.grouping.expression, b);
+    if (b->type == AST_GROUPING) return same_location(a, b->as.grouping.expression);
+    if (a->type != b->type) return false;
+    switch (a->type) {
+        case AST_IDENTIFIER:
+            return strcmp(a->as.identifier.name, b->as.identifier.name) == 0;
+        case AST_LITERAL_INT:
+            return a->as.literal_int.value == b->as.literal_int.value;
+        case AST_LITERAL_STRING:
+            return strcmp(a->as.literal_string.value, b->as.literal_string.value) == 0;
+        case AST_ATTRIBUTE:
+            return strcmp(a->as.attribute.name, b->as.attribute.name) == 0 &&
+                   same_location(a->as.attribute.object, b->as.attribute.object);
+        case AST_SUBSCRIPT:
+            return same_location(a->as.subscript.object, b->as.subscript.object) &&
+                   same_location(a->as.subscript.index, b->as.subscript.index);
+        case AST_CALL:
+            // The same call may well return the same object
+            if (a->as.call.arg_count != b->as.call.arg_count ||
+                !same_location(a->as.call.callee, b->as.call.callee)) return false;
+            for (int i = 0; i < a->as.call.arg_count; i++) {
+                if (!same_location(a->as.call.args[i], b->as.call.args[i])) return false;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Does evaluating 'node' read the location 'target'?
+static bool reads_location(ASTNode* node, ASTNode* target) {
+    if (!node) return false;
+    if (same_location(node, target)) return true;
+    switch (node->type) {
+        case AST_BINARY:
+            return reads_location(node->as.binary.left, target) ||
+                   reads_location(node->as.binary.right, target);
+        case AST_UNARY:
+            return reads_location(node->as.unary.operand, target);
+        case AST_GROUPING:
+            return reads_location(node->as.grouping.expression, target);
+        case AST_CALL:
+            if (reads_location(node->as.call.callee, target)) return true;
+            for (int i = 0; i < node->as.call.arg_count; i++) {
+                if (reads_location(node->as.call.args[i], target)) return true;
+            }
+            return false;
+        case AST_SUBSCRIPT:
+            return reads_location(node->as.subscript.object, target) ||
+                   reads_location(node->as.subscript.index, target);
+        case AST_ATTRIBUTE:
+            return reads_location(node->as.attribute.object, target);
+        case AST_LIST_LITERAL:
+            for (int i = 0; i < node->as.list_literal.count; i++) {
+                if (reads_location(node->as.list_literal.elements[i], target)) return true;
+            }
+            return false;
+        case AST_DICT_LITERAL:
+            for (int i = 0; i < node->as.dict_literal.count; i++) {
+                if (reads_location(node->as.dict_literal.entries[i].key, target) ||
+                    reads_location(node->as.dict_literal.entries[i].value, target)) return true;
+            }
+            return false;
+        case AST_TERNARY:
+            return reads_location(node->as.ternary.condition, target) ||
+                   reads_location(node->as.ternary.then_expr, target) ||
+                   reads_location(node->as.ternary.else_expr, target);
+        default:
+            return false;
+    }
+}
+
+// Could the value of 'value' be an object someone else also holds?
+// Literals, arithmetic and constructor calls are taken to be fresh.
+static bool may_alias(const Bindings* b, ASTNode* value) {
+    if (!value) return false;
+    switch (value->type) {
+        case AST_IDENTIFIER:
+        case AST_ATTRIBUTE:
+        case AST_SUBSCRIPT:
+            return true;
+        case AST_CALL:
+            return !fresh_call(b, value);
+        case AST_GROUPING:
+            return may_alias(b, value->as.grouping.expression);
+        case AST_TERNARY:
+            return may_alias(b, value->as.ternary.then_expr) ||
+                   may_alias(b, value->as.ternary.else_expr);
+        default:
+            return false;
+    }
+}
+
+static bool is_loop_var(BodyWalk* w, ASTNode* node) {
+    return node && node->type == AST_IDENTIFIER &&
+           strcmp(node->as.identifier.name, w->loop_var) == 0;
+}
+
+static void count_uses(BodyWalk* w, ASTNode* node);
+
+// 'name' read as an object: subscripted other than by the loop variable,
+// an attribute taken, or passed to a call
+static void count_element_read(BodyWalk* w, ASTNode* node) {
+    if (!node || node->type != AST_IDENTIFIER || lambda_param(w->lambda, node->as.identifier.name)) {
+        return;
+    }
+    NameUse* use = use_of(w, node->as.identifier.name, node);
+    if (use) use->element_reads++;
+}
+
+// 'obj.attr = v' or 'obj[i] = v': a store into the object 'obj'. Counted
+// on the name the chain is rooted at and recorded for classify_store.
+static void count_store(BodyWalk* w, ASTNode* target, ASTNode* stmt, bool rmw) {
+    ASTNode* obj;
+    bool indexed = false;
+    if (target->type == AST_ATTRIBUTE) {
+        obj = target->as.attribute.object;
+    } else {
+        obj = target->as.subscript.object;
+        indexed = obj->type == AST_IDENTIFIER && is_loop_var(w, target->as.subscript.index);
+        count_uses(w, target->as.subscript.index);
+    }
+    if (obj->type == AST_IDENTIFIER) {
+        NameUse* use = use_of(w, obj->as.identifier.name, stmt);
+        if (!use) return;
+        use->stores++;
+        if (indexed) use->indexed_stores++;
+    } else {
+        count_uses(w, obj);
+    }
+
+    if (w->store_count >= w->store_capacity) {
+        int new_cap = w->store_capacity == 0 ? 8 : w->store_capacity * 2;
+        StoreSite* stores = (StoreSite*)realloc(w->stores, sizeof(StoreSite) * new_cap);
+        if (!stores) {
+            w->failed = true;
+            return;
+        }
+        w->stores = stores;
+        w->store_capacity = new_cap;
+    }
+    StoreSite* site = &w->stores[w->store_count++];
+    site->base = root_name(target);
+    site->target = target;
+    site->rmw = rmw;
+    site->indexed = indexed;
+    site->node = stmt;
+}
+
+static void count_uses(BodyWalk* w, ASTNode* node) {
+    if (!node || w->failed) return;
+    switch (node->type) {
+        case AST_IDENTIFIER: {
+            if (lambda_param(w->lambda, node->as.identifier.name)) break;
+            NameUse* use = use_of(w, node->as.identifier.name, node);
+            if (use) use->reads++;
+            break;
+        }
+        case AST_BINARY:
+            count_uses(w, node->as.binary.left);
+            count_uses(w, node->as.binary.right);
+            break;
+        case AST_UNARY:
+            count_uses(w, node->as.unary.operand);
+            break;
+        case AST_GROUPING:
+            count_uses(w, node->as.grouping.expression);
+            break;
+        case AST_CALL:
+            count_uses(w, node->as.call.callee);
+            for (int i = 0; i < node->as.call.arg_count; i++) {
+                count_element_read(w, node->as.call.args[i]);
+                count_uses(w, node->as.call.args[i]);
+            }
+            break;
+        case AST_SUBSCRIPT: {
+            ASTNode* obj = node->as.subscript.object;
+            if (obj->type == AST_IDENTIFIER && is_loop_var(w, node->as.subscript.index) &&
+                !lambda_param(w->lambda, obj->as.identifier.name) &&
+                !lambda_param(w->lambda, w->loop_var)) {
+                NameUse* use = use_of(w, obj->as.identifier.name, node);
+                if (use) use->indexed_reads++;
+            } else {
+                count_element_read(w, obj);
+                count_uses(w, obj);
+            }
+            count_uses(w, node->as.subscript.index);
+            break;
+        }
+        case AST_ATTRIBUTE:
+            count_element_read(w, node->as.attribute.object);
+            count_uses(w, node->as.attribute.object);
+            break;
+        case AST_LIST_LITERAL:
+            for (int i = 0; i < node->as.list_literal.count; i++) {
+                count_uses(w, node->as.list_literal.elements[i]);
+            }
+            break;
+        case AST_DICT_LITERAL:
+            for (int i = 0; i < node->as.dict_literal.count; i++) {
+                count_uses(w, node->as.dict_literal.entries[i].key);
+                count_uses(w, node->as.dict_literal.entries[i].value);
+            }
+            break;
+        case AST_TERNARY:
+            count_uses(w, node->as.ternary.condition);
+            count_uses(w, node->as.ternary.then_expr);
+            count_uses(w, node->as.ternary.else_expr);
+            break;
+        case AST_LAMBDA: {
+            ASTNode* saved = w->lambda;
+            w->lambda = node;
+            count_uses(w, node->as.lambda.body);
+            w->lambda = saved;
+            break;
+        }
+
+        case AST_EXPRESSION_STMT: {
+            ASTNode* expr = node->as.expression_stmt.expression;
+            const char* receiver = append_receiver(expr);
+            if (receiver) {
+                NameUse* use = use_of(w, receiver, node);
+                if (use) use->appends++;
+                count_uses(w, expr->as.call.args[0]);
+            } else {
+                count_uses(w, expr);
+            }
+            break;
+        }
+        case AST_ASSIGNMENT: {
+            ASTNode* target = node->as.assignment.target;
+            count_uses(w, node->as.assignment.value);
+            if (target->type == AST_IDENTIFIER) {
+                NameUse* use = use_of(w, target->as.identifier.name, node);
+                if (!use) break;
+                use->writes++;
+                if (!may_alias(w->bindings, node->as.assignment.value)) use->fresh_writes++;
+            } else if (target->type == AST_ATTRIBUTE || target->type == AST_SUBSCRIPT) {
+                count_store(w, target, node, reads_location(node->as.assignment.value, target));
+            }
+            break;
+        }
+        case AST_AUGMENTED_ASSIGNMENT: {
+            ASTNode* target = node->as.augmented_assignment.target;
+            count_uses(w, node->as.augmented_assignment.value);
+            if (target->type == AST_IDENTIFIER) {
+                NameUse* use = use_of(w, target->as.identifier.name, node);
+                if (!use) break;
+                switch (node->as.augmented_assignment.op) {
+                    case TOKEN_PLUS:
+                    case TOKEN_MINUS: use->sum_updates++; break;
+                    case TOKEN_STAR: use->product_updates++; break;
+                    default: use->other_updates++; break;
+                }
+            } else if (target->type == AST_ATTRIBUTE || target->type == AST_SUBSCRIPT) {
+                count_store(w, target, node, true);
+            }
+            break;
+        }
+        case AST_RETURN:
+            reject(w->out, "return inside the loop", NULL, node);
+            count_uses(w, node->as.ret.value);
+            break;
+        case AST_BREAK:
+            if (w->loop_depth == 0) reject(w->out, "break out of the loop", NULL, node);
+            break;
+
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                count_uses(w, node->as.block.statements[i]);
+            }
+            break;
+        case AST_IF:
+            count_uses(w, node->as.if_stmt.condition);
+            count_uses(w, node->as.if_stmt.then_block);
+            count_uses(w, node->as.if_stmt.else_block);
+            break;
+        case AST_WHILE:
+            count_uses(w, node->as.while_stmt.condition);
+            w->loop_depth++;
+            count_uses(w, node->as.while_stmt.body);
+            w->loop_depth--;
+            break;
+        case AST_FOR: {
+            count_uses(w, node->as.for_stmt.iterable);
+            NameUse* use = use_of(w, node->as.for_stmt.var_name, node);
+            if (use) use->writes++;
+            w->loop_depth++;
+            count_uses(w, node->as.for_stmt.body);
+            w->loop_depth--;
+            break;
+        }
+        case AST_WITH:
+            count_uses(w, node->as.with_stmt.context);
+            if (node->as.with_stmt.var_name) {
+                NameUse* use = use_of(w, node->as.with_stmt.var_name, node);
+                if (use) use->writes++;
+            }
+            count_uses(w, node->as.with_stmt.body);
+            break;
+        case AST_FUNCTION_DEF:
+        case AST_CLASS_DEF:
+            reject(w->out, "definition inside the loop", NULL, node);
+            break;
+
+        case AST_LITERAL_INT:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_BOOL:
+        case AST_LITERAL_NONE:
+        case AST_PASS:
+        case AST_CONTINUE:
+        case AST_MODULE:
+            break;
+    }
+}
+
+// === Names observable outside the loop ===
+
+typedef struct {
+    ASTNode* loop;
+    NameSet* reads;
+    bool after;             // Past the loop, or the loop repeats (nested in another)
+    int nested_function;    // Inside a def or lambda: runs at an unknown time
+    const char* bound[MAX_BOUND_NAMES];
+    int bound_count;        // Variables of enclosing for loops
+    bool failed;
+} OutsideWalk;
+
+static bool is_bound(OutsideWalk* o, const char* name) {
+    for (int i = 0; i < o->bound_count; i++) {
+        if (strcmp(o->bound[i], name) == 0) return true;
+    }
+    return false;
+}
+
+static void collect_outside(OutsideWalk* o, ASTNode* node) {
+    if (!node || o->failed) return;
+    if (node == o->loop) {
+        o->after = true;
+        return;
+    }
+    switch (node->type) {
+        case AST_IDENTIFIER:
+            if ((o->after || o->nested_function) && !is_bound(o, node->as.identifier.name)) {
+                if (!names_add(o->reads, node->as.identifier.name)) o->failed = true;
+            }
+            break;
+        case AST_BINARY:
+            collect_outside(o, node->as.binary.left);
+            collect_outside(o, node->as.binary.right);
+            break;
+        case AST_UNARY:
+            collect_outside(o, node->as.unary.operand);
+            break;
+        case AST_GROUPING:
+            collect_outside(o, node->as.grouping.expression);
+            break;
+        case AST_CALL:
+            collect_outside(o, node->as.call.callee);
+            for (int i = 0; i < node->as.call.arg_count; i++) {
+                collect_outside(o, node->as.call.args[i]);
+            }
+            break;
+        case AST_SUBSCRIPT:
+            collect_outside(o, node->as.subscript.object);
+            collect_outside(o, node->as.subscript.index);
+            break;
+        case AST_ATTRIBUTE:
+            collect_outside(o, node->as.attribute.object);
+            break;
+        case AST_LIST_LITERAL:
+            for (int i = 0; i < node->as.list_literal.count; i++) {
+                collect_outside(o, node->as.list_literal.elements[i]);
+            }
+            break;
+        case AST_DICT_LITERAL:
+            for (int i = 0; i < node->as.dict_literal.count; i++) {
+                collect_outside(o, node->as.dict_literal.entries[i].key);
+                collect_outside(o, node->as.dict_literal.entries[i].value);
+            }
+            break;
+        case AST_TERNARY:
+            collect_outside(o, node->as.ternary.condition);
+            collect_outside(o, node->as.ternary.then_expr);
+            collect_outside(o, node->as.ternary.else_expr);
+            break;
+        case AST_LAMBDA:
+            o->nested_function++;
+            collect_outside(o, node->as.lambda.body);
+            o->nested_function--;
+            break;
+        case AST_FUNCTION_DEF:
+            o->nested_function++;
+            collect_outside(o, node->as.function_def.body);
+            o->nested_function--;
+            break;
+        case AST_CLASS_DEF:
+            collect_outside(o, node->as.class_def.body);
+            break;
+        case AST_EXPRESSION_STMT:
+            collect_outside(o, node->as.expression_stmt.expression);
+            break;
+        case AST_ASSIGNMENT:
+            // Plain identifier targets are writes, not reads
+            if (node->as.assignment.target->type != AST_IDENTIFIER) {
+                collect_outside(o, node->as.assignment.target);
+            }
+            collect_outside(o, node->as.assignment.value);
+            break;
+        case AST_AUGMENTED_ASSIGNMENT:
+            collect_outside(o, node->as.augmented_assignment.target);
+            collect_outside(o, node->as.augmented_assignment.value);
+            break;
+        case AST_RETURN:
+            collect_outside(o, node->as.ret.value);
+            break;
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                collect_outside(o, node->as.block.statements[i]);
+            }
+            break;
+        case AST_IF:
+            collect_outside(o, node->as.if_stmt.condition);
+            collect_outside(o, node->as.if_stmt.then_block);
+            collect_outside(o, node->as.if_stmt.else_block);
+            break;
+        case AST_WHILE:
+            collect_outside(o, node->as.while_stmt.condition);
+            collect_outside(o, node->as.while_stmt.body);
+            break;
+        case AST_FOR:
+            collect_outside(o, node->as.for_stmt.iterable);
+            // Reads in the body see this loop's own binding of the variable
+            if (o->bound_count < MAX_BOUND_NAMES) {
+                o->bound[o->bound_count++] = node->as.for_stmt.var_name;
+                collect_outside(o, node->as.for_stmt.body);
+                o->bound_count--;
+            } else {
+                collect_outside(o, node->as.for_stmt.body);
+            }
+            break;
+        case AST_WITH:
+            collect_outside(o, node->as.with_stmt.context);
+            collect_outside(o, node->as.with_stmt.body);
+            break;
+        case AST_LITERAL_INT:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_BOOL:
+        case AST_LITERAL_NONE:
+        case AST_PASS:
+        case AST_BREAK:
+        case AST_CONTINUE:
+        case AST_MODULE:
+            break;
+    }
+}
+
+// Is 'target' inside a while or for loop of 'node'? Then the code before
+// it in source order runs again after it.
+static bool inside_loop(ASTNode* node, ASTNode* target, bool in_loop) {
+    if (!node) return false;
+    if (node == target) return in_loop;
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                if (inside_loop(node->as.block.statements[i], target, in_loop)) return true;
+            }
+            return false;
+        case AST_IF:
+            return inside_loop(node->as.if_stmt.then_block, target, in_loop) ||
+                   inside_loop(node->as.if_stmt.else_block, target, in_loop);
+        case AST_WHILE:
+            return inside_loop(node->as.while_stmt.body, target, true);
+        case AST_FOR:
+            return inside_loop(node->as.for_stmt.body, target, true);
+        case AST_WITH:
+            return inside_loop(node->as.with_stmt.body, target, in_loop);
+        default:
+            return false;
+    }
+}
+
+// Parameters and names bound by statements of the function itself.
+static bool collect_locals(NameSet* locals, ASTNode* node) {
+    if (!node) return true;
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                if (!collect_locals(locals, node->as.block.statements[i])) return false;
+            }
+            return true;
+        case AST_ASSIGNMENT:
+            if (node->as.assignment.target->type != AST_IDENTIFIER) return true;
+            return names_add(locals, node->as.assignment.target->as.identifier.name);
+        case AST_AUGMENTED_ASSIGNMENT:
+            if (node->as.augmented_assignment.target->type != AST_IDENTIFIER) return true;
+            return names_add(locals, node->as.augmented_assignment.target->as.identifier.name);
+        case AST_IF:
+            return collect_locals(locals, node->as.if_stmt.then_block) &&
+                   collect_locals(locals, node->as.if_stmt.else_block);
+        case AST_WHILE:
+            return collect_locals(locals, node->as.while_stmt.body);
+        case AST_FOR:
+            return names_add(locals, node->as.for_stmt.var_name) &&
+                   collect_locals(locals, node->as.for_stmt.body);
+        case AST_WITH:
+            if (node->as.with_stmt.var_name &&
+                !names_add(locals, node->as.with_stmt.var_name)) return false;
+            return collect_locals(locals, node->as.with_stmt.body);
+        case AST_FUNCTION_DEF:
+            return names_add(locals, node->as.function_def.name);
+        default:
+            return true;
+    }
+}
+
+static bool mentions(ASTNode* node, const char* name) {
+    if (!node) return false;
+    switch (node->type) {
+        case AST_IDENTIFIER:
+            return strcmp(node->as.identifier.name, name) == 0;
+        case AST_BINARY:
+            return mentions(node->as.binary.left, name) || mentions(node->as.binary.right, name);
+        case AST_UNARY:
+            return mentions(node->as.unary.operand, name);
+        case AST_GROUPING:
+            return mentions(node->as.grouping.expression, name);
+        case AST_CALL:
+            if (mentions(node->as.call.callee, name)) return true;
+            for (int i = 0; i < node->as.call.arg_count; i++) {
+                if (mentions(node->as.call.args[i], name)) return true;
+            }
+            return false;
+        case AST_SUBSCRIPT:
+            return mentions(node->as.subscript.object, name) ||
+                   mentions(node->as.subscript.index, name);
+        case AST_ATTRIBUTE:
+            return mentions(node->as.attribute.object, name);
+        case AST_TERNARY:
+            return mentions(node->as.ternary.condition, name) ||
+                   mentions(node->as.ternary.then_expr, name) ||
+                   mentions(node->as.ternary.else_expr, name);
+        default:
+            return false;
+    }
+}
+
+// === Values carried between iterations ===
+
+typedef struct {
+    BodyWalk* body;
+    ASTNode* lambda;
+    bool failed;
+} CarryWalk;
+
+static bool written_privately(CarryWalk* c, const char* name) {
+    NameUse* use = find_use(c->body, name);
+    return use && use->writes > 0;
+}
+
+static void check_reads(CarryWalk* c, ASTNode* node, NameSet* defined) {
+    if (!node || c->failed) return;
+    switch (node->type) {
+        case AST_IDENTIFIER: {
+            const char* name = node->as.identifier.name;
+            if (!lambda_param(c->lambda, name) && written_privately(c, name) &&
+                !names_contains(defined, name)) {
+                NameUse* use = find_use(c->body, name);
+                if (!use->carried) use->carried = node;
+            }
+            break;
+        }
+        case AST_BINARY:
+            check_reads(c, node->as.binary.left, defined);
+            check_reads(c, node->as.binary.right, defined);
+            break;
+        case AST_UNARY:
+            check_reads(c, node->as.unary.operand, defined);
+            break;
+        case AST_GROUPING:
+            check_reads(c, node->as.grouping.expression, defined);
+            break;
+        case AST_CALL:
+            check_reads(c, node->as.call.callee, defined);
+            for (int i = 0; i < node->as.call.arg_count; i++) {
+                check_reads(c, node->as.call.args[i], defined);
+            }
+            break;
+        case AST_SUBSCRIPT:
+            check_reads(c, node->as.subscript.object, defined);
+            check_reads(c, node->as.subscript.index, defined);
+            break;
+        case AST_ATTRIBUTE:
+            check_reads(c, node->as.attribute.object, defined);
+            break;
+        case AST_LIST_LITERAL:
+            for (int i = 0; i < node->as.list_literal.count; i++) {
+                check_reads(c, node->as.list_literal.elements[i], defined);
+            }
+            break;
+        case AST_DICT_LITERAL:
+            for (int i = 0; i < node->as.dict_literal.count; i++) {
+                check_reads(c, node->as.dict_literal.entries[i].key, defined);
+                check_reads(c, node->as.dict_literal.entries[i].value, defined);
+            }
+            break;
+        case AST_TERNARY:
+            check_reads(c, node->as.ternary.condition, defined);
+            check_reads(c, node->as.ternary.then_expr, defined);
+            check_reads(c, node->as.ternary.else_expr, defined);
+            break;
+        case AST_LAMBDA: {
+            ASTNode* saved = c->lambda;
+            c->lambda = node;
+            check_reads(c, node->as.lambda.body, defined);
+            c->lambda = saved;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void check_stmt(CarryWalk* c, ASTNode* node, NameSet* defined);
+
+// Walk 'node' with a scratch copy of 'defined'; on return 'branch' holds
+// what is definitely assigned at its end.
+static void check_branch(CarryWalk* c, ASTNode* node, NameSet* defined, NameSet* branch) {
+    if (!names_copy(branch, defined)) {
+        c->failed = true;
+        return;
+    }
+    check_stmt(c, node, branch);
+}
+
+static void check_stmt(CarryWalk* c, ASTNode* node, NameSet* defined) {
+    if (!node || c->failed) return;
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                check_stmt(c, node->as.block.statements[i], defined);
+            }
+            break;
+        case AST_EXPRESSION_STMT:
+            check_reads(c, node->as.expression_stmt.expression, defined);
+            break;
+        case AST_ASSIGNMENT: {
+            ASTNode* target = node->as.assignment.target;
+            check_reads(c, node->as.assignment.value, defined);
+            if (target->type == AST_IDENTIFIER) {
+                if (!names_add(defined, target->as.identifier.name)) c->failed = true;
+            } else {
+                check_reads(c, target, defined);
+            }
+            break;
+        }
+        case AST_AUGMENTED_ASSIGNMENT:
+            check_reads(c, node->as.augmented_assignment.target, defined);
+            check_reads(c, node->as.augmented_assignment.value, defined);
+            break;
+        case AST_RETURN:
+            check_reads(c, node->as.ret.value, defined);
+            break;
+        case AST_IF: {
+            check_reads(c, node->as.if_stmt.condition, defined);
+            NameSet then_set = {0};
+            NameSet else_set = {0};
+            check_branch(c, node->as.if_stmt.then_block, defined, &then_set);
+            if (node->as.if_stmt.else_block) {
+                check_branch(c, node->as.if_stmt.else_block, defined, &else_set);
+                // Assigned on both arms
+                for (int i = 0; i < then_set.count && !c->failed; i++) {
+                    if (names_contains(&else_set, then_set.names[i]) &&
+                        !names_add(defined, then_set.names[i])) c->failed = true;
+                }
+            }
+            names_free(&then_set);
+            names_free(&else_set);
+            break;
+        }
+        case AST_WHILE: {
+            check_reads(c, node->as.while_stmt.condition, defined);
+            NameSet body = {0};
+            check_branch(c, node->as.while_stmt.body, defined, &body);
+            names_free(&body);
+            break;
+        }
+        case AST_FOR: {
+            check_reads(c, node->as.for_stmt.iterable, defined);
+            NameSet body = {0};
+            if (!names_copy(&body, defined) || !names_add(&body, node->as.for_stmt.var_name)) {
+                c->failed = true;
+            } else {
+                check_stmt(c, node->as.for_stmt.body, &body);
+            }
+            names_free(&body);
+            break;
+        }
+        case AST_WITH:
+            check_reads(c, node->as.with_stmt.context, defined);
+            if (node->as.with_stmt.var_name &&
+                !names_add(defined, node->as.with_stmt.var_name)) {
+                c->failed = true;
+            }
+            check_stmt(c, node->as.with_stmt.body, defined);
+            break;
+        default:
+            break;
+    }
+}
+
+// === Classification ===
+
+static bool push_write(ParallelWrite** writes, int* count, const char* name, ASTNode* target,
+                       WriteClass write_class, bool lost_update, const char* reason,
+                       ASTNode* node) {
+    ParallelWrite* w = (ParallelWrite*)realloc(*writes, sizeof(ParallelWrite) * (*count + 1));
+    if (!w) return false;
+    *writes = w;
+    w[*count].name = name;
+    w[*count].target = target;
+    w[*count].write_class = write_class;
+    w[*count].lost_update = lost_update;
+    w[*count].reason = reason;
+    w[*count].node = node;
+    (*count)++;
+    return true;
+}
+
+static bool add_write(LoopAnalysis* out, const char* name, ASTNode* target,
+                      WriteClass write_class, ASTNode* node) {
+    return push_write(&out->writes, &out->write_count, name, target, write_class,
+                      false, NULL, node);
+}
+
+static bool add_conflict(LoopAnalysis* out, const char* name, ASTNode* target,
+                         bool lost_update, const char* reason, ASTNode* node) {
+    reject(out, reason, name, node);
+    return push_write(&out->writes, &out->write_count, name, target, WRITE_CONFLICT,
+                      lost_update, reason, node);
+}
+
+static bool add_reduction(LoopAnalysis* out, NameUse* use, ReductionKind kind) {
+    LoopReduction* r = (LoopReduction*)realloc(out->reductions,
+        sizeof(LoopReduction) * (out->reduction_count + 1));
+    if (!r) return false;
+    out->reductions = r;
+    r[out->reduction_count].name = use->name;
+    r[out->reduction_count].kind = kind;
+    r[out->reduction_count].node = use->first;
+    out->reduction_count++;
+    return add_write(out, use->name, NULL, WRITE_REDUCTION, use->first);
+}
+
+// 'for v in range(...)' with v never reassigned in the body: every
+// iteration sees a different v.
+static bool distinct_indices(LoopAnalysis* out, BodyWalk* w) {
+    ASTNode* iterable = out->loop->as.for_stmt.iterable;
+    if (!iterable || iterable->type != AST_CALL) return false;
+    ASTNode* callee = iterable->as.call.callee;
+    if (!callee || callee->type != AST_IDENTIFIER ||
+        strcmp(callee->as.identifier.name, "range") != 0 ||
+        !is_builtin(w->bindings, "range")) return false;
+    NameUse* var = find_use(w, w->loop_var);
+    return var && var->writes == 1 && !var->carried;
+}
+
+// May a name other than 'base' that the loop reads other than element by
+// element refer to the same list? A list the function builds can only be
+// reached through locals assigned from another name; a parameter, a
+// global or such a local can be the list any of the others is.
+static bool element_alias(BodyWalk* w, const char* base) {
+    const NameSet* locals = w->bindings->locals;
+    bool base_shared = !names_contains(locals, base) || names_contains(w->shared, base);
+    for (int i = 0; i < w->use_count; i++) {
+        NameUse* other = &w->uses[i];
+        if (strcmp(other->name, base) == 0 || strcmp(other->name, w->loop_var) == 0) continue;
+        if (other->element_reads == 0 && other->appends == 0) continue;
+        if (global_def(w->bindings, other->name)) continue;
+        if (!names_contains(locals, other->name)) {
+            if (base_shared) return true;
+        } else if (names_contains(w->shared, other->name)) {
+            if (base_shared || !is_param(w->bindings->func, other->name)) return true;
+        }
+    }
+    return false;
+}
+
+static bool classify_store(LoopAnalysis* out, BodyWalk* w, StoreSite* s) {
+    // Stores into literals and constructed objects stay in the iteration
+    if (!s->base) {
+        if (fresh_root(w->bindings, s->target)) {
+            return add_write(out, NULL, s->target, WRITE_PRIVATE, s->node);
+        }
+        return add_conflict(out, NULL, s->target, s->rmw,
+                            "store into a call result that may be shared", s->node);
+    }
+
+    NameUse* use = find_use(w, s->base);
+    if (use && use->writes > 0) {
+        if (use->writes == use->fresh_writes) {
+            // Built in this iteration (a carried object is reported on the name)
+            return add_write(out, s->base, s->target, WRITE_PRIVATE, s->node);
+        }
+        return add_conflict(out, s->base, s->target, s->rmw,
+                            strcmp(s->base, w->loop_var) == 0
+                                ? "store into an element of the iterable"
+                                : "store into an object that may be shared",
+                            s->node);
+    }
+    if (use && s->indexed && distinct_indices(out, w) && use->reads == 0 &&
+        use->stores == use->indexed_stores && use->appends == 0 &&
+        use->sum_updates + use->product_updates + use->other_updates == 0) {
+        if (element_alias(w, s->base)) {
+            return add_conflict(out, s->base, s->target, s->rmw,
+                                "element store into a possibly aliased list",
+                                s->node);
+        }
+        // xs[i] = e: each iteration owns its element
+        return add_write(out, s->base, s->target, WRITE_PRIVATE, s->node);
+    }
+    return add_conflict(out, s->base, s->target, s->rmw, "store into a shared object", s->node);
+}
+
+static bool classify(LoopAnalysis* out, BodyWalk* w, NameSet* outside, NameSet* locals) {
+    for (int i = 0; i < w->use_count; i++) {
+        NameUse* use = &w->uses[i];
+        int reads = use->reads + use->indexed_reads;
+        int updates = use->sum_updates + use->product_updates + use->other_updates;
+        if (use->writes == 0 && updates == 0 && use->appends == 0) {
+            continue;  // Read-only, or only stored into (see below): shared safely
+        }
+        bool ok;
+        if (use->writes > 0) {
+            // Private to an iteration unless an iteration sees another's value
+            if (use->carried) {
+                ok = add_conflict(out, use->name, NULL, false,
+                                  "value carried between iterations", use->carried);
+            } else if (names_contains(outside, use->name)) {
+                ok = add_conflict(out, use->name, NULL, false,
+                                  "value assigned in the loop is read after it", use->first);
+            } else {
+                ok = add_write(out, use->name, NULL, WRITE_PRIVATE, use->first);
+            }
+            if (!ok) return false;
+            continue;
+        }
+        int kinds = (use->sum_updates > 0) + (use->product_updates > 0) +
+                    (use->other_updates > 0) + (use->appends > 0);
+        if (use->stores > 0 || use->other_updates > 0 || kinds > 1) {
+            ok = add_conflict(out, use->name, NULL, true,
+                              "conflicting updates of a shared name", use->first);
+        } else if (reads > 0) {
+            ok = add_conflict(out, use->name, NULL, false,
+                              "accumulator read inside the loop", use->first);
+        } else if (!names_contains(locals, use->name)) {
+            ok = add_conflict(out, use->name, NULL, true,
+                              "accumulator is not a local variable", use->first);
+        } else if (mentions(out->loop->as.for_stmt.iterable, use->name)) {
+            ok = add_conflict(out, use->name, NULL, false,
+                              "loop updates its own iterable", use->first);
+        } else {
+            ReductionKind kind = use->sum_updates ? REDUCE_SUM
+                               : use->product_updates ? REDUCE_PRODUCT
+                               : REDUCE_APPEND;
+            ok = add_reduction(out, use, kind);
+        }
+        if (!ok) return false;
+    }
+    for (int i = 0; i < w->store_count; i++) {
+        if (!classify_store(out, w, &w->stores[i])) return false;
+    }
+    return true;
+}
+
+// === Stores seen by concurrent calls ===
+
+typedef struct {
+    FunctionWrites* out;
+    const Bindings* bindings;
+    NameSet* shared;        // Parameters and locals that may alias them
+    NameSet* locals;
+    bool failed;
+} StoreWalk;
+
+// Locals that may refer to an object the caller (or anyone) can reach
+static bool collect_aliased(const Bindings* b, NameSet* shared, ASTNode* node) {
+    if (!node) return true;
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                if (!collect_aliased(b, shared, node->as.block.statements[i])) return false;
+            }
+            return true;
+        case AST_ASSIGNMENT:
+            if (node->as.assignment.target->type != AST_IDENTIFIER ||
+                !may_alias(b, node->as.assignment.value)) return true;
+            return names_add(shared, node->as.assignment.target->as.identifier.name);
+        case AST_IF:
+            return collect_aliased(b, shared, node->as.if_stmt.then_block) &&
+                   collect_aliased(b, shared, node->as.if_stmt.else_block);
+        case AST_WHILE:
+            return collect_aliased(b, shared, node->as.while_stmt.body);
+        case AST_FOR:
+            return names_add(shared, node->as.for_stmt.var_name) &&
+                   collect_aliased(b, shared, node->as.for_stmt.body);
+        case AST_WITH:
+            if (node->as.with_stmt.var_name &&
+                !names_add(shared, node->as.with_stmt.var_name)) return false;
+            return collect_aliased(b, shared, node->as.with_stmt.body);
+        default:
+            return true;
+    }
+}
+
+static void walk_store(StoreWalk* sw, ASTNode* target, ASTNode* stmt, bool rmw) {
+    const char* root = root_name(target);
+    // Literals and constructed objects belong to this call
+    if (!root && fresh_root(sw->bindings, target)) return;
+    bool shared = !root || names_contains(sw->shared, root) ||
+                  !names_contains(sw->locals, root);
+    bool ok;
+    if (shared) {
+        ok = push_write(&sw->out->writes, &sw->out->write_count, root, target,
+                        WRITE_CONFLICT, rmw,
+                        rmw ? "read-modify-write of an object other calls can reach"
+                            : "store into an object other calls can reach",
+                        stmt);
+    } else {
+        ok = push_write(&sw->out->writes, &sw->out->write_count, root, target,
+                        WRITE_PRIVATE, false, NULL, stmt);
+    }
+    if (!ok) sw->failed = true;
+}
+
+static void walk_stores(StoreWalk* sw, ASTNode* node) {
+    if (!node || sw->failed) return;
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                walk_stores(sw, node->as.block.statements[i]);
+            }
+            break;
+        case AST_ASSIGNMENT: {
+            ASTNode* target = node->as.assignment.target;
+            if (target->type == AST_ATTRIBUTE || target->type == AST_SUBSCRIPT) {
+                walk_store(sw, target, node, reads_location(node->as.assignment.value, target));
+            }
+            break;
+        }
+        case AST_AUGMENTED_ASSIGNMENT: {
+            ASTNode* target = node->as.augmented_assignment.target;
+            if (target->type == AST_ATTRIBUTE || target->type == AST_SUBSCRIPT) {
+                walk_store(sw, target, node, true);
+            }
+            break;
+        }
+        case AST_IF:
+            walk_stores(sw, node->as.if_stmt.then_block);
+            walk_stores(sw, node->as.if_stmt.else_block);
+            break;
+        case AST_WHILE:
+            walk_stores(sw, node->as.while_stmt.body);
+            break;
+        case AST_FOR:
+            walk_stores(sw, node->as.for_stmt.body);
+            break;
+        case AST_WITH:
+            walk_stores(sw, node->as.with_stmt.body);
+            break;
+        default:
+            // Nested defs run when called; they are checked if they are
+            // @parallel themselves
+            break;
+    }
+}
+
+bool parallel_analyze_function(ASTNode* module, ASTNode* func_def, FunctionWrites* out) {
+    memset(out, 0, sizeof(*out));
+    if (!func_def || func_def->type != AST_FUNCTION_DEF) return true;
+
+    NameSet shared = {0};
+    NameSet locals = {0};
+    bool ok = true;
+    for (int i = 0; ok && i < func_def->as.function_def.param_count; i++) {
+        ok = names_add(&shared, func_def->as.function_def.params[i].name) &&
+             names_add(&locals, func_def->as.function_def.params[i].name);
+    }
+    ok = ok && collect_locals(&locals, func_def->as.function_def.body);
+    Bindings b = { module, func_def, &locals };
+    ok = ok && collect_aliased(&b, &shared, func_def->as.function_def.body);
+    if (ok) {
+        StoreWalk sw = { out, &b, &shared, &locals, false };
+        walk_stores(&sw, func_def->as.function_def.body);
+        ok = !sw.failed;
+    }
+    names_free(&shared);
+    names_free(&locals);
+    if (!ok) {
+        parallel_function_free(out);
+        return false;
+    }
+    return true;
+}
+
+void parallel_function_free(FunctionWrites* writes) {
+    if (!writes) return;
+    free(writes->writes);
+    writes->writes = NULL;
+    writes->write_count = 0;
+}
+
+// === Entry point ===
+
+bool parallel_analyze_loop(ASTNode* module, ASTNode* func_def, ASTNode* loop,
+                           LoopAnalysis* out) {
+    memset(out, 0, sizeof(*out));
+    out->loop = loop;
+    out->independent = true;
+    if (!func_def || func_def->type != AST_FUNCTION_DEF || !loop || loop->type != AST_FOR) {
+        reject(out, "not a for loop in a function", NULL, loop);
+        return true;
+    }
+
+    NameSet locals = {0};
+    NameSet shared = {0};
+    bool ok = true;
+    for (int i = 0; ok && i < func_def->as.function_def.param_count; i++) {
+        ok = names_add(&locals, func_def->as.function_def.params[i].name) &&
+             names_add(&shared, func_def->as.function_def.params[i].name);
+    }
+    ok = ok && collect_locals(&locals, func_def->as.function_def.body);
+    Bindings b = { module, func_def, &locals };
+    ok = ok && collect_aliased(&b, &shared, func_def->as.function_def.body);
+
+    BodyWalk w = {0};
+    w.out = out;
+    w.bindings = &b;
+    w.shared = &shared;
+    w.loop_var = loop->as.for_stmt.var_name;
+    NameUse* var = use_of(&w, loop->as.for_stmt.var_name, loop);
+    if (var) var->writes++;
+    count_uses(&w, loop->as.for_stmt.body);
+
+    NameSet outside = {0};
+    OutsideWalk o = {0};
+    o.loop = loop;
+    o.reads = &outside;
+    o.after = inside_loop(func_def->as.function_def.body, loop, false);
+    collect_outside(&o, func_def->as.function_def.body);
+    ok = ok && !w.failed && !o.failed;
+
+    if (ok) {
+        CarryWalk c = { &w, NULL, false };
+        NameSet defined = {0};
+        if (names_add(&defined, loop->as.for_stmt.var_name)) {
+            check_stmt(&c, loop->as.for_stmt.body, &defined);
+        } else {
+            c.failed = true;
+        }
+        names_free(&defined);
+        ok = !c.failed;
+    }
+    ok = ok && classify(out, &w, &outside, &locals);
+
+    free(w.uses);
+    free(w.stores);
+    names_free(&outside);
+    names_free(&locals);
+    names_free(&shared);
+    if (!ok) {
+        parallel_loop_free(out);
+        return false;
+    }
+    // Without independence the reductions mean nothing
+    if (!out->independent) {
+        free(out->reductions);
+        out->reductions = NULL;
+        out->reduction_count = 0;
+    }
+    return true;
+}
+
+void parallel_loop_free(LoopAnalysis* analysis) {
+    if (!analysis) return;
+    free(analysis->reductions);
+    analysis->reductions = NULL;
+    analysis->reduction_count = 0;
+    free(analysis->writes);
+    analysis->writes = NULL;
+    analysis->write_count = 0;
+}
+
+static void describe_node(ASTNode* node, char* buf, size_t size, size_t* len) {
+    if (*len >= size) return;
+    int n;
+    switch (node ? node->type : AST_PASS) {
+        case AST_IDENTIFIER:
+            n = snprintf(buf + *len, size - *len, "%s", node->as.identifier.name);
+            break;
+        case AST_LITERAL_INT:
+            n = snprintf(buf + *len, size - *len, "%ld", node->as.literal_int.value);
+            break;
+        case AST_LITERAL_STRING:
+            n = snprintf(buf + *len, size - *len, "\"%s\"", node->as.literal_string.value);
+            break;
+        case AST_GROUPING:
+            describe_node(node->as.grouping.expression, buf, size, len);
+            return;
+        case AST_ATTRIBUTE:
+            describe_node(node->as.attribute.object, buf, size, len);
+            if (*len >= size) return;
+            n = snprintf(buf + *len, size - *len, ".%s", node->as.attribute.name);
+            break;
+        case AST_SUBSCRIPT:
+            describe_node(node->as.subscript.object, buf, size, len);
+            if (*len >= size) return;
+            n = snprintf(buf + *len, size - *len, "[");
+            if (n < 0) return;
+            *len += (size_t)n;
+            describe_node(node->as.subscript.index, buf, size, len);
+            if (*len >= size) return;
+            n = snprintf(buf + *len, size - *len, "]");
+            break;
+        case AST_CALL:
+            describe_node(node->as.call.callee, buf, size, len);
+            if (*len >= size) return;
+            n = snprintf(buf + *len, size - *len, "(...)");
+            break;
+        default:
+            n = snprintf(buf + *len, size - *len, "...");
+            break;
+    }
+    if (n > 0) *len += (size_t)n;
+}
+
+void parallel_describe_write(const ParallelWrite* write, char* buf, size_t size) {
+    if (size == 0) return;
+    buf[0] = '\0';
+    if (write->target) {
+        size_t len = 0;
+        describe_node(write->target, buf, size, &len);
+    } else {
+        snprintf(buf, size, "%s", write->name ? write->name : "?");
+    }
+}
+
+const char* write_class_to_string(WriteClass write_class) {
+    switch (write_class) {
+        case WRITE_PRIVATE: return "private";
+        case WRITE_REDUCTION: return "reduction";
+        case WRITE_CONFLICT: return "conflict";
+    }
+    return "?";
+}
+
+const char* reduction_kind_to_string(ReductionKind kind) {
+    switch (kind) {
+        case REDUCE_SUM: return "sum";
+        case REDUCE_PRODUCT: return "product";
+        case REDUCE_APPEND: return "append";
+    }
+    return "?";
+}
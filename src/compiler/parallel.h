@@ -0,0 +1,113 @@
+// parallel.h - Loop parallelization analysis for RHelix
+//
+// Decides whether the iterations of a `for` loop are independent, so the
+// backend can run the loop as chunks on the work-stealing scheduler. Every
+// name the loop body writes must be one of:
+//   - private: assigned before it is read in every iteration and never
+//     read after the loop (the loop variable, per-iteration temporaries);
+//   - a reduction: a local accumulator that the body only updates, with
+//     'x += e' / 'x -= e' (sum), 'x *= e' (product) or 'x.append(e)'
+//     statements (ordered concatenation), and never otherwise reads.
+// Stores into attributes and subscripts are private when the object was
+// created in the same iteration (by a literal, or by constructing a
+// module-level class - other callees may return an object they were
+// given or keep), or when 'xs[i] = e' writes a different
+// element in every iteration of 'for i in range(...)', the loop reads
+// 'xs' only as 'xs[i]', and no other name whose elements the loop reads
+// may be the same list (a parameter or a local assigned from another
+// name, unless 'xs' is a list the function builds). Anything else - stores into objects other
+// iterations can reach, values carried from one iteration to the next,
+// break or return - is a conflict and keeps the loop serial. Calls are
+// assumed not to write shared state: marking a function @parallel is the
+// programmer's promise about its callees.
+//
+// The body of an @parallel function as a whole is checked the same way
+// against concurrent calls: a store through a parameter, a global, or a
+// local that may alias one (anything not built by a literal or a
+// constructor in the function), or into the result of a call other than
+// a constructor, conflicts with the same store in another call. A read-modify-write
+// such as 'acct.balance = acct.balance - amount' can lose updates and is
+// reported as such.
+//
+// Each chunk starts its reductions at the identity (0, 1 or an empty
+// list), so once types are known the semantic analyzer keeps a sum or
+// product loop parallel only if its accumulator is an int or float. The
+// runtime combines chunk results in iteration order, so sums of floats
+// may round differently from the serial loop but appends keep their order.
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "ast.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum {
+    REDUCE_SUM,      // +=, -=: identity 0, chunks combined with +
+    REDUCE_PRODUCT,  // *=: identity 1, chunks combined with *
+    REDUCE_APPEND    // .append(e): identity [], chunks concatenated
+} ReductionKind;
+
+typedef struct {
+    const char* name;       // Accumulator, borrowed from the AST
+    ReductionKind kind;
+    ASTNode* node;          // First update in the loop body
+} LoopReduction;
+
+typedef enum {
+    WRITE_PRIVATE,     // Each iteration (or call) writes its own copy
+    WRITE_REDUCTION,   // Accumulator combined across chunks
+    WRITE_CONFLICT     // The same location is written by other iterations or calls
+} WriteClass;
+
+// One written name or store target, classified.
+typedef struct {
+    const char* name;       // Name written, or root of the stored-into object (borrowed)
+    ASTNode* target;        // Attribute/subscript target of a store; NULL for names
+    WriteClass write_class;
+    bool lost_update;       // A conflicting read-modify-write: updates can be lost
+    const char* reason;     // Why it conflicts
+    ASTNode* node;          // The (first) writing statement
+} ParallelWrite;
+
+typedef struct {
+    ASTNode* loop;          // The AST_FOR analyzed
+    bool independent;
+    const char* reason;     // Why not, when !independent
+    const char* reason_name;// Name involved, if any (borrowed)
+    ASTNode* reason_node;   // Where the problem was seen
+    LoopReduction* reductions;
+    int reduction_count;
+    ParallelWrite* writes;  // Every name and store target the body writes
+    int write_count;
+} LoopAnalysis;
+
+// Stores of an @parallel function body as seen by concurrent calls
+typedef struct {
+    ParallelWrite* writes;
+    int write_count;
+} FunctionWrites;
+
+// Analyze 'loop', an AST_FOR inside the body of 'func_def'. Callees are
+// resolved against the module-level defs and classes of 'module' (may be
+// NULL). Fills 'out' (free with parallel_loop_free) and returns false
+// only on allocation failure.
+bool parallel_analyze_loop(ASTNode* module, ASTNode* func_def, ASTNode* loop,
+                           LoopAnalysis* out);
+void parallel_loop_free(LoopAnalysis* analysis);
+
+// Classify the attribute and subscript stores in the body of 'func_def'
+// (outside nested definitions), resolving callees in 'module' as above.
+// Returns false only on allocation failure.
+bool parallel_analyze_function(ASTNode* module, ASTNode* func_def, FunctionWrites* out);
+void parallel_function_free(FunctionWrites* writes);
+
+// Render a written name or store target ('self.balance', 'xs[i]') into
+// 'buf' for diagnostics.
+void parallel_describe_write(const ParallelWrite* write, char* buf, size_t size);
+
+const char* write_class_to_string(WriteClass write_class);
+
+const char* reduction_kind_to_string(ReductionKind kind);
+
+#endif // PARALLEL_H
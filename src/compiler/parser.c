@@ -282,6 +282,19 @@ static ASTNode* unary(Parser* parser) {
         if (!operand) return NULL;
         return ast_unary(op->type, operand, op->line, op->column);
     }
+    // 'move x' transfers ownership of a local's reference. Only a bare name
+    // can give up its reference, so anything else is rejected here.
+    if (check(parser, TOKEN_MOVE)) {
+        Token* op = advance(parser);
+        ASTNode* operand = call(parser);
+        if (!operand) return NULL;
+        if (operand->type != AST_IDENTIFIER) {
+            ast_destroy(operand);
+            parser_error(parser, "'move' applies only to a variable name");
+            return NULL;
+        }
+        return ast_unary(TOKEN_MOVE, operand, op->line, op->column);
+    }
     return call(parser);
 }
 
@@ -902,10 +915,8 @@ static ASTNode* with_statement(Parser* parser) {
 //
 // Returns an AST node representing the type. For simple types this is an
 // Identifier. For compound types this is a Subscript wrapping the base
-// identifier, with the type arguments as the index. Multi-argument generics
-// like Dict[str, int] currently produce Subscript with only the FIRST arg
-// as the index - deferred cleanup: represent multi-arg generics properly
-// once we know if/how a real type-arg-list AST node is worth adding.
+// identifier, with the type argument as the index; a generic with several
+// arguments, like Dict[str, int], gets a List literal of them as its index.
 //
 // Returns NULL on error and sets parser->had_error.
 static ASTNode* parse_type_annotation(Parser* parser) {
@@ -923,41 +934,50 @@ static ASTNode* parse_type_annotation(Parser* parser) {
         Token* bracket_tok = previous(parser);
 
         // Parse the first type argument (recursive - types can be nested).
-        ASTNode* first_arg = parse_type_annotation(parser);
-        if (!first_arg) {
+        ASTNode* args = parse_type_annotation(parser);
+        if (!args) {
             ast_destroy(type);
             return NULL;
         }
 
-        // Additional type arguments after commas. For now we discard all
-        // but the first - see note above about deferred multi-arg support.
+        // Further arguments turn the index into a list of all of them
+        if (check(parser, TOKEN_COMMA)) {
+            ASTNode* list = ast_list_literal(bracket_tok->line, bracket_tok->column);
+            if (!list) {
+                ast_destroy(type);
+                ast_destroy(args);
+                return NULL;
+            }
+            ast_list_literal_add(list, args);
+            args = list;
+        }
         while (match(parser, TOKEN_COMMA)) {
             ASTNode* extra = parse_type_annotation(parser);
             if (!extra) {
                 ast_destroy(type);
-                ast_destroy(first_arg);
+                ast_destroy(args);
                 return NULL;
             }
-            ast_destroy(extra);  // Discard for v1
+            ast_list_literal_add(args, extra);
         }
 
         if (!consume(parser, TOKEN_RBRACKET,
                      "Expected ']' after generic type arguments")) {
             ast_destroy(type);
-            ast_destroy(first_arg);
+            ast_destroy(args);
             return NULL;
         }
 
-        // Wrap the accumulated type in a Subscript with the first arg.
+        // Wrap the accumulated type in a Subscript with the arguments.
         // This allows chaining: List[int][str] would parse as
         // Subscript(Subscript(List, int), str) - unusual but structurally
         // valid, and the walker doesn't need special casing.
-        ASTNode* subscript = ast_subscript(type, first_arg,
+        ASTNode* subscript = ast_subscript(type, args,
                                            bracket_tok->line,
                                            bracket_tok->column);
         if (!subscript) {
             ast_destroy(type);
-            ast_destroy(first_arg);
+            ast_destroy(args);
             return NULL;
         }
         type = subscript;
@@ -965,9 +985,12 @@ static ASTNode* parse_type_annotation(Parser* parser) {
 
     return type;
 }
-static bool parse_param(Parser* parser, char** out_name, ASTNode** out_type) {
+// param -> "owned"? IDENT ( ":" type )?
+static bool parse_param(Parser* parser, char** out_name, ASTNode** out_type,
+                        bool* out_owned) {
     *out_name = NULL;
     *out_type = NULL;
+    *out_owned = match(parser, TOKEN_OWNED);
     if (!check(parser, TOKEN_IDENTIFIER)) {
         parser_error(parser, "Expected parameter name");
         return false;
@@ -1008,20 +1031,23 @@ static ASTNode* function_def_statement(Parser* parser) {
     if (!check(parser, TOKEN_RPAREN)) {
         char* p_name;
         ASTNode* p_type;
-        if (!parse_param(parser, &p_name, &p_type)) {
+        bool p_owned;
+        if (!parse_param(parser, &p_name, &p_type, &p_owned)) {
             ast_destroy(func);
             return NULL;
         }
         ast_function_def_add_param(func, p_name, p_type);
+        func->as.function_def.params[func->as.function_def.param_count - 1].owned = p_owned;
         free(p_name);
 
         while (check(parser, TOKEN_COMMA)) {
             advance(parser);
-            if (!parse_param(parser, &p_name, &p_type)) {
+            if (!parse_param(parser, &p_name, &p_type, &p_owned)) {
                 ast_destroy(func);
                 return NULL;
             }
             ast_function_def_add_param(func, p_name, p_type);
+            func->as.function_def.params[func->as.function_def.param_count - 1].owned = p_owned;
             free(p_name);
         }
     }
@@ -7,9 +7,13 @@
 //
 // Future sessions will add symbol tables to each scope, name resolution
 // against the scope chain, break/continue validation, return validation,
-// and eventually type checking.
+// and eventually type checking. Type checking itself lives in typecheck.c
+// and runs after the walk.
 
 #include "semantic.h"
+#include "escape.h"
+#include "parallel.h"
+#include "typecheck.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,11 +25,34 @@ SemanticAnalyzer* semantic_create(void) {
     SemanticAnalyzer* sem = (SemanticAnalyzer*)malloc(sizeof(SemanticAnalyzer));
     if (!sem) return NULL;
     sem->current_scope = NULL;
+    sem->types = type_table_create();
+    if (!sem->types) {
+        free(sem);
+        return NULL;
+    }
     sem->had_error = false;
     sem->error_count = 0;
     sem->warning_count = 0;
     sem->max_depth_reached = 0;
     sem->debug_print_scopes = false;
+    sem->arena_escape_policy = ARENA_ESCAPE_PROMOTE;
+    sem->arena_kept_count = 0;
+    sem->arena_promoted_count = 0;
+    sem->debug_print_allocations = false;
+    sem->alloc_site_count = 0;
+    sem->stack_promoted_count = 0;
+    sem->parallel_loop_count = 0;
+    sem->serial_loop_count = 0;
+    sem->module = NULL;
+    sem->debug_print_loops = false;
+    sem->check_types = true;
+    sem->expression_count = 0;
+    sem->typed_expression_count = 0;
+    sem->debug_print_types = false;
+    sem->closure_count = 0;
+    sem->capture_count = 0;
+    sem->cell_capture_count = 0;
+    sem->debug_print_captures = false;
     return sem;
 }
 
@@ -36,6 +63,7 @@ void semantic_destroy(SemanticAnalyzer* sem) {
     while (sem->current_scope) {
         scope_pop(sem);
     }
+    type_table_destroy(sem->types);
     free(sem);
 }
 
@@ -49,6 +77,7 @@ void scope_push(SemanticAnalyzer* sem, ScopeKind kind) {
     scope->parent = sem->current_scope;
     scope->depth = sem->current_scope ? sem->current_scope->depth + 1 : 0;
     scope->symbol_table = NULL;  // Empty table on scope creation
+    scope->owner = NULL;         // Set by the walker for function scopes
     sem->current_scope = scope;
     if (scope->depth > sem->max_depth_reached) {
         sem->max_depth_reached = scope->depth;
@@ -78,7 +107,6 @@ void scope_pop(SemanticAnalyzer* sem) {
     while (sym) {
         Symbol* next = sym->next;
         free(sym->name);
-        type_destroy(sym->type);
         free(sym);
         sym = next;
     }
@@ -254,6 +282,643 @@ void semantic_warning(SemanticAnalyzer* sem, int line, int column,
 
 static void analyze_node(SemanticAnalyzer* sem, ASTNode* node);
 
+// decorator_name - Returns the name of '@name' or '@name(...)', or NULL for
+// other decorator shapes ('@module.name', subscripts, ...).
+static const char* decorator_name(ASTNode* decorator) {
+    if (!decorator) return NULL;
+    if (decorator->type == AST_CALL) decorator = decorator->as.call.callee;
+    if (decorator && decorator->type == AST_IDENTIFIER) {
+        return decorator->as.identifier.name;
+    }
+    return NULL;
+}
+
+// is_builtin_decorator - '@arena' and '@parallel' are given meaning by the
+// analyzer itself, so they resolve without a definition in scope.
+static bool is_builtin_decorator(const char* name) {
+    return name && (strcmp(name, "arena") == 0 || strcmp(name, "parallel") == 0);
+}
+
+// is_builtin_name - names the compiler gives meaning to when nothing in
+// scope defines them: 'range', 'min' and 'max', and the pipeline stages
+// the IR lowering fuses. A definition of the same name shadows them.
+static bool is_builtin_name(const char* name) {
+    static const char* builtins[] = {
+        "range", "min", "max",
+        "map", "filter", "take", "to_list", "find_first", "reduce", NULL
+    };
+    for (int i = 0; builtins[i]; i++) {
+        if (strcmp(name, builtins[i]) == 0) return true;
+    }
+    return false;
+}
+
+static bool has_decorator(ASTNode** decorators, int count, const char* name) {
+    for (int i = 0; i < count; i++) {
+        const char* dname = decorator_name(decorators[i]);
+        if (dname && strcmp(dname, name) == 0) return true;
+    }
+    return false;
+}
+
+// analyze_decorator - Walks a decorator expression. Builtin decorators skip
+// name resolution for the decorator name but still walk their arguments.
+static void analyze_decorator(SemanticAnalyzer* sem, ASTNode* decorator) {
+    if (!is_builtin_decorator(decorator_name(decorator))) {
+        analyze_node(sem, decorator);
+        return;
+    }
+    if (decorator->type == AST_CALL) {
+        for (int i = 0; i < decorator->as.call.arg_count; i++) {
+            analyze_node(sem, decorator->as.call.args[i]);
+        }
+    }
+}
+
+// Size limits for frame allocation. Literals larger than this (or that
+// grow past their inline capacity at runtime) live on the heap.
+#define STACK_MAX_LIST_ELEMENTS 16
+#define STACK_MAX_DICT_ENTRIES  8
+
+// is_stack_candidate - A site can live in its function's frame when no
+// reference to it can survive the call: it is never returned, stored into
+// another object, captured, or handed to a callee that might keep it. Sites
+// inside loops are skipped because each iteration would need a fresh slot.
+static bool is_stack_candidate(EscapeSite* site) {
+    if (site->escapes != ESCAPE_NONE || site->loop_depth > 0) return false;
+    switch (site->kind) {
+        case SITE_LIST:
+            return site->node->as.list_literal.count <= STACK_MAX_LIST_ELEMENTS;
+        case SITE_DICT:
+            return site->node->as.dict_literal.count <= STACK_MAX_DICT_ENTRIES;
+        case SITE_CLOSURE:
+            return site->node->type == AST_LAMBDA;
+        case SITE_CALL:
+            return false;  // The callee allocates the result
+    }
+    return false;
+}
+
+// defined_outside - EscapeIsDefined for escape.c: runs after the function's
+// scope is popped, so this sees the enclosing scopes and the module.
+static bool defined_outside(void* resolver, const char* name) {
+    return symbol_lookup((SemanticAnalyzer*)resolver, name) != NULL;
+}
+
+// analyze_function_allocations - Decides where each allocation in a
+// function body lives, using escape.c.
+//
+// Small non-escaping literals and lambdas go in the frame (stack
+// promotion). In an @arena function everything else lives in the arena,
+// which is freed on exit, so any allocation that can be returned, stored
+// into an object the function doesn't own, captured by a closure, or
+// handed to a callee (which may return or keep it) would dangle. Depending on the policy those sites are either moved to the
+// refcounted heap or rejected. Call results are always promoted rather than
+// rejected: the callee can simply allocate its result on the heap.
+static void analyze_function_allocations(SemanticAnalyzer* sem, ASTNode* func) {
+    bool is_arena = has_decorator(func->as.function_def.decorators,
+                                  func->as.function_def.decorator_count, "arena");
+    EscapeInfo* info = escape_analyze_function(func, defined_outside, sem);
+    if (!info) return;
+
+    const unsigned arena_escapes = ESCAPE_RETURN | ESCAPE_STORE | ESCAPE_CAPTURE | ESCAPE_ARG;
+    for (int i = 0; i < info->site_count; i++) {
+        EscapeSite* site = &info->sites[i];
+        unsigned escapes = site->escapes & arena_escapes;
+        ASTNode* at = site->escape_node ? site->escape_node : site->node;
+
+        if (site->kind != SITE_CALL) sem->alloc_site_count++;
+
+        const char* decision;
+        if (is_stack_candidate(site)) {
+            site->node->flags |= AST_FLAG_STACK_ALLOC;
+            sem->stack_promoted_count++;
+            decision = "stack";
+        } else if (!is_arena) {
+            decision = "heap";
+        } else if (!escapes) {
+            site->node->flags |= AST_FLAG_ARENA_ALLOC;
+            sem->arena_kept_count++;
+            decision = "arena";
+        } else if (sem->arena_escape_policy == ARENA_ESCAPE_REJECT &&
+                   site->kind != SITE_CALL) {
+            semantic_error(sem, at->line, at->column,
+                           "%s allocated at line %d escapes @arena function '%s' via %s",
+                           site_kind_to_string(site->kind), site->node->line,
+                           func->as.function_def.name,
+                           escape_kind_to_string(escapes));
+            decision = "rejected";
+        } else {
+            site->node->flags |= AST_FLAG_HEAP_PROMOTED;
+            sem->arena_promoted_count++;
+            decision = "heap";
+        }
+
+        // Call results outside @arena functions are ordinary heap values;
+        // listing them would only be noise.
+        if (sem->debug_print_allocations && (is_arena || site->kind != SITE_CALL)) {
+            printf("    %s%s: %s at line %d -> %s",
+                   is_arena ? "@arena " : "", func->as.function_def.name,
+                   site_kind_to_string(site->kind), site->node->line, decision);
+            if (site->escapes) {
+                printf(" (escapes via %s at line %d)",
+                       escape_kind_to_string(site->escapes), at->line);
+            }
+            printf("\n");
+        }
+    }
+
+    escape_info_destroy(info);
+}
+
+// reported_write - Was 'node' already diagnosed by the function-level check?
+static bool reported_write(const FunctionWrites* fw, ASTNode* node) {
+    for (int i = 0; i < fw->write_count; i++) {
+        if (fw->writes[i].write_class == WRITE_CONFLICT && fw->writes[i].node == node) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// analyze_parallel_loops - Finds the for loops of an @parallel function
+// that can run as independent chunks. A loop that qualifies is annotated
+// and its body left alone (nested loops run serially inside each chunk);
+// otherwise the loop gets a warning naming its first conflict, unless
+// that conflict was already reported against the whole function, and
+// loops nested in it are tried in turn.
+static void analyze_parallel_loops(SemanticAnalyzer* sem, ASTNode* func, ASTNode* node,
+                                   const FunctionWrites* fw) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                analyze_parallel_loops(sem, func, node->as.block.statements[i], fw);
+            }
+            break;
+        case AST_IF:
+            analyze_parallel_loops(sem, func, node->as.if_stmt.then_block, fw);
+            analyze_parallel_loops(sem, func, node->as.if_stmt.else_block, fw);
+            break;
+        case AST_WHILE:
+            analyze_parallel_loops(sem, func, node->as.while_stmt.body, fw);
+            break;
+        case AST_WITH:
+            analyze_parallel_loops(sem, func, node->as.with_stmt.body, fw);
+            break;
+        case AST_FOR: {
+            LoopAnalysis la;
+            if (!parallel_analyze_loop(sem->module, func, node, &la)) return;
+            char what[128];
+            if (la.independent) {
+                node->flags |= AST_FLAG_PARALLEL_LOOP;
+                sem->parallel_loop_count++;
+            } else {
+                sem->serial_loop_count++;
+                if (!reported_write(fw, la.reason_node)) {
+                    // Name the location rather than just its root
+                    what[0] = '\0';
+                    for (int i = 0; i < la.write_count; i++) {
+                        if (la.writes[i].node == la.reason_node) {
+                            parallel_describe_write(&la.writes[i], what, sizeof(what));
+                            break;
+                        }
+                    }
+                    if (!what[0] && la.reason_name) snprintf(what, sizeof(what), "%s", la.reason_name);
+                    int line = la.reason_node ? la.reason_node->line : node->line;
+                    semantic_warning(sem, node->line, node->column,
+                                     "for loop over '%s' in @parallel function '%s' runs "
+                                     "serially: %s%s%s%s at line %d",
+                                     node->as.for_stmt.var_name, func->as.function_def.name,
+                                     la.reason, what[0] ? " '" : "", what, what[0] ? "'" : "",
+                                     line);
+                }
+            }
+            if (sem->debug_print_loops) {
+                printf("    @parallel %s: for %s at line %d -> ",
+                       func->as.function_def.name, node->as.for_stmt.var_name, node->line);
+                if (la.independent) {
+                    printf("parallel");
+                    for (int i = 0; i < la.reduction_count; i++) {
+                        printf("%s%s (%s)", i == 0 ? ", reduces " : ", ",
+                               la.reductions[i].name,
+                               reduction_kind_to_string(la.reductions[i].kind));
+                    }
+                } else {
+                    printf("serial (%s", la.reason);
+                    if (la.reason_name) printf(" '%s'", la.reason_name);
+                    if (la.reason_node) printf(" at line %d", la.reason_node->line);
+                    printf(")");
+                }
+                printf("\n");
+                for (int i = 0; i < la.write_count; i++) {
+                    ParallelWrite* w = &la.writes[i];
+                    parallel_describe_write(w, what, sizeof(what));
+                    printf("      %s: %s", what, write_class_to_string(w->write_class));
+                    if (w->write_class == WRITE_CONFLICT) {
+                        printf(" (%s%s)", w->reason, w->lost_update ? ", lost update" : "");
+                    }
+                    printf(" at line %d\n", w->node->line);
+                }
+            }
+            if (!la.independent) analyze_parallel_loops(sem, func, node->as.for_stmt.body, fw);
+            parallel_loop_free(&la);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// analyze_parallel_function - Checks the stores of an @parallel function
+// against concurrent calls of the same function, then its loops. A
+// read-modify-write of state other calls can reach loses updates and is
+// an error; a plain store to it is a warning (the last writer wins).
+static void analyze_parallel_function(SemanticAnalyzer* sem, ASTNode* func) {
+    FunctionWrites fw;
+    if (!parallel_analyze_function(sem->module, func, &fw)) return;
+    for (int i = 0; i < fw.write_count; i++) {
+        ParallelWrite* w = &fw.writes[i];
+        if (w->write_class != WRITE_CONFLICT) continue;
+        char what[128];
+        parallel_describe_write(w, what, sizeof(what));
+        // A store into a call result has no name at its root
+        char sharing[140];
+        if (w->name) {
+            snprintf(sharing, sizeof(sharing), "'%s'", w->name);
+        } else {
+            snprintf(sharing, sizeof(sharing), "the object the call returns");
+        }
+        if (w->lost_update) {
+            semantic_error(sem, w->node->line, w->node->column,
+                           "conflicting update of '%s' in @parallel function '%s': "
+                           "concurrent calls sharing %s can lose updates",
+                           what, func->as.function_def.name, sharing);
+        } else {
+            semantic_warning(sem, w->node->line, w->node->column,
+                             "store into '%s' in @parallel function '%s' races with "
+                             "concurrent calls sharing %s",
+                             what, func->as.function_def.name, sharing);
+        }
+    }
+    analyze_parallel_loops(sem, func, func->as.function_def.body, &fw);
+    parallel_function_free(&fw);
+}
+
+// numeric_accumulator - Is every 'name op= e' in 'node' typed int or
+// float? Chunks start sums at 0 and products at 1, which is wrong for
+// strings and lists (and for anything whose type is unknown). Sets '*bad'
+// to the first other type found, or leaves it NULL when the type is
+// missing altogether.
+static bool numeric_accumulator(ASTNode* node, const char* name, Type** bad) {
+    if (!node) return true;
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                if (!numeric_accumulator(node->as.block.statements[i], name, bad)) {
+                    return false;
+                }
+            }
+            return true;
+        case AST_IF:
+            return numeric_accumulator(node->as.if_stmt.then_block, name, bad) &&
+                   numeric_accumulator(node->as.if_stmt.else_block, name, bad);
+        case AST_WHILE:
+            return numeric_accumulator(node->as.while_stmt.body, name, bad);
+        case AST_FOR:
+            return numeric_accumulator(node->as.for_stmt.body, name, bad);
+        case AST_WITH:
+            return numeric_accumulator(node->as.with_stmt.body, name, bad);
+        case AST_AUGMENTED_ASSIGNMENT: {
+            ASTNode* target = node->as.augmented_assignment.target;
+            if (target->type != AST_IDENTIFIER ||
+                strcmp(target->as.identifier.name, name) != 0) {
+                return true;
+            }
+            Type* t = target->inferred_type;
+            if (t && (t->kind == TYPE_INT || t->kind == TYPE_FLOAT)) return true;
+            *bad = t;
+            return false;
+        }
+        default:
+            return true;
+    }
+}
+
+// check_parallel_reductions - Once types are known, moves parallel loops
+// whose sum or product accumulator is not an int or float back to serial
+// (loops nested in them are tried in turn), with a warning.
+static void check_parallel_reductions(SemanticAnalyzer* sem, ASTNode* func, ASTNode* node) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_MODULE:
+            for (int i = 0; i < node->as.module.count; i++) {
+                check_parallel_reductions(sem, NULL, node->as.module.statements[i]);
+            }
+            break;
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                check_parallel_reductions(sem, func, node->as.block.statements[i]);
+            }
+            break;
+        case AST_FUNCTION_DEF:
+            check_parallel_reductions(sem, node, node->as.function_def.body);
+            break;
+        case AST_CLASS_DEF:
+            check_parallel_reductions(sem, func, node->as.class_def.body);
+            break;
+        case AST_IF:
+            check_parallel_reductions(sem, func, node->as.if_stmt.then_block);
+            check_parallel_reductions(sem, func, node->as.if_stmt.else_block);
+            break;
+        case AST_WHILE:
+            check_parallel_reductions(sem, func, node->as.while_stmt.body);
+            break;
+        case AST_WITH:
+            check_parallel_reductions(sem, func, node->as.with_stmt.body);
+            break;
+        case AST_FOR: {
+            ASTNode* body = node->as.for_stmt.body;
+            if (!func || !(node->flags & AST_FLAG_PARALLEL_LOOP)) {
+                check_parallel_reductions(sem, func, body);
+                break;
+            }
+            LoopAnalysis la;
+            if (!parallel_analyze_loop(sem->module, func, node, &la)) break;
+            const char* name = NULL;
+            Type* bad = NULL;
+            for (int i = 0; i < la.reduction_count && !name; i++) {
+                if (la.reductions[i].kind == REDUCE_APPEND) continue;
+                if (!numeric_accumulator(body, la.reductions[i].name, &bad)) {
+                    name = la.reductions[i].name;
+                }
+            }
+            if (name) {
+                char* type = bad ? type_to_string(bad) : NULL;
+                node->flags &= ~AST_FLAG_PARALLEL_LOOP;
+                sem->parallel_loop_count--;
+                sem->serial_loop_count++;
+                semantic_warning(sem, node->line, node->column,
+                                 "for loop over '%s' in @parallel function '%s' runs "
+                                 "serially: accumulator '%s' is %s, not int or float",
+                                 node->as.for_stmt.var_name, func->as.function_def.name,
+                                 name, type ? type : "of unknown type");
+                if (sem->debug_print_loops) {
+                    printf("    @parallel %s: for %s at line %d -> serial (%s accumulator '%s')\n",
+                           func->as.function_def.name, node->as.for_stmt.var_name,
+                           node->line, type ? type : "untyped", name);
+                }
+                free(type);
+                FunctionWrites fw;
+                if (parallel_analyze_function(sem->module, func, &fw)) {
+                    analyze_parallel_loops(sem, func, body, &fw);
+                    parallel_function_free(&fw);
+                }
+                check_parallel_reductions(sem, func, body);
+            }
+            parallel_loop_free(&la);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// === Closure captures ===
+//
+// A name a def or lambda reads is a capture when it resolves to a local of
+// an enclosing function (its owner) rather than the module or a class.
+// Every function between the use and the owner captures it, so a closure
+// can hand the value on to the closures it makes. The language has no
+// 'nonlocal', so only the owner ever binds a captured variable; whether
+// the closure may see it change is decided from the owner's body alone.
+
+typedef struct {
+    const char* name;
+    int count;            // Bindings in the owner's own body, parameters included
+    bool in_loop;         // Some binding runs inside a loop
+    ASTNode* binding;     // The last binding found
+} BindingCount;
+
+static bool names_parameter(ASTNode* func, const char* name) {
+    if (func->type == AST_LAMBDA) {
+        for (int i = 0; i < func->as.lambda.param_count; i++) {
+            if (strcmp(func->as.lambda.param_names[i], name) == 0) return true;
+        }
+    } else if (func->type == AST_FUNCTION_DEF) {
+        for (int i = 0; i < func->as.function_def.param_count; i++) {
+            if (strcmp(func->as.function_def.params[i].name, name) == 0) return true;
+        }
+    }
+    return false;
+}
+
+static bool binds(ASTNode* target, const char* name) {
+    return target && target->type == AST_IDENTIFIER &&
+           strcmp(target->as.identifier.name, name) == 0;
+}
+
+static void count_binding(BindingCount* bc, ASTNode* stmt, int loop_depth) {
+    bc->count++;
+    if (loop_depth > 0) bc->in_loop = true;
+    bc->binding = stmt;
+}
+
+// Statements binding bc->name, not looking inside nested defs and classes
+// (whose names are their own).
+static void count_bindings(BindingCount* bc, ASTNode* node, int loop_depth) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                count_bindings(bc, node->as.block.statements[i], loop_depth);
+            }
+            break;
+        case AST_ASSIGNMENT:
+            if (binds(node->as.assignment.target, bc->name)) {
+                count_binding(bc, node, loop_depth);
+            }
+            break;
+        case AST_AUGMENTED_ASSIGNMENT:
+            if (binds(node->as.augmented_assignment.target, bc->name)) {
+                count_binding(bc, node, loop_depth);
+            }
+            break;
+        case AST_IF:
+            count_bindings(bc, node->as.if_stmt.then_block, loop_depth);
+            count_bindings(bc, node->as.if_stmt.else_block, loop_depth);
+            break;
+        case AST_WHILE:
+            count_bindings(bc, node->as.while_stmt.body, loop_depth + 1);
+            break;
+        case AST_FOR:
+            if (strcmp(node->as.for_stmt.var_name, bc->name) == 0) {
+                count_binding(bc, node, loop_depth + 1);
+            }
+            count_bindings(bc, node->as.for_stmt.body, loop_depth + 1);
+            break;
+        case AST_WITH:
+            if (node->as.with_stmt.var_name &&
+                strcmp(node->as.with_stmt.var_name, bc->name) == 0) {
+                count_binding(bc, node, loop_depth);
+            }
+            count_bindings(bc, node->as.with_stmt.body, loop_depth);
+            break;
+        case AST_FUNCTION_DEF:
+            if (strcmp(node->as.function_def.name, bc->name) == 0) {
+                count_binding(bc, node, loop_depth);
+            }
+            break;
+        case AST_CLASS_DEF:
+            if (strcmp(node->as.class_def.name, bc->name) == 0) {
+                count_binding(bc, node, loop_depth);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Does expression 'node' make the closure 'target' (directly, not from
+// inside another lambda's body)?
+static bool makes_closure(ASTNode* node, ASTNode* target) {
+    if (!node) return false;
+    if (node == target) return true;
+    switch (node->type) {
+        case AST_BINARY:
+            return makes_closure(node->as.binary.left, target) ||
+                   makes_closure(node->as.binary.right, target);
+        case AST_UNARY:
+            return makes_closure(node->as.unary.operand, target);
+        case AST_GROUPING:
+            return makes_closure(node->as.grouping.expression, target);
+        case AST_CALL:
+            if (makes_closure(node->as.call.callee, target)) return true;
+            for (int i = 0; i < node->as.call.arg_count; i++) {
+                if (makes_closure(node->as.call.args[i], target)) return true;
+            }
+            return false;
+        case AST_SUBSCRIPT:
+            return makes_closure(node->as.subscript.object, target) ||
+                   makes_closure(node->as.subscript.index, target);
+        case AST_ATTRIBUTE:
+            return makes_closure(node->as.attribute.object, target);
+        case AST_LIST_LITERAL:
+            for (int i = 0; i < node->as.list_literal.count; i++) {
+                if (makes_closure(node->as.list_literal.elements[i], target)) return true;
+            }
+            return false;
+        case AST_DICT_LITERAL:
+            for (int i = 0; i < node->as.dict_literal.count; i++) {
+                if (makes_closure(node->as.dict_literal.entries[i].key, target) ||
+                    makes_closure(node->as.dict_literal.entries[i].value, target)) {
+                    return true;
+                }
+            }
+            return false;
+        case AST_TERNARY:
+            return makes_closure(node->as.ternary.then_expr, target) ||
+                   makes_closure(node->as.ternary.condition, target) ||
+                   makes_closure(node->as.ternary.else_expr, target);
+        default:
+            return false;
+    }
+}
+
+// The statement binding 'name' in 'owner' when it is bound exactly once,
+// outside any loop; NULL otherwise.
+static ASTNode* only_binding(ASTNode* owner, const char* name) {
+    BindingCount bc = { name, 0, false, NULL };
+    if (names_parameter(owner, name)) count_binding(&bc, owner, 0);
+    if (owner->type == AST_FUNCTION_DEF) count_bindings(&bc, owner->as.function_def.body, 0);
+    return bc.count == 1 && !bc.in_loop ? bc.binding : NULL;
+}
+
+// Can 'owner' rebind 'name' after making 'closure' (the def or lambda in
+// its body the use is in)? A variable with one binding outside any loop
+// cannot, unless that binding is what makes the closure: 'f = x => f(x)'
+// and a def calling itself see their own name before it is bound.
+static bool capture_mutated(ASTNode* owner, ASTNode* closure, const char* name) {
+    ASTNode* binding = only_binding(owner, name);
+    if (!binding) return true;
+    switch (binding->type) {
+        case AST_FUNCTION_DEF:
+            return binding == closure;
+        case AST_ASSIGNMENT:
+            return makes_closure(binding->as.assignment.value, closure);
+        case AST_WITH:
+            return makes_closure(binding->as.with_stmt.context, closure);
+        default:
+            return false;
+    }
+}
+
+// Record 'name', read in the current scope, as a capture of every
+// function between here and the function it is a local of.
+static void record_capture(SemanticAnalyzer* sem, const char* name) {
+    Scope* holder = NULL;
+    for (Scope* scope = sem->current_scope; scope && !holder; scope = scope->parent) {
+        for (Symbol* s = scope->symbol_table; s; s = s->next) {
+            if (strcmp(s->name, name) == 0) {
+                holder = scope;
+                break;
+            }
+        }
+    }
+    Scope* owner = holder;
+    while (owner && !owner->owner) {
+        if (owner->kind == SCOPE_CLASS) return;  // Class attribute
+        owner = owner->parent;
+    }
+    if (!owner) return;  // Module-level name
+
+    // Methods of a class nested in a function make no closure to carry
+    // captures in, so names reached through a class body are left alone.
+    ASTNode* outermost = NULL;
+    for (Scope* s = sem->current_scope; s != owner; s = s->parent) {
+        if (s->kind == SCOPE_CLASS) return;
+        if (s->owner) outermost = s->owner;
+    }
+    if (!outermost) return;  // A local of the current function
+
+    // A def whose one binding of its own name is itself reads that name as
+    // the running closure, which a cell would otherwise hold in a cycle
+    // with it. Closures inside it copy the name from it.
+    bool self = outermost->type == AST_FUNCTION_DEF &&
+                outermost->as.function_def.decorator_count == 0 &&
+                only_binding(owner->owner, name) == outermost;
+    bool mutated = !self && capture_mutated(owner->owner, outermost, name);
+    if (self) outermost->flags |= AST_FLAG_SELF_CLOSURE;
+    for (Scope* s = sem->current_scope; s != owner; s = s->parent) {
+        if (s->owner && !(self && s->owner == outermost)) ast_add_capture(s->owner, name, mutated);
+    }
+}
+
+// Mark a def or lambda as converted and count its captures.
+static void finish_captures(SemanticAnalyzer* sem, ASTNode* func) {
+    func->flags |= AST_FLAG_CAPTURES;
+    int count;
+    const ASTCapture* captures = ast_captures(func, &count);
+    if (sem->debug_print_captures && (func->flags & AST_FLAG_SELF_CLOSURE)) {
+        printf("    %s reads itself as its running closure\n", func->as.function_def.name);
+    }
+    if (count == 0) return;
+    sem->closure_count++;
+    sem->capture_count += count;
+    for (int i = 0; i < count; i++) {
+        if (captures[i].mutated) sem->cell_capture_count++;
+    }
+    if (sem->debug_print_captures) {
+        if (func->type == AST_LAMBDA) printf("    lambda at line %d captures", func->line);
+        else printf("    %s captures", func->as.function_def.name);
+        for (int i = 0; i < count; i++) {
+            printf("%s %s%s", i > 0 ? "," : "", captures[i].name,
+                   captures[i].mutated ? " (cell)" : "");
+        }
+        printf("\n");
+    }
+}
+
 static void analyze_block_body(SemanticAnalyzer* sem, ASTNode* block) {
     if (!block || block->type != AST_BLOCK) return;
     for (int i = 0; i < block->as.block.count; i++) {
@@ -293,9 +958,11 @@ static void analyze_node(SemanticAnalyzer* sem, ASTNode* node) {
           // scope chain. Assignment targets are pre-defined by AST_ASSIGNMENT
           // before recursion reaches here, so lookup will succeed for them.
           const char* name = node->as.identifier.name;
-          if (name && !symbol_lookup(sem, name)) {
+          if (name && !symbol_lookup(sem, name) && !is_builtin_name(name)) {
               semantic_error(sem, node->line, node->column,
                              "undefined name '%s'", name);
+          } else if (name) {
+              record_capture(sem, name);
           }
           break;
       }
@@ -376,8 +1043,8 @@ static void analyze_node(SemanticAnalyzer* sem, ASTNode* node) {
                 node->line, node->column);
           if (asym) {
               // Infer type from RHS literal if possible; otherwise ANY.
-              Type* rhs_type = type_of_literal(node->as.assignment.value);
-              asym->type = rhs_type ? rhs_type : type_create_primitive(TYPE_ANY);
+              Type* rhs_type = type_of_literal(sem->types, node->as.assignment.value);
+              asym->type = rhs_type ? rhs_type : type_create_primitive(sem->types, TYPE_ANY);
           }
           }
             analyze_node(sem, node->as.assignment.target);
@@ -433,7 +1100,7 @@ static void analyze_node(SemanticAnalyzer* sem, ASTNode* node) {
             if (node->as.for_stmt.var_name) {
               Symbol* fsym = symbol_define(sem, node->as.for_stmt.var_name,
                           SYM_VARIABLE, node->line, node->column);
-              if (fsym) fsym->type = type_create_primitive(TYPE_ANY);
+              if (fsym) fsym->type = type_create_primitive(sem->types, TYPE_ANY);
             }
             analyze_block_body(sem, node->as.for_stmt.body);
             scope_pop(sem);
@@ -446,7 +1113,7 @@ static void analyze_node(SemanticAnalyzer* sem, ASTNode* node) {
             if (node->as.with_stmt.var_name) {
               Symbol* wsym = symbol_define(sem, node->as.with_stmt.var_name,
                           SYM_VARIABLE, node->line, node->column);
-              if (wsym) wsym->type = type_create_primitive(TYPE_ANY);
+              if (wsym) wsym->type = type_create_primitive(sem->types, TYPE_ANY);
             }
             analyze_block_body(sem, node->as.with_stmt.body);
             scope_pop(sem);
@@ -454,7 +1121,7 @@ static void analyze_node(SemanticAnalyzer* sem, ASTNode* node) {
 
         case AST_FUNCTION_DEF:
           for (int i = 0; i < node->as.function_def.decorator_count; i++) {
-                analyze_node(sem, node->as.function_def.decorators[i]);
+                analyze_decorator(sem, node->as.function_def.decorators[i]);
             }
             // Define the function/method in the ENCLOSING scope. Whether
             // this is SYM_FUNCTION or SYM_METHOD depends on whether we're
@@ -474,38 +1141,51 @@ static void analyze_node(SemanticAnalyzer* sem, ASTNode* node) {
                         ? (Type**)malloc(sizeof(Type*) * pc)
                         : NULL;
                     for (int i = 0; i < pc; i++) {
-                        ptypes[i] = type_from_annotation(
+                        ptypes[i] = type_from_annotation(sem->types,
                             node->as.function_def.params[i].type_annotation);
                     }
-                    Type* ret = type_from_annotation(
+                    Type* ret = type_from_annotation(sem->types,
                         node->as.function_def.return_type);
-                    fsym->type = type_create_function(ptypes, pc, ret);
+                    fsym->type = type_create_function(sem->types, ptypes, pc, ret);
+                    free(ptypes);
                 }
             }
             scope_push(sem, SCOPE_FUNCTION);
+            sem->current_scope->owner = node;
             // Parameters live in the function's own scope.
             for (int i = 0; i < node->as.function_def.param_count; i++) {
                 Symbol* psym = symbol_define(sem, node->as.function_def.params[i].name,
                               SYM_PARAMETER, node->line, node->column);
                 if (psym) {
-                    psym->type = type_from_annotation(
+                    psym->type = type_from_annotation(sem->types,
                         node->as.function_def.params[i].type_annotation);
                 }
             }
             analyze_block_body(sem, node->as.function_def.body);
             scope_pop(sem);
+            if (!sem->had_error) finish_captures(sem, node);
+            if (!sem->had_error) {
+                analyze_function_allocations(sem, node);
+            }
+            if (!sem->had_error &&
+                has_decorator(node->as.function_def.decorators,
+                              node->as.function_def.decorator_count, "parallel")) {
+                analyze_parallel_function(sem, node);
+            }
             break;
 
       case AST_LAMBDA:
         scope_push(sem, SCOPE_LAMBDA);
+        sem->current_scope->owner = node;
         // Lambda parameters live in the lambda's own scope.
         for (int i = 0; i < node->as.lambda.param_count; i++) {
             Symbol* lsym = symbol_define(sem, node->as.lambda.param_names[i],
                           SYM_PARAMETER, node->line, node->column);
-            if (lsym) lsym->type = type_create_primitive(TYPE_ANY);
+            if (lsym) lsym->type = type_create_primitive(sem->types, TYPE_ANY);
         }
         analyze_node(sem, node->as.lambda.body);
         scope_pop(sem);
+        if (!sem->had_error) finish_captures(sem, node);
         break;
 
       case AST_TERNARY:
@@ -517,13 +1197,13 @@ static void analyze_node(SemanticAnalyzer* sem, ASTNode* node) {
 
         case AST_CLASS_DEF:
             for (int i = 0; i < node->as.class_def.decorator_count; i++) {
-                analyze_node(sem, node->as.class_def.decorators[i]);
+                analyze_decorator(sem, node->as.class_def.decorators[i]);
             }
             // Define the class in the enclosing scope.
             if (node->as.class_def.name) {
               Symbol* csym = symbol_define(sem, node->as.class_def.name,
                         SYM_CLASS, node->line, node->column);
-              if (csym) csym->type = type_create_primitive(TYPE_ANY);
+              if (csym) csym->type = type_create_primitive(sem->types, TYPE_ANY);
             }
             scope_push(sem, SCOPE_CLASS);
             analyze_block_body(sem, node->as.class_def.body);
@@ -553,6 +1233,7 @@ static void analyze_node(SemanticAnalyzer* sem, ASTNode* node) {
 bool semantic_analyze(SemanticAnalyzer* sem, ASTNode* module) {
     if (!sem || !module || module->type != AST_MODULE) return false;
 
+    sem->module = module;
     scope_push(sem, SCOPE_MODULE);
     analyze_node(sem, module);
     scope_pop(sem);
@@ -563,5 +1244,11 @@ bool semantic_analyze(SemanticAnalyzer* sem, ASTNode* module) {
         sem->had_error = true;
     }
 
+    // Types are only meaningful once every name resolves, and parallel
+    // sums and products are only safe for the types they hold
+    bool resolved = !sem->had_error;
+    if (resolved && sem->check_types) typecheck_module(sem, module);
+    if (resolved) check_parallel_reductions(sem, NULL, module);
+
     return !sem->had_error;
 }
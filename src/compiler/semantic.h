@@ -46,22 +46,32 @@ typedef struct Symbol {
     int defined_column;
     struct Symbol* next;     // Next symbol in the same scope's table
     int param_count;         // Number of declared params (SYM_FUNCTION/METHOD only, -1 otherwise)
-    Type* type;              // Inferred or declared type of this symbol (owned)
+    Type* type;              // Inferred or declared type of this symbol (interned in sem->types)
 } Symbol;
 
 typedef struct Scope {
     ScopeKind kind;
     struct Scope* parent;  // NULL only for the module scope
+    ASTNode* owner;        // FUNCTION and LAMBDA scopes: their def or lambda
     int depth;             // 0 for module, increments with each push
     Symbol* symbol_table;  // Head of the linked list of symbols in this scope
 } Scope;
 
+// ArenaEscapePolicy decides what happens to a value allocated inside an
+// @arena function that can outlive the arena (returned, stored into an
+// object the function doesn't own, or captured by a closure).
+typedef enum {
+    ARENA_ESCAPE_PROMOTE,  // Allocate the escaping value on the refcounted heap instead
+    ARENA_ESCAPE_REJECT    // Report a semantic error at the escape point
+} ArenaEscapePolicy;
+
 // SemanticAnalyzer holds all state that persists across the entire analysis
 // of one module. Right now that's just the current scope pointer and an
 // error flag. As we add features (symbol tables, type environments, error
 // lists), they land in this struct.
 typedef struct {
     Scope* current_scope;
+    TypeTable* types;  // Interns every Type the analysis creates
     bool had_error;
     int error_count;   // Number of semantic errors reported during analysis
     int warning_count; // Number of semantic warnings emitted (non-fatal)
@@ -69,6 +79,46 @@ typedef struct {
     // debugging and validates that push/pop are balanced.
     int max_depth_reached;
     bool debug_print_scopes;  // If true, scope_pop prints symbol table before freeing
+
+    // @arena escape analysis. Allocation sites inside @arena functions are
+    // annotated AST_FLAG_ARENA_ALLOC or AST_FLAG_HEAP_PROMOTED.
+    ArenaEscapePolicy arena_escape_policy;
+    int arena_kept_count;      // Sites that stay in their arena
+    int arena_promoted_count;  // Sites moved to the heap because they escape
+
+    // Stack promotion (per-module statistics). Small list/dict literals and
+    // closures that never leave their function are annotated
+    // AST_FLAG_STACK_ALLOC and allocated in the frame without refcounting.
+    int alloc_site_count;      // List/dict/closure sites seen in function bodies
+    int stack_promoted_count;  // ...of which promoted to the stack
+    bool debug_print_allocations;  // If true, print the placement of every site
+
+    // Parallel loops. For loops in @parallel functions whose iterations are
+    // proven independent (parallel.c), and whose sums and products are of
+    // ints or floats, are annotated AST_FLAG_PARALLEL_LOOP; the others stay
+    // serial.
+    int parallel_loop_count;
+    int serial_loop_count;
+    ASTNode* module;           // Module being analyzed, for resolving callees
+    bool debug_print_loops;    // If true, print the decision for every loop
+
+    // Type checking (typecheck.c). Runs once the walk finds no errors;
+    // every expression node gets its ASTNode.inferred_type.
+    bool check_types;              // On by default
+    int expression_count;          // Expressions the checker visited
+    int typed_expression_count;    // ...of which inferred to a type other than any
+    bool debug_print_types;        // If true, print the inferred type of every local
+
+    // Closure captures. Every def and lambda gets the names it reads from
+    // enclosing functions (ASTFunctionDef.captures, ASTLambda.captures) and
+    // AST_FLAG_CAPTURES. A capture is mutated when its owner may rebind it
+    // after the closure is made - it is bound more than once, inside a
+    // loop, or by the statement that makes the closure - and then lives in
+    // a cell shared with the owner; otherwise the closure gets a copy.
+    int closure_count;             // Defs and lambdas that capture something
+    int capture_count;             // Their captures, all told
+    int cell_capture_count;        // ...of which mutated
+    bool debug_print_captures;     // If true, print the captures of every closure
 } SemanticAnalyzer;
 
 // === Lifecycle ===
@@ -1027,5 +1027,18 @@ int main(void) {
        "    def lookup(self, key):\n"
        "        return self.store[key] if key in self.store else None\n");
 
+   printf("\n\n========== OWNERSHIP HINT TESTS ==========\n");
+
+   // 'move x' is a Unary(MOVE) over the name; 'owned' marks the param.
+   test_module_case("move as call argument",
+       "push(queue, move item)\n");
+
+   test_module_case("owned parameter",
+       "def adopt(self, owned child: Node, name):\n"
+       "    self.children.append(move child)\n");
+
+   test_module_case("Error: move of a non-name",
+       "x = move a.b\n");
+
     return 0;
 }
@@ -0,0 +1,790 @@
+// typecheck.c - Local type inference and checking (see typecheck.h)
+
+#include "typecheck.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+// Rounds of joining a function's locals before giving up on a fixed
+// point. Each round can only move a local up the lattice (unset, then a
+// concrete type, then a wider one, then any), so a handful is plenty.
+#define MAX_JOIN_ROUNDS 8
+
+// A name assigned in a function body (or at module level).
+typedef struct {
+    const char* name;
+    Type* type;                  // NULL until something is assigned
+    bool declared;               // Parameter: checked against, never widened
+    Type* checked;               // Join of the types assigned while reporting
+    Type* first;                 // First type assigned while reporting, and where
+    int first_line;
+    Type* conflict;              // First type that did not join, and where
+    int conflict_line;
+    int conflict_column;
+} Local;
+
+typedef struct Env {
+    Local* locals;
+    int count;
+    int capacity;
+    struct Env* outer;           // Enclosing function or lambda, then the module
+} Env;
+
+// Module-level functions by name, for calls
+typedef struct {
+    const char* name;
+    Type* type;
+} FuncEntry;
+
+typedef struct {
+    SemanticAnalyzer* sem;
+    TypeTable* tt;
+    FuncEntry* funcs;            // Open addressing, power-of-two capacity
+    size_t func_capacity;
+    Env* env;
+    Type* return_type;           // Declared return type being checked, or NULL
+    const char* func_name;
+    bool report;                 // Off while the locals are being joined
+    bool changed;                // Some local moved this round
+    Type* any;
+    Type* t_int;
+    Type* t_float;
+    Type* t_str;
+    Type* t_bool;
+    Type* t_none;
+} Checker;
+
+static Type* infer(Checker* c, ASTNode* node);
+static void check_block(Checker* c, ASTNode* block);
+static void check_function(Checker* c, ASTNode* def);
+
+// ============================================================
+// Diagnostics
+// ============================================================
+
+// Type names for messages, in a small ring of buffers so one message can
+// name several types without freeing anything.
+static const char* tname(Type* t) {
+    static char ring[4][128];
+    static int next;
+    char* buf = ring[next++ & 3];
+    char* s = type_to_string(t);
+    snprintf(buf, sizeof(ring[0]), "%s", s ? s : "?");
+    free(s);
+    return buf;
+}
+
+static const char* op_symbol(TokenType op) {
+    switch (op) {
+        case TOKEN_PLUS: return "+";
+        case TOKEN_MINUS: return "-";
+        case TOKEN_STAR: return "*";
+        case TOKEN_SLASH: return "/";
+        case TOKEN_PERCENT: return "%";
+        case TOKEN_LESS: return "<";
+        case TOKEN_GREATER: return ">";
+        case TOKEN_LESS_EQUALS: return "<=";
+        case TOKEN_GREATER_EQUALS: return ">=";
+        default: return token_type_to_string(op);
+    }
+}
+
+static void type_error(Checker* c, ASTNode* at, const char* format, ...) {
+    if (!c->report) return;
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    semantic_error(c->sem, at->line, at->column, "%s", message);
+}
+
+// ============================================================
+// The lattice
+// ============================================================
+
+static bool is_numeric(Checker* c, Type* t) {
+    return t == c->t_int || t == c->t_float;
+}
+
+// Can a value of type 'from' go where 'to' is expected? any is consistent
+// with everything, and an int may go where a float is expected.
+static bool consistent(Checker* c, Type* from, Type* to) {
+    if (!from || !to || from == to || from == c->any || to == c->any) return true;
+    if (from == c->t_int && to == c->t_float) return true;
+    if (from->kind != to->kind) return false;
+    switch (from->kind) {
+        case TYPE_LIST:
+            return consistent(c, from->element_type, to->element_type);
+        case TYPE_DICT:
+            return consistent(c, from->key_type, to->key_type) &&
+                   consistent(c, from->element_type, to->element_type);
+        case TYPE_FUNCTION:
+            if (from->param_count != to->param_count) return false;
+            for (int i = 0; i < from->param_count; i++) {
+                if (!consistent(c, to->param_types[i], from->param_types[i])) return false;
+            }
+            return consistent(c, from->return_type, to->return_type);
+        default:
+            return false;
+    }
+}
+
+// Least upper bound of two types; NULL is "nothing assigned yet". Lists,
+// dicts and functions of the same arity join element by element. Sets
+// '*conflict' for types with no useful bound (int and str, say), whose
+// join is any.
+static Type* join(Checker* c, Type* a, Type* b, bool* conflict) {
+    if (!a) return b;
+    if (!b || a == b) return a;
+    if (a == c->any || b == c->any || a == c->t_none || b == c->t_none) return c->any;
+    if (is_numeric(c, a) && is_numeric(c, b)) return c->t_float;
+    if (a->kind == TYPE_LIST && b->kind == TYPE_LIST) {
+        return type_create_list(c->tt, join(c, a->element_type, b->element_type, conflict));
+    }
+    if (a->kind == TYPE_DICT && b->kind == TYPE_DICT) {
+        Type* k = join(c, a->key_type, b->key_type, conflict);
+        return type_create_dict(c->tt, k, join(c, a->element_type, b->element_type, conflict));
+    }
+    if (a->kind == TYPE_FUNCTION && b->kind == TYPE_FUNCTION &&
+        a->param_count == b->param_count) {
+        int pc = a->param_count;
+        Type* params[pc > 0 ? pc : 1];
+        for (int i = 0; i < pc; i++) {
+            params[i] = join(c, a->param_types[i], b->param_types[i], conflict);
+        }
+        return type_create_function(c->tt, params, pc,
+                                    join(c, a->return_type, b->return_type, conflict));
+    }
+    *conflict = true;
+    return c->any;
+}
+
+// ============================================================
+// Names
+// ============================================================
+
+static size_t hash_name(const char* s) {
+    size_t h = 14695981039346656037ULL;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+    return h;
+}
+
+static Type* function_type(Checker* c, ASTNode* def) {
+    int pc = def->as.function_def.param_count;
+    Type* params[pc > 0 ? pc : 1];
+    for (int i = 0; i < pc; i++) {
+        params[i] = type_from_annotation(c->tt, def->as.function_def.params[i].type_annotation);
+    }
+    return type_create_function(c->tt, params, pc,
+                                type_from_annotation(c->tt, def->as.function_def.return_type));
+}
+
+// Index the module's functions. A redefinition keeps the first signature,
+// which is the one the redeclaration warning points at.
+static bool index_functions(Checker* c, ASTNode* module) {
+    size_t n = 0;
+    for (int i = 0; i < module->as.module.count; i++) {
+        if (module->as.module.statements[i]->type == AST_FUNCTION_DEF) n++;
+    }
+    size_t capacity = 16;
+    while (capacity < n * 2) capacity <<= 1;
+    c->funcs = (FuncEntry*)calloc(capacity, sizeof(FuncEntry));
+    if (!c->funcs) return false;
+    c->func_capacity = capacity;
+    for (int i = 0; i < module->as.module.count; i++) {
+        ASTNode* def = module->as.module.statements[i];
+        if (def->type != AST_FUNCTION_DEF) continue;
+        size_t slot = hash_name(def->as.function_def.name) & (capacity - 1);
+        while (c->funcs[slot].name && strcmp(c->funcs[slot].name, def->as.function_def.name) != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (c->funcs[slot].name) continue;
+        c->funcs[slot].name = def->as.function_def.name;
+        c->funcs[slot].type = function_type(c, def);
+    }
+    return true;
+}
+
+static Type* find_function(Checker* c, const char* name) {
+    size_t mask = c->func_capacity - 1;
+    for (size_t slot = hash_name(name) & mask; c->funcs[slot].name; slot = (slot + 1) & mask) {
+        if (strcmp(c->funcs[slot].name, name) == 0) return c->funcs[slot].type;
+    }
+    return NULL;
+}
+
+static Local* env_find(Env* env, const char* name) {
+    for (int i = 0; i < env->count; i++) {
+        if (strcmp(env->locals[i].name, name) == 0) return &env->locals[i];
+    }
+    return NULL;
+}
+
+static Local* env_add(Env* env, const char* name) {
+    if (env->count == env->capacity) {
+        int capacity = env->capacity ? env->capacity * 2 : 8;
+        Local* locals = (Local*)realloc(env->locals, sizeof(Local) * capacity);
+        if (!locals) return NULL;
+        env->locals = locals;
+        env->capacity = capacity;
+    }
+    Local* l = &env->locals[env->count++];
+    memset(l, 0, sizeof(*l));
+    l->name = name;
+    return l;
+}
+
+// The type of a name read in the current body. A local with nothing
+// assigned yet is NULL while joining (it may be assigned further down)
+// and any once the body is being checked.
+static Type* lookup(Checker* c, const char* name) {
+    for (Env* env = c->env; env; env = env->outer) {
+        Local* l = env_find(env, name);
+        if (l) return l->type ? l->type : (c->report ? c->any : NULL);
+    }
+    Type* f = find_function(c, name);
+    return f ? f : c->any;
+}
+
+static void assign_name(Checker* c, const char* name, Type* t, ASTNode* at) {
+    Local* l = env_find(c->env, name);
+    if (!l) {
+        l = env_add(c->env, name);
+        if (!l) return;
+    }
+    if (!t) return;
+    if (l->declared) {
+        if (!consistent(c, t, l->type)) {
+            type_error(c, at, "cannot assign %s to '%s' of type %s", tname(t), name, tname(l->type));
+        }
+        return;
+    }
+    bool conflict = false;
+    if (c->report) {
+        // Conflicts are judged on the settled types only: while joining, a
+        // local can briefly hold a type that a later round widens
+        if (!l->first) {
+            l->first = t;
+            l->first_line = at->line;
+        }
+        l->checked = join(c, l->checked, t, &conflict);
+        if (conflict && !l->conflict) {
+            l->conflict = t;
+            l->conflict_line = at->line;
+            l->conflict_column = at->column;
+        }
+        return;
+    }
+    Type* joined = join(c, l->type, t, &conflict);
+    if (joined != l->type) {
+        l->type = joined;
+        c->changed = true;
+    }
+}
+
+// ============================================================
+// Expressions
+// ============================================================
+
+// Result of 'a op b' for arithmetic operators, or NULL if unsupported
+static Type* arithmetic(Checker* c, TokenType op, Type* a, Type* b) {
+    if (a == c->any || b == c->any) return c->any;
+    if (is_numeric(c, a) && is_numeric(c, b)) {
+        if (op == TOKEN_SLASH || a == c->t_float || b == c->t_float) return c->t_float;
+        return c->t_int;
+    }
+    if (op == TOKEN_PLUS) {
+        if (a == c->t_str && b == c->t_str) return c->t_str;
+        if (a->kind == TYPE_LIST && b->kind == TYPE_LIST) {
+            bool conflict = false;
+            Type* e = join(c, a->element_type, b->element_type, &conflict);
+            return type_create_list(c->tt, e);
+        }
+    }
+    if (op == TOKEN_STAR) {
+        if (b == c->t_int && (a == c->t_str || a->kind == TYPE_LIST)) return a;
+        if (a == c->t_int && (b == c->t_str || b->kind == TYPE_LIST)) return b;
+    }
+    if (op == TOKEN_PERCENT && a == c->t_str) return c->t_str;
+    return NULL;
+}
+
+static Type* infer_binary(Checker* c, ASTNode* node) {
+    TokenType op = node->as.binary.op;
+    ASTNode* left = node->as.binary.left;
+    ASTNode* right = node->as.binary.right;
+    Type* a = infer(c, left);
+    Type* b = infer(c, right);
+
+    switch (op) {
+        case TOKEN_PIPELINE: {
+            // 'x |> f' is f(x)
+            if (!a || !b) return NULL;
+            if (b->kind != TYPE_FUNCTION) return c->any;
+            if (b->param_count == 1 && !consistent(c, a, b->param_types[0])) {
+                type_error(c, left, "pipeline stage expects %s, got %s",
+                           tname(b->param_types[0]), tname(a));
+            }
+            return b->return_type;
+        }
+        case TOKEN_AND:
+        case TOKEN_OR:
+            // The value of one operand or the other
+            if (!a || !b) return NULL;
+            return a == b ? a : c->any;
+        case TOKEN_EQUALS_EQUALS:
+        case TOKEN_NOT_EQUALS:
+        case TOKEN_IN:
+        case TOKEN_IS:
+            return c->t_bool;
+        case TOKEN_LESS:
+        case TOKEN_GREATER:
+        case TOKEN_LESS_EQUALS:
+        case TOKEN_GREATER_EQUALS:
+            if (a && b && a != c->any && b != c->any &&
+                !(is_numeric(c, a) && is_numeric(c, b)) && a != b) {
+                type_error(c, node, "cannot compare %s with %s using '%s'",
+                           tname(a), tname(b), op_symbol(op));
+            }
+            return c->t_bool;
+        default: {
+            if (!a || !b) return NULL;
+            Type* t = arithmetic(c, op, a, b);
+            if (!t) {
+                type_error(c, node, "unsupported operand types for '%s': %s and %s",
+                           op_symbol(op), tname(a), tname(b));
+                return c->any;
+            }
+            return t;
+        }
+    }
+}
+
+static Type* infer_unary(Checker* c, ASTNode* node) {
+    Type* t = infer(c, node->as.unary.operand);
+    switch (node->as.unary.op) {
+        case TOKEN_NOT:
+            return c->t_bool;
+        case TOKEN_MINUS:
+        case TOKEN_PLUS:
+            if (!t || t == c->any || is_numeric(c, t)) return t;
+            type_error(c, node, "bad operand type for unary '%s': %s",
+                       op_symbol(node->as.unary.op), tname(t));
+            return c->any;
+        default:
+            return t;  // move x
+    }
+}
+
+// Whether 'to' says everything 'from' does: the same type, with any
+// parts of 'from' filled in or ints widened to float
+static bool refines(Checker* c, Type* to, Type* from) {
+    if (to == from || from == c->any) return true;
+    if (!to || !from || to == c->any) return false;
+    if (from == c->t_int && to == c->t_float) return true;
+    if (from->kind != to->kind) return false;
+    if (from->kind == TYPE_DICT && !refines(c, to->key_type, from->key_type)) return false;
+    return (from->kind == TYPE_LIST || from->kind == TYPE_DICT) &&
+           refines(c, to->element_type, from->element_type);
+}
+
+// A list or dict literal takes the more precise container type it flows
+// into ('return []' from a '-> List[int]' function, an argument for a
+// Dict[str, int] parameter), so lowering can give it a typed layout.
+// This only refines what inference found; it never reports.
+static void refine_literal(Checker* c, ASTNode* node, Type* expected) {
+    while (node && node->type == AST_GROUPING) node = node->as.grouping.expression;
+    if (!node || !expected || !node->inferred_type) return;
+    if (node->type != AST_LIST_LITERAL && node->type != AST_DICT_LITERAL) return;
+    if (refines(c, expected, node->inferred_type)) node->inferred_type = expected;
+}
+
+static Type* infer_call(Checker* c, ASTNode* node) {
+    Type* f = infer(c, node->as.call.callee);
+    int argc = node->as.call.arg_count;
+    bool known = true;
+    for (int i = 0; i < argc; i++) {
+        Type* arg = infer(c, node->as.call.args[i]);
+        if (!arg) known = false;
+        if (f && f->kind == TYPE_FUNCTION && f->param_count == argc &&
+            !consistent(c, arg, f->param_types[i])) {
+            ASTNode* callee = node->as.call.callee;
+            type_error(c, node->as.call.args[i], "argument %d of '%s' expects %s, got %s", i + 1,
+                       callee->type == AST_IDENTIFIER ? callee->as.identifier.name : "call",
+                       tname(f->param_types[i]), tname(arg));
+        }
+        if (f && f->kind == TYPE_FUNCTION && f->param_count == argc) {
+            refine_literal(c, node->as.call.args[i], f->param_types[i]);
+        }
+    }
+    if (!f || !known) return NULL;
+    return f->kind == TYPE_FUNCTION ? f->return_type : c->any;
+}
+
+static Type* infer_subscript(Checker* c, ASTNode* node) {
+    Type* obj = infer(c, node->as.subscript.object);
+    Type* idx = infer(c, node->as.subscript.index);
+    if (!obj) return NULL;
+    if (obj->kind == TYPE_LIST || obj == c->t_str) {
+        if (idx && !consistent(c, idx, c->t_int)) {
+            type_error(c, node->as.subscript.index, "%s index must be int, got %s",
+                       tname(obj), tname(idx));
+        }
+        return obj == c->t_str ? c->t_str : obj->element_type;
+    }
+    if (obj->kind == TYPE_DICT) {
+        if (idx && !consistent(c, idx, obj->key_type)) {
+            type_error(c, node->as.subscript.index, "%s key must be %s, got %s",
+                       tname(obj), tname(obj->key_type), tname(idx));
+        }
+        return obj->element_type;
+    }
+    return c->any;
+}
+
+// Elements of a list literal, keys or values of a dict literal: their
+// join, or any for a heterogeneous literal (which is legal).
+static Type* join_elements(Checker* c, Type* acc, Type* t, bool* unknown) {
+    if (!t) {
+        *unknown = true;
+        return acc;
+    }
+    bool conflict = false;
+    Type* j = join(c, acc, t, &conflict);
+    return conflict ? c->any : j;
+}
+
+static Type* infer_lambda(Checker* c, ASTNode* node) {
+    Env env = { NULL, 0, 0, c->env };
+    int pc = node->as.lambda.param_count;
+    Type* params[pc > 0 ? pc : 1];
+    for (int i = 0; i < pc; i++) {
+        Local* l = env_add(&env, node->as.lambda.param_names[i]);
+        if (l) {
+            l->type = c->any;
+            l->declared = true;
+        }
+        params[i] = c->any;
+    }
+    Env* saved = c->env;
+    c->env = &env;
+    Type* body = infer(c, node->as.lambda.body);
+    c->env = saved;
+    free(env.locals);
+    return type_create_function(c->tt, params, pc, body ? body : c->any);
+}
+
+// Infer 'node' and record the result on it. NULL means "depends on a
+// local nothing has been assigned to yet" and only occurs while joining.
+static Type* infer(Checker* c, ASTNode* node) {
+    if (!node) return c->any;
+    Type* t = c->any;
+    switch (node->type) {
+        case AST_LITERAL_INT:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_BOOL:
+        case AST_LITERAL_NONE:
+            t = type_of_literal(c->tt, node);
+            break;
+        case AST_IDENTIFIER:
+            t = lookup(c, node->as.identifier.name);
+            break;
+        case AST_GROUPING:
+            t = infer(c, node->as.grouping.expression);
+            break;
+        case AST_BINARY:
+            t = infer_binary(c, node);
+            break;
+        case AST_UNARY:
+            t = infer_unary(c, node);
+            break;
+        case AST_CALL:
+            t = infer_call(c, node);
+            break;
+        case AST_SUBSCRIPT:
+            t = infer_subscript(c, node);
+            break;
+        case AST_ATTRIBUTE:
+            infer(c, node->as.attribute.object);
+            t = c->any;  // No class types yet
+            break;
+        case AST_LIST_LITERAL: {
+            Type* e = NULL;
+            bool unknown = false;
+            for (int i = 0; i < node->as.list_literal.count; i++) {
+                e = join_elements(c, e, infer(c, node->as.list_literal.elements[i]), &unknown);
+            }
+            t = unknown ? NULL : type_create_list(c->tt, e ? e : c->any);
+            break;
+        }
+        case AST_DICT_LITERAL: {
+            Type* k = NULL;
+            Type* v = NULL;
+            bool unknown = false;
+            for (int i = 0; i < node->as.dict_literal.count; i++) {
+                k = join_elements(c, k, infer(c, node->as.dict_literal.entries[i].key), &unknown);
+                v = join_elements(c, v, infer(c, node->as.dict_literal.entries[i].value), &unknown);
+            }
+            t = unknown ? NULL : type_create_dict(c->tt, k ? k : c->any, v ? v : c->any);
+            break;
+        }
+        case AST_TERNARY: {
+            infer(c, node->as.ternary.condition);
+            Type* a = infer(c, node->as.ternary.then_expr);
+            Type* b = infer(c, node->as.ternary.else_expr);
+            bool conflict = false;
+            t = (!a || !b) ? NULL : join(c, a, b, &conflict);
+            break;
+        }
+        case AST_LAMBDA:
+            t = infer_lambda(c, node);
+            break;
+        default:
+            break;
+    }
+    node->inferred_type = t;
+    if (c->report) {
+        c->sem->expression_count++;
+        if (t && t != c->any) c->sem->typed_expression_count++;
+    }
+    return t;
+}
+
+// ============================================================
+// Statements
+// ============================================================
+
+// Storing 'value' into obj[index]
+static void check_store(Checker* c, ASTNode* target, Type* value) {
+    Type* obj = target->as.subscript.object->inferred_type;
+    if (!obj || !value) return;
+    Type* slot = NULL;
+    if (obj->kind == TYPE_LIST || obj->kind == TYPE_DICT) slot = obj->element_type;
+    if (slot && !consistent(c, value, slot)) {
+        type_error(c, target, "cannot store %s into %s", tname(value), tname(obj));
+    }
+}
+
+static Type* iterated_type(Checker* c, Type* seq) {
+    if (!seq) return NULL;
+    if (seq->kind == TYPE_LIST) return seq->element_type;
+    if (seq->kind == TYPE_DICT) return seq->key_type;
+    if (seq == c->t_str) return c->t_str;
+    return c->any;
+}
+
+static void check_stmt(Checker* c, ASTNode* node) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_EXPRESSION_STMT:
+            infer(c, node->as.expression_stmt.expression);
+            break;
+
+        case AST_ASSIGNMENT: {
+            ASTNode* target = node->as.assignment.target;
+            Type* value = infer(c, node->as.assignment.value);
+            if (target->type == AST_IDENTIFIER) {
+                assign_name(c, target->as.identifier.name, value, node);
+                Local* l = env_find(c->env, target->as.identifier.name);
+                if (l && l->declared) refine_literal(c, node->as.assignment.value, l->type);
+                target->inferred_type = value;
+            } else {
+                infer(c, target);
+                if (target->type == AST_SUBSCRIPT) {
+                    check_store(c, target, value);
+                    Type* obj = target->as.subscript.object->inferred_type;
+                    if (obj && (obj->kind == TYPE_LIST || obj->kind == TYPE_DICT)) {
+                        refine_literal(c, node->as.assignment.value, obj->element_type);
+                    }
+                }
+            }
+            break;
+        }
+
+        case AST_AUGMENTED_ASSIGNMENT: {
+            ASTNode* target = node->as.augmented_assignment.target;
+            Type* current = infer(c, target);
+            Type* value = infer(c, node->as.augmented_assignment.value);
+            Type* result = NULL;
+            if (current && value) {
+                result = arithmetic(c, node->as.augmented_assignment.op, current, value);
+                if (!result) {
+                    type_error(c, node, "unsupported operand types for '%s=': %s and %s",
+                               op_symbol(node->as.augmented_assignment.op),
+                               tname(current), tname(value));
+                    result = c->any;
+                }
+            }
+            if (target->type == AST_IDENTIFIER) {
+                assign_name(c, target->as.identifier.name, result, node);
+            } else if (target->type == AST_SUBSCRIPT) {
+                check_store(c, target, result);
+            }
+            break;
+        }
+
+        case AST_RETURN: {
+            Type* t = node->as.ret.value ? infer(c, node->as.ret.value) : c->t_none;
+            if (c->return_type && c->return_type != c->any && t &&
+                !consistent(c, t, c->return_type)) {
+                type_error(c, node, "'%s' returns %s but is declared to return %s",
+                           c->func_name, tname(t), tname(c->return_type));
+            }
+            refine_literal(c, node->as.ret.value, c->return_type);
+            break;
+        }
+
+        case AST_IF:
+            infer(c, node->as.if_stmt.condition);
+            check_block(c, node->as.if_stmt.then_block);
+            check_block(c, node->as.if_stmt.else_block);
+            break;
+
+        case AST_WHILE:
+            infer(c, node->as.while_stmt.condition);
+            check_block(c, node->as.while_stmt.body);
+            break;
+
+        case AST_FOR:
+            assign_name(c, node->as.for_stmt.var_name,
+                        iterated_type(c, infer(c, node->as.for_stmt.iterable)), node);
+            check_block(c, node->as.for_stmt.body);
+            break;
+
+        case AST_WITH:
+            infer(c, node->as.with_stmt.context);
+            if (node->as.with_stmt.var_name) {
+                assign_name(c, node->as.with_stmt.var_name, c->any, node);
+            }
+            check_block(c, node->as.with_stmt.body);
+            break;
+
+        case AST_FUNCTION_DEF:
+            // Nested defs are names in this body; module-level ones are
+            // found through the function index instead
+            if (c->env->outer) {
+                assign_name(c, node->as.function_def.name, function_type(c, node), node);
+            }
+            if (c->report) check_function(c, node);
+            break;
+
+        case AST_CLASS_DEF:
+            if (c->env->outer) assign_name(c, node->as.class_def.name, c->any, node);
+            if (c->report) {
+                ASTNode* body = node->as.class_def.body;
+                for (int i = 0; body && i < body->as.block.count; i++) {
+                    if (body->as.block.statements[i]->type == AST_FUNCTION_DEF) {
+                        check_function(c, body->as.block.statements[i]);
+                    }
+                }
+            }
+            break;
+
+        case AST_BLOCK:
+            check_block(c, node);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void check_block(Checker* c, ASTNode* block) {
+    if (!block) return;
+    if (block->type != AST_BLOCK) {
+        check_stmt(c, block);
+        return;
+    }
+    for (int i = 0; i < block->as.block.count; i++) check_stmt(c, block->as.block.statements[i]);
+}
+
+// Join the body's locals to a fixed point, check the body once, and
+// report the locals that were assigned incompatible types.
+static void check_body(Checker* c, ASTNode* body, const char* label) {
+    bool report = c->report;
+    c->report = false;
+    for (int round = 0; round < MAX_JOIN_ROUNDS; round++) {
+        c->changed = false;
+        check_block(c, body);
+        if (!c->changed) break;
+    }
+    c->report = report;
+    check_block(c, body);
+
+    Env* env = c->env;
+    for (int i = 0; i < env->count; i++) {
+        Local* l = &env->locals[i];
+        if (!l->conflict) continue;
+        semantic_error(c->sem, l->conflict_line, l->conflict_column,
+                       "'%s' is assigned %s at line %d and %s at line %d",
+                       l->name, tname(l->first), l->first_line,
+                       tname(l->conflict), l->conflict_line);
+    }
+
+    if (c->sem->debug_print_types && env->count > 0) {
+        printf("    Types in %s:", label);
+        for (int i = 0; i < env->count; i++) {
+            printf("%s %s: %s", i ? "," : "", env->locals[i].name,
+                   tname(env->locals[i].type ? env->locals[i].type : c->any));
+        }
+        printf("\n");
+    }
+}
+
+static void check_function(Checker* c, ASTNode* def) {
+    Env env = { NULL, 0, 0, c->env };
+    for (int i = 0; i < def->as.function_def.param_count; i++) {
+        ASTParam* p = &def->as.function_def.params[i];
+        Local* l = env_add(&env, p->name);
+        if (!l) continue;
+        l->type = type_from_annotation(c->tt, p->type_annotation);
+        l->declared = true;
+    }
+
+    Env* saved_env = c->env;
+    Type* saved_return = c->return_type;
+    const char* saved_name = c->func_name;
+    c->env = &env;
+    c->return_type = def->as.function_def.return_type
+        ? type_from_annotation(c->tt, def->as.function_def.return_type)
+        : NULL;
+    c->func_name = def->as.function_def.name;
+    check_body(c, def->as.function_def.body, def->as.function_def.name);
+    c->env = saved_env;
+    c->return_type = saved_return;
+    c->func_name = saved_name;
+    free(env.locals);
+}
+
+void typecheck_module(SemanticAnalyzer* sem, ASTNode* module) {
+    if (!sem || !module || module->type != AST_MODULE) return;
+    Checker c;
+    memset(&c, 0, sizeof(c));
+    c.sem = sem;
+    c.tt = sem->types;
+    c.any = type_create_primitive(c.tt, TYPE_ANY);
+    c.t_int = type_create_primitive(c.tt, TYPE_INT);
+    c.t_float = type_create_primitive(c.tt, TYPE_FLOAT);
+    c.t_str = type_create_primitive(c.tt, TYPE_STRING);
+    c.t_bool = type_create_primitive(c.tt, TYPE_BOOL);
+    c.t_none = type_create_primitive(c.tt, TYPE_NONE);
+    if (!index_functions(&c, module)) return;
+
+    // Module-level statements are a body of their own; their names are
+    // the outermost environment of every function
+    Env globals = { NULL, 0, 0, NULL };
+    ASTNode body;
+    memset(&body, 0, sizeof(body));
+    body.type = AST_BLOCK;
+    body.as.block.statements = module->as.module.statements;
+    body.as.block.count = module->as.module.count;
+    c.env = &globals;
+    c.report = true;
+    check_body(&c, &body, "module");
+
+    free(globals.locals);
+    free(c.funcs);
+}
@@ -0,0 +1,35 @@
+// typecheck.h - Local type inference and checking against annotations
+//
+// Runs after the semantic walk has resolved every name without errors.
+// Expression types are inferred bottom-up: literals (type_of_literal) are
+// the base case, annotated parameters and the signatures of module-level
+// functions are the declared facts, and every other local gets the join
+// of the types assigned to it. Each expression node records its type in
+// ASTNode.inferred_type for later passes (unboxing, specialization).
+//
+// TYPE_ANY is the gradual escape hatch: it is consistent with every type,
+// so code without annotations never produces an error, and anything
+// combined with an unknown value is unknown. Checked:
+//   - operands of arithmetic, ordering and unary operators;
+//   - assignments: joining int and float widens to float, None or any
+//     with anything gives any, lists, dicts and functions of one arity
+//     join part by part, and other mixes are a conflict;
+//   - call arguments against the callee's TYPE_FUNCTION param_types, for
+//     callees that resolve to a module-level function or a typed local;
+//   - return values against the declared return type;
+//   - list and dict subscripts against the element and key types.
+//
+// Inference is flow-insensitive within a function: its locals are joined
+// to a fixed point first, then the body is checked once, and only the
+// assignments of that pass can conflict.
+
+#ifndef TYPECHECK_H
+#define TYPECHECK_H
+
+#include "semantic.h"
+
+// Infer and check every function, method, lambda and module-level
+// statement. Errors are reported through semantic_error.
+void typecheck_module(SemanticAnalyzer* sem, ASTNode* module);
+
+#endif // TYPECHECK_H
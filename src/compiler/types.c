@@ -2,63 +2,191 @@
 
 #include "types.h"
 #include "ast.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// === Constructors ===
+// === Interning ===
 
-Type* type_create_primitive(TypeKind kind) {
-    Type* t = (Type*)malloc(sizeof(Type));
-    if (!t) return NULL;
-    t->kind = kind;
-    t->element_type = NULL;
-    t->key_type = NULL;
-    t->param_types = NULL;
-    t->param_count = 0;
-    t->return_type = NULL;
-    return t;
+#define TYPE_CHUNK_SIZE 4096
+#define TYPE_TABLE_MIN_CAPACITY 64
+
+typedef struct TypeChunk {
+    struct TypeChunk* next;
+    size_t used;
+    size_t size;
+    _Alignas(max_align_t) unsigned char data[];
+} TypeChunk;
+
+struct TypeTable {
+    Type* primitives[TYPE_NONE + 1];  // ANY .. NONE, created up front
+    Type** buckets;                   // Open addressing, linear probing
+    size_t capacity;                  // Power of two
+    int count;
+    TypeChunk* chunks;
+    size_t bytes;
+};
+
+static void* table_alloc(TypeTable* table, size_t bytes) {
+    bytes = (bytes + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+    TypeChunk* c = table->chunks;
+    if (!c || c->size - c->used < bytes) {
+        size_t size = bytes > TYPE_CHUNK_SIZE ? bytes : TYPE_CHUNK_SIZE;
+        c = (TypeChunk*)malloc(sizeof(TypeChunk) + size);
+        if (!c) return NULL;
+        c->next = table->chunks;
+        c->used = 0;
+        c->size = size;
+        table->chunks = c;
+        table->bytes += sizeof(TypeChunk) + size;
+    }
+    void* p = c->data + c->used;
+    c->used += bytes;
+    return p;
 }
 
-Type* type_create_list(Type* element_type) {
-    Type* t = type_create_primitive(TYPE_LIST);
-    if (!t) return NULL;
-    t->element_type = element_type;
-    return t;
+// Children are canonical, so hashing and comparing their addresses is
+// structural hashing and comparison.
+static size_t hash_pointer(size_t h, const void* p) {
+    h ^= (size_t)(uintptr_t)p >> 4;
+    return h * 0x9E3779B97F4A7C15ULL;
 }
 
-Type* type_create_dict(Type* key_type, Type* value_type) {
-    Type* t = type_create_primitive(TYPE_DICT);
-    if (!t) return NULL;
-    t->key_type = key_type;
-    t->element_type = value_type;
-    return t;
+static size_t type_hash(const Type* t) {
+    size_t h = hash_pointer((size_t)t->kind + 1, t->element_type);
+    h = hash_pointer(h, t->key_type);
+    h = hash_pointer(h, t->return_type);
+    for (int i = 0; i < t->param_count; i++) h = hash_pointer(h, t->param_types[i]);
+    return h ^ (size_t)t->param_count;
+}
+
+static bool type_same_shape(const Type* a, const Type* b) {
+    if (a->kind != b->kind || a->element_type != b->element_type ||
+        a->key_type != b->key_type || a->return_type != b->return_type ||
+        a->param_count != b->param_count) {
+        return false;
+    }
+    for (int i = 0; i < a->param_count; i++) {
+        if (a->param_types[i] != b->param_types[i]) return false;
+    }
+    return true;
 }
 
-Type* type_create_function(Type** param_types, int param_count, Type* return_type) {
-    Type* t = type_create_primitive(TYPE_FUNCTION);
+static bool table_grow(TypeTable* table) {
+    size_t capacity = table->capacity ? table->capacity * 2 : TYPE_TABLE_MIN_CAPACITY;
+    Type** buckets = (Type**)calloc(capacity, sizeof(Type*));
+    if (!buckets) return false;
+    for (size_t i = 0; i < table->capacity; i++) {
+        Type* t = table->buckets[i];
+        if (!t) continue;
+        size_t slot = type_hash(t) & (capacity - 1);
+        while (buckets[slot]) slot = (slot + 1) & (capacity - 1);
+        buckets[slot] = t;
+    }
+    table->bytes += (capacity - table->capacity) * sizeof(Type*);
+    free(table->buckets);
+    table->buckets = buckets;
+    table->capacity = capacity;
+    return true;
+}
+
+// Return the canonical copy of 'key', creating it (and copying its param
+// array into the table) the first time this shape is seen.
+static Type* intern(TypeTable* table, const Type* key) {
+    if (!table) return NULL;
+    if ((size_t)(table->count + 1) * 4 > table->capacity * 3 && !table_grow(table)) return NULL;
+    size_t mask = table->capacity - 1;
+    size_t slot = type_hash(key) & mask;
+    for (Type* t; (t = table->buckets[slot]) != NULL; slot = (slot + 1) & mask) {
+        if (type_same_shape(t, key)) return t;
+    }
+
+    Type* t = (Type*)table_alloc(table, sizeof(Type));
     if (!t) return NULL;
-    t->param_types = param_types;
-    t->param_count = param_count;
-    t->return_type = return_type;
+    *t = *key;
+    t->id = table->count;
+    if (key->param_count > 0) {
+        t->param_types = (Type**)table_alloc(table, sizeof(Type*) * key->param_count);
+        if (!t->param_types) return NULL;
+        memcpy(t->param_types, key->param_types, sizeof(Type*) * key->param_count);
+    } else {
+        t->param_types = NULL;
+    }
+    table->buckets[slot] = t;
+    table->count++;
     return t;
 }
 
-// === Destructor ===
+static Type shape(TypeKind kind) {
+    Type t;
+    memset(&t, 0, sizeof(t));
+    t.kind = kind;
+    return t;
+}
 
-void type_destroy(Type* type) {
-    if (!type) return;
-    // Recursively free owned sub-types.
-    type_destroy(type->element_type);
-    type_destroy(type->key_type);
-    type_destroy(type->return_type);
-    if (type->param_types) {
-        for (int i = 0; i < type->param_count; i++) {
-            type_destroy(type->param_types[i]);
+TypeTable* type_table_create(void) {
+    TypeTable* table = (TypeTable*)calloc(1, sizeof(TypeTable));
+    if (!table) return NULL;
+    table->bytes = sizeof(TypeTable);
+    for (int k = TYPE_ANY; k <= TYPE_NONE; k++) {
+        Type key = shape((TypeKind)k);
+        table->primitives[k] = intern(table, &key);
+        if (!table->primitives[k]) {
+            type_table_destroy(table);
+            return NULL;
         }
-        free(type->param_types);
     }
-    free(type);
+    return table;
+}
+
+void type_table_destroy(TypeTable* table) {
+    if (!table) return;
+    TypeChunk* c = table->chunks;
+    while (c) {
+        TypeChunk* next = c->next;
+        free(c);
+        c = next;
+    }
+    free(table->buckets);
+    free(table);
+}
+
+int type_table_count(const TypeTable* table) {
+    return table ? table->count : 0;
+}
+
+size_t type_table_bytes(const TypeTable* table) {
+    return table ? table->bytes : 0;
+}
+
+// === Constructors ===
+
+Type* type_create_primitive(TypeTable* table, TypeKind kind) {
+    if (!table || kind < TYPE_ANY || kind > TYPE_NONE) return NULL;
+    return table->primitives[kind];
+}
+
+Type* type_create_list(TypeTable* table, Type* element_type) {
+    Type key = shape(TYPE_LIST);
+    key.element_type = element_type;
+    return intern(table, &key);
+}
+
+Type* type_create_dict(TypeTable* table, Type* key_type, Type* value_type) {
+    Type key = shape(TYPE_DICT);
+    key.key_type = key_type;
+    key.element_type = value_type;
+    return intern(table, &key);
+}
+
+Type* type_create_function(TypeTable* table, Type* const* param_types, int param_count,
+                           Type* return_type) {
+    Type key = shape(TYPE_FUNCTION);
+    key.param_types = (Type**)param_types;  // Only read; intern copies it
+    key.param_count = param_count;
+    key.return_type = return_type;
+    return intern(table, &key);
 }
 
 // === Conversion from AST ===
@@ -75,16 +203,16 @@ static TypeKind primitive_kind_from_name(const char* name) {
     return TYPE_ANY;
 }
 
-Type* type_from_annotation(ASTNode* annotation) {
+Type* type_from_annotation(TypeTable* table, ASTNode* annotation) {
     if (!annotation) {
-        return type_create_primitive(TYPE_ANY);
+        return type_create_primitive(table, TYPE_ANY);
     }
 
     // Simple identifier annotation: int, str, bool, MyClass, etc.
     if (annotation->type == AST_IDENTIFIER) {
         const char* name = annotation->as.identifier.name;
         TypeKind kind = primitive_kind_from_name(name);
-        return type_create_primitive(kind);
+        return type_create_primitive(table, kind);
     }
 
     // Compound annotation: List[X], Dict[K, V], etc.
@@ -97,35 +225,37 @@ Type* type_from_annotation(ASTNode* annotation) {
             const char* base_name = base->as.identifier.name;
 
             if (strcmp(base_name, "List") == 0) {
-                Type* element = type_from_annotation(index);
-                return type_create_list(element);
+                Type* element = type_from_annotation(table, index);
+                return type_create_list(table, element);
             }
             if (strcmp(base_name, "Dict") == 0) {
-                // Per current design: only the first type arg is preserved
-                // in the AST for multi-arg generics. So Dict[str, int] parses
-                // with just 'str' as the subscript index; the int is
-                // discarded. We treat the single arg as the KEY type and
-                // leave the value type as ANY. Revisit when multi-arg
-                // generics are properly represented.
-                Type* key = type_from_annotation(index);
-                Type* value = type_create_primitive(TYPE_ANY);
-                return type_create_dict(key, value);
+                // Dict[K, V] carries both arguments as a list; a lone
+                // argument is the key type, with any values
+                Type* any = type_create_primitive(table, TYPE_ANY);
+                if (index && index->type == AST_LIST_LITERAL) {
+                    ASTNode** args = index->as.list_literal.elements;
+                    int n = index->as.list_literal.count;
+                    Type* key = n > 0 ? type_from_annotation(table, args[0]) : any;
+                    Type* value = n > 1 ? type_from_annotation(table, args[1]) : any;
+                    return type_create_dict(table, key, value);
+                }
+                return type_create_dict(table, type_from_annotation(table, index), any);
             }
         }
     }
 
     // Anything we don't recognize - be permissive.
-    return type_create_primitive(TYPE_ANY);
+    return type_create_primitive(table, TYPE_ANY);
 }
 
-Type* type_of_literal(ASTNode* node) {
+Type* type_of_literal(TypeTable* table, ASTNode* node) {
     if (!node) return NULL;
     switch (node->type) {
-        case AST_LITERAL_INT:    return type_create_primitive(TYPE_INT);
-        case AST_LITERAL_FLOAT:  return type_create_primitive(TYPE_FLOAT);
-        case AST_LITERAL_STRING: return type_create_primitive(TYPE_STRING);
-        case AST_LITERAL_BOOL:   return type_create_primitive(TYPE_BOOL);
-        case AST_LITERAL_NONE:   return type_create_primitive(TYPE_NONE);
+        case AST_LITERAL_INT:    return type_create_primitive(table, TYPE_INT);
+        case AST_LITERAL_FLOAT:  return type_create_primitive(table, TYPE_FLOAT);
+        case AST_LITERAL_STRING: return type_create_primitive(table, TYPE_STRING);
+        case AST_LITERAL_BOOL:   return type_create_primitive(table, TYPE_BOOL);
+        case AST_LITERAL_NONE:   return type_create_primitive(table, TYPE_NONE);
         default: return NULL;
     }
 }
@@ -4,16 +4,19 @@
 // language. Types are used by the semantic analyzer for type checking and
 // (eventually) by the code generator for specialization.
 //
-// Ownership model: Types are allocated per-symbol and freed with their
-// owning symbol. No sharing, no reference counting - simpler than the
-// alternatives at this scale.
-//
-// Compound types (list, dict, function) contain pointers to other Type
-// instances that they own. The destructor recursively frees them.
+// Ownership model: Types are hash-consed in a TypeTable. Every
+// constructor returns the table's canonical instance, so structurally
+// equal types are the same pointer: equality is a pointer comparison and
+// a module that mentions List[int] a thousand times holds one List[int].
+// Types are immutable, shared freely, and all freed together with their
+// table. Compound types point at (canonical) child types they do not own.
 
 #ifndef RHELIX_TYPES_H
 #define RHELIX_TYPES_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 typedef enum {
     TYPE_ANY,      // Unknown or unresolved - the "escape hatch"
     TYPE_INT,      // Integer literals, arithmetic on ints
@@ -28,6 +31,7 @@ typedef enum {
 
 typedef struct Type {
     TypeKind kind;
+    int id;            // Dense per table, in creation order
 
     // === Compound type payload ===
     // For LIST: element_type is the element type, key_type unused
@@ -43,39 +47,44 @@ typedef struct Type {
     struct Type* return_type;
 } Type;
 
-// === Constructors ===
+// The interner. Nodes and their param arrays live in chunks owned by the
+// table; lookup hashes a node's kind and child pointers, which is enough
+// because the children are canonical already.
+typedef struct TypeTable TypeTable;
 
-// Create a primitive type (INT, FLOAT, STRING, BOOL, NONE, ANY).
-// Panics if called with a compound TypeKind.
-Type* type_create_primitive(TypeKind kind);
+TypeTable* type_table_create(void);
+void type_table_destroy(TypeTable* table);   // Frees every type it handed out
+int type_table_count(const TypeTable* table);      // Distinct types
+size_t type_table_bytes(const TypeTable* table);   // Memory held for them
 
-// Create a list type with the given element type. Takes ownership of element_type.
-Type* type_create_list(Type* element_type);
+// === Constructors ===
+// Each returns the canonical instance from 'table', or NULL on allocation
+// failure. Arguments are canonical types from the same table.
 
-// Create a dict type with the given key and value types. Takes ownership of both.
-Type* type_create_dict(Type* key_type, Type* value_type);
+// A primitive type (INT, FLOAT, STRING, BOOL, NONE, ANY). Returns NULL
+// for a compound TypeKind.
+Type* type_create_primitive(TypeTable* table, TypeKind kind);
 
-// Create a function type. Takes ownership of param_types array and return_type.
-// param_types should be a heap-allocated array of Type* of length param_count.
-Type* type_create_function(Type** param_types, int param_count, Type* return_type);
+Type* type_create_list(TypeTable* table, Type* element_type);
+Type* type_create_dict(TypeTable* table, Type* key_type, Type* value_type);
 
-// === Destructor ===
+// 'param_types' is copied; the caller keeps ownership of the array.
+Type* type_create_function(TypeTable* table, Type* const* param_types, int param_count,
+                           Type* return_type);
 
-// Recursively frees a Type and all its owned sub-types. Safe to call with NULL.
-void type_destroy(Type* type);
+// Structural equality, which interning makes pointer equality
+static inline bool type_equals(const Type* a, const Type* b) { return a == b; }
 
 // === Conversion from AST ===
 
 // Convert an annotation AST node (an Identifier or Subscript) into a Type.
 // Returns TYPE_ANY for unrecognized identifiers (user-defined types deferred).
 // Returns TYPE_ANY when annotation is NULL (no annotation was written).
-// Caller owns the returned Type.
 struct ASTNode;  // Forward declaration to avoid circular include
-Type* type_from_annotation(struct ASTNode* annotation);
+Type* type_from_annotation(TypeTable* table, struct ASTNode* annotation);
 
 // Infer the type of a literal AST node. Returns NULL if node is not a literal.
-// Caller owns the returned Type.
-Type* type_of_literal(struct ASTNode* node);
+Type* type_of_literal(TypeTable* table, struct ASTNode* node);
 
 // === Debug ===
 
@@ -0,0 +1,411 @@
+// ir.c - IR construction, arena management and printing
+#include "ir.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Arena chunks are sized for a typical module; larger requests get a
+// chunk of their own.
+#define IR_ARENA_CHUNK (64 * 1024)
+
+// ============================================================
+// Lifecycle
+// ============================================================
+
+IRModule* ir_module_create(void) {
+    IRModule* module = (IRModule*)calloc(1, sizeof(IRModule));
+    if (!module) return NULL;
+    // The IR only uses arenas; compiler memory is not capped.
+    module->mm = mm_create(MM_UNLIMITED);
+    if (!module->mm) {
+        free(module);
+        return NULL;
+    }
+    module->arena = mm_arena_create(module->mm, IR_ARENA_CHUNK);
+    if (!module->arena) {
+        mm_destroy(module->mm);
+        free(module);
+        return NULL;
+    }
+    return module;
+}
+
+void ir_module_destroy(IRModule* module) {
+    if (!module) return;
+    mm_destroy(module->mm);  // Frees every arena chunk
+    free(module);
+}
+
+void* ir_alloc(IRModule* module, size_t size) {
+    void* p = mm_arena_alloc(module->arena, size);
+    if (!p) {
+        size_t chunk = size + MM_DEFAULT_ALIGN > IR_ARENA_CHUNK
+                     ? size + MM_DEFAULT_ALIGN : IR_ARENA_CHUNK;
+        Arena* arena = mm_arena_create(module->mm, chunk);
+        if (!arena) return NULL;
+        module->arena = arena;
+        p = mm_arena_alloc(arena, size);
+        if (!p) return NULL;
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+const char* ir_strdup(IRModule* module, const char* s) {
+    if (!s) return NULL;
+    size_t len = strlen(s) + 1;
+    char* copy = (char*)ir_alloc(module, len);
+    if (copy) memcpy(copy, s, len);
+    return copy;
+}
+
+// ============================================================
+// Construction
+// ============================================================
+
+IRFunction* ir_function_create(IRModule* module, const char* name, ASTNode* node) {
+    IRFunction* func = (IRFunction*)ir_alloc(module, sizeof(IRFunction));
+    if (!func) return NULL;
+    func->name = ir_strdup(module, name);
+    func->node = node;
+    func->index = module->function_count++;
+    if (module->last_function) {
+        module->last_function->next = func;
+    } else {
+        module->functions = func;
+    }
+    module->last_function = func;
+    return func;
+}
+
+IRFunction* ir_function_find(IRModule* module, const char* name) {
+    for (IRFunction* f = module->functions; f; f = f->next) {
+        if (f->name && strcmp(f->name, name) == 0) return f;
+    }
+    return NULL;
+}
+
+int ir_slot_add(IRModule* module, IRFunction* func, const char* name, bool synthetic) {
+    if (func->slot_count >= func->slot_capacity) {
+        int new_cap = func->slot_capacity == 0 ? 8 : func->slot_capacity * 2;
+        IRSlot* slots = (IRSlot*)ir_alloc(module, sizeof(IRSlot) * new_cap);
+        if (!slots) return -1;
+        if (func->slot_count > 0) {
+            memcpy(slots, func->slots, sizeof(IRSlot) * func->slot_count);
+        }
+        func->slots = slots;  // The old array stays in the arena
+        func->slot_capacity = new_cap;
+    }
+    IRSlot* slot = &func->slots[func->slot_count];
+    slot->name = ir_strdup(module, name);
+    slot->captured = false;
+    slot->cell = false;
+    slot->synthetic = synthetic;
+    return func->slot_count++;
+}
+
+int ir_slot_find(IRFunction* func, const char* name) {
+    for (int i = 0; i < func->slot_count; i++) {
+        if (strcmp(func->slots[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+IRBlock* ir_block_create(IRModule* module, IRFunction* func, int loop_depth) {
+    IRBlock* block = (IRBlock*)ir_alloc(module, sizeof(IRBlock));
+    if (!block) return NULL;
+    block->id = func->block_count++;
+    block->loop_depth = loop_depth;
+    if (func->last_block) {
+        func->last_block->next = block;
+    } else {
+        func->entry = block;
+    }
+    func->last_block = block;
+    return block;
+}
+
+IRInstr* ir_instr_new(IRModule* module, IROpcode op, int arg_count) {
+    IRInstr* instr = (IRInstr*)ir_alloc(module, sizeof(IRInstr));
+    if (!instr) return NULL;
+    instr->op = op;
+    instr->dest = IR_NO_VALUE;
+    instr->slot = -1;
+    if (arg_count > 0) {
+        instr->args = (IRValue*)ir_alloc(module, sizeof(IRValue) * arg_count);
+        if (!instr->args) return NULL;
+    }
+    instr->arg_count = arg_count;
+    return instr;
+}
+
+void ir_instr_append(IRBlock* block, IRInstr* instr) {
+    instr->block = block;
+    instr->prev = block->last;
+    instr->next = NULL;
+    if (block->last) {
+        block->last->next = instr;
+    } else {
+        block->first = instr;
+    }
+    block->last = instr;
+}
+
+void ir_instr_insert_after(IRInstr* pos, IRInstr* instr) {
+    IRBlock* block = pos->block;
+    instr->block = block;
+    instr->prev = pos;
+    instr->next = pos->next;
+    if (pos->next) {
+        pos->next->prev = instr;
+    } else {
+        block->last = instr;
+    }
+    pos->next = instr;
+}
+
+void ir_instr_insert_before(IRInstr* pos, IRInstr* instr) {
+    IRBlock* block = pos->block;
+    instr->block = block;
+    instr->next = pos;
+    instr->prev = pos->prev;
+    if (pos->prev) {
+        pos->prev->next = instr;
+    } else {
+        block->first = instr;
+    }
+    pos->prev = instr;
+}
+
+void ir_instr_remove(IRInstr* instr) {
+    IRBlock* block = instr->block;
+    if (instr->prev) {
+        instr->prev->next = instr->next;
+    } else {
+        block->first = instr->next;
+    }
+    if (instr->next) {
+        instr->next->prev = instr->prev;
+    } else {
+        block->last = instr->prev;
+    }
+    instr->prev = instr->next = NULL;
+    instr->block = NULL;
+}
+
+IRValue ir_define(IRFunction* func, IRInstr* instr) {
+    instr->dest = func->value_count++;
+    return instr->dest;
+}
+
+bool ir_is_terminator(IROpcode op) {
+    return op == IR_JUMP || op == IR_BRANCH || op == IR_RETURN;
+}
+
+// ============================================================
+// Printing
+// ============================================================
+
+const char* ir_opcode_to_string(IROpcode op) {
+    switch (op) {
+        case IR_CONST_INT: return "const";
+        case IR_CONST_FLOAT: return "const";
+        case IR_CONST_STRING: return "const";
+        case IR_CONST_BOOL: return "const";
+        case IR_CONST_NONE: return "const";
+        case IR_PARAM: return "param";
+        case IR_LOAD_LOCAL: return "load";
+        case IR_MOVE_LOCAL: return "move";
+        case IR_STORE_LOCAL: return "store";
+        case IR_DROP_LOCAL: return "drop";
+        case IR_LOAD_GLOBAL: return "global";
+        case IR_MAKE_CELL: return "cell";
+        case IR_LOAD_CAPTURE: return "capture";
+        case IR_PHI: return "phi";
+        case IR_BINARY: return "binary";
+        case IR_UNARY: return "unary";
+        case IR_TRUTH: return "truth";
+        case IR_CALL: return "call";
+        case IR_GET_ATTR: return "getattr";
+        case IR_SET_ATTR: return "setattr";
+        case IR_GET_ITEM: return "getitem";
+        case IR_SET_ITEM: return "setitem";
+        case IR_BUILD_LIST: return "list";
+        case IR_BUILD_DICT: return "dict";
+        case IR_MAKE_CLOSURE: return "closure";
+        case IR_GET_ITER: return "iter";
+        case IR_ITER_HAS_NEXT: return "hasnext";
+        case IR_ITER_NEXT: return "next";
+        case IR_PARALLEL_FOR: return "parfor";
+        case IR_VEC_REDUCE: return "vreduce";
+        case IR_VEC_MAP: return "vmap";
+        case IR_VEC_STORE: return "vstore";
+        case IR_BOX: return "box";
+        case IR_WIDEN: return "widen";
+        case IR_RETAIN: return "retain";
+        case IR_RELEASE: return "release";
+        case IR_JUMP: return "jump";
+        case IR_BRANCH: return "branch";
+        case IR_RETURN: return "return";
+    }
+    return "?";
+}
+
+const char* ir_repr_to_string(IRRepr repr) {
+    switch (repr) {
+        case IR_REPR_BOXED: return "boxed";
+        case IR_REPR_INT: return "int";
+        case IR_REPR_FLOAT: return "float";
+        case IR_REPR_BOOL: return "bool";
+    }
+    return "?";
+}
+
+static void print_args(IRInstr* instr, int from) {
+    for (int i = from; i < instr->arg_count; i++) {
+        printf("%s%%%d", i > from ? ", " : "", instr->args[i]);
+    }
+}
+
+static void print_instr(IRFunction* func, IRInstr* instr) {
+    printf("    ");
+    if (instr->dest != IR_NO_VALUE) {
+        printf("%%%d", instr->dest);
+        if (instr->repr != IR_REPR_BOXED) printf(":%s", ir_repr_to_string(instr->repr));
+        printf(" = ");
+    }
+    printf("%s", ir_opcode_to_string(instr->op));
+
+    const char* slot = instr->slot >= 0 ? func->slots[instr->slot].name : NULL;
+    switch (instr->op) {
+        case IR_CONST_INT: printf(" %ld", instr->int_value); break;
+        case IR_CONST_FLOAT: printf(" %g", instr->float_value); break;
+        case IR_CONST_STRING: printf(" \"%s\"", instr->name); break;
+        case IR_CONST_BOOL: printf(" %s", instr->int_value ? "True" : "False"); break;
+        case IR_CONST_NONE: printf(" None"); break;
+        case IR_PARAM:
+            printf(" %ld", instr->int_value);
+            break;
+        case IR_LOAD_LOCAL:
+        case IR_MOVE_LOCAL:
+        case IR_DROP_LOCAL:
+        case IR_MAKE_CELL:
+            printf(" %s", slot);
+            break;
+        case IR_LOAD_CAPTURE:
+            if (instr->int_value < 0) printf(" self %s", instr->name);
+            else printf(" #%ld %s", instr->int_value, instr->name);
+            break;
+        case IR_STORE_LOCAL:
+            printf(" %s, %%%d", slot, instr->args[0]);
+            break;
+        case IR_LOAD_GLOBAL:
+            printf(" %s", instr->name);
+            break;
+        case IR_PHI:
+            printf(" %s", slot);
+            for (int k = 0; k < instr->arg_count; k++) {
+                printf("%s[%%%d, bb%d]", k > 0 ? ", " : " ", instr->args[k],
+                       instr->block->preds[k]->id);
+            }
+            break;
+        case IR_BINARY:
+            printf(" %s %%%d, %%%d", token_type_to_string(instr->token),
+                   instr->args[0], instr->args[1]);
+            break;
+        case IR_UNARY:
+            printf(" %s %%%d", token_type_to_string(instr->token), instr->args[0]);
+            break;
+        case IR_CALL:
+            printf(" %%%d", instr->args[0]);
+            if (instr->name) printf(" <%s>", instr->name);
+            printf("(");
+            print_args(instr, 1);
+            printf(")");
+            break;
+        case IR_GET_ATTR:
+            printf(" %%%d.%s", instr->args[0], instr->name);
+            break;
+        case IR_SET_ATTR:
+            printf(" %%%d.%s, %%%d", instr->args[0], instr->name, instr->args[1]);
+            break;
+        case IR_MAKE_CLOSURE:
+            printf(" #%ld", instr->int_value);
+            if (instr->arg_count > 0) {
+                printf(" [");
+                print_args(instr, 0);
+                printf("]");
+            }
+            break;
+        case IR_VEC_REDUCE:
+        case IR_VEC_MAP:
+        case IR_VEC_STORE:
+            printf(" %s ", kernel_op_to_string((KernelOp)instr->int_value));
+            print_args(instr, 0);
+            break;
+        case IR_BOX:
+            printf(" %s %%%d", ir_repr_to_string((IRRepr)instr->int_value), instr->args[0]);
+            break;
+        case IR_BUILD_LIST:
+        case IR_BUILD_DICT:
+            // The boxed layout is the default and goes unmentioned
+            if (instr->int_value != LAYOUT_BOXED) {
+                printf(" %s", container_layout_to_string((ContainerLayout)instr->int_value));
+            }
+            if (instr->arg_count > 0) {
+                printf(" ");
+                print_args(instr, 0);
+            }
+            break;
+        case IR_JUMP:
+            printf(" bb%d", instr->targets[0]->id);
+            break;
+        case IR_BRANCH:
+            printf(" %%%d, bb%d, bb%d", instr->args[0],
+                   instr->targets[0]->id, instr->targets[1]->id);
+            break;
+        default:
+            if (instr->arg_count > 0) {
+                printf(" ");
+                print_args(instr, 0);
+            }
+            break;
+    }
+    if (instr->flags & IR_FLAG_MOVE_HINT) printf("  ; move");
+    if (instr->flags & IR_FLAG_CELL) printf("  ; cell");
+    if (instr->flags & IR_FLAG_DEREF) printf("  ; deref");
+    printf("\n");
+}
+
+void ir_print_function(IRFunction* func) {
+    printf("function %s(", func->name);
+    for (int i = 0; i < func->param_count; i++) {
+        printf("%s%s%s%s", i > 0 ? ", " : "",
+               func->params[i].owned ? "owned " : "",
+               func->params[i].borrowed ? "borrowed " : "",
+               func->params[i].name);
+        if (func->param_reprs) printf(": %s", ir_repr_to_string(func->param_reprs[i]));
+    }
+    printf(")");
+    if (func->return_repr != IR_REPR_BOXED) printf(" -> %s", ir_repr_to_string(func->return_repr));
+    printf(" {\n");
+    for (int i = 0; i < func->reduction_count; i++) {
+        printf("  ; reduces %s (%s)\n", func->reductions[i].name,
+               reduction_kind_to_string(func->reductions[i].kind));
+    }
+    for (IRBlock* b = func->entry; b; b = b->next) {
+        printf("  bb%d:", b->id);
+        if (b->loop_depth > 0) printf("  ; loop depth %d", b->loop_depth);
+        printf("\n");
+        for (IRInstr* i = b->first; i; i = i->next) {
+            print_instr(func, i);
+        }
+    }
+    printf("}\n");
+}
+
+void ir_print_module(IRModule* module) {
+    for (IRFunction* f = module->functions; f; f = f->next) {
+        ir_print_function(f);
+    }
+}
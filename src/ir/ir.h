@@ -0,0 +1,394 @@
+// ir.h - Mid-level intermediate representation for RHelix
+//
+// Function bodies are lowered from the AST into a control-flow graph of
+// basic blocks holding three-address instructions. Every instruction that
+// produces a value defines a fresh, dense, per-function value id, so
+// analyses can keep side tables in plain arrays indexed by IRValue.
+// Source-level variables live in numbered local slots (LOAD_LOCAL /
+// STORE_LOCAL) until ir_build_ssa replaces the loads with the values
+// that reach them, merged by IR_PHI where control flow joins.
+//
+// Reference counting is explicit. The lowering in ir_lower.c emits the
+// naive sequence - every load retained, every temporary released after
+// its last use, every argument passed at +1 - and optimization passes
+// such as ir_elide_refcounts() remove what they can prove redundant.
+//
+// All IR memory comes from the module's arena chain and is released at
+// once by ir_module_destroy; there are no per-instruction frees.
+
+#ifndef IR_H
+#define IR_H
+
+#include "ast.h"
+#include "parallel.h"
+#include "memory_manager.h"
+#include "value.h"
+#include "container.h"
+#include "kernels.h"
+#include <stdbool.h>
+
+typedef struct IRInstr IRInstr;
+typedef struct IRBlock IRBlock;
+typedef struct IRFunction IRFunction;
+typedef struct IRModule IRModule;
+
+// Dense per-function value id; IR_NO_VALUE when an instruction has no result.
+typedef int IRValue;
+#define IR_NO_VALUE (-1)
+
+typedef enum {
+    // Constants (immortal - never retained or released)
+    IR_CONST_INT,       // dest = int_value
+    IR_CONST_FLOAT,     // dest = float_value
+    IR_CONST_STRING,    // dest = name (string contents)
+    IR_CONST_BOOL,      // dest = int_value
+    IR_CONST_NONE,      // dest = None
+
+    // Variables
+    IR_PARAM,           // dest = incoming parameter #int_value
+    IR_LOAD_LOCAL,      // dest = slot (borrowed from the slot)
+    IR_MOVE_LOCAL,      // dest = slot, which is left empty (ownership moves to dest)
+    IR_STORE_LOCAL,     // slot = args[0]; consumes args[0], releases the old value
+    IR_DROP_LOCAL,      // Release the slot's value on function exit
+    IR_LOAD_GLOBAL,     // dest = module-level name (borrowed)
+    IR_MAKE_CELL,       // Give cell slot 'slot' a fresh cell holding None, see below
+    IR_LOAD_CAPTURE,    // dest = capture #int_value of the running closure (borrowed)
+    IR_PHI,             // dest = args[k] when entered from block->preds[k]; slot merged
+
+    // Operations. Results are owned unless noted.
+    IR_BINARY,          // dest = args[0] <token> args[1]
+    IR_UNARY,           // dest = <token> args[0]
+    IR_TRUTH,           // dest = unboxed truth value of args[0] (not refcounted)
+    IR_CALL,            // dest = args[0](args[1..]); name = direct callee, if known
+    IR_GET_ATTR,        // dest = args[0].name (borrowed)
+    IR_SET_ATTR,        // args[0].name = args[1]; consumes args[1]
+    IR_GET_ITEM,        // dest = args[0][args[1]] (borrowed)
+    IR_SET_ITEM,        // args[0][args[1]] = args[2]; consumes args[2]
+    IR_BUILD_LIST,      // dest = [args...] with ContainerLayout int_value; consumes args
+    IR_BUILD_DICT,      // dest = {args[0]: args[1], ...}, values in layout int_value; consumes args
+    IR_MAKE_CLOSURE,    // dest = closure of module function #int_value over args; consumes args
+    IR_GET_ITER,        // dest = iterator over args[0]
+    IR_ITER_HAS_NEXT,   // dest = unboxed "has another item" flag of iterator args[0]
+    IR_ITER_NEXT,       // dest = next item of iterator args[0]
+    IR_PARALLEL_FOR,    // dest = chunk closure args[1] run over args[0], see below
+
+    // Vector kernels over typed lists; int_value is the KernelOp, see below
+    IR_VEC_REDUCE,      // dest = args[0] + reduction over the lists args[1..] (kernel_reduce)
+    IR_VEC_MAP,         // dest = new list args[0][i] op args[1] (kernel_map)
+    IR_VEC_STORE,       // args[0][i] = args[1][i] op args[2] for i < args[3] (kernel_store)
+
+    // Representation changes (inserted by ir_specialize)
+    IR_BOX,             // dest = boxed Value of unboxed args[0], whose repr is int_value
+    IR_WIDEN,           // dest = (float) int args[0]
+
+    // Reference counting
+    IR_RETAIN,          // Increment args[0]
+    IR_RELEASE,         // Decrement args[0]
+
+    // Terminators
+    IR_JUMP,            // goto targets[0]
+    IR_BRANCH,          // if args[0] goto targets[0] else targets[1]
+    IR_RETURN           // return args[0]; consumes args[0]
+} IROpcode;
+
+// How a value is held. The lowering produces boxed values throughout;
+// ir_specialize gives numeric values raw machine representations, which
+// are never refcounted.
+typedef enum {
+    IR_REPR_BOXED,      // NaN-boxed Value
+    IR_REPR_INT,        // int64_t
+    IR_REPR_FLOAT,      // double
+    IR_REPR_BOOL        // 0 or 1
+} IRRepr;
+
+// IRInstr.flags
+#define IR_FLAG_MOVE_HINT  0x0001  // LOAD_LOCAL written as 'move x' in the source
+#define IR_FLAG_STATIC     0x0002  // LOAD_GLOBAL of a module-level def or class (immortal)
+#define IR_FLAG_CELL       0x0004  // LOAD_LOCAL of a cell slot: the cell, not its contents
+#define IR_FLAG_DEREF      0x0008  // LOAD_CAPTURE of a cell: its contents
+
+// Closures. A def or lambda the analyzer gave a capture list
+// (AST_FLAG_CAPTURES) is made by one IR_MAKE_CLOSURE whose operands are
+// its captures in list order, and reads capture k with IR_LOAD_CAPTURE k,
+// named after the variable; a nested def reads its own name as capture
+// #-1, the running closure. A read-only capture is a copy of the value; a
+// mutated one is the cell of its variable, read with IR_FLAG_DEREF. In
+// the function that owns such a variable the slot is a cell slot
+// (IRSlot.cell): IR_MAKE_CELL at entry gives it its cell, loads, moves and
+// stores go through the cell, a load with IR_FLAG_CELL produces the cell
+// itself for a closure to capture, and DROP_LOCAL releases the cell.
+// Functions lowered without capture lists read enclosing locals with
+// IR_LOAD_GLOBAL of their names instead.
+
+// Vector kernels. Loops and map stages over List[int] / List[float] whose
+// body is a single element-wise operation are lowered to one call of a
+// SIMD kernel (kernels.h) instead of an element loop; see "Vector kernels"
+// in ir_lower.c for the patterns. VEC_REDUCE takes the accumulator, the
+// one (KERNEL_SUM) or two (KERNEL_DOT) lists, and for a range loop the
+// element count last. In VEC_MAP and VEC_STORE the second operand is a
+// list or a broadcast number. All three borrow their operands. A list
+// shorter than the count fails the way the replaced loop's index would.
+
+// Parallel for loops. A loop annotated AST_FLAG_PARALLEL_LOOP is outlined
+// into a chunk function '<function>.<for@line>' that takes a slice of the
+// iterable, runs the loop body over it, and returns its reduction
+// accumulators as a list (None if there are none), each started at its
+// identity. IR_PARALLEL_FOR borrows the iterable and the closure, runs the
+// chunk function over slices chosen by the scheduler's lazy binary
+// splitting, combines the returned lists element-wise in iteration order,
+// and produces the combined list; the caller then folds each entry into
+// its accumulator slot.
+typedef struct {
+    const char* name;       // Accumulator slot in the enclosing function
+    ReductionKind kind;
+} IRReduction;
+
+struct IRInstr {
+    IROpcode op;
+    IRValue dest;
+    IRValue* args;
+    int arg_count;
+    int slot;               // Local slot for *_LOCAL opcodes, -1 otherwise
+    const char* name;       // Global, attribute, callee, capture or string constant
+    long int_value;
+    double float_value;
+    TokenType token;        // Operator for BINARY / UNARY
+    IRRepr repr;            // Representation of dest
+    IRBlock* targets[2];    // JUMP / BRANCH successors
+    unsigned flags;
+    int line;
+    IRBlock* block;
+    IRInstr* prev;
+    IRInstr* next;
+};
+
+struct IRBlock {
+    int id;
+    int loop_depth;         // Loops enclosing this block in the source
+    IRInstr* first;
+    IRInstr* last;
+    IRBlock* next;          // Next block of the function, in creation order
+
+    // Set by ir_compute_dominators, over the blocks reachable from entry
+    IRBlock** preds;        // Predecessors; PHI operands follow this order
+    int pred_count;
+    int rpo;                // Position in reverse postorder, -1 if unreachable
+    IRBlock* idom;          // Immediate dominator; NULL for the entry
+    IRBlock** dom_children; // Blocks this one immediately dominates
+    int dom_child_count;
+    int dom_depth;          // Depth in the dominator tree (entry 0)
+};
+
+typedef struct {
+    const char* name;
+    bool captured;          // Referenced from a nested lambda or def
+    bool cell;              // Shared with closures through a cell (implies captured)
+    bool synthetic;         // Compiler temporary (no DROP_LOCAL on exit)
+} IRSlot;
+
+typedef struct {
+    const char* name;
+    bool owned;             // Declared 'owned': passed at +1 by direct callers
+    bool borrowed;          // Passed at +0 (decided by ir_elide_refcounts)
+} IRParam;
+
+struct IRFunction {
+    const char* name;
+    ASTNode* node;          // AST_FUNCTION_DEF, AST_LAMBDA, or AST_FOR for a chunk function
+    int index;              // Position in the module's function list
+    IRParam* params;
+    int param_count;
+    IRSlot* slots;
+    int slot_count;
+    int slot_capacity;
+    IRBlock* entry;
+    IRBlock* last_block;
+    int block_count;
+    int value_count;        // Value ids are 0 .. value_count-1
+    IRReduction* reductions;    // Chunk functions: accumulators, in result order
+    int reduction_count;
+    IRFunction* generic;    // Specializations: the function they were cloned from
+    IRRepr* param_reprs;    // Specializations: how each parameter is passed
+    IRRepr return_repr;     // Boxed except in specializations
+    IRBlock** rpo;          // Reachable blocks in reverse postorder (ir_compute_dominators)
+    int rpo_count;
+    IRFunction* next;
+};
+
+struct IRModule {
+    MemoryManager* mm;      // Owns the arena chain
+    Arena* arena;           // Chunk currently being filled
+    IRFunction* functions;
+    IRFunction* last_function;
+    int function_count;
+};
+
+// === Lifecycle ===
+IRModule* ir_module_create(void);
+void ir_module_destroy(IRModule* module);
+
+// Arena allocation; memory is zeroed. Returns NULL only if the system is
+// out of memory.
+void* ir_alloc(IRModule* module, size_t size);
+const char* ir_strdup(IRModule* module, const char* s);
+
+// === Construction ===
+IRFunction* ir_function_create(IRModule* module, const char* name, ASTNode* node);
+IRFunction* ir_function_find(IRModule* module, const char* name);
+int ir_slot_add(IRModule* module, IRFunction* func, const char* name, bool synthetic);
+int ir_slot_find(IRFunction* func, const char* name);
+IRBlock* ir_block_create(IRModule* module, IRFunction* func, int loop_depth);
+
+// Allocate an instruction with room for 'arg_count' operands. The
+// instruction is not linked anywhere yet; dest is IR_NO_VALUE.
+IRInstr* ir_instr_new(IRModule* module, IROpcode op, int arg_count);
+void ir_instr_append(IRBlock* block, IRInstr* instr);
+void ir_instr_insert_after(IRInstr* pos, IRInstr* instr);
+void ir_instr_insert_before(IRInstr* pos, IRInstr* instr);
+void ir_instr_remove(IRInstr* instr);
+
+// Give 'instr' a fresh result value.
+IRValue ir_define(IRFunction* func, IRInstr* instr);
+
+// === Queries ===
+bool ir_is_terminator(IROpcode op);
+
+// Lower every function, method and lambda in an AST_MODULE. Returns NULL
+// on allocation failure. The AST must outlive the module (names of
+// functions refer back to it only through IRFunction.node).
+IRModule* ir_lower_module(ASTNode* module);
+
+// === Inlining (ir_inline.c) ===
+
+// Inline calls whose callee is known statically - direct calls of module
+// functions and calls of closures the caller makes - when the callee costs
+// at most IR_INLINE_BUDGET instructions (twice that inside a loop) and the
+// caller stays under IR_INLINE_MAX_SIZE. Inlined bodies are inlined into
+// again, up to IR_INLINE_ROUNDS deep. Runs right after ir_lower_module.
+#define IR_INLINE_BUDGET 16
+#define IR_INLINE_MAX_SIZE 2000
+#define IR_INLINE_ROUNDS 3
+
+typedef struct {
+    int inlined;            // Call sites replaced by the callee's body
+    int lambdas;            // Of those, calls of closures
+    int closures_removed;   // Closures nothing calls any more
+    int calls_before;       // Static CALL instructions before and after
+    int calls_after;
+    int instrs_before;      // Module size before and after
+    int instrs_after;
+} IRInlineStats;
+
+void ir_inline(IRModule* module, IRInlineStats* stats);
+
+// === Reference-count optimization (ir_refcount.c) ===
+
+typedef struct {
+    int retains;            // RETAIN instructions
+    int releases;           // RELEASE and DROP_LOCAL instructions
+    long weighted;          // Estimated executions, see ir_count_refcounts
+} IRRefcountStats;
+
+// Static refcount instruction counts. 'weighted' scales each instruction
+// by IR_LOOP_TRIP_ESTIMATE per enclosing loop to approximate how often it
+// runs; there is no interpreter to measure real executions yet.
+#define IR_LOOP_TRIP_ESTIMATE 10
+void ir_count_refcounts(IRFunction* func, IRRefcountStats* stats);
+void ir_count_module_refcounts(IRModule* module, IRRefcountStats* stats);
+
+// Remove refcount operations the naive lowering emitted but the program
+// does not need. Runs over every function of the module.
+void ir_elide_refcounts(IRModule* module);
+
+// === Specialization (ir_specialize.c) ===
+
+// Clone functions per tuple of argument representations seen at direct
+// call sites, so numeric code runs unboxed. At most
+// IR_MAX_SPECIALIZATIONS clones per function; further tuples call the
+// generic version. Runs after ir_elide_refcounts.
+#define IR_MAX_SPECIALIZATIONS 4
+
+typedef struct {
+    int specializations;    // Clones created
+    int capped;             // Call sites left generic by the cap
+    int static_calls;       // Calls dispatched to a specialization
+    int unboxed_values;     // Values given a raw representation, all functions
+    int conversions;        // BOX and WIDEN instructions inserted
+    int instrs_before;      // Module size before and after
+    int instrs_after;
+} IRSpecializeStats;
+
+void ir_specialize(IRModule* module, IRSpecializeStats* stats);
+int ir_count_instructions(IRModule* module);
+
+// === SSA form (ir_ssa.c) ===
+
+// Fill in the CFG fields of every block: predecessors, reverse postorder
+// and the dominator tree. Returns false on allocation failure.
+bool ir_compute_dominators(IRModule* module, IRFunction* func);
+bool ir_dominates(IRBlock* a, IRBlock* b);
+
+typedef struct {
+    int promoted_slots;     // Slots none of whose loads are left
+    int phis;               // PHI instructions after cleanup
+    int loads_replaced;     // LOAD_LOCAL instructions deleted
+    int stores_removed;     // STORE_LOCAL / DROP_LOCAL of raw slots deleted
+} IRSSAStats;
+
+// Rename loads of local slots to the values reaching them, inserting
+// phis at joins, in every function. Captured and moved-from slots, and
+// reads that may see a slot before its first store, keep their loads;
+// stores of boxed values stay because they own a reference. Runs after
+// ir_specialize.
+void ir_build_ssa(IRModule* module, IRSSAStats* stats);
+
+// === Redundancy elimination (ir_gvn.c) ===
+
+typedef struct {
+    int eliminated;         // Instructions replaced by an equal dominating one
+    int hoisted;            // Instructions moved out of a loop
+    int instrs_before;      // Module size before and after
+    int instrs_after;
+    long weighted_before;   // Loop-weighted size, see ir_count_weighted_instructions
+    long weighted_after;
+} IRRedundancyStats;
+
+// Delete instructions that recompute a value already available (global
+// value numbering) and move loop-invariant ones into the block before the
+// loop. Constants, raw arithmetic and borrowed reads are candidates;
+// reads of attributes, items and globals are kept apart by whether a
+// store or call in between may write them. Runs after ir_build_ssa.
+void ir_eliminate_redundancy(IRModule* module, IRRedundancyStats* stats);
+
+// Instruction count with each instruction scaled by IR_LOOP_TRIP_ESTIMATE
+// per enclosing loop.
+long ir_count_weighted_instructions(IRModule* module);
+
+// === Reference interpreter (ir_eval.c) ===
+
+// Run module function 'name' on boxed arguments, storing its boxed result
+// in '*result'. Covers the numeric subset of the IR: constants other than
+// strings, locals, cells and phis, operators on ints, floats and bools,
+// truth tests, branches, direct calls, and closures with their captures.
+// Returns false if execution reaches anything else, including a read of
+// an enclosing local by name, or if raw int arithmetic overflows.
+bool ir_eval(IRModule* module, MemoryManager* mm, const char* name,
+             const Value* args, int argc, Value* result);
+
+typedef struct {
+    long calls;             // IR_CALL instructions executed
+    long instructions;      // Instructions executed, in every function
+} IREvalCounts;
+
+// As ir_eval, also reporting what ran in '*counts' (if not NULL).
+bool ir_eval_counted(IRModule* module, MemoryManager* mm, const char* name,
+                     const Value* args, int argc, Value* result, IREvalCounts* counts);
+
+// === Debugging ===
+const char* ir_opcode_to_string(IROpcode op);
+const char* ir_repr_to_string(IRRepr repr);
+void ir_print_function(IRFunction* func);
+void ir_print_module(IRModule* module);
+void ir_print_dominators(IRFunction* func);
+
+#endif // IR_H
@@ -0,0 +1,536 @@
+// ir_eval.c - Reference interpreter for the numeric subset of the IR
+//
+// There is no code generator yet, so this is how passes that change what
+// the IR computes with (ir_specialize, for one) are checked and timed:
+// run the module before and after and compare results and time. It walks
+// the instruction lists directly; every function gets a frame of value
+// and slot cells on an evaluator-owned stack. A cell holds a boxed Value
+// or a raw int64_t / double, as the defining instruction's IRRepr says.
+//
+// Boxed arithmetic follows the language: ints and floats mix, '/' is true
+// division, '%' takes the sign of the divisor, bools count as ints, and an
+// int result outside int64 becomes a float. Raw int arithmetic has no
+// float to fall back to, so an overflow there stops the evaluation.
+// Closures are the runtime's flat closure records (value_closure): the
+// function's index and its captures, cells for the mutated ones. A slot
+// marked 'cell' holds its cell, and loads and stores go through it. A
+// lambda lowered without capture lists reads enclosing locals as
+// IR_LOAD_GLOBAL and is not covered.
+// Refcounting is exactly what the IR says; RETAIN, RELEASE, STORE_LOCAL
+// and DROP_LOCAL act on the memory manager, nothing else does. A jump
+// into a block assigns its phis together, from the edge it came along.
+
+#include "ir.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EVAL_STACK_CELLS (1 << 20)
+#define EVAL_MAX_DEPTH 10000
+
+typedef union {
+    Value v;
+    int64_t i;
+    double f;
+} Cell;
+
+typedef struct {
+    IRInstr** defs;             // Value id -> defining instruction
+    IRFunction** callees;       // Value id of a direct CALL -> callee, once resolved
+    int value_count;
+} EvalInfo;
+
+typedef struct {
+    IRModule* module;
+    MemoryManager* mm;
+    EvalInfo* info;             // By IRFunction.index
+    int info_count;
+    IRFunction** functions;     // By IRFunction.index, for closures
+    IREvalCounts counts;
+    Cell* stack;
+    size_t sp;
+    int depth;
+} Eval;
+
+static EvalInfo* info_for(Eval* E, IRFunction* f) {
+    if (f->index >= E->info_count) {
+        int count = f->index + 16;
+        EvalInfo* info = (EvalInfo*)realloc(E->info, sizeof(EvalInfo) * count);
+        if (!info) return NULL;
+        memset(info + E->info_count, 0, sizeof(EvalInfo) * (count - E->info_count));
+        E->info = info;
+        E->info_count = count;
+    }
+    EvalInfo* fi = &E->info[f->index];
+    if (fi->defs) return fi;
+
+    int nv = f->value_count > 0 ? f->value_count : 1;
+    fi->defs = (IRInstr**)calloc(nv, sizeof(IRInstr*));
+    fi->callees = (IRFunction**)calloc(nv, sizeof(IRFunction*));
+    if (!fi->defs || !fi->callees) return NULL;
+    fi->value_count = f->value_count;
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->dest != IR_NO_VALUE) fi->defs[i->dest] = i;
+        }
+    }
+    return fi;
+}
+
+static IRRepr operand_repr(EvalInfo* fi, IRValue v) {
+    return fi->defs[v] ? fi->defs[v]->repr : IR_REPR_BOXED;
+}
+
+// ============================================================
+// Arithmetic
+// ============================================================
+
+static int64_t floor_mod_int(int64_t a, int64_t b) {
+    int64_t r = a % b;
+    return (r != 0 && ((r < 0) != (b < 0))) ? r + b : r;
+}
+
+static double floor_mod_float(double a, double b) {
+    double r = fmod(a, b);
+    return (r != 0 && ((r < 0) != (b < 0))) ? r + b : r;
+}
+
+static bool compare_int(TokenType op, int64_t a, int64_t b) {
+    switch (op) {
+        case TOKEN_LESS: return a < b;
+        case TOKEN_GREATER: return a > b;
+        case TOKEN_LESS_EQUALS: return a <= b;
+        case TOKEN_GREATER_EQUALS: return a >= b;
+        case TOKEN_EQUALS_EQUALS: return a == b;
+        default: return a != b;
+    }
+}
+
+static bool compare_float(TokenType op, double a, double b) {
+    switch (op) {
+        case TOKEN_LESS: return a < b;
+        case TOKEN_GREATER: return a > b;
+        case TOKEN_LESS_EQUALS: return a <= b;
+        case TOKEN_GREATER_EQUALS: return a >= b;
+        case TOKEN_EQUALS_EQUALS: return a == b;
+        default: return a != b;
+    }
+}
+
+static bool is_compare(TokenType op) {
+    return op == TOKEN_LESS || op == TOKEN_GREATER || op == TOKEN_LESS_EQUALS ||
+           op == TOKEN_GREATER_EQUALS || op == TOKEN_EQUALS_EQUALS || op == TOKEN_NOT_EQUALS;
+}
+
+// False on a zero divisor and on a result outside int64, which boxed
+// arithmetic turns into a float (as value.c does) and raw ints cannot hold
+static bool int_binary(TokenType op, int64_t a, int64_t b, int64_t* out) {
+    switch (op) {
+        case TOKEN_PLUS: return !__builtin_add_overflow(a, b, out);
+        case TOKEN_MINUS: return !__builtin_sub_overflow(a, b, out);
+        case TOKEN_STAR: return !__builtin_mul_overflow(a, b, out);
+        case TOKEN_PERCENT:
+            if (b == 0) return false;
+            *out = b == -1 ? 0 : floor_mod_int(a, b);
+            return true;
+        default: return false;
+    }
+}
+
+static bool float_binary(TokenType op, double a, double b, double* out) {
+    switch (op) {
+        case TOKEN_PLUS: *out = a + b; return true;
+        case TOKEN_MINUS: *out = a - b; return true;
+        case TOKEN_STAR: *out = a * b; return true;
+        case TOKEN_SLASH:
+            if (b == 0) return false;
+            *out = a / b;
+            return true;
+        case TOKEN_PERCENT:
+            if (b == 0) return false;
+            *out = floor_mod_float(a, b);
+            return true;
+        default: return false;
+    }
+}
+
+// Numeric view of a boxed value
+static bool boxed_number(Value v, int64_t* i, double* f, bool* is_int) {
+    if (value_is_int(v)) {
+        *i = value_as_int(v);
+        *is_int = true;
+    } else if (value_is_bool(v)) {
+        *i = value_as_bool(v);
+        *is_int = true;
+    } else if (value_is_float(v)) {
+        *f = value_as_float(v);
+        *is_int = false;
+    } else {
+        return false;
+    }
+    if (*is_int) *f = (double)*i;
+    return true;
+}
+
+static bool boxed_binary(Eval* E, TokenType op, Value a, Value b, Value* out) {
+    int64_t ai, bi;
+    double af, bf;
+    bool a_int, b_int;
+    if (!boxed_number(a, &ai, &af, &a_int) || !boxed_number(b, &bi, &bf, &b_int)) {
+        if (op == TOKEN_EQUALS_EQUALS || op == TOKEN_NOT_EQUALS) {
+            bool eq = value_equals(a, b);
+            *out = value_bool(op == TOKEN_EQUALS_EQUALS ? eq : !eq);
+            return true;
+        }
+        return false;
+    }
+    if (is_compare(op)) {
+        *out = value_bool(a_int && b_int ? compare_int(op, ai, bi) : compare_float(op, af, bf));
+        return true;
+    }
+    if (a_int && b_int && op != TOKEN_SLASH) {
+        int64_t r;
+        if (int_binary(op, ai, bi, &r)) {
+            *out = value_int(E->mm, r);
+            return true;
+        }
+        if (op == TOKEN_PERCENT) return false;  // Only overflow falls back to float
+    }
+    double r;
+    if (!float_binary(op, af, bf, &r)) return false;
+    *out = value_float(r);
+    return true;
+}
+
+static bool raw_truth(IRRepr repr, Cell c) {
+    switch (repr) {
+        case IR_REPR_BOXED: return value_truthy(c.v);
+        case IR_REPR_FLOAT: return c.f != 0;
+        default: return c.i != 0;
+    }
+}
+
+// ============================================================
+// Execution
+// ============================================================
+
+static bool eval_function(Eval* E, IRFunction* f, Value self, const Cell* args,
+                          Cell* result);
+
+static bool eval_binary(Eval* E, EvalInfo* fi, IRInstr* i, Cell* values) {
+    Cell a = values[i->args[0]];
+    Cell b = values[i->args[1]];
+    Cell* d = &values[i->dest];
+    switch (i->repr) {
+        case IR_REPR_BOXED:
+            return boxed_binary(E, i->token, a.v, b.v, &d->v);
+        case IR_REPR_INT:
+            return int_binary(i->token, a.i, b.i, &d->i);
+        case IR_REPR_FLOAT:
+            return float_binary(i->token, a.f, b.f, &d->f);
+        case IR_REPR_BOOL:
+            d->i = operand_repr(fi, i->args[0]) == IR_REPR_FLOAT
+                 ? compare_float(i->token, a.f, b.f)
+                 : compare_int(i->token, a.i, b.i);
+            return true;
+    }
+    return false;
+}
+
+static bool eval_unary(Eval* E, EvalInfo* fi, IRInstr* i, Cell* values) {
+    Cell a = values[i->args[0]];
+    Cell* d = &values[i->dest];
+    IRRepr from = operand_repr(fi, i->args[0]);
+    if (i->token == TOKEN_NOT) {
+        bool t = !raw_truth(from, a);
+        if (i->repr == IR_REPR_BOXED) d->v = value_bool(t); else d->i = t;
+        return true;
+    }
+    if (i->token == TOKEN_PLUS) {
+        *d = a;
+        return true;
+    }
+    if (i->token != TOKEN_MINUS) return false;
+    switch (i->repr) {
+        case IR_REPR_INT:
+            if (a.i == INT64_MIN) return false;
+            d->i = -a.i;
+            return true;
+        case IR_REPR_FLOAT: d->f = -a.f; return true;
+        case IR_REPR_BOXED: {
+            int64_t n;
+            double x;
+            bool is_int;
+            if (!boxed_number(a.v, &n, &x, &is_int)) return false;
+            if (is_int && n == INT64_MIN) is_int = false;
+            d->v = is_int ? value_int(E->mm, -n) : value_float(-x);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static Value box_cell(Eval* E, IRRepr repr, Cell c) {
+    switch (repr) {
+        case IR_REPR_INT: return value_int(E->mm, c.i);
+        case IR_REPR_FLOAT: return value_float(c.f);
+        case IR_REPR_BOOL: return value_bool(c.i != 0);
+        default: return c.v;
+    }
+}
+
+static IRFunction* closure_function(Eval* E, Value v) {
+    if (!value_is_closure(v)) return NULL;
+    int32_t index = VALUE_CLOSURE_DATA(value_as_object(v))->function;
+    return index >= 0 && index < E->module->function_count ? E->functions[index] : NULL;
+}
+
+static bool eval_call(Eval* E, EvalInfo* fi, IRInstr* i, Cell* values) {
+    IRFunction* callee = fi->callees[i->dest];
+    Value closure = value_none();
+    if (!callee && !i->name) {
+        // Through a value: the generic version of a closure's function
+        closure = values[i->args[0]].v;
+        callee = closure_function(E, closure);
+        if (!callee || callee->param_count != i->arg_count - 1) return false;
+    } else if (!callee) {
+        callee = ir_function_find(E->module, i->name);
+        if (!callee || callee->param_count != i->arg_count - 1) return false;
+        fi->callees[i->dest] = callee;
+    }
+    E->counts.calls++;
+    int n = callee->param_count;
+    Cell args[n > 0 ? n : 1];
+    for (int a = 0; a < n; a++) args[a] = values[i->args[a + 1]];
+    if (value_is_none(closure)) return eval_function(E, callee, closure, args, &values[i->dest]);
+
+    // The closure and its captures are borrowed for the whole call
+    value_retain(closure);
+    bool ok = eval_function(E, callee, closure, args, &values[i->dest]);
+    value_release(E->mm, closure);
+    return ok;
+}
+
+static bool make_closure(Eval* E, IRInstr* i, Cell* values, Value* result) {
+    int n = i->arg_count;
+    Value captures[n > 0 ? n : 1];
+    for (int a = 0; a < n; a++) captures[a] = values[i->args[a]].v;
+    *result = value_closure(E->mm, (int32_t)i->int_value, captures, n);
+    return !value_is_none(*result);
+}
+
+// Capture #int_value of the running closure 'self', or 'self' for #-1
+static bool load_capture(Value self, IRInstr* i, Value* result) {
+    if (value_is_none(self)) return false;
+    if (i->int_value < 0) {
+        *result = self;
+        return true;
+    }
+    const ClosureData* env = VALUE_CLOSURE_DATA(value_as_object(self));
+    if (i->int_value >= env->capture_count) return false;
+    Value v = env->captures[i->int_value];
+    if (!(i->flags & IR_FLAG_DEREF)) {
+        *result = v;
+        return true;
+    }
+    if (!value_is_cell(v)) return false;
+    *result = value_cell_get(v);
+    return true;
+}
+
+// Take the edge 'from' -> 'to': assign to's phis (all reading their
+// operands before any is written) and return its first other instruction
+static IRInstr* enter_block(IRBlock* from, IRBlock* to, Cell* values) {
+    IRInstr* i = to->first;
+    if (!i || i->op != IR_PHI) return i;
+    int edge = 0;
+    while (edge < to->pred_count && to->preds[edge] != from) edge++;
+    int n = 0;
+    for (IRInstr* p = i; p && p->op == IR_PHI; p = p->next) n++;
+    Cell incoming[n];
+    n = 0;
+    for (IRInstr* p = i; p && p->op == IR_PHI; p = p->next) incoming[n++] = values[p->args[edge]];
+    n = 0;
+    for (; i && i->op == IR_PHI; i = i->next) values[i->dest] = incoming[n++];
+    return i;
+}
+
+static bool eval_function(Eval* E, IRFunction* f, Value self, const Cell* args,
+                          Cell* result) {
+    EvalInfo* fi = info_for(E, f);
+    size_t frame = (size_t)f->value_count + (size_t)f->slot_count;
+    if (!fi || E->depth >= EVAL_MAX_DEPTH || E->sp + frame > EVAL_STACK_CELLS) return false;
+    Cell* values = E->stack + E->sp;
+    Cell* slots = values + f->value_count;
+    for (int k = 0; k < f->slot_count; k++) slots[k].v = value_none();
+    E->sp += frame;
+    E->depth++;
+
+    bool ok = true;
+    IRInstr* i = f->entry ? f->entry->first : NULL;
+    while (ok && i) {
+        Cell* d = i->dest != IR_NO_VALUE ? &values[i->dest] : NULL;
+        E->counts.instructions++;
+        switch (i->op) {
+            case IR_CONST_INT:
+                if (i->repr == IR_REPR_INT) d->i = i->int_value;
+                else d->v = value_int(E->mm, i->int_value);
+                break;
+            case IR_CONST_FLOAT:
+                if (i->repr == IR_REPR_FLOAT) d->f = i->float_value;
+                else d->v = value_float(i->float_value);
+                break;
+            case IR_CONST_BOOL:
+                if (i->repr == IR_REPR_BOOL) d->i = i->int_value != 0;
+                else d->v = value_bool(i->int_value != 0);
+                break;
+            case IR_CONST_NONE:
+                d->v = value_none();
+                break;
+            case IR_PARAM:
+                *d = args[i->int_value];
+                break;
+            case IR_MAKE_CELL:
+                value_release(E->mm, slots[i->slot].v);
+                slots[i->slot].v = value_cell(E->mm, value_none());
+                ok = !value_is_none(slots[i->slot].v);
+                break;
+            case IR_LOAD_LOCAL:
+                if (!f->slots[i->slot].cell || (i->flags & IR_FLAG_CELL)) {
+                    *d = slots[i->slot];
+                } else {
+                    ok = value_is_cell(slots[i->slot].v);
+                    if (ok) d->v = value_cell_get(slots[i->slot].v);
+                }
+                break;
+            case IR_MOVE_LOCAL:
+                if (f->slots[i->slot].cell) {
+                    ok = value_is_cell(slots[i->slot].v);
+                    if (!ok) break;
+                    d->v = value_cell_get(slots[i->slot].v);
+                    value_retain(d->v);
+                    value_cell_set(E->mm, slots[i->slot].v, value_none());
+                    break;
+                }
+                *d = slots[i->slot];
+                if (i->repr == IR_REPR_BOXED) slots[i->slot].v = value_none();
+                break;
+            case IR_STORE_LOCAL:
+                if (f->slots[i->slot].cell) {
+                    ok = value_is_cell(slots[i->slot].v);
+                    if (ok) {
+                        value_cell_set(E->mm, slots[i->slot].v,
+                                       box_cell(E, operand_repr(fi, i->args[0]), values[i->args[0]]));
+                    }
+                    break;
+                }
+                if (operand_repr(fi, i->args[0]) == IR_REPR_BOXED) {
+                    value_release(E->mm, slots[i->slot].v);
+                }
+                slots[i->slot] = values[i->args[0]];
+                break;
+            case IR_DROP_LOCAL:
+                value_release(E->mm, slots[i->slot].v);
+                slots[i->slot].v = value_none();
+                break;
+            case IR_PHI:
+                break;  // Assigned by enter_block
+            case IR_LOAD_CAPTURE:
+                ok = load_capture(self, i, &d->v);
+                break;
+            case IR_LOAD_GLOBAL:
+                // Only module functions, as the callee of a direct call
+                if (!(i->flags & IR_FLAG_STATIC)) ok = false;
+                d->v = value_none();
+                break;
+            case IR_BINARY:
+                ok = eval_binary(E, fi, i, values);
+                break;
+            case IR_UNARY:
+                ok = eval_unary(E, fi, i, values);
+                break;
+            case IR_TRUTH:
+                d->i = raw_truth(operand_repr(fi, i->args[0]), values[i->args[0]]);
+                break;
+            case IR_CALL:
+                ok = eval_call(E, fi, i, values);
+                break;
+            case IR_MAKE_CLOSURE:
+                ok = make_closure(E, i, values, &d->v);
+                break;
+            case IR_BOX:
+                d->v = box_cell(E, (IRRepr)i->int_value, values[i->args[0]]);
+                break;
+            case IR_WIDEN:
+                d->f = (double)values[i->args[0]].i;
+                break;
+            case IR_RETAIN:
+                value_retain(values[i->args[0]].v);
+                break;
+            case IR_RELEASE:
+                value_release(E->mm, values[i->args[0]].v);
+                break;
+            case IR_JUMP:
+                i = enter_block(i->block, i->targets[0], values);
+                continue;
+            case IR_BRANCH:
+                i = enter_block(i->block, values[i->args[0]].i ? i->targets[0] : i->targets[1],
+                                values);
+                continue;
+            case IR_RETURN:
+                *result = values[i->args[0]];
+                E->sp -= frame;
+                E->depth--;
+                return true;
+            default:
+                ok = false;
+                break;
+        }
+        i = i->next;
+    }
+    E->sp -= frame;
+    E->depth--;
+    return false;
+}
+
+bool ir_eval(IRModule* module, MemoryManager* mm, const char* name,
+             const Value* args, int argc, Value* result) {
+    return ir_eval_counted(module, mm, name, args, argc, result, NULL);
+}
+
+bool ir_eval_counted(IRModule* module, MemoryManager* mm, const char* name,
+                     const Value* args, int argc, Value* result, IREvalCounts* counts) {
+    IRFunction* f = ir_function_find(module, name);
+    if (!f || f->param_reprs || f->param_count != argc) return false;
+
+    Eval E;
+    memset(&E, 0, sizeof(E));
+    E.module = module;
+    E.mm = mm;
+    E.stack = (Cell*)malloc(sizeof(Cell) * EVAL_STACK_CELLS);
+    E.functions = (IRFunction**)calloc(module->function_count > 0 ? module->function_count : 1,
+                                       sizeof(IRFunction*));
+    if (!E.stack || !E.functions) {
+        free(E.stack);
+        free(E.functions);
+        return false;
+    }
+    for (IRFunction* g = module->functions; g; g = g->next) E.functions[g->index] = g;
+
+    Cell in[argc > 0 ? argc : 1];
+    for (int a = 0; a < argc; a++) in[a].v = args[a];
+    Cell out;
+    bool ok = eval_function(&E, f, value_none(), in, &out);
+    if (ok) *result = box_cell(&E, f->return_repr, out);
+
+    for (int k = 0; k < E.info_count; k++) {
+        free(E.info[k].defs);
+        free(E.info[k].callees);
+    }
+    free(E.info);
+    free(E.stack);
+    free(E.functions);
+    if (counts) *counts = E.counts;
+    return ok;
+}
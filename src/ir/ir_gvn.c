@@ -0,0 +1,725 @@
+// ir_gvn.c - Global value numbering and loop-invariant code motion
+//
+// Runs on SSA form (ir_build_ssa), where two reads of a variable are the
+// same value. Value numbering walks the dominator tree with a scoped hash
+// table: an instruction equal to one that dominates it - same opcode,
+// operands, constant, name and representation - is deleted and its uses
+// renamed. Loop-invariant code motion then moves instructions whose
+// operands are all defined outside a loop into the block that jumps to
+// the loop header (the preheader), and value numbering runs once more to
+// merge what the hoisting lined up.
+//
+// Only instructions without a reference of their own are touched:
+// constants (immortal), raw arithmetic, truth tests and widening, and the
+// borrowed reads IR_GET_ATTR, IR_GET_ITEM and IR_LOAD_GLOBAL, and reads of
+// the running closure's captures (which never change; a cell's contents
+// can, so reads through one are left alone). Owned boxed results keep
+// their retain/release bookkeeping exactly as it was.
+//
+// The reads depend on memory, which is split into classes: one per
+// attribute name read in the function, one for container items, and one
+// for module-level names. Every point of the function has a version of
+// each class, numbered like SSA values: a write that may touch the class
+// starts a new version, and where paths with different versions meet
+// there is a fresh one. Two reads are equal only when they see the same
+// version. What writes what:
+//   - IR_SET_ATTR writes its attribute name, whatever the object: two
+//     names never alias, two objects may;
+//   - IR_SET_ITEM and IR_VEC_STORE write items;
+//   - a direct call of a module function writes what that function and
+//     its callees write (a module-wide fixed point); any other call, and
+//     IR_PARALLEL_FOR, may write everything.
+//
+// A hoisted instruction runs even when the loop body would not have, so
+// an instruction that can fail (a read, a division, boxed arithmetic) is
+// hoisted only from the loop header - which runs whenever the loop is
+// entered - and only when nothing observable comes before it there.
+
+#include "ir.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_REPLACEMENT (-2)
+#define VERSION_UNKNOWN (-1)
+
+#define CLASS_ITEMS 0
+#define CLASS_GLOBALS 1
+#define CLASS_FIRST_ATTR 2
+
+// ============================================================
+// Write summaries
+// ============================================================
+
+typedef struct {
+    const char** attrs;         // Attribute names written (borrowed from the IR)
+    int attr_count;
+    int attr_capacity;
+    bool items;
+    bool everything;
+} Effects;
+
+static bool writes_attr(const Effects* e, const char* name) {
+    if (e->everything) return true;
+    for (int k = 0; k < e->attr_count; k++) {
+        if (strcmp(e->attrs[k], name) == 0) return true;
+    }
+    return false;
+}
+
+// Returns true if 'e' grew
+static bool add_attr(Effects* e, const char* name) {
+    if (e->everything || writes_attr(e, name)) return false;
+    if (e->attr_count == e->attr_capacity) {
+        int cap = e->attr_capacity == 0 ? 4 : e->attr_capacity * 2;
+        const char** attrs = (const char**)realloc(e->attrs, sizeof(const char*) * cap);
+        if (!attrs) {
+            e->everything = true;  // Losing precision is safe
+            return true;
+        }
+        e->attrs = attrs;
+        e->attr_capacity = cap;
+    }
+    e->attrs[e->attr_count++] = name;
+    return true;
+}
+
+static bool merge_effects(Effects* into, const Effects* from) {
+    if (into->everything) return false;
+    if (from->everything) {
+        into->everything = true;
+        return true;
+    }
+    bool grew = false;
+    if (from->items && !into->items) {
+        into->items = true;
+        grew = true;
+    }
+    for (int k = 0; k < from->attr_count; k++) grew |= add_attr(into, from->attrs[k]);
+    return grew;
+}
+
+static IRFunction* direct_callee(IRModule* module, IRInstr* call) {
+    return call->name ? ir_function_find(module, call->name) : NULL;
+}
+
+// What every function may write, indexed by IRFunction.index
+static Effects* summarize_effects(IRModule* module) {
+    Effects* effects = (Effects*)calloc(module->function_count > 0 ? module->function_count : 1,
+                                        sizeof(Effects));
+    if (!effects) return NULL;
+    for (IRFunction* f = module->functions; f; f = f->next) {
+        Effects* e = &effects[f->index];
+        for (IRBlock* b = f->entry; b; b = b->next) {
+            for (IRInstr* i = b->first; i; i = i->next) {
+                switch (i->op) {
+                    case IR_SET_ATTR: add_attr(e, i->name); break;
+                    case IR_SET_ITEM:
+                    case IR_VEC_STORE: e->items = true; break;
+                    case IR_PARALLEL_FOR: e->everything = true; break;
+                    case IR_CALL:
+                        if (!direct_callee(module, i)) e->everything = true;
+                        break;
+                    default: break;
+                }
+            }
+        }
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (IRFunction* f = module->functions; f; f = f->next) {
+            for (IRBlock* b = f->entry; b && !effects[f->index].everything; b = b->next) {
+                for (IRInstr* i = b->first; i; i = i->next) {
+                    IRFunction* callee = i->op == IR_CALL ? direct_callee(module, i) : NULL;
+                    if (callee && callee != f) {
+                        changed |= merge_effects(&effects[f->index], &effects[callee->index]);
+                    }
+                }
+            }
+        }
+    }
+    return effects;
+}
+
+// ============================================================
+// Per-function state
+// ============================================================
+
+typedef struct {
+    IRModule* module;
+    IRFunction* func;
+    IRRedundancyStats* stats;
+    Effects* effects;           // By IRFunction.index
+    const char** classes;       // Memory class -> attribute name (NULL for items, globals)
+    int class_count;
+    int* version_in;            // Block id * class_count + class -> version at entry
+    int* block_seq;             // Block id -> ordinal of its first instruction
+    int* version;               // Value id -> version of the class it reads
+    IRInstr** defs;             // Value id -> defining instruction
+    IRValue* replace;           // Value id -> equal earlier value, or NO_REPLACEMENT
+    int value_count;
+
+    // Scoped hash table: buckets hold the index of their newest entry
+    int* buckets;
+    int bucket_mask;
+    IRInstr** entries;
+    int* entry_next;
+    int entry_count;
+    int entry_capacity;
+    bool failed;
+} GVN;
+
+static int class_of(GVN* G, IRInstr* i) {
+    switch (i->op) {
+        case IR_GET_ITEM:
+            return CLASS_ITEMS;
+        case IR_LOAD_GLOBAL:
+            return (i->flags & IR_FLAG_STATIC) ? -1 : CLASS_GLOBALS;
+        case IR_GET_ATTR:
+            for (int c = CLASS_FIRST_ATTR; c < G->class_count; c++) {
+                if (strcmp(G->classes[c], i->name) == 0) return c;
+            }
+            return -1;  // Not collected: cannot happen
+        default:
+            return -1;
+    }
+}
+
+static bool may_write(GVN* G, IRInstr* i, int c) {
+    switch (i->op) {
+        case IR_SET_ATTR:
+            return c >= CLASS_FIRST_ATTR && strcmp(G->classes[c], i->name) == 0;
+        case IR_SET_ITEM:
+        case IR_VEC_STORE:
+            return c == CLASS_ITEMS;
+        case IR_PARALLEL_FOR:
+            return true;
+        case IR_CALL: {
+            IRFunction* callee = direct_callee(G->module, i);
+            if (!callee) return true;
+            const Effects* e = &G->effects[callee->index];
+            if (e->everything) return true;
+            if (c == CLASS_ITEMS) return e->items;
+            return c >= CLASS_FIRST_ATTR && writes_attr(e, G->classes[c]);
+        }
+        default:
+            return false;
+    }
+}
+
+static bool writes_memory(IROpcode op) {
+    return op == IR_SET_ATTR || op == IR_SET_ITEM || op == IR_VEC_STORE ||
+           op == IR_PARALLEL_FOR || op == IR_CALL;
+}
+
+// Instructions value numbering and hoisting may delete or move
+static bool is_candidate(IRInstr* i) {
+    switch (i->op) {
+        case IR_CONST_INT:
+        case IR_CONST_FLOAT:
+        case IR_CONST_STRING:
+        case IR_CONST_BOOL:
+        case IR_CONST_NONE:
+        case IR_TRUTH:
+        case IR_WIDEN:
+        case IR_GET_ATTR:
+        case IR_GET_ITEM:
+        case IR_LOAD_GLOBAL:
+            return true;
+        case IR_LOAD_CAPTURE:
+            return !(i->flags & IR_FLAG_DEREF);
+        case IR_BINARY:
+        case IR_UNARY:
+            return i->repr != IR_REPR_BOXED;
+        default:
+            return false;
+    }
+}
+
+static bool is_commutative(TokenType op) {
+    return op == TOKEN_PLUS || op == TOKEN_STAR ||
+           op == TOKEN_EQUALS_EQUALS || op == TOKEN_NOT_EQUALS;
+}
+
+// Can running 'i' fail, or be seen from outside the function?
+static bool is_observable(GVN* G, IRInstr* i) {
+    switch (i->op) {
+        case IR_CONST_INT:
+        case IR_CONST_FLOAT:
+        case IR_CONST_STRING:
+        case IR_CONST_BOOL:
+        case IR_CONST_NONE:
+        case IR_PARAM:
+        case IR_PHI:
+        case IR_LOAD_LOCAL:
+        case IR_MOVE_LOCAL:
+        case IR_STORE_LOCAL:
+        case IR_DROP_LOCAL:
+        case IR_TRUTH:
+        case IR_WIDEN:
+        case IR_BOX:
+        case IR_RETAIN:
+        case IR_RELEASE:
+        case IR_MAKE_CLOSURE:
+        case IR_BUILD_LIST:
+        case IR_BUILD_DICT:
+            return false;
+        case IR_LOAD_GLOBAL:
+            return class_of(G, i) >= 0;
+        case IR_LOAD_CAPTURE:
+            return (i->flags & IR_FLAG_DEREF) != 0;
+        case IR_BINARY:
+            return i->repr == IR_REPR_BOXED || i->token == TOKEN_SLASH ||
+                   i->token == TOKEN_PERCENT;
+        case IR_UNARY:
+            return i->repr == IR_REPR_BOXED;
+        default:
+            return true;
+    }
+}
+
+static bool collect_classes(GVN* G) {
+    int capacity = CLASS_FIRST_ATTR;
+    for (IRBlock* b = G->func->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->op == IR_GET_ATTR) capacity++;
+        }
+    }
+    G->classes = (const char**)calloc(capacity, sizeof(const char*));
+    if (!G->classes) return false;
+    G->class_count = CLASS_FIRST_ATTR;
+    for (IRBlock* b = G->func->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->op == IR_GET_ATTR && class_of(G, i) < 0) G->classes[G->class_count++] = i->name;
+        }
+    }
+    return true;
+}
+
+// Memory versions at each block entry. 0 is the version on function
+// entry, 1 + block * classes + class the one made where paths meet at a
+// block, and after that 1 + blocks * classes + n the one the n-th
+// instruction of the function writes.
+static bool compute_versions(GVN* G) {
+    IRFunction* f = G->func;
+    int nc = G->class_count;
+    int n = f->block_count * nc;
+    int* written = (int*)malloc(sizeof(int) * (n > 0 ? n : 1));  // Version a block leaves, or unknown
+    G->version_in = (int*)malloc(sizeof(int) * (n > 0 ? n : 1));
+    G->block_seq = (int*)malloc(sizeof(int) * (f->block_count > 0 ? f->block_count : 1));
+    if (!written || !G->version_in || !G->block_seq) {
+        free(written);
+        return false;
+    }
+    for (int k = 0; k < n; k++) written[k] = G->version_in[k] = VERSION_UNKNOWN;
+
+    int seq = 1 + n;
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        G->block_seq[b->id] = seq;
+        for (IRInstr* i = b->first; i; i = i->next, seq++) {
+            if (!writes_memory(i->op)) continue;
+            for (int c = 0; c < nc; c++) {
+                if (may_write(G, i, c)) written[b->id * nc + c] = seq;
+            }
+        }
+    }
+
+    for (int c = 0; c < nc; c++) G->version_in[f->entry->id * nc + c] = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = 1; k < f->rpo_count; k++) {
+            IRBlock* b = f->rpo[k];
+            for (int c = 0; c < nc; c++) {
+                int v = VERSION_UNKNOWN;
+                for (int p = 0; p < b->pred_count; p++) {
+                    int id = b->preds[p]->id * nc + c;
+                    int out = written[id] != VERSION_UNKNOWN ? written[id] : G->version_in[id];
+                    if (out == VERSION_UNKNOWN) continue;
+                    if (v == VERSION_UNKNOWN) v = out;
+                    else if (v != out) v = 1 + b->id * nc + c;
+                }
+                if (v != G->version_in[b->id * nc + c]) {
+                    G->version_in[b->id * nc + c] = v;
+                    changed = true;
+                }
+            }
+        }
+    }
+    free(written);
+    return true;
+}
+
+static IRValue resolve(GVN* G, IRValue v) {
+    while (v >= 0 && G->replace[v] != NO_REPLACEMENT) v = G->replace[v];
+    return v;
+}
+
+// ============================================================
+// Value numbering
+// ============================================================
+
+static unsigned hash_string(const char* s) {
+    unsigned h = 2166136261u;
+    while (s && *s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+static unsigned hash_instr(GVN* G, IRInstr* i) {
+    uint64_t bits;
+    memcpy(&bits, &i->float_value, sizeof(bits));
+    unsigned h = (unsigned)i->op * 31u + (unsigned)i->repr;
+    h = h * 31u + (unsigned)i->token;
+    h = h * 31u + (unsigned)i->int_value;
+    h = h * 31u + (unsigned)(bits ^ (bits >> 32));
+    h = h * 31u + hash_string(i->name);
+    for (int a = 0; a < i->arg_count; a++) h = h * 31u + (unsigned)i->args[a];
+    return h * 31u + (unsigned)G->version[i->dest];
+}
+
+static bool same_value(GVN* G, IRInstr* a, IRInstr* b) {
+    if (a->op != b->op || a->repr != b->repr || a->token != b->token ||
+        a->int_value != b->int_value || a->arg_count != b->arg_count ||
+        a->flags != b->flags || memcmp(&a->float_value, &b->float_value, sizeof(double)) != 0) {
+        return false;
+    }
+    if ((a->name == NULL) != (b->name == NULL) || (a->name && strcmp(a->name, b->name) != 0)) {
+        return false;
+    }
+    for (int k = 0; k < a->arg_count; k++) {
+        if (a->args[k] != b->args[k]) return false;
+    }
+    return G->version[a->dest] == G->version[b->dest];
+}
+
+static IRInstr* table_find(GVN* G, IRInstr* i, unsigned h) {
+    for (int e = G->buckets[h & G->bucket_mask]; e >= 0; e = G->entry_next[e]) {
+        if (same_value(G, G->entries[e], i)) return G->entries[e];
+    }
+    return NULL;
+}
+
+static void table_push(GVN* G, IRInstr* i, unsigned h) {
+    if (G->entry_count == G->entry_capacity) {
+        int cap = G->entry_capacity == 0 ? 64 : G->entry_capacity * 2;
+        IRInstr** entries = (IRInstr**)realloc(G->entries, sizeof(IRInstr*) * cap);
+        if (entries) G->entries = entries;
+        int* next = (int*)realloc(G->entry_next, sizeof(int) * cap);
+        if (next) G->entry_next = next;
+        if (!entries || !next) {
+            G->failed = true;
+            return;
+        }
+        G->entry_capacity = cap;
+    }
+    int bucket = (int)(h & G->bucket_mask);
+    G->entries[G->entry_count] = i;
+    G->entry_next[G->entry_count] = G->buckets[bucket];
+    G->buckets[bucket] = G->entry_count++;
+}
+
+// Leave a dominator subtree: forget what it added, newest first
+static void table_pop_to(GVN* G, int mark) {
+    while (G->entry_count > mark) {
+        G->entry_count--;
+        IRInstr* i = G->entries[G->entry_count];
+        G->buckets[hash_instr(G, i) & G->bucket_mask] = G->entry_next[G->entry_count];
+    }
+}
+
+// Number 'b' and the blocks it dominates. 'current' is scratch space for
+// the memory versions, one int per class per dominator tree level.
+static void number_block(GVN* G, IRBlock* b, int* current) {
+    int nc = G->class_count;
+    for (int c = 0; c < nc; c++) current[c] = G->version_in[b->id * nc + c];
+    int mark = G->entry_count;
+
+    int seq = G->block_seq[b->id];
+    IRInstr* i = b->first;
+    while (i && !G->failed) {
+        IRInstr* next = i->next;
+        for (int a = 0; a < i->arg_count; a++) i->args[a] = resolve(G, i->args[a]);
+        if (is_candidate(i)) {
+            if (i->op == IR_BINARY && is_commutative(i->token) && i->args[0] > i->args[1]) {
+                IRValue t = i->args[0];
+                i->args[0] = i->args[1];
+                i->args[1] = t;
+            }
+            int c = class_of(G, i);
+            G->version[i->dest] = c >= 0 ? current[c] : 0;
+            unsigned h = hash_instr(G, i);
+            IRInstr* same = table_find(G, i, h);
+            if (same) {
+                G->replace[i->dest] = same->dest;
+                ir_instr_remove(i);
+                G->stats->eliminated++;
+            } else {
+                table_push(G, i, h);
+            }
+        } else if (writes_memory(i->op)) {
+            for (int c = 0; c < nc; c++) {
+                if (may_write(G, i, c)) current[c] = seq;
+            }
+        }
+        i = next;
+        seq++;
+    }
+
+    for (int k = 0; k < b->dom_child_count && !G->failed; k++) {
+        number_block(G, b->dom_children[k], current + nc);
+    }
+    table_pop_to(G, mark);
+}
+
+static bool number_function(GVN* G) {
+    IRFunction* f = G->func;
+    G->class_count = 0;
+    G->entry_count = 0;
+    free(G->classes);
+    free(G->version_in);
+    free(G->block_seq);
+    G->classes = NULL;
+    G->version_in = G->block_seq = NULL;
+    if (!collect_classes(G) || !compute_versions(G)) return false;
+
+    int buckets = 16;
+    while (buckets < f->value_count * 2) buckets *= 2;
+    int* table = (int*)malloc(sizeof(int) * buckets);
+    int max_depth = 0;
+    for (int k = 0; k < f->rpo_count; k++) {
+        if (f->rpo[k]->dom_depth > max_depth) max_depth = f->rpo[k]->dom_depth;
+    }
+    int* current = (int*)malloc(sizeof(int) * (size_t)(max_depth + 1) * (G->class_count + 1));
+    if (!table || !current) {
+        free(table);
+        free(current);
+        return false;
+    }
+    for (int k = 0; k < buckets; k++) table[k] = -1;
+    for (int v = 0; v < f->value_count; v++) G->replace[v] = NO_REPLACEMENT;
+    G->buckets = table;
+    G->bucket_mask = buckets - 1;
+
+    number_block(G, f->entry, current);
+
+    // Phis in loop headers were visited before the back edge values they
+    // name, so those operands may still point at removed instructions
+    for (int k = 0; k < f->rpo_count; k++) {
+        for (IRInstr* i = f->rpo[k]->first; i && i->op == IR_PHI; i = i->next) {
+            for (int a = 0; a < i->arg_count; a++) i->args[a] = resolve(G, i->args[a]);
+        }
+    }
+
+    G->buckets = NULL;
+    free(table);
+    free(current);
+    return !G->failed;
+}
+
+// ============================================================
+// Loop-invariant code motion
+// ============================================================
+
+typedef struct {
+    IRBlock* header;
+    bool* body;             // Block id -> part of the loop
+    int size;
+} Loop;
+
+static int compare_loops(const void* a, const void* b) {
+    return ((const Loop*)a)->size - ((const Loop*)b)->size;
+}
+
+static IRBlock* preheader(Loop* loop) {
+    IRBlock* outside = NULL;
+    for (int p = 0; p < loop->header->pred_count; p++) {
+        IRBlock* pred = loop->header->preds[p];
+        if (loop->body[pred->id]) continue;
+        if (outside) return NULL;
+        outside = pred;
+    }
+    return outside && outside->last && outside->last->op == IR_JUMP ? outside : NULL;
+}
+
+static bool is_invariant(GVN* G, Loop* loop, IRInstr* i, const bool* written) {
+    for (int a = 0; a < i->arg_count; a++) {
+        IRInstr* def = i->args[a] >= 0 ? G->defs[i->args[a]] : NULL;
+        if (!def || loop->body[def->block->id]) return false;
+    }
+    int c = class_of(G, i);
+    return c < 0 || !written[c];
+}
+
+static void hoist_loop(GVN* G, Loop* loop, bool* written) {
+    IRBlock* pre = preheader(loop);
+    if (!pre) return;
+    IRFunction* f = G->func;
+    for (int c = 0; c < G->class_count; c++) written[c] = false;
+    for (int k = 0; k < f->rpo_count; k++) {
+        IRBlock* b = f->rpo[k];
+        if (!loop->body[b->id]) continue;
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (!writes_memory(i->op)) continue;
+            for (int c = 0; c < G->class_count; c++) written[c] |= may_write(G, i, c);
+        }
+    }
+
+    // Reverse postorder puts definitions before their uses, so a chain
+    // of invariant instructions moves out in one pass.
+    for (int k = 0; k < f->rpo_count; k++) {
+        IRBlock* b = f->rpo[k];
+        if (!loop->body[b->id]) continue;
+        bool blocked = b != loop->header;
+        IRInstr* i = b->first;
+        while (i) {
+            IRInstr* next = i->next;
+            bool observable = is_observable(G, i);
+            if (is_candidate(i) && (!observable || !blocked) && is_invariant(G, loop, i, written)) {
+                ir_instr_remove(i);
+                ir_instr_insert_before(pre->last, i);
+                G->stats->hoisted++;
+            } else if (observable) {
+                blocked = true;
+            }
+            i = next;
+        }
+    }
+}
+
+static bool hoist_function(GVN* G) {
+    IRFunction* f = G->func;
+    Loop* loops = NULL;
+    int loop_count = 0;
+    bool ok = true;
+    IRBlock** stack = (IRBlock**)malloc(sizeof(IRBlock*) * (f->block_count + 1));
+    bool* written = (bool*)malloc(sizeof(bool) * (G->class_count + 1));
+    if (!stack || !written) ok = false;
+
+    for (int k = 0; ok && k < f->rpo_count; k++) {
+        IRBlock* latch = f->rpo[k];
+        IRInstr* t = latch->last;
+        int count = !t ? 0 : t->op == IR_JUMP ? 1 : t->op == IR_BRANCH ? 2 : 0;
+        for (int s = 0; ok && s < count; s++) {
+            IRBlock* header = t->targets[s];
+            if (!ir_dominates(header, latch)) continue;
+            Loop* loop = NULL;
+            for (int l = 0; l < loop_count; l++) {
+                if (loops[l].header == header) loop = &loops[l];
+            }
+            if (!loop) {
+                Loop* grown = (Loop*)realloc(loops, sizeof(Loop) * (loop_count + 1));
+                bool* body = (bool*)calloc(f->block_count, sizeof(bool));
+                if (grown) loops = grown;
+                if (!grown || !body) {
+                    free(body);
+                    ok = false;
+                    break;
+                }
+                loop = &loops[loop_count++];
+                loop->header = header;
+                loop->body = body;
+                loop->body[header->id] = true;
+                loop->size = 1;
+            }
+            // Everything that reaches the latch without passing the header
+            int top = 0;
+            if (!loop->body[latch->id]) {
+                loop->body[latch->id] = true;
+                loop->size++;
+                stack[top++] = latch;
+            }
+            while (top > 0) {
+                IRBlock* b = stack[--top];
+                for (int p = 0; p < b->pred_count; p++) {
+                    IRBlock* pred = b->preds[p];
+                    if (loop->body[pred->id]) continue;
+                    loop->body[pred->id] = true;
+                    loop->size++;
+                    stack[top++] = pred;
+                }
+            }
+        }
+    }
+
+    if (ok) {
+        G->defs = (IRInstr**)calloc(f->value_count > 0 ? f->value_count : 1, sizeof(IRInstr*));
+        if (!G->defs) ok = false;
+    }
+    if (ok) {
+        for (IRBlock* b = f->entry; b; b = b->next) {
+            for (IRInstr* i = b->first; i; i = i->next) {
+                if (i->dest >= 0) G->defs[i->dest] = i;
+            }
+        }
+        // Inner loops first: what leaves them may then leave the outer loop
+        if (loop_count > 1) qsort(loops, loop_count, sizeof(Loop), compare_loops);
+        for (int l = 0; l < loop_count; l++) hoist_loop(G, &loops[l], written);
+    }
+
+    for (int l = 0; l < loop_count; l++) free(loops[l].body);
+    free(loops);
+    free(stack);
+    free(written);
+    free(G->defs);
+    G->defs = NULL;
+    return ok;
+}
+
+// ============================================================
+// Driver
+// ============================================================
+
+long ir_count_weighted_instructions(IRModule* module) {
+    long n = 0;
+    for (IRFunction* f = module->functions; f; f = f->next) {
+        for (IRBlock* b = f->entry; b; b = b->next) {
+            long weight = 1;
+            for (int d = 0; d < b->loop_depth; d++) weight *= IR_LOOP_TRIP_ESTIMATE;
+            for (IRInstr* i = b->first; i; i = i->next) n += weight;
+        }
+    }
+    return n;
+}
+
+void ir_eliminate_redundancy(IRModule* module, IRRedundancyStats* stats) {
+    IRRedundancyStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    stats->instrs_before = ir_count_instructions(module);
+    stats->weighted_before = ir_count_weighted_instructions(module);
+
+    Effects* effects = summarize_effects(module);
+    if (effects) {
+        GVN G;
+        memset(&G, 0, sizeof(G));
+        G.module = module;
+        G.stats = stats;
+        G.effects = effects;
+        for (IRFunction* f = module->functions; f; f = f->next) {
+            if (!f->rpo && !ir_compute_dominators(module, f)) break;
+            G.func = f;
+            G.version = (int*)calloc(f->value_count > 0 ? f->value_count : 1, sizeof(int));
+            G.replace = (IRValue*)malloc(sizeof(IRValue) * (f->value_count > 0 ? f->value_count : 1));
+            bool ok = G.version && G.replace;
+            // Number, hoist, and number again what the hoisting brought
+            // together in the preheaders
+            ok = ok && number_function(&G);
+            ok = ok && hoist_function(&G);
+            ok = ok && number_function(&G);
+            free(G.version);
+            free(G.replace);
+            if (!ok) break;
+        }
+        free(G.classes);
+        free(G.version_in);
+        free(G.block_seq);
+        free(G.entries);
+        free(G.entry_next);
+        for (int k = 0; k < module->function_count; k++) free(effects[k].attrs);
+        free(effects);
+    }
+
+    stats->instrs_after = ir_count_instructions(module);
+    stats->weighted_after = ir_count_weighted_instructions(module);
+}
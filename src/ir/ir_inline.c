@@ -0,0 +1,697 @@
+// ir_inline.c - Inlining of small functions and lambdas
+//
+// Runs on the IR straight out of ir_lower_module, before any other pass,
+// so that refcount elision, specialization and SSA construction treat an
+// inlined body as ordinary code of its caller. A call is inlined when its
+// callee is known statically:
+//   - a direct call of a module-level function (IR_CALL with a name, the
+//     resolution the arity checker makes for SYM_FUNCTION);
+//   - a call of a closure the caller makes itself: the IR_MAKE_CLOSURE
+//     value directly, as for the stages of a fused pipeline, or a local
+//     slot whose one store is such a closure and dominates the load, as
+//     for 'f = x => ...' followed by 'f(y)'. A parameter of an inlined
+//     function is such a slot too, which is how a lambda passed to a
+//     small higher-order function is inlined in the next round;
+// and the cost model accepts it: the callee's size, not counting the
+// refcount instructions and the parameter prologue (which mostly go away
+// once the body is in the caller), is at most IR_INLINE_BUDGET, doubled
+// for calls inside a loop, and the caller stays under
+// IR_INLINE_MAX_SIZE instructions. Recursive functions, functions that
+// make closures or have captured locals, and chunk functions are never
+// inlined.
+//
+// The inlined body gets fresh slots named '<callee>.<slot>'. Arguments are
+// stored into the parameter slots (they are already passed at +1, so the
+// store takes them over), and each return stores into a result slot that
+// the continuation moves the call's value out of. Callee locals are
+// dropped where the callee returned, exactly as before. A closure's
+// captures are the operands of the IR_MAKE_CLOSURE that made it, so an
+// IR_LOAD_CAPTURE in the inlined body becomes that operand, and a read
+// through a cell a read of the caller's cell slot (or of the caller's own
+// capture of the cell). A lambda lowered without capture lists reads its
+// enclosing function's locals through IR_LOAD_GLOBAL of their names;
+// inlined into that function, such a read becomes an IR_LOAD_LOCAL of the
+// slot, which sees the value at the time of the call - what a by-reference
+// capture sees.
+//
+// Closures left with no callers are deleted along with the retains and
+// releases of them (which become retains and releases of what they
+// captured), and locals no remaining closure reads stop being marked
+// captured, or kept in a cell.
+
+#include "ir.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    IRModule* module;
+    IRInlineStats* stats;
+    IRFunction** functions;     // By IRFunction.index
+    bool* nested;               // By index: created by an IR_MAKE_CLOSURE
+    IRFunction* func;           // Caller being inlined into
+    IRInstr** defs;             // Value id -> defining instruction, for the round
+    int instances;              // Inlined bodies, for unique slot names
+    bool failed;
+} Inliner;
+
+typedef struct {
+    IRInstr* call;
+    IRFunction* callee;
+    IRInstr* maker;             // IR_MAKE_CLOSURE of a closure callee, else NULL
+} InlineSite;
+
+static int function_size(IRFunction* f) {
+    int n = 0;
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) n++;
+    }
+    return n;
+}
+
+static IRInstr** build_defs(IRFunction* f) {
+    IRInstr** defs = (IRInstr**)calloc(f->value_count > 0 ? f->value_count : 1, sizeof(IRInstr*));
+    if (!defs) return NULL;
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->dest != IR_NO_VALUE) defs[i->dest] = i;
+        }
+    }
+    return defs;
+}
+
+// ============================================================
+// Cost model
+// ============================================================
+
+// Instructions that stay once the body is in the caller
+static int inline_cost(IRFunction* g) {
+    int cost = 0;
+    for (IRBlock* b = g->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            switch (i->op) {
+                case IR_PARAM:
+                case IR_RETAIN:
+                case IR_RELEASE:
+                case IR_DROP_LOCAL:
+                    break;
+                case IR_STORE_LOCAL:
+                    if (i->slot >= g->param_count) cost++;
+                    break;
+                default:
+                    cost++;
+                    break;
+            }
+        }
+    }
+    return cost;
+}
+
+static bool can_inline(IRFunction* g) {
+    if (!g->entry || g->reductions || g->param_reprs) return false;
+    for (int s = 0; s < g->slot_count; s++) {
+        if (g->slots[s].captured) return false;
+    }
+    for (IRBlock* b = g->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->op == IR_MAKE_CLOSURE || i->op == IR_PARALLEL_FOR) return false;
+            if (i->op == IR_CALL && i->name && strcmp(i->name, g->name) == 0) return false;
+        }
+    }
+    return true;
+}
+
+static bool reads_globals(IRFunction* g) {
+    for (IRBlock* b = g->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->op == IR_LOAD_GLOBAL && !(i->flags & IR_FLAG_STATIC)) return true;
+        }
+    }
+    return false;
+}
+
+// ============================================================
+// Resolving callees
+// ============================================================
+
+static IRInstr* closure_maker(Inliner* I, IRValue v) {
+    IRInstr* def = v >= 0 ? I->defs[v] : NULL;
+    if (!def || def->op != IR_MAKE_CLOSURE) return NULL;
+    if (def->int_value < 0 || def->int_value >= I->module->function_count) return NULL;
+    return def;
+}
+
+static IRFunction* closure_function(Inliner* I, IRValue v) {
+    IRInstr* maker = closure_maker(I, v);
+    return maker ? I->functions[maker->int_value] : NULL;
+}
+
+static bool writes_slot(IRInstr* i, int slot) {
+    if (i->slot != slot) return false;
+    return i->op == IR_STORE_LOCAL || i->op == IR_MOVE_LOCAL ||
+           (i->op == IR_LOAD_LOCAL && (i->flags & IR_FLAG_MOVE_HINT));
+}
+
+// The IR_MAKE_CLOSURE of the closure 'load' reads from its slot, if the
+// slot has exactly one store, of a closure, that runs before the load on
+// every path.
+static IRInstr* slot_closure(Inliner* I, IRInstr* load) {
+    IRFunction* f = I->func;
+    if (f->slots[load->slot].captured || (load->flags & IR_FLAG_MOVE_HINT)) return NULL;
+    IRInstr* store = NULL;
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (!writes_slot(i, load->slot)) continue;
+            if (i->op != IR_STORE_LOCAL || store) return NULL;
+            store = i;
+        }
+    }
+    if (!store || store->block->rpo < 0 || load->block->rpo < 0) return NULL;
+    if (store->block == load->block) {
+        IRInstr* i = store->next;
+        while (i && i != load) i = i->next;
+        if (!i) return NULL;
+    } else if (!ir_dominates(store->block, load->block)) {
+        return NULL;
+    }
+    return closure_maker(I, store->args[0]);
+}
+
+static IRFunction* resolve_callee(Inliner* I, IRInstr* call, IRInstr** maker) {
+    *maker = NULL;
+    if (call->name) {
+        IRFunction* g = ir_function_find(I->module, call->name);
+        return g && !I->nested[g->index] ? g : NULL;
+    }
+    IRInstr* def = I->defs[call->args[0]];
+    if (!def) return NULL;
+    if (def->op == IR_MAKE_CLOSURE) *maker = closure_maker(I, def->dest);
+    else if (def->op == IR_LOAD_LOCAL) *maker = slot_closure(I, def);
+    return *maker ? I->functions[(*maker)->int_value] : NULL;
+}
+
+// Can every capture 'g' reads be found in the caller? A read through a
+// cell needs the cell as the caller has it: one of its cell slots, or a
+// capture of its own. A def reading itself (#-1) stays a call.
+static bool captures_resolvable(Inliner* I, IRFunction* g, IRInstr* maker) {
+    for (IRBlock* b = g->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->op != IR_LOAD_CAPTURE) continue;
+            if (!maker || i->int_value < 0 || i->int_value >= maker->arg_count) return false;
+            if (!(i->flags & IR_FLAG_DEREF)) continue;
+            IRInstr* def = I->defs[maker->args[i->int_value]];
+            if (!def) return false;
+            bool cell_slot = def->op == IR_LOAD_LOCAL && (def->flags & IR_FLAG_CELL);
+            bool capture = def->op == IR_LOAD_CAPTURE && !(def->flags & IR_FLAG_DEREF);
+            if (!cell_slot && !capture) return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================
+// Inlining one call
+// ============================================================
+
+static int add_inlined_slot(Inliner* I, IRFunction* g, const char* name, bool synthetic) {
+    char full[256];
+    snprintf(full, sizeof(full), "%s.%s", g->name, name);
+    if (ir_slot_find(I->func, full) >= 0) {
+        snprintf(full, sizeof(full), "%s#%d.%s", g->name, I->instances, name);
+    }
+    return ir_slot_add(I->module, I->func, full, synthetic);
+}
+
+static IRInstr* clone_instr(Inliner* I, IRInstr* gi, int arg_count) {
+    IRInstr* c = ir_instr_new(I->module, gi->op, arg_count);
+    if (!c) {
+        I->failed = true;
+        return NULL;
+    }
+    for (int a = 0; a < arg_count && a < gi->arg_count; a++) c->args[a] = gi->args[a];
+    c->name = gi->name;
+    c->int_value = gi->int_value;
+    c->float_value = gi->float_value;
+    c->token = gi->token;
+    c->repr = gi->repr;
+    c->flags = gi->flags;
+    c->line = gi->line;
+    return c;
+}
+
+static void inline_call(Inliner* I, IRInstr* call, IRFunction* g, IRInstr* maker) {
+    IRModule* m = I->module;
+    IRFunction* f = I->func;
+    IRBlock* b = call->block;
+    I->instances++;
+
+    IRValue* vmap = (IRValue*)malloc(sizeof(IRValue) * (g->value_count > 0 ? g->value_count : 1));
+    int* smap = (int*)malloc(sizeof(int) * (g->slot_count > 0 ? g->slot_count : 1));
+    IRBlock** bmap = (IRBlock**)calloc(g->block_count > 0 ? g->block_count : 1, sizeof(IRBlock*));
+    if (!vmap || !smap || !bmap) {
+        I->failed = true;
+        goto done;
+    }
+    for (int v = 0; v < g->value_count; v++) vmap[v] = IR_NO_VALUE;
+
+    for (int s = 0; s < g->slot_count && !I->failed; s++) {
+        smap[s] = add_inlined_slot(I, g, g->slots[s].name, g->slots[s].synthetic);
+        if (smap[s] < 0) I->failed = true;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "$ret%d", f->slot_count);
+    int result = ir_slot_add(m, f, name, true);
+    for (IRBlock* gb = g->entry; gb && !I->failed; gb = gb->next) {
+        bmap[gb->id] = ir_block_create(m, f, b->loop_depth + gb->loop_depth);
+        if (!bmap[gb->id]) I->failed = true;
+    }
+    IRBlock* after = ir_block_create(m, f, b->loop_depth);
+    if (result < 0 || !after || I->failed) {
+        I->failed = true;
+        goto done;
+    }
+
+    // Copy the body; operands still name callee values until every
+    // definition has its new id
+    for (IRBlock* gb = g->entry; gb && !I->failed; gb = gb->next) {
+        for (IRInstr* gi = gb->first; gi && !I->failed; gi = gi->next) {
+            if (gi->op == IR_PARAM) {
+                vmap[gi->dest] = call->args[gi->int_value + 1];
+                continue;
+            }
+            if (gi->op == IR_RETURN) {
+                IRInstr* store = clone_instr(I, gi, 1);
+                IRInstr* jump = ir_instr_new(m, IR_JUMP, 0);
+                if (!store || !jump) {
+                    I->failed = true;
+                    break;
+                }
+                store->op = IR_STORE_LOCAL;
+                store->slot = result;
+                jump->targets[0] = after;
+                jump->line = gi->line;
+                ir_instr_append(bmap[gb->id], store);
+                ir_instr_append(bmap[gb->id], jump);
+                continue;
+            }
+            if (gi->op == IR_LOAD_CAPTURE && !(gi->flags & IR_FLAG_DEREF)) {
+                // Held by the closure, which the call keeps alive
+                vmap[gi->dest] = maker->args[gi->int_value];
+                continue;
+            }
+            IRInstr* c = clone_instr(I, gi, gi->arg_count);
+            if (!c) break;
+            if (gi->slot >= 0) c->slot = smap[gi->slot];
+            for (int t = 0; t < 2; t++) {
+                if (gi->targets[t]) c->targets[t] = bmap[gi->targets[t]->id];
+            }
+            if (gi->op == IR_LOAD_CAPTURE) {
+                // Through the cell the caller gave the closure (see
+                // captures_resolvable)
+                IRInstr* cell = I->defs[maker->args[gi->int_value]];
+                if (cell->op == IR_LOAD_LOCAL) {
+                    c->op = IR_LOAD_LOCAL;
+                    c->slot = cell->slot;
+                    c->name = NULL;
+                    c->flags = 0;
+                } else {
+                    c->int_value = cell->int_value;
+                    c->name = cell->name;
+                }
+            }
+            if (maker && gi->op == IR_LOAD_GLOBAL && !(gi->flags & IR_FLAG_STATIC)) {
+                // A local of the function that made the closure
+                int slot = ir_slot_find(f, gi->name);
+                if (slot >= 0) {
+                    c->op = IR_LOAD_LOCAL;
+                    c->slot = slot;
+                    c->name = NULL;
+                    c->flags = 0;
+                }
+            }
+            if (gi->dest != IR_NO_VALUE) vmap[gi->dest] = ir_define(f, c);
+            ir_instr_append(bmap[gb->id], c);
+        }
+    }
+    if (I->failed) goto done;
+    for (IRBlock* gb = g->entry; gb; gb = gb->next) {
+        for (IRInstr* c = bmap[gb->id]->first; c; c = c->next) {
+            for (int a = 0; a < c->arg_count; a++) {
+                if (c->args[a] >= 0) c->args[a] = vmap[c->args[a]];
+            }
+        }
+    }
+
+    // Split the caller's block at the call: the rest of it continues
+    // after the body, starting with the call's value
+    IRInstr* rest = call->next;
+    while (rest) {
+        IRInstr* next = rest->next;
+        ir_instr_remove(rest);
+        ir_instr_append(after, rest);
+        rest = next;
+    }
+    IRInstr* move = ir_instr_new(m, IR_MOVE_LOCAL, 0);
+    IRInstr* enter = ir_instr_new(m, IR_JUMP, 0);
+    if (!move || !enter) {
+        I->failed = true;
+        goto done;
+    }
+    move->slot = result;
+    move->dest = call->dest;
+    move->line = call->line;
+    if (after->first) ir_instr_insert_before(after->first, move);
+    else ir_instr_append(after, move);
+    enter->targets[0] = bmap[g->entry->id];
+    enter->line = call->line;
+    ir_instr_remove(call);
+    ir_instr_append(b, enter);
+
+    I->stats->inlined++;
+    if (maker) I->stats->lambdas++;
+
+done:
+    free(vmap);
+    free(smap);
+    free(bmap);
+}
+
+// ============================================================
+// Cleanup
+// ============================================================
+
+// Retain or release each capture of 'maker' where 'op' retained or
+// released the closure
+static void transfer_refcounts(Inliner* I, IRInstr* op, IRInstr* maker) {
+    for (int a = 0; a < maker->arg_count; a++) {
+        IRInstr* r = ir_instr_new(I->module, op->op, 1);
+        if (!r) {
+            I->failed = true;
+            return;
+        }
+        r->args[0] = maker->args[a];
+        r->line = op->line;
+        ir_instr_insert_before(op, r);
+    }
+}
+
+// Is 'v' kept alive until the function exits by something other than the
+// closure it was captured into? A cell slot is never rebound, a local
+// stored once outside loops is not either, and the running closure's own
+// captures last the call.
+static bool held_to_exit(IRFunction* f, IRInstr** defs, IRValue v) {
+    IRInstr* def = defs[v];
+    if (!def) return false;
+    if (def->op == IR_LOAD_CAPTURE) return !(def->flags & IR_FLAG_DEREF);
+    if (def->op != IR_LOAD_LOCAL) return false;
+    if (def->flags & IR_FLAG_CELL) return true;
+    int stores = 0;
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (!writes_slot(i, def->slot)) continue;
+            if (i->op != IR_STORE_LOCAL || b->loop_depth > 0) return false;
+            stores++;
+        }
+    }
+    return stores == 1;
+}
+
+// Delete closures (and loads of them) whose only remaining uses are
+// retains and releases: nothing can call them any more.
+static void remove_dead_closures(Inliner* I) {
+    IRFunction* f = I->func;
+    bool changed = true;
+    while (changed && !I->failed) {
+        changed = false;
+        int nv = f->value_count > 0 ? f->value_count : 1;
+        int ns = f->slot_count > 0 ? f->slot_count : 1;
+        int* retains = (int*)calloc(nv, sizeof(int));
+        int* releases = (int*)calloc(nv, sizeof(int));
+        int* others = (int*)calloc(nv, sizeof(int));
+        int* reads = (int*)calloc(ns, sizeof(int));
+        bool* dead = (bool*)calloc(nv, sizeof(bool));
+        bool* dead_slot = (bool*)calloc(ns, sizeof(bool));
+        IRInstr** defs = build_defs(f);
+        if (!retains || !releases || !others || !reads || !dead || !dead_slot || !defs) {
+            I->failed = true;
+        } else {
+            for (IRBlock* b = f->entry; b; b = b->next) {
+                for (IRInstr* i = b->first; i; i = i->next) {
+                    for (int a = 0; a < i->arg_count; a++) {
+                        IRValue v = i->args[a];
+                        if (v < 0) continue;
+                        if (i->op == IR_RETAIN) retains[v]++;
+                        else if (i->op == IR_RELEASE) releases[v]++;
+                        else others[v]++;
+                    }
+                    if (i->slot >= 0 && i->op != IR_STORE_LOCAL && i->op != IR_DROP_LOCAL) {
+                        reads[i->slot]++;
+                    }
+                }
+            }
+            for (IRBlock* b = f->entry; b; b = b->next) {
+                for (IRInstr* i = b->first; i; i = i->next) {
+                    IRValue d = i->dest;
+                    if (d < 0 || others[d] > 0) continue;
+                    if ((i->op == IR_LOAD_LOCAL && !(i->flags & IR_FLAG_MOVE_HINT) &&
+                         retains[d] == releases[d]) ||
+                        (i->op == IR_MAKE_CLOSURE && releases[d] == retains[d] + 1)) {
+                        dead[d] = true;
+                    }
+                }
+            }
+            // Slots nothing reads that hold only closures
+            for (int s = f->param_count; s < f->slot_count; s++) {
+                if (reads[s] > 0 || f->slots[s].captured) continue;
+                bool closures_only = false;
+                for (IRBlock* b = f->entry; b; b = b->next) {
+                    for (IRInstr* i = b->first; i; i = i->next) {
+                        if (i->op != IR_STORE_LOCAL || i->slot != s) continue;
+                        IRInstr* def = defs[i->args[0]];
+                        closures_only = def && def->op == IR_MAKE_CLOSURE &&
+                                        others[def->dest] == 1 && retains[def->dest] == 0 &&
+                                        releases[def->dest] == 0;
+                        if (!closures_only) goto next_slot;
+                        // What the closure captured is released where it was made
+                        // instead of at the drop, so it must be held until then
+                        for (int a = 0; a < def->arg_count; a++) {
+                            if (!held_to_exit(f, defs, def->args[a])) goto next_slot;
+                        }
+                    }
+                }
+                if (closures_only) dead_slot[s] = true;
+            next_slot:;
+            }
+            for (IRBlock* b = f->entry; b; b = b->next) {
+                IRInstr* i = b->first;
+                while (i) {
+                    IRInstr* next = i->next;
+                    bool remove = false;
+                    if (i->dest >= 0 && dead[i->dest]) {
+                        remove = true;
+                    } else if ((i->op == IR_RETAIN || i->op == IR_RELEASE) && dead[i->args[0]]) {
+                        IRInstr* def = defs[i->args[0]];
+                        if (def->op == IR_MAKE_CLOSURE) transfer_refcounts(I, i, def);
+                        remove = true;
+                    } else if ((i->op == IR_STORE_LOCAL || i->op == IR_DROP_LOCAL) &&
+                               dead_slot[i->slot]) {
+                        if (i->op == IR_STORE_LOCAL) {
+                            IRInstr* maker = defs[i->args[0]];
+                            for (int a = 0; a < maker->arg_count && !I->failed; a++) {
+                                IRInstr* r = ir_instr_new(I->module, IR_RELEASE, 1);
+                                if (!r) {
+                                    I->failed = true;
+                                    break;
+                                }
+                                r->args[0] = maker->args[a];
+                                r->line = maker->line;
+                                ir_instr_insert_before(maker, r);
+                            }
+                            ir_instr_remove(maker);
+                            I->stats->closures_removed++;
+                        }
+                        remove = true;
+                    }
+                    if (remove) {
+                        if (i->op == IR_MAKE_CLOSURE) I->stats->closures_removed++;
+                        ir_instr_remove(i);
+                        changed = true;
+                    }
+                    i = next;
+                }
+            }
+        }
+        free(retains);
+        free(releases);
+        free(others);
+        free(reads);
+        free(dead);
+        free(dead_slot);
+        free(defs);
+    }
+}
+
+// Does 'g', or a closure it makes, read 'name' from an enclosing function?
+static bool reads_enclosing(Inliner* I, IRFunction* g, const char* name, int depth) {
+    if (depth > 8) return true;
+    for (IRBlock* b = g->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->op == IR_LOAD_GLOBAL && !(i->flags & IR_FLAG_STATIC) &&
+                strcmp(i->name, name) == 0) {
+                return true;
+            }
+            if (i->op == IR_MAKE_CLOSURE && i->int_value >= 0 &&
+                i->int_value < I->module->function_count &&
+                reads_enclosing(I, I->functions[i->int_value], name, depth + 1)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void refresh_captures(Inliner* I) {
+    IRFunction* f = I->func;
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->op == IR_PARALLEL_FOR) return;  // Chunks capture by other means
+        }
+    }
+    for (int s = 0; s < f->slot_count; s++) {
+        if (!f->slots[s].captured) continue;
+        bool captured = false;
+        IRInstr* make_cell = NULL;
+        for (IRBlock* b = f->entry; b && !captured; b = b->next) {
+            for (IRInstr* i = b->first; i && !captured; i = i->next) {
+                if (i->op == IR_MAKE_CELL && i->slot == s) make_cell = i;
+                // A closure still gets the cell
+                if (i->op == IR_LOAD_LOCAL && i->slot == s && (i->flags & IR_FLAG_CELL)) {
+                    captured = true;
+                }
+            }
+        }
+        if (captured) continue;
+        if (f->slots[s].cell) {
+            if (make_cell) ir_instr_remove(make_cell);
+            f->slots[s].cell = false;
+        }
+        for (IRBlock* b = f->entry; b && !captured; b = b->next) {
+            for (IRInstr* i = b->first; i && !captured; i = i->next) {
+                if (i->op != IR_MAKE_CLOSURE) continue;
+                captured = closure_function(I, i->dest) != NULL &&
+                           reads_enclosing(I, I->functions[i->int_value], f->slots[s].name, 0);
+            }
+        }
+        f->slots[s].captured = captured;
+    }
+}
+
+// ============================================================
+// Driver
+// ============================================================
+
+static void inline_into(Inliner* I, IRFunction* f) {
+    I->func = f;
+    int inlined_before = I->stats->inlined;
+    for (int round = 0; round < IR_INLINE_ROUNDS && !I->failed; round++) {
+        if (!ir_compute_dominators(I->module, f)) {
+            I->failed = true;
+            break;
+        }
+        I->defs = build_defs(f);
+        int capacity = 0, count = 0;
+        InlineSite* sites = NULL;
+        for (IRBlock* b = f->entry; b && I->defs; b = b->next) {
+            if (b->rpo < 0) continue;
+            for (IRInstr* call = b->first; call; call = call->next) {
+                if (call->op != IR_CALL) continue;
+                IRInstr* maker;
+                IRFunction* g = resolve_callee(I, call, &maker);
+                if (!g || g == f || g->param_count != call->arg_count - 1) continue;
+                int budget = IR_INLINE_BUDGET * (b->loop_depth > 0 ? 2 : 1);
+                if (inline_cost(g) > budget || !can_inline(g)) continue;
+                if (!captures_resolvable(I, g, maker)) continue;
+                // A module function's globals would read as captures in a nested function
+                if (!maker && I->nested[f->index] && reads_globals(g)) continue;
+                if (count == capacity) {
+                    capacity = capacity == 0 ? 8 : capacity * 2;
+                    InlineSite* grown = (InlineSite*)realloc(sites, sizeof(InlineSite) * capacity);
+                    if (!grown) {
+                        I->failed = true;
+                        break;
+                    }
+                    sites = grown;
+                }
+                sites[count].call = call;
+                sites[count].callee = g;
+                sites[count].maker = maker;
+                count++;
+            }
+        }
+        if (!I->defs) I->failed = true;
+
+        // Inlining reads the definitions of captures, which stay where they are
+        int size = function_size(f);
+        for (int k = 0; k < count && !I->failed; k++) {
+            int grow = function_size(sites[k].callee);
+            if (size + grow > IR_INLINE_MAX_SIZE) continue;
+            inline_call(I, sites[k].call, sites[k].callee, sites[k].maker);
+            size += grow;
+        }
+        free(sites);
+        free(I->defs);
+        I->defs = NULL;
+        if (count == 0) break;
+    }
+    // The CFG changed: later passes recompute what they need
+    f->rpo = NULL;
+    f->rpo_count = 0;
+    if (I->stats->inlined > inlined_before) {
+        remove_dead_closures(I);
+        refresh_captures(I);
+    }
+}
+
+static int count_calls(IRModule* module) {
+    int n = 0;
+    for (IRFunction* f = module->functions; f; f = f->next) {
+        for (IRBlock* b = f->entry; b; b = b->next) {
+            for (IRInstr* i = b->first; i; i = i->next) n += i->op == IR_CALL;
+        }
+    }
+    return n;
+}
+
+void ir_inline(IRModule* module, IRInlineStats* stats) {
+    IRInlineStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    stats->calls_before = count_calls(module);
+    stats->instrs_before = ir_count_instructions(module);
+
+    Inliner I;
+    memset(&I, 0, sizeof(I));
+    I.module = module;
+    I.stats = stats;
+    int n = module->function_count > 0 ? module->function_count : 1;
+    I.functions = (IRFunction**)calloc(n, sizeof(IRFunction*));
+    I.nested = (bool*)calloc(n, sizeof(bool));
+    if (I.functions && I.nested) {
+        for (IRFunction* f = module->functions; f; f = f->next) {
+            I.functions[f->index] = f;
+            for (IRBlock* b = f->entry; b; b = b->next) {
+                for (IRInstr* i = b->first; i; i = i->next) {
+                    if (i->op == IR_MAKE_CLOSURE && i->int_value >= 0 && i->int_value < n) {
+                        I.nested[i->int_value] = true;
+                    }
+                }
+            }
+        }
+        for (IRFunction* f = module->functions; f && !I.failed; f = f->next) inline_into(&I, f);
+    }
+    free(I.functions);
+    free(I.nested);
+
+    stats->calls_after = count_calls(module);
+    stats->instrs_after = ir_count_instructions(module);
+}
@@ -0,0 +1,2000 @@
+// ir_lower.c - AST to IR lowering
+//
+// Each function, method and lambda becomes one IRFunction. Module-level
+// statements other than definitions are not lowered yet. A `|>` chain of
+// map/filter/take stages becomes a single loop over its source (see
+// lower_pipeline). A for loop the
+// analyzer marked AST_FLAG_PARALLEL_LOOP also becomes a chunk function
+// that runs the body over one slice of the iterable; the enclosing
+// function hands it to `parfor` and folds the chunk reductions back into
+// its own accumulators. Simple loops and map stages over typed numeric
+// lists become single vector kernel calls (see "Vector kernels"). List
+// and dict literals get a typed layout from the type checker's
+// ASTNode.inferred_type, so when the tree has been analyzed the
+// SemanticAnalyzer (which owns those types) must outlive the lowering.
+// Closures of an analyzed tree carry their captures (see "Closures" in
+// ir.h); without the analyzer's capture lists a closure reads enclosing
+// locals by name.
+//
+// The refcount discipline is deliberately naive so that every saving is
+// visible to (and testable in) the optimization passes:
+//   - a value read from a slot, global, attribute or item is retained;
+//   - every owned temporary is released right after its consuming use,
+//     unless that use takes ownership (stores, returns, container
+//     construction and call arguments, which are all passed at +1);
+//   - parameters arrive at +1 and every user-visible slot is dropped on
+//     each exit path.
+// Constants, unboxed truth values and module-level definitions are
+// immortal and never touched.
+
+#include "ir.h"
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct LoopContext {
+    IRBlock* break_target;
+    IRBlock* continue_target;
+    IRValue iterator;            // For loops: released on early return
+    struct LoopContext* outer;
+} LoopContext;
+
+typedef struct {
+    IRModule* module;
+    ASTNode* ast_module;         // For recognizing module-level definitions
+    IRFunction* func;
+    IRBlock* current;            // NULL after a terminator
+    int loop_depth;
+    LoopContext* loop;
+    IRInstr** defs;              // Value id -> defining instruction
+    int def_capacity;
+    int temp_count;              // Synthetic slot names: $t0, $t1, ...
+    bool failed;                 // Arena allocation failed somewhere
+} Lowerer;
+
+static IRFunction* lower_function(IRModule* module, ASTNode* ast_module,
+                                  ASTNode* node, const char* name);
+static IRValue lower_expr(Lowerer* L, ASTNode* node);
+static void lower_stmt(Lowerer* L, ASTNode* node);
+static IRValue lower_pipeline(Lowerer* L, ASTNode* node);
+
+// ============================================================
+// Emission helpers
+// ============================================================
+
+static IRBlock* new_block(Lowerer* L, int loop_depth) {
+    IRBlock* b = ir_block_create(L->module, L->func, loop_depth);
+    if (!b) L->failed = true;
+    return b;
+}
+
+// Append to the current block. Code after a return/break lands in a fresh
+// block with no predecessors, which keeps the walk simple; lower_block
+// skips such statements anyway.
+static IRInstr* emit(Lowerer* L, IROpcode op, int argc, int line) {
+    if (L->failed) return NULL;
+    if (!L->current) {
+        L->current = new_block(L, L->loop_depth);
+        if (!L->current) return NULL;
+    }
+    IRInstr* i = ir_instr_new(L->module, op, argc);
+    if (!i) {
+        L->failed = true;
+        return NULL;
+    }
+    i->line = line;
+    ir_instr_append(L->current, i);
+    return i;
+}
+
+// Record the definition of every value so releases can tell owned
+// temporaries from immortal ones by value id alone.
+static IRValue emit_def(Lowerer* L, IRInstr* i) {
+    if (!i) return IR_NO_VALUE;
+    IRValue v = ir_define(L->func, i);
+    if (v >= L->def_capacity) {
+        int new_cap = L->def_capacity == 0 ? 64 : L->def_capacity * 2;
+        IRInstr** defs = (IRInstr**)realloc(L->defs, sizeof(IRInstr*) * new_cap);
+        if (!defs) {
+            L->failed = true;
+            return v;
+        }
+        L->defs = defs;
+        L->def_capacity = new_cap;
+    }
+    L->defs[v] = i;
+    return v;
+}
+
+// Does this value carry a reference count?
+static bool value_counted(IRInstr* def) {
+    if (!def) return false;
+    switch (def->op) {
+        case IR_CONST_INT:
+        case IR_CONST_FLOAT:
+        case IR_CONST_STRING:
+        case IR_CONST_BOOL:
+        case IR_CONST_NONE:
+        case IR_TRUTH:
+        case IR_ITER_HAS_NEXT:
+            return false;
+        case IR_LOAD_GLOBAL:
+            return !(def->flags & IR_FLAG_STATIC);
+        default:
+            return true;
+    }
+}
+
+static void emit_refcount(Lowerer* L, IROpcode op, IRValue v, int line) {
+    if (v == IR_NO_VALUE || v >= L->def_capacity || !value_counted(L->defs[v])) return;
+    IRInstr* i = emit(L, op, 1, line);
+    if (i) i->args[0] = v;
+}
+
+static void emit_retain(Lowerer* L, IRValue v, int line) {
+    emit_refcount(L, IR_RETAIN, v, line);
+}
+
+static void release_value(Lowerer* L, IRValue v, int line) {
+    emit_refcount(L, IR_RELEASE, v, line);
+}
+
+static IRValue emit_load_slot(Lowerer* L, int slot, unsigned flags, int line) {
+    IRInstr* i = emit(L, IR_LOAD_LOCAL, 0, line);
+    if (!i) return IR_NO_VALUE;
+    i->slot = slot;
+    i->flags = flags;
+    IRValue v = emit_def(L, i);
+    emit_retain(L, v, line);
+    return v;
+}
+
+static void emit_store_slot(Lowerer* L, int slot, IRValue v, int line) {
+    IRInstr* i = emit(L, IR_STORE_LOCAL, 1, line);
+    if (!i) return;
+    i->slot = slot;
+    i->args[0] = v;
+}
+
+static IRValue emit_move_slot(Lowerer* L, int slot, int line) {
+    IRInstr* i = emit(L, IR_MOVE_LOCAL, 0, line);
+    if (!i) return IR_NO_VALUE;
+    i->slot = slot;
+    return emit_def(L, i);
+}
+
+static void emit_jump(Lowerer* L, IRBlock* target, int line) {
+    if (!L->current) return;  // Already terminated
+    IRInstr* i = emit(L, IR_JUMP, 0, line);
+    if (i) i->targets[0] = target;
+    L->current = NULL;
+}
+
+static void emit_branch(Lowerer* L, IRValue cond, IRBlock* then_b,
+                        IRBlock* else_b, int line) {
+    IRInstr* i = emit(L, IR_BRANCH, 1, line);
+    if (i) {
+        i->args[0] = cond;
+        i->targets[0] = then_b;
+        i->targets[1] = else_b;
+    }
+    L->current = NULL;
+}
+
+// Evaluate 'node' for its truth value: the boxed value is released before
+// the branch so no reference is live across the edge.
+static IRValue lower_condition(Lowerer* L, ASTNode* node) {
+    IRValue c = lower_expr(L, node);
+    IRInstr* t = emit(L, IR_TRUTH, 1, node->line);
+    if (!t) return IR_NO_VALUE;
+    t->args[0] = c;
+    IRValue b = emit_def(L, t);
+    release_value(L, c, node->line);
+    return b;
+}
+
+static int new_temp_slot(Lowerer* L) {
+    char name[32];
+    snprintf(name, sizeof(name), "$t%d", L->temp_count++);
+    int slot = ir_slot_add(L->module, L->func, name, true);
+    if (slot < 0) L->failed = true;
+    return slot;
+}
+
+// Release everything the function still owns, ahead of a return.
+static void emit_exit_cleanup(Lowerer* L, int line) {
+    for (LoopContext* loop = L->loop; loop; loop = loop->outer) {
+        if (loop->iterator != IR_NO_VALUE) release_value(L, loop->iterator, line);
+    }
+    for (int s = 0; s < L->func->slot_count; s++) {
+        if (L->func->slots[s].synthetic) continue;
+        IRInstr* i = emit(L, IR_DROP_LOCAL, 0, line);
+        if (i) i->slot = s;
+    }
+}
+
+// ============================================================
+// Slot discovery
+// ============================================================
+
+static void add_slot(Lowerer* L, const char* name) {
+    if (ir_slot_find(L->func, name) >= 0) return;
+    if (ir_slot_add(L->module, L->func, name, false) < 0) L->failed = true;
+}
+
+// Names bound by statements of this function (not nested definitions).
+static void collect_slots(Lowerer* L, ASTNode* node) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                collect_slots(L, node->as.block.statements[i]);
+            }
+            break;
+        case AST_ASSIGNMENT:
+            if (node->as.assignment.target->type == AST_IDENTIFIER) {
+                add_slot(L, node->as.assignment.target->as.identifier.name);
+            }
+            break;
+        case AST_AUGMENTED_ASSIGNMENT:
+            if (node->as.augmented_assignment.target->type == AST_IDENTIFIER) {
+                add_slot(L, node->as.augmented_assignment.target->as.identifier.name);
+            }
+            break;
+        case AST_IF:
+            collect_slots(L, node->as.if_stmt.then_block);
+            collect_slots(L, node->as.if_stmt.else_block);
+            break;
+        case AST_WHILE:
+            collect_slots(L, node->as.while_stmt.body);
+            break;
+        case AST_FOR:
+            add_slot(L, node->as.for_stmt.var_name);
+            collect_slots(L, node->as.for_stmt.body);
+            break;
+        case AST_WITH:
+            if (node->as.with_stmt.var_name) add_slot(L, node->as.with_stmt.var_name);
+            collect_slots(L, node->as.with_stmt.body);
+            break;
+        case AST_FUNCTION_DEF:
+            add_slot(L, node->as.function_def.name);
+            break;
+        default:
+            break;
+    }
+}
+
+static bool names_param(ASTNode* nested, const char* name) {
+    if (nested->type == AST_LAMBDA) {
+        for (int i = 0; i < nested->as.lambda.param_count; i++) {
+            if (strcmp(nested->as.lambda.param_names[i], name) == 0) return true;
+        }
+    } else if (nested->type == AST_FUNCTION_DEF) {
+        for (int i = 0; i < nested->as.function_def.param_count; i++) {
+            if (strcmp(nested->as.function_def.params[i].name, name) == 0) return true;
+        }
+    }
+    return false;
+}
+
+// An analyzed closure copies the variables it only reads when it is made;
+// the ones its maker rebinds are shared through a cell.
+static void mark_cells(Lowerer* L, ASTNode* closure) {
+    int count;
+    const ASTCapture* captures = ast_captures(closure, &count);
+    for (int k = 0; k < count; k++) {
+        if (!captures[k].mutated) continue;
+        int s = ir_slot_find(L->func, captures[k].name);
+        if (s >= 0) {
+            L->func->slots[s].captured = true;
+            L->func->slots[s].cell = true;
+        }
+    }
+}
+
+// Mark slots referenced from nested lambdas and defs. A captured slot can
+// change behind any call, so the refcount passes treat it like memory.
+static void mark_captures(Lowerer* L, ASTNode* node, ASTNode* nested) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_IDENTIFIER:
+            if (nested && !names_param(nested, node->as.identifier.name)) {
+                int s = ir_slot_find(L->func, node->as.identifier.name);
+                if (s >= 0) L->func->slots[s].captured = true;
+            }
+            break;
+        case AST_BINARY:
+            mark_captures(L, node->as.binary.left, nested);
+            mark_captures(L, node->as.binary.right, nested);
+            break;
+        case AST_UNARY:
+            mark_captures(L, node->as.unary.operand, nested);
+            break;
+        case AST_GROUPING:
+            mark_captures(L, node->as.grouping.expression, nested);
+            break;
+        case AST_CALL:
+            mark_captures(L, node->as.call.callee, nested);
+            for (int i = 0; i < node->as.call.arg_count; i++) {
+                mark_captures(L, node->as.call.args[i], nested);
+            }
+            break;
+        case AST_SUBSCRIPT:
+            mark_captures(L, node->as.subscript.object, nested);
+            mark_captures(L, node->as.subscript.index, nested);
+            break;
+        case AST_ATTRIBUTE:
+            mark_captures(L, node->as.attribute.object, nested);
+            break;
+        case AST_LIST_LITERAL:
+            for (int i = 0; i < node->as.list_literal.count; i++) {
+                mark_captures(L, node->as.list_literal.elements[i], nested);
+            }
+            break;
+        case AST_DICT_LITERAL:
+            for (int i = 0; i < node->as.dict_literal.count; i++) {
+                mark_captures(L, node->as.dict_literal.entries[i].key, nested);
+                mark_captures(L, node->as.dict_literal.entries[i].value, nested);
+            }
+            break;
+        case AST_TERNARY:
+            mark_captures(L, node->as.ternary.then_expr, nested);
+            mark_captures(L, node->as.ternary.condition, nested);
+            mark_captures(L, node->as.ternary.else_expr, nested);
+            break;
+        case AST_LAMBDA:
+            if (node->flags & AST_FLAG_CAPTURES) mark_cells(L, node);
+            else mark_captures(L, node->as.lambda.body, node);
+            break;
+        case AST_FUNCTION_DEF:
+            if (node->flags & AST_FLAG_CAPTURES) mark_cells(L, node);
+            else mark_captures(L, node->as.function_def.body, node);
+            break;
+        case AST_CLASS_DEF:
+            mark_captures(L, node->as.class_def.body, nested);
+            break;
+        case AST_EXPRESSION_STMT:
+            mark_captures(L, node->as.expression_stmt.expression, nested);
+            break;
+        case AST_ASSIGNMENT:
+            mark_captures(L, node->as.assignment.target, nested);
+            mark_captures(L, node->as.assignment.value, nested);
+            break;
+        case AST_AUGMENTED_ASSIGNMENT:
+            mark_captures(L, node->as.augmented_assignment.target, nested);
+            mark_captures(L, node->as.augmented_assignment.value, nested);
+            break;
+        case AST_RETURN:
+            mark_captures(L, node->as.ret.value, nested);
+            break;
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                mark_captures(L, node->as.block.statements[i], nested);
+            }
+            break;
+        case AST_IF:
+            mark_captures(L, node->as.if_stmt.condition, nested);
+            mark_captures(L, node->as.if_stmt.then_block, nested);
+            mark_captures(L, node->as.if_stmt.else_block, nested);
+            break;
+        case AST_WHILE:
+            mark_captures(L, node->as.while_stmt.condition, nested);
+            mark_captures(L, node->as.while_stmt.body, nested);
+            break;
+        case AST_FOR:
+            mark_captures(L, node->as.for_stmt.iterable, nested);
+            mark_captures(L, node->as.for_stmt.body, nested);
+            break;
+        case AST_WITH:
+            mark_captures(L, node->as.with_stmt.context, nested);
+            mark_captures(L, node->as.with_stmt.body, nested);
+            break;
+        case AST_LITERAL_INT:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_BOOL:
+        case AST_LITERAL_NONE:
+        case AST_PASS:
+        case AST_BREAK:
+        case AST_CONTINUE:
+        case AST_MODULE:
+            break;
+    }
+}
+
+// Module-level defs and classes are bound once and live for the whole
+// program, so loading them needs no refcounting.
+static bool is_static_global(Lowerer* L, const char* name) {
+    ASTNode* m = L->ast_module;
+    if (!m) return false;
+    for (int i = 0; i < m->as.module.count; i++) {
+        ASTNode* s = m->as.module.statements[i];
+        if (s->type == AST_FUNCTION_DEF &&
+            strcmp(s->as.function_def.name, name) == 0) return true;
+        if (s->type == AST_CLASS_DEF &&
+            strcmp(s->as.class_def.name, name) == 0) return true;
+    }
+    return false;
+}
+
+// ============================================================
+// Expressions
+// ============================================================
+
+// Index of 'name' in the capture list of the function being lowered, or -1
+static int capture_index(Lowerer* L, const char* name) {
+    ASTNode* node = L->func->node;
+    if (!node || !(node->flags & AST_FLAG_CAPTURES)) return -1;
+    return ast_find_capture(node, name);
+}
+
+// Is 'name' the nested def being lowered, read as its running closure?
+static bool is_self_name(Lowerer* L, const char* name) {
+    ASTNode* node = L->func->node;
+    return node && (node->flags & AST_FLAG_SELF_CLOSURE) &&
+           strcmp(node->as.function_def.name, name) == 0;
+}
+
+static bool is_local_name(Lowerer* L, const char* name) {
+    return ir_slot_find(L->func, name) >= 0 || capture_index(L, name) >= 0 ||
+           is_self_name(L, name);
+}
+
+// Capture #k of the running closure, retained; #-1 is the closure itself.
+// 'deref' reads a cell's contents rather than the cell.
+static IRValue emit_load_capture(Lowerer* L, int k, bool deref, int line) {
+    IRInstr* i = emit(L, IR_LOAD_CAPTURE, 0, line);
+    if (!i) return IR_NO_VALUE;
+    int count;
+    i->int_value = k;
+    i->name = k >= 0 ? ast_captures(L->func->node, &count)[k].name
+                     : L->func->node->as.function_def.name;
+    if (deref) i->flags |= IR_FLAG_DEREF;
+    IRValue v = emit_def(L, i);
+    emit_retain(L, v, line);
+    return v;
+}
+
+static IRValue lower_name(Lowerer* L, const char* name, unsigned flags, int line) {
+    int slot = ir_slot_find(L->func, name);
+    if (slot >= 0) return emit_load_slot(L, slot, flags, line);
+    int k = capture_index(L, name);
+    if (k >= 0) {
+        int count;
+        return emit_load_capture(L, k, ast_captures(L->func->node, &count)[k].mutated, line);
+    }
+    if (is_self_name(L, name)) return emit_load_capture(L, -1, false, line);
+
+    IRInstr* i = emit(L, IR_LOAD_GLOBAL, 0, line);
+    if (!i) return IR_NO_VALUE;
+    i->name = ir_strdup(L->module, name);
+    if (is_static_global(L, name)) i->flags |= IR_FLAG_STATIC;
+    IRValue v = emit_def(L, i);
+    emit_retain(L, v, line);
+    return v;
+}
+
+// Emit a call that borrows 'callee'. The arguments are passed at +1 and
+// belong to the callee. 'direct' names a statically known module-level
+// callee, or is NULL.
+static IRValue emit_call_borrowed(Lowerer* L, IRValue callee, const char* direct,
+                                  IRValue* args, int argc, int line) {
+    IRInstr* i = emit(L, IR_CALL, argc + 1, line);
+    if (!i) return IR_NO_VALUE;
+    i->args[0] = callee;
+    for (int a = 0; a < argc; a++) i->args[a + 1] = args[a];
+    if (direct) i->name = ir_strdup(L->module, direct);
+    return emit_def(L, i);
+}
+
+// As above, releasing 'callee' afterwards.
+static IRValue emit_call(Lowerer* L, IRValue callee, const char* direct,
+                         IRValue* args, int argc, int line) {
+    IRValue v = emit_call_borrowed(L, callee, direct, args, argc, line);
+    release_value(L, callee, line);
+    return v;
+}
+
+static const char* direct_callee(Lowerer* L, ASTNode* callee) {
+    if (callee->type != AST_IDENTIFIER) return NULL;
+    const char* name = callee->as.identifier.name;
+    return is_local_name(L, name) ? NULL : name;
+}
+
+// 'a and b' / 'a or b': the result goes through a synthetic slot so both
+// arms can produce it.
+static IRValue lower_logical(Lowerer* L, ASTNode* node) {
+    int line = node->line;
+    int slot = new_temp_slot(L);
+    IRValue left = lower_expr(L, node->as.binary.left);
+    emit_store_slot(L, slot, left, line);
+
+    IRValue probe = emit_load_slot(L, slot, 0, line);
+    IRInstr* t = emit(L, IR_TRUTH, 1, line);
+    if (!t) return IR_NO_VALUE;
+    t->args[0] = probe;
+    IRValue truth = emit_def(L, t);
+    release_value(L, probe, line);
+
+    IRBlock* rhs = new_block(L, L->loop_depth);
+    IRBlock* done = new_block(L, L->loop_depth);
+    if (!rhs || !done) return IR_NO_VALUE;
+    if (node->as.binary.op == TOKEN_AND) {
+        emit_branch(L, truth, rhs, done, line);
+    } else {
+        emit_branch(L, truth, done, rhs, line);
+    }
+
+    L->current = rhs;
+    IRValue right = lower_expr(L, node->as.binary.right);
+    emit_store_slot(L, slot, right, line);
+    emit_jump(L, done, line);
+
+    L->current = done;
+    return emit_move_slot(L, slot, line);
+}
+
+static IRValue lower_ternary(Lowerer* L, ASTNode* node) {
+    int line = node->line;
+    int slot = new_temp_slot(L);
+    IRValue cond = lower_condition(L, node->as.ternary.condition);
+    IRBlock* then_b = new_block(L, L->loop_depth);
+    IRBlock* else_b = new_block(L, L->loop_depth);
+    IRBlock* done = new_block(L, L->loop_depth);
+    if (!then_b || !else_b || !done) return IR_NO_VALUE;
+    emit_branch(L, cond, then_b, else_b, line);
+
+    L->current = then_b;
+    emit_store_slot(L, slot, lower_expr(L, node->as.ternary.then_expr), line);
+    emit_jump(L, done, line);
+
+    L->current = else_b;
+    emit_store_slot(L, slot, lower_expr(L, node->as.ternary.else_expr), line);
+    emit_jump(L, done, line);
+
+    L->current = done;
+    return emit_move_slot(L, slot, line);
+}
+
+// What a new closure gets for one of its captures, at +1: the variable's
+// cell if it is mutated, a copy of its value otherwise. The variable is a
+// local here or, when it belongs further out, one of this function's own
+// captures, which already is the cell or the value.
+static IRValue lower_capture(Lowerer* L, const ASTCapture* c, int line) {
+    int slot = ir_slot_find(L->func, c->name);
+    if (slot >= 0) {
+        return emit_load_slot(L, slot, L->func->slots[slot].cell ? IR_FLAG_CELL : 0, line);
+    }
+    int k = capture_index(L, c->name);
+    if (k >= 0) return emit_load_capture(L, k, false, line);
+    return lower_name(L, c->name, 0, line);
+}
+
+static IRValue lower_closure(Lowerer* L, ASTNode* node, const char* name) {
+    IRFunction* inner = lower_function(L->module, L->ast_module, node, name);
+    if (!inner) {
+        L->failed = true;
+        return IR_NO_VALUE;
+    }
+    int count = 0;
+    const ASTCapture* captures = NULL;
+    if (node->flags & AST_FLAG_CAPTURES) captures = ast_captures(node, &count);
+    IRValue* args = count > 0 ? (IRValue*)ir_alloc(L->module, sizeof(IRValue) * count) : NULL;
+    if (count > 0 && !args) {
+        L->failed = true;
+        return IR_NO_VALUE;
+    }
+    for (int k = 0; k < count; k++) args[k] = lower_capture(L, &captures[k], node->line);
+    IRInstr* i = emit(L, IR_MAKE_CLOSURE, count, node->line);
+    if (!i) return IR_NO_VALUE;
+    i->int_value = inner->index;
+    for (int k = 0; k < count; k++) i->args[k] = args[k];
+    return emit_def(L, i);
+}
+
+// Layout of a list literal's elements or a dict literal's values: typed
+// when the checker gave the literal a concrete int or float element type,
+// boxed otherwise (no type, any, or anything else)
+static ContainerLayout literal_layout(ASTNode* node) {
+    Type* t = node->inferred_type;
+    if (!t || (t->kind != TYPE_LIST && t->kind != TYPE_DICT) || !t->element_type) {
+        return LAYOUT_BOXED;
+    }
+    switch (t->element_type->kind) {
+        case TYPE_INT: return LAYOUT_INT;
+        case TYPE_FLOAT: return LAYOUT_FLOAT;
+        default: return LAYOUT_BOXED;
+    }
+}
+
+static IRValue lower_expr(Lowerer* L, ASTNode* node) {
+    if (L->failed || !node) return IR_NO_VALUE;
+    int line = node->line;
+    IRInstr* i;
+
+    switch (node->type) {
+        case AST_LITERAL_INT:
+            i = emit(L, IR_CONST_INT, 0, line);
+            if (!i) return IR_NO_VALUE;
+            i->int_value = node->as.literal_int.value;
+            return emit_def(L, i);
+        case AST_LITERAL_FLOAT:
+            i = emit(L, IR_CONST_FLOAT, 0, line);
+            if (!i) return IR_NO_VALUE;
+            i->float_value = node->as.literal_float.value;
+            return emit_def(L, i);
+        case AST_LITERAL_STRING:
+            i = emit(L, IR_CONST_STRING, 0, line);
+            if (!i) return IR_NO_VALUE;
+            i->name = ir_strdup(L->module, node->as.literal_string.value);
+            return emit_def(L, i);
+        case AST_LITERAL_BOOL:
+            i = emit(L, IR_CONST_BOOL, 0, line);
+            if (!i) return IR_NO_VALUE;
+            i->int_value = node->as.literal_bool.value;
+            return emit_def(L, i);
+        case AST_LITERAL_NONE:
+            return emit_def(L, emit(L, IR_CONST_NONE, 0, line));
+
+        case AST_IDENTIFIER:
+            return lower_name(L, node->as.identifier.name, 0, line);
+
+        case AST_BINARY: {
+            TokenType op = node->as.binary.op;
+            if (op == TOKEN_AND || op == TOKEN_OR) return lower_logical(L, node);
+            if (op == TOKEN_PIPELINE) return lower_pipeline(L, node);
+            IRValue a = lower_expr(L, node->as.binary.left);
+            IRValue b = lower_expr(L, node->as.binary.right);
+            i = emit(L, IR_BINARY, 2, line);
+            if (!i) return IR_NO_VALUE;
+            i->token = op;
+            i->args[0] = a;
+            i->args[1] = b;
+            IRValue v = emit_def(L, i);
+            release_value(L, a, line);
+            release_value(L, b, line);
+            return v;
+        }
+
+        case AST_UNARY: {
+            if (node->as.unary.op == TOKEN_MOVE) {
+                return lower_name(L, node->as.unary.operand->as.identifier.name,
+                                  IR_FLAG_MOVE_HINT, line);
+            }
+            IRValue a = lower_expr(L, node->as.unary.operand);
+            i = emit(L, IR_UNARY, 1, line);
+            if (!i) return IR_NO_VALUE;
+            i->token = node->as.unary.op;
+            i->args[0] = a;
+            IRValue v = emit_def(L, i);
+            release_value(L, a, line);
+            return v;
+        }
+
+        case AST_GROUPING:
+            return lower_expr(L, node->as.grouping.expression);
+
+        case AST_CALL: {
+            IRValue callee = lower_expr(L, node->as.call.callee);
+            int argc = node->as.call.arg_count;
+            IRValue* args = argc > 0 ? (IRValue*)ir_alloc(L->module, sizeof(IRValue) * argc) : NULL;
+            if (argc > 0 && !args) {
+                L->failed = true;
+                return IR_NO_VALUE;
+            }
+            for (int a = 0; a < argc; a++) args[a] = lower_expr(L, node->as.call.args[a]);
+            return emit_call(L, callee, direct_callee(L, node->as.call.callee),
+                             args, argc, line);
+        }
+
+        case AST_SUBSCRIPT: {
+            IRValue obj = lower_expr(L, node->as.subscript.object);
+            IRValue idx = lower_expr(L, node->as.subscript.index);
+            i = emit(L, IR_GET_ITEM, 2, line);
+            if (!i) return IR_NO_VALUE;
+            i->args[0] = obj;
+            i->args[1] = idx;
+            IRValue v = emit_def(L, i);
+            emit_retain(L, v, line);
+            release_value(L, obj, line);
+            release_value(L, idx, line);
+            return v;
+        }
+
+        case AST_ATTRIBUTE: {
+            IRValue obj = lower_expr(L, node->as.attribute.object);
+            i = emit(L, IR_GET_ATTR, 1, line);
+            if (!i) return IR_NO_VALUE;
+            i->args[0] = obj;
+            i->name = ir_strdup(L->module, node->as.attribute.name);
+            IRValue v = emit_def(L, i);
+            emit_retain(L, v, line);
+            release_value(L, obj, line);
+            return v;
+        }
+
+        case AST_LIST_LITERAL: {
+            int n = node->as.list_literal.count;
+            IRValue* elems = n > 0 ? (IRValue*)ir_alloc(L->module, sizeof(IRValue) * n) : NULL;
+            if (n > 0 && !elems) {
+                L->failed = true;
+                return IR_NO_VALUE;
+            }
+            for (int e = 0; e < n; e++) elems[e] = lower_expr(L, node->as.list_literal.elements[e]);
+            i = emit(L, IR_BUILD_LIST, n, line);
+            if (!i) return IR_NO_VALUE;
+            i->int_value = literal_layout(node);
+            for (int e = 0; e < n; e++) i->args[e] = elems[e];
+            return emit_def(L, i);
+        }
+
+        case AST_DICT_LITERAL: {
+            int n = node->as.dict_literal.count;
+            IRValue* kv = n > 0 ? (IRValue*)ir_alloc(L->module, sizeof(IRValue) * n * 2) : NULL;
+            if (n > 0 && !kv) {
+                L->failed = true;
+                return IR_NO_VALUE;
+            }
+            for (int e = 0; e < n; e++) {
+                kv[2 * e] = lower_expr(L, node->as.dict_literal.entries[e].key);
+                kv[2 * e + 1] = lower_expr(L, node->as.dict_literal.entries[e].value);
+            }
+            i = emit(L, IR_BUILD_DICT, n * 2, line);
+            if (!i) return IR_NO_VALUE;
+            i->int_value = literal_layout(node);
+            for (int e = 0; e < n * 2; e++) i->args[e] = kv[e];
+            return emit_def(L, i);
+        }
+
+        case AST_TERNARY:
+            return lower_ternary(L, node);
+
+        case AST_LAMBDA: {
+            char name[128];
+            snprintf(name, sizeof(name), "%s.<lambda@%d>", L->func->name, line);
+            return lower_closure(L, node, name);
+        }
+
+        default:
+            // Statements never appear in expression position.
+            return IR_NO_VALUE;
+    }
+}
+
+// ============================================================
+// Statements
+// ============================================================
+
+static void lower_block(Lowerer* L, ASTNode* block) {
+    if (!block) return;
+    if (block->type != AST_BLOCK) {
+        lower_stmt(L, block);
+        return;
+    }
+    for (int s = 0; s < block->as.block.count; s++) {
+        if (!L->current || L->failed) return;  // Unreachable tail
+        lower_stmt(L, block->as.block.statements[s]);
+    }
+}
+
+static void lower_assignment(Lowerer* L, ASTNode* target, IRValue value, int line) {
+    switch (target->type) {
+        case AST_IDENTIFIER: {
+            int slot = ir_slot_find(L->func, target->as.identifier.name);
+            emit_store_slot(L, slot, value, line);
+            break;
+        }
+        case AST_ATTRIBUTE: {
+            IRValue obj = lower_expr(L, target->as.attribute.object);
+            IRInstr* i = emit(L, IR_SET_ATTR, 2, line);
+            if (!i) return;
+            i->args[0] = obj;
+            i->args[1] = value;
+            i->name = ir_strdup(L->module, target->as.attribute.name);
+            release_value(L, obj, line);
+            break;
+        }
+        case AST_SUBSCRIPT: {
+            IRValue obj = lower_expr(L, target->as.subscript.object);
+            IRValue idx = lower_expr(L, target->as.subscript.index);
+            IRInstr* i = emit(L, IR_SET_ITEM, 3, line);
+            if (!i) return;
+            i->args[0] = obj;
+            i->args[1] = idx;
+            i->args[2] = value;
+            release_value(L, obj, line);
+            release_value(L, idx, line);
+            break;
+        }
+        default:
+            release_value(L, value, line);
+            break;
+    }
+}
+
+static IRValue emit_binary(Lowerer* L, TokenType op, IRValue a, IRValue b, int line) {
+    IRInstr* i = emit(L, IR_BINARY, 2, line);
+    if (!i) return IR_NO_VALUE;
+    i->token = op;
+    i->args[0] = a;
+    i->args[1] = b;
+    IRValue v = emit_def(L, i);
+    release_value(L, a, line);
+    release_value(L, b, line);
+    return v;
+}
+
+// 'target op= value'. The target's object and index are evaluated once.
+static void lower_augmented(Lowerer* L, ASTNode* node) {
+    ASTNode* target = node->as.augmented_assignment.target;
+    TokenType op = node->as.augmented_assignment.op;
+    int line = node->line;
+
+    switch (target->type) {
+        case AST_IDENTIFIER: {
+            IRValue old = lower_expr(L, target);
+            IRValue rhs = lower_expr(L, node->as.augmented_assignment.value);
+            IRValue v = emit_binary(L, op, old, rhs, line);
+            emit_store_slot(L, ir_slot_find(L->func, target->as.identifier.name), v, line);
+            break;
+        }
+        case AST_ATTRIBUTE: {
+            IRValue obj = lower_expr(L, target->as.attribute.object);
+            const char* attr = ir_strdup(L->module, target->as.attribute.name);
+            IRInstr* get = emit(L, IR_GET_ATTR, 1, line);
+            if (!get) return;
+            get->args[0] = obj;
+            get->name = attr;
+            IRValue old = emit_def(L, get);
+            emit_retain(L, old, line);
+            IRValue rhs = lower_expr(L, node->as.augmented_assignment.value);
+            IRValue v = emit_binary(L, op, old, rhs, line);
+            IRInstr* set = emit(L, IR_SET_ATTR, 2, line);
+            if (!set) return;
+            set->args[0] = obj;
+            set->args[1] = v;
+            set->name = attr;
+            release_value(L, obj, line);
+            break;
+        }
+        case AST_SUBSCRIPT: {
+            IRValue obj = lower_expr(L, target->as.subscript.object);
+            IRValue idx = lower_expr(L, target->as.subscript.index);
+            IRInstr* get = emit(L, IR_GET_ITEM, 2, line);
+            if (!get) return;
+            get->args[0] = obj;
+            get->args[1] = idx;
+            IRValue old = emit_def(L, get);
+            emit_retain(L, old, line);
+            IRValue rhs = lower_expr(L, node->as.augmented_assignment.value);
+            IRValue v = emit_binary(L, op, old, rhs, line);
+            IRInstr* set = emit(L, IR_SET_ITEM, 3, line);
+            if (!set) return;
+            set->args[0] = obj;
+            set->args[1] = idx;
+            set->args[2] = v;
+            release_value(L, obj, line);
+            release_value(L, idx, line);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void lower_return(Lowerer* L, ASTNode* node) {
+    IRValue v = node->as.ret.value
+              ? lower_expr(L, node->as.ret.value)
+              : emit_def(L, emit(L, IR_CONST_NONE, 0, node->line));
+    emit_exit_cleanup(L, node->line);
+    IRInstr* i = emit(L, IR_RETURN, 1, node->line);
+    if (i) i->args[0] = v;
+    L->current = NULL;
+}
+
+static void lower_if(Lowerer* L, ASTNode* node) {
+    int line = node->line;
+    IRValue cond = lower_condition(L, node->as.if_stmt.condition);
+    IRBlock* then_b = new_block(L, L->loop_depth);
+    IRBlock* else_b = node->as.if_stmt.else_block ? new_block(L, L->loop_depth) : NULL;
+    IRBlock* done = new_block(L, L->loop_depth);
+    if (!then_b || !done) return;
+    emit_branch(L, cond, then_b, else_b ? else_b : done, line);
+
+    L->current = then_b;
+    lower_block(L, node->as.if_stmt.then_block);
+    emit_jump(L, done, line);
+
+    if (else_b) {
+        L->current = else_b;
+        lower_block(L, node->as.if_stmt.else_block);
+        emit_jump(L, done, line);
+    }
+    L->current = done;
+}
+
+static void lower_while(Lowerer* L, ASTNode* node) {
+    int line = node->line;
+    L->loop_depth++;
+    IRBlock* header = new_block(L, L->loop_depth);
+    IRBlock* body = new_block(L, L->loop_depth);
+    L->loop_depth--;
+    IRBlock* exit = new_block(L, L->loop_depth);
+    if (!header || !body || !exit) return;
+    emit_jump(L, header, line);
+
+    L->loop_depth++;
+    L->current = header;
+    IRValue cond = lower_condition(L, node->as.while_stmt.condition);
+    emit_branch(L, cond, body, exit, line);
+
+    LoopContext loop = { exit, header, IR_NO_VALUE, L->loop };
+    L->loop = &loop;
+    L->current = body;
+    lower_block(L, node->as.while_stmt.body);
+    emit_jump(L, header, line);
+    L->loop = loop.outer;
+    L->loop_depth--;
+
+    L->current = exit;
+}
+
+// Iterate 'seq', an owned value already evaluated from the loop's iterable.
+static void lower_for_over(Lowerer* L, ASTNode* node, IRValue seq) {
+    int line = node->line;
+    IRInstr* gi = emit(L, IR_GET_ITER, 1, line);
+    if (!gi) return;
+    gi->args[0] = seq;
+    IRValue it = emit_def(L, gi);
+    release_value(L, seq, line);
+
+    L->loop_depth++;
+    IRBlock* header = new_block(L, L->loop_depth);
+    IRBlock* body = new_block(L, L->loop_depth);
+    L->loop_depth--;
+    IRBlock* exit = new_block(L, L->loop_depth);
+    if (!header || !body || !exit) return;
+    emit_jump(L, header, line);
+
+    L->loop_depth++;
+    L->current = header;
+    IRInstr* hn = emit(L, IR_ITER_HAS_NEXT, 1, line);
+    if (!hn) return;
+    hn->args[0] = it;
+    emit_branch(L, emit_def(L, hn), body, exit, line);
+
+    LoopContext loop = { exit, header, it, L->loop };
+    L->loop = &loop;
+    L->current = body;
+    IRInstr* next = emit(L, IR_ITER_NEXT, 1, line);
+    if (!next) return;
+    next->args[0] = it;
+    emit_store_slot(L, ir_slot_find(L->func, node->as.for_stmt.var_name),
+                    emit_def(L, next), line);
+    lower_block(L, node->as.for_stmt.body);
+    emit_jump(L, header, line);
+    L->loop = loop.outer;
+    L->loop_depth--;
+
+    L->current = exit;
+    release_value(L, it, line);
+}
+
+static void lower_parallel_for(Lowerer* L, ASTNode* node);
+static bool lower_vector_loop(Lowerer* L, ASTNode* node);
+
+static void lower_for(Lowerer* L, ASTNode* node) {
+    if (node->flags & AST_FLAG_PARALLEL_LOOP) {
+        lower_parallel_for(L, node);
+        return;
+    }
+    if (lower_vector_loop(L, node)) return;
+    lower_for_over(L, node, lower_expr(L, node->as.for_stmt.iterable));
+}
+
+// ============================================================
+// Pipelines
+// ============================================================
+
+// 'xs |> map(f) |> filter(p) |> take(n) |> ...' is fused: the stages run
+// one element at a time inside a single loop over 'xs', so no
+// intermediate list is built and a take or find_first stops pulling as
+// soon as it is satisfied. Only the end of a fused run materializes: into
+// a list by default, or through a consuming stage (find_first, reduce).
+// 'to_list' is an explicit barrier. Any other stage is an opaque call,
+// which also acts as a barrier: the run before it is collected and passed
+// to it. The stage names are recognized only when nothing in scope
+// shadows them.
+
+typedef enum {
+    FUSE_OPAQUE,
+    FUSE_MAP,
+    FUSE_FILTER,
+    FUSE_TAKE,
+    FUSE_TO_LIST,
+    FUSE_FIND_FIRST,
+    FUSE_REDUCE
+} FuseKind;
+
+typedef struct {
+    FuseKind kind;
+    ASTNode* node;
+    IRValue fn;                  // Callable, or the take limit
+    const char* direct;          // Statically known callee, or NULL
+    int slot;                    // take: the counter
+} FusedStage;
+
+static FuseKind classify_stage(Lowerer* L, ASTNode* stage) {
+    static const struct { const char* name; int argc; FuseKind kind; } known[] = {
+        { "map", 1, FUSE_MAP },
+        { "filter", 1, FUSE_FILTER },
+        { "take", 1, FUSE_TAKE },
+        { "to_list", 0, FUSE_TO_LIST },
+        { "find_first", 1, FUSE_FIND_FIRST },
+        { "reduce", 2, FUSE_REDUCE },
+    };
+    ASTNode* callee = stage;
+    int argc = 0;
+    if (stage->type == AST_CALL) {
+        callee = stage->as.call.callee;
+        argc = stage->as.call.arg_count;
+    }
+    if (callee->type != AST_IDENTIFIER) return FUSE_OPAQUE;
+    const char* name = callee->as.identifier.name;
+    if (is_local_name(L, name) || is_static_global(L, name)) return FUSE_OPAQUE;
+    for (size_t k = 0; k < sizeof(known) / sizeof(known[0]); k++) {
+        if (strcmp(name, known[k].name) != 0 || argc != known[k].argc) continue;
+        // A bare 'to_list' is a stage too; the others need their arguments
+        if (stage->type != AST_CALL && known[k].kind != FUSE_TO_LIST) return FUSE_OPAQUE;
+        return known[k].kind;
+    }
+    return FUSE_OPAQUE;
+}
+
+static bool is_consumer(FuseKind kind) {
+    return kind == FUSE_TO_LIST || kind == FUSE_FIND_FIRST || kind == FUSE_REDUCE;
+}
+
+// Stage callables live until the loop exits, so each call borrows them.
+static IRValue call_stage(Lowerer* L, FusedStage* s, IRValue* args, int argc, int line) {
+    return emit_call_borrowed(L, s->fn, s->direct, args, argc, line);
+}
+
+static IRValue stage_truth(Lowerer* L, FusedStage* s, IRValue v, int line) {
+    emit_retain(L, v, line);  // The predicate borrows nothing: pass a +1
+    IRValue r = call_stage(L, s, &v, 1, line);
+    IRInstr* t = emit(L, IR_TRUTH, 1, line);
+    if (!t) return IR_NO_VALUE;
+    t->args[0] = r;
+    IRValue b = emit_def(L, t);
+    release_value(L, r, line);
+    return b;
+}
+
+// Lower one fused run over 'seq' (owned): 'stages' are map/filter/take,
+// 'consumer' is the stage that ends the run, or NULL to collect a list.
+// The stage arguments are evaluated once, ahead of the loop.
+static IRValue lower_fused_run(Lowerer* L, IRValue seq, FusedStage* stages, int n,
+                               FusedStage* consumer, int line) {
+    for (int k = 0; k < n; k++) {
+        FusedStage* s = &stages[k];
+        ASTNode* arg = s->node->as.call.args[0];
+        s->fn = lower_expr(L, arg);
+        s->direct = s->kind == FUSE_TAKE ? NULL : direct_callee(L, arg);
+        if (s->kind == FUSE_TAKE) {
+            s->slot = new_temp_slot(L);
+            IRInstr* z = emit(L, IR_CONST_INT, 0, line);
+            if (!z) return IR_NO_VALUE;
+            z->int_value = 0;
+            emit_store_slot(L, s->slot, emit_def(L, z), line);
+        }
+    }
+
+    if (consumer && consumer->kind != FUSE_TO_LIST) {
+        ASTNode* arg = consumer->node->as.call.args[0];
+        consumer->fn = lower_expr(L, arg);
+        consumer->direct = direct_callee(L, arg);
+    }
+
+    // The result lives in a slot: the list, the match, or the accumulator
+    FuseKind end = consumer ? consumer->kind : FUSE_TO_LIST;
+    int result = new_temp_slot(L);
+    IRValue init;
+    if (end == FUSE_TO_LIST) {
+        init = emit_def(L, emit(L, IR_BUILD_LIST, 0, line));
+    } else if (end == FUSE_FIND_FIRST) {
+        init = emit_def(L, emit(L, IR_CONST_NONE, 0, line));
+    } else {
+        init = lower_expr(L, consumer->node->as.call.args[1]);
+    }
+    emit_store_slot(L, result, init, line);
+
+    IRInstr* gi = emit(L, IR_GET_ITER, 1, line);
+    if (!gi) return IR_NO_VALUE;
+    gi->args[0] = seq;
+    IRValue it = emit_def(L, gi);
+    release_value(L, seq, line);
+
+    L->loop_depth++;
+    IRBlock* header = new_block(L, L->loop_depth);
+    L->loop_depth--;
+    IRBlock* exit = new_block(L, L->loop_depth);
+    if (!header || !exit) return IR_NO_VALUE;
+    emit_jump(L, header, line);
+
+    // Header: stop once any take is full, then once the source runs dry
+    L->loop_depth++;
+    L->current = header;
+    for (int k = 0; k < n; k++) {
+        if (stages[k].kind != FUSE_TAKE) continue;
+        IRValue count = emit_load_slot(L, stages[k].slot, 0, line);
+        emit_retain(L, stages[k].fn, line);
+        IRValue below = emit_binary(L, TOKEN_LESS, count, stages[k].fn, line);
+        IRInstr* t = emit(L, IR_TRUTH, 1, line);
+        if (!t) return IR_NO_VALUE;
+        t->args[0] = below;
+        IRValue b = emit_def(L, t);
+        release_value(L, below, line);
+        IRBlock* more = new_block(L, L->loop_depth);
+        if (!more) return IR_NO_VALUE;
+        emit_branch(L, b, more, exit, line);
+        L->current = more;
+    }
+    IRBlock* body = new_block(L, L->loop_depth);
+    IRInstr* hn = emit(L, IR_ITER_HAS_NEXT, 1, line);
+    if (!body || !hn) return IR_NO_VALUE;
+    hn->args[0] = it;
+    emit_branch(L, emit_def(L, hn), body, exit, line);
+
+    L->current = body;
+    IRInstr* next = emit(L, IR_ITER_NEXT, 1, line);
+    if (!next) return IR_NO_VALUE;
+    next->args[0] = it;
+    IRValue cur = emit_def(L, next);
+    for (int k = 0; k < n; k++) {
+        FusedStage* s = &stages[k];
+        if (s->kind == FUSE_MAP) {
+            cur = call_stage(L, s, &cur, 1, line);
+        } else if (s->kind == FUSE_FILTER) {
+            IRValue keep = stage_truth(L, s, cur, line);
+            IRBlock* kept = new_block(L, L->loop_depth);
+            IRBlock* dropped = new_block(L, L->loop_depth);
+            if (!kept || !dropped) return IR_NO_VALUE;
+            emit_branch(L, keep, kept, dropped, line);
+            L->current = dropped;
+            release_value(L, cur, line);
+            emit_jump(L, header, line);
+            L->current = kept;
+        } else {
+            IRValue count = emit_load_slot(L, s->slot, 0, line);
+            IRInstr* one = emit(L, IR_CONST_INT, 0, line);
+            if (!one) return IR_NO_VALUE;
+            one->int_value = 1;
+            emit_store_slot(L, s->slot,
+                            emit_binary(L, TOKEN_PLUS, count, emit_def(L, one), line), line);
+        }
+    }
+
+    if (end == FUSE_TO_LIST) {
+        // result.append(cur)
+        IRValue list = emit_load_slot(L, result, 0, line);
+        IRInstr* m = emit(L, IR_GET_ATTR, 1, line);
+        if (!m) return IR_NO_VALUE;
+        m->args[0] = list;
+        m->name = ir_strdup(L->module, "append");
+        IRValue method = emit_def(L, m);
+        emit_retain(L, method, line);
+        release_value(L, list, line);
+        release_value(L, emit_call(L, method, NULL, &cur, 1, line), line);
+        emit_jump(L, header, line);
+    } else if (end == FUSE_FIND_FIRST) {
+        IRValue hit = stage_truth(L, consumer, cur, line);
+        IRBlock* found = new_block(L, L->loop_depth);
+        IRBlock* missed = new_block(L, L->loop_depth);
+        if (!found || !missed) return IR_NO_VALUE;
+        emit_branch(L, hit, found, missed, line);
+        L->current = found;
+        emit_store_slot(L, result, cur, line);  // Replaces the immortal None
+        emit_jump(L, exit, line);
+        L->current = missed;
+        release_value(L, cur, line);
+        emit_jump(L, header, line);
+    } else {
+        // result = f(result, cur)
+        IRValue args[2] = { emit_move_slot(L, result, line), cur };
+        emit_store_slot(L, result, call_stage(L, consumer, args, 2, line), line);
+        emit_jump(L, header, line);
+    }
+    L->loop_depth--;
+
+    L->current = exit;
+    release_value(L, it, line);
+    for (int k = 0; k < n; k++) release_value(L, stages[k].fn, line);
+    if (consumer && consumer->kind != FUSE_TO_LIST) release_value(L, consumer->fn, line);
+    return emit_move_slot(L, result, line);
+}
+
+static int lower_vector_maps(Lowerer* L, ASTNode* source, FusedStage* stages, int n,
+                             IRValue* cur);
+
+static IRValue lower_pipeline(Lowerer* L, ASTNode* node) {
+    int line = node->line;
+    // Flatten the left-nested chain: ((xs |> a) |> b) |> c
+    int n = 0;
+    ASTNode* source = node;
+    while (source->type == AST_BINARY && source->as.binary.op == TOKEN_PIPELINE) {
+        source = source->as.binary.left;
+        n++;
+    }
+    FusedStage* stages = (FusedStage*)ir_alloc(L->module, sizeof(FusedStage) * n);
+    if (!stages) {
+        L->failed = true;
+        return IR_NO_VALUE;
+    }
+    ASTNode* link = node;
+    for (int k = n - 1; k >= 0; k--) {
+        stages[k].node = link->as.binary.right;
+        stages[k].kind = classify_stage(L, stages[k].node);
+        link = link->as.binary.left;
+    }
+
+    IRValue cur = lower_expr(L, source);
+    // First stage of the pending fused run, after any vectorized maps
+    int run = lower_vector_maps(L, source, stages, n, &cur);
+    for (int k = run; k < n; k++) {
+        FusedStage* s = &stages[k];
+        if (s->kind == FUSE_OPAQUE) {
+            // A barrier: materialize the run so far, then 'cur |> f' calls f(cur)
+            if (run < k) cur = lower_fused_run(L, cur, &stages[run], k - run, NULL, line);
+            IRValue f = lower_expr(L, s->node);
+            cur = emit_call(L, f, direct_callee(L, s->node), &cur, 1, line);
+            run = k + 1;
+        } else if (is_consumer(s->kind)) {
+            cur = lower_fused_run(L, cur, &stages[run], k - run, s, line);
+            run = k + 1;
+        }
+    }
+    if (run < n) cur = lower_fused_run(L, cur, &stages[run], n - run, NULL, line);
+    return cur;
+}
+
+// ============================================================
+// Vector kernels
+// ============================================================
+
+// Loops and map stages over List[int] / List[float] whose body is one
+// element-wise operation become a single kernel call (IR_VEC_* in ir.h):
+//   for x in xs: acc += x                      acc = vreduce sum acc, xs
+//   for x in xs: acc += x * x                  acc = vreduce dot acc, xs, xs
+//   for i in range(n): acc += a[i]             acc = vreduce sum acc, a, n
+//   for i in range(n): acc += a[i] * b[i]      acc = vreduce dot acc, a, b, n
+//   for i in range(n): out[i] = a[i] op b[i]   vstore op out, a, b, n
+//   xs |> map(x => x op c)                     vmap op xs, c
+// where op is +, -, * or a call of min or max (when nothing in scope
+// shadows them), and b may instead be a number the loop leaves alone: a
+// literal or a local of type int or float. The list types come from the
+// type checker; a list that turns out not to be typed at run time takes
+// the kernels' generic path, so a wrong guess costs only speed. Float
+// sums are reassociated (see kernels.h). The loop variable is never
+// assigned, so it must not be used anywhere else in the function.
+
+static ASTNode* strip_grouping(ASTNode* node) {
+    while (node && node->type == AST_GROUPING) node = node->as.grouping.expression;
+    return node;
+}
+
+static bool is_numeric_list(ASTNode* node) {
+    Type* t = node ? node->inferred_type : NULL;
+    return t && t->kind == TYPE_LIST && t->element_type &&
+           (t->element_type->kind == TYPE_INT || t->element_type->kind == TYPE_FLOAT);
+}
+
+static bool is_number_type(ASTNode* node) {
+    Type* t = node ? node->inferred_type : NULL;
+    return t && (t->kind == TYPE_INT || t->kind == TYPE_FLOAT);
+}
+
+static bool is_name(ASTNode* node, const char* name) {
+    return node && node->type == AST_IDENTIFIER && strcmp(node->as.identifier.name, name) == 0;
+}
+
+static bool is_builtin(Lowerer* L, ASTNode* callee, const char* name) {
+    return is_name(callee, name) && !is_local_name(L, name) &&
+           !is_static_global(L, name);
+}
+
+// Does 'name' occur anywhere in 'node', other than inside 'skip'?
+static bool mentions(ASTNode* node, const char* name, ASTNode* skip) {
+    if (!node || node == skip) return false;
+    switch (node->type) {
+        case AST_IDENTIFIER:
+            return strcmp(node->as.identifier.name, name) == 0;
+        case AST_BINARY:
+            return mentions(node->as.binary.left, name, skip) ||
+                   mentions(node->as.binary.right, name, skip);
+        case AST_UNARY:
+            return mentions(node->as.unary.operand, name, skip);
+        case AST_GROUPING:
+            return mentions(node->as.grouping.expression, name, skip);
+        case AST_CALL:
+            if (mentions(node->as.call.callee, name, skip)) return true;
+            for (int i = 0; i < node->as.call.arg_count; i++) {
+                if (mentions(node->as.call.args[i], name, skip)) return true;
+            }
+            return false;
+        case AST_SUBSCRIPT:
+            return mentions(node->as.subscript.object, name, skip) ||
+                   mentions(node->as.subscript.index, name, skip);
+        case AST_ATTRIBUTE:
+            return mentions(node->as.attribute.object, name, skip);
+        case AST_LIST_LITERAL:
+            for (int i = 0; i < node->as.list_literal.count; i++) {
+                if (mentions(node->as.list_literal.elements[i], name, skip)) return true;
+            }
+            return false;
+        case AST_DICT_LITERAL:
+            for (int i = 0; i < node->as.dict_literal.count; i++) {
+                if (mentions(node->as.dict_literal.entries[i].key, name, skip) ||
+                    mentions(node->as.dict_literal.entries[i].value, name, skip)) return true;
+            }
+            return false;
+        case AST_TERNARY:
+            return mentions(node->as.ternary.then_expr, name, skip) ||
+                   mentions(node->as.ternary.condition, name, skip) ||
+                   mentions(node->as.ternary.else_expr, name, skip);
+        case AST_LAMBDA:
+            return names_param(node, name) || mentions(node->as.lambda.body, name, skip);
+        case AST_FUNCTION_DEF:
+            return strcmp(node->as.function_def.name, name) == 0 || names_param(node, name) ||
+                   mentions(node->as.function_def.body, name, skip);
+        case AST_CLASS_DEF:
+            return strcmp(node->as.class_def.name, name) == 0 ||
+                   mentions(node->as.class_def.body, name, skip);
+        case AST_EXPRESSION_STMT:
+            return mentions(node->as.expression_stmt.expression, name, skip);
+        case AST_ASSIGNMENT:
+            return mentions(node->as.assignment.target, name, skip) ||
+                   mentions(node->as.assignment.value, name, skip);
+        case AST_AUGMENTED_ASSIGNMENT:
+            return mentions(node->as.augmented_assignment.target, name, skip) ||
+                   mentions(node->as.augmented_assignment.value, name, skip);
+        case AST_RETURN:
+            return mentions(node->as.ret.value, name, skip);
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                if (mentions(node->as.block.statements[i], name, skip)) return true;
+            }
+            return false;
+        case AST_IF:
+            return mentions(node->as.if_stmt.condition, name, skip) ||
+                   mentions(node->as.if_stmt.then_block, name, skip) ||
+                   mentions(node->as.if_stmt.else_block, name, skip);
+        case AST_WHILE:
+            return mentions(node->as.while_stmt.condition, name, skip) ||
+                   mentions(node->as.while_stmt.body, name, skip);
+        case AST_FOR:
+            return strcmp(node->as.for_stmt.var_name, name) == 0 ||
+                   mentions(node->as.for_stmt.iterable, name, skip) ||
+                   mentions(node->as.for_stmt.body, name, skip);
+        case AST_WITH:
+            return (node->as.with_stmt.var_name &&
+                    strcmp(node->as.with_stmt.var_name, name) == 0) ||
+                   mentions(node->as.with_stmt.context, name, skip) ||
+                   mentions(node->as.with_stmt.body, name, skip);
+        case AST_LITERAL_INT:
+        case AST_LITERAL_FLOAT:
+        case AST_LITERAL_STRING:
+        case AST_LITERAL_BOOL:
+        case AST_LITERAL_NONE:
+        case AST_PASS:
+        case AST_BREAK:
+        case AST_CONTINUE:
+        case AST_MODULE:
+            return false;
+    }
+    return false;
+}
+
+typedef struct {
+    const char* var;             // Loop variable or lambda parameter
+    ASTNode* source;             // What 'var' itself ranges over; NULL for range(n)
+} ElemContext;
+
+// The list whose current element 'node' is: 'var' itself, or 'a[var]' for
+// a numeric list 'a' when 'var' is a range index. NULL for anything else.
+static ASTNode* element_list(ElemContext* ec, ASTNode* node) {
+    node = strip_grouping(node);
+    if (is_name(node, ec->var)) return ec->source;
+    if (ec->source || node->type != AST_SUBSCRIPT) return NULL;
+    ASTNode* obj = node->as.subscript.object;
+    if (obj->type != AST_IDENTIFIER || is_name(obj, ec->var) ||
+        !is_name(strip_grouping(node->as.subscript.index), ec->var) ||
+        !is_numeric_list(obj)) return NULL;
+    return obj;
+}
+
+static bool invariant_number(ElemContext* ec, ASTNode* node) {
+    node = strip_grouping(node);
+    if (node->type == AST_LITERAL_INT || node->type == AST_LITERAL_FLOAT) return true;
+    return node->type == AST_IDENTIFIER && !is_name(node, ec->var) && is_number_type(node);
+}
+
+typedef struct {
+    KernelOp op;
+    ASTNode* a;                  // List operand
+    ASTNode* b;                  // List operand, or the broadcast number
+} ElemOp;
+
+// 'node' as 'a op b' over the elements of 'ec'
+static bool match_elementwise(Lowerer* L, ElemContext* ec, ASTNode* node, ElemOp* out) {
+    node = strip_grouping(node);
+    ASTNode* x;
+    ASTNode* y;
+    if (node->type == AST_BINARY) {
+        switch (node->as.binary.op) {
+            case TOKEN_PLUS: out->op = KERNEL_ADD; break;
+            case TOKEN_MINUS: out->op = KERNEL_SUB; break;
+            case TOKEN_STAR: out->op = KERNEL_MUL; break;
+            default: return false;
+        }
+        x = node->as.binary.left;
+        y = node->as.binary.right;
+    } else if (node->type == AST_CALL && node->as.call.arg_count == 2) {
+        if (is_builtin(L, node->as.call.callee, "min")) {
+            out->op = KERNEL_MIN;
+        } else if (is_builtin(L, node->as.call.callee, "max")) {
+            out->op = KERNEL_MAX;
+        } else {
+            return false;
+        }
+        x = node->as.call.args[0];
+        y = node->as.call.args[1];
+    } else {
+        return false;
+    }
+
+    out->a = element_list(ec, x);
+    if (!out->a) {
+        // 'c + x' and 'c * x' commute; min and max pick b on ties, so
+        // they keep their operand order like subtraction
+        if ((out->op != KERNEL_ADD && out->op != KERNEL_MUL) || !invariant_number(ec, x)) {
+            return false;
+        }
+        out->a = element_list(ec, y);
+        out->b = strip_grouping(x);
+        return out->a != NULL;
+    }
+    out->b = element_list(ec, y);
+    if (!out->b && invariant_number(ec, y)) out->b = strip_grouping(y);
+    return out->b != NULL;
+}
+
+// Lower each distinct operand once; 'seq' is the already evaluated
+// iterable of a 'for x in xs' loop
+static IRValue lower_operand(Lowerer* L, ASTNode* node, ASTNode* iterable, IRValue seq,
+                             ASTNode* other, IRValue other_value) {
+    if (node == iterable) return seq;
+    if (node == other) return other_value;
+    return lower_expr(L, node);
+}
+
+static void emit_vector_op(Lowerer* L, IROpcode op, KernelOp kop, IRValue* args, int argc,
+                           int acc_slot, int line) {
+    IRInstr* i = emit(L, op, argc, line);
+    if (!i) return;
+    i->int_value = kop;
+    for (int a = 0; a < argc; a++) i->args[a] = args[a];
+    IRValue v = op == IR_VEC_STORE ? IR_NO_VALUE : emit_def(L, i);
+    for (int a = 0; a < argc; a++) {
+        bool seen = false;
+        for (int b = 0; b < a; b++) seen = seen || args[b] == args[a];
+        if (!seen) release_value(L, args[a], line);
+    }
+    if (acc_slot >= 0) emit_store_slot(L, acc_slot, v, line);
+}
+
+// A for loop matching one of the patterns above, lowered to its kernel.
+// False, with nothing emitted, when it does not match.
+static bool lower_vector_loop(Lowerer* L, ASTNode* node) {
+    ASTNode* fn = L->func->node;
+    const char* var = node->as.for_stmt.var_name;
+    ASTNode* body = node->as.for_stmt.body;
+    if (!fn || fn->type != AST_FUNCTION_DEF || names_param(fn, var) ||
+        mentions(fn->as.function_def.body, var, node)) return false;
+    if (body->type == AST_BLOCK) {
+        if (body->as.block.count != 1) return false;
+        body = body->as.block.statements[0];
+    }
+
+    ASTNode* iterable = strip_grouping(node->as.for_stmt.iterable);
+    ASTNode* count = NULL;
+    ElemContext ec = { var, NULL };
+    if (mentions(iterable, var, NULL)) return false;
+    if (is_numeric_list(iterable)) {
+        ec.source = iterable;
+    } else if (iterable->type == AST_CALL && iterable->as.call.arg_count == 1 &&
+               is_builtin(L, iterable->as.call.callee, "range") &&
+               iterable->as.call.args[0]->inferred_type &&
+               iterable->as.call.args[0]->inferred_type->kind == TYPE_INT) {
+        count = iterable->as.call.args[0];
+    } else {
+        return false;
+    }
+
+    int line = node->line;
+    IRValue args[4];
+    if (body->type == AST_AUGMENTED_ASSIGNMENT) {
+        // acc += x, or acc += x * y
+        ASTNode* target = body->as.augmented_assignment.target;
+        if (body->as.augmented_assignment.op != TOKEN_PLUS ||
+            target->type != AST_IDENTIFIER) return false;
+        const char* acc = target->as.identifier.name;
+        int acc_slot = ir_slot_find(L->func, acc);
+        if (acc_slot < 0 || strcmp(acc, var) == 0 || mentions(iterable, acc, NULL)) return false;
+        ASTNode* value = strip_grouping(body->as.augmented_assignment.value);
+        ASTNode* a = element_list(&ec, value);
+        ASTNode* b = NULL;
+        if (!a) {
+            if (value->type != AST_BINARY || value->as.binary.op != TOKEN_STAR) return false;
+            a = element_list(&ec, value->as.binary.left);
+            b = element_list(&ec, value->as.binary.right);
+            if (!a || !b) return false;
+        }
+        if (is_name(a, acc) || is_name(b, acc)) return false;
+
+        IRValue seq = lower_expr(L, count ? count : iterable);
+        int argc = 0;
+        args[argc++] = IR_NO_VALUE;  // The accumulator, loaded last
+        args[argc++] = lower_operand(L, a, iterable, seq, NULL, IR_NO_VALUE);
+        if (b) args[argc++] = lower_operand(L, b, iterable, seq, a, args[1]);
+        if (count) args[argc++] = seq;
+        args[0] = lower_name(L, acc, 0, line);
+        emit_vector_op(L, IR_VEC_REDUCE, b ? KERNEL_DOT : KERNEL_SUM, args, argc,
+                       acc_slot, line);
+        return true;
+    }
+
+    if (body->type == AST_ASSIGNMENT && count) {
+        // out[i] = a[i] op b[i]
+        ASTNode* target = body->as.assignment.target;
+        if (target->type != AST_SUBSCRIPT) return false;
+        ASTNode* out = target->as.subscript.object;
+        if (out->type != AST_IDENTIFIER || is_name(out, var) || !is_numeric_list(out) ||
+            !is_name(strip_grouping(target->as.subscript.index), var)) return false;
+        ElemOp e;
+        if (!match_elementwise(L, &ec, body->as.assignment.value, &e)) return false;
+
+        args[3] = lower_expr(L, count);
+        args[0] = lower_expr(L, out);
+        args[1] = lower_expr(L, e.a);
+        args[2] = e.b == e.a ? args[1] : lower_expr(L, e.b);
+        emit_vector_op(L, IR_VEC_STORE, e.op, args, 4, -1, line);
+        return true;
+    }
+    return false;
+}
+
+// The leading map stages of a pipeline over a numeric list that match
+// 'map(x => x op c)', each lowered to a vmap of 'cur' (owned, replaced by
+// the new list). Returns how many stages that covered.
+static int lower_vector_maps(Lowerer* L, ASTNode* source, FusedStage* stages, int n,
+                             IRValue* cur) {
+    if (!is_numeric_list(strip_grouping(source))) return 0;
+    // take and find_first stop pulling early; a whole-list map ahead of
+    // them could do far more work than the fused loop
+    for (int k = 0; k < n; k++) {
+        if (stages[k].kind == FUSE_TAKE || stages[k].kind == FUSE_FIND_FIRST) return 0;
+        if (stages[k].kind == FUSE_OPAQUE || is_consumer(stages[k].kind)) break;
+    }
+
+    int k = 0;
+    for (; k < n && stages[k].kind == FUSE_MAP; k++) {
+        ASTNode* f = stages[k].node->as.call.args[0];
+        if (f->type != AST_LAMBDA || f->as.lambda.param_count != 1) break;
+        ElemContext ec = { f->as.lambda.param_names[0], f };
+        ElemOp e;
+        if (!match_elementwise(L, &ec, f->as.lambda.body, &e)) break;
+        IRValue args[2] = { *cur, e.b == f ? *cur : lower_expr(L, e.b) };
+        IRInstr* i = emit(L, IR_VEC_MAP, 2, stages[k].node->line);
+        if (!i) break;
+        i->int_value = e.op;
+        i->args[0] = args[0];
+        i->args[1] = args[1];
+        *cur = emit_def(L, i);
+        release_value(L, args[0], stages[k].node->line);
+        if (args[1] != args[0]) release_value(L, args[1], stages[k].node->line);
+    }
+    return k;
+}
+
+// ============================================================
+// Parallel for loops
+// ============================================================
+
+// The chunk function of a parallel loop (see ir.h): one '$chunk'
+// parameter, the accumulators started at their identities, the loop
+// itself, and the accumulators moved out into the result list. Names the
+// body reads from the enclosing function are loaded by name, like the
+// free variables of a lambda.
+static bool lower_chunk_body(Lowerer* L, ASTNode* loop, LoopAnalysis* la) {
+    IRModule* module = L->module;
+    IRFunction* func = L->func;
+    int line = loop->line;
+
+    func->params = (IRParam*)ir_alloc(module, sizeof(IRParam));
+    if (!func->params) return false;
+    func->param_count = 1;
+    func->params[0].name = ir_strdup(module, "$chunk");
+    add_slot(L, "$chunk");
+
+    int n = la->reduction_count;
+    if (n > 0) {
+        func->reductions = (IRReduction*)ir_alloc(module, sizeof(IRReduction) * n);
+        if (!func->reductions) return false;
+        func->reduction_count = n;
+    }
+    for (int r = 0; r < n; r++) {
+        func->reductions[r].name = ir_strdup(module, la->reductions[r].name);
+        func->reductions[r].kind = la->reductions[r].kind;
+        add_slot(L, la->reductions[r].name);
+    }
+    collect_slots(L, loop);
+    mark_captures(L, loop->as.for_stmt.body, NULL);
+    if (L->failed) return false;
+
+    L->current = new_block(L, 0);
+    IRInstr* p = emit(L, IR_PARAM, 0, line);
+    if (!p) return false;
+    p->int_value = 0;
+    emit_store_slot(L, 0, emit_def(L, p), line);
+
+    for (int r = 0; r < n; r++) {
+        IRInstr* identity;
+        if (la->reductions[r].kind == REDUCE_APPEND) {
+            identity = emit(L, IR_BUILD_LIST, 0, line);
+        } else {
+            identity = emit(L, IR_CONST_INT, 0, line);
+            if (identity) identity->int_value = la->reductions[r].kind == REDUCE_PRODUCT ? 1 : 0;
+        }
+        emit_store_slot(L, ir_slot_find(func, la->reductions[r].name),
+                        emit_def(L, identity), line);
+    }
+
+    lower_for_over(L, loop, emit_load_slot(L, 0, 0, line));
+
+    IRValue result;
+    if (n == 0) {
+        result = emit_def(L, emit(L, IR_CONST_NONE, 0, line));
+    } else {
+        IRValue* parts = (IRValue*)ir_alloc(module, sizeof(IRValue) * n);
+        if (!parts) return false;
+        for (int r = 0; r < n; r++) {
+            parts[r] = emit_move_slot(L, ir_slot_find(func, la->reductions[r].name), line);
+        }
+        IRInstr* list = emit(L, IR_BUILD_LIST, n, line);
+        if (!list) return false;
+        for (int r = 0; r < n; r++) list->args[r] = parts[r];
+        result = emit_def(L, list);
+    }
+    emit_exit_cleanup(L, line);
+    IRInstr* ret = emit(L, IR_RETURN, 1, line);
+    if (ret) ret->args[0] = result;
+    return !L->failed;
+}
+
+static IRFunction* lower_chunk_function(Lowerer* parent, ASTNode* loop, LoopAnalysis* la) {
+    char name[256];
+    snprintf(name, sizeof(name), "%s.<for@%d>", parent->func->name, loop->line);
+    IRFunction* func = ir_function_create(parent->module, name, loop);
+    if (!func) return NULL;
+
+    Lowerer L = {0};
+    L.module = parent->module;
+    L.ast_module = parent->ast_module;
+    L.func = func;
+    bool ok = lower_chunk_body(&L, loop, la);
+    free(L.defs);
+    return ok ? func : NULL;
+}
+
+// Fold entry 'index' of the combined chunk results into its accumulator.
+static void fold_reduction(Lowerer* L, IRValue results, int index,
+                           LoopReduction* red, int line) {
+    IRInstr* k = emit(L, IR_CONST_INT, 0, line);
+    if (!k) return;
+    k->int_value = index;
+    IRValue idx = emit_def(L, k);
+    IRInstr* get = emit(L, IR_GET_ITEM, 2, line);
+    if (!get) return;
+    get->args[0] = results;
+    get->args[1] = idx;
+    IRValue partial = emit_def(L, get);
+    emit_retain(L, partial, line);
+
+    if (red->kind == REDUCE_APPEND) {
+        // acc.extend(partial)
+        IRValue acc = lower_name(L, red->name, 0, line);
+        IRInstr* m = emit(L, IR_GET_ATTR, 1, line);
+        if (!m) return;
+        m->args[0] = acc;
+        m->name = ir_strdup(L->module, "extend");
+        IRValue method = emit_def(L, m);
+        emit_retain(L, method, line);
+        release_value(L, acc, line);
+        release_value(L, emit_call(L, method, NULL, &partial, 1, line), line);
+    } else {
+        int slot = ir_slot_find(L->func, red->name);
+        IRValue old = emit_load_slot(L, slot, 0, line);
+        TokenType op = red->kind == REDUCE_PRODUCT ? TOKEN_STAR : TOKEN_PLUS;
+        emit_store_slot(L, slot, emit_binary(L, op, old, partial, line), line);
+    }
+}
+
+static void lower_parallel_for(Lowerer* L, ASTNode* node) {
+    int line = node->line;
+    LoopAnalysis la;
+    if (!parallel_analyze_loop(L->ast_module, L->func->node, node, &la)) {
+        L->failed = true;
+        return;
+    }
+    if (!la.independent) {
+        // Annotated by a different analysis run; trust this one
+        parallel_loop_free(&la);
+        lower_for_over(L, node, lower_expr(L, node->as.for_stmt.iterable));
+        return;
+    }
+
+    IRFunction* chunk = lower_chunk_function(L, node, &la);
+    if (!chunk) {
+        L->failed = true;
+        parallel_loop_free(&la);
+        return;
+    }
+    IRValue seq = lower_expr(L, node->as.for_stmt.iterable);
+    IRInstr* c = emit(L, IR_MAKE_CLOSURE, 0, line);
+    if (c) c->int_value = chunk->index;
+    IRValue closure = emit_def(L, c);
+    IRInstr* pf = emit(L, IR_PARALLEL_FOR, 2, line);
+    if (pf) {
+        pf->args[0] = seq;
+        pf->args[1] = closure;
+    }
+    IRValue results = emit_def(L, pf);
+    release_value(L, seq, line);
+    release_value(L, closure, line);
+
+    for (int r = 0; r < la.reduction_count; r++) {
+        fold_reduction(L, results, r, &la.reductions[r], line);
+    }
+    release_value(L, results, line);
+    parallel_loop_free(&la);
+}
+
+// Slots read by the body of a parallel loop are read from its chunk
+// function, so they count as captured.
+static void mark_parallel_captures(Lowerer* L, ASTNode* node) {
+    if (!node) return;
+    switch (node->type) {
+        case AST_BLOCK:
+            for (int i = 0; i < node->as.block.count; i++) {
+                mark_parallel_captures(L, node->as.block.statements[i]);
+            }
+            break;
+        case AST_IF:
+            mark_parallel_captures(L, node->as.if_stmt.then_block);
+            mark_parallel_captures(L, node->as.if_stmt.else_block);
+            break;
+        case AST_WHILE:
+            mark_parallel_captures(L, node->as.while_stmt.body);
+            break;
+        case AST_WITH:
+            mark_parallel_captures(L, node->as.with_stmt.body);
+            break;
+        case AST_FOR:
+            if (node->flags & AST_FLAG_PARALLEL_LOOP) {
+                mark_captures(L, node->as.for_stmt.body, node);
+            } else {
+                mark_parallel_captures(L, node->as.for_stmt.body);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void lower_nested_class(Lowerer* L, ASTNode* node) {
+    ASTNode* body = node->as.class_def.body;
+    for (int s = 0; body && s < body->as.block.count; s++) {
+        ASTNode* member = body->as.block.statements[s];
+        if (member->type != AST_FUNCTION_DEF) continue;
+        char name[256];
+        snprintf(name, sizeof(name), "%s.%s.%s", L->func->name,
+                 node->as.class_def.name, member->as.function_def.name);
+        if (!lower_function(L->module, L->ast_module, member, name)) L->failed = true;
+    }
+}
+
+static void lower_stmt(Lowerer* L, ASTNode* node) {
+    if (L->failed || !node) return;
+    int line = node->line;
+
+    switch (node->type) {
+        case AST_EXPRESSION_STMT:
+            release_value(L, lower_expr(L, node->as.expression_stmt.expression), line);
+            break;
+        case AST_ASSIGNMENT: {
+            IRValue v = lower_expr(L, node->as.assignment.value);
+            lower_assignment(L, node->as.assignment.target, v, line);
+            break;
+        }
+        case AST_AUGMENTED_ASSIGNMENT:
+            lower_augmented(L, node);
+            break;
+        case AST_RETURN:
+            lower_return(L, node);
+            break;
+        case AST_PASS:
+            break;
+        case AST_BREAK:
+            if (L->loop) emit_jump(L, L->loop->break_target, line);
+            break;
+        case AST_CONTINUE:
+            if (L->loop) emit_jump(L, L->loop->continue_target, line);
+            break;
+        case AST_BLOCK:
+            lower_block(L, node);
+            break;
+        case AST_IF:
+            lower_if(L, node);
+            break;
+        case AST_WHILE:
+            lower_while(L, node);
+            break;
+        case AST_FOR:
+            lower_for(L, node);
+            break;
+        case AST_WITH: {
+            // The context object lives in a slot until the function exits.
+            IRValue ctx = lower_expr(L, node->as.with_stmt.context);
+            int slot;
+            if (node->as.with_stmt.var_name) {
+                slot = ir_slot_find(L->func, node->as.with_stmt.var_name);
+            } else {
+                char name[32];
+                snprintf(name, sizeof(name), "$with%d", L->temp_count++);
+                slot = ir_slot_add(L->module, L->func, name, false);
+                if (slot < 0) {
+                    L->failed = true;
+                    return;
+                }
+            }
+            emit_store_slot(L, slot, ctx, line);
+            lower_block(L, node->as.with_stmt.body);
+            break;
+        }
+        case AST_FUNCTION_DEF: {
+            char name[256];
+            snprintf(name, sizeof(name), "%s.%s", L->func->name,
+                     node->as.function_def.name);
+            IRValue closure = lower_closure(L, node, name);
+            emit_store_slot(L, ir_slot_find(L->func, node->as.function_def.name),
+                            closure, line);
+            break;
+        }
+        case AST_CLASS_DEF:
+            lower_nested_class(L, node);
+            break;
+        default:
+            // Bare expressions are wrapped in AST_EXPRESSION_STMT by the parser.
+            break;
+    }
+}
+
+// ============================================================
+// Functions and modules
+// ============================================================
+
+static bool lower_function_body(Lowerer* L, ASTNode* node) {
+    IRModule* module = L->module;
+    IRFunction* func = L->func;
+
+    // Parameters occupy the first slots, in order.
+    int n = node->type == AST_LAMBDA ? node->as.lambda.param_count
+                                     : node->as.function_def.param_count;
+    if (n > 0) {
+        func->params = (IRParam*)ir_alloc(module, sizeof(IRParam) * n);
+        if (!func->params) return false;
+    }
+    func->param_count = n;
+    for (int p = 0; p < n; p++) {
+        const char* pname = node->type == AST_LAMBDA
+                          ? node->as.lambda.param_names[p]
+                          : node->as.function_def.params[p].name;
+        func->params[p].name = ir_strdup(module, pname);
+        func->params[p].owned = node->type == AST_FUNCTION_DEF &&
+                                node->as.function_def.params[p].owned;
+        add_slot(L, pname);
+    }
+
+    ASTNode* body = node->type == AST_LAMBDA ? node->as.lambda.body
+                                             : node->as.function_def.body;
+    if (node->type == AST_FUNCTION_DEF) collect_slots(L, body);
+    mark_captures(L, body, NULL);
+    if (node->type == AST_FUNCTION_DEF) mark_parallel_captures(L, body);
+    if (L->failed) return false;
+
+    L->current = new_block(L, 0);
+    for (int s = 0; s < func->slot_count; s++) {
+        if (!func->slots[s].cell) continue;
+        IRInstr* i = emit(L, IR_MAKE_CELL, 0, node->line);
+        if (i) i->slot = s;
+    }
+    for (int p = 0; p < n; p++) {
+        IRInstr* i = emit(L, IR_PARAM, 0, node->line);
+        if (!i) return false;
+        i->int_value = p;
+        emit_store_slot(L, p, emit_def(L, i), node->line);
+    }
+
+    if (node->type == AST_LAMBDA) {
+        IRValue v = lower_expr(L, body);
+        emit_exit_cleanup(L, node->line);
+        IRInstr* ret = emit(L, IR_RETURN, 1, node->line);
+        if (ret) ret->args[0] = v;
+    } else {
+        lower_block(L, body);
+        if (L->current) {
+            // Falling off the end returns None.
+            IRValue none = emit_def(L, emit(L, IR_CONST_NONE, 0, node->line));
+            emit_exit_cleanup(L, node->line);
+            IRInstr* ret = emit(L, IR_RETURN, 1, node->line);
+            if (ret) ret->args[0] = none;
+        }
+    }
+    return !L->failed;
+}
+
+static IRFunction* lower_function(IRModule* module, ASTNode* ast_module,
+                                  ASTNode* node, const char* name) {
+    IRFunction* func = ir_function_create(module, name, node);
+    if (!func) return NULL;
+
+    Lowerer L = {0};
+    L.module = module;
+    L.ast_module = ast_module;
+    L.func = func;
+    bool ok = lower_function_body(&L, node);
+    free(L.defs);
+    return ok ? func : NULL;
+}
+
+IRModule* ir_lower_module(ASTNode* ast_module) {
+    if (!ast_module || ast_module->type != AST_MODULE) return NULL;
+    IRModule* module = ir_module_create();
+    if (!module) return NULL;
+
+    for (int s = 0; s < ast_module->as.module.count; s++) {
+        ASTNode* stmt = ast_module->as.module.statements[s];
+        if (stmt->type == AST_FUNCTION_DEF) {
+            if (!lower_function(module, ast_module, stmt, stmt->as.function_def.name)) {
+                ir_module_destroy(module);
+                return NULL;
+            }
+        } else if (stmt->type == AST_CLASS_DEF) {
+            ASTNode* body = stmt->as.class_def.body;
+            for (int m = 0; body && m < body->as.block.count; m++) {
+                ASTNode* member = body->as.block.statements[m];
+                if (member->type != AST_FUNCTION_DEF) continue;
+                char name[256];
+                snprintf(name, sizeof(name), "%s.%s", stmt->as.class_def.name,
+                         member->as.function_def.name);
+                if (!lower_function(module, ast_module, member, name)) {
+                    ir_module_destroy(module);
+                    return NULL;
+                }
+            }
+        }
+    }
+    return module;
+}
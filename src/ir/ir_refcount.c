@@ -0,0 +1,430 @@
+// ir_refcount.c - Reference-count elision
+//
+// Works on the naive refcounting emitted by ir_lower.c, in three steps:
+//
+//   1. Borrowed parameters. Every parameter not declared 'owned' is passed
+//      at +0. The callee stops dropping it on exit; if it reassigns, moves
+//      out of, or captures the parameter it takes its own reference at
+//      entry instead. Callers stop retaining arguments they load straight
+//      from a local (the slot keeps the value alive across the call) and
+//      release other temporaries after the call instead of handing them
+//      over. 'owned' parameters keep the +1 convention for direct calls,
+//      which is what makes 'f(move x)' free. Calls through values always
+//      use the borrowed convention.
+//   2. Moves. 'move x' takes the slot's reference rather than retaining a
+//      copy, and a slot that is definitely empty on exit is not dropped.
+//   3. Pairs. A RETAIN followed in the same block by a RELEASE of the same
+//      value is removed when nothing in between can drop the last other
+//      reference to it.
+//
+// The pass assumes operators, truth tests and iteration on builtin values
+// do not run user code; calls and stores are the only things that can
+// release arbitrary objects.
+
+#include "ir.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    IRModule* module;
+    IRFunction* func;
+    IRInstr** defs;     // Value id -> defining instruction
+    int* uses;          // Value id -> number of operand uses
+} RCContext;
+
+static bool rc_context_init(RCContext* ctx, IRModule* module, IRFunction* func) {
+    ctx->module = module;
+    ctx->func = func;
+    int nv = func->value_count > 0 ? func->value_count : 1;
+    ctx->defs = (IRInstr**)calloc(nv, sizeof(IRInstr*));
+    ctx->uses = (int*)calloc(nv, sizeof(int));
+    if (!ctx->defs || !ctx->uses) return false;
+
+    for (IRBlock* b = func->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->dest != IR_NO_VALUE) ctx->defs[i->dest] = i;
+            for (int a = 0; a < i->arg_count; a++) {
+                if (i->args[a] != IR_NO_VALUE) ctx->uses[i->args[a]]++;
+            }
+        }
+    }
+    return true;
+}
+
+static void rc_context_free(RCContext* ctx) {
+    free(ctx->defs);
+    free(ctx->uses);
+}
+
+static IRInstr* new_refcount_op(RCContext* ctx, IROpcode op, IRValue v, int line) {
+    IRInstr* i = ir_instr_new(ctx->module, op, 1);
+    if (!i) return NULL;
+    i->args[0] = v;
+    i->line = line;
+    ctx->uses[v]++;
+    return i;
+}
+
+static void remove_refcount_op(RCContext* ctx, IRInstr* i) {
+    ctx->uses[i->args[0]]--;
+    ir_instr_remove(i);
+}
+
+static bool is_refcounted(IRInstr* def) {
+    if (!def) return false;
+    switch (def->op) {
+        case IR_CONST_INT:
+        case IR_CONST_FLOAT:
+        case IR_CONST_STRING:
+        case IR_CONST_BOOL:
+        case IR_CONST_NONE:
+        case IR_TRUTH:
+        case IR_ITER_HAS_NEXT:
+            return false;
+        case IR_LOAD_GLOBAL:
+            return !(def->flags & IR_FLAG_STATIC);
+        default:
+            return true;
+    }
+}
+
+// A value loaded from an uncaptured slot is kept alive by the slot until
+// the slot is written; returns that slot, or -1. A capture read straight
+// from the running closure is held by the closure for the whole call,
+// which is returned as a slot number nothing writes.
+static int keeper_slot(RCContext* ctx, IRValue v) {
+    IRInstr* def = ctx->defs[v];
+    if (def && def->op == IR_LOAD_CAPTURE && !(def->flags & IR_FLAG_DEREF)) {
+        return ctx->func->slot_count;
+    }
+    if (!def || def->op != IR_LOAD_LOCAL) return -1;
+    if (ctx->func->slots[def->slot].captured) return -1;
+    return def->slot;
+}
+
+// Does argument 'index' (1-based, args[0] is the callee) of a call take
+// ownership of its value?
+static bool call_consumes(RCContext* ctx, IRInstr* call, int index) {
+    if (!call->name) return false;
+    IRFunction* callee = ir_function_find(ctx->module, call->name);
+    if (!callee || call->arg_count - 1 != callee->param_count) return false;
+    return callee->params[index - 1].owned;
+}
+
+// ============================================================
+// Step 1: borrowed parameters
+// ============================================================
+
+static bool slot_written_after_entry(RCContext* ctx, int slot) {
+    for (IRBlock* b = ctx->func->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->slot != slot) continue;
+            if (i->op == IR_STORE_LOCAL) {
+                IRInstr* def = ctx->defs[i->args[0]];
+                if (!def || def->op != IR_PARAM) return true;
+            } else if (i->op == IR_MOVE_LOCAL ||
+                       (i->op == IR_LOAD_LOCAL && (i->flags & IR_FLAG_MOVE_HINT))) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void borrow_params(RCContext* ctx) {
+    IRFunction* func = ctx->func;
+    for (int p = 0; p < func->param_count; p++) {
+        if (!func->params[p].borrowed) continue;
+        if (!func->slots[p].captured && !slot_written_after_entry(ctx, p)) {
+            // The caller's reference outlives the call: never drop it.
+            for (IRBlock* b = func->entry; b; b = b->next) {
+                IRInstr* i = b->first;
+                while (i) {
+                    IRInstr* next = i->next;
+                    if (i->op == IR_DROP_LOCAL && i->slot == p) ir_instr_remove(i);
+                    i = next;
+                }
+            }
+            continue;
+        }
+        // The slot needs a reference of its own.
+        for (IRInstr* i = func->entry->first; i; i = i->next) {
+            if (i->op == IR_PARAM && i->int_value == p) {
+                IRInstr* r = new_refcount_op(ctx, IR_RETAIN, i->dest, i->line);
+                if (r) ir_instr_insert_after(i, r);
+                break;
+            }
+        }
+    }
+}
+
+// Callers: arguments to borrowed parameters are no longer handed over.
+static void borrow_arguments(RCContext* ctx) {
+    for (IRBlock* b = ctx->func->entry; b; b = b->next) {
+        for (IRInstr* call = b->first; call; call = call->next) {
+            if (call->op != IR_CALL) continue;
+            for (int a = 1; a < call->arg_count; a++) {
+                IRValue v = call->args[a];
+                if (v == IR_NO_VALUE || !is_refcounted(ctx->defs[v])) continue;
+                if (call_consumes(ctx, call, a)) continue;
+
+                // Loaded from a slot just for this call: the retain only
+                // existed to produce the +1, and the slot cannot change
+                // while the arguments are evaluated.
+                IRInstr* def = ctx->defs[v];
+                IRInstr* retain = def->next;
+                if (keeper_slot(ctx, v) >= 0 && def->block == b &&
+                    retain && retain->op == IR_RETAIN && retain->args[0] == v &&
+                    ctx->uses[v] == 2) {
+                    remove_refcount_op(ctx, retain);
+                    continue;
+                }
+                IRInstr* rel = new_refcount_op(ctx, IR_RELEASE, v, call->line);
+                if (rel) ir_instr_insert_after(call, rel);
+            }
+        }
+    }
+}
+
+// ============================================================
+// Step 2: moves
+// ============================================================
+
+static void apply_moves(RCContext* ctx) {
+    for (IRBlock* b = ctx->func->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->op != IR_LOAD_LOCAL || !(i->flags & IR_FLAG_MOVE_HINT)) continue;
+            if (ctx->func->slots[i->slot].captured) continue;  // A closure may still read it
+            i->op = IR_MOVE_LOCAL;
+            i->flags &= ~IR_FLAG_MOVE_HINT;
+            IRInstr* retain = i->next;
+            if (retain && retain->op == IR_RETAIN && retain->args[0] == i->dest) {
+                remove_refcount_op(ctx, retain);
+            }
+        }
+    }
+}
+
+static void move_transfer(IRBlock* b, bool* state) {
+    for (IRInstr* i = b->first; i; i = i->next) {
+        if (i->op == IR_MOVE_LOCAL) state[i->slot] = true;
+        if (i->op == IR_STORE_LOCAL) state[i->slot] = false;
+    }
+}
+
+static int block_successors(IRBlock* b, IRBlock** out) {
+    IRInstr* t = b->last;
+    if (!t) return 0;
+    if (t->op == IR_JUMP) {
+        out[0] = t->targets[0];
+        return 1;
+    }
+    if (t->op == IR_BRANCH) {
+        out[0] = t->targets[0];
+        out[1] = t->targets[1];
+        return 2;
+    }
+    return 0;
+}
+
+// Forward must-analysis: a slot is "moved" at a point if every path from
+// the entry moves out of it without storing it again. Dropping such a
+// slot would only release an empty value.
+static void drop_moved_slots(RCContext* ctx) {
+    IRFunction* func = ctx->func;
+    int nb = func->block_count, ns = func->slot_count;
+    if (ns == 0) return;
+    bool* in = (bool*)malloc(sizeof(bool) * nb * ns);
+    bool* out = (bool*)malloc(sizeof(bool) * nb * ns);
+    bool* seen = (bool*)calloc(nb, sizeof(bool));
+    bool* state = (bool*)malloc(sizeof(bool) * ns);
+    if (!in || !out || !seen || !state) {
+        free(in); free(out); free(seen); free(state);
+        return;
+    }
+    for (int k = 0; k < nb * ns; k++) {
+        in[k] = true;
+        out[k] = true;
+    }
+    memset(in + func->entry->id * ns, 0, sizeof(bool) * ns);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (IRBlock* b = func->entry; b; b = b->next) {
+            bool* bin = in + b->id * ns;
+            bool* bout = out + b->id * ns;
+            memcpy(state, bin, sizeof(bool) * ns);
+            move_transfer(b, state);
+            if (!seen[b->id] || memcmp(state, bout, sizeof(bool) * ns) != 0) {
+                memcpy(bout, state, sizeof(bool) * ns);
+                seen[b->id] = true;
+                IRBlock* succ[2];
+                int n = block_successors(b, succ);
+                for (int s = 0; s < n; s++) {
+                    bool* sin = in + succ[s]->id * ns;
+                    for (int k = 0; k < ns; k++) sin[k] = sin[k] && bout[k];
+                }
+                changed = true;
+            }
+        }
+    }
+
+    for (IRBlock* b = func->entry; b; b = b->next) {
+        memcpy(state, in + b->id * ns, sizeof(bool) * ns);
+        IRInstr* i = b->first;
+        while (i) {
+            IRInstr* next = i->next;
+            if (i->op == IR_MOVE_LOCAL) state[i->slot] = true;
+            if (i->op == IR_STORE_LOCAL) state[i->slot] = false;
+            if (i->op == IR_DROP_LOCAL && state[i->slot]) ir_instr_remove(i);
+            i = next;
+        }
+    }
+    free(in);
+    free(out);
+    free(seen);
+    free(state);
+}
+
+// ============================================================
+// Step 3: retain/release pairs
+// ============================================================
+
+// Does 'i' take over the reference held in 'v'?
+static bool consumes(RCContext* ctx, IRInstr* i, IRValue v) {
+    switch (i->op) {
+        case IR_STORE_LOCAL:
+        case IR_RETURN:
+            return i->args[0] == v;
+        case IR_SET_ATTR:
+            return i->args[1] == v;
+        case IR_SET_ITEM:
+            return i->args[2] == v;
+        case IR_BUILD_LIST:
+        case IR_BUILD_DICT:
+        case IR_MAKE_CLOSURE:
+            for (int a = 0; a < i->arg_count; a++) {
+                if (i->args[a] == v) return true;
+            }
+            return false;
+        case IR_CALL:
+            for (int a = 1; a < i->arg_count; a++) {
+                if (i->args[a] == v && call_consumes(ctx, i, a)) return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+// Is 'v' still held by the slot it was loaded from at instruction 'at'?
+// Releasing such a value cannot free it.
+static bool slot_still_holds(RCContext* ctx, IRValue v, IRInstr* at) {
+    int slot = keeper_slot(ctx, v);
+    if (slot < 0) return false;
+    IRInstr* def = ctx->defs[v];
+    for (IRInstr* i = at->prev; i; i = i->prev) {
+        if (i == def) return true;
+        if ((i->op == IR_STORE_LOCAL || i->op == IR_MOVE_LOCAL ||
+             i->op == IR_DROP_LOCAL) && i->slot == slot) return false;
+    }
+    return false;  // Defined in another block
+}
+
+// Could 'i' release the last reference to 'v' other than the one the
+// pending RETAIN protects?
+static bool may_release(RCContext* ctx, IRInstr* i, IRValue v, int keeper) {
+    if (keeper >= 0) {
+        return (i->op == IR_STORE_LOCAL || i->op == IR_MOVE_LOCAL ||
+                i->op == IR_DROP_LOCAL) && i->slot == keeper;
+    }
+    switch (i->op) {
+        case IR_CALL:
+        case IR_PARALLEL_FOR:
+        case IR_SET_ATTR:
+        case IR_SET_ITEM:
+        case IR_VEC_STORE:
+        case IR_STORE_LOCAL:
+        case IR_DROP_LOCAL:
+            return true;
+        case IR_RELEASE:
+            return i->args[0] != v && !slot_still_holds(ctx, i->args[0], i);
+        default:
+            return false;
+    }
+}
+
+static void elide_pairs(RCContext* ctx) {
+    for (IRBlock* b = ctx->func->entry; b; b = b->next) {
+        IRInstr* i = b->first;
+        while (i) {
+            IRInstr* next = i->next;
+            if (i->op == IR_RETAIN) {
+                IRValue v = i->args[0];
+                int keeper = keeper_slot(ctx, v);
+                for (IRInstr* j = i->next; j; j = j->next) {
+                    if (j->op == IR_RELEASE && j->args[0] == v) {
+                        if (next == j) next = j->next;
+                        remove_refcount_op(ctx, j);
+                        remove_refcount_op(ctx, i);
+                        break;
+                    }
+                    if (consumes(ctx, j, v) || may_release(ctx, j, v, keeper)) break;
+                }
+            }
+            i = next;
+        }
+    }
+}
+
+// ============================================================
+// Driver and statistics
+// ============================================================
+
+void ir_elide_refcounts(IRModule* module) {
+    if (!module) return;
+    // Conventions first: callers need every callee's decision.
+    for (IRFunction* f = module->functions; f; f = f->next) {
+        for (int p = 0; p < f->param_count; p++) {
+            f->params[p].borrowed = !f->params[p].owned;
+        }
+    }
+    for (IRFunction* f = module->functions; f; f = f->next) {
+        RCContext ctx;
+        if (!rc_context_init(&ctx, module, f)) {
+            rc_context_free(&ctx);
+            continue;
+        }
+        borrow_params(&ctx);
+        apply_moves(&ctx);       // Before borrow_arguments: moved values are owned
+        borrow_arguments(&ctx);
+        drop_moved_slots(&ctx);
+        elide_pairs(&ctx);
+        rc_context_free(&ctx);
+    }
+}
+
+void ir_count_refcounts(IRFunction* func, IRRefcountStats* stats) {
+    for (IRBlock* b = func->entry; b; b = b->next) {
+        long weight = 1;
+        for (int d = 0; d < b->loop_depth; d++) weight *= IR_LOOP_TRIP_ESTIMATE;
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->op == IR_RETAIN) {
+                stats->retains++;
+            } else if (i->op == IR_RELEASE || i->op == IR_DROP_LOCAL) {
+                stats->releases++;
+            } else {
+                continue;
+            }
+            stats->weighted += weight;
+        }
+    }
+}
+
+void ir_count_module_refcounts(IRModule* module, IRRefcountStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (IRFunction* f = module->functions; f; f = f->next) {
+        ir_count_refcounts(f, stats);
+    }
+}
@@ -0,0 +1,600 @@
+// ir_specialize.c - Monomorphization and unboxing
+//
+// Parameters without annotations are boxed Values, so a function like
+//
+//     def sum_to(n):
+//         total = 0
+//         ...
+//
+// runs every operation through tag checks even when every caller passes
+// an int. This pass infers a representation (IRRepr) for every value and
+// local slot and clones a function once per distinct tuple of argument
+// representations seen at its direct call sites: sum_to(1000) calls a
+// clone 'sum_to<int>' whose parameter, locals and arithmetic are raw
+// int64_t and whose result comes back unboxed.
+//
+// Inference is flow-insensitive over slots, like the checker's locals:
+// a slot's representation is the join of everything stored to it (int
+// and float join to float, anything else mixed to boxed), and captured
+// slots stay boxed for the closures that share them. Values start unset
+// and only move up the lattice, so the module-wide fixed point - which
+// also settles the return representation of recursive clones - is
+// reached in a few rounds. A clone is made only when some argument is
+// unboxed, and at most IR_MAX_SPECIALIZATIONS per function; calls beyond
+// the cap use the generic version.
+//
+// Generic functions keep the boxed calling convention but still get raw
+// locals where their own code allows (a loop counter, say). Where a raw
+// value meets a boxed use, IR_BOX is inserted (followed by a RELEASE if
+// the use only borrows), int operands of float operations get IR_WIDEN,
+// and refcount operations on raw values are deleted. The calling
+// conventions of ir_elide_refcounts are assumed, so this runs after it.
+
+#include "ir.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPR_UNSET (-1)     // Nothing known yet: the bottom of the lattice
+#define NEED_ANY   (-1)     // An operand used in whatever form it has
+
+typedef struct {
+    IRFunction* func;
+    int* values;                // Value id -> repr, or REPR_UNSET
+    int* slots;                 // Slot -> repr, or REPR_UNSET
+    IRFunction** targets;       // Value id of a CALL -> specialization it calls
+    int ret;                    // Return repr (boxed for generic functions)
+    int clone_count;            // Generic functions: specializations made
+    bool live;                  // Reachable from a generic function
+} Spec;
+
+typedef struct {
+    IRModule* module;
+    Spec* specs;                // By IRFunction.index
+    int spec_count;
+    int spec_capacity;
+    bool changed;
+    bool failed;
+} Specializer;
+
+static int join(int a, int b) {
+    if (a == REPR_UNSET) return b;
+    if (b == REPR_UNSET || a == b) return a;
+    if ((a == IR_REPR_INT && b == IR_REPR_FLOAT) || (a == IR_REPR_FLOAT && b == IR_REPR_INT)) {
+        return IR_REPR_FLOAT;
+    }
+    return IR_REPR_BOXED;
+}
+
+static bool is_numeric(int r) {
+    return r == IR_REPR_INT || r == IR_REPR_FLOAT;
+}
+
+static bool is_comparison(TokenType op) {
+    switch (op) {
+        case TOKEN_LESS:
+        case TOKEN_GREATER:
+        case TOKEN_LESS_EQUALS:
+        case TOKEN_GREATER_EQUALS:
+        case TOKEN_EQUALS_EQUALS:
+        case TOKEN_NOT_EQUALS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// ============================================================
+// Functions and their clones
+// ============================================================
+
+static Spec* add_spec(Specializer* S, IRFunction* func) {
+    if (func->index >= S->spec_capacity) {
+        int capacity = S->spec_capacity ? S->spec_capacity * 2 : 16;
+        while (capacity <= func->index) capacity *= 2;
+        Spec* specs = (Spec*)realloc(S->specs, sizeof(Spec) * capacity);
+        if (!specs) return NULL;
+        memset(specs + S->spec_capacity, 0, sizeof(Spec) * (capacity - S->spec_capacity));
+        S->specs = specs;
+        S->spec_capacity = capacity;
+    }
+    if (func->index >= S->spec_count) S->spec_count = func->index + 1;
+
+    Spec* s = &S->specs[func->index];
+    s->func = func;
+    int nv = func->value_count > 0 ? func->value_count : 1;
+    int ns = func->slot_count > 0 ? func->slot_count : 1;
+    s->values = (int*)malloc(sizeof(int) * nv);
+    s->slots = (int*)malloc(sizeof(int) * ns);
+    s->targets = (IRFunction**)calloc(nv, sizeof(IRFunction*));
+    if (!s->values || !s->slots || !s->targets) return NULL;
+    for (int v = 0; v < nv; v++) s->values[v] = REPR_UNSET;
+    for (int i = 0; i < ns; i++) s->slots[i] = REPR_UNSET;
+    s->ret = func->generic ? REPR_UNSET : IR_REPR_BOXED;
+    return s;
+}
+
+// A copy of generic 'g' taking its parameters as 'reprs'. The body is
+// identical, value ids included; representations are assigned later.
+static IRFunction* clone_function(Specializer* S, IRFunction* g, const IRRepr* reprs) {
+    IRModule* m = S->module;
+    char name[256];
+    int len = snprintf(name, sizeof(name), "%s<", g->name);
+    for (int p = 0; p < g->param_count && len < (int)sizeof(name); p++) {
+        len += snprintf(name + len, sizeof(name) - len, "%s%s", p ? "," : "",
+                        ir_repr_to_string(reprs[p]));
+    }
+    if (len < (int)sizeof(name) - 1) snprintf(name + len, sizeof(name) - len, ">");
+
+    IRFunction* f = ir_function_create(m, name, g->node);
+    if (!f) return NULL;
+    f->generic = g;
+    f->param_count = g->param_count;
+    f->value_count = g->value_count;
+    f->reductions = g->reductions;
+    f->reduction_count = g->reduction_count;
+    if (g->param_count > 0) {
+        f->params = (IRParam*)ir_alloc(m, sizeof(IRParam) * g->param_count);
+        f->param_reprs = (IRRepr*)ir_alloc(m, sizeof(IRRepr) * g->param_count);
+        if (!f->params || !f->param_reprs) return NULL;
+        memcpy(f->params, g->params, sizeof(IRParam) * g->param_count);
+        memcpy(f->param_reprs, reprs, sizeof(IRRepr) * g->param_count);
+    }
+    if (g->slot_count > 0) {
+        f->slots = (IRSlot*)ir_alloc(m, sizeof(IRSlot) * g->slot_count);
+        if (!f->slots) return NULL;
+        memcpy(f->slots, g->slots, sizeof(IRSlot) * g->slot_count);
+        f->slot_count = f->slot_capacity = g->slot_count;
+    }
+
+    IRBlock** blocks = (IRBlock**)calloc(g->block_count > 0 ? g->block_count : 1, sizeof(IRBlock*));
+    if (!blocks) return NULL;
+    for (IRBlock* b = g->entry; b; b = b->next) {
+        blocks[b->id] = ir_block_create(m, f, b->loop_depth);
+        if (!blocks[b->id]) {
+            free(blocks);
+            return NULL;
+        }
+    }
+    for (IRBlock* b = g->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            IRInstr* c = ir_instr_new(m, i->op, i->arg_count);
+            if (!c) {
+                free(blocks);
+                return NULL;
+            }
+            if (i->arg_count > 0) memcpy(c->args, i->args, sizeof(IRValue) * i->arg_count);
+            c->dest = i->dest;
+            c->slot = i->slot;
+            c->name = i->name;
+            c->int_value = i->int_value;
+            c->float_value = i->float_value;
+            c->token = i->token;
+            c->flags = i->flags;
+            c->line = i->line;
+            for (int t = 0; t < 2; t++) c->targets[t] = i->targets[t] ? blocks[i->targets[t]->id] : NULL;
+            ir_instr_append(blocks[b->id], c);
+        }
+    }
+    free(blocks);
+    return f;
+}
+
+// The module function a direct call can be specialized against, or NULL
+static IRFunction* specializable_callee(Specializer* S, IRInstr* call) {
+    if (!call->name) return NULL;
+    IRFunction* callee = ir_function_find(S->module, call->name);
+    if (!callee || callee->generic || !callee->node ||
+        callee->node->type != AST_FUNCTION_DEF || strchr(callee->name, '.') ||
+        callee->param_count != call->arg_count - 1) {
+        return NULL;
+    }
+    return callee;
+}
+
+static IRFunction* find_clone(Specializer* S, IRFunction* g, const IRRepr* reprs) {
+    for (int k = 0; k < S->spec_count; k++) {
+        IRFunction* f = S->specs[k].func;
+        if (f && f->generic == g &&
+            memcmp(f->param_reprs, reprs, sizeof(IRRepr) * g->param_count) == 0) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+// ============================================================
+// Inference
+// ============================================================
+
+static int binary_repr(TokenType op, int a, int b) {
+    if (a == REPR_UNSET || b == REPR_UNSET) return REPR_UNSET;
+    bool numeric = is_numeric(a) && is_numeric(b);
+    switch (op) {
+        case TOKEN_PLUS:
+        case TOKEN_MINUS:
+        case TOKEN_STAR:
+        case TOKEN_PERCENT:
+            return numeric ? join(a, b) : IR_REPR_BOXED;
+        case TOKEN_SLASH:
+            return numeric ? IR_REPR_FLOAT : IR_REPR_BOXED;
+        case TOKEN_EQUALS_EQUALS:
+        case TOKEN_NOT_EQUALS:
+            if (a == IR_REPR_BOOL && b == IR_REPR_BOOL) return IR_REPR_BOOL;
+            return numeric ? IR_REPR_BOOL : IR_REPR_BOXED;
+        default:
+            if (is_comparison(op)) return numeric ? IR_REPR_BOOL : IR_REPR_BOXED;
+            return IR_REPR_BOXED;
+    }
+}
+
+static int unary_repr(TokenType op, int a) {
+    if (a == REPR_UNSET) return REPR_UNSET;
+    if (a == IR_REPR_BOXED) return IR_REPR_BOXED;
+    if (op == TOKEN_NOT) return IR_REPR_BOOL;
+    if (op == TOKEN_MINUS || op == TOKEN_PLUS) return is_numeric(a) ? a : IR_REPR_BOXED;
+    return IR_REPR_BOXED;
+}
+
+// Representation of a call's result; picks (and if needed makes) the
+// specialization it dispatches to.
+static int call_repr(Specializer* S, int index, IRInstr* call) {
+    IRFunction* callee = specializable_callee(S, call);
+    if (!callee) return IR_REPR_BOXED;
+
+    int n = callee->param_count;
+    IRRepr reprs[n > 0 ? n : 1];
+    bool unboxed = false;
+    for (int a = 0; a < n; a++) {
+        int r = S->specs[index].values[call->args[a + 1]];
+        if (r == REPR_UNSET) return REPR_UNSET;
+        reprs[a] = (IRRepr)r;
+        if (r != IR_REPR_BOXED) unboxed = true;
+    }
+    S->specs[index].targets[call->dest] = NULL;
+    if (!unboxed) return IR_REPR_BOXED;
+
+    IRFunction* clone = find_clone(S, callee, reprs);
+    if (!clone) {
+        Spec* g = &S->specs[callee->index];
+        if (g->clone_count >= IR_MAX_SPECIALIZATIONS) return IR_REPR_BOXED;
+        clone = clone_function(S, callee, reprs);
+        if (!clone || !add_spec(S, clone)) {
+            S->failed = true;
+            return IR_REPR_BOXED;
+        }
+        S->specs[callee->index].clone_count++;
+        S->changed = true;
+    }
+    S->specs[index].targets[call->dest] = clone;
+    return S->specs[clone->index].ret;
+}
+
+static int value_rule(Specializer* S, int index, IRInstr* i) {
+    Spec* s = &S->specs[index];
+    switch (i->op) {
+        case IR_CONST_INT: return IR_REPR_INT;
+        case IR_CONST_FLOAT: return IR_REPR_FLOAT;
+        case IR_CONST_BOOL: return IR_REPR_BOOL;
+        case IR_PARAM:
+            return s->func->param_reprs ? (int)s->func->param_reprs[i->int_value] : IR_REPR_BOXED;
+        case IR_LOAD_LOCAL:
+        case IR_MOVE_LOCAL:
+            return s->func->slots[i->slot].captured ? IR_REPR_BOXED : s->slots[i->slot];
+        case IR_BINARY:
+            return binary_repr(i->token, s->values[i->args[0]], s->values[i->args[1]]);
+        case IR_UNARY:
+            return unary_repr(i->token, s->values[i->args[0]]);
+        case IR_TRUTH:
+        case IR_ITER_HAS_NEXT:
+            return IR_REPR_BOOL;  // Raw flags already
+        case IR_CALL:
+            return call_repr(S, index, i);
+        default:
+            return IR_REPR_BOXED;
+    }
+}
+
+// One pass over a function's instructions
+static void infer_function(Specializer* S, int index) {
+    IRFunction* f = S->specs[index].func;
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->dest != IR_NO_VALUE) {
+                int r = value_rule(S, index, i);
+                Spec* s = &S->specs[index];  // value_rule may grow the array
+                int joined = join(s->values[i->dest], r);
+                if (joined != s->values[i->dest]) {
+                    s->values[i->dest] = joined;
+                    S->changed = true;
+                }
+            }
+            Spec* s = &S->specs[index];
+            if (i->op == IR_STORE_LOCAL) {
+                int r = f->slots[i->slot].captured ? IR_REPR_BOXED : s->values[i->args[0]];
+                int joined = join(s->slots[i->slot], r);
+                if (joined != s->slots[i->slot]) {
+                    s->slots[i->slot] = joined;
+                    S->changed = true;
+                }
+            } else if (i->op == IR_RETURN && f->generic) {
+                int joined = join(s->ret, s->values[i->args[0]]);
+                if (joined != s->ret) {
+                    s->ret = joined;
+                    S->changed = true;
+                }
+            }
+        }
+    }
+}
+
+static void infer_module(Specializer* S) {
+    do {
+        S->changed = false;
+        for (int k = 0; k < S->spec_count && !S->failed; k++) {
+            if (S->specs[k].func) infer_function(S, k);
+        }
+    } while (S->changed && !S->failed);
+}
+
+// Clones that are only called from clones nobody calls (left behind when
+// a call site's argument representations widened) are dropped.
+static void mark_live(Specializer* S, int index) {
+    Spec* s = &S->specs[index];
+    if (s->live) return;
+    s->live = true;
+    int nv = s->func->value_count;
+    for (int v = 0; v < nv; v++) {
+        if (s->targets[v]) mark_live(S, s->targets[v]->index);
+    }
+}
+
+static void drop_dead_clones(Specializer* S) {
+    for (int k = 0; k < S->spec_count; k++) {
+        if (S->specs[k].func && !S->specs[k].func->generic) mark_live(S, k);
+    }
+    IRModule* m = S->module;
+    IRFunction* prev = NULL;
+    for (IRFunction* f = m->functions; f; f = f->next) {
+        if (S->specs[f->index].live) {
+            prev = f;
+            continue;
+        }
+        if (prev) {
+            prev->next = f->next;
+        } else {
+            m->functions = f->next;
+        }
+        if (m->last_function == f) m->last_function = prev;
+        S->specs[f->index].func = NULL;
+    }
+}
+
+// ============================================================
+// Rewriting
+// ============================================================
+
+typedef struct {
+    IRInstr** defs;
+    int capacity;
+} DefMap;
+
+static void def_set(DefMap* d, IRValue v, IRInstr* i) {
+    if (v >= d->capacity) {
+        int capacity = d->capacity ? d->capacity * 2 : 64;
+        while (capacity <= v) capacity *= 2;
+        IRInstr** defs = (IRInstr**)realloc(d->defs, sizeof(IRInstr*) * capacity);
+        if (!defs) return;
+        memset(defs + d->capacity, 0, sizeof(IRInstr*) * (capacity - d->capacity));
+        d->defs = defs;
+        d->capacity = capacity;
+    }
+    d->defs[v] = i;
+}
+
+static IRRepr repr_of(DefMap* d, IRValue v) {
+    return v >= 0 && v < d->capacity && d->defs[v] ? d->defs[v]->repr : IR_REPR_BOXED;
+}
+
+// The representation operand 'a' of 'i' must have, or NEED_ANY
+static int operand_need(Specializer* S, IRFunction* f, DefMap* d, IRInstr* i, int a) {
+    Spec* s = &S->specs[f->index];
+    switch (i->op) {
+        case IR_STORE_LOCAL:
+            return s->slots[i->slot];
+        case IR_RETURN:
+            return f->return_repr;
+        case IR_BINARY:
+            if (i->repr == IR_REPR_BOXED) return IR_REPR_BOXED;
+            if (i->repr == IR_REPR_BOOL) {
+                return join(repr_of(d, i->args[0]), repr_of(d, i->args[1]));
+            }
+            return i->repr;
+        case IR_UNARY:
+            return i->repr == IR_REPR_BOXED ? IR_REPR_BOXED : NEED_ANY;
+        case IR_CALL: {
+            if (a == 0) return NEED_ANY;
+            IRFunction* target = s->targets[i->dest];
+            return target ? (int)target->param_reprs[a - 1] : IR_REPR_BOXED;
+        }
+        case IR_TRUTH:
+        case IR_BRANCH:
+        case IR_RETAIN:
+        case IR_RELEASE:
+        case IR_BOX:
+        case IR_WIDEN:
+            return NEED_ANY;
+        default:
+            return IR_REPR_BOXED;
+    }
+}
+
+// Does 'i' take over the reference its operand 'a' holds?
+static bool use_consumes(Specializer* S, IRInstr* i, int a) {
+    switch (i->op) {
+        case IR_STORE_LOCAL:
+        case IR_RETURN:
+        case IR_BUILD_LIST:
+        case IR_BUILD_DICT:
+        case IR_MAKE_CLOSURE:
+            return true;
+        case IR_SET_ATTR:
+            return a == 1;
+        case IR_SET_ITEM:
+            return a == 2;
+        case IR_CALL: {
+            if (a == 0 || !i->name) return false;
+            IRFunction* callee = ir_function_find(S->module, i->name);
+            return callee && callee->param_count == i->arg_count - 1 && callee->params[a - 1].owned;
+        }
+        default:
+            return false;
+    }
+}
+
+static bool convert_operands(Specializer* S, IRFunction* f, DefMap* d, IRInstr* i,
+                             IRSpecializeStats* stats) {
+    for (int a = 0; a < i->arg_count; a++) {
+        IRValue v = i->args[a];
+        if (v == IR_NO_VALUE) continue;
+        int need = operand_need(S, f, d, i, a);
+        IRRepr have = repr_of(d, v);
+        if (need == NEED_ANY || need == REPR_UNSET || need == (int)have) continue;
+
+        IRInstr* c;
+        if (need == IR_REPR_FLOAT && have == IR_REPR_INT) {
+            c = ir_instr_new(S->module, IR_WIDEN, 1);
+            if (!c) return false;
+            c->repr = IR_REPR_FLOAT;
+        } else {
+            c = ir_instr_new(S->module, IR_BOX, 1);
+            if (!c) return false;
+            c->int_value = have;
+            c->repr = IR_REPR_BOXED;
+        }
+        c->args[0] = v;
+        c->line = i->line;
+        ir_define(f, c);
+        def_set(d, c->dest, c);
+        ir_instr_insert_before(i, c);
+        i->args[a] = c->dest;
+        stats->conversions++;
+
+        if (c->op == IR_BOX && !use_consumes(S, i, a)) {
+            IRInstr* rel = ir_instr_new(S->module, IR_RELEASE, 1);
+            if (!rel) return false;
+            rel->args[0] = c->dest;
+            rel->line = i->line;
+            ir_instr_insert_after(i, rel);
+        }
+    }
+    return true;
+}
+
+static bool rewrite_function(Specializer* S, IRFunction* f, IRSpecializeStats* stats) {
+    Spec* s = &S->specs[f->index];
+    if (f->generic) f->return_repr = (IRRepr)(s->ret == REPR_UNSET ? IR_REPR_BOXED : s->ret);
+    for (int k = 0; k < f->slot_count; k++) {
+        if (s->slots[k] == REPR_UNSET) s->slots[k] = IR_REPR_BOXED;
+    }
+
+    DefMap d = { NULL, 0 };
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->dest == IR_NO_VALUE) continue;
+            int r = s->values[i->dest];
+            i->repr = (IRRepr)(r == REPR_UNSET ? IR_REPR_BOXED : r);
+            if (i->repr != IR_REPR_BOXED && i->op != IR_TRUTH && i->op != IR_ITER_HAS_NEXT) {
+                stats->unboxed_values++;
+            }
+            def_set(&d, i->dest, i);
+            if (i->op != IR_CALL) continue;
+            if (s->targets[i->dest]) {
+                i->name = s->targets[i->dest]->name;
+                stats->static_calls++;
+            } else if (specializable_callee(S, i)) {
+                for (int a = 1; a < i->arg_count; a++) {
+                    if (s->values[i->args[a]] != IR_REPR_BOXED) {
+                        stats->capped++;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    bool ok = true;
+    for (IRBlock* b = f->entry; b && ok; b = b->next) {
+        IRInstr* i = b->first;
+        while (i) {
+            IRInstr* next = i->next;
+            bool raw_refcount = (i->op == IR_RETAIN || i->op == IR_RELEASE) &&
+                                repr_of(&d, i->args[0]) != IR_REPR_BOXED;
+            bool raw_drop = i->op == IR_DROP_LOCAL && s->slots[i->slot] != IR_REPR_BOXED;
+            if (raw_refcount || raw_drop) {
+                ir_instr_remove(i);
+            } else if (!convert_operands(S, f, &d, i, stats)) {
+                ok = false;
+                break;
+            }
+            i = next;
+        }
+    }
+    free(d.defs);
+    return ok;
+}
+
+int ir_count_instructions(IRModule* module) {
+    int n = 0;
+    for (IRFunction* f = module->functions; f; f = f->next) {
+        for (IRBlock* b = f->entry; b; b = b->next) {
+            for (IRInstr* i = b->first; i; i = i->next) n++;
+        }
+    }
+    return n;
+}
+
+void ir_specialize(IRModule* module, IRSpecializeStats* stats) {
+    IRSpecializeStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    stats->instrs_before = ir_count_instructions(module);
+
+    Specializer S;
+    memset(&S, 0, sizeof(S));
+    S.module = module;
+    for (IRFunction* f = module->functions; f && !S.failed; f = f->next) {
+        if (!add_spec(&S, f)) S.failed = true;
+    }
+
+    // Settle, then give up on return representations that never became
+    // known (functions that never return) and settle again.
+    infer_module(&S);
+    bool unset;
+    do {
+        unset = false;
+        for (int k = 0; k < S.spec_count; k++) {
+            if (S.specs[k].func && S.specs[k].ret == REPR_UNSET) {
+                S.specs[k].ret = IR_REPR_BOXED;
+                unset = true;
+            }
+        }
+        if (unset) infer_module(&S);
+    } while (unset && !S.failed);
+
+    if (!S.failed) {
+        drop_dead_clones(&S);
+        for (IRFunction* f = module->functions; f; f = f->next) {
+            if (f->generic) stats->specializations++;
+            if (!rewrite_function(&S, f, stats)) break;
+        }
+    }
+    stats->instrs_after = ir_count_instructions(module);
+
+    for (int k = 0; k < S.spec_capacity; k++) {
+        free(S.specs[k].values);
+        free(S.specs[k].slots);
+        free(S.specs[k].targets);
+    }
+    free(S.specs);
+}
@@ -0,0 +1,651 @@
+// ir_ssa.c - Dominators and SSA construction
+//
+// The lowering keeps source variables in local slots: every read is a
+// LOAD_LOCAL, so two reads of 'x' with no store between them are two
+// unrelated values as far as an optimizer can tell. ir_build_ssa turns
+// the reads into uses of the value that reaches them: each LOAD_LOCAL of
+// a promotable slot is deleted and its uses renamed to the stored value,
+// with IR_PHI instructions where stores from different paths meet.
+//
+// It is the textbook construction (Cytron et al.): predecessors and a
+// reverse postorder of the reachable blocks, immediate dominators by the
+// iterative Cooper-Harvey-Kennedy intersection, dominance frontiers,
+// phis at the iterated frontier of each slot's stores, and renaming in a
+// walk of the dominator tree. Trivial phis (every operand the same value
+// or the phi itself) and phis nothing uses are then removed. Everything
+// but the scratch tables is linear in the size of the function; the
+// dominator fixed point takes a couple of passes on the CFGs the
+// lowering produces.
+//
+// A slot is promotable unless a closure shares it (captured) or some
+// 'move' empties it. A read that may see the slot before any store - a
+// path from entry with no store on it - stays a LOAD_LOCAL, and so does
+// every read that would need a phi on such a path.
+//
+// Stores are the one place the slot form carries more than dataflow: a
+// STORE_LOCAL of a boxed value owns it, releases the previous one, and
+// DROP_LOCAL releases the last one on exit. Those stay. A slot whose
+// stores are all raw (unboxed by ir_specialize) and whose loads are all
+// gone has nothing left to do, so its stores are removed as well.
+
+#include "ir.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_REPLACEMENT (-2)
+
+// ============================================================
+// CFG and dominators
+// ============================================================
+
+static int successors(IRBlock* b, IRBlock** out) {
+    IRInstr* t = b->last;
+    if (!t) return 0;
+    if (t->op == IR_JUMP) {
+        out[0] = t->targets[0];
+        return 1;
+    }
+    if (t->op == IR_BRANCH) {
+        out[0] = t->targets[0];
+        out[1] = t->targets[1];
+        return 2;
+    }
+    return 0;
+}
+
+// Walk up from 'a' and 'b' to their nearest common dominator
+static IRBlock* intersect(IRBlock* a, IRBlock* b) {
+    while (a != b) {
+        while (a->rpo > b->rpo) a = a->idom;
+        while (b->rpo > a->rpo) b = b->idom;
+    }
+    return a;
+}
+
+bool ir_compute_dominators(IRModule* module, IRFunction* func) {
+    int n = func->block_count;
+    if (!func->entry || n == 0) return false;
+    IRBlock** order = (IRBlock**)malloc(sizeof(IRBlock*) * n);
+    IRBlock** stack = (IRBlock**)malloc(sizeof(IRBlock*) * n);
+    int* next_succ = (int*)calloc(n, sizeof(int));
+    int* pred_counts = (int*)calloc(n, sizeof(int));
+    bool ok = order && stack && next_succ && pred_counts;
+
+    for (IRBlock* b = func->entry; b; b = b->next) {
+        b->rpo = -1;
+        b->idom = NULL;
+        b->preds = NULL;
+        b->pred_count = 0;
+        b->dom_children = NULL;
+        b->dom_child_count = 0;
+        b->dom_depth = 0;
+    }
+
+    // Postorder by an explicit DFS; rpo doubles as the visited mark
+    int post = 0;
+    if (ok) {
+        int sp = 0;
+        stack[sp++] = func->entry;
+        func->entry->rpo = 0;
+        while (sp > 0) {
+            IRBlock* b = stack[sp - 1];
+            IRBlock* succ[2];
+            int count = successors(b, succ);
+            if (next_succ[b->id] < count) {
+                IRBlock* s = succ[next_succ[b->id]++];
+                if (s->rpo < 0) {
+                    s->rpo = 0;
+                    stack[sp++] = s;
+                }
+                continue;
+            }
+            order[post++] = b;
+            sp--;
+        }
+    }
+
+    // Reverse it, and count predecessors among the reachable blocks
+    IRBlock** rpo = ok ? (IRBlock**)ir_alloc(module, sizeof(IRBlock*) * (post > 0 ? post : 1)) : NULL;
+    ok = ok && rpo;
+    for (int k = 0; ok && k < post; k++) {
+        rpo[k] = order[post - 1 - k];
+        rpo[k]->rpo = k;
+    }
+    for (int k = 0; ok && k < post; k++) {
+        IRBlock* succ[2];
+        int count = successors(rpo[k], succ);
+        for (int s = 0; s < count; s++) pred_counts[succ[s]->id]++;
+    }
+    for (int k = 0; ok && k < post; k++) {
+        IRBlock* b = rpo[k];
+        if (pred_counts[b->id] == 0) continue;
+        b->preds = (IRBlock**)ir_alloc(module, sizeof(IRBlock*) * pred_counts[b->id]);
+        if (!b->preds) ok = false;
+    }
+    for (int k = 0; ok && k < post; k++) {
+        IRBlock* succ[2];
+        int count = successors(rpo[k], succ);
+        for (int s = 0; s < count; s++) succ[s]->preds[succ[s]->pred_count++] = rpo[k];
+    }
+
+    // Immediate dominators; the entry is its own while iterating
+    if (ok) {
+        func->entry->idom = func->entry;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int k = 1; k < post; k++) {
+                IRBlock* b = rpo[k];
+                IRBlock* idom = NULL;
+                for (int p = 0; p < b->pred_count; p++) {
+                    IRBlock* pred = b->preds[p];
+                    if (!pred->idom) continue;  // Not processed yet
+                    idom = idom ? intersect(pred, idom) : pred;
+                }
+                if (idom != b->idom) {
+                    b->idom = idom;
+                    changed = true;
+                }
+            }
+        }
+        func->entry->idom = NULL;
+    }
+
+    // Dominator tree children, in block order
+    memset(pred_counts, 0, ok ? sizeof(int) * n : 0);
+    for (int k = 1; ok && k < post; k++) pred_counts[rpo[k]->idom->id]++;
+    for (int k = 0; ok && k < post; k++) {
+        IRBlock* b = rpo[k];
+        if (b->idom) b->dom_depth = b->idom->dom_depth + 1;
+        if (pred_counts[b->id] == 0) continue;
+        b->dom_children = (IRBlock**)ir_alloc(module, sizeof(IRBlock*) * pred_counts[b->id]);
+        if (!b->dom_children) ok = false;
+    }
+    for (IRBlock* b = func->entry; ok && b; b = b->next) {
+        if (b->rpo >= 0 && b->idom) b->idom->dom_children[b->idom->dom_child_count++] = b;
+    }
+
+    func->rpo = ok ? rpo : NULL;
+    func->rpo_count = ok ? post : 0;
+    free(order);
+    free(stack);
+    free(next_succ);
+    free(pred_counts);
+    return ok;
+}
+
+bool ir_dominates(IRBlock* a, IRBlock* b) {
+    if (a->rpo < 0 || b->rpo < 0) return false;
+    while (b && b->dom_depth > a->dom_depth) b = b->idom;
+    return b == a;
+}
+
+// ============================================================
+// SSA construction
+// ============================================================
+
+typedef struct {
+    int* items;
+    int count;
+    int capacity;
+} IntList;
+
+static bool int_list_add(IntList* list, int v) {
+    if (list->count > 0 && list->items[list->count - 1] == v) return true;
+    if (list->count == list->capacity) {
+        int cap = list->capacity == 0 ? 4 : list->capacity * 2;
+        int* items = (int*)realloc(list->items, sizeof(int) * cap);
+        if (!items) return false;
+        list->items = items;
+        list->capacity = cap;
+    }
+    list->items[list->count++] = v;
+    return true;
+}
+
+typedef struct {
+    IRModule* module;
+    IRFunction* func;
+    IRBlock** blocks;           // Block id -> block
+    IRInstr** defs;             // Value id -> defining instruction
+    IRValue* replace;           // Value id -> value it was renamed to, or NO_REPLACEMENT
+    IRValue* reaching;          // LOAD_LOCAL dest -> value reaching it (IR_NO_VALUE: none)
+    bool* partial;              // PHI dest -> some path has no store
+    bool* promote;              // Slot -> promotable
+    bool* kept;                 // Slot -> some load of it stays
+    int* slot_repr;             // Slot -> representation of its loads
+    IRValue* current;           // Slot -> value reaching the current point in the rename walk
+    int* undo_slots;            // Rename walk: (slot, previous value) pairs to restore
+    IRValue* undo_values;
+    int undo_count;
+    int undo_capacity;
+    bool failed;
+} SSABuilder;
+
+static IRValue resolve(SSABuilder* B, IRValue v) {
+    while (v >= 0 && B->replace[v] != NO_REPLACEMENT) v = B->replace[v];
+    return v;
+}
+
+// Which slots can become SSA values, and the representation their phis get
+static void choose_slots(SSABuilder* B) {
+    IRFunction* f = B->func;
+    for (int s = 0; s < f->slot_count; s++) {
+        B->promote[s] = !f->slots[s].captured;
+        B->slot_repr[s] = -1;
+    }
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->op == IR_MOVE_LOCAL) B->promote[i->slot] = false;
+            if (i->op == IR_LOAD_LOCAL && B->slot_repr[i->slot] < 0) {
+                B->slot_repr[i->slot] = i->repr;
+            }
+        }
+    }
+    // A store that would change the representation a load reads back
+    // does not happen after ir_specialize; don't rely on it.
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->op != IR_STORE_LOCAL) continue;
+            IRInstr* def = B->defs[i->args[0]];
+            int repr = def ? (int)def->repr : IR_REPR_BOXED;
+            if (B->slot_repr[i->slot] < 0) B->slot_repr[i->slot] = repr;
+            else if (B->slot_repr[i->slot] != repr) B->promote[i->slot] = false;
+        }
+    }
+}
+
+static IRInstr* new_phi(SSABuilder* B, IRBlock* b, int slot) {
+    IRInstr* phi = ir_instr_new(B->module, IR_PHI, b->pred_count);
+    if (!phi) return NULL;
+    for (int k = 0; k < b->pred_count; k++) phi->args[k] = IR_NO_VALUE;
+    phi->slot = slot;
+    phi->repr = (IRRepr)B->slot_repr[slot];
+    ir_define(B->func, phi);
+    if (b->first) {
+        ir_instr_insert_before(b->first, phi);
+    } else {
+        ir_instr_append(b, phi);
+    }
+    return phi;
+}
+
+// Phis at the iterated dominance frontier of every promotable slot's stores
+static void place_phis(SSABuilder* B) {
+    IRFunction* f = B->func;
+    int n = f->block_count;
+    IntList* frontier = (IntList*)calloc(n, sizeof(IntList));
+    IntList* stores = (IntList*)calloc(f->slot_count > 0 ? f->slot_count : 1, sizeof(IntList));
+    int* has_phi = (int*)malloc(sizeof(int) * n);
+    int* queued = (int*)malloc(sizeof(int) * n);
+    int* work = (int*)malloc(sizeof(int) * n);
+    if (!frontier || !stores || !has_phi || !queued || !work) {
+        B->failed = true;
+        goto done;
+    }
+
+    for (int k = 0; k < f->rpo_count; k++) {
+        IRBlock* b = f->rpo[k];
+        if (b->pred_count < 2) continue;
+        for (int p = 0; p < b->pred_count; p++) {
+            for (IRBlock* r = b->preds[p]; r != b->idom; r = r->idom) {
+                // Consecutive duplicates are skipped; others are harmless
+                if (!int_list_add(&frontier[r->id], b->id)) B->failed = true;
+            }
+        }
+    }
+    for (int k = 0; k < f->rpo_count; k++) {
+        for (IRInstr* i = f->rpo[k]->first; i; i = i->next) {
+            if (i->op == IR_STORE_LOCAL && B->promote[i->slot] &&
+                !int_list_add(&stores[i->slot], f->rpo[k]->id)) B->failed = true;
+        }
+    }
+
+    for (int k = 0; k < n; k++) has_phi[k] = queued[k] = -1;
+    for (int s = 0; s < f->slot_count && !B->failed; s++) {
+        int top = 0;
+        for (int d = 0; d < stores[s].count; d++) {
+            int id = stores[s].items[d];
+            if (queued[id] == s) continue;
+            queued[id] = s;
+            work[top++] = id;
+        }
+        while (top > 0 && !B->failed) {
+            IntList* df = &frontier[work[--top]];
+            for (int d = 0; d < df->count; d++) {
+                int id = df->items[d];
+                if (has_phi[id] == s) continue;
+                has_phi[id] = s;
+                if (!new_phi(B, B->blocks[id], s)) {
+                    B->failed = true;
+                    break;
+                }
+                if (queued[id] != s) {
+                    queued[id] = s;
+                    work[top++] = id;
+                }
+            }
+        }
+    }
+
+done:
+    for (int k = 0; frontier && k < n; k++) free(frontier[k].items);
+    for (int s = 0; stores && s < f->slot_count; s++) free(stores[s].items);
+    free(frontier);
+    free(stores);
+    free(has_phi);
+    free(queued);
+    free(work);
+}
+
+static void set_current(SSABuilder* B, int slot, IRValue v) {
+    if (B->undo_count == B->undo_capacity) {
+        int cap = B->undo_capacity == 0 ? 64 : B->undo_capacity * 2;
+        int* slots = (int*)realloc(B->undo_slots, sizeof(int) * cap);
+        if (slots) B->undo_slots = slots;
+        IRValue* values = (IRValue*)realloc(B->undo_values, sizeof(IRValue) * cap);
+        if (values) B->undo_values = values;
+        if (!slots || !values) {
+            B->failed = true;
+            return;
+        }
+        B->undo_capacity = cap;
+    }
+    B->undo_slots[B->undo_count] = slot;
+    B->undo_values[B->undo_count] = B->current[slot];
+    B->undo_count++;
+    B->current[slot] = v;
+}
+
+// Record the value reaching every load, and fill in phi operands, in a
+// preorder walk of the dominator tree
+static void rename_block(SSABuilder* B, IRBlock* b) {
+    int mark = B->undo_count;
+    for (IRInstr* i = b->first; i; i = i->next) {
+        if (i->op == IR_PHI) {
+            set_current(B, i->slot, i->dest);
+        } else if (i->op == IR_LOAD_LOCAL && B->promote[i->slot]) {
+            B->reaching[i->dest] = B->current[i->slot];
+        } else if (i->op == IR_STORE_LOCAL && B->promote[i->slot]) {
+            set_current(B, i->slot, i->args[0]);
+        }
+    }
+
+    IRBlock* succ[2] = { NULL, NULL };
+    int count = successors(b, succ);
+    for (int s = 0; s < count; s++) {
+        if (s == 1 && succ[1] == succ[0]) break;
+        IRBlock* t = succ[s];
+        for (int k = 0; k < t->pred_count; k++) {
+            if (t->preds[k] != b) continue;
+            for (IRInstr* phi = t->first; phi && phi->op == IR_PHI; phi = phi->next) {
+                phi->args[k] = B->current[phi->slot];
+            }
+        }
+    }
+
+    for (int c = 0; c < b->dom_child_count && !B->failed; c++) {
+        rename_block(B, b->dom_children[c]);
+    }
+
+    while (B->undo_count > mark) {
+        B->undo_count--;
+        B->current[B->undo_slots[B->undo_count]] = B->undo_values[B->undo_count];
+    }
+}
+
+// Is 'v' missing on some path: no store reaches it, or it is a phi or a
+// load fed by such a path?
+static bool undefined_on_a_path(SSABuilder* B, IRValue v) {
+    while (v >= 0) {
+        IRInstr* def = B->defs[v];
+        if (!def) return false;
+        if (def->op == IR_PHI) return B->partial[v];
+        if (def->op != IR_LOAD_LOCAL || !B->promote[def->slot]) return false;
+        v = B->reaching[v];
+    }
+    return true;
+}
+
+// Delete the loads a value reaches, and the phis that some path leaves
+// without a value
+static void replace_loads(SSABuilder* B, IRSSAStats* stats) {
+    IRFunction* f = B->func;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = 0; k < f->rpo_count; k++) {
+            for (IRInstr* i = f->rpo[k]->first; i && i->op == IR_PHI; i = i->next) {
+                if (B->partial[i->dest]) continue;
+                for (int a = 0; a < i->arg_count; a++) {
+                    if (undefined_on_a_path(B, i->args[a])) {
+                        B->partial[i->dest] = true;
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int k = 0; k < f->rpo_count; k++) {
+        IRInstr* i = f->rpo[k]->first;
+        while (i) {
+            IRInstr* next = i->next;
+            if (i->op == IR_PHI && B->partial[i->dest]) {
+                ir_instr_remove(i);
+            } else if (i->op == IR_LOAD_LOCAL && B->promote[i->slot]) {
+                if (undefined_on_a_path(B, i->dest)) {
+                    B->kept[i->slot] = true;  // So its stores must stay
+                } else {
+                    B->replace[i->dest] = B->reaching[i->dest];
+                    ir_instr_remove(i);
+                    stats->loads_replaced++;
+                }
+            }
+            i = next;
+        }
+    }
+}
+
+// A phi whose operands are all one value (or the phi itself) is that value
+static void remove_trivial_phis(SSABuilder* B) {
+    IRFunction* f = B->func;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = 0; k < f->rpo_count; k++) {
+            IRInstr* i = f->rpo[k]->first;
+            while (i && i->op == IR_PHI) {
+                IRInstr* next = i->next;
+                IRValue same = IR_NO_VALUE;
+                bool trivial = true;
+                for (int a = 0; a < i->arg_count && trivial; a++) {
+                    IRValue v = resolve(B, i->args[a]);
+                    if (v == i->dest || v == same) continue;
+                    if (same != IR_NO_VALUE) trivial = false;
+                    same = v;
+                }
+                if (trivial && same != IR_NO_VALUE) {
+                    B->replace[i->dest] = same;
+                    ir_instr_remove(i);
+                    changed = true;
+                }
+                i = next;
+            }
+        }
+    }
+}
+
+// Rename every operand, then drop phis nothing reads
+static void rewrite_uses(SSABuilder* B) {
+    IRFunction* f = B->func;
+    int* uses = (int*)calloc(f->value_count > 0 ? f->value_count : 1, sizeof(int));
+    if (!uses) {
+        B->failed = true;
+        return;
+    }
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            for (int a = 0; a < i->arg_count; a++) {
+                i->args[a] = resolve(B, i->args[a]);
+                if (i->args[a] >= 0 && !(i->op == IR_PHI && i->args[a] == i->dest)) {
+                    uses[i->args[a]]++;
+                }
+            }
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = 0; k < f->rpo_count; k++) {
+            IRInstr* i = f->rpo[k]->first;
+            while (i && i->op == IR_PHI) {
+                IRInstr* next = i->next;
+                if (uses[i->dest] == 0) {
+                    for (int a = 0; a < i->arg_count; a++) {
+                        if (i->args[a] >= 0 && i->args[a] != i->dest) uses[i->args[a]]--;
+                    }
+                    ir_instr_remove(i);
+                    changed = true;
+                }
+                i = next;
+            }
+        }
+    }
+    free(uses);
+}
+
+// Stores of raw values into a slot no load reads any more
+static void remove_raw_stores(SSABuilder* B, IRSSAStats* stats) {
+    IRFunction* f = B->func;
+    bool* raw = B->promote;  // Reused: slot -> its stores can go
+    for (int s = 0; s < f->slot_count; s++) {
+        raw[s] = B->promote[s] && !B->kept[s];
+        if (raw[s]) stats->promoted_slots++;
+        if (B->slot_repr[s] == IR_REPR_BOXED) raw[s] = false;
+    }
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->op != IR_LOAD_LOCAL && i->op != IR_STORE_LOCAL) continue;
+            // Unreachable blocks were not renamed; their loads still read the slot
+            if (b->rpo < 0) raw[i->slot] = false;
+            if (i->op == IR_STORE_LOCAL && (!B->defs[i->args[0]] ||
+                                            B->defs[i->args[0]]->repr == IR_REPR_BOXED)) {
+                raw[i->slot] = false;
+            }
+        }
+    }
+    for (IRBlock* b = f->entry; b; b = b->next) {
+        IRInstr* i = b->first;
+        while (i) {
+            IRInstr* next = i->next;
+            if ((i->op == IR_STORE_LOCAL || i->op == IR_DROP_LOCAL) && raw[i->slot]) {
+                ir_instr_remove(i);
+                stats->stores_removed++;
+            }
+            i = next;
+        }
+    }
+}
+
+static void build_function(IRModule* module, IRFunction* func, IRSSAStats* stats) {
+    if (!ir_compute_dominators(module, func)) return;
+
+    SSABuilder B;
+    memset(&B, 0, sizeof(B));
+    B.module = module;
+    B.func = func;
+    int slots = func->slot_count > 0 ? func->slot_count : 1;
+    // Phis add values; each slot gets at most one per block
+    int values = func->value_count + func->slot_count * func->block_count + 1;
+    B.blocks = (IRBlock**)malloc(sizeof(IRBlock*) * func->block_count);
+    B.defs = (IRInstr**)calloc(values, sizeof(IRInstr*));
+    B.replace = (IRValue*)malloc(sizeof(IRValue) * values);
+    B.reaching = (IRValue*)malloc(sizeof(IRValue) * values);
+    B.partial = (bool*)calloc(values, sizeof(bool));
+    B.promote = (bool*)calloc(slots, sizeof(bool));
+    B.kept = (bool*)calloc(slots, sizeof(bool));
+    B.slot_repr = (int*)malloc(sizeof(int) * slots);
+    B.current = (IRValue*)malloc(sizeof(IRValue) * slots);
+    if (!B.blocks || !B.defs || !B.replace || !B.reaching || !B.partial || !B.promote ||
+        !B.kept || !B.slot_repr || !B.current) goto done;
+
+    for (int v = 0; v < values; v++) {
+        B.replace[v] = NO_REPLACEMENT;
+        B.reaching[v] = IR_NO_VALUE;
+    }
+    for (int s = 0; s < func->slot_count; s++) B.current[s] = IR_NO_VALUE;
+    for (IRBlock* b = func->entry; b; b = b->next) {
+        B.blocks[b->id] = b;
+        for (IRInstr* i = b->first; i; i = i->next) {
+            if (i->dest != IR_NO_VALUE) B.defs[i->dest] = i;
+        }
+    }
+
+    choose_slots(&B);
+    place_phis(&B);
+    if (B.failed) goto done;  // Phis without operands would be wrong; leave as is
+    for (IRBlock* b = func->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i && i->op == IR_PHI; i = i->next) B.defs[i->dest] = i;
+    }
+    rename_block(&B, func->entry);
+    if (B.failed) goto done;
+
+    replace_loads(&B, stats);
+    remove_trivial_phis(&B);
+    rewrite_uses(&B);
+    remove_raw_stores(&B, stats);
+    for (IRBlock* b = func->entry; b; b = b->next) {
+        for (IRInstr* i = b->first; i && i->op == IR_PHI; i = i->next) stats->phis++;
+    }
+
+done:
+    // A failure before renaming leaves only unfilled phis behind
+    if (B.failed) {
+        for (IRBlock* b = func->entry; b; b = b->next) {
+            while (b->first && b->first->op == IR_PHI) ir_instr_remove(b->first);
+        }
+    }
+    free(B.blocks);
+    free(B.defs);
+    free(B.replace);
+    free(B.reaching);
+    free(B.partial);
+    free(B.promote);
+    free(B.kept);
+    free(B.slot_repr);
+    free(B.current);
+    free(B.undo_slots);
+    free(B.undo_values);
+}
+
+void ir_build_ssa(IRModule* module, IRSSAStats* stats) {
+    IRSSAStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    for (IRFunction* f = module->functions; f; f = f->next) {
+        build_function(module, f, stats);
+    }
+}
+
+// ============================================================
+// Printing
+// ============================================================
+
+static void print_dom_subtree(IRBlock* b, int depth) {
+    printf("  %*sbb%d", depth * 2, "", b->id);
+    if (b->pred_count > 0) {
+        printf("  ; preds");
+        for (int p = 0; p < b->pred_count; p++) printf(" bb%d", b->preds[p]->id);
+    }
+    printf("\n");
+    for (int c = 0; c < b->dom_child_count; c++) print_dom_subtree(b->dom_children[c], depth + 1);
+}
+
+void ir_print_dominators(IRFunction* func) {
+    printf("dominators %s:\n", func->name);
+    if (func->rpo && func->entry) print_dom_subtree(func->entry, 0);
+}
@@ -0,0 +1,1225 @@
+// test_ir.c - Tests for AST -> IR lowering and the IR passes
+//
+// Like the semantic tests these are print-based: each case shows its
+// source, the IR it lowers to, and the effect of the pass under test.
+// Expected properties are noted in comments next to each case.
+
+#include "lexer.h"
+#include "parser.h"
+#include "semantic.h"
+#include "ir.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Lex and parse a source string. Returns NULL (after printing why) if the
+// source does not parse.
+static ASTNode* parse_source(const char* source) {
+    Lexer* lexer = lexer_create(source);
+    if (!lexer) { printf("  Lexer creation failed\n"); return NULL; }
+
+    Token** tokens = NULL;
+    int token_count = 0;
+    int token_capacity = 0;
+    Token* tok;
+    do {
+        tok = lexer_next_token(lexer);
+        if (!tok) break;
+        if (token_count >= token_capacity) {
+            int new_cap = token_capacity == 0 ? 16 : token_capacity * 2;
+            tokens = (Token**)realloc(tokens, sizeof(Token*) * new_cap);
+            token_capacity = new_cap;
+        }
+        tokens[token_count++] = tok;
+    } while (tok->type != TOKEN_EOF);
+
+    Parser* parser = parser_create(tokens, token_count);
+    ASTNode* module = parser_parse_module(parser);
+    if (!module || parser->had_error) {
+        printf("  Parse failed: %s\n",
+               parser->had_error ? parser->error_message : "no module");
+        ast_destroy(module);
+        module = NULL;
+    }
+
+    parser_destroy(parser);
+    for (int i = 0; i < token_count; i++) token_destroy(tokens[i]);
+    free(tokens);
+    lexer_destroy(lexer);
+    return module;
+}
+
+static void print_stats(const char* label, IRRefcountStats* s) {
+    printf("  %s: %d retains, %d releases (%d static, ~%ld executed)\n",
+           label, s->retains, s->releases, s->retains + s->releases, s->weighted);
+}
+
+// Lower 'source', run refcount elision, and print the IR on both sides
+// of the pass (the naive IR only when 'show_naive' is set).
+static void run_refcount_case(const char* label, const char* source, bool show_naive) {
+    printf("\n=== Testing: %s ===\n", label);
+    printf("Source:\n%s\n", source);
+
+    ASTNode* ast = parse_source(source);
+    if (!ast) return;
+    IRModule* ir = ir_lower_module(ast);
+    if (!ir) {
+        printf("  Lowering failed\n");
+        ast_destroy(ast);
+        return;
+    }
+
+    IRRefcountStats before, after;
+    ir_count_module_refcounts(ir, &before);
+    if (show_naive) {
+        printf("Naive IR:\n");
+        ir_print_module(ir);
+    }
+    ir_elide_refcounts(ir);
+    ir_count_module_refcounts(ir, &after);
+    printf("After refcount elision:\n");
+    ir_print_module(ir);
+    print_stats("Before", &before);
+    print_stats("After ", &after);
+
+    ir_module_destroy(ir);
+    ast_destroy(ast);
+}
+
+// One row of the benchmark table.
+static void run_refcount_benchmark(const char* label, const char* source) {
+    ASTNode* ast = parse_source(source);
+    if (!ast) return;
+    IRModule* ir = ir_lower_module(ast);
+    if (!ir) {
+        printf("  %-22s lowering failed\n", label);
+        ast_destroy(ast);
+        return;
+    }
+    IRRefcountStats before, after;
+    ir_count_module_refcounts(ir, &before);
+    ir_elide_refcounts(ir);
+    ir_count_module_refcounts(ir, &after);
+
+    int s0 = before.retains + before.releases;
+    int s1 = after.retains + after.releases;
+    printf("  %-22s %6d -> %-6d %9ld -> %-9ld %5.1f%%\n", label, s0, s1,
+           before.weighted, after.weighted,
+           before.weighted ? 100.0 * (before.weighted - after.weighted) / before.weighted : 0.0);
+
+    ir_module_destroy(ir);
+    ast_destroy(ast);
+}
+
+static void print_result(const char* label, bool ok, Value v) {
+    printf("  %s: ", label);
+    if (!ok) {
+        printf("(not evaluable)\n");
+        return;
+    }
+    value_print(v);
+    printf("\n");
+}
+
+// Lower 'source' and elide refcounts, evaluate 'entry' (if any) on the
+// generic IR, specialize, print the result, and evaluate again.
+static void run_specialize_case(const char* label, const char* source, const char* entry,
+                                bool show_ir) {
+    printf("\n=== Testing: %s ===\n", label);
+    printf("Source:\n%s\n", source);
+
+    ASTNode* ast = parse_source(source);
+    if (!ast) return;
+    IRModule* ir = ir_lower_module(ast);
+    if (!ir) {
+        printf("  Lowering failed\n");
+        ast_destroy(ast);
+        return;
+    }
+    ir_elide_refcounts(ir);
+
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    Value before = value_none(), after = value_none();
+    bool ran_before = entry && ir_eval(ir, mm, entry, NULL, 0, &before);
+
+    IRSpecializeStats stats;
+    ir_specialize(ir, &stats);
+    if (show_ir) {
+        printf("After specialization:\n");
+        ir_print_module(ir);
+    }
+    printf("  %d specializations, %d static calls, %d capped; %d unboxed values, "
+           "%d conversions; %d -> %d instructions\n",
+           stats.specializations, stats.static_calls, stats.capped, stats.unboxed_values,
+           stats.conversions, stats.instrs_before, stats.instrs_after);
+    if (entry) {
+        bool ran_after = ir_eval(ir, mm, entry, NULL, 0, &after);
+        print_result("Generic", ran_before, before);
+        print_result("Specialized", ran_after, after);
+        value_release(mm, before);
+        value_release(mm, after);
+    }
+
+    mm_destroy(mm);
+    ir_module_destroy(ir);
+    ast_destroy(ast);
+}
+
+// Lower, elide refcounts and specialize 'source', then build SSA form and
+// print it with each function's dominator tree. 'entry' (if any) is
+// evaluated before and after SSA construction.
+static void run_ssa_case(const char* label, const char* source, const char* entry) {
+    printf("\n=== Testing: %s ===\n", label);
+    printf("Source:\n%s\n", source);
+
+    ASTNode* ast = parse_source(source);
+    if (!ast) return;
+    IRModule* ir = ir_lower_module(ast);
+    if (!ir) {
+        printf("  Lowering failed\n");
+        ast_destroy(ast);
+        return;
+    }
+    ir_elide_refcounts(ir);
+    ir_specialize(ir, NULL);
+
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    Value before = value_none(), after = value_none();
+    bool ran_before = entry && ir_eval(ir, mm, entry, NULL, 0, &before);
+    int instrs_before = ir_count_instructions(ir);
+
+    IRSSAStats stats;
+    ir_build_ssa(ir, &stats);
+    printf("SSA form:\n");
+    ir_print_module(ir);
+    for (IRFunction* f = ir->functions; f; f = f->next) {
+        if (f->rpo_count > 1) ir_print_dominators(f);
+    }
+    printf("  %d slots promoted, %d loads replaced, %d phis, %d raw stores removed; "
+           "%d -> %d instructions\n", stats.promoted_slots, stats.loads_replaced,
+           stats.phis, stats.stores_removed, instrs_before, ir_count_instructions(ir));
+    if (entry) {
+        bool ran_after = ir_eval(ir, mm, entry, NULL, 0, &after);
+        print_result("Slots", ran_before, before);
+        print_result("SSA  ", ran_after, after);
+        value_release(mm, before);
+        value_release(mm, after);
+    }
+
+    mm_destroy(mm);
+    ir_module_destroy(ir);
+    ast_destroy(ast);
+}
+
+// Run every pass up to SSA form on 'source', returning the module (NULL
+// after printing why, if lowering fails).
+static IRModule* lower_to_ssa(ASTNode* ast) {
+    IRModule* ir = ir_lower_module(ast);
+    if (!ir) return NULL;
+    ir_elide_refcounts(ir);
+    ir_specialize(ir, NULL);
+    ir_build_ssa(ir, NULL);
+    return ir;
+}
+
+// Bring 'source' to SSA form, then eliminate redundancy and print the
+// result with its before/after sizes. 'entry' (if any) is evaluated
+// before and after.
+static void run_redundancy_case(const char* label, const char* source, const char* entry) {
+    printf("\n=== Testing: %s ===\n", label);
+    printf("Source:\n%s\n", source);
+
+    ASTNode* ast = parse_source(source);
+    if (!ast) return;
+    IRModule* ir = lower_to_ssa(ast);
+    if (!ir) {
+        printf("  Lowering failed\n");
+        ast_destroy(ast);
+        return;
+    }
+
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    Value before = value_none(), after = value_none();
+    bool ran_before = entry && ir_eval(ir, mm, entry, NULL, 0, &before);
+
+    IRRedundancyStats stats;
+    ir_eliminate_redundancy(ir, &stats);
+    printf("Optimized IR:\n");
+    ir_print_module(ir);
+    printf("  %d eliminated, %d hoisted; %d -> %d instructions, %ld -> %ld weighted\n",
+           stats.eliminated, stats.hoisted, stats.instrs_before, stats.instrs_after,
+           stats.weighted_before, stats.weighted_after);
+    if (entry) {
+        bool ran_after = ir_eval(ir, mm, entry, NULL, 0, &after);
+        print_result("Before", ran_before, before);
+        print_result("After ", ran_after, after);
+        value_release(mm, before);
+        value_release(mm, after);
+    }
+
+    mm_destroy(mm);
+    ir_module_destroy(ir);
+    ast_destroy(ast);
+}
+
+static void run_redundancy_benchmark(const char* label, const char* source) {
+    ASTNode* ast = parse_source(source);
+    if (!ast) return;
+    IRModule* ir = lower_to_ssa(ast);
+    if (!ir) {
+        printf("  %-22s lowering failed\n", label);
+        ast_destroy(ast);
+        return;
+    }
+    IRRedundancyStats stats;
+    ir_eliminate_redundancy(ir, &stats);
+    printf("  %-22s %6d -> %-6d %9ld -> %-9ld %5.1f%%\n", label,
+           stats.instrs_before, stats.instrs_after, stats.weighted_before, stats.weighted_after,
+           stats.weighted_before
+               ? 100.0 * (stats.weighted_before - stats.weighted_after) / stats.weighted_before
+               : 0.0);
+
+    ir_module_destroy(ir);
+    ast_destroy(ast);
+}
+
+// Lower 'source' twice, inline calls in one copy and print it, then take
+// both through the rest of the pipeline. 'entry' (if any) is evaluated on
+// each, counting the calls made.
+static void run_inline_case(const char* label, const char* source, const char* entry) {
+    printf("\n=== Testing: %s ===\n", label);
+    printf("Source:\n%s\n", source);
+
+    ASTNode* ast = parse_source(source);
+    if (!ast) return;
+    IRModule* plain = ir_lower_module(ast);
+    IRModule* inlined = ir_lower_module(ast);
+    if (!plain || !inlined) {
+        printf("  Lowering failed\n");
+        if (plain) ir_module_destroy(plain);
+        if (inlined) ir_module_destroy(inlined);
+        ast_destroy(ast);
+        return;
+    }
+
+    IRInlineStats stats;
+    ir_inline(inlined, &stats);
+    printf("After inlining:\n");
+    ir_print_module(inlined);
+    printf("  %d inlined (%d lambdas), %d closures removed; %d -> %d calls, "
+           "%d -> %d instructions\n", stats.inlined, stats.lambdas, stats.closures_removed,
+           stats.calls_before, stats.calls_after, stats.instrs_before, stats.instrs_after);
+
+    IRModule* modules[2] = { plain, inlined };
+    for (int k = 0; k < 2; k++) {
+        ir_elide_refcounts(modules[k]);
+        ir_specialize(modules[k], NULL);
+        ir_build_ssa(modules[k], NULL);
+        ir_eliminate_redundancy(modules[k], NULL);
+    }
+    if (entry) {
+        MemoryManager* mm = mm_create(MM_UNLIMITED);
+        const char* names[2] = { "Calls  ", "Inlined" };
+        for (int k = 0; k < 2; k++) {
+            Value result = value_none();
+            IREvalCounts counts;
+            bool ran = ir_eval_counted(modules[k], mm, entry, NULL, 0, &result, &counts);
+            print_result(names[k], ran, result);
+            if (ran) printf("    %ld calls, %ld instructions\n", counts.calls, counts.instructions);
+            value_release(mm, result);
+        }
+        mm_destroy(mm);
+    }
+
+    ir_module_destroy(plain);
+    ir_module_destroy(inlined);
+    ast_destroy(ast);
+}
+
+// Analyze 'source' - which lists what each closure captures - and lower
+// it twice. The IR is printed as lowered; then one copy goes through the
+// pass pipeline as is and the other with ir_inline in front, and 'entry'
+// is evaluated on each.
+static void run_closure_case(const char* label, const char* source, const char* entry) {
+    printf("\n=== Testing: %s ===\n", label);
+    printf("Source:\n%s\n", source);
+
+    ASTNode* ast = parse_source(source);
+    if (!ast) return;
+    SemanticAnalyzer* sem = semantic_create();
+    if (!semantic_analyze(sem, ast)) {
+        printf("  Analysis failed\n");
+        semantic_destroy(sem);
+        ast_destroy(ast);
+        return;
+    }
+    IRModule* plain = ir_lower_module(ast);
+    IRModule* inlined = ir_lower_module(ast);
+    semantic_destroy(sem);
+    if (!plain || !inlined) {
+        printf("  Lowering failed\n");
+        if (plain) ir_module_destroy(plain);
+        if (inlined) ir_module_destroy(inlined);
+        ast_destroy(ast);
+        return;
+    }
+    printf("IR:\n");
+    ir_print_module(plain);
+
+    IRInlineStats stats;
+    ir_inline(inlined, &stats);
+    printf("  %d inlined (%d lambdas), %d closures removed\n", stats.inlined, stats.lambdas,
+           stats.closures_removed);
+    IRModule* modules[2] = { plain, inlined };
+    for (int k = 0; k < 2; k++) {
+        ir_elide_refcounts(modules[k]);
+        ir_specialize(modules[k], NULL);
+        ir_build_ssa(modules[k], NULL);
+        ir_eliminate_redundancy(modules[k], NULL);
+    }
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    size_t live = mm->allocation_count;
+    const char* names[2] = { "Closures", "Inlined " };
+    for (int k = 0; k < 2; k++) {
+        Value result = value_none();
+        IREvalCounts counts;
+        bool ran = ir_eval_counted(modules[k], mm, entry, NULL, 0, &result, &counts);
+        print_result(names[k], ran, result);
+        if (ran) printf("    %ld calls, %ld instructions\n", counts.calls, counts.instructions);
+        value_release(mm, result);
+    }
+    // Every closure and cell the runs made has been freed again
+    printf("  Objects left: %zu\n", mm->allocation_count - live);
+    mm_destroy(mm);
+
+    ir_module_destroy(plain);
+    ir_module_destroy(inlined);
+    ast_destroy(ast);
+}
+
+// Analyze 'source' before lowering - which marks parallel loops and
+// types container literals - and print the IR after refcount elision.
+static void run_analyzed_case(const char* label, const char* source) {
+    printf("\n=== Testing: %s ===\n", label);
+    printf("Source:\n%s\n", source);
+
+    ASTNode* ast = parse_source(source);
+    if (!ast) return;
+    SemanticAnalyzer* sem = semantic_create();
+    sem->debug_print_loops = true;
+    if (!semantic_analyze(sem, ast)) {
+        printf("  Analysis failed\n");
+        semantic_destroy(sem);
+        ast_destroy(ast);
+        return;
+    }
+
+    // The analyzer owns the types the lowering reads off the AST
+    IRModule* ir = ir_lower_module(ast);
+    semantic_destroy(sem);
+    if (!ir) {
+        printf("  Lowering failed\n");
+        ast_destroy(ast);
+        return;
+    }
+    ir_elide_refcounts(ir);
+    printf("IR:\n");
+    ir_print_module(ir);
+
+    ir_module_destroy(ir);
+    ast_destroy(ast);
+}
+
+int main(void) {
+    printf("========== IR LOWERING AND REFCOUNT ELISION TESTS ==========\n");
+
+    // Attribute read off a parameter. Naive: param stored at +1, load
+    // retained, getattr result retained, 'user' dropped on exit. After:
+    // 'user' is borrowed and only the +1 for the returned value remains.
+    run_refcount_case("Attribute of a borrowed parameter",
+        "def get_name(user):\n"
+        "    return user.name\n",
+        true);
+
+    // Short-circuit and ternary lower through synthetic $t slots that are
+    // moved out at the join, never dropped.
+    run_refcount_case("Short-circuit and ternary",
+        "def pick(a, b):\n"
+        "    c = a and b\n"
+        "    return c if c else a\n",
+        true);
+
+    // Loop body: the retain/release around each item.price read pairs up
+    // and disappears; the iterator is released once on the exit edge.
+    run_refcount_case("Loop with attribute reads",
+        "def total(items):\n"
+        "    sum = 0\n"
+        "    for item in items:\n"
+        "        sum += item.price * item.qty\n"
+        "    return sum\n",
+        false);
+
+    // 'node' is reassigned, so the callee takes its own reference at
+    // entry and keeps the drop - the caller still passes it borrowed.
+    run_refcount_case("Reassigned parameter keeps a reference",
+        "def last(node):\n"
+        "    while node.next:\n"
+        "        node = node.next\n"
+        "    return node\n",
+        false);
+
+    // Arguments loaded straight from locals are passed without a retain;
+    // the call result passed to print is released after the call instead.
+    run_refcount_case("Borrowed arguments",
+        "def show(a, b):\n"
+        "    print(a, b)\n"
+        "    print(combine(a, b))\n"
+        "def combine(x, y):\n"
+        "    return x + y\n",
+        false);
+
+    // move into an owned parameter: no refcount traffic at all on the
+    // caller side, and 'buf' is not dropped because it is empty on exit.
+    // Without 'move' the caller keeps its copy and pays retain + drop.
+    run_refcount_case("move into an owned parameter",
+        "def consume(owned buf):\n"
+        "    return buf.size\n"
+        "def produce():\n"
+        "    buf = [1, 2, 3]\n"
+        "    return consume(move buf)\n"
+        "def produce_copy():\n"
+        "    buf = [1, 2, 3]\n"
+        "    return consume(buf)\n",
+        false);
+
+    // move into a borrowed parameter: the moved reference is released by
+    // the caller right after the call.
+    run_refcount_case("move into a borrowed parameter",
+        "def inspect(buf):\n"
+        "    return buf.size\n"
+        "def run():\n"
+        "    buf = [1, 2, 3]\n"
+        "    return inspect(move buf)\n",
+        false);
+
+    // A move on only one path: the path that moved skips the drop of
+    // 'item', the other path still releases it.
+    run_refcount_case("Conditional move keeps the drop",
+        "def keep(owned v):\n"
+        "    return v\n"
+        "def maybe(flag):\n"
+        "    item = [flag]\n"
+        "    if flag:\n"
+        "        return keep(move item)\n"
+        "    return None\n",
+        false);
+
+    // Captured slots can be changed by the closure, so loads from 'step'
+    // keep their retains.
+    run_refcount_case("Captured local stays conservative",
+        "def make_adder(n):\n"
+        "    step = n + 1\n"
+        "    f = x => x + step\n"
+        "    return f(step)\n",
+        false);
+
+    // Methods lower as Class.method; 'self' is borrowed like any other
+    // parameter and the stored value is consumed by setattr.
+    run_refcount_case("Method storing an owned parameter",
+        "class Box:\n"
+        "    def set(self, owned value):\n"
+        "        self.value = value\n"
+        "    def get(self):\n"
+        "        return self.value\n",
+        false);
+
+    printf("\n========== PARALLEL LOOPS ==========\n");
+
+    // The loop body becomes sum_squares.<for@4>, which starts its own
+    // 'total' at 0 and returns [total]; the caller runs it with parfor
+    // and adds entry 0 of the combined result to its 'total'.
+    run_analyzed_case("Sum reduction",
+        "@parallel\n"
+        "def sum_squares(xs: List[int]):\n"
+        "    total = 0\n"
+        "    for x in xs:\n"
+        "        total += x * x\n"
+        "    return total\n");
+
+    // Filter: each chunk appends to a fresh list; the chunk lists are
+    // concatenated in order and extend the caller's 'out'. 'limit' is
+    // read from the enclosing function, so its slot is captured.
+    run_analyzed_case("Filter through append",
+        "@parallel\n"
+        "def small(xs, limit):\n"
+        "    out = []\n"
+        "    for x in xs:\n"
+        "        if x < limit:\n"
+        "            out.append(x)\n"
+        "    return out\n");
+
+    // Element stores indexed by the loop variable of a range loop: each
+    // chunk stores into the enclosing function's list through a capture
+    // and there is nothing to fold.
+    run_analyzed_case("Disjoint element stores",
+        "@parallel\n"
+        "def squares(xs, n):\n"
+        "    out = [0] * n\n"
+        "    for i in range(n):\n"
+        "        out[i] = xs[i] * xs[i]\n"
+        "    return out\n");
+
+    printf("\n========== PIPELINES ==========\n");
+
+    // Three stages, one loop: each element is tripled, tested and
+    // incremented before the next is pulled, and only the final list is
+    // built. The lambdas are created once, ahead of the loop.
+    run_refcount_case("Fused map |> filter |> map",
+        "def evens(xs):\n"
+        "    return xs |> map(x => x * 3) |> filter(x => x % 2 == 0) |> map(x => x + 1)\n",
+        false);
+
+    // find_first jumps out of the loop at the first match, and take
+    // checks its counter before pulling, so neither reads past what it
+    // needs. 'big' is a module-level def: called directly, no refcounting.
+    run_refcount_case("Lazy prefix consumers",
+        "def big(x):\n"
+        "    return x > 1000\n"
+        "def first_big(xs):\n"
+        "    return xs |> map(x => x * x) |> find_first(big)\n"
+        "def head(xs, n):\n"
+        "    return xs |> filter(x => x.ok) |> take(n)\n",
+        false);
+
+    // 'sort' is opaque: the run before it is collected and passed to it,
+    // and the run after it fuses into a reduce. A local named 'map' is
+    // just a function.
+    run_refcount_case("Barriers and shadowing",
+        "def sort(xs):\n"
+        "    return xs\n"
+        "def total(xs):\n"
+        "    return xs |> filter(x => x > 0) |> sort |> map(x => x * 2) |> reduce((a, x) => a + x, 0)\n"
+        "def apply(xs, map):\n"
+        "    return xs |> map\n",
+        false);
+
+    printf("\n========== SPECIALIZATION ==========\n");
+
+    // run() passes a constant int, so sum_to<int> is made: n, total and
+    // i are raw, the loop has no boxing and no refcounting, and the
+    // result comes back as an int. The generic sum_to stays for other
+    // callers; its own locals are unboxed where its code allows.
+    run_specialize_case("Int loop",
+        "def sum_to(n):\n"
+        "    total = 0\n"
+        "    i = 0\n"
+        "    while i < n:\n"
+        "        total += i * i % 7\n"
+        "        i += 1\n"
+        "    return total\n"
+        "def run():\n"
+        "    return sum_to(1000)\n",
+        "run", true);
+
+    // The recursive calls in fib<int> dispatch to fib<int> itself, and
+    // its return representation settles at int.
+    run_specialize_case("Recursion",
+        "def fib(n):\n"
+        "    if n < 2:\n"
+        "        return n\n"
+        "    return fib(n - 1) + fib(n - 2)\n"
+        "def run():\n"
+        "    return fib(20)\n",
+        "run", true);
+
+    // One clone per argument tuple; the int operand of a float multiply
+    // is widened, and an int accumulator that also receives floats is a
+    // float slot.
+    run_specialize_case("Argument tuples and widening",
+        "def scale(x, k):\n"
+        "    acc = 0\n"
+        "    acc = acc + x * k\n"
+        "    return acc + 1\n"
+        "def run():\n"
+        "    a = scale(3, 4)\n"
+        "    b = scale(2.5, 4)\n"
+        "    c = scale(3, 0.5)\n"
+        "    return a + b + c\n",
+        "run", true);
+
+    // Raw values meeting boxed uses: the list append gets a boxed i * i
+    // (released after the borrowing call), and xs stays boxed.
+    run_specialize_case("Boxing at boundaries",
+        "def fill(xs, n):\n"
+        "    i = 0\n"
+        "    while i < n:\n"
+        "        xs.append(i * i)\n"
+        "        i += 1\n"
+        "    return xs\n",
+        NULL, true);
+
+    // x * x leaves int64. Boxed, it falls back to float as the runtime
+    // does; sq<int> has no float to give, so its run stops rather than
+    // wrapping around.
+    run_specialize_case("Int overflow",
+        "def sq(x):\n"
+        "    return x * x\n"
+        "def run():\n"
+        "    return sq(4000000000)\n",
+        "run", false);
+
+    // Five distinct tuples: the first IR_MAX_SPECIALIZATIONS get clones,
+    // the fifth calls the generic add.
+    run_specialize_case("Clone cap",
+        "def add(a, b):\n"
+        "    return a + b\n"
+        "def run():\n"
+        "    return add(1, 2) + add(1.5, 2) + add(1, 2.5) + add(1.5, 2.5) + add(True, 1)\n",
+        "run", false);
+
+    printf("\n========== CONTAINER LAYOUTS ==========\n");
+
+    // Literals typed int or float elements (or dict values) are built
+    // unboxed; an empty literal takes the annotated type it is returned or
+    // passed as. Anything heterogeneous or untyped stays boxed.
+    run_analyzed_case("Typed literals and the boxed fallback",
+        "def counts() -> Dict[str, int]:\n"
+        "    return {\"a\": 1, \"b\": 2}\n"
+        "def weights() -> List[float]:\n"
+        "    return [1, 2.5]\n"
+        "def empty() -> List[int]:\n"
+        "    return []\n"
+        "def mixed(x):\n"
+        "    return [1, \"two\", x]\n"
+        "def first(xs: List[int]) -> int:\n"
+        "    return xs[0]\n"
+        "def run():\n"
+        "    return first([])\n");
+
+    printf("\n========== VECTOR KERNELS ==========\n");
+
+    // A float sum becomes one vreduce into 'total'; 'x' is never assigned.
+    run_analyzed_case("Sum over a List[float]",
+        "def total(xs: List[float]) -> float:\n"
+        "    total = 0.0\n"
+        "    for x in xs:\n"
+        "        total += x\n"
+        "    return total\n");
+
+    // An indexed product over range(n) is a dot product with the count
+    // passed last, so a short list fails like the index would.
+    run_analyzed_case("Dot product over a range",
+        "def dot(a: List[float], b: List[float], n: int) -> float:\n"
+        "    acc = 0.0\n"
+        "    for i in range(n):\n"
+        "        acc += a[i] * b[i]\n"
+        "    return acc\n");
+
+    // Element-wise store into a third list, and a broadcast number.
+    run_analyzed_case("Element-wise stores",
+        "def apply_window(x: List[float], w: List[float], out: List[float], n: int):\n"
+        "    for i in range(n):\n"
+        "        out[i] = x[i] * w[i]\n"
+        "def clamp(xs: List[int], hi: int, n: int):\n"
+        "    for i in range(n):\n"
+        "        xs[i] = min(xs[i], hi)\n");
+
+    // Leading maps become vmaps; the filter after them stays fused.
+    run_analyzed_case("Map stages",
+        "def scale(xs: List[float], k: float):\n"
+        "    return xs |> map(x => x * k) |> map(x => 1.0 + x) |> filter(x => x > 2.0)\n");
+
+    // Not vectorized: the loop variable is read after the loop, a take
+    // would stop the pipeline early, and 'max' is shadowed.
+    run_analyzed_case("Loops and maps left alone",
+        "def last(xs: List[int]) -> int:\n"
+        "    x = 0\n"
+        "    total = 0\n"
+        "    for x in xs:\n"
+        "        total += x\n"
+        "    return total + x\n"
+        "def head(xs: List[int]):\n"
+        "    return xs |> map(x => x + 1) |> take(3)\n"
+        "def shadow(xs: List[int], max):\n"
+        "    return xs |> map(x => max(x, 0))\n");
+
+    printf("\n========== SSA FORM ==========\n");
+
+    // The two stores to 's' meet in a phi at the join; every load is
+    // gone, and so are the stores, since 's' is a raw int.
+    run_ssa_case("if/else merge",
+        "def sign(x):\n"
+        "    if x < 0:\n"
+        "        s = 0 - 1\n"
+        "    else:\n"
+        "        s = 1\n"
+        "    return s * x\n"
+        "def run():\n"
+        "    return sign(0 - 7) + sign(3)\n",
+        "run");
+
+    // Loop-carried 'total' and 'i' get phis in the loop header, which is
+    // the immediate dominator of both the body and the exit. 'n' is
+    // never reassigned, so its reads are the parameter itself.
+    run_ssa_case("while loop",
+        "def sum_to(n):\n"
+        "    total = 0\n"
+        "    i = 0\n"
+        "    while i < n:\n"
+        "        total += i * i % 7\n"
+        "        i += 1\n"
+        "    return total\n"
+        "def run():\n"
+        "    return sum_to(1000)\n",
+        "run");
+
+    // A boxed accumulator: its loads become the phi, but the stores stay
+    // because each one releases the previous total. 'item' keeps its
+    // store for the same reason, though nothing loads it any more.
+    run_ssa_case("for loop over a list",
+        "def total(items):\n"
+        "    sum = 0\n"
+        "    for item in items:\n"
+        "        sum += item.price\n"
+        "    return sum\n",
+        NULL);
+
+    // 'sq' is assigned only inside the loop, so the read after it may see
+    // the slot before any store: that load and sq's stores stay, while
+    // 'i' is fully promoted. Nested loop headers nest in the tree.
+    run_ssa_case("Possibly unassigned local and nested loops",
+        "def last_square(n):\n"
+        "    i = 0\n"
+        "    while i < n:\n"
+        "        sq = i * i\n"
+        "        i += 1\n"
+        "    return sq\n"
+        "def grid(n):\n"
+        "    count = 0\n"
+        "    i = 0\n"
+        "    while i < n:\n"
+        "        j = 0\n"
+        "        while j < i:\n"
+        "            count += 1\n"
+        "            j += 1\n"
+        "        i += 1\n"
+        "    return count\n"
+        "def run():\n"
+        "    return last_square(5) + grid(10)\n",
+        "run");
+
+    printf("\n========== REDUNDANCY ELIMINATION ==========\n");
+
+    // All three reads of account.balance are dominated by the first, with
+    // no store in between: they are the same value.
+    run_redundancy_case("Repeated attribute read",
+        "def fee(account, amount):\n"
+        "    if account.balance > amount:\n"
+        "        return account.balance - amount - account.balance / 100\n"
+        "    return 0\n",
+        NULL);
+
+    // Here the first read sits behind the short-circuit 'and', so it
+    // does not dominate the second one: both stay. Removing it would
+    // need partial redundancy elimination, which this pass does not do.
+    run_redundancy_case("Read behind a short circuit",
+        "def withdraw(account, amount):\n"
+        "    if amount > 0 and amount < account.balance and not account.frozen:\n"
+        "        account.balance = account.balance - amount\n"
+        "        return True\n"
+        "    return False\n",
+        NULL);
+
+    // touch() writes only 'balance', so the second account.owner is the
+    // first while the second account.balance is read again. After log(),
+    // which calls a builtin, nothing is known and every read stays.
+    run_redundancy_case("Calls and what they write",
+        "def touch(acc):\n"
+        "    acc.balance = 0\n"
+        "def log(acc):\n"
+        "    print(acc)\n"
+        "def audit(account):\n"
+        "    a = account.balance\n"
+        "    o = account.owner\n"
+        "    touch(account)\n"
+        "    b = account.balance\n"
+        "    p = account.owner\n"
+        "    log(account)\n"
+        "    q = account.owner\n"
+        "    return a + b + o + p + q\n",
+        NULL);
+
+    // a * b and a - b do not change in the loop and leave it, as do the
+    // loop's constants; the two copies of a * b become one.
+    run_redundancy_case("Invariant arithmetic",
+        "def poly(n, a, b):\n"
+        "    total = 0\n"
+        "    i = 0\n"
+        "    while i < n:\n"
+        "        total += a * b + i * (a - b) + a * b\n"
+        "        i += 1\n"
+        "    return total\n"
+        "def run():\n"
+        "    return poly(1000, 3, 4)\n",
+        "run");
+
+    // The loop condition reads account.limit in the header, the loop
+    // writes only 'count' and calls scale(), which writes nothing: the
+    // read moves before the loop. account.rate is read in the body, which
+    // may not run at all, so it stays. In drain() the loop writes the
+    // attribute it tests, and in watch() it calls log(): both stay.
+    run_redundancy_case("Invariant reads and loop stores",
+        "def scale(v, k):\n"
+        "    return v * k\n"
+        "def log(v):\n"
+        "    print(v)\n"
+        "def settle(account):\n"
+        "    total = 0\n"
+        "    i = 0\n"
+        "    while i < account.limit:\n"
+        "        total += scale(i, account.rate)\n"
+        "        account.count = i\n"
+        "        i += 1\n"
+        "    return total\n"
+        "def drain(account):\n"
+        "    while account.balance > 0:\n"
+        "        account.balance = account.balance - 1\n"
+        "    return account.balance\n"
+        "def watch(account):\n"
+        "    while account.limit > 0:\n"
+        "        log(account)\n",
+        NULL);
+
+    // Division can fail, so n / d is hoisted only because it is in the
+    // header; the inner loop's constants and 'i * n' move out one level.
+    run_redundancy_case("Nested loops",
+        "def grid(n, d):\n"
+        "    count = 0\n"
+        "    i = 0\n"
+        "    while i < n / d:\n"
+        "        j = 0\n"
+        "        while j < n:\n"
+        "            count += i * n + j\n"
+        "            j += 1\n"
+        "        i += 1\n"
+        "    return count\n"
+        "def run():\n"
+        "    return grid(20, 2)\n",
+        "run");
+
+    printf("\n========== INLINING ==========\n");
+
+    // The call names a module function; clamp's returns become stores to
+    // a result slot and jumps to the rest of the loop body.
+    run_inline_case("Small helpers",
+        "def clamp(x, lo, hi):\n"
+        "    if x < lo:\n"
+        "        return lo\n"
+        "    if x > hi:\n"
+        "        return hi\n"
+        "    return x\n"
+        "def run():\n"
+        "    t = 0\n"
+        "    i = 0\n"
+        "    while i < 100:\n"
+        "        t += clamp(i * 7 % 100, 10, 90)\n"
+        "        i += 1\n"
+        "    return t\n",
+        "run");
+
+    // sq is stored once, from a closure, before the loop: calls through
+    // it are calls to the lambda. apply() and twice() are inlined first,
+    // which makes the lambdas passed to them direct callees in turn, and
+    // the closures nothing calls any more are dropped.
+    run_inline_case("Lambdas in locals and higher-order calls",
+        "def apply(f, x):\n"
+        "    return f(x)\n"
+        "def twice(f, x):\n"
+        "    return f(f(x))\n"
+        "def run():\n"
+        "    total = 0\n"
+        "    i = 0\n"
+        "    sq = x => x * x\n"
+        "    while i < 100:\n"
+        "        total += sq(i) % 7 + apply(x => x * 3, i) % 5 + twice(y => y + 1, i)\n"
+        "        i += 1\n"
+        "    return total\n",
+        "run");
+
+    // The lambda reads 'step' from run(), which the interpreter's closures
+    // cannot carry: only the inlined copy, where the read is a local
+    // load again, can be evaluated.
+    run_inline_case("Lambda reading an enclosing local",
+        "def run():\n"
+        "    step = 3\n"
+        "    f = x => x + step\n"
+        "    t = 0\n"
+        "    i = 0\n"
+        "    while i < 100:\n"
+        "        t += f(i)\n"
+        "        i += 1\n"
+        "    return t\n",
+        "run");
+
+    // Each stage's lambda is called once per element inside the fused
+    // loop, through the closure made before it: all three are inlined.
+    run_inline_case("Pipeline stages",
+        "def evens(xs):\n"
+        "    return xs |> map(x => x * 3) |> filter(x => x % 2 == 0) |> reduce((a, b) => a + b, 0)\n",
+        NULL);
+
+    // fib calls itself and stays a call; a function too large for the
+    // budget is left alone too.
+    run_inline_case("Recursive and large callees",
+        "def fib(n):\n"
+        "    if n < 2:\n"
+        "        return n\n"
+        "    return fib(n - 1) + fib(n - 2)\n"
+        "def big(a, b):\n"
+        "    c = a * b + a - b\n"
+        "    d = c * c - a * b + 7\n"
+        "    e = d % 13 + c % 11 + a * 3\n"
+        "    f = e * e + d * c - b\n"
+        "    return f % 1000 + e % 100 + d % 10\n"
+        "def run():\n"
+        "    return fib(10) + big(3, 4)\n",
+        "run");
+
+    printf("\n========== CLOSURE CONVERSION ==========\n");
+
+    // 'step' and 'base' are only read: the closure record copies them
+    // (MAKE_CLOSURE's operands) and the lambda reads them by index
+    // (LOAD_CAPTURE). Run as calls, and inlined, where each read becomes
+    // the value the record was made from.
+    run_closure_case("Read-only captures",
+        "def make(base):\n"
+        "    step = 3\n"
+        "    return x => x * step + base\n"
+        "def run():\n"
+        "    f = make(10)\n"
+        "    t = 0\n"
+        "    i = 0\n"
+        "    while i < 100:\n"
+        "        t += f(i) % 7\n"
+        "        i += 1\n"
+        "    return t\n",
+        "run");
+
+    // The same read from a closure the caller calls itself: inlined, the
+    // capture is the local's value and the closure goes away.
+    run_closure_case("Read-only capture, inlined",
+        "def run():\n"
+        "    step = 3\n"
+        "    f = x => x + step\n"
+        "    t = 0\n"
+        "    i = 0\n"
+        "    while i < 100:\n"
+        "        t += f(i)\n"
+        "        i += 1\n"
+        "    return t\n",
+        "run");
+
+    // 'count' is rebound after the lambda is made, so both share a cell
+    // (MAKE_CELL in the prologue; the closure gets the cell, '; cell',
+    // and reads through it, '; deref'). The lambda sees each new value.
+    run_closure_case("Mutated capture in a cell",
+        "def run():\n"
+        "    count = 0\n"
+        "    seen = () => count * 10\n"
+        "    t = 0\n"
+        "    while count < 5:\n"
+        "        count += 1\n"
+        "        t += seen()\n"
+        "    return t\n",
+        "run");
+
+    // The inner lambda's 'n' belongs to run(): the outer lambda captures
+    // it too, only to hand it on when it makes the inner one.
+    run_closure_case("Captures passed through a closure",
+        "def run():\n"
+        "    n = 4\n"
+        "    outer = x => (y => x + y + n)\n"
+        "    add = outer(1)\n"
+        "    return add(2)\n",
+        "run");
+
+    // A nested def that calls itself reads its own name as the running
+    // closure, not through a cell that would hold it in a cycle: nothing
+    // is left once run() returns.
+    run_closure_case("Recursive nested def",
+        "def run():\n"
+        "    def fact(n):\n"
+        "        if n < 2:\n"
+        "            return 1\n"
+        "        return n * fact(n - 1)\n"
+        "    return fact(6)\n",
+        "run");
+
+    // A lambda inside it copies the name from the def, which hands over
+    // the running closure.
+    run_closure_case("Recursion through an inner lambda",
+        "def run():\n"
+        "    def count(k):\n"
+        "        if k == 0:\n"
+        "            return 0\n"
+        "        step = () => count(k - 1)\n"
+        "        return 1 + step()\n"
+        "    return count(5)\n",
+        "run");
+
+    printf("\n========== REDUNDANCY BENCHMARKS ==========\n");
+    printf("  Instructions after SSA construction, static and estimated executions\n"
+           "  with %d iterations per loop, before -> after the pass.\n\n",
+           IR_LOOP_TRIP_ESTIMATE);
+    printf("  %-22s %-16s %-22s %s\n", "Program", "static", "executed", "saved");
+
+    run_redundancy_benchmark("withdraw",
+        "def withdraw(account, amount):\n"
+        "    if amount > 0 and amount < account.balance and not account.frozen:\n"
+        "        account.balance = account.balance - amount\n"
+        "        return True\n"
+        "    return False\n");
+
+    run_redundancy_benchmark("polynomial",
+        "def poly(n, a, b):\n"
+        "    total = 0\n"
+        "    i = 0\n"
+        "    while i < n:\n"
+        "        total += a * b + i * (a - b) + a * b\n"
+        "        i += 1\n"
+        "    return total\n"
+        "def run():\n"
+        "    return poly(1000, 3, 4)\n");
+
+    run_redundancy_benchmark("matrix multiply",
+        "def matmul(a, b, n):\n"
+        "    c = []\n"
+        "    i = 0\n"
+        "    while i < n:\n"
+        "        row = []\n"
+        "        j = 0\n"
+        "        while j < n:\n"
+        "            s = 0\n"
+        "            k = 0\n"
+        "            while k < n:\n"
+        "                s += a[i][k] * b[k][j]\n"
+        "                k += 1\n"
+        "            row.append(s)\n"
+        "            j += 1\n"
+        "        c.append(row)\n"
+        "        i += 1\n"
+        "    return c\n");
+
+    run_redundancy_benchmark("account settlement",
+        "def scale(v, k):\n"
+        "    return v * k\n"
+        "def settle(account):\n"
+        "    total = 0\n"
+        "    i = 0\n"
+        "    while i < account.limit:\n"
+        "        total += scale(i, account.rate)\n"
+        "        account.count = i\n"
+        "        i += 1\n"
+        "    return total\n");
+
+    run_redundancy_benchmark("nested counts",
+        "def grid(n, d):\n"
+        "    count = 0\n"
+        "    i = 0\n"
+        "    while i < n / d:\n"
+        "        j = 0\n"
+        "        while j < n:\n"
+        "            count += i * n + j\n"
+        "            j += 1\n"
+        "        i += 1\n"
+        "    return count\n"
+        "def run():\n"
+        "    return grid(20, 2)\n");
+
+    printf("\n========== REFCOUNT BENCHMARKS ==========\n");
+    printf("  Static refcount ops, and estimated executions with %d iterations\n"
+           "  per loop, before -> after elision.\n\n", IR_LOOP_TRIP_ESTIMATE);
+    printf("  %-22s %-16s %-22s %s\n", "Program", "static", "executed", "saved");
+
+    run_refcount_benchmark("order totals",
+        "def line_total(line):\n"
+        "    return line.price * line.qty\n"
+        "def order_total(order):\n"
+        "    total = 0\n"
+        "    for line in order.lines:\n"
+        "        total += line_total(line)\n"
+        "    return total\n"
+        "def all_orders(orders):\n"
+        "    grand = 0\n"
+        "    for order in orders:\n"
+        "        if order.open:\n"
+        "            grand += order_total(order)\n"
+        "    return grand\n");
+
+    run_refcount_benchmark("linked list",
+        "class Node:\n"
+        "    def link(self, owned next):\n"
+        "        self.next = next\n"
+        "def build(n):\n"
+        "    head = None\n"
+        "    i = 0\n"
+        "    while i < n:\n"
+        "        node = Node()\n"
+        "        node.link(move head)\n"
+        "        head = node\n"
+        "        i += 1\n"
+        "    return head\n"
+        "def length(head):\n"
+        "    count = 0\n"
+        "    node = head\n"
+        "    while node:\n"
+        "        count += 1\n"
+        "        node = node.next\n"
+        "    return count\n");
+
+    run_refcount_benchmark("matrix multiply",
+        "def matmul(a, b, n):\n"
+        "    c = []\n"
+        "    i = 0\n"
+        "    while i < n:\n"
+        "        row = []\n"
+        "        j = 0\n"
+        "        while j < n:\n"
+        "            s = 0\n"
+        "            k = 0\n"
+        "            while k < n:\n"
+        "                s += a[i][k] * b[k][j]\n"
+        "                k += 1\n"
+        "            row.append(s)\n"
+        "            j += 1\n"
+        "        c.append(row)\n"
+        "        i += 1\n"
+        "    return c\n");
+
+    run_refcount_benchmark("word count",
+        "def count_words(lines):\n"
+        "    counts = {}\n"
+        "    for line in lines:\n"
+        "        for word in line.split(\" \"):\n"
+        "            w = word.lower()\n"
+        "            if w in counts:\n"
+        "                counts[w] += 1\n"
+        "            else:\n"
+        "                counts[w] = 1\n"
+        "    return counts\n");
+
+    run_refcount_benchmark("pipeline",
+        "def clean(rows):\n"
+        "    out = []\n"
+        "    for r in rows:\n"
+        "        if r.valid:\n"
+        "            out.append(r)\n"
+        "    return out\n"
+        "def summarize(owned rows):\n"
+        "    return rows.count\n"
+        "def report(rows):\n"
+        "    cleaned = rows |> clean\n"
+        "    return summarize(move cleaned)\n");
+
+    printf("\n========== DONE ==========\n");
+    return 0;
+}
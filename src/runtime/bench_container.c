@@ -0,0 +1,188 @@
+// bench_container.c - Boxed vs typed container layouts
+//
+// Run with `make bench`. Each 10M-element list is built presized, then
+// summed the way code of each kind would: a boxed list through the
+// generic value_add (tag checks, and a boxed result whenever a partial
+// sum leaves the 48-bit immediate range), a typed list as a plain loop
+// over its int64_t / double array. Memory is what the memory manager
+// holds for the list once built. NaN-boxing already keeps small ints and
+// floats in 8 bytes, so typed layouts save memory only on ints past 48
+// bits, which a boxed list stores as separate heap objects.
+//
+// The dict benchmark counts 10M words over 100k distinct keys in a
+// Dict[str, int], updating each count in place through dict_lookup.
+#include "container.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LENGTH 10000000
+#define DISTINCT_WORDS 100000
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+typedef enum { SMALL_INTS, LARGE_INTS, FLOATS } Elements;
+
+// Element i. Large ints alternate in sign so their sum stays in range.
+static int64_t int_element(Elements kind, int64_t i) {
+    if (kind == SMALL_INTS) return i % 1000;
+    int64_t x = ((int64_t)1 << 50) + i;
+    return (i & 1) ? -x : x;
+}
+
+static double float_element(int64_t i) {
+    return (double)(i % 1000) * 0.25;
+}
+
+static Value build(MemoryManager* mm, Elements kind, ContainerLayout layout) {
+    Value list = list_create(mm, layout, LENGTH);
+    if (value_is_none(list)) return list;
+    for (int64_t i = 0; i < LENGTH; i++) {
+        bool ok = kind == FLOATS ? list_append_float(mm, list, float_element(i))
+                                 : list_append_int(mm, list, int_element(kind, i));
+        if (!ok) {
+            value_release(mm, list);
+            return value_none();
+        }
+    }
+    return list;
+}
+
+// Sum as untyped code would: every element is a Value of unknown kind
+static Value sum_boxed(MemoryManager* mm, Value list, Elements kind) {
+    const Value* items = (const Value*)list_data(list)->items;
+    size_t n = list_length(list);
+    Value acc = kind == FLOATS ? value_float(0.0) : value_small_int(0);
+    for (size_t i = 0; i < n; i++) {
+        Value next = value_add(mm, acc, items[i]);
+        value_release(mm, acc);
+        acc = next;
+    }
+    return acc;
+}
+
+static Value sum_typed(MemoryManager* mm, Value list, Elements kind) {
+    size_t n = list_length(list);
+    if (kind == FLOATS) {
+        const double* xs = list_floats(list);
+        double acc = 0.0;
+        for (size_t i = 0; i < n; i++) acc += xs[i];
+        return value_float(acc);
+    }
+    const int64_t* xs = list_ints(list);
+    int64_t acc = 0;
+    for (size_t i = 0; i < n; i++) acc += xs[i];
+    return value_int(mm, acc);
+}
+
+// One row: build, measure, sum. Returns the sum (owned) for comparison.
+static Value run_list(MemoryManager* mm, const char* label, Elements kind,
+                      ContainerLayout layout, double* sum_seconds) {
+    size_t before = mm_get_allocated_bytes(mm);
+    double start = now_seconds();
+    Value list = build(mm, kind, layout);
+    double build_time = now_seconds() - start;
+    if (value_is_none(list)) {
+        printf("  %-30s out of memory\n", label);
+        return list;
+    }
+    size_t bytes = mm_get_allocated_bytes(mm) - before;
+
+    start = now_seconds();
+    Value sum = layout == LAYOUT_BOXED ? sum_boxed(mm, list, kind) : sum_typed(mm, list, kind);
+    *sum_seconds = now_seconds() - start;
+
+    printf("  %-30s %9.1f ms %9.1f MB %9.1f B %9.1f ms %9.0f M/s\n", label,
+           build_time * 1e3, bytes / 1e6, (double)bytes / LENGTH, *sum_seconds * 1e3,
+           LENGTH / *sum_seconds / 1e6);
+    value_release(mm, list);
+    return sum;
+}
+
+static void compare_lists(MemoryManager* mm, const char* type, Elements kind,
+                          ContainerLayout typed) {
+    char label[64];
+    double boxed_time, typed_time;
+    snprintf(label, sizeof(label), "%s, boxed", type);
+    Value a = run_list(mm, label, kind, LAYOUT_BOXED, &boxed_time);
+    snprintf(label, sizeof(label), "%s, %s", type, container_layout_to_string(typed));
+    Value b = run_list(mm, label, kind, typed, &typed_time);
+    if (!value_equals(a, b)) {
+        printf("  sums disagree: ");
+        value_print(a);
+        printf(" vs ");
+        value_print(b);
+        printf("\n");
+    } else {
+        printf("  %-30s typed sum %.1fx faster\n", "", boxed_time / typed_time);
+    }
+    value_release(mm, a);
+    value_release(mm, b);
+}
+
+// 10M increments over DISTINCT_WORDS keys, in place
+static void count_words(MemoryManager* mm, const Value* words, ContainerLayout layout) {
+    Value counts = dict_create(mm, layout, 0);
+    double start = now_seconds();
+    for (int64_t i = 0; i < LENGTH; i++) {
+        Value w = words[(i * 7919) % DISTINCT_WORDS];
+        void* slot = dict_lookup(counts, w);
+        if (!slot) {
+            value_retain(w);
+            dict_set(mm, counts, w, value_small_int(1));
+        } else if (layout == LAYOUT_INT) {
+            *(int64_t*)slot += 1;
+        } else {
+            Value* v = (Value*)slot;
+            Value next = value_add(mm, *v, value_small_int(1));
+            value_release(mm, *v);
+            *v = next;
+        }
+    }
+    double seconds = now_seconds() - start;
+
+    Value total = value_small_int(0);
+    for (size_t i = 0; i < dict_length(counts); i++) {
+        Value c = dict_value_at(mm, counts, i);
+        total = value_add(mm, total, c);
+        value_release(mm, c);
+    }
+    printf("  %-30s %9.1f ms %9.1f M/s   %zu keys, %lld counted\n",
+           layout == LAYOUT_INT ? "Dict[str, int], int" : "Dict[str, int], boxed",
+           seconds * 1e3, LENGTH / seconds / 1e6, dict_length(counts),
+           (long long)value_as_int(total));
+    value_release(mm, counts);
+}
+
+int main(void) {
+    printf("=== RHelix Container Layout Benchmarks ===\n\n");
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+
+    printf("%d-element lists\n", LENGTH);
+    printf("  %-30s %12s %12s %11s %12s %12s\n", "", "build", "memory", "per elem",
+           "sum", "sum rate");
+    compare_lists(mm, "List[int] (small)", SMALL_INTS, LAYOUT_INT);
+    compare_lists(mm, "List[int] (> 48 bits)", LARGE_INTS, LAYOUT_INT);
+    compare_lists(mm, "List[float]", FLOATS, LAYOUT_FLOAT);
+    printf("\n");
+
+    printf("Word count: %d increments over %d keys\n", LENGTH, DISTINCT_WORDS);
+    Value* words = (Value*)malloc(sizeof(Value) * DISTINCT_WORDS);
+    for (int i = 0; i < DISTINCT_WORDS; i++) {
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), "word%d", i);
+        words[i] = value_string(mm, buf, (size_t)n);
+    }
+    count_words(mm, words, LAYOUT_BOXED);
+    count_words(mm, words, LAYOUT_INT);
+    for (int i = 0; i < DISTINCT_WORDS; i++) value_release(mm, words[i]);
+    free(words);
+    printf("\n");
+
+    mm_destroy(mm);
+    return 0;
+}
@@ -0,0 +1,344 @@
+// bench_memory.c - Microbenchmarks for the memory manager
+//
+// Run with `make bench`. Numbers are wall-clock on whatever machine runs
+// them; they are meant for before/after comparisons, not absolutes.
+#include "memory_manager.h"
+#include "value.h"
+#include "profiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// ============================================================
+// Weak-heavy tree traversal
+// ============================================================
+//
+// A complete binary tree whose nodes point up to their parent, walked
+// from every leaf to the root. The weak variant keeps the parent link as
+// a WeakRef (no cycle, nothing to break by hand); the strong variant
+// retains the parent and has to be torn down explicitly.
+
+typedef struct {
+    Object* left;
+    Object* right;
+    WeakRef* weak_parent;
+    Object* strong_parent;
+} TreeNode;
+
+#define TREE_DEPTH 20
+#define TREE_NODES ((1u << TREE_DEPTH) - 1)
+
+static TreeNode* node_of(Object* obj) {
+    return (TreeNode*)MM_OBJECT_DATA(obj);
+}
+
+// Nodes are stored in heap order: children of i are 2i+1 and 2i+2.
+static Object** build_tree(MemoryManager* mm, bool weak) {
+    Object** nodes = (Object**)malloc(sizeof(Object*) * TREE_NODES);
+    for (unsigned i = 0; i < TREE_NODES; i++) {
+        nodes[i] = mm_alloc(mm, sizeof(TreeNode));
+    }
+    for (unsigned i = 0; i < TREE_NODES; i++) {
+        TreeNode* n = node_of(nodes[i]);
+        if (2 * i + 2 < TREE_NODES) {
+            n->left = nodes[2 * i + 1];
+            n->right = nodes[2 * i + 2];
+        }
+        if (i == 0) continue;
+        Object* parent = nodes[(i - 1) / 2];
+        if (weak) {
+            n->weak_parent = mm_weak_create(mm, parent);
+        } else {
+            mm_retain(parent);
+            n->strong_parent = parent;
+        }
+    }
+    return nodes;
+}
+
+static unsigned long walk_to_root(Object** nodes, bool weak) {
+    unsigned long steps = 0;
+    for (unsigned i = TREE_NODES / 2; i < TREE_NODES; i++) {
+        Object* cur = nodes[i];
+        while (cur) {
+            TreeNode* n = node_of(cur);
+            cur = weak ? mm_weak_get(n->weak_parent) : n->strong_parent;
+            steps++;
+        }
+    }
+    return steps;
+}
+
+static void bench_weak_tree(void) {
+    printf("Weak-heavy tree traversal (%u nodes, leaf-to-root walks)\n", TREE_NODES);
+    printf("  %-8s %12s %12s %14s %12s\n",
+           "parent", "build ms", "walk ms", "ns/step", "teardown ms");
+
+    for (int variant = 0; variant < 2; variant++) {
+        bool weak = variant == 1;
+        MemoryManager* mm = mm_create((size_t)4 << 30);
+
+        double t0 = now_seconds();
+        Object** nodes = build_tree(mm, weak);
+        double t1 = now_seconds();
+        unsigned long steps = walk_to_root(nodes, weak);
+        double t2 = now_seconds();
+        double walk = t2 - t1;
+
+        size_t table_bytes = mm->weak_table.capacity * sizeof(WeakSlot);
+        size_t handle_bytes = mm->weak_ref_count * sizeof(WeakRef);
+
+        // Handles outlive the nodes that hold them during teardown
+        WeakRef** handles = (WeakRef**)malloc(sizeof(WeakRef*) * TREE_NODES);
+        for (unsigned i = 0; i < TREE_NODES; i++) handles[i] = node_of(nodes[i])->weak_parent;
+        t2 = now_seconds();
+
+        // Teardown root first. Weak: freeing a node clears its children's
+        // links through the side table. Strong: every child pins its parent,
+        // so the links must be dropped before anything can be freed.
+        if (weak) {
+            for (unsigned i = 0; i < TREE_NODES; i++) mm_release(mm, nodes[i]);
+            // Every parent was freed before its children, so all handles
+            // have been cleared and just need freeing.
+            for (unsigned i = 1; i < TREE_NODES; i++) mm_weak_destroy(mm, handles[i]);
+        } else {
+            for (unsigned i = 1; i < TREE_NODES; i++) {
+                mm_release(mm, node_of(nodes[i])->strong_parent);
+            }
+            for (unsigned i = 0; i < TREE_NODES; i++) mm_release(mm, nodes[i]);
+        }
+        double t3 = now_seconds();
+
+        printf("  %-8s %12.1f %12.1f %14.2f %12.1f\n", weak ? "weak" : "strong",
+               (t1 - t0) * 1e3, walk * 1e3, walk * 1e9 / (double)steps,
+               (t3 - t2) * 1e3);
+        if (weak) {
+            printf("  weak side table: %zu bytes of slots + %zu bytes of handles "
+                   "(%.1f bytes/node); Object header %zu bytes\n",
+                   table_bytes, handle_bytes,
+                   (double)(table_bytes + handle_bytes) / TREE_NODES, sizeof(Object));
+        }
+        free(handles);
+        free(nodes);
+        mm_destroy(mm);
+    }
+    printf("\n");
+}
+
+// ============================================================
+// List of boxed ints
+// ============================================================
+//
+// A list object holding pointers to N individually boxed ints: the
+// shape of `[i for i in range(n)]`. Overhead is everything allocated
+// beyond the 8-byte payloads and the list's pointer array.
+
+#define LIST_LENGTH 1000000
+
+// The header layout before size classes: 32-bit refcount, 16-bit flags,
+// 16-bit size and a next pointer, each object its own calloc block.
+typedef struct {
+    uint32_t ref_count;
+    uint16_t flags;
+    uint16_t size;
+    void* next;
+} LegacyObject;
+
+static void bench_int_list(void) {
+    printf("List of %d boxed ints\n", LIST_LENGTH);
+    printf("  %-28s %10s %10s %16s\n", "allocator", "build ms", "free ms", "overhead B/int");
+    
+    // Legacy layout for comparison. malloc's own chunk header (8 bytes
+    // or more with glibc) is not visible from here and is left out.
+    double t0 = now_seconds();
+    LegacyObject** legacy = (LegacyObject**)calloc(LIST_LENGTH, sizeof(LegacyObject*));
+    for (long i = 0; i < LIST_LENGTH; i++) {
+        legacy[i] = (LegacyObject*)calloc(1, sizeof(LegacyObject) + sizeof(long));
+        legacy[i]->ref_count = 1;
+        *(long*)(legacy[i] + 1) = i;
+    }
+    double t1 = now_seconds();
+    for (long i = 0; i < LIST_LENGTH; i++) free(legacy[i]);
+    free(legacy);
+    double t2 = now_seconds();
+    char label[32];
+    snprintf(label, sizeof(label), "calloc + %zu-byte header", sizeof(LegacyObject));
+    printf("  %-28s %10.1f %10.1f %16.1f\n", label,
+           (t1 - t0) * 1e3, (t2 - t1) * 1e3, (double)sizeof(LegacyObject));
+    
+    MemoryManager* mm = mm_create((size_t)4 << 30);
+    t0 = now_seconds();
+    Object* list = mm_alloc_array(mm, LIST_LENGTH, sizeof(Object*), MM_DEFAULT_ALIGN);
+    Object** items = (Object**)MM_OBJECT_DATA(list);
+    for (long i = 0; i < LIST_LENGTH; i++) {
+        items[i] = mm_alloc(mm, sizeof(long));
+        *(long*)MM_OBJECT_DATA(items[i]) = i;
+    }
+    t1 = now_seconds();
+    size_t payload = (size_t)LIST_LENGTH * (sizeof(long) + sizeof(Object*));
+    size_t charged = mm_get_allocated_bytes(mm);
+    size_t slab_bytes = mm->slab_count * (size_t)MM_SLAB_SIZE;
+    size_t list_bytes = charged - (size_t)LIST_LENGTH * 16;
+    for (long i = 0; i < LIST_LENGTH; i++) mm_release(mm, items[i]);
+    mm_release(mm, list);
+    t2 = now_seconds();
+    snprintf(label, sizeof(label), "mm_alloc + %zu-byte header", sizeof(Object));
+    printf("  %-28s %10.1f %10.1f %16.1f\n", label,
+           (t1 - t0) * 1e3, (t2 - t1) * 1e3,
+           (double)(charged - payload) / LIST_LENGTH);
+    printf("  with slab slack: %.1f B/int (%zu slabs of %d KB)\n",
+           (double)(slab_bytes + list_bytes - payload) / LIST_LENGTH,
+           mm->slab_count, MM_SLAB_SIZE / 1024);
+    mm_destroy(mm);
+    printf("\n");
+}
+
+// ============================================================
+// Arithmetic loops: boxed vs immediate values
+// ============================================================
+//
+//     total = 0                      x = 0.0
+//     for i in range(n):             for i in range(n):
+//         total = total + i              x = x * 0.5 + 1.0
+//
+// "boxed" allocates every int and float result as a heap object the way
+// a uniform Object* representation would; "immediate" uses NaN-boxed
+// Values, which only touch the heap for ints past 48 bits.
+
+#define LOOP_ITERATIONS 10000000L
+
+static Object* box_int(MemoryManager* mm, int64_t i) {
+    Object* obj = mm_alloc(mm, sizeof(int64_t));
+    *(int64_t*)MM_OBJECT_DATA(obj) = i;
+    return obj;
+}
+
+static Object* box_float(MemoryManager* mm, double d) {
+    Object* obj = mm_alloc(mm, sizeof(double));
+    *(double*)MM_OBJECT_DATA(obj) = d;
+    return obj;
+}
+
+#define UNBOX(type, obj) (*(type*)MM_OBJECT_DATA(obj))
+
+static void report_loop(const char* label, double seconds, MemoryManager* mm) {
+    printf("  %-18s %10.1f %10.2f %14zu\n", label, seconds * 1e3,
+           seconds * 1e9 / LOOP_ITERATIONS, mm->total_allocated);
+}
+
+static void bench_value_loops(void) {
+    printf("Arithmetic loops (%ld iterations)\n", LOOP_ITERATIONS);
+    printf("  %-18s %10s %10s %14s\n", "loop", "ms", "ns/iter", "heap bytes");
+    
+    // Integer sum, boxed
+    MemoryManager* mm = mm_create((size_t)1 << 30);
+    double t0 = now_seconds();
+    Object* total = box_int(mm, 0);
+    for (long i = 0; i < LOOP_ITERATIONS; i++) {
+        Object* boxed_i = box_int(mm, i);
+        Object* sum = box_int(mm, UNBOX(int64_t, total) + UNBOX(int64_t, boxed_i));
+        mm_release(mm, boxed_i);
+        mm_release(mm, total);
+        total = sum;
+    }
+    int64_t boxed_sum = UNBOX(int64_t, total);
+    mm_release(mm, total);
+    report_loop("int sum, boxed", now_seconds() - t0, mm);
+    mm_destroy(mm);
+    
+    // Integer sum, immediate
+    mm = mm_create((size_t)1 << 30);
+    t0 = now_seconds();
+    Value vtotal = value_int(mm, 0);
+    for (long i = 0; i < LOOP_ITERATIONS; i++) {
+        Value next = value_add(mm, vtotal, value_int(mm, i));
+        value_release(mm, vtotal);
+        vtotal = next;
+    }
+    report_loop("int sum, immediate", now_seconds() - t0, mm);
+    if (value_as_int(vtotal) != boxed_sum) printf("  MISMATCH in int sums\n");
+    value_release(mm, vtotal);
+    mm_destroy(mm);
+    
+    // Float recurrence, boxed
+    mm = mm_create((size_t)1 << 30);
+    t0 = now_seconds();
+    Object* half = box_float(mm, 0.5);
+    Object* one = box_float(mm, 1.0);
+    Object* x = box_float(mm, 0.0);
+    for (long i = 0; i < LOOP_ITERATIONS; i++) {
+        Object* scaled = box_float(mm, UNBOX(double, x) * UNBOX(double, half));
+        Object* next = box_float(mm, UNBOX(double, scaled) + UNBOX(double, one));
+        mm_release(mm, scaled);
+        mm_release(mm, x);
+        x = next;
+    }
+    double boxed_x = UNBOX(double, x);
+    mm_release(mm, x);
+    mm_release(mm, one);
+    mm_release(mm, half);
+    report_loop("float, boxed", now_seconds() - t0, mm);
+    mm_destroy(mm);
+    
+    // Float recurrence, immediate
+    mm = mm_create((size_t)1 << 30);
+    t0 = now_seconds();
+    Value vhalf = value_float(0.5), vone = value_float(1.0), vx = value_float(0.0);
+    for (long i = 0; i < LOOP_ITERATIONS; i++) {
+        vx = value_add(mm, value_mul(mm, vx, vhalf), vone);
+    }
+    report_loop("float, immediate", now_seconds() - t0, mm);
+    if (value_as_float(vx) != boxed_x) printf("  MISMATCH in float results\n");
+    mm_destroy(mm);
+    
+    printf("\n");
+}
+
+// ============================================================
+// Allocation profiler overhead
+// ============================================================
+
+#define PROFILE_ALLOCS 10000000L
+
+static const MMSourceLoc bench_loc = { "churn", "bench.rh", 1, 1 };
+
+static double churn(MemoryManager* mm) {
+    double t0 = now_seconds();
+    MM_PROFILE_ENTER(mm, &bench_loc);
+    for (long i = 0; i < PROFILE_ALLOCS; i++) mm_release(mm, mm_alloc(mm, 16));
+    MM_PROFILE_EXIT(mm);
+    return now_seconds() - t0;
+}
+
+static void bench_profiler(void) {
+    printf("Allocation profiler (%ld alloc/free pairs of 16 bytes)\n", PROFILE_ALLOCS);
+    printf("  %-28s %10s %10s\n", "profiler", "ms", "ns/alloc");
+    
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    double off = churn(mm);
+    printf("  %-28s %10.1f %10.2f\n", "disabled", off * 1e3, off * 1e9 / PROFILE_ALLOCS);
+    
+    mm_profile_start(mm, MM_PROFILE_DEFAULT_RATE);
+    double on = churn(mm);
+    printf("  %-28s %10.1f %10.2f\n", "sampling every ~512 KB", on * 1e3,
+           on * 1e9 / PROFILE_ALLOCS);
+    mm_profile_stop(mm);
+    mm_destroy(mm);
+    printf("\n");
+}
+
+int main(void) {
+    printf("=== RHelix Memory Manager Benchmarks ===\n\n");
+    bench_weak_tree();
+    bench_int_list();
+    bench_value_loops();
+    bench_profiler();
+    return 0;
+}
@@ -0,0 +1,303 @@
+// bench_scheduler.c - Scaling benchmarks for the work-stealing scheduler
+//
+// Run with `make bench`. Each workload runs on pools of 1..N workers,
+// where N is the online CPU count (at least 2, so stealing is exercised
+// even on a single-core machine). Speedup is relative to the one-worker
+// pool, which pays the same task overhead as the others.
+#include "scheduler.h"
+#include "value.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static Scheduler* sched;
+
+static int max_workers(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 2 ? (int)cpus : 2;
+}
+
+static void print_header(void) {
+    printf("  %-8s %10s %9s %12s %10s %14s\n",
+           "workers", "ms", "speedup", "tasks", "steals", "steal attempts");
+}
+
+static void print_row(int workers, double seconds, double base) {
+    SchedStats stats;
+    sched_get_stats(sched, &stats);
+    printf("  %-8d %10.1f %8.2fx %12lu %10lu %14lu\n", workers, seconds * 1e3,
+           base / seconds, stats.tasks_run, stats.steals, stats.steal_attempts);
+}
+
+// ============================================================
+// Parallel fib
+// ============================================================
+//
+// The shape of a recursive `@parallel def fib(n)`: spawn one call, run
+// the other inline, join. Below the cutoff the recursion is serial so
+// tasks stay coarse enough to amortize a spawn.
+
+#define FIB_N 36
+#define FIB_CUTOFF 20
+
+typedef struct {
+    int n;
+    long result;
+} FibArgs;
+
+static long fib_serial(int n) {
+    return n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2);
+}
+
+static void fib_task(void* p) {
+    FibArgs* a = (FibArgs*)p;
+    if (a->n < FIB_CUTOFF) {
+        a->result = fib_serial(a->n);
+        return;
+    }
+    FibArgs left = { a->n - 1, 0 };
+    FibArgs right = { a->n - 2, 0 };
+    TaskGroup group;
+    sched_group_init(&group);
+    sched_spawn(sched, &group, fib_task, &left);
+    fib_task(&right);
+    sched_wait(sched, &group);
+    a->result = left.result + right.result;
+}
+
+static void bench_fib(void) {
+    printf("Parallel fib(%d), serial below %d\n", FIB_N, FIB_CUTOFF);
+    double t0 = now_seconds();
+    long expected = fib_serial(FIB_N);
+    printf("  serial baseline %.1f ms\n", (now_seconds() - t0) * 1e3);
+    print_header();
+
+    double base = 0;
+    for (int workers = 1; workers <= max_workers(); workers++) {
+        sched = sched_create(workers);
+        FibArgs args = { FIB_N, 0 };
+        double start = now_seconds();
+        sched_run(sched, fib_task, &args);
+        double seconds = now_seconds() - start;
+        if (args.result != expected) {
+            printf("  wrong result %ld\n", args.result);
+            exit(1);
+        }
+        if (workers == 1) base = seconds;
+        print_row(workers, seconds, base);
+        sched_destroy(sched);
+    }
+    printf("\n");
+}
+
+// ============================================================
+// Parallel map over a large list
+// ============================================================
+//
+// `[collatz_steps(x) for x in xs]` with xs a list of immediate ints.
+// Per-element cost varies a lot, so static partitioning would leave
+// workers idle; range splitting plus stealing evens it out.
+
+#define MAP_LENGTH 2000000
+
+typedef struct {
+    const Value* in;
+    Value* out;
+} MapArgs;
+
+static int64_t collatz_steps(int64_t x) {
+    int64_t steps = 0;
+    while (x > 1) {
+        x = (x & 1) ? 3 * x + 1 : x / 2;
+        steps++;
+    }
+    return steps;
+}
+
+static void map_range(long lo, long hi, void* p) {
+    MapArgs* m = (MapArgs*)p;
+    for (long i = lo; i < hi; i++) {
+        m->out[i] = value_small_int(collatz_steps(value_as_small_int(m->in[i])));
+    }
+}
+
+static void bench_map(void) {
+    printf("Parallel map over a %d-element list\n", MAP_LENGTH);
+    Value* in = (Value*)malloc(sizeof(Value) * MAP_LENGTH);
+    Value* out = (Value*)malloc(sizeof(Value) * MAP_LENGTH);
+    Value* check = (Value*)malloc(sizeof(Value) * MAP_LENGTH);
+    for (long i = 0; i < MAP_LENGTH; i++) in[i] = value_small_int(i + 1);
+
+    MapArgs serial = { in, check };
+    double t0 = now_seconds();
+    map_range(0, MAP_LENGTH, &serial);
+    printf("  serial baseline %.1f ms\n", (now_seconds() - t0) * 1e3);
+    print_header();
+
+    double base = 0;
+    for (int workers = 1; workers <= max_workers(); workers++) {
+        sched = sched_create(workers);
+        MapArgs args = { in, out };
+        double start = now_seconds();
+        sched_parallel_for(sched, 0, MAP_LENGTH, 0, map_range, &args);
+        double seconds = now_seconds() - start;
+        for (long i = 0; i < MAP_LENGTH; i++) {
+            if (out[i].bits != check[i].bits) {
+                printf("  mismatch at %ld\n", i);
+                exit(1);
+            }
+        }
+        if (workers == 1) base = seconds;
+        print_row(workers, seconds, base);
+        sched_destroy(sched);
+    }
+    free(check);
+    free(out);
+    free(in);
+    printf("\n");
+}
+
+// ============================================================
+// Parallel reductions
+// ============================================================
+//
+// What a chunked `@parallel` for loop turns into: each chunk starts its
+// accumulator at the identity and partial results are combined in
+// iteration order. Sum: `total += x * x`. Filter: `if keep(x):
+// out.append(x)`, where chunk lists are concatenated.
+
+#define REDUCE_LENGTH 10000000
+
+static void sum_init(void* acc, void* arg) {
+    (void)arg;
+    *(int64_t*)acc = 0;
+}
+
+static void sum_combine(void* into, const void* from, void* arg) {
+    (void)arg;
+    *(int64_t*)into += *(const int64_t*)from;
+}
+
+static void sum_squares_range(long lo, long hi, void* acc, void* arg) {
+    const Value* in = (const Value*)arg;
+    int64_t total = *(int64_t*)acc;
+    for (long i = lo; i < hi; i++) {
+        int64_t x = value_as_small_int(in[i]);
+        total += x * x % 1000003;
+    }
+    *(int64_t*)acc = total;
+}
+
+typedef struct {
+    Value* items;
+    long count;
+    long capacity;
+} ValueList;
+
+static void list_init(void* acc, void* arg) {
+    (void)arg;
+    ValueList* l = (ValueList*)acc;
+    l->items = NULL;
+    l->count = 0;
+    l->capacity = 0;
+}
+
+static void list_push(ValueList* l, Value v) {
+    if (l->count == l->capacity) {
+        l->capacity = l->capacity ? l->capacity * 2 : 256;
+        l->items = (Value*)realloc(l->items, sizeof(Value) * l->capacity);
+    }
+    l->items[l->count++] = v;
+}
+
+static void list_combine(void* into, const void* from, void* arg) {
+    (void)arg;
+    ValueList* a = (ValueList*)into;
+    const ValueList* b = (const ValueList*)from;
+    for (long i = 0; i < b->count; i++) list_push(a, b->items[i]);
+    free(b->items);
+}
+
+static void filter_range(long lo, long hi, void* acc, void* arg) {
+    const Value* in = (const Value*)arg;
+    for (long i = lo; i < hi; i++) {
+        if (collatz_steps(value_as_small_int(in[i])) > 150) list_push((ValueList*)acc, in[i]);
+    }
+}
+
+static void bench_reduce(void) {
+    Value* in = (Value*)malloc(sizeof(Value) * REDUCE_LENGTH);
+    for (long i = 0; i < REDUCE_LENGTH; i++) in[i] = value_small_int(i + 1);
+    SchedReducer sum = { sizeof(int64_t), sum_init, sum_combine };
+    SchedReducer list = { sizeof(ValueList), list_init, list_combine };
+
+    printf("Parallel sum of squares over %d elements\n", REDUCE_LENGTH);
+    int64_t expected = 0;
+    double t0 = now_seconds();
+    sum_squares_range(0, REDUCE_LENGTH, &expected, in);
+    printf("  serial baseline %.1f ms\n", (now_seconds() - t0) * 1e3);
+    print_header();
+    double base = 0;
+    for (int workers = 1; workers <= max_workers(); workers++) {
+        sched = sched_create(workers);
+        int64_t total;
+        double start = now_seconds();
+        sched_parallel_reduce(sched, 0, REDUCE_LENGTH, 0, sum_squares_range, &sum, &total, in);
+        double seconds = now_seconds() - start;
+        if (total != expected) {
+            printf("  wrong result %lld\n", (long long)total);
+            exit(1);
+        }
+        if (workers == 1) base = seconds;
+        print_row(workers, seconds, base);
+        sched_destroy(sched);
+    }
+    printf("\n");
+
+    printf("Parallel filter over %d elements (ordered append)\n", MAP_LENGTH);
+    ValueList check;
+    list_init(&check, NULL);
+    t0 = now_seconds();
+    filter_range(0, MAP_LENGTH, &check, in);
+    printf("  serial baseline %.1f ms, %ld kept\n", (now_seconds() - t0) * 1e3, check.count);
+    print_header();
+    for (int workers = 1; workers <= max_workers(); workers++) {
+        sched = sched_create(workers);
+        ValueList out;
+        double start = now_seconds();
+        sched_parallel_reduce(sched, 0, MAP_LENGTH, 0, filter_range, &list, &out, in);
+        double seconds = now_seconds() - start;
+        if (out.count != check.count) {
+            printf("  kept %ld, expected %ld\n", out.count, check.count);
+            exit(1);
+        }
+        for (long i = 0; i < out.count; i++) {
+            if (out.items[i].bits != check.items[i].bits) {
+                printf("  out of order at %ld\n", i);
+                exit(1);
+            }
+        }
+        free(out.items);
+        if (workers == 1) base = seconds;
+        print_row(workers, seconds, base);
+        sched_destroy(sched);
+    }
+    free(check.items);
+    free(in);
+    printf("\n");
+}
+
+int main(void) {
+    printf("=== RHelix Scheduler Benchmarks ===\n\n");
+    bench_fib();
+    bench_map();
+    bench_reduce();
+    return 0;
+}
@@ -0,0 +1,339 @@
+// container.c - Typed list and dict layouts
+#include "container.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LIST_MIN_CAPACITY 8
+#define DICT_MIN_CAPACITY 8
+#define DICT_MAX_CAPACITY ((size_t)INT32_MAX)
+
+// Every layout stores 8-byte elements, so arrays convert in place of size
+_Static_assert(sizeof(Value) == 8 && sizeof(int64_t) == 8 && sizeof(double) == 8,
+               "container elements are 8 bytes in every layout");
+#define ELEM_SIZE 8
+
+const char* container_layout_to_string(ContainerLayout layout) {
+    switch (layout) {
+        case LAYOUT_BOXED: return "boxed";
+        case LAYOUT_INT: return "int";
+        case LAYOUT_FLOAT: return "float";
+    }
+    return "?";
+}
+
+// ============================================================
+// Elements
+// ============================================================
+
+// Whether 'v' can be stored in 'layout' without changing its meaning
+static bool fits(ContainerLayout layout, Value v) {
+    switch (layout) {
+        case LAYOUT_INT: return value_is_int(v);
+        case LAYOUT_FLOAT: return value_is_float(v) || value_is_int(v);
+        default: return true;
+    }
+}
+
+// Store 'v' (which fits) at items[i], consuming it
+static void store(MemoryManager* mm, ContainerLayout layout, void* items, size_t i, Value v) {
+    switch (layout) {
+        case LAYOUT_INT:
+            ((int64_t*)items)[i] = value_as_int(v);
+            value_release(mm, v);  // A boxed int object is no longer needed
+            break;
+        case LAYOUT_FLOAT:
+            ((double*)items)[i] = value_is_float(v) ? value_as_float(v)
+                                                    : (double)value_as_int(v);
+            value_release(mm, v);
+            break;
+        default:
+            ((Value*)items)[i] = v;
+            break;
+    }
+}
+
+// items[i] as a new reference. Only an int outside the immediate range
+// allocates; if that fails the result is None.
+static Value load(MemoryManager* mm, ContainerLayout layout, const void* items, size_t i) {
+    switch (layout) {
+        case LAYOUT_INT: return value_int(mm, ((const int64_t*)items)[i]);
+        case LAYOUT_FLOAT: return value_float(((const double*)items)[i]);
+        default: {
+            Value v = ((const Value*)items)[i];
+            value_retain(v);
+            return v;
+        }
+    }
+}
+
+// Box 'count' typed elements into 'dst'. On allocation failure the
+// values boxed so far are released.
+static bool box_all(MemoryManager* mm, ContainerLayout layout, const void* src, size_t count,
+                    Value* dst) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = load(mm, layout, src, i);
+        if (layout == LAYOUT_INT && value_is_none(dst[i])) {
+            for (size_t j = 0; j < i; j++) value_release(mm, dst[j]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void release_all(MemoryManager* mm, ContainerLayout layout, const void* items,
+                        size_t count) {
+    if (layout != LAYOUT_BOXED) return;
+    for (size_t i = 0; i < count; i++) value_release(mm, ((const Value*)items)[i]);
+}
+
+static size_t grown(size_t capacity, size_t minimum) {
+    return capacity ? capacity * 2 : minimum;
+}
+
+// ============================================================
+// Lists
+// ============================================================
+
+bool value_is_list(Value v) {
+    return value_is_object(v) && OBJ_TYPE(value_as_object(v)) == OBJ_TYPE_LIST;
+}
+
+Value list_create(MemoryManager* mm, ContainerLayout layout, size_t capacity) {
+    Object* obj = mm_alloc(mm, sizeof(ListData));
+    if (!obj) return value_none();
+    OBJ_SET_TYPE(obj, OBJ_TYPE_LIST);
+    ListData* d = LIST_DATA(obj);
+    memset(d, 0, sizeof(*d));
+    d->layout = layout;
+    if (capacity > 0) {
+        d->storage = mm_alloc_array(mm, capacity, ELEM_SIZE, _Alignof(Value));
+        if (!d->storage) {
+            mm_release(mm, obj);
+            return value_none();
+        }
+        d->items = MM_OBJECT_DATA(d->storage);
+        d->capacity = capacity;
+    }
+    return value_object(obj);
+}
+
+// Move the elements into new storage for 'capacity' of them, in the
+// list's own layout or boxed. The list is unchanged on failure.
+static bool list_rebuild(MemoryManager* mm, ListData* d, size_t capacity,
+                         ContainerLayout layout) {
+    Object* storage = mm_alloc_array(mm, capacity, ELEM_SIZE, _Alignof(Value));
+    if (!storage) return false;
+    void* items = MM_OBJECT_DATA(storage);
+    if (layout == d->layout) {
+        if (d->length > 0) memcpy(items, d->items, d->length * ELEM_SIZE);
+    } else if (!box_all(mm, d->layout, d->items, d->length, (Value*)items)) {
+        mm_release(mm, storage);
+        return false;
+    }
+    if (d->storage) mm_release(mm, d->storage);
+    d->storage = storage;
+    d->items = items;
+    d->capacity = capacity;
+    d->layout = layout;
+    return true;
+}
+
+static bool list_grow(MemoryManager* mm, ListData* d) {
+    return list_rebuild(mm, d, grown(d->capacity, LIST_MIN_CAPACITY), d->layout);
+}
+
+// Make room for 'v' in the list's layout, going boxed if it does not fit
+static bool list_accept(MemoryManager* mm, ListData* d, Value v) {
+    if (fits(d->layout, v)) return true;
+    size_t capacity = d->capacity ? d->capacity : LIST_MIN_CAPACITY;
+    return list_rebuild(mm, d, capacity, LAYOUT_BOXED);
+}
+
+bool list_append(MemoryManager* mm, Value list, Value item) {
+    ListData* d = list_data(list);
+    if (!list_accept(mm, d, item) ||
+        (d->length == d->capacity && !list_grow(mm, d))) {
+        value_release(mm, item);
+        return false;
+    }
+    store(mm, d->layout, d->items, d->length++, item);
+    return true;
+}
+
+bool list_append_int(MemoryManager* mm, Value list, int64_t x) {
+    ListData* d = list_data(list);
+    if (d->layout == LAYOUT_BOXED) {
+        Value v = value_int(mm, x);
+        return !value_is_none(v) && list_append(mm, list, v);
+    }
+    if (d->length == d->capacity && !list_grow(mm, d)) return false;
+    if (d->layout == LAYOUT_INT) {
+        ((int64_t*)d->items)[d->length++] = x;
+    } else {
+        ((double*)d->items)[d->length++] = (double)x;
+    }
+    return true;
+}
+
+bool list_append_float(MemoryManager* mm, Value list, double x) {
+    ListData* d = list_data(list);
+    if (d->layout != LAYOUT_FLOAT) return list_append(mm, list, value_float(x));
+    if (d->length == d->capacity && !list_grow(mm, d)) return false;
+    ((double*)d->items)[d->length++] = x;
+    return true;
+}
+
+Value list_get(MemoryManager* mm, Value list, size_t i) {
+    ListData* d = list_data(list);
+    return load(mm, d->layout, d->items, i);
+}
+
+bool list_set(MemoryManager* mm, Value list, size_t i, Value item) {
+    ListData* d = list_data(list);
+    if (!list_accept(mm, d, item)) {
+        value_release(mm, item);
+        return false;
+    }
+    if (d->layout == LAYOUT_BOXED) value_release(mm, ((Value*)d->items)[i]);
+    store(mm, d->layout, d->items, i, item);
+    return true;
+}
+
+static void list_finalize(MemoryManager* mm, Object* obj) {
+    ListData* d = LIST_DATA(obj);
+    release_all(mm, d->layout, d->items, d->length);
+    if (d->storage) mm_release(mm, d->storage);
+}
+
+// ============================================================
+// Dicts
+// ============================================================
+
+bool value_is_dict(Value v) {
+    return value_is_object(v) && OBJ_TYPE(value_as_object(v)) == OBJ_TYPE_DICT;
+}
+
+// Index slot holding 'key', or the empty slot where it would go
+static size_t dict_find(const DictData* d, Value key, uint64_t hash) {
+    size_t i = (size_t)hash & d->index_mask;
+    for (;;) {
+        int32_t e = d->index[i];
+        if (e < 0 || value_equals(d->keys[e], key)) return i;
+        i = (i + 1) & d->index_mask;
+    }
+}
+
+// Move the entries into new storage for 'capacity' of them, in the
+// dict's own layout or boxed, and rebuild the index. The dict is
+// unchanged on failure.
+static bool dict_rebuild(MemoryManager* mm, DictData* d, size_t capacity,
+                         ContainerLayout layout) {
+    if (capacity > DICT_MAX_CAPACITY) return false;
+    size_t slots = 1;
+    while (slots < capacity * 2) slots <<= 1;
+    size_t bytes = capacity * ELEM_SIZE * 2 + slots * sizeof(int32_t);
+    Object* storage = mm_alloc_array(mm, bytes, 1, _Alignof(Value));
+    if (!storage) return false;
+
+    Value* keys = (Value*)MM_OBJECT_DATA(storage);
+    void* values = keys + capacity;
+    int32_t* index = (int32_t*)((char*)values + capacity * ELEM_SIZE);
+    if (layout == d->layout) {
+        if (d->length > 0) memcpy(values, d->values, d->length * ELEM_SIZE);
+    } else if (!box_all(mm, d->layout, d->values, d->length, (Value*)values)) {
+        mm_release(mm, storage);
+        return false;
+    }
+    if (d->length > 0) memcpy(keys, d->keys, d->length * sizeof(Value));
+    memset(index, 0xFF, slots * sizeof(int32_t));
+
+    if (d->storage) mm_release(mm, d->storage);
+    d->storage = storage;
+    d->keys = keys;
+    d->values = values;
+    d->index = index;
+    d->index_mask = slots - 1;
+    d->capacity = capacity;
+    d->layout = layout;
+    for (size_t e = 0; e < d->length; e++) {
+        d->index[dict_find(d, keys[e], value_hash(keys[e]))] = (int32_t)e;
+    }
+    return true;
+}
+
+Value dict_create(MemoryManager* mm, ContainerLayout layout, size_t capacity) {
+    Object* obj = mm_alloc(mm, sizeof(DictData));
+    if (!obj) return value_none();
+    OBJ_SET_TYPE(obj, OBJ_TYPE_DICT);
+    DictData* d = DICT_DATA(obj);
+    memset(d, 0, sizeof(*d));
+    d->layout = layout;
+    if (capacity > 0 && !dict_rebuild(mm, d, capacity, layout)) {
+        mm_release(mm, obj);
+        return value_none();
+    }
+    return value_object(obj);
+}
+
+bool dict_set(MemoryManager* mm, Value dict, Value key, Value value) {
+    DictData* d = dict_data(dict);
+    bool ok = true;
+    if (!fits(d->layout, value)) {
+        ok = dict_rebuild(mm, d, d->capacity ? d->capacity : DICT_MIN_CAPACITY, LAYOUT_BOXED);
+    }
+    uint64_t hash = value_hash(key);
+    if (ok && d->length > 0) {
+        int32_t e = d->index[dict_find(d, key, hash)];
+        if (e >= 0) {
+            // Replace: the dict keeps its original key
+            value_release(mm, key);
+            if (d->layout == LAYOUT_BOXED) value_release(mm, ((Value*)d->values)[e]);
+            store(mm, d->layout, d->values, (size_t)e, value);
+            return true;
+        }
+    }
+    if (ok && d->length == d->capacity) {
+        ok = dict_rebuild(mm, d, grown(d->capacity, DICT_MIN_CAPACITY), d->layout);
+    }
+    if (!ok) {
+        value_release(mm, key);
+        value_release(mm, value);
+        return false;
+    }
+    size_t e = d->length++;
+    d->index[dict_find(d, key, hash)] = (int32_t)e;
+    d->keys[e] = key;
+    store(mm, d->layout, d->values, e, value);
+    return true;
+}
+
+void* dict_lookup(Value dict, Value key) {
+    DictData* d = dict_data(dict);
+    if (d->length == 0) return NULL;
+    int32_t e = d->index[dict_find(d, key, value_hash(key))];
+    return e < 0 ? NULL : (char*)d->values + (size_t)e * ELEM_SIZE;
+}
+
+bool dict_get(MemoryManager* mm, Value dict, Value key, Value* out) {
+    void* slot = dict_lookup(dict, key);
+    if (!slot) return false;
+    *out = load(mm, dict_layout(dict), slot, 0);
+    return true;
+}
+
+Value dict_value_at(MemoryManager* mm, Value dict, size_t i) {
+    DictData* d = dict_data(dict);
+    return load(mm, d->layout, d->values, i);
+}
+
+static void dict_finalize(MemoryManager* mm, Object* obj) {
+    DictData* d = DICT_DATA(obj);
+    release_all(mm, LAYOUT_BOXED, d->keys, d->length);
+    release_all(mm, d->layout, d->values, d->length);
+    if (d->storage) mm_release(mm, d->storage);
+}
+
+void container_register(MemoryManager* mm) {
+    mm_set_finalizer(mm, OBJ_TYPE_LIST, list_finalize);
+    mm_set_finalizer(mm, OBJ_TYPE_DICT, dict_finalize);
+}
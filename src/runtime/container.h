@@ -0,0 +1,129 @@
+// container.h - Lists and dicts with typed element layouts
+//
+// A list keeps its elements in one managed array whose layout is chosen
+// when the list is created. LAYOUT_INT and LAYOUT_FLOAT hold raw int64_t
+// and double: no tag checks on the way in or out, no refcounting, and
+// ints keep their full 64 bits instead of being boxed past 48. LAYOUT_BOXED
+// holds Values. The compiler picks the layout from the static element
+// type (List[int], List[float]) and uses boxed storage for anything else,
+// any included.
+//
+// A layout never changes what a program computes. An int stored into a
+// float list is widened, as the type checker already treats it; any
+// other value a typed list cannot hold (a str reaching a List[int]
+// through untyped code) converts the list to boxed storage in place.
+//
+// Dicts keep insertion order: entries are appended to dense key and value
+// arrays, and an open-addressing index of int32 positions (linear probing,
+// at most half full) maps hashes to them. Keys are always boxed; values
+// take the same layouts as list elements, so Dict[str, int] stores its
+// counts as raw int64_t.
+//
+// Ownership: a container holds a reference to each boxed element, key
+// and value. Values passed in are consumed; values handed out are new
+// references (typed layouts box on the way out). The element arrays are
+// freed with the container by a finalizer that mm_create registers.
+
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include "value.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    LAYOUT_BOXED,            // Value
+    LAYOUT_INT,              // int64_t
+    LAYOUT_FLOAT             // double
+} ContainerLayout;
+
+// Payload of an OBJ_TYPE_LIST object
+typedef struct {
+    ContainerLayout layout;
+    size_t length;
+    size_t capacity;
+    Object* storage;         // Managed array of 'capacity' elements, NULL when empty
+    void* items;             // Value*, int64_t* or double*, by layout
+} ListData;
+
+// Payload of an OBJ_TYPE_DICT object
+typedef struct {
+    ContainerLayout layout;  // Of the values
+    size_t length;
+    size_t capacity;         // Entries the dense arrays can hold
+    size_t index_mask;       // Index slots - 1; slots are a power of two >= 2 * capacity
+    Object* storage;         // Keys, values and index in one managed block
+    Value* keys;             // In insertion order
+    void* values;            // Value*, int64_t* or double*, by layout
+    int32_t* index;          // Entry position per slot, -1 when empty
+} DictData;
+
+#define LIST_DATA(obj) ((ListData*)MM_OBJECT_DATA(obj))
+#define DICT_DATA(obj) ((DictData*)MM_OBJECT_DATA(obj))
+
+// Install the list and dict finalizers (called by mm_create)
+void container_register(MemoryManager* mm);
+
+const char* container_layout_to_string(ContainerLayout layout);
+
+// === Lists ===
+
+// Empty list with room for 'capacity' elements. None on allocation failure.
+Value list_create(MemoryManager* mm, ContainerLayout layout, size_t capacity);
+
+bool value_is_list(Value v);
+
+static inline ListData* list_data(Value list) { return LIST_DATA(value_as_object(list)); }
+static inline size_t list_length(Value list) { return list_data(list)->length; }
+static inline ContainerLayout list_layout(Value list) { return list_data(list)->layout; }
+
+// Raw elements of a LAYOUT_INT / LAYOUT_FLOAT list (caller checks the
+// layout). Valid until the list next grows or changes layout.
+static inline int64_t* list_ints(Value list) { return (int64_t*)list_data(list)->items; }
+static inline double* list_floats(Value list) { return (double*)list_data(list)->items; }
+
+// Append 'item', consuming it. On allocation failure the item is released
+// and false returned.
+bool list_append(MemoryManager* mm, Value list, Value item);
+
+// Typed appends; they work on any layout (boxing or widening as needed)
+bool list_append_int(MemoryManager* mm, Value list, int64_t x);
+bool list_append_float(MemoryManager* mm, Value list, double x);
+
+// Element 'i' as a new reference (caller checks i < length)
+Value list_get(MemoryManager* mm, Value list, size_t i);
+
+// Replace element 'i', consuming 'item'. False on allocation failure
+// (item released, list unchanged).
+bool list_set(MemoryManager* mm, Value list, size_t i, Value item);
+
+// === Dicts ===
+
+Value dict_create(MemoryManager* mm, ContainerLayout layout, size_t capacity);
+
+bool value_is_dict(Value v);
+
+static inline DictData* dict_data(Value dict) { return DICT_DATA(value_as_object(dict)); }
+static inline size_t dict_length(Value dict) { return dict_data(dict)->length; }
+static inline ContainerLayout dict_layout(Value dict) { return dict_data(dict)->layout; }
+
+// Insert or replace, consuming 'key' and 'value'. False on allocation
+// failure (both released, dict unchanged).
+bool dict_set(MemoryManager* mm, Value dict, Value key, Value value);
+
+// The value stored under 'key' (borrowed) as a new reference in *out;
+// false if it is absent
+bool dict_get(MemoryManager* mm, Value dict, Value key, Value* out);
+
+// Where the value for 'key' lives - a Value*, int64_t* or double* by
+// layout - or NULL if it is absent. Lets typed code update in place
+// ('*(int64_t*)dict_lookup(d, k) += 1'). Valid until the next insertion.
+void* dict_lookup(Value dict, Value key);
+
+// Entry 'i' in insertion order (caller checks i < length). The key is
+// borrowed; the value is a new reference.
+static inline Value dict_key_at(Value dict, size_t i) { return dict_data(dict)->keys[i]; }
+Value dict_value_at(MemoryManager* mm, Value dict, size_t i);
+
+#endif // CONTAINER_H
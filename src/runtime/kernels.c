@@ -0,0 +1,683 @@
+// kernels.c - Scalar, SSE2 and AVX2 kernels and their list entry points
+#include "kernels.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+
+// Float reductions keep this many interleaved partial sums in every
+// variant: one per double of two AVX2 or four SSE2 registers.
+#define LANES 8
+
+// ============================================================
+// Scalar kernels
+// ============================================================
+
+// The per-element operations. Min and max match minpd/maxpd exactly.
+static inline double add_f(double a, double b) { return a + b; }
+static inline double sub_f(double a, double b) { return a - b; }
+static inline double mul_f(double a, double b) { return a * b; }
+static inline double min_f(double a, double b) { return a < b ? a : b; }
+static inline double max_f(double a, double b) { return a > b ? a : b; }
+
+// Int versions store the result and return true on overflow
+static inline bool add_i(int64_t a, int64_t b, int64_t* r) { return __builtin_add_overflow(a, b, r); }
+static inline bool sub_i(int64_t a, int64_t b, int64_t* r) { return __builtin_sub_overflow(a, b, r); }
+static inline bool mul_i(int64_t a, int64_t b, int64_t* r) { return __builtin_mul_overflow(a, b, r); }
+static inline bool min_i(int64_t a, int64_t b, int64_t* r) { *r = a < b ? a : b; return false; }
+static inline bool max_i(int64_t a, int64_t b, int64_t* r) { *r = a > b ? a : b; return false; }
+
+#define SCALAR_KERNELS(op)                                                              \
+    static void op##_f64_scalar(double* dst, const double* a, const double* b, size_t n) { \
+        for (size_t i = 0; i < n; i++) dst[i] = op##_f(a[i], b[i]);                     \
+    }                                                                                   \
+    static void op##_f64_broadcast_scalar(double* dst, const double* a, double b,        \
+                                          size_t n) {                                   \
+        for (size_t i = 0; i < n; i++) dst[i] = op##_f(a[i], b);                        \
+    }                                                                                   \
+    static bool op##_i64_scalar(int64_t* dst, const int64_t* a, const int64_t* b,        \
+                                size_t n) {                                             \
+        bool overflow = false;                                                          \
+        for (size_t i = 0; i < n; i++) overflow |= op##_i(a[i], b[i], &dst[i]);          \
+        return !overflow;                                                               \
+    }                                                                                   \
+    static bool op##_i64_broadcast_scalar(int64_t* dst, const int64_t* a, int64_t b,    \
+                                          size_t n) {                                   \
+        bool overflow = false;                                                          \
+        for (size_t i = 0; i < n; i++) overflow |= op##_i(a[i], b, &dst[i]);             \
+        return !overflow;                                                               \
+    }
+
+SCALAR_KERNELS(add)
+SCALAR_KERNELS(sub)
+SCALAR_KERNELS(mul)
+SCALAR_KERNELS(min)
+SCALAR_KERNELS(max)
+
+static void fma_f64_scalar(double* dst, const double* a, const double* b, const double* c,
+                           size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = fma(a[i], b[i], c[i]);
+}
+
+// The fixed order every variant combines its lanes in: lane j with lane
+// j + 4 (the two AVX2 accumulators), then the halves of what remains.
+static inline double combine_lanes(const double l[LANES]) {
+    return ((l[0] + l[4]) + (l[2] + l[6])) + ((l[1] + l[5]) + (l[3] + l[7]));
+}
+
+static double sum_f64_scalar(const double* a, size_t n) {
+    double l[LANES] = { 0 };
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (int j = 0; j < LANES; j++) l[j] += a[i + j];
+    }
+    double s = combine_lanes(l);
+    for (; i < n; i++) s += a[i];
+    return s;
+}
+
+// Multiply, then add: never contracted into an FMA (-std=c11 implies
+// -ffp-contract=off), so all variants round the same way.
+static double dot_f64_scalar(const double* a, const double* b, size_t n) {
+    double l[LANES] = { 0 };
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (int j = 0; j < LANES; j++) l[j] += a[i + j] * b[i + j];
+    }
+    double s = combine_lanes(l);
+    for (; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+
+static int64_t sum_i64_scalar(const int64_t* a, size_t n, uint64_t* magnitude) {
+    uint64_t s = 0, m = 0;
+    for (size_t i = 0; i < n; i++) {
+        s += (uint64_t)a[i];
+        m |= (uint64_t)(a[i] ^ (a[i] >> 63));
+    }
+    *magnitude = m;
+    return (int64_t)s;
+}
+
+static const Kernels scalar_kernels = {
+    .isa = KERNEL_ISA_SCALAR,
+    .f64 = { add_f64_scalar, sub_f64_scalar, mul_f64_scalar, min_f64_scalar, max_f64_scalar },
+    .f64_broadcast = { add_f64_broadcast_scalar, sub_f64_broadcast_scalar,
+                       mul_f64_broadcast_scalar, min_f64_broadcast_scalar,
+                       max_f64_broadcast_scalar },
+    .i64 = { add_i64_scalar, sub_i64_scalar, mul_i64_scalar, min_i64_scalar, max_i64_scalar },
+    .i64_broadcast = { add_i64_broadcast_scalar, sub_i64_broadcast_scalar,
+                       mul_i64_broadcast_scalar, min_i64_broadcast_scalar,
+                       max_i64_broadcast_scalar },
+    .fma_f64 = fma_f64_scalar,
+    .sum_f64 = sum_f64_scalar,
+    .dot_f64 = dot_f64_scalar,
+    .sum_i64 = sum_i64_scalar,
+};
+
+#ifdef KERNELS_X86
+
+// ============================================================
+// SIMD kernels
+// ============================================================
+
+// Element-wise float kernels for one instruction set: two vectors per
+// iteration, the remainder through the scalar kernel.
+#define SIMD_F64_KERNELS(isa, attr, vec, width, load, store, set1, op, vop)             \
+    static attr void op##_f64_##isa(double* dst, const double* a, const double* b,       \
+                                    size_t n) {                                         \
+        size_t i = 0;                                                                   \
+        for (; i + 2 * width <= n; i += 2 * width) {                                    \
+            store(dst + i, vop(load(a + i), load(b + i)));                              \
+            store(dst + i + width, vop(load(a + i + width), load(b + i + width)));      \
+        }                                                                               \
+        op##_f64_scalar(dst + i, a + i, b + i, n - i);                                  \
+    }                                                                                   \
+    static attr void op##_f64_broadcast_##isa(double* dst, const double* a, double b,    \
+                                              size_t n) {                               \
+        vec vb = set1(b);                                                               \
+        size_t i = 0;                                                                   \
+        for (; i + 2 * width <= n; i += 2 * width) {                                    \
+            store(dst + i, vop(load(a + i), vb));                                       \
+            store(dst + i + width, vop(load(a + i + width), vb));                       \
+        }                                                                               \
+        op##_f64_broadcast_scalar(dst + i, a + i, b, n - i);                            \
+    }
+
+// Int kernels: 'compute' sets 'r' from 'x' and 'y' and ORs a vector whose
+// sign bits flag overflowing lanes into 'flags'
+#define SIMD_I64_KERNELS(isa, attr, vec, width, load, store, set1, zero, any_sign, op, compute) \
+    static attr bool op##_i64_##isa(int64_t* dst, const int64_t* a, const int64_t* b,    \
+                                    size_t n) {                                         \
+        vec flags = zero();                                                             \
+        size_t i = 0;                                                                   \
+        for (; i + width <= n; i += width) {                                            \
+            vec x = load((const vec*)(a + i)), y = load((const vec*)(b + i)), r;         \
+            compute;                                                                    \
+            store((vec*)(dst + i), r);                                                  \
+        }                                                                               \
+        bool ok = op##_i64_scalar(dst + i, a + i, b + i, n - i);                        \
+        return ok && !any_sign(flags);                                                  \
+    }                                                                                   \
+    static attr bool op##_i64_broadcast_##isa(int64_t* dst, const int64_t* a, int64_t b, \
+                                              size_t n) {                               \
+        vec flags = zero(), y = set1(b);                                                \
+        size_t i = 0;                                                                   \
+        for (; i + width <= n; i += width) {                                            \
+            vec x = load((const vec*)(a + i)), r;                                       \
+            compute;                                                                    \
+            store((vec*)(dst + i), r);                                                  \
+        }                                                                               \
+        bool ok = op##_i64_broadcast_scalar(dst + i, a + i, b, n - i);                  \
+        return ok && !any_sign(flags);                                                  \
+    }
+
+// --- SSE2 (part of every x86-64 CPU) ---
+
+#define SSE2_F64(op, vop) \
+    SIMD_F64_KERNELS(sse2, , __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, op, vop)
+SSE2_F64(add, _mm_add_pd)
+SSE2_F64(sub, _mm_sub_pd)
+SSE2_F64(mul, _mm_mul_pd)
+SSE2_F64(min, _mm_min_pd)
+SSE2_F64(max, _mm_max_pd)
+
+static inline bool any_sign_sse2(__m128i v) {
+    return _mm_movemask_pd(_mm_castsi128_pd(v)) != 0;
+}
+
+// Signed overflow of x + y = r: x and y agree in sign and r does not
+#define SSE2_I64(op, compute)                                                           \
+    SIMD_I64_KERNELS(sse2, , __m128i, 2, _mm_loadu_si128, _mm_storeu_si128,             \
+                     _mm_set1_epi64x, _mm_setzero_si128, any_sign_sse2, op, compute)
+SSE2_I64(add, r = _mm_add_epi64(x, y);
+              flags = _mm_or_si128(flags, _mm_and_si128(_mm_xor_si128(x, r),
+                                                        _mm_xor_si128(y, r))))
+SSE2_I64(sub, r = _mm_sub_epi64(x, y);
+              flags = _mm_or_si128(flags, _mm_and_si128(_mm_xor_si128(x, y),
+                                                        _mm_xor_si128(x, r))))
+
+static double sum_f64_sse2(const double* a, size_t n) {
+    __m128d acc[4] = { _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd() };
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (int j = 0; j < 4; j++) acc[j] = _mm_add_pd(acc[j], _mm_loadu_pd(a + i + 2 * j));
+    }
+    // (l0+l4, l1+l5) + (l2+l6, l3+l7), then the two halves: combine_lanes
+    __m128d t = _mm_add_pd(_mm_add_pd(acc[0], acc[2]), _mm_add_pd(acc[1], acc[3]));
+    double s = _mm_cvtsd_f64(t) + _mm_cvtsd_f64(_mm_unpackhi_pd(t, t));
+    for (; i < n; i++) s += a[i];
+    return s;
+}
+
+static double dot_f64_sse2(const double* a, const double* b, size_t n) {
+    __m128d acc[4] = { _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd() };
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (int j = 0; j < 4; j++) {
+            __m128d p = _mm_mul_pd(_mm_loadu_pd(a + i + 2 * j), _mm_loadu_pd(b + i + 2 * j));
+            acc[j] = _mm_add_pd(acc[j], p);
+        }
+    }
+    __m128d t = _mm_add_pd(_mm_add_pd(acc[0], acc[2]), _mm_add_pd(acc[1], acc[3]));
+    double s = _mm_cvtsd_f64(t) + _mm_cvtsd_f64(_mm_unpackhi_pd(t, t));
+    for (; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+
+static int64_t sum_i64_sse2(const int64_t* a, size_t n, uint64_t* magnitude) {
+    __m128i s = _mm_setzero_si128(), m = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        // No 64-bit arithmetic shift in SSE2: spread each high dword's sign
+        __m128i sign = _mm_shuffle_epi32(_mm_srai_epi32(x, 31), _MM_SHUFFLE(3, 3, 1, 1));
+        s = _mm_add_epi64(s, x);
+        m = _mm_or_si128(m, _mm_xor_si128(x, sign));
+    }
+    uint64_t sv[2], mv[2];
+    _mm_storeu_si128((__m128i*)sv, s);
+    _mm_storeu_si128((__m128i*)mv, m);
+    uint64_t tail_m;
+    int64_t tail = sum_i64_scalar(a + i, n - i, &tail_m);
+    *magnitude = mv[0] | mv[1] | tail_m;
+    return (int64_t)(sv[0] + sv[1] + (uint64_t)tail);
+}
+
+// SSE2 has no 64-bit compare (that is SSE4.2) and no 64-bit multiply:
+// int mul, min and max stay scalar.
+static const Kernels sse2_kernels = {
+    .isa = KERNEL_ISA_SSE2,
+    .f64 = { add_f64_sse2, sub_f64_sse2, mul_f64_sse2, min_f64_sse2, max_f64_sse2 },
+    .f64_broadcast = { add_f64_broadcast_sse2, sub_f64_broadcast_sse2,
+                       mul_f64_broadcast_sse2, min_f64_broadcast_sse2,
+                       max_f64_broadcast_sse2 },
+    .i64 = { add_i64_sse2, sub_i64_sse2, mul_i64_scalar, min_i64_scalar, max_i64_scalar },
+    .i64_broadcast = { add_i64_broadcast_sse2, sub_i64_broadcast_sse2,
+                       mul_i64_broadcast_scalar, min_i64_broadcast_scalar,
+                       max_i64_broadcast_scalar },
+    .fma_f64 = fma_f64_scalar,
+    .sum_f64 = sum_f64_sse2,
+    .dot_f64 = dot_f64_sse2,
+    .sum_i64 = sum_i64_sse2,
+};
+
+// --- AVX2 and FMA (compiled for them, run only if the CPU has them) ---
+
+#define AVX2_F64(op, vop) \
+    SIMD_F64_KERNELS(avx2, TARGET_AVX2, __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, \
+                     _mm256_set1_pd, op, vop)
+AVX2_F64(add, _mm256_add_pd)
+AVX2_F64(sub, _mm256_sub_pd)
+AVX2_F64(mul, _mm256_mul_pd)
+AVX2_F64(min, _mm256_min_pd)
+AVX2_F64(max, _mm256_max_pd)
+
+static TARGET_AVX2 inline bool any_sign_avx2(__m256i v) {
+    return _mm256_movemask_pd(_mm256_castsi256_pd(v)) != 0;
+}
+
+#define AVX2_I64(op, compute)                                                           \
+    SIMD_I64_KERNELS(avx2, TARGET_AVX2, __m256i, 4, _mm256_loadu_si256,                 \
+                     _mm256_storeu_si256, _mm256_set1_epi64x, _mm256_setzero_si256,     \
+                     any_sign_avx2, op, compute)
+AVX2_I64(add, r = _mm256_add_epi64(x, y);
+              flags = _mm256_or_si256(flags, _mm256_and_si256(_mm256_xor_si256(x, r),
+                                                              _mm256_xor_si256(y, r))))
+AVX2_I64(sub, r = _mm256_sub_epi64(x, y);
+              flags = _mm256_or_si256(flags, _mm256_and_si256(_mm256_xor_si256(x, y),
+                                                              _mm256_xor_si256(x, r))))
+AVX2_I64(min, r = _mm256_blendv_epi8(y, x, _mm256_cmpgt_epi64(y, x)); (void)flags)
+AVX2_I64(max, r = _mm256_blendv_epi8(y, x, _mm256_cmpgt_epi64(x, y)); (void)flags)
+
+static TARGET_AVX2 void fma_f64_avx2(double* dst, const double* a, const double* b,
+                                     const double* c, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d r = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i),
+                                    _mm256_loadu_pd(c + i));
+        _mm256_storeu_pd(dst + i, r);
+    }
+    fma_f64_scalar(dst + i, a + i, b + i, c + i, n - i);
+}
+
+// (l0+l4, l1+l5, l2+l6, l3+l7), then its halves and their halves: combine_lanes
+static TARGET_AVX2 inline double combine_avx2(__m256d acc0, __m256d acc1) {
+    __m256d s = _mm256_add_pd(acc0, acc1);
+    __m128d t = _mm_add_pd(_mm256_castpd256_pd128(s), _mm256_extractf128_pd(s, 1));
+    return _mm_cvtsd_f64(t) + _mm_cvtsd_f64(_mm_unpackhi_pd(t, t));
+}
+
+static TARGET_AVX2 double sum_f64_avx2(const double* a, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(a + i));
+        acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(a + i + 4));
+    }
+    double s = combine_avx2(acc0, acc1);
+    for (; i < n; i++) s += a[i];
+    return s;
+}
+
+static TARGET_AVX2 double dot_f64_avx2(const double* a, const double* b, size_t n) {
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4),
+                                                 _mm256_loadu_pd(b + i + 4)));
+    }
+    double s = combine_avx2(acc0, acc1);
+    for (; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+
+static TARGET_AVX2 int64_t sum_i64_avx2(const int64_t* a, size_t n, uint64_t* magnitude) {
+    __m256i s = _mm256_setzero_si256(), m = _mm256_setzero_si256();
+    __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        s = _mm256_add_epi64(s, x);
+        m = _mm256_or_si256(m, _mm256_xor_si256(x, _mm256_cmpgt_epi64(zero, x)));
+    }
+    uint64_t sv[4], mv[4];
+    _mm256_storeu_si256((__m256i*)sv, s);
+    _mm256_storeu_si256((__m256i*)mv, m);
+    uint64_t tail_m;
+    int64_t tail = sum_i64_scalar(a + i, n - i, &tail_m);
+    *magnitude = mv[0] | mv[1] | mv[2] | mv[3] | tail_m;
+    return (int64_t)(sv[0] + sv[1] + sv[2] + sv[3] + (uint64_t)tail);
+}
+
+static const Kernels avx2_kernels = {
+    .isa = KERNEL_ISA_AVX2,
+    .f64 = { add_f64_avx2, sub_f64_avx2, mul_f64_avx2, min_f64_avx2, max_f64_avx2 },
+    .f64_broadcast = { add_f64_broadcast_avx2, sub_f64_broadcast_avx2,
+                       mul_f64_broadcast_avx2, min_f64_broadcast_avx2,
+                       max_f64_broadcast_avx2 },
+    .i64 = { add_i64_avx2, sub_i64_avx2, mul_i64_scalar, min_i64_avx2, max_i64_avx2 },
+    .i64_broadcast = { add_i64_broadcast_avx2, sub_i64_broadcast_avx2,
+                       mul_i64_broadcast_scalar, min_i64_broadcast_avx2,
+                       max_i64_broadcast_avx2 },
+    .fma_f64 = fma_f64_avx2,
+    .sum_f64 = sum_f64_avx2,
+    .dot_f64 = dot_f64_avx2,
+    .sum_i64 = sum_i64_avx2,
+};
+
+// Checks the OS saves YMM state too, not just the CPUID bits
+static bool cpu_has_avx2(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+#endif // KERNELS_X86
+
+// ============================================================
+// Selection
+// ============================================================
+
+static const Kernels* selected;
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+
+static void select_kernels(void) {
+    selected = &scalar_kernels;
+    for (int isa = KERNEL_ISA_COUNT - 1; isa >= 0; isa--) {
+        const Kernels* k = kernels_for((KernelISA)isa);
+        if (k) {
+            selected = k;
+            break;
+        }
+    }
+}
+
+const Kernels* kernels(void) {
+    pthread_once(&select_once, select_kernels);
+    return selected;
+}
+
+const Kernels* kernels_for(KernelISA isa) {
+    switch (isa) {
+        case KERNEL_ISA_SCALAR: return &scalar_kernels;
+#ifdef KERNELS_X86
+        case KERNEL_ISA_SSE2: return &sse2_kernels;
+        case KERNEL_ISA_AVX2: return cpu_has_avx2() ? &avx2_kernels : NULL;
+#endif
+        default: return NULL;
+    }
+}
+
+const char* kernel_isa_to_string(KernelISA isa) {
+    switch (isa) {
+        case KERNEL_ISA_SCALAR: return "scalar";
+        case KERNEL_ISA_SSE2: return "sse2";
+        case KERNEL_ISA_AVX2: return "avx2";
+        case KERNEL_ISA_COUNT: break;
+    }
+    return "?";
+}
+
+const char* kernel_op_to_string(KernelOp op) {
+    switch (op) {
+        case KERNEL_ADD: return "add";
+        case KERNEL_SUB: return "sub";
+        case KERNEL_MUL: return "mul";
+        case KERNEL_MIN: return "min";
+        case KERNEL_MAX: return "max";
+        case KERNEL_FMA: return "fma";
+        case KERNEL_SUM: return "sum";
+        case KERNEL_DOT: return "dot";
+    }
+    return "?";
+}
+
+// ============================================================
+// List entry points
+// ============================================================
+
+static bool is_number(Value v) {
+    return value_is_float(v) || value_is_int(v);
+}
+
+// How 'v' takes part in a kernel: the layout of a typed list, INT or
+// FLOAT for a number, BOXED for anything else
+static ContainerLayout kernel_layout(Value v) {
+    if (value_is_list(v)) return list_layout(v);
+    if (value_is_float(v)) return LAYOUT_FLOAT;
+    if (value_is_int(v)) return LAYOUT_INT;
+    return LAYOUT_BOXED;
+}
+
+// Element 'i' of an operand: a list element or the broadcast number
+static Value operand_at(MemoryManager* mm, Value v, size_t i) {
+    if (value_is_list(v)) return list_get(mm, v, i);
+    value_retain(v);
+    return v;
+}
+
+static bool number_less(Value a, Value b) {
+    if (value_is_int(a) && value_is_int(b)) return value_as_int(a) < value_as_int(b);
+    double x = value_is_float(a) ? value_as_float(a) : (double)value_as_int(a);
+    double y = value_is_float(b) ? value_as_float(b) : (double)value_as_int(b);
+    return x < y;
+}
+
+// One element the way generic code computes it; consumes neither operand
+static Value apply(MemoryManager* mm, KernelOp op, Value x, Value y) {
+    switch (op) {
+        case KERNEL_ADD: return value_add(mm, x, y);
+        case KERNEL_SUB: return value_sub(mm, x, y);
+        case KERNEL_MUL: return value_mul(mm, x, y);
+        case KERNEL_MIN:
+        case KERNEL_MAX: {
+            if (!is_number(x) || !is_number(y)) return value_none();
+            Value r = (op == KERNEL_MIN ? number_less(x, y) : number_less(y, x)) ? x : y;
+            value_retain(r);
+            return r;
+        }
+        default:
+            return value_none();
+    }
+}
+
+static void widen(double* dst, const int64_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = (double)src[i];
+}
+
+// Float element-wise kernel into 'dst' for a float result: at most one
+// operand is an int list, and it is widened into 'dst' first, so 'dst'
+// must not be the other operand's storage.
+static void run_f64(const Kernels* k, KernelOp op, double* dst, Value a, Value b, size_t n) {
+    const double* x;
+    if (list_layout(a) == LAYOUT_INT) {
+        widen(dst, list_ints(a), n);
+        x = dst;
+    } else {
+        x = list_floats(a);
+    }
+    if (!value_is_list(b)) {
+        double y = value_is_float(b) ? value_as_float(b) : (double)value_as_int(b);
+        k->f64_broadcast[op](dst, x, y, n);
+    } else if (list_layout(b) == LAYOUT_INT) {
+        widen(dst, list_ints(b), n);
+        k->f64[op](dst, x, dst, n);
+    } else {
+        k->f64[op](dst, x, list_floats(b), n);
+    }
+}
+
+static bool run_i64(const Kernels* k, KernelOp op, int64_t* dst, Value a, Value b, size_t n) {
+    if (value_is_list(b)) return k->i64[op](dst, list_ints(a), list_ints(b), n);
+    return k->i64_broadcast[op](dst, list_ints(a), value_as_int(b), n);
+}
+
+Value kernel_map(MemoryManager* mm, KernelOp op, Value a, Value b) {
+    size_t n = list_length(a);
+    if (value_is_list(b) && list_length(b) < n) n = list_length(b);
+    ContainerLayout la = kernel_layout(a), lb = kernel_layout(b);
+    ContainerLayout layout = la == LAYOUT_BOXED || lb == LAYOUT_BOXED ? LAYOUT_BOXED
+                           : la == LAYOUT_FLOAT || lb == LAYOUT_FLOAT ? LAYOUT_FLOAT
+                           : LAYOUT_INT;
+    Value out = list_create(mm, layout, n);
+    if (value_is_none(out)) return out;
+    ListData* d = list_data(out);
+
+    if (layout == LAYOUT_FLOAT) {
+        run_f64(kernels(), op, (double*)d->items, a, b, n);
+        d->length = n;
+        return out;
+    }
+    if (layout == LAYOUT_INT && run_i64(kernels(), op, (int64_t*)d->items, a, b, n)) {
+        d->length = n;
+        return out;
+    }
+
+    // Generic: boxed elements, or an int result that overflowed
+    for (size_t i = 0; i < n; i++) {
+        Value x = list_get(mm, a, i), y = operand_at(mm, b, i);
+        Value r = apply(mm, op, x, y);
+        value_release(mm, x);
+        value_release(mm, y);
+        if (!list_append(mm, out, r)) {
+            value_release(mm, out);
+            return value_none();
+        }
+    }
+    return out;
+}
+
+bool kernel_store(MemoryManager* mm, KernelOp op, Value out, Value a, Value b,
+                  int64_t count) {
+    if (count <= 0) return true;
+    size_t n = (size_t)count;
+    if (list_length(out) < n || list_length(a) < n ||
+        (value_is_list(b) && list_length(b) < n)) return false;
+    ContainerLayout la = kernel_layout(a), lb = kernel_layout(b);
+    ContainerLayout layout = la == LAYOUT_BOXED || lb == LAYOUT_BOXED ? LAYOUT_BOXED
+                           : la == LAYOUT_FLOAT || lb == LAYOUT_FLOAT ? LAYOUT_FLOAT
+                           : LAYOUT_INT;
+    bool out_is_a = out.bits == a.bits, out_is_b = out.bits == b.bits;
+
+    // run_f64 widens an int list into 'out', which must then not be the other operand
+    if (layout == LAYOUT_FLOAT && list_layout(out) == LAYOUT_FLOAT &&
+        !(la == LAYOUT_INT && out_is_b) && !(lb == LAYOUT_INT && value_is_list(b) && out_is_a)) {
+        run_f64(kernels(), op, list_floats(out), a, b, n);
+        return true;
+    }
+    if (layout == LAYOUT_INT && list_layout(out) == LAYOUT_INT) {
+        // An overflow sends us to the generic path, which needs the inputs intact
+        if (!out_is_a && !out_is_b) {
+            if (run_i64(kernels(), op, list_ints(out), a, b, n)) return true;
+        } else {
+            int64_t* scratch = (int64_t*)malloc(n * sizeof(int64_t));
+            if (!scratch) return false;
+            bool ok = run_i64(kernels(), op, scratch, a, b, n);
+            if (ok) memcpy(list_ints(out), scratch, n * sizeof(int64_t));
+            free(scratch);
+            if (ok) return true;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        Value x = list_get(mm, a, i), y = operand_at(mm, b, i);
+        Value r = apply(mm, op, x, y);
+        value_release(mm, x);
+        value_release(mm, y);
+        if (!list_set(mm, out, i, r)) return false;
+    }
+    return true;
+}
+
+// acc + a[0] + a[1] + ... exactly as the left-to-right loop adds it, or
+// false if that loop would overflow somewhere
+static bool sum_ints(const Kernels* k, int64_t acc, const int64_t* a, size_t n, int64_t* out) {
+    uint64_t m, bound;
+    int64_t s = k->sum_i64(a, n, &m);
+    // Every |x| <= m + 1, so every partial sum lies within acc +- n * (m + 1)
+    uint64_t mag_acc = acc < 0 ? -(uint64_t)acc : (uint64_t)acc;
+    if (!__builtin_mul_overflow((uint64_t)n, m + 1, &bound) &&
+        !__builtin_add_overflow(bound, mag_acc, &bound) && bound <= (uint64_t)INT64_MAX) {
+        *out = (int64_t)((uint64_t)acc + (uint64_t)s);
+        return true;
+    }
+    // Large elements: check every step
+    int64_t r = acc;
+    for (size_t i = 0; i < n; i++) {
+        if (__builtin_add_overflow(r, a[i], &r)) return false;
+    }
+    *out = r;
+    return true;
+}
+
+// No 64-bit SIMD multiply to speak of: checked scalar code, in loop order
+static bool dot_ints(int64_t acc, const int64_t* a, const int64_t* b, size_t n, int64_t* out) {
+    int64_t r = acc, p;
+    for (size_t i = 0; i < n; i++) {
+        if (__builtin_mul_overflow(a[i], b[i], &p) || __builtin_add_overflow(r, p, &r)) {
+            return false;
+        }
+    }
+    *out = r;
+    return true;
+}
+
+bool kernel_reduce(MemoryManager* mm, KernelOp op, Value acc, Value a, Value b,
+                   int64_t count, Value* out) {
+    size_t n = list_length(a);
+    if (count != KERNEL_WHOLE) {
+        if (count < 0) count = 0;
+        if ((uint64_t)count > n) return false;
+        n = (size_t)count;
+    }
+    bool dot = op == KERNEL_DOT;
+    if (dot && list_length(b) < n) return false;
+    if (n == 0) {
+        value_retain(acc);
+        *out = acc;
+        return true;
+    }
+
+    const Kernels* k = kernels();
+    ContainerLayout la = list_layout(a), lb = dot ? list_layout(b) : la;
+    if (la == LAYOUT_FLOAT && lb == LAYOUT_FLOAT && is_number(acc)) {
+        double s = dot ? k->dot_f64(list_floats(a), list_floats(b), n)
+                       : k->sum_f64(list_floats(a), n);
+        *out = value_add(mm, acc, value_float(s));
+        return true;
+    }
+    int64_t r;
+    if (la == LAYOUT_INT && lb == LAYOUT_INT && value_is_int(acc) &&
+        (dot ? dot_ints(value_as_int(acc), list_ints(a), list_ints(b), n, &r)
+             : sum_ints(k, value_as_int(acc), list_ints(a), n, &r))) {
+        *out = value_int(mm, r);
+        return true;
+    }
+
+    // Generic: boxed elements, mixed layouts, or an int loop that overflows
+    Value s = acc;
+    value_retain(s);
+    for (size_t i = 0; i < n; i++) {
+        Value term = list_get(mm, a, i);
+        if (dot) {
+            Value y = list_get(mm, b, i);
+            Value p = value_mul(mm, term, y);
+            value_release(mm, term);
+            value_release(mm, y);
+            term = p;
+        }
+        Value next = value_add(mm, s, term);
+        value_release(mm, s);
+        value_release(mm, term);
+        s = next;
+    }
+    *out = s;
+    return true;
+}
@@ -0,0 +1,118 @@
+// kernels.h - Vector kernels over typed list buffers
+//
+// Element-wise arithmetic and reductions over contiguous int64_t and
+// double arrays - the items of LAYOUT_INT and LAYOUT_FLOAT lists - in
+// three instruction-set variants: portable scalar C, SSE2 and AVX2 (with
+// FMA). The best one the CPU supports is selected once, on first use;
+// kernels_for() hands out the others for tests and benchmarks.
+//
+// Every variant computes bit-identical results:
+//   - element-wise ops round exactly as the scalar expression does (min
+//     and max follow minpd/maxpd: 'a < b ? a : b', so a NaN in either
+//     operand yields b);
+//   - FMA rounds once, in every variant (the scalar ones call fma());
+//   - float sums and dot products accumulate into eight interleaved lanes
+//     combined in a fixed order, then add the tail left to right. That
+//     is a reassociation of the left-to-right loop, so the result can
+//     differ from it in the last bits - but never between variants;
+//   - int add and sub report overflow instead of wrapping, so callers can
+//     fall back to generic arithmetic (which turns overflowing ints into
+//     floats); int mul is checked scalar code in every variant, there
+//     being no 64-bit SIMD multiply before AVX-512.
+//
+// Buffers need no particular alignment (list storage is 8-byte aligned)
+// and 'dst' may be the same array as an input.
+//
+// The kernel_* functions at the end are what compiled code calls for the
+// IR_VEC_* instructions (see ir.h): they take the kernel path when the
+// lists are typed and fall back to generic Value arithmetic otherwise, so
+// they compute what the loop or map stage they replace would.
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "container.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    KERNEL_ISA_SCALAR,
+    KERNEL_ISA_SSE2,
+    KERNEL_ISA_AVX2,             // AVX2 and FMA
+    KERNEL_ISA_COUNT
+} KernelISA;
+
+typedef enum {
+    // Element-wise: dst[i] = a[i] op b[i], or a[i] op b for a broadcast operand
+    KERNEL_ADD,
+    KERNEL_SUB,
+    KERNEL_MUL,
+    KERNEL_MIN,
+    KERNEL_MAX,
+    KERNEL_FMA,                  // dst[i] = a[i] * b[i] + c[i]
+    // Reductions
+    KERNEL_SUM,                  // a[0] + a[1] + ...
+    KERNEL_DOT                   // a[0] * b[0] + a[1] * b[1] + ...
+} KernelOp;
+
+#define KERNEL_ELEMENTWISE_COUNT (KERNEL_MAX + 1)
+
+typedef void (*KernelF64)(double* dst, const double* a, const double* b, size_t n);
+typedef void (*KernelF64Broadcast)(double* dst, const double* a, double b, size_t n);
+
+// Int kernels return false if any element overflowed; dst is then unspecified
+typedef bool (*KernelI64)(int64_t* dst, const int64_t* a, const int64_t* b, size_t n);
+typedef bool (*KernelI64Broadcast)(int64_t* dst, const int64_t* a, int64_t b, size_t n);
+
+typedef struct {
+    KernelISA isa;
+    KernelF64 f64[KERNEL_ELEMENTWISE_COUNT];
+    KernelF64Broadcast f64_broadcast[KERNEL_ELEMENTWISE_COUNT];
+    KernelI64 i64[KERNEL_ELEMENTWISE_COUNT];
+    KernelI64Broadcast i64_broadcast[KERNEL_ELEMENTWISE_COUNT];
+    void (*fma_f64)(double* dst, const double* a, const double* b, const double* c, size_t n);
+    double (*sum_f64)(const double* a, size_t n);
+    double (*dot_f64)(const double* a, const double* b, size_t n);
+    // Wrapping sum. '*magnitude' gets the OR of x ^ (x >> 63) over the
+    // elements, which bounds every |x| by magnitude + 1: enough for the
+    // caller to prove that no partial sum overflowed.
+    int64_t (*sum_i64)(const int64_t* a, size_t n, uint64_t* magnitude);
+} Kernels;
+
+// The kernels for the best instruction set this CPU supports
+const Kernels* kernels(void);
+
+// The kernels for 'isa', or NULL if this build or CPU cannot run them
+const Kernels* kernels_for(KernelISA isa);
+
+const char* kernel_isa_to_string(KernelISA isa);
+const char* kernel_op_to_string(KernelOp op);
+
+// === Compiled-code entry points ===
+
+// A count meaning "every element of 'a'". Counts come from 'range(n)', so
+// a negative one means no elements.
+#define KERNEL_WHOLE INT64_MAX
+
+// 'acc' plus the KERNEL_SUM of 'a', or the KERNEL_DOT of 'a' and 'b', over
+// the first 'count' elements. Stores a new reference in '*out'. False if a
+// list is shorter than 'count', where the loop being replaced would have
+// indexed past its end. Int lists with an int 'acc' sum exactly in loop
+// order (overflow turns the result float, as in the loop); float sums
+// are reassociated as described above.
+bool kernel_reduce(MemoryManager* mm, KernelOp op, Value acc, Value a, Value b,
+                   int64_t count, Value* out);
+
+// New list of 'a[i] op b[i]' (over the shorter list), or 'a[i] op b' when
+// 'b' is a number, for an element-wise 'op'. Typed like its inputs: float
+// if either is float, int if both are int. None on allocation failure.
+Value kernel_map(MemoryManager* mm, KernelOp op, Value a, Value b);
+
+// 'out[i] = a[i] op b[i]' (or 'a[i] op b') for i < count. 'out' may be
+// 'a' or 'b'. False if a list is shorter than 'count' or allocation
+// failed.
+bool kernel_store(MemoryManager* mm, KernelOp op, Value out, Value a, Value b,
+                  int64_t count);
+
+#endif // KERNELS_H
@@ -1,5 +1,8 @@
 // memory_manager.c
 #include "memory_manager.h"
+#include "value.h"
+#include "container.h"
+#include "profiler.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,7 +14,22 @@ MemoryManager* mm_create(size_t max_heap_size) {
     if (!mm) return NULL;
     
     mm->max_heap_size = max_heap_size;
-    mm->gc_threshold = max_heap_size / 10;  // GC when 10% of heap used
+    mm->soft_limit = max_heap_size;
+    mm->gc_growth_percent = MM_GC_DEFAULT_GROWTH;
+    mm->gc_threshold = MM_GC_MIN_HEADROOM < max_heap_size ? MM_GC_MIN_HEADROOM
+                                                         : max_heap_size;
+    
+    // Common strings are preallocated once and never refcounted
+    mm->value_cache = value_cache_create(mm);
+    if (!mm->value_cache) {
+        mm_destroy(mm);
+        return NULL;
+    }
+    
+    // Lists and dicts free their element storage with them, closures and
+    // cells what they captured
+    container_register(mm);
+    closure_register(mm);
     
     return mm;
 }
@@ -20,6 +38,22 @@ MemoryManager* mm_create(size_t max_heap_size) {
 void mm_destroy(MemoryManager* mm) {
     if (!mm) return;
     
+    mm_profile_stop(mm);
+    
+    // Outstanding WeakRef handles belong to their owners; only the table goes
+    free(mm->weak_table.slots);
+    
+    // Cached objects live in arenas, freed below with the rest
+    value_cache_destroy(mm->value_cache);
+    
+    // Small objects go with their slabs
+    Slab* slab = mm->slab_list;
+    while (slab) {
+        Slab* next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    
     // Clean up all arenas
     Arena* arena = mm->arena_list;
     while (arena) {
@@ -32,65 +66,482 @@ void mm_destroy(MemoryManager* mm) {
     free(mm);
 }
 
-// Allocate with automatic reference counting
-Object* mm_alloc(MemoryManager* mm, size_t size) {
-    // Check memory limits
-    if (mm->allocated_bytes + size + sizeof(Object) > mm->max_heap_size) {
+// Under a hard limit smaller than a slab, a whole slab could never be
+// charged: small objects are charged one block at a time instead.
+static bool charge_blocks(const MemoryManager* mm) {
+    return mm->max_heap_size < MM_SLAB_SIZE;
+}
+
+size_t mm_get_footprint(MemoryManager* mm) {
+    size_t slabs = charge_blocks(mm) ? mm->small_bytes : mm->slab_count * (size_t)MM_SLAB_SIZE;
+    return (mm->allocated_bytes - mm->small_bytes) + slabs + mm->arena_bytes;
+}
+
+// footprint + bytes > limit, without overflowing
+static bool exceeds(size_t footprint, size_t bytes, size_t limit) {
+    return footprint > limit || bytes > limit - footprint;
+}
+
+// Next collection point: the surviving footprint plus the allowed growth,
+// never past the soft limit.
+static void mm_pace(MemoryManager* mm) {
+    size_t live = mm_get_footprint(mm);
+    size_t growth = live / 100 * mm->gc_growth_percent;
+    if (growth < MM_GC_MIN_HEADROOM) growth = MM_GC_MIN_HEADROOM;
+    mm->gc_threshold = exceeds(live, growth, mm->soft_limit) ? mm->soft_limit
+                                                            : live + growth;
+}
+
+void mm_set_limits(MemoryManager* mm, size_t soft_limit, size_t hard_limit) {
+    mm->max_heap_size = hard_limit;
+    mm->soft_limit = soft_limit < hard_limit ? soft_limit : hard_limit;
+    mm->soft_limit_hit = false;
+    mm_pace(mm);
+}
+
+void mm_set_limit_callback(MemoryManager* mm, MMLimitCallback callback, void* user_data) {
+    mm->limit_callback = callback;
+    mm->limit_user_data = user_data;
+}
+
+void mm_set_gc_growth(MemoryManager* mm, unsigned percent) {
+    mm->gc_growth_percent = percent;
+    mm_pace(mm);
+}
+
+void mm_set_finalizer(MemoryManager* mm, unsigned type, MMFinalizer finalizer) {
+    if (type < MM_TYPE_COUNT) mm->finalizers[type] = finalizer;
+}
+
+// Check whether 'bytes' more fit under the limits before the memory is
+// taken from the system. Crossing the soft limit collects and notifies
+// once; the hard limit collects and notifies on every refusal.
+static bool mm_reserve(MemoryManager* mm, size_t bytes) {
+    if (!exceeds(mm_get_footprint(mm), bytes, mm->soft_limit)) {
+        mm->soft_limit_hit = false;
+        return true;
+    }
+    
+    if (!mm->soft_limit_hit) {
+        mm->soft_limit_hit = true;
+        mm_collect_cycles(mm);
+        if (mm->limit_callback) {
+            mm->limit_callback(mm, MM_LIMIT_SOFT, mm_get_footprint(mm), bytes,
+                               mm->limit_user_data);
+        }
+    }
+    
+    if (exceeds(mm_get_footprint(mm), bytes, mm->max_heap_size)) {
         // Try cycle collection first
         mm_collect_cycles(mm);
         
-        if (mm->allocated_bytes + size + sizeof(Object) > mm->max_heap_size) {
-            fprintf(stderr, "Out of memory: requested %zu bytes\n", size);
-            return NULL;
+        if (exceeds(mm_get_footprint(mm), bytes, mm->max_heap_size)) {
+            bool retry = mm->limit_callback &&
+                         mm->limit_callback(mm, MM_LIMIT_HARD, mm_get_footprint(mm),
+                                            bytes, mm->limit_user_data);
+            if (retry && !exceeds(mm_get_footprint(mm), bytes, mm->max_heap_size)) {
+                return true;
+            }
+            if (!mm->limit_callback) {
+                fprintf(stderr, "Out of memory: requested %zu bytes\n", bytes);
+            }
+            return false;
         }
     }
+    return true;
+}
+
+// Record a new allocation of 'bytes' and run cycle detection if needed
+static void mm_account_alloc(MemoryManager* mm, size_t bytes) {
+    mm->allocated_bytes += bytes;
+    mm->allocation_count++;
+    mm->total_allocated += bytes;
+    if (mm->allocated_bytes > mm->peak_allocated_bytes) {
+        mm->peak_allocated_bytes = mm->allocated_bytes;
+    }
+    
+    if (mm->profiler) mm_profile_record(mm, bytes);
+    
+    // Check if we should run cycle detection
+    if (mm_get_footprint(mm) > mm->gc_threshold) {
+        mm_collect_cycles(mm);
+    }
+}
+
+static bool is_power_of_two(size_t x) {
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+// ============================================================
+// Size classes and slabs
+// ============================================================
+
+// Block sizes (header included) of the small size classes: 8-byte steps
+// up to 64, then four classes per power of two up to MM_SMALL_MAX, so
+// rounding wastes at most 25% of a block.
+static const uint16_t class_sizes[MM_SIZE_CLASS_COUNT] = {
+    16, 24, 32, 40, 48, 56, 64,
+    80, 96, 112, 128,
+    160, 192, 224, 256,
+    320, 384, 448, 512,
+    640, 768, 896, 1024
+};
+
+// Smallest class whose blocks hold 'bytes', or MM_SIZE_CLASS_LARGE.
+static unsigned size_class_for(size_t bytes) {
+    if (bytes > MM_SMALL_MAX) return MM_SIZE_CLASS_LARGE;
+    unsigned lo = 0, hi = MM_SIZE_CLASS_COUNT - 1;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (class_sizes[mid] < bytes) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Pop a block of class 'sc', carving a new slab when the free list and
+// the current slab are both exhausted. Only a new slab changes the
+// footprint, so that is where the limits are checked - or at every block
+// when blocks are what is charged.
+static void* slab_block_alloc(MemoryManager* mm, unsigned sc) {
+    SizeClass* cls = &mm->size_classes[sc];
+    size_t block = class_sizes[sc];
+    bool per_block = charge_blocks(mm);
+    if (per_block && !mm_reserve(mm, block)) return NULL;
+    
+    if (cls->free_list) {
+        void* p = cls->free_list;
+        cls->free_list = *(void**)p;
+        return p;
+    }
+    
+    if ((size_t)(cls->bump_end - cls->bump) < block) {
+        if (!per_block && !mm_reserve(mm, MM_SLAB_SIZE)) return NULL;
+        Slab* slab = (Slab*)malloc(MM_SLAB_SIZE);
+        if (!slab) return NULL;
+        slab->next = mm->slab_list;
+        mm->slab_list = slab;
+        mm->slab_count++;
+        cls->bump = (char*)(slab + 1);
+        cls->bump_end = (char*)slab + MM_SLAB_SIZE;
+    }
+    
+    void* p = cls->bump;
+    cls->bump += block;
+    return p;
+}
+
+static void slab_block_free(MemoryManager* mm, unsigned sc, void* p) {
+    SizeClass* cls = &mm->size_classes[sc];
+    *(void**)p = cls->free_list;
+    cls->free_list = p;
+}
+
+// Offset from the start of a large block to its Object, chosen so that
+// the payload lands on an 'alignment' boundary when the block itself
+// starts on one.
+static size_t large_offset(size_t alignment) {
+    size_t headers = sizeof(LargeObjectHeader) + sizeof(Object);
+    size_t payload = (headers + alignment - 1) & ~(alignment - 1);
+    return payload - sizeof(Object);
+}
+
+// Bytes charged to the heap for an object (header and rounding included)
+static size_t object_footprint(const Object* obj) {
+    if (obj->size_class != MM_SIZE_CLASS_LARGE) return class_sizes[obj->size_class];
+    const LargeObjectHeader* large = MM_LARGE_HEADER(obj);
+    return large->offset + sizeof(Object) + large->size;
+}
+
+size_t mm_object_size(const Object* obj) {
+    if (obj->size_class != MM_SIZE_CLASS_LARGE) {
+        return class_sizes[obj->size_class] - sizeof(Object);
+    }
+    return MM_LARGE_HEADER(obj)->size;
+}
+
+// Allocate a large object whose payload is aligned to 'alignment'.
+// 'size' has already been checked against overflow.
+static Object* large_alloc(MemoryManager* mm, size_t size, size_t alignment) {
+    size_t offset = large_offset(alignment);
+    size_t bytes = offset + sizeof(Object) + size;
+    if (!mm_reserve(mm, bytes)) return NULL;
+    
+    char* block;
+    if (alignment <= MM_DEFAULT_ALIGN) {
+        block = (char*)calloc(1, bytes);
+        if (!block) return NULL;
+    } else {
+        // aligned_alloc wants a size that is a multiple of the alignment
+        size_t block_size = (bytes + alignment - 1) & ~(alignment - 1);
+        block = (char*)aligned_alloc(alignment, block_size);
+        if (!block) return NULL;
+        memset(block, 0, block_size);
+    }
+    
+    Object* obj = (Object*)(block + offset);
+    LargeObjectHeader* large = MM_LARGE_HEADER(obj);
+    large->size = size;
+    large->offset = offset;
+    obj->ref_count = 1;
+    obj->size_class = MM_SIZE_CLASS_LARGE;
+    if (alignment > MM_DEFAULT_ALIGN) obj->flags = OBJ_ALIGNED;
+    
+    mm_account_alloc(mm, bytes);
+    
+    return obj;
+}
+
+// Allocate with automatic reference counting
+Object* mm_alloc(MemoryManager* mm, size_t size) {
+    // Check memory limits
+    size_t overhead = sizeof(LargeObjectHeader) + sizeof(Object);
+    if (size > SIZE_MAX - overhead - MM_MAX_ALIGN) return NULL;
+    
+    unsigned sc = size_class_for(sizeof(Object) + size);
+    if (sc == MM_SIZE_CLASS_LARGE) return large_alloc(mm, size, MM_DEFAULT_ALIGN);
     
     // Allocate object with header
-    Object* obj = (Object*)calloc(1, sizeof(Object) + size);
+    size_t bytes = class_sizes[sc];
+    Object* obj = (Object*)slab_block_alloc(mm, sc);
     if (!obj) return NULL;
+    memset(obj, 0, bytes);
     
     obj->ref_count = 1;  // Start with reference count of 1
-    obj->size = size;
-    obj->flags = 0;
+    obj->size_class = (uint8_t)sc;
     
     // Update statistics
-    mm->allocated_bytes += sizeof(Object) + size;
-    mm->allocation_count++;
-    mm->total_allocated += sizeof(Object) + size;
+    mm->small_bytes += bytes;
+    mm_account_alloc(mm, bytes);
     
-    // Check if we should run cycle detection
-    if (mm->allocated_bytes > mm->gc_threshold) {
-        mm_collect_cycles(mm);
+    return obj;
+}
+
+// Allocate an object whose payload is aligned to 'alignment' bytes
+// (power of two, at most MM_MAX_ALIGN). Used for SIMD-ready buffers.
+Object* mm_alloc_aligned(MemoryManager* mm, size_t size, size_t alignment) {
+    if (!is_power_of_two(alignment) || alignment > MM_MAX_ALIGN) return NULL;
+    
+    // The header already keeps the payload 8-byte aligned
+    if (alignment <= MM_DEFAULT_ALIGN) return mm_alloc(mm, size);
+    
+    size_t overhead = large_offset(alignment) + sizeof(Object);
+    if (size > SIZE_MAX - overhead - alignment) return NULL;
+    
+    return large_alloc(mm, size, alignment);
+}
+
+// Allocate a zeroed array of 'count' elements, rejecting count * elem_size
+// overflow instead of silently allocating a short buffer.
+Object* mm_alloc_array(MemoryManager* mm, size_t count, size_t elem_size,
+                       size_t alignment) {
+    if (elem_size != 0 && count > SIZE_MAX / elem_size) {
+        fprintf(stderr, "Array allocation overflow: %zu x %zu bytes\n",
+                count, elem_size);
+        return NULL;
+    }
+    return mm_alloc_aligned(mm, count * elem_size, alignment);
+}
+
+// Initialize a frame-allocated object in caller-provided storage of at
+// least sizeof(LargeObjectHeader) + sizeof(Object) + size bytes. Used by
+// the STACK_OBJECT macro.
+Object* mm_stack_object_init(void* storage, size_t size) {
+    size_t offset = sizeof(LargeObjectHeader);
+    memset(storage, 0, offset + sizeof(Object) + size);
+    Object* obj = (Object*)((char*)storage + offset);
+    LargeObjectHeader* large = MM_LARGE_HEADER(obj);
+    large->size = size;
+    large->offset = offset;
+    obj->ref_count = 1;
+    obj->size_class = MM_SIZE_CLASS_LARGE;
+    obj->flags = OBJ_STACK;
+    return obj;
+}
+
+// ============================================================
+// Weak reference side table
+// ============================================================
+
+#define WEAK_TABLE_MIN_CAPACITY 16
+
+static size_t weak_hash(const Object* obj, size_t capacity) {
+    // Objects are at least 8-byte aligned; drop the constant low bits and
+    // spread the rest with a multiplicative hash.
+    uint64_t h = (uint64_t)(uintptr_t)obj >> 3;
+    h *= 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> 32) & (capacity - 1);
+}
+
+// Index of the slot holding 'obj', or of the empty slot where it would go.
+static size_t weak_find(const WeakTable* table, const Object* obj) {
+    size_t i = weak_hash(obj, table->capacity);
+    while (table->slots[i].key && table->slots[i].key != obj) {
+        i = (i + 1) & (table->capacity - 1);
+    }
+    return i;
+}
+
+static bool weak_table_grow(WeakTable* table) {
+    size_t new_cap = table->capacity ? table->capacity * 2 : WEAK_TABLE_MIN_CAPACITY;
+    WeakSlot* slots = (WeakSlot*)calloc(new_cap, sizeof(WeakSlot));
+    if (!slots) return false;
+    
+    WeakTable grown = { slots, new_cap, table->count };
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->slots[i].key) {
+            grown.slots[weak_find(&grown, table->slots[i].key)] = table->slots[i];
+        }
+    }
+    free(table->slots);
+    *table = grown;
+    return true;
+}
+
+// Remove slot 'i', shifting later members of its probe run back so that
+// lookups never need tombstones.
+static void weak_table_remove_at(WeakTable* table, size_t i) {
+    size_t mask = table->capacity - 1;
+    size_t j = i;
+    table->slots[i].key = NULL;
+    table->slots[i].refs = NULL;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!table->slots[j].key) break;
+        size_t home = weak_hash(table->slots[j].key, table->capacity);
+        // Move j into the hole unless its home lies cyclically in (i, j]
+        bool stays = (i <= j) ? (i < home && home <= j)
+                              : (i < home || home <= j);
+        if (!stays) {
+            table->slots[i] = table->slots[j];
+            table->slots[j].key = NULL;
+            table->slots[j].refs = NULL;
+            i = j;
+        }
+    }
+    table->count--;
+}
+
+// Called when a weakly referenced object is freed: null out every weak
+// reference to it. O(number of weak references to 'obj').
+static void weak_clear(MemoryManager* mm, Object* obj) {
+    WeakTable* table = &mm->weak_table;
+    size_t i = weak_find(table, obj);
+    if (!table->slots[i].key) return;
+    for (WeakRef* ref = table->slots[i].refs; ref; ) {
+        WeakRef* next = ref->next;
+        ref->target = NULL;
+        ref->next = ref->prev = NULL;
+        ref = next;
+    }
+    weak_table_remove_at(table, i);
+    obj->flags &= ~OBJ_WEAK_REFERENCED;
+}
+
+WeakRef* mm_weak_create(MemoryManager* mm, Object* target) {
+    if (!target || (target->flags & (OBJ_ARENA | OBJ_STACK))) return NULL;
+    
+    WeakTable* table = &mm->weak_table;
+    // Keep the load factor at or below 1/2
+    if ((table->count + 1) * 2 > table->capacity && !weak_table_grow(table)) {
+        return NULL;
     }
     
+    WeakRef* ref = (WeakRef*)calloc(1, sizeof(WeakRef));
+    if (!ref) return NULL;
+    ref->target = target;
+    
+    size_t i = weak_find(table, target);
+    if (!table->slots[i].key) {
+        table->slots[i].key = target;
+        table->count++;
+        target->flags |= OBJ_WEAK_REFERENCED;
+    }
+    ref->next = table->slots[i].refs;
+    if (ref->next) ref->next->prev = ref;
+    table->slots[i].refs = ref;
+    
+    mm->weak_ref_count++;
+    return ref;
+}
+
+Object* mm_weak_get(const WeakRef* ref) {
+    return ref ? ref->target : NULL;
+}
+
+Object* mm_weak_lock(WeakRef* ref) {
+    Object* obj = mm_weak_get(ref);
+    if (obj) mm_retain(obj);
     return obj;
 }
 
+void mm_weak_destroy(MemoryManager* mm, WeakRef* ref) {
+    if (!ref) return;
+    if (ref->target) {
+        if (ref->prev) {
+            ref->prev->next = ref->next;
+        } else {
+            // Head of the chain: the table slot points at it
+            WeakTable* table = &mm->weak_table;
+            size_t i = weak_find(table, ref->target);
+            table->slots[i].refs = ref->next;
+            if (!ref->next) {
+                weak_table_remove_at(table, i);
+                ref->target->flags &= ~OBJ_WEAK_REFERENCED;
+            }
+        }
+        if (ref->next) ref->next->prev = ref->prev;
+    }
+    mm->weak_ref_count--;
+    free(ref);
+}
+
+size_t mm_weak_count(MemoryManager* mm, Object* target) {
+    if (!target || !(target->flags & OBJ_WEAK_REFERENCED)) return 0;
+    size_t i = weak_find(&mm->weak_table, target);
+    size_t n = 0;
+    for (WeakRef* ref = mm->weak_table.slots[i].refs; ref; ref = ref->next) n++;
+    return n;
+}
+
 // Increment reference count
 void mm_retain(Object* obj) {
-    if (!obj || (obj->flags & OBJ_IMMORTAL)) return;
+    if (!obj || (obj->flags & (OBJ_IMMORTAL | OBJ_STACK))) return;
     
     obj->ref_count++;
 }
 
 // Decrement reference count and free if zero
 void mm_release(MemoryManager* mm, Object* obj) {
-    if (!obj || (obj->flags & OBJ_IMMORTAL)) return;
+    if (!obj || (obj->flags & (OBJ_IMMORTAL | OBJ_STACK))) return;
     
     assert(obj->ref_count > 0);
     obj->ref_count--;
     
     if (obj->ref_count == 0) {
+        if (obj->flags & OBJ_WEAK_REFERENCED) weak_clear(mm, obj);
+        
+        MMFinalizer finalize = mm->finalizers[OBJ_TYPE(obj)];
+        if (finalize) finalize(mm, obj);
+        
         // Free the object
-        mm->allocated_bytes -= sizeof(Object) + obj->size;
+        size_t bytes = object_footprint(obj);
+        mm->allocated_bytes -= bytes;
         mm->allocation_count--;
-        mm->total_freed += sizeof(Object) + obj->size;
+        mm->total_freed += bytes;
         
-        free(obj);
+        if (obj->size_class == MM_SIZE_CLASS_LARGE) {
+            free((char*)obj - MM_LARGE_HEADER(obj)->offset);
+        } else {
+            mm->small_bytes -= bytes;
+            slab_block_free(mm, obj->size_class, obj);
+        }
     }
 }
-// Create a new arena for fast allocation
-Arena* mm_arena_create(MemoryManager* mm, size_t size) {
+static Arena* arena_create(MemoryManager* mm, size_t size, bool charged) {
+    // Arena chunks count against the same limits as the heap
+    if (charged && !mm_reserve(mm, size)) return NULL;
+    
     Arena* arena = (Arena*)calloc(1, sizeof(Arena));
     if (!arena) return NULL;
     
@@ -103,6 +554,8 @@ Arena* mm_arena_create(MemoryManager* mm, size_t size) {
     arena->current = arena->start;
     arena->end = arena->start + size;
     arena->chunk_size = size;
+    arena->uncharged = !charged;
+    if (charged) mm->arena_bytes += size;
     
     // Add to arena list
     arena->next = mm->arena_list;
@@ -111,20 +564,51 @@ Arena* mm_arena_create(MemoryManager* mm, size_t size) {
     return arena;
 }
 
+// Create a new arena for fast allocation
+Arena* mm_arena_create(MemoryManager* mm, size_t size) {
+    return arena_create(mm, size, true);
+}
+
+// An arena for the manager's own preallocated data, which every manager
+// has whatever its limits
+Arena* mm_arena_create_uncharged(MemoryManager* mm, size_t size) {
+    return arena_create(mm, size, false);
+}
+
 // Allocate from arena (no individual frees)
 void* mm_arena_alloc(Arena* arena, size_t size) {
-    // Align to 8 bytes
-    size = (size + 7) & ~7;
+    return mm_arena_alloc_aligned(arena, size, MM_DEFAULT_ALIGN);
+}
+
+// Allocate from arena with an explicit power-of-two alignment. The bump
+// pointer is aligned rather than the size, so byte buffers with
+// alignment 1 pack tightly and SIMD buffers can ask for up to 64 bytes.
+void* mm_arena_alloc_aligned(Arena* arena, size_t size, size_t alignment) {
+    if (!arena || !is_power_of_two(alignment) || alignment > MM_MAX_ALIGN) {
+        return NULL;
+    }
+    
+    uintptr_t current = (uintptr_t)arena->current;
+    uintptr_t aligned = (current + alignment - 1) & ~(uintptr_t)(alignment - 1);
     
-    if (arena->current + size > arena->end) {
+    if (aligned > (uintptr_t)arena->end ||
+        size > (size_t)((uintptr_t)arena->end - aligned)) {
         // Arena is full
         return NULL;
     }
     
-    void* ptr = arena->current;
-    arena->current += size;
+    arena->current = (char*)(aligned + size);
     
-    return ptr;
+    return (void*)aligned;
+}
+
+// Allocate an array from arena, rejecting count * elem_size overflow
+void* mm_arena_alloc_array(Arena* arena, size_t count, size_t elem_size,
+                           size_t alignment) {
+    if (elem_size != 0 && count > SIZE_MAX / elem_size) {
+        return NULL;
+    }
+    return mm_arena_alloc_aligned(arena, count * elem_size, alignment);
 }
 
 // Reset arena (free all at once)
@@ -144,6 +628,7 @@ void mm_arena_destroy(MemoryManager* mm, Arena* arena) {
     
     if (*prev) {
         *prev = arena->next;
+        if (!arena->uncharged) mm->arena_bytes -= arena->chunk_size;
     }
     
     free(arena->start);
@@ -159,6 +644,9 @@ void mm_collect_cycles(MemoryManager* mm) {
         fprintf(stderr, "GC: %zu cycles run, %zu bytes allocated\n", 
                 mm->gc_cycles, mm->allocated_bytes);
     }
+    
+    // Schedule the next collection from what survived this one
+    mm_pace(mm);
 }
 
 // Get current allocated bytes
@@ -166,15 +654,29 @@ size_t mm_get_allocated_bytes(MemoryManager* mm) {
     return mm->allocated_bytes;
 }
 
+size_t mm_get_peak_allocated_bytes(MemoryManager* mm) {
+    return mm->peak_allocated_bytes;
+}
+
+void mm_reset_peak(MemoryManager* mm) {
+    mm->peak_allocated_bytes = mm->allocated_bytes;
+}
+
 // Print memory statistics
 void mm_print_stats(MemoryManager* mm) {
     printf("Memory Statistics:\n");
     printf("  Currently allocated: %zu bytes in %zu objects\n", 
            mm->allocated_bytes, mm->allocation_count);
+    printf("  Peak allocated: %zu bytes\n", mm->peak_allocated_bytes);
     printf("  Total allocated: %zu bytes\n", mm->total_allocated);
     printf("  Total freed: %zu bytes\n", mm->total_freed);
     printf("  GC cycles: %zu\n", mm->gc_cycles);
-    printf("  Max heap size: %zu bytes\n", mm->max_heap_size);
+    printf("  Weak references: %zu to %zu objects\n",
+           mm->weak_ref_count, mm->weak_table.count);
+    printf("  Footprint: %zu bytes (soft limit %zu, hard limit %zu)\n",
+           mm_get_footprint(mm), mm->soft_limit, mm->max_heap_size);
+    printf("  Next GC at: %zu bytes (growth %u%%)\n",
+           mm->gc_threshold, mm->gc_growth_percent);
     
     // Count arenas
     size_t arena_count = 0;
@@ -187,4 +689,8 @@ void mm_print_stats(MemoryManager* mm) {
     }
     
     printf("  Arenas: %zu using %zu bytes\n", arena_count, arena_bytes);
+    printf("  Immortal strings: %zu (%zu interned)\n",
+           value_cache_string_count(mm), value_cache_interned_count(mm));
+    printf("  Slabs: %zu using %zu bytes\n", mm->slab_count,
+           mm->slab_count * (size_t)MM_SLAB_SIZE);
 }
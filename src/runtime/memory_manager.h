@@ -10,21 +10,59 @@
 typedef struct Object Object;
 typedef struct Arena Arena;
 typedef struct MemoryManager MemoryManager;
+typedef struct ValueCache ValueCache;
+typedef struct AllocProfiler AllocProfiler;
 
-// Object header for all managed objects
+// Object header for all managed objects. Kept to 8 bytes: the byte size
+// is recovered from the size class, free-list links live in the freed
+// blocks themselves, and the type id shares the flags word.
 typedef struct Object {
     uint32_t ref_count;      // Reference count for automatic management
-    uint16_t flags;          // GC flags, object type, etc.
-    uint16_t size;           // Size of allocation
-    struct Object* next;     // For free list or GC traversal
+    uint16_t flags;          // OBJ_* bits (low byte) and type id (high byte)
+    uint8_t size_class;      // Index into the size class table, or MM_SIZE_CLASS_LARGE
+    uint8_t reserved;
     // Actual object data follows this header
 } Object;
 
+// Payload of a managed object (data begins right after the header)
+#define MM_OBJECT_DATA(obj) ((void*)((Object*)(obj) + 1))
+
 // Object flags
 #define OBJ_MARKED    0x0001  // For cycle detection
 #define OBJ_IMMORTAL  0x0002  // Never free this object
 #define OBJ_ARENA     0x0004  // Allocated in arena
 #define OBJ_STACK     0x0008  // Stack allocated
+#define OBJ_ALIGNED   0x0010  // Payload over-aligned; padding precedes header
+#define OBJ_WEAK_REFERENCED 0x0020  // Has entries in the weak reference table
+
+// Type id, stored in the high byte of flags (0 = untyped)
+#define OBJ_TYPE_SHIFT       8
+#define OBJ_TYPE_MASK        0xFF00
+#define OBJ_TYPE(obj)        (((obj)->flags & OBJ_TYPE_MASK) >> OBJ_TYPE_SHIFT)
+#define OBJ_SET_TYPE(obj, t) ((obj)->flags = (uint16_t)(((obj)->flags & ~OBJ_TYPE_MASK) | \
+                                                        (((t) & 0xFF) << OBJ_TYPE_SHIFT)))
+
+// Size classes. Objects whose header plus payload fit in MM_SMALL_MAX
+// bytes are carved out of per-class slabs and rounded up to the class
+// size. Anything bigger, over-aligned, or frame-allocated takes the
+// large-object path: a LargeObjectHeader just before the Object records
+// the exact payload size and where the underlying block starts.
+#define MM_SIZE_CLASS_COUNT  23
+#define MM_SIZE_CLASS_LARGE  0xFF
+#define MM_SMALL_MAX         1024
+#define MM_SLAB_SIZE         (64 * 1024)
+
+typedef struct {
+    size_t size;             // Payload bytes
+    size_t offset;           // Bytes from the start of the block to the Object
+} LargeObjectHeader;
+
+#define MM_LARGE_HEADER(obj) ((LargeObjectHeader*)(obj) - 1)
+
+// Alignment limits. Arena and aligned heap allocations accept any power of
+// two up to one cache line; plain mm_arena_alloc keeps the 8-byte default.
+#define MM_DEFAULT_ALIGN  8
+#define MM_MAX_ALIGN      64
 
 // Arena allocator for performance-critical sections
 typedef struct Arena {
@@ -33,8 +71,81 @@ typedef struct Arena {
     char* end;
     struct Arena* next;
     size_t chunk_size;
+    bool uncharged;          // Not counted against the limits
 } Arena;
 
+// Weak reference. Does not keep its target alive: when the target's
+// reference count drops to zero, 'target' is set to NULL. Weak references
+// to one object are chained together and found through the manager's
+// weak table, so objects that are never weakly referenced pay nothing
+// beyond the OBJ_WEAK_REFERENCED flag test in mm_release.
+typedef struct WeakRef {
+    Object* target;          // NULL once the target has been freed
+    struct WeakRef* next;    // Other weak references to the same target
+    struct WeakRef* prev;
+} WeakRef;
+
+// Side table: object -> head of its weak reference chain. Open addressing
+// with linear probing; a NULL key marks an empty slot.
+typedef struct {
+    Object* key;
+    WeakRef* refs;
+} WeakSlot;
+
+typedef struct {
+    WeakSlot* slots;
+    size_t capacity;         // Power of two (or 0 before first use)
+    size_t count;            // Occupied slots
+} WeakTable;
+
+// Slabs back the small size classes. Each slab serves a single class;
+// freed blocks are threaded onto the class's free list through their
+// first word, so live objects carry no link pointer.
+typedef struct Slab {
+    struct Slab* next;
+    size_t pad_;             // Keeps the blocks after it 16-byte aligned
+} Slab;
+
+typedef struct {
+    void* free_list;         // Freed blocks of this class
+    char* bump;              // Unused tail of the class's newest slab
+    char* bump_end;
+} SizeClass;
+
+// Memory limits. The footprint - live large objects, every slab, every
+// arena chunk - is what gets checked, so arenas count like the heap. Two
+// exceptions keep small limits usable: the value cache's preallocated
+// strings are not counted, and under a hard limit smaller than one slab
+// slabs are charged by the blocks in use rather than in full.
+// Past the soft limit the manager collects and notifies once per
+// excursion but keeps allocating; past the hard limit it collects,
+// notifies, and fails the allocation unless the callback freed enough.
+#define MM_UNLIMITED SIZE_MAX
+
+typedef enum {
+    MM_LIMIT_SOFT,
+    MM_LIMIT_HARD
+} MMLimitEvent;
+
+// Return true from a MM_LIMIT_HARD notification after releasing memory
+// to have the allocation retried; the return value is ignored for
+// MM_LIMIT_SOFT.
+typedef bool (*MMLimitCallback)(MemoryManager* mm, MMLimitEvent event,
+                                size_t footprint, size_t requested, void* user_data);
+
+// GC pacer: after each collection the next one is scheduled once the
+// footprint grows by gc_growth_percent of what survived (at least
+// MM_GC_MIN_HEADROOM), capped at the soft limit.
+#define MM_GC_DEFAULT_GROWTH 100
+#define MM_GC_MIN_HEADROOM   (4 * 1024 * 1024)
+
+// Finalizers, one per object type id. Called when an object's reference
+// count drops to zero, just before its storage is freed, so an object can
+// release what its payload refers to (a list's elements, for one).
+#define MM_TYPE_COUNT 256
+
+typedef void (*MMFinalizer)(MemoryManager* mm, Object* obj);
+
 // Main memory manager
 typedef struct MemoryManager {
     // Reference counting
@@ -46,28 +157,87 @@ typedef struct MemoryManager {
     Arena* current_arena;
     Arena* arena_list;
     
+    // Small-object slabs, one free list per size class
+    SizeClass size_classes[MM_SIZE_CLASS_COUNT];
+    Slab* slab_list;
+    size_t slab_count;
+    
+    // Immortal preallocated values (value.c), built by mm_create
+    ValueCache* value_cache;
+    
+    // Per-type finalizers, indexed by OBJ_TYPE
+    MMFinalizer finalizers[MM_TYPE_COUNT];
+    
+    // Weak references, keyed by target object
+    WeakTable weak_table;
+    size_t weak_ref_count;   // Live WeakRef handles
+    
+    // Footprint beyond live objects
+    size_t small_bytes;      // Live small objects (part of allocated_bytes)
+    size_t arena_bytes;      // Chunks owned by arenas
+    
     // Memory limits
-    size_t max_heap_size;
-    size_t gc_threshold;
+    size_t max_heap_size;    // Hard limit on the footprint
+    size_t soft_limit;       // Defaults to the hard limit
+    bool soft_limit_hit;     // Soft notification sent for this excursion
+    MMLimitCallback limit_callback;
+    void* limit_user_data;
+    
+    // Collection pacing
+    size_t gc_threshold;     // Collect when the footprint passes this
+    unsigned gc_growth_percent;
+    
+    // Sampling allocation profiler (profiler.c); NULL when disabled
+    AllocProfiler* profiler;
     
     // Statistics
+    size_t peak_allocated_bytes;  // High-water mark of allocated_bytes
     size_t total_allocated;
     size_t total_freed;
     size_t gc_cycles;
 } MemoryManager;
 
-// Core API
+// Core API. 'max_heap_size' is the hard limit (MM_UNLIMITED for none).
 MemoryManager* mm_create(size_t max_heap_size);
 void mm_destroy(MemoryManager* mm);
 
+// Limit policy
+void mm_set_limits(MemoryManager* mm, size_t soft_limit, size_t hard_limit);
+void mm_set_limit_callback(MemoryManager* mm, MMLimitCallback callback, void* user_data);
+void mm_set_gc_growth(MemoryManager* mm, unsigned percent);
+
+// Install (or with NULL, remove) the finalizer for objects of 'type'
+void mm_set_finalizer(MemoryManager* mm, unsigned type, MMFinalizer finalizer);
+
 // Automatic memory management (default)
 Object* mm_alloc(MemoryManager* mm, size_t size);
+Object* mm_alloc_aligned(MemoryManager* mm, size_t size, size_t alignment);
+Object* mm_alloc_array(MemoryManager* mm, size_t count, size_t elem_size,
+                       size_t alignment);
 void mm_retain(Object* obj);
 void mm_release(MemoryManager* mm, Object* obj);
 
+// Usable payload bytes of an object (at least what was requested; small
+// objects report their size class's full capacity)
+size_t mm_object_size(const Object* obj);
+
+// Weak references. Objects in arenas or stack frames cannot be weakly
+// referenced (their storage is not released through mm_release), and
+// mm_weak_create returns NULL for them. Every WeakRef must be destroyed
+// before the memory manager.
+WeakRef* mm_weak_create(MemoryManager* mm, Object* target);
+Object* mm_weak_get(const WeakRef* ref);                 // Borrowed; NULL if freed
+Object* mm_weak_lock(WeakRef* ref);                      // Retained; NULL if freed
+void mm_weak_destroy(MemoryManager* mm, WeakRef* ref);
+size_t mm_weak_count(MemoryManager* mm, Object* target); // Weak refs to target
+
 // Arena allocation for performance
 Arena* mm_arena_create(MemoryManager* mm, size_t size);
+Arena* mm_arena_create_uncharged(MemoryManager* mm, size_t size);  // Outside the limits
 void* mm_arena_alloc(Arena* arena, size_t size);
+void* mm_arena_alloc_aligned(Arena* arena, size_t size, size_t alignment);
+void* mm_arena_alloc_array(Arena* arena, size_t count, size_t elem_size,
+                           size_t alignment);
 void mm_arena_reset(Arena* arena);
 void mm_arena_destroy(MemoryManager* mm, Arena* arena);
 
@@ -76,11 +246,25 @@ void mm_arena_destroy(MemoryManager* mm, Arena* arena);
     type name[count]; \
     memset(name, 0, sizeof(type) * (count))
 
+// Frame allocation for objects the compiler proved never leave their
+// function (AST_FLAG_STACK_ALLOC). The header is marked OBJ_STACK, so
+// retain/release are no-ops and the storage dies with the frame. Frame
+// objects use the large-object layout so their exact size is recorded.
+#define STACK_OBJECT(name, payload_size) \
+    _Alignas(16) unsigned char name##_storage[sizeof(LargeObjectHeader) + \
+                                              sizeof(Object) + (payload_size)]; \
+    Object* name = mm_stack_object_init(name##_storage, (payload_size))
+
+Object* mm_stack_object_init(void* storage, size_t size);
+
 // Cycle detection and collection
 void mm_collect_cycles(MemoryManager* mm);
 
 // Memory introspection
-size_t mm_get_allocated_bytes(MemoryManager* mm);
+size_t mm_get_allocated_bytes(MemoryManager* mm);   // Live objects only
+size_t mm_get_footprint(MemoryManager* mm);         // What the limits see
+size_t mm_get_peak_allocated_bytes(MemoryManager* mm);
+void mm_reset_peak(MemoryManager* mm);              // Restart the high-water mark from now
 void mm_print_stats(MemoryManager* mm);
 
 #endif // MEMORY_MANAGER_H
@@ -0,0 +1,428 @@
+// pipeline.c - Fused, lazy pipeline execution
+#include "pipeline.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PIPE_LIST_MIN_CAPACITY 16
+
+void pipe_init(Pipeline* p, MemoryManager* mm, const Value* items, size_t count) {
+    memset(p, 0, sizeof(*p));
+    p->mm = mm;
+    p->items = items;
+    p->count = count;
+}
+
+static PipeStage* add_stage(Pipeline* p, PipeStageKind kind) {
+    if (p->stage_count >= PIPE_MAX_STAGES) return NULL;
+    PipeStage* s = &p->stages[p->stage_count++];
+    memset(s, 0, sizeof(*s));
+    s->kind = kind;
+    return s;
+}
+
+bool pipe_map(Pipeline* p, PipeMapFn fn, void* ctx) {
+    PipeStage* s = add_stage(p, PIPE_MAP);
+    if (!s) return false;
+    s->map = fn;
+    s->ctx = ctx;
+    return true;
+}
+
+bool pipe_filter(Pipeline* p, PipePredFn fn, void* ctx) {
+    PipeStage* s = add_stage(p, PIPE_FILTER);
+    if (!s) return false;
+    s->pred = fn;
+    s->ctx = ctx;
+    return true;
+}
+
+bool pipe_take(Pipeline* p, size_t n) {
+    PipeStage* s = add_stage(p, PIPE_TAKE);
+    if (!s) return false;
+    s->limit = n;
+    if (n == 0) p->exhausted = true;
+    return true;
+}
+
+// Run 'v' through stages [first, last). 'owned' says whether the caller
+// hands over a reference (source items are borrowed, everything a stage
+// produces is owned); the value stored in 'out' always is.
+static bool run_stages(Pipeline* p, int first, int last, Value v, bool owned, Value* out) {
+    for (int i = first; i < last; i++) {
+        PipeStage* s = &p->stages[i];
+        switch (s->kind) {
+            case PIPE_MAP: {
+                Value next = s->map(p->mm, v, s->ctx);
+                if (owned) value_release(p->mm, v);
+                v = next;
+                owned = true;
+                break;
+            }
+            case PIPE_FILTER:
+                if (!s->pred(v, s->ctx)) {
+                    if (owned) value_release(p->mm, v);
+                    return false;
+                }
+                break;
+            case PIPE_TAKE:
+                // Full stages set 'exhausted' before anything reaches them
+                if (++s->passed == s->limit) p->exhausted = true;
+                break;
+        }
+    }
+    if (!owned) value_retain(v);
+    *out = v;
+    return true;
+}
+
+bool pipe_next(Pipeline* p, Value* out) {
+    while (!p->exhausted && p->next < p->count) {
+        if (run_stages(p, 0, p->stage_count, p->items[p->next++], false, out)) return true;
+    }
+    return false;
+}
+
+static bool list_grow(MemoryManager* mm, PipeList* list) {
+    size_t capacity = list->capacity ? list->capacity * 2 : PIPE_LIST_MIN_CAPACITY;
+    Object* storage = mm_alloc_array(mm, capacity, sizeof(Value), _Alignof(Value));
+    if (!storage) return false;
+    Value* items = (Value*)MM_OBJECT_DATA(storage);
+    if (list->count > 0) memcpy(items, list->items, sizeof(Value) * list->count);
+    if (list->storage) mm_release(mm, list->storage);
+    list->storage = storage;
+    list->items = items;
+    list->capacity = capacity;
+    return true;
+}
+
+// Append an owned value; on failure the value is released
+static bool list_push(MemoryManager* mm, PipeList* list, Value v) {
+    if (list->count == list->capacity && !list_grow(mm, list)) {
+        value_release(mm, v);
+        return false;
+    }
+    list->items[list->count++] = v;
+    return true;
+}
+
+bool pipe_collect(Pipeline* p, PipeList* out) {
+    memset(out, 0, sizeof(*out));
+    Value v;
+    while (pipe_next(p, &v)) {
+        if (!list_push(p->mm, out, v)) return false;
+    }
+    return true;
+}
+
+bool pipe_find_first(Pipeline* p, PipePredFn pred, void* ctx, Value* out) {
+    Value v;
+    while (pipe_next(p, &v)) {
+        if (pred(v, ctx)) {
+            *out = v;
+            return true;
+        }
+        value_release(p->mm, v);
+    }
+    return false;
+}
+
+Value pipe_fold(Pipeline* p, Value init, PipeFoldFn fn, void* ctx) {
+    Value acc = init;
+    Value v;
+    while (pipe_next(p, &v)) {
+        acc = fn(p->mm, acc, v, ctx);
+        value_release(p->mm, v);
+    }
+    return acc;
+}
+
+void pipe_list_free(MemoryManager* mm, PipeList* list) {
+    for (size_t i = 0; i < list->count; i++) value_release(mm, list->items[i]);
+    if (list->storage) mm_release(mm, list->storage);
+    memset(list, 0, sizeof(*list));
+}
+
+// === Parallel stages ===
+//
+// Stage i reads rings[i - 1] (stage 0 reads the source) and writes
+// rings[i] (the last stage appends to the output list). Each ring has one
+// producer and one consumer, so head and tail are plain counters: the
+// consumer publishes 'head' after reading a batch, the producer publishes
+// 'tail' after writing one, and each side reads the other's counter once
+// per batch.
+//
+// A stage task never blocks. It runs batches while it has a full one
+// waiting (or its producer is done) and room for a full one downstream,
+// then clears its 'scheduled' flag and rechecks. Whoever changes what it
+// was waiting for - its producer publishing, its consumer freeing space,
+// its producer finishing - wakes it by setting the flag and spawning it.
+// At most one task per stage is live, so a stage's state (the source
+// cursor, a take counter) is only ever touched by one thread at a time.
+// When no task is scheduled, the group wait returns: either the last stage
+// has finished, or a full take stopped everything before it.
+
+#define CACHE_LINE 64
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_size_t head;  // Written by the consumer
+    _Alignas(CACHE_LINE) atomic_size_t tail;  // Written by the producer
+    _Alignas(CACHE_LINE) Value* slots;
+    size_t mask;                              // Capacity - 1, a power of two
+} PipeRing;
+
+typedef struct ParallelRun ParallelRun;
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_int scheduled;  // Spawned or running
+    atomic_bool done;                           // Will produce nothing more
+    ParallelRun* run;
+    int index;
+} StageTask;
+
+struct ParallelRun {
+    Pipeline* p;
+    Scheduler* sched;
+    TaskGroup group;
+    size_t batch;
+    PipeRing* rings;             // rings[i] connects stage i to stage i + 1
+    StageTask* tasks;
+    PipeList* out;
+    atomic_int stop_before;      // Stages before this index stop: a take is full
+    bool failed;                 // The output list could not grow (last stage only)
+    atomic_ulong batches;
+    atomic_ulong wakeups;
+    atomic_ulong stalls;
+};
+
+typedef enum {
+    STAGE_READY,
+    STAGE_WAITING,               // For input
+    STAGE_STALLED,               // For room downstream
+    STAGE_FINISHED
+} StageState;
+
+static void stage_task(void* arg);
+
+static void wake_stage(ParallelRun* r, int i) {
+    StageTask* t = &r->tasks[i];
+    int idle = 0;
+    // Pairs with the fence in stage_task: either the stage sees our
+    // update on its recheck, or we see its flag cleared
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_compare_exchange_strong(&t->scheduled, &idle, 1)) {
+        atomic_fetch_add_explicit(&r->wakeups, 1, memory_order_relaxed);
+        sched_spawn(r->sched, &r->group, stage_task, t);
+    }
+}
+
+// The part of a stage's state that only its own task changes. It is read
+// while the task owns the stage, so the recheck after letting go never
+// races with the next task.
+typedef struct {
+    size_t source_left;          // Stage 0: source items not pulled yet
+    bool take_full;
+} StageOwn;
+
+static StageOwn stage_own(ParallelRun* r, int i) {
+    Pipeline* p = r->p;
+    PipeStage* s = &p->stages[i];
+    StageOwn own;
+    own.source_left = i == 0 ? p->count - p->next : 0;
+    own.take_full = s->kind == PIPE_TAKE && s->passed >= s->limit;
+    return own;
+}
+
+// Can stage i run a batch, and of how many items?
+static StageState stage_state(ParallelRun* r, int i, StageOwn own, size_t* n) {
+    Pipeline* p = r->p;
+    if (i < atomic_load(&r->stop_before) || own.take_full) return STAGE_FINISHED;
+
+    size_t avail;
+    bool producer_done;
+    if (i == 0) {
+        avail = own.source_left;
+        producer_done = true;
+    } else {
+        // Read 'done' first: once it is set, 'tail' is final
+        producer_done = atomic_load(&r->tasks[i - 1].done);
+        PipeRing* in = &r->rings[i - 1];
+        avail = atomic_load_explicit(&in->tail, memory_order_acquire) -
+                atomic_load_explicit(&in->head, memory_order_relaxed);
+    }
+    if (avail == 0) return producer_done ? STAGE_FINISHED : STAGE_WAITING;
+    if (avail < r->batch && !producer_done) return STAGE_WAITING;
+
+    if (i + 1 < p->stage_count) {
+        PipeRing* out = &r->rings[i];
+        size_t used = atomic_load_explicit(&out->tail, memory_order_relaxed) -
+                      atomic_load_explicit(&out->head, memory_order_acquire);
+        if (out->mask + 1 - used < r->batch) return STAGE_STALLED;
+    }
+    *n = avail < r->batch ? avail : r->batch;
+    return STAGE_READY;
+}
+
+static void stage_run_batch(ParallelRun* r, int i, size_t n) {
+    Pipeline* p = r->p;
+    PipeStage* s = &p->stages[i];
+    bool last = i + 1 == p->stage_count;
+    PipeRing* in = i > 0 ? &r->rings[i - 1] : NULL;
+    PipeRing* out = last ? NULL : &r->rings[i];
+    size_t head = in ? atomic_load_explicit(&in->head, memory_order_relaxed) : 0;
+    size_t tail = out ? atomic_load_explicit(&out->tail, memory_order_relaxed) : 0;
+    size_t emitted = 0;
+
+    for (size_t k = 0; k < n; k++) {
+        Value v = in ? in->slots[(head + k) & in->mask] : p->items[p->next++];
+        if (s->kind == PIPE_TAKE && s->passed >= s->limit) {
+            if (in) value_release(p->mm, v);  // Past the limit: dropped
+            continue;
+        }
+        Value result;
+        if (!run_stages(p, i, i + 1, v, in != NULL, &result)) continue;
+        assert(!value_is_object(result));  // Released on other threads (see pipeline.h)
+        if (out) {
+            out->slots[(tail + emitted++) & out->mask] = result;
+        } else if (r->failed) {
+            value_release(p->mm, result);
+        } else if (!list_push(p->mm, r->out, result)) {
+            r->failed = true;
+            atomic_store(&r->stop_before, p->stage_count);
+        }
+    }
+    atomic_fetch_add_explicit(&r->batches, 1, memory_order_relaxed);
+
+    if (s->kind == PIPE_TAKE && s->passed >= s->limit) {
+        int stop = atomic_load(&r->stop_before);
+        while (i > stop && !atomic_compare_exchange_weak(&r->stop_before, &stop, i)) {}
+    }
+    if (in) {
+        atomic_store_explicit(&in->head, head + n, memory_order_release);
+        wake_stage(r, i - 1);
+    }
+    if (emitted > 0) {
+        atomic_store_explicit(&out->tail, tail + emitted, memory_order_release);
+        wake_stage(r, i + 1);
+    }
+}
+
+static void stage_task(void* arg) {
+    StageTask* t = (StageTask*)arg;
+    ParallelRun* r = t->run;
+    int i = t->index;
+    for (;;) {
+        size_t n = 0;
+        StageState state;
+        while ((state = stage_state(r, i, stage_own(r, i), &n)) == STAGE_READY) {
+            stage_run_batch(r, i, n);
+        }
+        if (state == STAGE_FINISHED) {
+            // 'scheduled' stays set: a finished stage is never spawned again
+            atomic_store(&t->done, true);
+            if (i + 1 < r->p->stage_count) wake_stage(r, i + 1);
+            return;
+        }
+        if (state == STAGE_STALLED) {
+            atomic_fetch_add_explicit(&r->stalls, 1, memory_order_relaxed);
+        }
+
+        StageOwn own = stage_own(r, i);
+        atomic_store(&t->scheduled, 0);
+        atomic_thread_fence(memory_order_seq_cst);
+        state = stage_state(r, i, own, &n);
+        if (state == STAGE_WAITING || state == STAGE_STALLED) return;
+        int idle = 0;
+        if (!atomic_compare_exchange_strong(&t->scheduled, &idle, 1)) return;  // Already woken
+    }
+}
+
+static void launch_stages(void* arg) {
+    ParallelRun* r = (ParallelRun*)arg;
+    wake_stage(r, 0);
+    sched_wait(r->sched, &r->group);
+}
+
+static void* alloc_lines(size_t bytes) {
+    return aligned_alloc(CACHE_LINE, (bytes + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1));
+}
+
+// Would running the stages concurrently touch the memory manager from
+// more than one thread? Only through heap objects: releasing anything
+// else is a no-op.
+static bool heap_source(const Pipeline* p) {
+    for (size_t k = p->next; k < p->count; k++) {
+        if (value_is_object(p->items[k])) return true;
+    }
+    return false;
+}
+
+bool pipe_collect_parallel(Pipeline* p, Scheduler* sched, size_t batch,
+                           PipeList* out, PipeParallelStats* stats) {
+    if (stats) memset(stats, 0, sizeof(*stats));
+    if (p->stage_count < 2 || p->exhausted || heap_source(p)) return pipe_collect(p, out);
+    memset(out, 0, sizeof(*out));
+    if (batch == 0) batch = 1;
+
+    int n = p->stage_count;
+    ParallelRun r;
+    memset(&r, 0, sizeof(r));
+    r.p = p;
+    r.sched = sched;
+    r.batch = batch;
+    r.out = out;
+    atomic_init(&r.stop_before, 0);
+    atomic_init(&r.batches, 0);
+    atomic_init(&r.wakeups, 0);
+    atomic_init(&r.stalls, 0);
+    sched_group_init(&r.group);
+
+    size_t capacity = 1;
+    while (capacity < batch * PIPE_RING_BATCHES) capacity <<= 1;
+    r.tasks = (StageTask*)alloc_lines(sizeof(StageTask) * n);
+    r.rings = (PipeRing*)alloc_lines(sizeof(PipeRing) * (n - 1));
+    bool ok = r.tasks && r.rings;
+    for (int i = 0; ok && i < n - 1; i++) {
+        PipeRing* ring = &r.rings[i];
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->tail, 0);
+        ring->mask = capacity - 1;
+        ring->slots = (Value*)malloc(sizeof(Value) * capacity);
+        if (!ring->slots) {
+            for (int j = 0; j < i; j++) free(r.rings[j].slots);
+            ok = false;
+        }
+    }
+    if (!ok) {
+        free(r.tasks);
+        free(r.rings);
+        return false;
+    }
+    for (int i = 0; i < n; i++) {
+        atomic_init(&r.tasks[i].scheduled, 0);
+        atomic_init(&r.tasks[i].done, false);
+        r.tasks[i].run = &r;
+        r.tasks[i].index = i;
+    }
+
+    sched_run(sched, launch_stages, &r);
+
+    // A full take or a failed append leaves values in the rings
+    for (int i = 0; i < n - 1; i++) {
+        PipeRing* ring = &r.rings[i];
+        size_t tail = atomic_load(&ring->tail);
+        for (size_t k = atomic_load(&ring->head); k != tail; k++) {
+            value_release(p->mm, ring->slots[k & ring->mask]);
+        }
+        free(ring->slots);
+    }
+    free(r.tasks);
+    free(r.rings);
+
+    if (stats) {
+        stats->batches = atomic_load(&r.batches);
+        stats->wakeups = atomic_load(&r.wakeups);
+        stats->stalls = atomic_load(&r.stalls);
+    }
+    return !r.failed;
+}
@@ -0,0 +1,125 @@
+// pipeline.h - Fused, lazy pipelines over Values
+//
+// The runtime side of `xs |> map(f) |> filter(p) |> take(n) |> ...`.
+// Stages are recorded on a Pipeline and run one element at a time: an
+// element pulled from the source flows through every stage before the
+// next one is pulled, so no intermediate list is ever built. Nothing runs
+// until a consumer asks for output, and consumers that only need a prefix
+// (pipe_find_first, or a take stage) stop pulling as soon as they have
+// it. pipe_collect is the materialization point at the end of a chain.
+//
+// pipe_collect_parallel is the other execution mode, for chains whose
+// stages are expensive: every stage runs as its own task on a Scheduler,
+// connected to the next by a bounded ring, so the stages overlap.
+//
+// Ownership: source items are borrowed. Map functions borrow their input
+// and return a new reference; the pipeline releases intermediate values a
+// filter drops. Every value a consumer hands out is owned by the caller.
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "value.h"
+#include "scheduler.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef Value (*PipeMapFn)(MemoryManager* mm, Value v, void* ctx);
+typedef bool (*PipePredFn)(Value v, void* ctx);
+// Consumes 'acc', borrows 'v', returns the new accumulator
+typedef Value (*PipeFoldFn)(MemoryManager* mm, Value acc, Value v, void* ctx);
+
+typedef enum {
+    PIPE_MAP,
+    PIPE_FILTER,
+    PIPE_TAKE
+} PipeStageKind;
+
+typedef struct {
+    PipeStageKind kind;
+    PipeMapFn map;
+    PipePredFn pred;
+    void* ctx;
+    size_t limit;            // PIPE_TAKE: items to let through
+    size_t passed;           // PIPE_TAKE: let through so far
+} PipeStage;
+
+#define PIPE_MAX_STAGES 16
+
+typedef struct {
+    MemoryManager* mm;
+    const Value* items;      // Source (borrowed)
+    size_t count;
+    size_t next;             // Source items pulled so far
+    PipeStage stages[PIPE_MAX_STAGES];
+    int stage_count;
+    bool exhausted;          // A take stage is full: nothing more can come out
+} Pipeline;
+
+// A materialized result. 'storage' is a managed array object.
+typedef struct {
+    Object* storage;
+    Value* items;
+    size_t count;
+    size_t capacity;
+} PipeList;
+
+void pipe_init(Pipeline* p, MemoryManager* mm, const Value* items, size_t count);
+
+// Append a stage. Return false when PIPE_MAX_STAGES are already in use.
+bool pipe_map(Pipeline* p, PipeMapFn fn, void* ctx);
+bool pipe_filter(Pipeline* p, PipePredFn fn, void* ctx);
+bool pipe_take(Pipeline* p, size_t n);
+
+// Pull the next output, or return false at the end
+bool pipe_next(Pipeline* p, Value* out);
+
+// Source items pulled so far: how lazy the consumer was
+static inline size_t pipe_pulled(const Pipeline* p) { return p->next; }
+
+// === Consumers ===
+
+// Run to the end into 'out'. Returns false on allocation failure, with
+// whatever was collected still in 'out'.
+bool pipe_collect(Pipeline* p, PipeList* out);
+// First output satisfying 'pred'; pulls nothing after it
+bool pipe_find_first(Pipeline* p, PipePredFn pred, void* ctx, Value* out);
+Value pipe_fold(Pipeline* p, Value init, PipeFoldFn fn, void* ctx);
+
+void pipe_list_free(MemoryManager* mm, PipeList* list);
+
+// === Parallel stages ===
+//
+// Each stage runs as a scheduler task, connected to the next by a bounded
+// single-producer single-consumer ring of PIPE_RING_BATCHES * batch
+// slots. Elements move in batches: a stage takes a batch only when a full
+// one is waiting (or its producer has finished), and synchronizes once per
+// batch rather than once per element. A stage whose output ring has no
+// room for a batch stops and is resumed by its consumer, so a slow stage
+// holds back the ones before it instead of letting the rings grow. Tasks
+// never block a worker, so any pool size works, down to a single worker.
+// Output order is preserved.
+//
+// Stages run concurrently on different workers and the MemoryManager is
+// not thread-safe, so the values passed between stages must be unboxed
+// (no heap objects): a stage releases the values a filter drops or a map
+// replaces, and the last stage grows the output list from the manager at
+// the same time. A source holding heap objects runs pipe_collect instead,
+// and stage functions must neither use the manager nor return a heap
+// object (asserted).
+
+#define PIPE_RING_BATCHES 4
+
+typedef struct {
+    unsigned long batches;   // Batches processed, over all stages
+    unsigned long wakeups;   // Stage tasks spawned
+    unsigned long stalls;    // Times a stage stopped for lack of room downstream
+} PipeParallelStats;
+
+// Run every stage concurrently and collect the result, as pipe_collect
+// does. 'batch' 0 means 1; 'stats' may be NULL. Chains of fewer than two
+// stages, and sources holding heap objects, simply run pipe_collect.
+bool pipe_collect_parallel(Pipeline* p, Scheduler* sched, size_t batch,
+                           PipeList* out, PipeParallelStats* stats);
+
+#endif // PIPELINE_H
@@ -0,0 +1,444 @@
+// profiler.c - Sampling allocation profiler
+#include "profiler.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const MMSourceLoc** frames;  // Outermost first
+    int depth;
+    uint64_t hash;
+    size_t samples;
+    size_t bytes;                // Estimated: samples x mean interval
+} ProfileStack;
+
+struct AllocProfiler {
+    size_t rate;                 // Mean bytes between samples
+    size_t until_next;           // Bytes left before the next sample
+    uint64_t rng;
+
+    // Shadow stack of RHelix frames. 'depth' keeps counting past
+    // MM_PROFILE_MAX_DEPTH so exits stay balanced; deeper frames are
+    // simply not recorded.
+    const MMSourceLoc* frames[MM_PROFILE_MAX_DEPTH];
+    int depth;
+
+    // Distinct stacks, with an open-addressed index (slot = stack + 1)
+    ProfileStack* stacks;
+    size_t stack_count;
+    size_t stack_capacity;
+    size_t* index;
+    size_t index_capacity;
+    size_t total_bytes;
+};
+
+// Samples with no RHelix frame on the stack (runtime-internal allocations)
+static const MMSourceLoc unknown_frame = { "[runtime]", "", 0, 0 };
+
+// Intervals are drawn uniformly from [rate/2, 3*rate/2) so that periodic
+// allocation patterns cannot alias with the sampling period. The
+// generator is seeded identically every run to keep profiles repeatable.
+static size_t next_interval(AllocProfiler* p) {
+    p->rng ^= p->rng << 13;
+    p->rng ^= p->rng >> 7;
+    p->rng ^= p->rng << 17;
+    size_t interval = p->rate / 2 + (size_t)(p->rng % p->rate);
+    return interval ? interval : 1;
+}
+
+bool mm_profile_start(MemoryManager* mm, size_t sample_bytes) {
+    mm_profile_stop(mm);
+    AllocProfiler* p = (AllocProfiler*)calloc(1, sizeof(AllocProfiler));
+    if (!p) return false;
+    p->rate = sample_bytes ? sample_bytes : MM_PROFILE_DEFAULT_RATE;
+    p->rng = 0x9E3779B97F4A7C15ull;
+    p->until_next = next_interval(p);
+    mm->profiler = p;
+    return true;
+}
+
+void mm_profile_stop(MemoryManager* mm) {
+    AllocProfiler* p = mm->profiler;
+    if (!p) return;
+    for (size_t i = 0; i < p->stack_count; i++) free(p->stacks[i].frames);
+    free(p->stacks);
+    free(p->index);
+    free(p);
+    mm->profiler = NULL;
+}
+
+void mm_profile_enter(MemoryManager* mm, const MMSourceLoc* loc) {
+    AllocProfiler* p = mm->profiler;
+    if (p->depth < MM_PROFILE_MAX_DEPTH) p->frames[p->depth] = loc;
+    p->depth++;
+}
+
+void mm_profile_exit(MemoryManager* mm) {
+    AllocProfiler* p = mm->profiler;
+    if (p->depth > 0) p->depth--;
+}
+
+// ============================================================
+// Aggregation
+// ============================================================
+
+static uint64_t stack_hash(const MMSourceLoc* const* frames, int depth) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (int i = 0; i < depth; i++) {
+        h ^= (uint64_t)(uintptr_t)frames[i];
+        h *= 0x100000001B3ull;
+    }
+    return h ^ (uint64_t)depth;
+}
+
+static bool index_grow(AllocProfiler* p) {
+    size_t new_cap = p->index_capacity ? p->index_capacity * 2 : 64;
+    size_t* index = (size_t*)calloc(new_cap, sizeof(size_t));
+    if (!index) return false;
+    for (size_t i = 0; i < p->stack_count; i++) {
+        size_t j = (size_t)p->stacks[i].hash & (new_cap - 1);
+        while (index[j]) j = (j + 1) & (new_cap - 1);
+        index[j] = i + 1;
+    }
+    free(p->index);
+    p->index = index;
+    p->index_capacity = new_cap;
+    return true;
+}
+
+// Entry for the current shadow stack, created on first use. NULL only
+// if the profiler itself runs out of memory (the sample is dropped).
+static ProfileStack* current_stack(AllocProfiler* p) {
+    int depth = p->depth < MM_PROFILE_MAX_DEPTH ? p->depth : MM_PROFILE_MAX_DEPTH;
+    uint64_t hash = stack_hash(p->frames, depth);
+
+    if ((p->stack_count + 1) * 2 > p->index_capacity && !index_grow(p)) return NULL;
+    size_t mask = p->index_capacity - 1;
+    size_t j = (size_t)hash & mask;
+    while (p->index[j]) {
+        ProfileStack* s = &p->stacks[p->index[j] - 1];
+        if (s->hash == hash && s->depth == depth &&
+            memcmp(s->frames, p->frames, sizeof(MMSourceLoc*) * depth) == 0) {
+            return s;
+        }
+        j = (j + 1) & mask;
+    }
+
+    if (p->stack_count == p->stack_capacity) {
+        size_t new_cap = p->stack_capacity ? p->stack_capacity * 2 : 32;
+        ProfileStack* stacks = (ProfileStack*)realloc(p->stacks, sizeof(ProfileStack) * new_cap);
+        if (!stacks) return NULL;
+        p->stacks = stacks;
+        p->stack_capacity = new_cap;
+    }
+    const MMSourceLoc** frames = (const MMSourceLoc**)malloc(sizeof(MMSourceLoc*) * (depth ? depth : 1));
+    if (!frames) return NULL;
+    memcpy(frames, p->frames, sizeof(MMSourceLoc*) * depth);
+
+    ProfileStack* s = &p->stacks[p->stack_count++];
+    s->frames = frames;
+    s->depth = depth;
+    s->hash = hash;
+    s->samples = 0;
+    s->bytes = 0;
+    p->index[j] = p->stack_count;
+    return s;
+}
+
+void mm_profile_record(MemoryManager* mm, size_t bytes) {
+    AllocProfiler* p = mm->profiler;
+    if (bytes < p->until_next) {
+        p->until_next -= bytes;
+        return;
+    }
+
+    // One allocation can span several sampling points
+    size_t samples = 0;
+    while (bytes >= p->until_next) {
+        bytes -= p->until_next;
+        samples++;
+        p->until_next = next_interval(p);
+    }
+    p->until_next -= bytes;
+
+    ProfileStack* s = current_stack(p);
+    if (!s) return;
+    s->samples += samples;
+    s->bytes += samples * p->rate;
+    p->total_bytes += samples * p->rate;
+}
+
+size_t mm_profile_stack_count(MemoryManager* mm) {
+    return mm->profiler ? mm->profiler->stack_count : 0;
+}
+
+size_t mm_profile_sampled_bytes(MemoryManager* mm) {
+    return mm->profiler ? mm->profiler->total_bytes : 0;
+}
+
+// ============================================================
+// Folded stacks
+// ============================================================
+
+static void write_frame(FILE* out, const MMSourceLoc* loc) {
+    if (loc == &unknown_frame) {
+        fputs(loc->function, out);
+        return;
+    }
+    fprintf(out, "%s (%s:%d:%d)", loc->function, loc->file, loc->line, loc->column);
+}
+
+static void write_folded_stack(FILE* out, const ProfileStack* s) {
+    if (s->depth == 0) write_frame(out, &unknown_frame);
+    for (int i = 0; i < s->depth; i++) {
+        if (i > 0) fputc(';', out);
+        write_frame(out, s->frames[i]);
+    }
+}
+
+bool mm_profile_write_folded(MemoryManager* mm, FILE* out) {
+    AllocProfiler* p = mm->profiler;
+    if (!p) return false;
+    for (size_t i = 0; i < p->stack_count; i++) {
+        write_folded_stack(out, &p->stacks[i]);
+        fprintf(out, " %zu\n", p->stacks[i].bytes);
+    }
+    return !ferror(out);
+}
+
+// ============================================================
+// pprof (profile.proto, uncompressed)
+// ============================================================
+
+typedef struct {
+    unsigned char* data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} PBuf;
+
+static void pb_put(PBuf* b, const void* data, size_t n) {
+    if (b->failed) return;
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 256;
+        while (cap < b->len + n) cap *= 2;
+        unsigned char* grown = (unsigned char*)realloc(b->data, cap);
+        if (!grown) {
+            b->failed = true;
+            return;
+        }
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, n);
+    b->len += n;
+}
+
+static void pb_varint(PBuf* b, uint64_t v) {
+    unsigned char bytes[10];
+    size_t n = 0;
+    do {
+        bytes[n] = (unsigned char)(v & 0x7F);
+        v >>= 7;
+        if (v) bytes[n] |= 0x80;
+        n++;
+    } while (v);
+    pb_put(b, bytes, n);
+}
+
+// Wire types: 0 = varint, 2 = length-delimited
+static void pb_uint(PBuf* b, int field, uint64_t v) {
+    pb_varint(b, (uint64_t)field << 3);
+    pb_varint(b, v);
+}
+
+static void pb_bytes(PBuf* b, int field, const void* data, size_t n) {
+    pb_varint(b, ((uint64_t)field << 3) | 2);
+    pb_varint(b, n);
+    pb_put(b, data, n);
+}
+
+// Append 'inner' to 'outer' as a nested message and reset it for reuse
+static void pb_message(PBuf* outer, int field, PBuf* inner) {
+    if (inner->failed) outer->failed = true;
+    pb_bytes(outer, field, inner->data, inner->len);
+    inner->len = 0;
+}
+
+// Small interning table for the string_table and the location/function
+// ids. Profiles have few distinct frames, so linear search is fine.
+typedef struct {
+    const char** strings;
+    size_t string_count;
+    const MMSourceLoc** locs;
+    size_t loc_count;
+    size_t* loc_function;        // Function id per location
+    size_t* function_name;       // String index per function
+    size_t* function_file;
+    size_t function_count;
+    bool failed;
+} PprofTables;
+
+static size_t string_index(PprofTables* t, const char* s) {
+    for (size_t i = 0; i < t->string_count; i++) {
+        if (strcmp(t->strings[i], s) == 0) return i;
+    }
+    const char** grown = (const char**)realloc(t->strings, sizeof(char*) * (t->string_count + 1));
+    if (!grown) {
+        t->failed = true;
+        return 0;
+    }
+    t->strings = grown;
+    t->strings[t->string_count] = s;
+    return t->string_count++;
+}
+
+static size_t function_id(PprofTables* t, const MMSourceLoc* loc) {
+    size_t name = string_index(t, loc->function);
+    size_t file = string_index(t, loc->file);
+    for (size_t i = 0; i < t->function_count; i++) {
+        if (t->function_name[i] == name && t->function_file[i] == file) return i + 1;
+    }
+    size_t n = t->function_count + 1;
+    size_t* names = (size_t*)realloc(t->function_name, sizeof(size_t) * n);
+    if (names) t->function_name = names;
+    size_t* files = (size_t*)realloc(t->function_file, sizeof(size_t) * n);
+    if (files) t->function_file = files;
+    if (!names || !files) {
+        t->failed = true;
+        return 0;
+    }
+    t->function_name[t->function_count] = name;
+    t->function_file[t->function_count] = file;
+    return ++t->function_count;
+}
+
+static size_t location_id(PprofTables* t, const MMSourceLoc* loc) {
+    for (size_t i = 0; i < t->loc_count; i++) {
+        if (t->locs[i] == loc) return i + 1;
+    }
+    size_t fn = function_id(t, loc);
+    size_t n = t->loc_count + 1;
+    const MMSourceLoc** locs = (const MMSourceLoc**)realloc(t->locs, sizeof(MMSourceLoc*) * n);
+    if (locs) t->locs = locs;
+    size_t* fns = (size_t*)realloc(t->loc_function, sizeof(size_t) * n);
+    if (fns) t->loc_function = fns;
+    if (!locs || !fns) {
+        t->failed = true;
+        return 0;
+    }
+    t->locs[t->loc_count] = loc;
+    t->loc_function[t->loc_count] = fn;
+    return ++t->loc_count;
+}
+
+static void value_type(PBuf* out, PBuf* tmp, int field, PprofTables* t,
+                       const char* type, const char* unit) {
+    pb_uint(tmp, 1, string_index(t, type));
+    pb_uint(tmp, 2, string_index(t, unit));
+    pb_message(out, field, tmp);
+}
+
+bool mm_profile_write_pprof(MemoryManager* mm, FILE* out) {
+    AllocProfiler* p = mm->profiler;
+    if (!p) return false;
+
+    PprofTables t = { 0 };
+    PBuf prof = { 0 }, msg = { 0 }, packed = { 0 };
+    string_index(&t, "");  // string_table[0] must be empty
+
+    // Profile.sample_type (1), then one Sample (2) per stack
+    value_type(&prof, &msg, 1, &t, "alloc_objects", "count");
+    value_type(&prof, &msg, 1, &t, "alloc_space", "bytes");
+    for (size_t i = 0; i < p->stack_count; i++) {
+        const ProfileStack* s = &p->stacks[i];
+        // Sample.location_id (1), packed, leaf first
+        if (s->depth == 0) pb_varint(&packed, location_id(&t, &unknown_frame));
+        for (int d = s->depth - 1; d >= 0; d--) {
+            pb_varint(&packed, location_id(&t, s->frames[d]));
+        }
+        pb_bytes(&msg, 1, packed.data, packed.len);
+        packed.len = 0;
+        // Sample.value (2), packed: sampled allocations, estimated bytes
+        pb_varint(&packed, s->samples);
+        pb_varint(&packed, s->bytes);
+        pb_bytes(&msg, 2, packed.data, packed.len);
+        packed.len = 0;
+        pb_message(&prof, 2, &msg);
+    }
+
+    // Location (4): id (1), Line (4) { function_id (1), line (2), column (3) }
+    for (size_t i = 0; i < t.loc_count; i++) {
+        pb_uint(&packed, 1, t.loc_function[i]);
+        pb_uint(&packed, 2, (uint64_t)t.locs[i]->line);
+        pb_uint(&packed, 3, (uint64_t)t.locs[i]->column);
+        pb_uint(&msg, 1, i + 1);
+        pb_message(&msg, 4, &packed);
+        pb_message(&prof, 4, &msg);
+    }
+
+    // Function (5): id (1), name (2), system_name (3), filename (4)
+    for (size_t i = 0; i < t.function_count; i++) {
+        pb_uint(&msg, 1, i + 1);
+        pb_uint(&msg, 2, t.function_name[i]);
+        pb_uint(&msg, 3, t.function_name[i]);
+        pb_uint(&msg, 4, t.function_file[i]);
+        pb_message(&prof, 5, &msg);
+    }
+
+    // period_type (11) and period (12) before the string table, which
+    // must already contain their strings
+    value_type(&prof, &msg, 11, &t, "space", "bytes");
+    pb_uint(&prof, 12, p->rate);
+
+    // string_table (6)
+    for (size_t i = 0; i < t.string_count; i++) {
+        pb_bytes(&prof, 6, t.strings[i], strlen(t.strings[i]));
+    }
+
+    bool ok = !prof.failed && !msg.failed && !packed.failed && !t.failed &&
+              fwrite(prof.data, 1, prof.len, out) == prof.len;
+
+    free(prof.data);
+    free(msg.data);
+    free(packed.data);
+    free(t.strings);
+    free(t.locs);
+    free(t.loc_function);
+    free(t.function_name);
+    free(t.function_file);
+    return ok;
+}
+
+// ============================================================
+// Console report
+// ============================================================
+
+static int compare_stack_bytes(const void* a, const void* b) {
+    const ProfileStack* x = *(const ProfileStack* const*)a;
+    const ProfileStack* y = *(const ProfileStack* const*)b;
+    return (x->bytes < y->bytes) - (x->bytes > y->bytes);
+}
+
+void mm_profile_print(MemoryManager* mm, int max_rows) {
+    AllocProfiler* p = mm->profiler;
+    if (!p) {
+        printf("Allocation profile: profiler not running\n");
+        return;
+    }
+    printf("Allocation profile (1 sample per ~%zu bytes, %zu stacks, ~%zu bytes):\n",
+           p->rate, p->stack_count, p->total_bytes);
+
+    const ProfileStack** sorted = (const ProfileStack**)malloc(sizeof(ProfileStack*) * (p->stack_count + 1));
+    if (!sorted) return;
+    for (size_t i = 0; i < p->stack_count; i++) sorted[i] = &p->stacks[i];
+    qsort(sorted, p->stack_count, sizeof(ProfileStack*), compare_stack_bytes);
+
+    for (size_t i = 0; i < p->stack_count && (int)i < max_rows; i++) {
+        const ProfileStack* s = sorted[i];
+        printf("  %12zu bytes %5.1f%%  ", s->bytes,
+               p->total_bytes ? 100.0 * s->bytes / p->total_bytes : 0.0);
+        write_folded_stack(stdout, s);
+        printf("\n");
+    }
+    free(sorted);
+}
@@ -0,0 +1,640 @@
+// scheduler.c - Work-stealing task scheduler
+#include "scheduler.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_LINE 64
+#define DEQUE_INITIAL_CAPACITY 256
+#define STEAL_ROUNDS_BEFORE_SLEEP 64
+#define IDLE_SLEEP_NS 1000000L      // Bounds the latency of a missed wakeup
+
+typedef struct Task {
+    TaskFn fn;
+    void* arg;
+    TaskGroup* group;
+    struct Task* next;              // Free list or injection queue link
+} Task;
+
+// ============================================================
+// Chase-Lev deque
+// ============================================================
+//
+// Lê, Pop, Cohen, Zappa Nardelli, "Correct and Efficient Work-Stealing
+// for Weak Memory Models" (PPoPP 2013), with C11 atomics. The owner
+// pushes and takes at 'bottom'; thieves steal at 'top'. Arrays replaced
+// on growth may still be read by a thief, so they are retired and only
+// freed when the deque is.
+
+typedef struct DequeArray {
+    long capacity;                  // Power of two
+    struct DequeArray* retired;     // Older arrays, freed with the deque
+    _Atomic(Task*) slots[];
+} DequeArray;
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_long top;
+    _Alignas(CACHE_LINE) atomic_long bottom;
+    _Atomic(DequeArray*) array;
+} Deque;
+
+static DequeArray* deque_array_new(long capacity) {
+    DequeArray* a = (DequeArray*)calloc(1, sizeof(DequeArray) + sizeof(Task*) * capacity);
+    if (a) a->capacity = capacity;
+    return a;
+}
+
+static bool deque_init(Deque* d) {
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    DequeArray* a = deque_array_new(DEQUE_INITIAL_CAPACITY);
+    atomic_init(&d->array, a);
+    return a != NULL;
+}
+
+static void deque_free(Deque* d) {
+    DequeArray* a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    while (a) {
+        DequeArray* older = a->retired;
+        free(a);
+        a = older;
+    }
+}
+
+static DequeArray* deque_grow(Deque* d, DequeArray* a, long top, long bottom) {
+    DequeArray* grown = deque_array_new(a->capacity * 2);
+    if (!grown) return NULL;
+    for (long i = top; i < bottom; i++) {
+        Task* t = atomic_load_explicit(&a->slots[i & (a->capacity - 1)], memory_order_relaxed);
+        atomic_store_explicit(&grown->slots[i & (grown->capacity - 1)], t, memory_order_relaxed);
+    }
+    grown->retired = a;
+    atomic_store_explicit(&d->array, grown, memory_order_release);
+    return grown;
+}
+
+// Owner only. Returns false if the deque could not grow.
+static bool deque_push(Deque* d, Task* t) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&d->top, memory_order_acquire);
+    DequeArray* a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    if (b - top > a->capacity - 1) {
+        a = deque_grow(d, a, top, b);
+        if (!a) return false;
+    }
+    atomic_store_explicit(&a->slots[b & (a->capacity - 1)], t, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return true;
+}
+
+// Owner only. Newest task, or NULL.
+static Task* deque_take(Deque* d) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    DequeArray* a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b) {
+        // Empty
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    Task* task = atomic_load_explicit(&a->slots[b & (a->capacity - 1)], memory_order_relaxed);
+    if (t == b) {
+        // Last task: race thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed)) {
+            task = NULL;
+        }
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+// Any thread. Oldest task, or NULL if empty or another thief won.
+static Task* deque_steal(Deque* d) {
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+
+    DequeArray* a = atomic_load_explicit(&d->array, memory_order_acquire);
+    Task* task = atomic_load_explicit(&a->slots[t & (a->capacity - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+        return NULL;
+    }
+    return task;
+}
+
+static bool deque_looks_nonempty(Deque* d) {
+    return atomic_load_explicit(&d->bottom, memory_order_relaxed) >
+           atomic_load_explicit(&d->top, memory_order_relaxed);
+}
+
+// ============================================================
+// Workers and the pool
+// ============================================================
+
+typedef struct {
+    Deque deque;
+    Scheduler* sched;
+    int index;
+    pthread_t thread;
+    uint64_t rng;                   // Victim selection
+    Task* free_tasks;               // Recycled Task records (owner only)
+
+    // Read by sched_get_stats from other threads
+    atomic_ulong tasks_run;
+    atomic_ulong steals;
+    atomic_ulong steal_attempts;
+} Worker;
+
+struct Scheduler {
+    Worker* workers;
+    int worker_count;
+    atomic_bool stopping;
+
+    // Tasks spawned from outside the pool
+    pthread_mutex_t inject_lock;
+    Task* inject_head;
+    Task* inject_tail;
+    atomic_long inject_count;
+    atomic_ulong injected;
+
+    // Idle workers sleep here
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    atomic_int sleepers;
+};
+
+static _Thread_local Worker* current_worker;
+
+static Worker* worker_of(Scheduler* sched) {
+    Worker* w = current_worker;
+    return (w && w->sched == sched) ? w : NULL;
+}
+
+int sched_current_worker(void) {
+    return current_worker ? current_worker->index : -1;
+}
+
+int sched_worker_count(const Scheduler* sched) {
+    return sched->worker_count;
+}
+
+static Task* task_alloc(Worker* w) {
+    if (w && w->free_tasks) {
+        Task* t = w->free_tasks;
+        w->free_tasks = t->next;
+        return t;
+    }
+    return (Task*)malloc(sizeof(Task));
+}
+
+// Records migrate to whichever worker ran the task
+static void task_free(Worker* w, Task* t) {
+    t->next = w->free_tasks;
+    w->free_tasks = t;
+}
+
+static void wake_one(Scheduler* sched) {
+    if (atomic_load_explicit(&sched->sleepers, memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&sched->idle_lock);
+        pthread_cond_signal(&sched->idle_cond);
+        pthread_mutex_unlock(&sched->idle_lock);
+    }
+}
+
+static void inject(Scheduler* sched, Task* t) {
+    t->next = NULL;
+    pthread_mutex_lock(&sched->inject_lock);
+    if (sched->inject_tail) {
+        sched->inject_tail->next = t;
+    } else {
+        sched->inject_head = t;
+    }
+    sched->inject_tail = t;
+    atomic_fetch_add_explicit(&sched->inject_count, 1, memory_order_release);
+    pthread_mutex_unlock(&sched->inject_lock);
+    atomic_fetch_add_explicit(&sched->injected, 1, memory_order_relaxed);
+    wake_one(sched);
+}
+
+static Task* take_injected(Scheduler* sched) {
+    if (atomic_load_explicit(&sched->inject_count, memory_order_acquire) == 0) return NULL;
+    pthread_mutex_lock(&sched->inject_lock);
+    Task* t = sched->inject_head;
+    if (t) {
+        sched->inject_head = t->next;
+        if (!sched->inject_head) sched->inject_tail = NULL;
+        atomic_fetch_sub_explicit(&sched->inject_count, 1, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&sched->inject_lock);
+    return t;
+}
+
+static uint64_t next_random(Worker* w) {
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 7;
+    w->rng ^= w->rng << 17;
+    return w->rng;
+}
+
+// One pass of random-victim stealing: as many attempts as there are
+// other workers.
+static Task* steal_round(Worker* w) {
+    Scheduler* sched = w->sched;
+    int n = sched->worker_count;
+    for (int i = 1; i < n; i++) {
+        int victim = (int)(next_random(w) % (uint64_t)(n - 1));
+        if (victim >= w->index) victim++;  // Never ourselves
+        atomic_fetch_add_explicit(&w->steal_attempts, 1, memory_order_relaxed);
+        Task* t = deque_steal(&sched->workers[victim].deque);
+        if (t) {
+            atomic_fetch_add_explicit(&w->steals, 1, memory_order_relaxed);
+            return t;
+        }
+    }
+    return NULL;
+}
+
+static Task* find_task(Worker* w) {
+    Task* t = deque_take(&w->deque);
+    if (!t) t = steal_round(w);
+    if (!t) t = take_injected(w->sched);
+    return t;
+}
+
+static void run_task(Worker* w, Task* t) {
+    TaskFn fn = t->fn;
+    void* arg = t->arg;
+    TaskGroup* group = t->group;
+    task_free(w, t);
+    fn(arg);
+    atomic_fetch_add_explicit(&w->tasks_run, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&group->pending, 1, memory_order_release);
+}
+
+static bool any_work(Scheduler* sched) {
+    if (atomic_load_explicit(&sched->inject_count, memory_order_relaxed) > 0) return true;
+    for (int i = 0; i < sched->worker_count; i++) {
+        if (deque_looks_nonempty(&sched->workers[i].deque)) return true;
+    }
+    return false;
+}
+
+static void idle_wait(Scheduler* sched) {
+    pthread_mutex_lock(&sched->idle_lock);
+    atomic_fetch_add_explicit(&sched->sleepers, 1, memory_order_seq_cst);
+    if (!atomic_load(&sched->stopping) && !any_work(sched)) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += IDLE_SLEEP_NS;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&sched->idle_cond, &sched->idle_lock, &deadline);
+    }
+    atomic_fetch_sub_explicit(&sched->sleepers, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&sched->idle_lock);
+}
+
+static void* worker_main(void* p) {
+    Worker* w = (Worker*)p;
+    current_worker = w;
+    int idle_rounds = 0;
+    while (!atomic_load_explicit(&w->sched->stopping, memory_order_acquire)) {
+        Task* t = find_task(w);
+        if (t) {
+            run_task(w, t);
+            idle_rounds = 0;
+        } else if (++idle_rounds < STEAL_ROUNDS_BEFORE_SLEEP) {
+            sched_yield();
+        } else {
+            idle_wait(w->sched);
+        }
+    }
+    current_worker = NULL;
+    return NULL;
+}
+
+Scheduler* sched_create(int workers) {
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    if (workers > SCHED_MAX_WORKERS) workers = SCHED_MAX_WORKERS;
+
+    Scheduler* sched = (Scheduler*)calloc(1, sizeof(Scheduler));
+    if (!sched) return NULL;
+    sched->workers = (Worker*)aligned_alloc(CACHE_LINE,
+        ((sizeof(Worker) * workers + CACHE_LINE - 1) / CACHE_LINE) * CACHE_LINE);
+    if (!sched->workers) {
+        free(sched);
+        return NULL;
+    }
+    memset(sched->workers, 0, sizeof(Worker) * workers);
+    sched->worker_count = workers;
+    atomic_init(&sched->stopping, false);
+    atomic_init(&sched->inject_count, 0);
+    atomic_init(&sched->injected, 0);
+    atomic_init(&sched->sleepers, 0);
+    pthread_mutex_init(&sched->inject_lock, NULL);
+    pthread_mutex_init(&sched->idle_lock, NULL);
+    pthread_cond_init(&sched->idle_cond, NULL);
+
+    for (int i = 0; i < workers; i++) {
+        Worker* w = &sched->workers[i];
+        w->sched = sched;
+        w->index = i;
+        w->rng = 0x9E3779B97F4A7C15ull * (uint64_t)(i + 1);
+        atomic_init(&w->tasks_run, 0);
+        atomic_init(&w->steals, 0);
+        atomic_init(&w->steal_attempts, 0);
+        if (!deque_init(&w->deque)) {
+            sched->worker_count = i + 1;
+            sched_destroy(sched);
+            return NULL;
+        }
+    }
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&sched->workers[i].thread, NULL, worker_main, &sched->workers[i]) != 0) {
+            // Stop the threads that did start, then free everything
+            atomic_store(&sched->stopping, true);
+            for (int j = 0; j < i; j++) pthread_join(sched->workers[j].thread, NULL);
+            for (int j = 0; j < workers; j++) deque_free(&sched->workers[j].deque);
+            free(sched->workers);
+            free(sched);
+            return NULL;
+        }
+    }
+    return sched;
+}
+
+void sched_destroy(Scheduler* sched) {
+    if (!sched) return;
+    atomic_store_explicit(&sched->stopping, true, memory_order_release);
+    pthread_mutex_lock(&sched->idle_lock);
+    pthread_cond_broadcast(&sched->idle_cond);
+    pthread_mutex_unlock(&sched->idle_lock);
+
+    for (int i = 0; i < sched->worker_count; i++) {
+        Worker* w = &sched->workers[i];
+        if (w->thread) pthread_join(w->thread, NULL);
+    }
+    for (int i = 0; i < sched->worker_count; i++) {
+        Worker* w = &sched->workers[i];
+        while (w->free_tasks) {
+            Task* next = w->free_tasks->next;
+            free(w->free_tasks);
+            w->free_tasks = next;
+        }
+        deque_free(&w->deque);
+    }
+    while (sched->inject_head) {
+        Task* next = sched->inject_head->next;
+        free(sched->inject_head);
+        sched->inject_head = next;
+    }
+    pthread_mutex_destroy(&sched->inject_lock);
+    pthread_mutex_destroy(&sched->idle_lock);
+    pthread_cond_destroy(&sched->idle_cond);
+    free(sched->workers);
+    free(sched);
+}
+
+// ============================================================
+// Fork-join
+// ============================================================
+
+void sched_group_init(TaskGroup* group) {
+    atomic_init(&group->pending, 0);
+}
+
+void sched_spawn(Scheduler* sched, TaskGroup* group, TaskFn fn, void* arg) {
+    Worker* w = worker_of(sched);
+    Task* t = task_alloc(w);
+    if (!t) {
+        // Out of memory: run inline, which is always correct for fork-join
+        fn(arg);
+        return;
+    }
+    t->fn = fn;
+    t->arg = arg;
+    t->group = group;
+    atomic_fetch_add_explicit(&group->pending, 1, memory_order_relaxed);
+
+    if (w && deque_push(&w->deque, t)) {
+        wake_one(sched);
+    } else {
+        inject(sched, t);
+    }
+}
+
+void sched_wait(Scheduler* sched, TaskGroup* group) {
+    Worker* w = worker_of(sched);
+    while (atomic_load_explicit(&group->pending, memory_order_acquire) > 0) {
+        // Help instead of blocking: our own children first, then anyone's
+        Task* t = w ? find_task(w) : NULL;
+        if (t) {
+            run_task(w, t);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+typedef struct {
+    TaskFn fn;
+    void* arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool done;
+} RootTask;
+
+static void root_task(void* p) {
+    RootTask* root = (RootTask*)p;
+    root->fn(root->arg);
+    pthread_mutex_lock(&root->lock);
+    root->done = true;
+    pthread_cond_signal(&root->cond);
+    pthread_mutex_unlock(&root->lock);
+}
+
+void sched_run(Scheduler* sched, TaskFn fn, void* arg) {
+    if (worker_of(sched)) {
+        fn(arg);
+        return;
+    }
+    RootTask root = { fn, arg, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, false };
+    TaskGroup group;
+    sched_group_init(&group);
+    sched_spawn(sched, &group, root_task, &root);
+
+    pthread_mutex_lock(&root.lock);
+    while (!root.done) pthread_cond_wait(&root.cond, &root.lock);
+    pthread_mutex_unlock(&root.lock);
+    // The worker still decrements the group after root_task returns
+    while (atomic_load_explicit(&group.pending, memory_order_acquire) > 0) sched_yield();
+    pthread_mutex_destroy(&root.lock);
+    pthread_cond_destroy(&root.cond);
+}
+
+// ============================================================
+// Parallel for
+// ============================================================
+
+typedef struct {
+    Scheduler* sched;
+    long lo;
+    long hi;
+    long grain;
+    RangeFn body;
+    void* arg;
+} RangeTask;
+
+// Split in halves down to the grain: the right half is offered to
+// thieves, the left half runs here. Large chunks are stolen first.
+static void range_task(void* p) {
+    RangeTask* r = (RangeTask*)p;
+    if (r->hi - r->lo <= r->grain) {
+        r->body(r->lo, r->hi, r->arg);
+        return;
+    }
+    long mid = r->lo + (r->hi - r->lo) / 2;
+    RangeTask left = *r;
+    RangeTask right = *r;
+    left.hi = mid;
+    right.lo = mid;
+
+    TaskGroup group;
+    sched_group_init(&group);
+    sched_spawn(r->sched, &group, range_task, &right);
+    range_task(&left);
+    sched_wait(r->sched, &group);
+}
+
+// ============================================================
+// Lazy binary splitting
+// ============================================================
+
+// Each split halves what remains, so a task never splits more than the
+// number of bits in a long.
+#define LBS_MAX_SPLITS 64
+
+typedef struct {
+    Scheduler* sched;
+    long lo;
+    long hi;
+    long chunk;
+    RangeFn for_body;               // Exactly one of for_body / reduce_body
+    ReduceRangeFn reduce_body;
+    const SchedReducer* reducer;
+    void* acc;                      // This task's accumulator, or NULL
+    void* arg;
+} LazyRange;
+
+static void lazy_range_task(void* p) {
+    LazyRange* r = (LazyRange*)p;
+    Worker* w = worker_of(r->sched);
+    LazyRange halves[LBS_MAX_SPLITS];
+    int splits = 0;
+    TaskGroup group;
+    sched_group_init(&group);
+
+    long lo = r->lo;
+    long hi = r->hi;
+    while (lo < hi) {
+        if (hi - lo > r->chunk && splits < LBS_MAX_SPLITS && w &&
+            !deque_looks_nonempty(&w->deque)) {
+            LazyRange* half = &halves[splits];
+            *half = *r;
+            half->lo = lo + (hi - lo) / 2;
+            half->hi = hi;
+            if (r->reducer) {
+                half->acc = malloc(r->reducer->size);
+                if (half->acc) r->reducer->init(half->acc, r->arg);
+            }
+            if (!r->reducer || half->acc) {
+                splits++;
+                hi = half->lo;
+                sched_spawn(r->sched, &group, lazy_range_task, half);
+                continue;
+            }
+        }
+        long step = hi - lo < r->chunk ? hi - lo : r->chunk;
+        if (r->reducer) {
+            r->reduce_body(lo, lo + step, r->acc, r->arg);
+        } else {
+            r->for_body(lo, lo + step, r->arg);
+        }
+        lo += step;
+    }
+    sched_wait(r->sched, &group);
+
+    // Each half lies to the right of the ones split after it, so the
+    // latest split is the nearest neighbour of this task's own range
+    if (r->reducer) {
+        for (int i = splits - 1; i >= 0; i--) {
+            r->reducer->combine(r->acc, halves[i].acc, r->arg);
+            free(halves[i].acc);
+        }
+    }
+}
+
+void sched_parallel_for(Scheduler* sched, long begin, long end, long grain,
+                        RangeFn body, void* arg) {
+    if (end <= begin) return;
+    if (grain <= 0) {
+        LazyRange root = { sched, begin, end, SCHED_LBS_CHUNK, body, NULL, NULL, NULL, arg };
+        sched_run(sched, lazy_range_task, &root);
+        return;
+    }
+    RangeTask root = { sched, begin, end, grain, body, arg };
+    sched_run(sched, range_task, &root);
+}
+
+void sched_parallel_reduce(Scheduler* sched, long begin, long end, long chunk,
+                           ReduceRangeFn body, const SchedReducer* reducer,
+                           void* result, void* arg) {
+    reducer->init(result, arg);
+    if (end <= begin) return;
+    if (chunk <= 0) chunk = SCHED_LBS_CHUNK;
+    LazyRange root = { sched, begin, end, chunk, NULL, body, reducer, result, arg };
+    sched_run(sched, lazy_range_task, &root);
+}
+
+// ============================================================
+// Statistics
+// ============================================================
+
+void sched_get_stats(Scheduler* sched, SchedStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < sched->worker_count; i++) {
+        Worker* w = &sched->workers[i];
+        stats->tasks_run += atomic_load_explicit(&w->tasks_run, memory_order_relaxed);
+        stats->steals += atomic_load_explicit(&w->steals, memory_order_relaxed);
+        stats->steal_attempts += atomic_load_explicit(&w->steal_attempts, memory_order_relaxed);
+    }
+    stats->injected = atomic_load_explicit(&sched->injected, memory_order_relaxed);
+}
+
+void sched_reset_stats(Scheduler* sched) {
+    for (int i = 0; i < sched->worker_count; i++) {
+        Worker* w = &sched->workers[i];
+        atomic_store_explicit(&w->tasks_run, 0, memory_order_relaxed);
+        atomic_store_explicit(&w->steals, 0, memory_order_relaxed);
+        atomic_store_explicit(&w->steal_attempts, 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&sched->injected, 0, memory_order_relaxed);
+}
@@ -0,0 +1,96 @@
+// scheduler.h - Work-stealing task scheduler
+//
+// A fixed pool of worker threads, each owning a Chase-Lev deque. A
+// worker pushes and pops its own tasks at the bottom of its deque (LIFO,
+// cache-warm) and, when it runs dry, steals from the top of a randomly
+// chosen victim (FIFO, oldest and usually largest work first). Tasks
+// spawned from outside the pool go through a shared injection queue.
+//
+// The backend lowers `@parallel` functions and parallel `for` loops onto
+// two primitives: sched_spawn/sched_wait on a TaskGroup (fork-join), and
+// sched_parallel_for (recursive range splitting). A waiting worker keeps
+// executing other tasks, so nested fork-join never starves the pool.
+//
+// The memory manager is not thread-safe; tasks must not share a
+// MemoryManager without external locking.
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct Scheduler Scheduler;
+typedef void (*TaskFn)(void* arg);
+
+// Counts the tasks spawned into it that have not finished yet. Must stay
+// alive until sched_wait on it returns.
+typedef struct {
+    atomic_long pending;
+} TaskGroup;
+
+typedef struct {
+    unsigned long tasks_run;         // Tasks executed by workers
+    unsigned long steals;            // Successful steals
+    unsigned long steal_attempts;    // Including empty and lost races
+    unsigned long injected;          // Tasks submitted from outside the pool
+} SchedStats;
+
+#define SCHED_MAX_WORKERS 256
+
+// 'workers' <= 0 uses one worker per online CPU
+Scheduler* sched_create(int workers);
+void sched_destroy(Scheduler* sched);    // Waits for running tasks to finish
+int sched_worker_count(const Scheduler* sched);
+int sched_current_worker(void);          // Index of the calling worker, or -1
+
+// Fork-join
+void sched_group_init(TaskGroup* group);
+void sched_spawn(Scheduler* sched, TaskGroup* group, TaskFn fn, void* arg);
+void sched_wait(Scheduler* sched, TaskGroup* group);
+
+// Run fn(arg) on the pool and block until it - and everything it waited
+// for - has finished. The entry point for code outside the pool.
+void sched_run(Scheduler* sched, TaskFn fn, void* arg);
+
+// body(lo, hi, arg) over disjoint chunks covering [begin, end). With
+// grain > 0 the range is split eagerly in halves down to chunks of at most
+// 'grain'. With grain <= 0 it is split lazily (see below) and chunks are
+// at most SCHED_LBS_CHUNK long. Returns once every chunk is done; callable
+// from inside or outside the pool.
+typedef void (*RangeFn)(long lo, long hi, void* arg);
+void sched_parallel_for(Scheduler* sched, long begin, long end, long grain,
+                        RangeFn body, void* arg);
+
+// Lazy binary splitting (Tzannes et al., PPoPP 2010). A task consumes its
+// range 'chunk' iterations at a time and splits off the upper half of what
+// remains only when its own deque is empty - that is, when no other worker
+// could be stealing from it. Busy pools barely split; an idle worker that
+// steals one half causes the owner to split again, so chunk sizes adapt to
+// load without a tuned grain.
+#define SCHED_LBS_CHUNK 64
+
+// Accumulators for sched_parallel_reduce. Every task gets its own, set to
+// the identity by init; partial results are combined pairwise in iteration
+// order, so combine must be associative but need not be commutative.
+typedef struct {
+    size_t size;                                           // Bytes per accumulator
+    void (*init)(void* acc, void* arg);
+    void (*combine)(void* into, const void* from, void* arg);  // into = into (+) from
+} SchedReducer;
+
+typedef void (*ReduceRangeFn)(long lo, long hi, void* acc, void* arg);
+
+// Fold body over [begin, end) with lazy binary splitting ('chunk' <= 0
+// uses SCHED_LBS_CHUNK) and store the combined accumulator in 'result'.
+// If an accumulator cannot be allocated the range is simply not split.
+void sched_parallel_reduce(Scheduler* sched, long begin, long end, long chunk,
+                           ReduceRangeFn body, const SchedReducer* reducer,
+                           void* result, void* arg);
+
+// Statistics, summed over workers
+void sched_get_stats(Scheduler* sched, SchedStats* stats);
+void sched_reset_stats(Scheduler* sched);
+
+#endif // SCHEDULER_H
@@ -0,0 +1,187 @@
+// test_container.c - Test suite for typed list and dict layouts
+#include "container.h"
+#include <stdio.h>
+#include <assert.h>
+
+#define BIG_INT (((int64_t)1 << 60) + 7)  // Boxed as a Value, raw in an int list
+
+void test_typed_lists() {
+    printf("Testing typed lists...\n");
+
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    size_t baseline = mm_get_allocated_bytes(mm);
+
+    Value ints = list_create(mm, LAYOUT_INT, 0);
+    assert(value_is_list(ints) && list_length(ints) == 0);
+    assert(!value_truthy(ints));
+    for (int64_t i = 0; i < 1000; i++) assert(list_append_int(mm, ints, i * 3));
+    assert(list_append(mm, ints, value_int(mm, BIG_INT)));
+    assert(list_length(ints) == 1001 && list_layout(ints) == LAYOUT_INT);
+    assert(list_ints(ints)[999] == 2997);
+    assert(list_ints(ints)[1000] == BIG_INT);  // Full 64 bits, no box
+
+    // Reading out boxes only what does not fit in an immediate
+    Value v = list_get(mm, ints, 10);
+    assert(value_is_small_int(v) && value_as_int(v) == 30);
+    v = list_get(mm, ints, 1000);
+    assert(value_is_object(v) && value_as_int(v) == BIG_INT);
+    value_release(mm, v);
+
+    assert(list_set(mm, ints, 0, value_small_int(-5)));
+    assert(list_ints(ints)[0] == -5);
+    printf("✓ List[int] stores raw int64_t, including ints past 48 bits\n");
+
+    // Ints widen into a float list, as the type checker treats them
+    Value floats = list_create(mm, LAYOUT_FLOAT, 4);
+    assert(list_append_float(mm, floats, 0.5));
+    assert(list_append(mm, floats, value_small_int(2)));
+    assert(list_append_int(mm, floats, 3));
+    assert(list_layout(floats) == LAYOUT_FLOAT);
+    assert(list_floats(floats)[1] == 2.0 && list_floats(floats)[2] == 3.0);
+    v = list_get(mm, floats, 1);
+    assert(value_is_float(v) && value_as_float(v) == 2.0);
+    printf("✓ List[float] widens ints\n");
+
+    value_release(mm, ints);
+    value_release(mm, floats);
+    assert(mm_get_allocated_bytes(mm) == baseline);
+    printf("✓ Releasing a list frees its storage\n");
+
+    mm_destroy(mm);
+    printf("✅ Typed list tests passed!\n\n");
+}
+
+void test_layout_fallback() {
+    printf("Testing layout fallback...\n");
+
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    size_t baseline = mm_get_allocated_bytes(mm);
+
+    // A value the layout cannot hold turns the list boxed; nothing changes meaning
+    Value list = list_create(mm, LAYOUT_INT, 0);
+    list_append_int(mm, list, 1);
+    list_append_int(mm, list, BIG_INT);
+    Value s = value_string(mm, "hello", 5);
+    assert(list_append(mm, list, s));
+    assert(list_layout(list) == LAYOUT_BOXED && list_length(list) == 3);
+    Value v = list_get(mm, list, 1);
+    assert(value_is_int(v) && value_as_int(v) == BIG_INT);
+    value_release(mm, v);
+    v = list_get(mm, list, 2);
+    assert(value_equals(v, s));
+    value_release(mm, v);
+    assert(list_append(mm, list, value_float(1.5)));
+    assert(list_set(mm, list, 0, value_bool(true)));
+    printf("✓ List[int] goes boxed on a str, keeping its ints\n");
+
+    Value floats = list_create(mm, LAYOUT_FLOAT, 0);
+    list_append_float(mm, floats, 1.25);
+    assert(list_set(mm, floats, 0, value_none()));
+    assert(list_layout(floats) == LAYOUT_BOXED && value_is_none(list_get(mm, floats, 0)));
+    printf("✓ List[float] goes boxed on None\n");
+
+    // A boxed list holds references: releasing it releases the elements
+    Value boxed = list_create(mm, LAYOUT_BOXED, 0);
+    Value inner = list_create(mm, LAYOUT_INT, 0);
+    list_append_int(mm, inner, 42);
+    value_retain(inner);
+    assert(list_append(mm, boxed, inner));
+    assert(value_as_object(inner)->ref_count == 2);
+    value_release(mm, boxed);
+    assert(value_as_object(inner)->ref_count == 1);
+    value_release(mm, inner);
+
+    value_release(mm, list);
+    value_release(mm, floats);
+    assert(mm_get_allocated_bytes(mm) == baseline);
+    printf("✓ Boxed elements are released with their list\n");
+
+    mm_destroy(mm);
+    printf("✅ Layout fallback tests passed!\n\n");
+}
+
+static Value key(MemoryManager* mm, int i) {
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "word%d", i);
+    return value_string(mm, buf, (size_t)n);
+}
+
+void test_typed_dicts() {
+    printf("Testing typed dicts...\n");
+
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    size_t baseline = mm_get_allocated_bytes(mm);
+
+    // Dict[str, int]: counts live as raw int64_t and update in place
+    Value counts = dict_create(mm, LAYOUT_INT, 0);
+    assert(value_is_dict(counts) && !value_truthy(counts));
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 500; i++) {
+            Value k = key(mm, i);
+            int64_t* slot = (int64_t*)dict_lookup(counts, k);
+            if (slot) {
+                *slot += i;
+                value_release(mm, k);
+            } else {
+                assert(dict_set(mm, counts, k, value_small_int(i)));
+            }
+        }
+    }
+    assert(dict_length(counts) == 500 && dict_layout(counts) == LAYOUT_INT);
+    Value k = key(mm, 77), v;
+    assert(dict_get(mm, counts, k, &v) && value_as_int(v) == 3 * 77);
+    value_release(mm, k);
+    k = key(mm, 500);
+    assert(!dict_get(mm, counts, k, &v) && dict_lookup(counts, k) == NULL);
+    value_release(mm, k);
+    printf("✓ Dict[str, int] counts in place over %zu keys\n", dict_length(counts));
+
+    // Insertion order survives growth and replacement
+    assert(dict_set(mm, counts, key(mm, 3), value_small_int(-1)));
+    assert(dict_length(counts) == 500);
+    for (size_t i = 0; i < dict_length(counts); i++) {
+        Value expected = key(mm, (int)i);
+        assert(value_equals(dict_key_at(counts, i), expected));
+        value_release(mm, expected);
+    }
+    assert(((int64_t*)dict_data(counts)->values)[3] == -1);
+    printf("✓ Entries stay in insertion order\n");
+
+    // Equal keys find each other across int and float
+    Value mixed = dict_create(mm, LAYOUT_INT, 2);
+    assert(dict_set(mm, mixed, value_small_int(1), value_small_int(10)));
+    assert(dict_set(mm, mixed, value_float(1.0), value_small_int(11)));
+    assert(dict_length(mixed) == 1);
+    assert(*(int64_t*)dict_lookup(mixed, value_small_int(1)) == 11);
+    assert(value_hash(value_small_int(7)) == value_hash(value_float(7.0)));
+    printf("✓ 1 and 1.0 are one key\n");
+
+    // A value the layout cannot hold turns the values boxed
+    Value name = value_string(mm, "typed", 5);
+    assert(dict_set(mm, mixed, value_small_int(2), name));
+    assert(dict_layout(mixed) == LAYOUT_BOXED);
+    assert(dict_get(mm, mixed, value_small_int(1), &v) && value_as_int(v) == 11);
+    v = dict_value_at(mm, mixed, 1);
+    assert(value_equals(v, name));
+    value_release(mm, v);
+    printf("✓ Dict values go boxed on a str\n");
+
+    value_release(mm, counts);
+    value_release(mm, mixed);
+    assert(mm_get_allocated_bytes(mm) == baseline);
+    printf("✓ Releasing a dict frees its keys, values and index\n");
+
+    mm_destroy(mm);
+    printf("✅ Typed dict tests passed!\n\n");
+}
+
+int main() {
+    printf("=== RHelix Container Test Suite ===\n\n");
+
+    test_typed_lists();
+    test_layout_fallback();
+    test_typed_dicts();
+
+    printf("🎉 All tests passed!\n");
+    return 0;
+}
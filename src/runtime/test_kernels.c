@@ -0,0 +1,263 @@
+// test_kernels.c - Test suite for the vector kernels
+#include "kernels.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#define MAX_N 1001
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double random_double(void) {
+    return ((double)(next_random() >> 11) / 9007199254740992.0 - 0.5) * 1000.0;
+}
+
+static double a[MAX_N], b[MAX_N], c[MAX_N], want[MAX_N], got[MAX_N];
+static int64_t ia[MAX_N], ib[MAX_N], iwant[MAX_N], igot[MAX_N];
+
+// Lengths that exercise empty input, the scalar tails and several vector iterations
+static const size_t lengths[] = { 0, 1, 3, 7, 8, 9, 15, 16, 17, 31, 33, 1001 };
+#define LENGTH_COUNT (sizeof(lengths) / sizeof(lengths[0]))
+
+static void fill(void) {
+    for (size_t i = 0; i < MAX_N; i++) {
+        a[i] = random_double();
+        b[i] = random_double();
+        c[i] = random_double();
+        ia[i] = (int64_t)(next_random() % 2000001) - 1000000;
+        ib[i] = (int64_t)(next_random() % 2000001) - 1000000;
+    }
+}
+
+static bool same_bits(const double* x, const double* y, size_t n) {
+    return memcmp(x, y, n * sizeof(double)) == 0;
+}
+
+void test_variants_agree() {
+    printf("Testing that every instruction set agrees with scalar...\n");
+
+    fill();
+    // The edge cases min and max must agree on
+    a[5] = NAN;
+    b[6] = NAN;
+    a[10] = -0.0;
+    b[10] = 0.0;
+    const Kernels* ref = kernels_for(KERNEL_ISA_SCALAR);
+    assert(ref && kernels() && kernels()->isa >= KERNEL_ISA_SCALAR);
+    for (int isa = KERNEL_ISA_SCALAR + 1; isa < KERNEL_ISA_COUNT; isa++) {
+        const Kernels* k = kernels_for((KernelISA)isa);
+        if (!k) {
+            printf("  (%s not available here)\n", kernel_isa_to_string((KernelISA)isa));
+            continue;
+        }
+        assert(k->isa == (KernelISA)isa);
+        for (size_t l = 0; l < LENGTH_COUNT; l++) {
+            size_t n = lengths[l];
+            for (int op = 0; op < KERNEL_ELEMENTWISE_COUNT; op++) {
+                ref->f64[op](want, a, b, n);
+                k->f64[op](got, a, b, n);
+                assert(same_bits(want, got, n));
+                ref->f64_broadcast[op](want, a, 2.5, n);
+                k->f64_broadcast[op](got, a, 2.5, n);
+                assert(same_bits(want, got, n));
+
+                assert(ref->i64[op](iwant, ia, ib, n) && k->i64[op](igot, ia, ib, n));
+                assert(memcmp(iwant, igot, n * sizeof(int64_t)) == 0);
+                assert(ref->i64_broadcast[op](iwant, ia, -7, n) &&
+                       k->i64_broadcast[op](igot, ia, -7, n));
+                assert(memcmp(iwant, igot, n * sizeof(int64_t)) == 0);
+            }
+            ref->fma_f64(want, a, b, c, n);
+            k->fma_f64(got, a, b, c, n);
+            assert(same_bits(want, got, n));
+
+            double s1 = ref->sum_f64(b, n), s2 = k->sum_f64(b, n);
+            assert(memcmp(&s1, &s2, sizeof(double)) == 0);
+            s1 = ref->dot_f64(b, c, n);
+            s2 = k->dot_f64(b, c, n);
+            assert(memcmp(&s1, &s2, sizeof(double)) == 0);
+            uint64_t m1, m2;
+            assert(ref->sum_i64(ia, n, &m1) == k->sum_i64(ia, n, &m2) && m1 == m2);
+        }
+        printf("✓ %s matches scalar bit for bit\n", kernel_isa_to_string(k->isa));
+
+        // dst may be an input
+        memcpy(want, a, sizeof(a));
+        ref->f64[KERNEL_MUL](want, want, b, MAX_N);
+        memcpy(got, a, sizeof(a));
+        k->f64[KERNEL_MUL](got, got, b, MAX_N);
+        assert(same_bits(want, got, MAX_N));
+
+        // Overflow is caught in the vector body and in the tail alike
+        for (size_t at = 0; at < 20; at++) {
+            int64_t x[20] = { 0 }, y[20] = { 0 }, r[20];
+            x[at] = INT64_MAX;
+            y[at] = 1;
+            assert(!k->i64[KERNEL_ADD](r, x, y, 20));
+            assert(!k->i64_broadcast[KERNEL_ADD](r, x, 1, 20));
+            x[at] = INT64_MIN;
+            assert(!k->i64[KERNEL_SUB](r, x, y, 20));
+            assert(k->i64[KERNEL_MIN](r, x, y, 20) && r[at] == INT64_MIN);
+        }
+        printf("✓ %s reports int overflow\n", kernel_isa_to_string(k->isa));
+    }
+
+    // Reassociated, but close to the left-to-right sum
+    double seq = 0.0;
+    for (size_t i = 0; i < MAX_N; i++) seq += c[i];
+    assert(fabs(kernels()->sum_f64(c, MAX_N) - seq) < 1e-9 * MAX_N * 500.0);
+    printf("✅ Kernel variant tests passed!\n\n");
+}
+
+static Value float_list(MemoryManager* mm, const double* xs, size_t n) {
+    Value list = list_create(mm, LAYOUT_FLOAT, n);
+    for (size_t i = 0; i < n; i++) list_append_float(mm, list, xs[i]);
+    return list;
+}
+
+static Value int_list(MemoryManager* mm, const int64_t* xs, size_t n) {
+    Value list = list_create(mm, LAYOUT_INT, n);
+    for (size_t i = 0; i < n; i++) list_append_int(mm, list, xs[i]);
+    return list;
+}
+
+void test_reduce() {
+    printf("Testing kernel_reduce...\n");
+
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    size_t baseline = mm_get_allocated_bytes(mm);
+    fill();
+
+    Value xs = float_list(mm, b, MAX_N), ys = float_list(mm, c, MAX_N), r;
+    assert(kernel_reduce(mm, KERNEL_SUM, value_small_int(0), xs, value_none(), KERNEL_WHOLE, &r));
+    assert(value_is_float(r) && value_as_float(r) == kernels()->sum_f64(b, MAX_N));
+    assert(kernel_reduce(mm, KERNEL_DOT, value_float(1.0), xs, ys, 100, &r));
+    assert(value_as_float(r) == 1.0 + kernels()->dot_f64(b, c, 100));
+    printf("✓ Float sums and dot products run the kernels\n");
+
+    // An empty loop leaves the accumulator alone, int and all
+    assert(kernel_reduce(mm, KERNEL_SUM, value_small_int(3), xs, value_none(), -4, &r));
+    assert(value_is_small_int(r) && value_as_int(r) == 3);
+    assert(!kernel_reduce(mm, KERNEL_DOT, value_small_int(0), xs, ys, MAX_N + 1, &r));
+    printf("✓ Counts follow range(): negative is empty, too long fails\n");
+
+    // Ints sum exactly, in loop order
+    Value is = int_list(mm, ia, MAX_N);
+    int64_t expect = 10;
+    for (size_t i = 0; i < MAX_N; i++) expect += ia[i];
+    assert(kernel_reduce(mm, KERNEL_SUM, value_small_int(10), is, value_none(), KERNEL_WHOLE, &r));
+    assert(value_is_int(r) && value_as_int(r) == expect);
+    int64_t dot = 0;
+    for (size_t i = 0; i < 50; i++) dot += ia[i] * ia[i];
+    assert(kernel_reduce(mm, KERNEL_DOT, value_small_int(0), is, is, 50, &r));
+    assert(value_as_int(r) == dot);
+
+    // Overflow midway turns the loop float, as value_add does, even though
+    // the wrapped total would be back in range
+    int64_t big[3] = { INT64_MAX, 1, -1 };
+    Value bs = int_list(mm, big, 3);
+    Value loop = value_small_int(0);
+    for (size_t i = 0; i < 3; i++) {
+        Value x = list_get(mm, bs, i);
+        Value next = value_add(mm, loop, x);
+        value_release(mm, loop);
+        value_release(mm, x);
+        loop = next;
+    }
+    assert(kernel_reduce(mm, KERNEL_SUM, value_small_int(0), bs, value_none(), KERNEL_WHOLE, &r));
+    assert(value_is_float(r) && value_equals(r, loop));
+    printf("✓ Int sums are exact and overflow like the loop\n");
+
+    value_release(mm, xs);
+    value_release(mm, ys);
+    value_release(mm, is);
+    value_release(mm, bs);
+    assert(mm_get_allocated_bytes(mm) == baseline);
+    mm_destroy(mm);
+    printf("✅ kernel_reduce tests passed!\n\n");
+}
+
+void test_map_and_store() {
+    printf("Testing kernel_map and kernel_store...\n");
+
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    size_t baseline = mm_get_allocated_bytes(mm);
+    fill();
+
+    Value xs = float_list(mm, b, MAX_N);
+    Value doubled = kernel_map(mm, KERNEL_MUL, xs, value_float(2.0));
+    assert(list_layout(doubled) == LAYOUT_FLOAT && list_length(doubled) == MAX_N);
+    for (size_t i = 0; i < MAX_N; i++) assert(list_floats(doubled)[i] == b[i] * 2.0);
+    Value squared = kernel_map(mm, KERNEL_MUL, xs, xs);
+    assert(list_floats(squared)[7] == b[7] * b[7]);
+    printf("✓ Float maps, broadcast and element-wise\n");
+
+    Value is = int_list(mm, ia, MAX_N);
+    Value inc = kernel_map(mm, KERNEL_ADD, is, value_small_int(1));
+    assert(list_layout(inc) == LAYOUT_INT && list_ints(inc)[3] == ia[3] + 1);
+    Value halves = kernel_map(mm, KERNEL_MUL, is, value_float(0.5));
+    assert(list_layout(halves) == LAYOUT_FLOAT && list_floats(halves)[3] == (double)ia[3] * 0.5);
+    Value capped = kernel_map(mm, KERNEL_MIN, is, value_small_int(0));
+    assert(list_ints(capped)[3] == (ia[3] < 0 ? ia[3] : 0));
+    printf("✓ Int maps stay int, and widen for a float operand\n");
+
+    // An overflowing element comes out float, the list boxed: what the loop builds
+    int64_t big[2] = { 5, INT64_MAX };
+    Value bs = int_list(mm, big, 2);
+    Value over = kernel_map(mm, KERNEL_MUL, bs, value_small_int(2));
+    assert(list_layout(over) == LAYOUT_BOXED);
+    Value v = list_get(mm, over, 0);
+    assert(value_is_int(v) && value_as_int(v) == 10);
+    v = list_get(mm, over, 1);
+    assert(value_is_float(v) && value_as_float(v) == (double)INT64_MAX * 2.0);
+    printf("✓ Int overflow falls back to generic arithmetic\n");
+
+    // apply_window: in place, x[i] = x[i] * w[i]
+    Value w = float_list(mm, c, MAX_N);
+    assert(kernel_store(mm, KERNEL_MUL, xs, xs, w, MAX_N));
+    for (size_t i = 0; i < MAX_N; i++) assert(list_floats(xs)[i] == b[i] * c[i]);
+    assert(!kernel_store(mm, KERNEL_MUL, xs, xs, w, MAX_N + 1));
+    // In place over ints with an overflow: the generic retry sees the original inputs
+    assert(kernel_store(mm, KERNEL_ADD, bs, bs, bs, 2));
+    v = list_get(mm, bs, 0);
+    assert(value_as_int(v) == 10);
+    v = list_get(mm, bs, 1);
+    assert(value_is_float(v) && value_as_float(v) == (double)INT64_MAX * 2.0);
+    printf("✓ kernel_store writes in place, safely when out is an input\n");
+
+    // Boxed lists take the generic path
+    Value boxed = list_create(mm, LAYOUT_BOXED, 0);
+    list_append(mm, boxed, value_small_int(4));
+    list_append(mm, boxed, value_float(1.5));
+    Value mixed = kernel_map(mm, KERNEL_SUB, boxed, value_small_int(1));
+    v = list_get(mm, mixed, 0);
+    assert(value_is_small_int(v) && value_as_int(v) == 3);
+    v = list_get(mm, mixed, 1);
+    assert(value_is_float(v) && value_as_float(v) == 0.5);
+    printf("✓ Boxed lists compute generically\n");
+
+    Value lists[] = { xs, doubled, squared, is, inc, halves, capped, bs, over, w, boxed, mixed };
+    for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) value_release(mm, lists[i]);
+    assert(mm_get_allocated_bytes(mm) == baseline);
+    mm_destroy(mm);
+    printf("✅ kernel_map and kernel_store tests passed!\n\n");
+}
+
+int main() {
+    printf("=== RHelix Kernel Test Suite ===\n\n");
+
+    test_variants_agree();
+    test_reduce();
+    test_map_and_store();
+
+    printf("🎉 All tests passed!\n");
+    return 0;
+}
@@ -1,8 +1,11 @@
 // test_memory.c - Test suite for memory manager
 #include "memory_manager.h"
+#include "value.h"
+#include "profiler.h"
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
 
 typedef struct {
     Object header;
@@ -67,11 +70,690 @@ void test_arena_allocation() {
     printf("✅ Arena allocation tests passed!\n\n");
 }
 
+void test_aligned_arena_allocation() {
+    printf("Testing aligned arena allocation...\n");
+    
+    MemoryManager* mm = mm_create(1024 * 1024);
+    Arena* arena = mm_arena_create(mm, 4096);
+    
+    // Byte buffers pack tightly with alignment 1
+    char* a = (char*)mm_arena_alloc_aligned(arena, 3, 1);
+    char* b = (char*)mm_arena_alloc_aligned(arena, 3, 1);
+    assert(a && b && b == a + 3);
+    printf("✓ Byte buffers packed without padding\n");
+    
+    // Every power of two up to a cache line is honored
+    for (size_t align = 1; align <= MM_MAX_ALIGN; align <<= 1) {
+        mm_arena_alloc_aligned(arena, 1, 1);  // Knock the bump pointer off
+        void* p = mm_arena_alloc_aligned(arena, 24, align);
+        assert(p != NULL);
+        assert(((uintptr_t)p & (align - 1)) == 0);
+    }
+    printf("✓ Alignments 1..%d bytes honored\n", MM_MAX_ALIGN);
+    
+    // Default allocation keeps 8-byte alignment
+    mm_arena_alloc_aligned(arena, 1, 1);
+    void* d = mm_arena_alloc(arena, 10);
+    assert(((uintptr_t)d & (MM_DEFAULT_ALIGN - 1)) == 0);
+    
+    // Invalid alignments are rejected
+    assert(mm_arena_alloc_aligned(arena, 8, 3) == NULL);
+    assert(mm_arena_alloc_aligned(arena, 8, 0) == NULL);
+    assert(mm_arena_alloc_aligned(arena, 8, 128) == NULL);
+    printf("✓ Non-power-of-two and over-cache-line alignments rejected\n");
+    
+    // Typed array helper, e.g. alloc[float](512)
+    float* window = (float*)mm_arena_alloc_array(arena, 512, sizeof(float), 32);
+    assert(window != NULL && ((uintptr_t)window & 31) == 0);
+    for (int i = 0; i < 512; i++) window[i] = (float)i;
+    printf("✓ alloc[float](512) is 32-byte aligned\n");
+    
+    // Running off the end fails cleanly
+    assert(mm_arena_alloc_aligned(arena, 8192, 8) == NULL);
+    
+    mm_arena_destroy(mm, arena);
+    mm_destroy(mm);
+    printf("✅ Aligned arena allocation tests passed!\n\n");
+}
+
+void test_array_overflow() {
+    printf("Testing array allocation overflow checks...\n");
+    
+    MemoryManager* mm = mm_create(1024 * 1024);
+    Arena* arena = mm_arena_create(mm, 4096);
+    
+    size_t huge = SIZE_MAX / 4 + 2;  // huge * 8 wraps around to a small value
+    assert(mm_arena_alloc_array(arena, huge, 8, 8) == NULL);
+    assert(mm_alloc_array(mm, huge, 8, 8) == NULL);
+    assert(mm_alloc_array(mm, SIZE_MAX, SIZE_MAX, 64) == NULL);
+    printf("✓ count * size overflow rejected (arena and heap)\n");
+    
+    // Zero-length arrays are valid
+    assert(mm_arena_alloc_array(arena, 0, 8, 8) != NULL);
+    Object* empty = mm_alloc_array(mm, 0, sizeof(double), 32);
+    assert(empty != NULL);
+    mm_release(mm, empty);
+    assert(mm_get_allocated_bytes(mm) == 0);
+    printf("✓ Zero-length arrays allowed\n");
+    
+    mm_arena_destroy(mm, arena);
+    mm_destroy(mm);
+    printf("✅ Array overflow tests passed!\n\n");
+}
+
+void test_aligned_heap_allocation() {
+    printf("Testing aligned heap allocation...\n");
+    
+    MemoryManager* mm = mm_create(1024 * 1024);
+    
+    for (size_t align = 1; align <= MM_MAX_ALIGN; align <<= 1) {
+        Object* obj = mm_alloc_aligned(mm, 100, align);
+        assert(obj != NULL);
+        assert(obj->ref_count == 1);
+        
+        unsigned char* data = (unsigned char*)MM_OBJECT_DATA(obj);
+        assert(((uintptr_t)data & (align - 1)) == 0);
+        for (int i = 0; i < 100; i++) assert(data[i] == 0);
+        memset(data, 0xAB, 100);
+        
+        mm_retain(obj);
+        mm_release(mm, obj);
+        mm_release(mm, obj);
+    }
+    assert(mm_get_allocated_bytes(mm) == 0);
+    printf("✓ Heap payloads aligned 1..%d bytes, accounting balanced\n", MM_MAX_ALIGN);
+    
+    double* samples = (double*)MM_OBJECT_DATA(mm_alloc_array(mm, 256, sizeof(double), 64));
+    assert(((uintptr_t)samples & 63) == 0);
+    mm_release(mm, (Object*)samples - 1);
+    assert(mm_get_allocated_bytes(mm) == 0);
+    printf("✓ Cache-line aligned double array\n");
+    
+    assert(mm_alloc_aligned(mm, 16, 48) == NULL);
+    assert(mm_alloc_aligned(mm, 16, 128) == NULL);
+    printf("✓ Invalid heap alignments rejected\n");
+    
+    mm_destroy(mm);
+    printf("✅ Aligned heap allocation tests passed!\n\n");
+}
+
+void test_stack_objects() {
+    printf("Testing frame-allocated objects...\n");
+    
+    MemoryManager* mm = mm_create(1024 * 1024);
+    
+    STACK_OBJECT(pair, 2 * sizeof(long));
+    long* slots = (long*)MM_OBJECT_DATA(pair);
+    assert(slots[0] == 0 && slots[1] == 0);
+    slots[0] = 7;
+    slots[1] = 9;
+    assert(pair->flags & OBJ_STACK);
+    printf("✓ Stack object initialized in frame storage\n");
+    
+    // No refcount traffic and nothing accounted to the heap
+    mm_retain(pair);
+    mm_release(mm, pair);
+    mm_release(mm, pair);
+    assert(pair->ref_count == 1);
+    assert(slots[0] + slots[1] == 16);
+    assert(mm_get_allocated_bytes(mm) == 0);
+    printf("✓ Retain/release are no-ops for stack objects\n");
+    
+    mm_destroy(mm);
+    printf("✅ Frame-allocated object tests passed!\n\n");
+}
+
+void test_weak_references() {
+    printf("Testing weak references...\n");
+    
+    MemoryManager* mm = mm_create(16 * 1024 * 1024);
+    
+    // A weak reference sees its target while it is alive...
+    Object* parent = mm_alloc(mm, 32);
+    WeakRef* w1 = mm_weak_create(mm, parent);
+    WeakRef* w2 = mm_weak_create(mm, parent);
+    assert(mm_weak_get(w1) == parent && mm_weak_get(w2) == parent);
+    assert(parent->ref_count == 1);
+    assert(parent->flags & OBJ_WEAK_REFERENCED);
+    assert(mm_weak_count(mm, parent) == 2);
+    printf("✓ Weak references do not retain their target\n");
+    
+    // ...and lock() hands out a strong reference
+    Object* strong = mm_weak_lock(w1);
+    assert(strong == parent && parent->ref_count == 2);
+    mm_release(mm, strong);
+    
+    // Releasing the last strong reference clears every weak reference
+    mm_release(mm, parent);
+    assert(mm_weak_get(w1) == NULL && mm_weak_get(w2) == NULL);
+    assert(mm_weak_lock(w1) == NULL);
+    assert(mm->weak_table.count == 0);
+    mm_weak_destroy(mm, w1);
+    mm_weak_destroy(mm, w2);
+    printf("✓ Freeing the target clears its weak references\n");
+    
+    // Destroying weak references first leaves the target untouched
+    Object* obj = mm_alloc(mm, 8);
+    WeakRef* a = mm_weak_create(mm, obj);
+    WeakRef* b = mm_weak_create(mm, obj);
+    WeakRef* c = mm_weak_create(mm, obj);
+    mm_weak_destroy(mm, b);  // Middle of the chain
+    assert(mm_weak_count(mm, obj) == 2);
+    mm_weak_destroy(mm, c);  // Head of the chain
+    mm_weak_destroy(mm, a);
+    assert(!(obj->flags & OBJ_WEAK_REFERENCED));
+    assert(mm->weak_table.count == 0 && mm->weak_ref_count == 0);
+    mm_release(mm, obj);
+    printf("✓ Destroyed weak references unlink from the side table\n");
+    
+    // Many targets: the table grows, and deleting in an arbitrary order
+    // keeps every remaining lookup intact
+    enum { N = 1000 };
+    static Object* objs[N];
+    static WeakRef* refs[N];
+    for (int i = 0; i < N; i++) {
+        objs[i] = mm_alloc(mm, 16);
+        refs[i] = mm_weak_create(mm, objs[i]);
+    }
+    assert(mm->weak_table.count == N);
+    for (int i = 0; i < N; i += 3) mm_release(mm, objs[i]);
+    for (int i = 0; i < N; i++) {
+        assert(mm_weak_get(refs[i]) == (i % 3 == 0 ? NULL : objs[i]));
+        assert(i % 3 == 0 || mm_weak_count(mm, objs[i]) == 1);
+    }
+    for (int i = 0; i < N; i++) {
+        if (i % 3 != 0) mm_release(mm, objs[i]);
+        mm_weak_destroy(mm, refs[i]);
+    }
+    assert(mm->weak_table.count == 0 && mm->weak_ref_count == 0);
+    printf("✓ Side table stays consistent across %d targets\n", N);
+    
+    // Frame and arena storage is never released, so no weak references
+    STACK_OBJECT(local, 8);
+    assert(mm_weak_create(mm, local) == NULL);
+    printf("✓ Stack objects cannot be weakly referenced\n");
+    
+    mm_destroy(mm);
+    printf("✅ Weak reference tests passed!\n\n");
+}
+
+void test_compact_header() {
+    printf("Testing compact object header...\n");
+    
+    MemoryManager* mm = mm_create(16 * 1024 * 1024);
+    
+    assert(sizeof(Object) == 8);
+    
+    // A boxed int is one 16-byte block: 8 bytes of header, 8 of payload
+    Object* boxed = mm_alloc(mm, sizeof(long));
+    assert(((uintptr_t)MM_OBJECT_DATA(boxed) & (MM_DEFAULT_ALIGN - 1)) == 0);
+    assert(mm_object_size(boxed) == sizeof(long));
+    assert(mm_get_allocated_bytes(mm) == 16);
+    printf("✓ Boxed int costs %zu bytes (header %zu)\n",
+           mm_get_allocated_bytes(mm), sizeof(Object));
+    
+    // Odd sizes round up to their class; freed blocks are reused
+    Object* odd = mm_alloc(mm, 100);
+    assert(mm_object_size(odd) >= 100 && mm_object_size(odd) < 125);
+    mm_release(mm, odd);
+    Object* again = mm_alloc(mm, 100);
+    assert(again == odd);
+    unsigned char* bytes = (unsigned char*)MM_OBJECT_DATA(again);
+    for (int i = 0; i < 100; i++) assert(bytes[i] == 0);
+    mm_release(mm, again);
+    printf("✓ Size classes round up and recycle zeroed blocks\n");
+    
+    // The type id shares the flags word without disturbing flag bits
+    OBJ_SET_TYPE(boxed, 0x2A);
+    boxed->flags |= OBJ_MARKED;
+    assert(OBJ_TYPE(boxed) == 0x2A && (boxed->flags & OBJ_MARKED));
+    // Released below, so a type without a finalizer: the 8-byte payload
+    // is what a boxed int has, not a list header
+    OBJ_SET_TYPE(boxed, OBJ_TYPE_INT);
+    assert(OBJ_TYPE(boxed) == OBJ_TYPE_INT && (boxed->flags & OBJ_MARKED));
+    assert(!mm->finalizers[OBJ_TYPE_INT]);
+    mm_release(mm, boxed);
+    printf("✓ Type id packed into the flags word\n");
+    
+    // Sizes past 64 KB keep their exact size (a 16-bit field truncated them)
+    size_t big_size = 70000;
+    Object* big = mm_alloc(mm, big_size);
+    assert(big && big->size_class == MM_SIZE_CLASS_LARGE);
+    assert(mm_object_size(big) == big_size);
+    memset(MM_OBJECT_DATA(big), 0x5A, big_size);
+    assert(((unsigned char*)MM_OBJECT_DATA(big))[big_size - 1] == 0x5A);
+    Object* huge = mm_alloc_array(mm, 1 << 20, sizeof(double), 64);
+    assert(huge && mm_object_size(huge) == (size_t)(1 << 20) * sizeof(double));
+    mm_release(mm, big);
+    mm_release(mm, huge);
+    assert(mm_get_allocated_bytes(mm) == 0);
+    printf("✓ Large objects (70000 bytes, 8 MB) sized and freed exactly\n");
+    
+    STACK_OBJECT(frame, 24);
+    assert(mm_object_size(frame) == 24);
+    
+    mm_destroy(mm);
+    printf("✅ Compact header tests passed!\n\n");
+}
+
+void test_values() {
+    printf("Testing NaN-boxed values...\n");
+    
+    MemoryManager* mm = mm_create(1024 * 1024);
+    
+    assert(sizeof(Value) == 8);
+    
+    // Immediates round-trip without touching the heap
+    int64_t ints[] = { 0, 1, -1, 42, VALUE_INT_MAX, VALUE_INT_MIN };
+    for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); i++) {
+        Value v = value_int(mm, ints[i]);
+        assert(value_is_small_int(v) && value_as_int(v) == ints[i]);
+        assert(value_kind(v) == VALUE_INT);
+    }
+    double floats[] = { 0.0, -0.0, 1.5, -2.25, 1e308, -1e-308 };
+    for (size_t i = 0; i < sizeof(floats) / sizeof(floats[0]); i++) {
+        Value v = value_float(floats[i]);
+        assert(value_is_float(v) && value_as_float(v) == floats[i]);
+    }
+    assert(value_is_float(value_float(1.0 / 0.0)));
+    assert(value_is_float(value_float(-1.0 / 0.0)));
+    assert(value_is_bool(value_bool(true)) && value_as_bool(value_bool(true)));
+    assert(!value_as_bool(value_bool(false)));
+    assert(value_is_none(value_none()));
+    assert(mm_get_allocated_bytes(mm) == 0);
+    printf("✓ Ints, floats, bools and None are immediate\n");
+    
+    // NaNs, including ones whose bits collide with tags, stay floats
+    uint64_t nasty = 0xFFFC000000001234ull;
+    double nan_bits;
+    memcpy(&nan_bits, &nasty, sizeof(nan_bits));
+    Value nan = value_float(nan_bits);
+    assert(value_is_float(nan) && !value_is_object(nan));
+    assert(!value_equals(nan, nan));
+    printf("✓ NaN payloads are canonicalized\n");
+    
+    // Arithmetic stays immediate, promotes on mixing, boxes past 48 bits
+    Value a = value_int(mm, 40), b = value_int(mm, 2);
+    assert(value_as_int(value_add(mm, a, b)) == 42);
+    assert(value_as_int(value_sub(mm, a, b)) == 38);
+    assert(value_as_int(value_mul(mm, a, b)) == 80);
+    Value mixed = value_add(mm, a, value_float(0.5));
+    assert(value_is_float(mixed) && value_as_float(mixed) == 40.5);
+    assert(value_equals(value_int(mm, 3), value_float(3.0)));
+    
+    Value big = value_add(mm, value_int(mm, VALUE_INT_MAX), value_int(mm, 1));
+    assert(value_is_object(big) && value_is_int(big));
+    assert(value_as_int(big) == VALUE_INT_MAX + 1);
+    assert(OBJ_TYPE(value_as_object(big)) == OBJ_TYPE_INT);
+    Value back = value_sub(mm, big, value_int(mm, 1));
+    assert(value_is_small_int(back) && value_as_int(back) == VALUE_INT_MAX);
+    Value huge = value_mul(mm, big, big);  // Overflows int64: falls back to float
+    assert(value_is_float(huge));
+    value_release(mm, big);
+    assert(mm_get_allocated_bytes(mm) == 0);
+    printf("✓ Ints past 48 bits are boxed and released like objects\n");
+    
+    // Heap objects carry their kind in the header
+    Object* str = mm_alloc(mm, 16);
+    OBJ_SET_TYPE(str, OBJ_TYPE_STRING);
+    Value s = value_object(str);
+    assert(value_is_object(s) && value_as_object(s) == str);
+    assert(value_kind(s) == VALUE_OBJECT);
+    value_retain(s);
+    assert(str->ref_count == 2);
+    value_release(mm, s);
+    value_release(mm, s);
+    assert(mm_get_allocated_bytes(mm) == 0);
+    
+    assert(!value_truthy(value_int(mm, 0)) && value_truthy(value_int(mm, -3)));
+    assert(!value_truthy(value_float(0.0)) && !value_truthy(value_none()));
+    printf("✓ Heap values, refcounts and truthiness\n");
+    
+    mm_destroy(mm);
+    printf("✅ Value tests passed!\n\n");
+}
+
+void test_immortal_values() {
+    printf("Testing immortal value cache...\n");
+    
+    MemoryManager* mm = mm_create(1024 * 1024);
+    
+    // The cache lives outside the counted heap
+    assert(mm_get_allocated_bytes(mm) == 0);
+    assert(value_cache_string_count(mm) >= 257);
+    
+    // Empty and single-byte strings never allocate or count references
+    Value empty = value_string(mm, "", 0);
+    Value a1 = value_string(mm, "a", 1);
+    Value a2 = value_string(mm, "abc", 1);
+    assert(value_is_string(empty) && value_string_length(empty) == 0);
+    assert(a1.bits == a2.bits && strcmp(value_string_chars(a1), "a") == 0);
+    Object* cached = value_as_object(a1);
+    assert(cached->flags & OBJ_IMMORTAL);
+    for (int i = 0; i < 10; i++) value_retain(a1);
+    value_release(mm, a1);
+    assert(cached->ref_count == 1);
+    assert(mm_get_allocated_bytes(mm) == 0);
+    assert(!value_truthy(empty) && value_truthy(a1));
+    printf("✓ Empty and single-byte strings come from the cache\n");
+    
+    // Interning returns one immortal object per content
+    size_t before = value_cache_interned_count(mm);
+    Value n1 = value_intern(mm, "counter", 7);
+    char buf[] = "counter";
+    Value n2 = value_intern(mm, buf, strlen(buf));
+    assert(n1.bits == n2.bits);
+    assert(value_cache_interned_count(mm) == before + 1);
+    assert(value_intern(mm, "self", 4).bits == value_intern(mm, "self", 4).bits);
+    assert(value_cache_interned_count(mm) == before + 1);  // Preinterned
+    assert(mm_get_allocated_bytes(mm) == 0);
+    printf("✓ Identifiers intern to shared immortal strings\n");
+    
+    // Ordinary strings are refcounted heap objects that compare by content
+    Value heap = value_string(mm, "counter", 7);
+    assert(!(value_as_object(heap)->flags & OBJ_IMMORTAL));
+    assert(heap.bits != n1.bits && value_equals(heap, n1));
+    assert(!value_equals(heap, value_string(mm, "x", 1)));
+    value_release(mm, heap);
+    assert(mm_get_allocated_bytes(mm) == 0);
+    
+    // The intern table grows without losing entries
+    char name[16];
+    for (int i = 0; i < 500; i++) {
+        snprintf(name, sizeof(name), "var_%d", i);
+        value_intern(mm, name, strlen(name));
+    }
+    Value again = value_intern(mm, "counter", 7);
+    assert(again.bits == n1.bits);
+    assert(value_cache_interned_count(mm) == before + 501);
+    printf("✓ Intern table grows; heap strings stay refcounted\n");
+    
+    // Small ints, bools and None need no cache at all
+    assert(value_is_small_int(value_int(mm, -5)) && value_is_small_int(value_int(mm, 1024)));
+    assert(mm_get_allocated_bytes(mm) == 0);
+    
+    mm_destroy(mm);
+    printf("✅ Immortal value cache tests passed!\n\n");
+}
+
+void test_closures() {
+    printf("Testing closures and cells...\n");
+    
+    MemoryManager* mm = mm_create(1024 * 1024);
+    
+    // A closure record holds its captures inline and owns them
+    Value name = value_string(mm, "captured", 8);
+    Value captures[3] = { value_small_int(7), name, value_float(0.5) };
+    value_retain(name);
+    Value closure = value_closure(mm, 4, captures, 3);
+    assert(value_is_closure(closure) && !value_is_cell(closure));
+    ClosureData* d = VALUE_CLOSURE_DATA(value_as_object(closure));
+    assert(d->function == 4 && d->capture_count == 3);
+    assert(value_as_small_int(d->captures[0]) == 7);
+    assert(d->captures[1].bits == name.bits);
+    assert(value_as_object(name)->ref_count == 2);
+    printf("✓ Closure records copy their captures in one allocation\n");
+    
+    // Releasing the closure releases what it captured
+    value_release(mm, closure);
+    assert(value_as_object(name)->ref_count == 1);
+    value_release(mm, name);
+    assert(mm_get_allocated_bytes(mm) == 0);
+    
+    Value empty = value_closure(mm, 0, NULL, 0);
+    assert(value_is_closure(empty));
+    assert(VALUE_CLOSURE_DATA(value_as_object(empty))->capture_count == 0);
+    value_release(mm, empty);
+    assert(mm_get_allocated_bytes(mm) == 0);
+    printf("✓ Captures are released with the closure\n");
+    
+    // Cells are shared: a store through one holder is seen by the other
+    Value cell = value_cell(mm, value_small_int(1));
+    assert(value_is_cell(cell));
+    value_retain(cell);
+    Value shared[1] = { cell };
+    Value reader = value_closure(mm, 1, shared, 1);
+    Value in_record = VALUE_CLOSURE_DATA(value_as_object(reader))->captures[0];
+    value_cell_set(mm, cell, value_string(mm, "rebound", 7));
+    assert(value_is_string(value_cell_get(in_record)));
+    assert(strcmp(value_string_chars(value_cell_get(in_record)), "rebound") == 0);
+    
+    // The cell outlives the frame that made it while a closure holds it
+    value_release(mm, cell);
+    assert(value_is_string(value_cell_get(in_record)));
+    value_release(mm, reader);
+    assert(mm_get_allocated_bytes(mm) == 0);
+    printf("✓ Cells share rebinding and release their contents\n");
+    
+    mm_destroy(mm);
+    printf("✅ Closure tests passed!\n\n");
+}
+
+typedef struct {
+    int soft_events;
+    int hard_events;
+    Object* reserve;         // Released on the first hard-limit event
+    MemoryManager* mm;
+} LimitLog;
+
+static bool on_limit(MemoryManager* mm, MMLimitEvent event, size_t footprint,
+                     size_t requested, void* user_data) {
+    (void)footprint;
+    (void)requested;
+    LimitLog* log = (LimitLog*)user_data;
+    assert(log->mm == mm);
+    if (event == MM_LIMIT_SOFT) {
+        log->soft_events++;
+        return false;
+    }
+    log->hard_events++;
+    if (log->reserve) {
+        mm_release(mm, log->reserve);
+        log->reserve = NULL;
+        return true;  // Freed something: retry
+    }
+    return false;
+}
+
+void test_memory_limits() {
+    printf("Testing unified accounting and limits...\n");
+    
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    
+    // Arenas count toward the footprint, not toward live objects
+    size_t base = mm_get_footprint(mm);
+    Arena* arena = mm_arena_create(mm, 256 * 1024);
+    assert(mm_get_footprint(mm) == base + 256 * 1024);
+    assert(mm_get_allocated_bytes(mm) == 0);
+    mm_arena_destroy(mm, arena);
+    assert(mm_get_footprint(mm) == base);
+    
+    // Small objects are charged by slab, large ones by block
+    Object* small = mm_alloc(mm, 8);
+    assert(mm_get_footprint(mm) == base + MM_SLAB_SIZE);
+    Object* large = mm_alloc(mm, 100000);
+    assert(mm_get_footprint(mm) > base + MM_SLAB_SIZE + 100000);
+    mm_release(mm, large);
+    mm_release(mm, small);
+    assert(mm_get_footprint(mm) == base + MM_SLAB_SIZE);
+    printf("✓ Footprint covers arenas, slabs and large objects\n");
+    
+    // Soft limit: allocation continues, one notification per excursion.
+    // Hard limit: refused, unless the callback frees enough to retry.
+    size_t soft = mm_get_footprint(mm) + 512 * 1024;
+    size_t hard = mm_get_footprint(mm) + 1024 * 1024;
+    LimitLog log = { 0, 0, NULL, mm };
+    mm_set_limits(mm, soft, hard);
+    mm_set_limit_callback(mm, on_limit, &log);
+    
+    Object* a = mm_alloc(mm, 400 * 1024);
+    assert(a && log.soft_events == 0);
+    Object* b = mm_alloc(mm, 300 * 1024);
+    assert(b && log.soft_events == 1);
+    Object* c = mm_alloc(mm, 10 * 1024);
+    assert(c && log.soft_events == 1);
+    printf("✓ Soft limit notifies once and keeps allocating\n");
+    
+    assert(mm_alloc(mm, 400 * 1024) == NULL);
+    assert(log.hard_events == 1);
+    assert(mm_arena_create(mm, 400 * 1024) == NULL);
+    assert(log.hard_events == 2);
+    
+    log.reserve = b;
+    Object* d = mm_alloc(mm, 320 * 1024);
+    assert(d && log.hard_events == 3 && log.reserve == NULL);
+    assert(mm_get_footprint(mm) <= hard);
+    printf("✓ Hard limit refuses, callback can free and retry\n");
+    
+    mm_release(mm, a);
+    mm_release(mm, c);
+    mm_release(mm, d);
+    Object* f = mm_alloc(mm, 100 * 1024);  // Back under soft: re-armed
+    Object* e = mm_alloc(mm, 600 * 1024);
+    assert(f && e && log.soft_events == 2);
+    mm_release(mm, f);
+    mm_release(mm, e);
+    mm_destroy(mm);
+    
+    // Pacer: the threshold tracks the surviving footprint, so a growing
+    // heap is collected a logarithmic number of times, not per allocation
+    mm = mm_create(MM_UNLIMITED);
+    mm_set_gc_growth(mm, 100);
+    enum { LIVE = 200000 };
+    static Object* live[LIVE];
+    for (int i = 0; i < LIVE; i++) live[i] = mm_alloc(mm, 200);
+    size_t footprint = mm_get_footprint(mm);
+    assert(footprint > 40 * 1024 * 1024);
+    assert(mm->gc_cycles >= 2 && mm->gc_cycles <= 6);
+    assert(mm->gc_threshold > footprint);
+    printf("✓ %zu collections while growing to %zu MB\n",
+           mm->gc_cycles, footprint >> 20);
+    for (int i = 0; i < LIVE; i++) mm_release(mm, live[i]);
+    
+    // The pacer never schedules past the soft limit
+    mm_set_limits(mm, 8 * 1024 * 1024, MM_UNLIMITED);
+    assert(mm->gc_threshold <= 8 * 1024 * 1024);
+    mm_destroy(mm);
+    printf("✓ Pacer threshold capped at the soft limit\n");
+    
+    // Small limits: the preallocated value cache is outside them, and
+    // below one slab small objects are charged block by block
+    size_t small_limits[] = { 1024, 8192, 65536 };
+    for (int k = 0; k < 3; k++) {
+        mm = mm_create(small_limits[k]);
+        assert(mm && mm_get_footprint(mm) == 0);
+        assert(value_is_string(value_string(mm, "x", 1)));
+        Object* first = mm_alloc(mm, 16);
+        assert(first);
+        int count = 1;
+        while (mm_alloc(mm, 16)) count++;
+        assert(mm_get_footprint(mm) <= small_limits[k]);
+        assert(count >= (int)(small_limits[k] / 64));
+        mm_destroy(mm);
+    }
+    printf("✓ Managers limited to 1, 8 and 64 KB allocate up to their limit\n");
+    
+    printf("✅ Memory limit tests passed!\n\n");
+}
+
+// Source locations as generated code would emit them
+static const MMSourceLoc loc_main  = { "main", "app.rh", 1, 1 };
+static const MMSourceLoc loc_build = { "build_rows", "app.rh", 10, 5 };
+static const MMSourceLoc loc_parse = { "parse_row", "app.rh", 20, 9 };
+
+static size_t read_file(FILE* f, char* buf, size_t cap) {
+    rewind(f);
+    size_t n = fread(buf, 1, cap - 1, f);
+    buf[n] = '\0';
+    return n;
+}
+
+static bool contains_bytes(const char* hay, size_t n, const char* needle) {
+    size_t m = strlen(needle);
+    for (size_t i = 0; i + m <= n; i++) {
+        if (memcmp(hay + i, needle, m) == 0) return true;
+    }
+    return false;
+}
+
+void test_allocation_profiler() {
+    printf("Testing sampling allocation profiler...\n");
+    
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    
+    // Disabled: frame markers and allocations leave no trace
+    MM_PROFILE_ENTER(mm, &loc_main);
+    mm_release(mm, mm_alloc(mm, 64));
+    MM_PROFILE_EXIT(mm);
+    assert(mm->profiler == NULL && mm_profile_stack_count(mm) == 0);
+    
+    assert(mm_profile_start(mm, 4096));
+    MM_PROFILE_EXIT(mm);  // Unbalanced exit from before the start: ignored
+    
+    size_t before = mm->total_allocated;
+    MM_PROFILE_ENTER(mm, &loc_main);
+    MM_PROFILE_ENTER(mm, &loc_build);
+    for (int i = 0; i < 2000; i++) mm_release(mm, mm_alloc(mm, 200));
+    MM_PROFILE_ENTER(mm, &loc_parse);
+    for (int i = 0; i < 2000; i++) mm_release(mm, mm_alloc(mm, 1000));
+    MM_PROFILE_EXIT(mm);
+    MM_PROFILE_EXIT(mm);
+    MM_PROFILE_EXIT(mm);
+    size_t allocated = mm->total_allocated - before;
+    
+    // Two distinct stacks, and the estimate tracks what was allocated
+    assert(mm_profile_stack_count(mm) == 2);
+    size_t estimate = mm_profile_sampled_bytes(mm);
+    assert(estimate > allocated * 8 / 10 && estimate < allocated * 12 / 10);
+    printf("✓ %zu bytes allocated, ~%zu sampled across %zu stacks\n",
+           allocated, estimate, mm_profile_stack_count(mm));
+    
+    // Folded stacks, outermost frame first, one line per stack
+    static char buf[8192];
+    FILE* f = tmpfile();
+    assert(f && mm_profile_write_folded(mm, f));
+    size_t n = read_file(f, buf, sizeof(buf));
+    fclose(f);
+    assert(strstr(buf, "main (app.rh:1:1);build_rows (app.rh:10:5) "));
+    assert(strstr(buf, "main (app.rh:1:1);build_rows (app.rh:10:5);"
+                       "parse_row (app.rh:20:9) "));
+    int lines = 0;
+    for (size_t i = 0; i < n; i++) lines += buf[i] == '\n';
+    assert(lines == 2);
+    printf("✓ Folded stacks for flame graphs\n");
+    
+    // pprof: a profile.proto whose string table holds the frame names
+    f = tmpfile();
+    assert(f && mm_profile_write_pprof(mm, f));
+    n = read_file(f, buf, sizeof(buf));
+    fclose(f);
+    assert(n > 0 && (unsigned char)buf[0] == 0x0A);  // Field 1 (sample_type), LEN
+    assert(contains_bytes(buf, n, "alloc_space") && contains_bytes(buf, n, "parse_row"));
+    assert(contains_bytes(buf, n, "app.rh"));
+    printf("✓ pprof profile written (%zu bytes)\n", n);
+    
+    mm_profile_stop(mm);
+    assert(mm->profiler == NULL);
+    mm_destroy(mm);
+    printf("✅ Allocation profiler tests passed!\n\n");
+}
+
 int main() {
     printf("=== RHelix Memory Manager Test Suite ===\n\n");
     
     test_reference_counting();
     test_arena_allocation();
+    test_aligned_arena_allocation();
+    test_array_overflow();
+    test_aligned_heap_allocation();
+    test_stack_objects();
+    test_weak_references();
+    test_compact_header();
+    test_values();
+    test_immortal_values();
+    test_closures();
+    test_memory_limits();
+    test_allocation_profiler();
     
     printf("🎉 All tests passed!\n");
     return 0;
@@ -0,0 +1,316 @@
+// test_pipeline.c - Test suite for fused, lazy pipelines
+#include "pipeline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+// Stage functions count their calls through ctx
+typedef struct {
+    int64_t operand;
+    long calls;
+} StageCtx;
+
+static Value add_stage(MemoryManager* mm, Value v, void* ctx) {
+    StageCtx* c = (StageCtx*)ctx;
+    c->calls++;
+    return value_int(mm, value_as_int(v) + c->operand);
+}
+
+static Value mul_stage(MemoryManager* mm, Value v, void* ctx) {
+    StageCtx* c = (StageCtx*)ctx;
+    c->calls++;
+    return value_int(mm, value_as_int(v) * c->operand);
+}
+
+static bool multiple_of(Value v, void* ctx) {
+    StageCtx* c = (StageCtx*)ctx;
+    c->calls++;
+    return value_as_int(v) % c->operand == 0;
+}
+
+static bool greater_than(Value v, void* ctx) {
+    StageCtx* c = (StageCtx*)ctx;
+    c->calls++;
+    return value_as_int(v) > c->operand;
+}
+
+static Value sum_fold(MemoryManager* mm, Value acc, Value v, void* ctx) {
+    (void)ctx;
+    return value_int(mm, value_as_int(acc) + value_as_int(v));
+}
+
+static Value* make_range(long n) {
+    Value* items = (Value*)malloc(sizeof(Value) * n);
+    for (long i = 0; i < n; i++) items[i] = value_small_int(i);
+    return items;
+}
+
+void test_fused_stages() {
+    printf("Testing fused stages...\n");
+
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    long n = 1000;
+    Value* items = make_range(n);
+
+    // xs |> map(x * 3) |> filter(x % 2 == 0) |> map(x + 1)
+    StageCtx times3 = { 3, 0 }, even = { 2, 0 }, plus1 = { 1, 0 };
+    Pipeline p;
+    pipe_init(&p, mm, items, n);
+    assert(pipe_map(&p, mul_stage, &times3));
+    assert(pipe_filter(&p, multiple_of, &even));
+    assert(pipe_map(&p, add_stage, &plus1));
+    assert(times3.calls == 0);  // Nothing runs until a consumer pulls
+
+    PipeList out;
+    assert(pipe_collect(&p, &out));
+    assert(out.count == 500);
+    for (size_t i = 0; i < out.count; i++) {
+        assert(value_as_int(out.items[i]) == (int64_t)(6 * i + 1));
+    }
+    // One call per element reaching each stage
+    assert(times3.calls == n && even.calls == n && plus1.calls == 500);
+    printf("✓ map |> filter |> map: %zu outputs, one pass over %ld items\n", out.count, n);
+
+    pipe_list_free(mm, &out);
+    assert(out.count == 0 && out.storage == NULL);
+    free(items);
+    mm_destroy(mm);
+
+    printf("✅ Fused stage tests passed!\n\n");
+}
+
+void test_lazy_consumers() {
+    printf("Testing lazy consumers...\n");
+
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    long n = 1000000;
+    Value* items = make_range(n);
+
+    // find_first stops pulling at the first match
+    StageCtx sq = { 7, 0 }, big = { 1000, 0 };
+    Pipeline p;
+    pipe_init(&p, mm, items, n);
+    pipe_map(&p, mul_stage, &sq);
+    Value found;
+    assert(pipe_find_first(&p, greater_than, &big, &found));
+    assert(value_as_int(found) == 1001);  // 143 * 7
+    assert(pipe_pulled(&p) == 144);
+    assert(sq.calls == 144);
+    printf("✓ find_first pulled %zu of %ld items\n", pipe_pulled(&p), n);
+
+    // take(n) stops once it is full, even with a filter before it
+    StageCtx odd_ctx = { 2, 0 };
+    pipe_init(&p, mm, items, n);
+    pipe_filter(&p, multiple_of, &odd_ctx);
+    pipe_take(&p, 5);
+    PipeList out;
+    assert(pipe_collect(&p, &out));
+    assert(out.count == 5 && value_as_int(out.items[4]) == 8);
+    assert(pipe_pulled(&p) == 9);
+    pipe_list_free(mm, &out);
+
+    pipe_init(&p, mm, items, n);
+    pipe_take(&p, 0);
+    assert(pipe_collect(&p, &out) && out.count == 0 && pipe_pulled(&p) == 0);
+    pipe_list_free(mm, &out);
+    printf("✓ take stops pulling once full\n");
+
+    // A prefix of a long chain: no stage sees more than it must
+    StageCtx a = { 1, 0 }, b = { 3, 0 }, c = { 2, 0 };
+    pipe_init(&p, mm, items, n);
+    pipe_map(&p, add_stage, &a);
+    pipe_filter(&p, multiple_of, &b);
+    pipe_map(&p, mul_stage, &c);
+    pipe_take(&p, 2);
+    Value v;
+    assert(pipe_next(&p, &v) && value_as_int(v) == 6);
+    assert(pipe_next(&p, &v) && value_as_int(v) == 12);
+    assert(!pipe_next(&p, &v));
+    assert(a.calls == 6 && b.calls == 6 && c.calls == 2);
+    printf("✓ pipe_next pulls one element at a time\n");
+
+    free(items);
+    mm_destroy(mm);
+
+    printf("✅ Lazy consumer tests passed!\n\n");
+}
+
+void test_ownership() {
+    printf("Testing ownership of intermediates...\n");
+
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    long n = 2000;
+    Value* items = make_range(n);
+    size_t baseline = mm_get_allocated_bytes(mm);
+
+    // Adding 2^47 boxes every mapped value, so each intermediate is a heap
+    // object; those the filter drops must be released
+    StageCtx box = { VALUE_INT_MAX + 1, 0 }, unbox = { -(VALUE_INT_MAX + 1), 0 };
+    StageCtx third = { 3, 0 };
+    Pipeline p;
+    pipe_init(&p, mm, items, n);
+    pipe_map(&p, add_stage, &box);
+    pipe_filter(&p, multiple_of, &third);
+    pipe_map(&p, add_stage, &unbox);
+    PipeList out;
+    assert(pipe_collect(&p, &out));
+    assert(out.count > 0 && value_is_small_int(out.items[0]));
+    pipe_list_free(mm, &out);
+    assert(mm_get_allocated_bytes(mm) == baseline);
+    printf("✓ Dropped and consumed intermediates are released\n");
+
+    // Boxed outputs survive in the list until it is freed
+    pipe_init(&p, mm, items, n);
+    pipe_map(&p, add_stage, &box);
+    assert(pipe_collect(&p, &out) && out.count == (size_t)n);
+    assert(value_is_object(out.items[0]));
+    assert(mm_get_allocated_bytes(mm) > baseline);
+    pipe_list_free(mm, &out);
+    assert(mm_get_allocated_bytes(mm) == baseline);
+
+    // Fold: a running sum, no list at all
+    mm_reset_peak(mm);
+    pipe_init(&p, mm, items, n);
+    Value total = pipe_fold(&p, value_small_int(0), sum_fold, NULL);
+    assert(value_as_int(total) == (int64_t)n * (n - 1) / 2);
+    assert(mm_get_peak_allocated_bytes(mm) == baseline);
+    printf("✓ Collected values are owned by the list; fold allocates nothing\n");
+
+    // Source items are borrowed: an identity pipeline retains its outputs
+    Value s = value_string(mm, "pipeline", 8);
+    pipe_init(&p, mm, &s, 1);
+    Value got;
+    assert(pipe_next(&p, &got) && got.bits == s.bits);
+    assert(value_as_object(s)->ref_count == 2);
+    value_release(mm, got);
+    value_release(mm, s);
+
+    // Stage limit
+    pipe_init(&p, mm, items, n);
+    for (int i = 0; i < PIPE_MAX_STAGES; i++) assert(pipe_take(&p, n));
+    assert(!pipe_map(&p, add_stage, &box));
+    printf("✓ Borrowed sources and the stage limit\n");
+
+    free(items);
+    mm_destroy(mm);
+
+    printf("✅ Ownership tests passed!\n\n");
+}
+
+// Spin for ctx iterations: a CPU-bound stage that allocates nothing
+static Value spin_stage(MemoryManager* mm, Value v, void* ctx) {
+    (void)mm;
+    uint64_t x = (uint64_t)value_as_small_int(v);
+    for (long i = 0; i < *(long*)ctx; i++) x = x * 6364136223846793005ULL + 1;
+    (void)x;
+    return value_small_int(value_as_small_int(v) + 1);
+}
+
+static bool small_even(Value v, void* ctx) {
+    (void)ctx;
+    return (value_as_small_int(v) & 1) == 0;
+}
+
+static void build_parallel_chain(Pipeline* p, MemoryManager* mm, const Value* items,
+                                 long n, long* work) {
+    pipe_init(p, mm, items, n);
+    pipe_map(p, spin_stage, work);
+    pipe_filter(p, small_even, NULL);
+    pipe_map(p, spin_stage, work);
+    pipe_map(p, spin_stage, work);
+}
+
+void test_parallel_stages() {
+    printf("Testing parallel stages...\n");
+
+    MemoryManager* mm = mm_create(MM_UNLIMITED);
+    long n = 20000;
+    Value* items = make_range(n);
+    long work = 20;
+
+    Pipeline p;
+    build_parallel_chain(&p, mm, items, n, &work);
+    PipeList serial;
+    assert(pipe_collect(&p, &serial));
+
+    // Same output, in order, for any batch size and pool size
+    size_t batches[] = { 1, 7, 64, 4096 };
+    int pools[] = { 1, 4 };
+    for (int w = 0; w < 2; w++) {
+        Scheduler* sched = sched_create(pools[w]);
+        for (int b = 0; b < 4; b++) {
+            build_parallel_chain(&p, mm, items, n, &work);
+            PipeList out;
+            PipeParallelStats stats;
+            assert(pipe_collect_parallel(&p, sched, batches[b], &out, &stats));
+            assert(out.count == serial.count);
+            for (size_t i = 0; i < out.count; i++) assert(out.items[i].bits == serial.items[i].bits);
+            assert(pipe_pulled(&p) == (size_t)n);
+            assert(stats.batches > 0 && stats.wakeups >= 4);
+            pipe_list_free(mm, &out);
+        }
+        sched_destroy(sched);
+    }
+    printf("✓ %zu outputs match the serial run for every batch and pool size\n", serial.count);
+
+    // One worker: the source runs until its ring is full before anything
+    // downstream gets a turn, so it must stall, and stage tasks interleave
+    // through wakeups rather than a pass each
+    Scheduler* single = sched_create(1);
+    build_parallel_chain(&p, mm, items, n, &work);
+    PipeList out;
+    PipeParallelStats stats;
+    assert(pipe_collect_parallel(&p, single, 16, &out, &stats));
+    assert(out.count == serial.count);
+    assert(stats.stalls > 0);
+    assert(stats.wakeups > 4);
+    pipe_list_free(mm, &out);
+    printf("✓ Backpressure: %lu stalls in %lu batches\n", stats.stalls, stats.batches);
+
+    // A full take stops the stages before it; the rings are drained
+    pipe_init(&p, mm, items, n);
+    pipe_map(&p, spin_stage, &work);
+    pipe_take(&p, 10);
+    pipe_map(&p, spin_stage, &work);
+    assert(pipe_collect_parallel(&p, single, 4, &out, NULL));
+    assert(out.count == 10 && value_as_small_int(out.items[9]) == 11);
+    assert(pipe_pulled(&p) < (size_t)n);
+    pipe_list_free(mm, &out);
+    printf("✓ take stops the stages upstream after %zu of %ld items\n", pipe_pulled(&p), n);
+    sched_destroy(single);
+
+    // Heap values would be released on workers while the last stage grows
+    // the output list: such a source runs on the calling thread
+    Scheduler* pool = sched_create(4);
+    Value boxed[3] = { value_small_int(1), value_int(mm, (int64_t)1 << 60), value_small_int(3) };
+    assert(value_is_object(boxed[1]));
+    StageCtx plus = { 1, 0 };
+    pipe_init(&p, mm, boxed, 3);
+    pipe_map(&p, add_stage, &plus);
+    pipe_map(&p, add_stage, &plus);
+    assert(pipe_collect_parallel(&p, pool, 1, &out, &stats));
+    assert(stats.wakeups == 0 && out.count == 3);
+    assert(value_as_int(out.items[1]) == ((int64_t)1 << 60) + 2);
+    pipe_list_free(mm, &out);
+    value_release(mm, boxed[1]);
+    sched_destroy(pool);
+    printf("✓ A source with heap values is collected on the calling thread\n");
+
+    pipe_list_free(mm, &serial);
+    free(items);
+    mm_destroy(mm);
+
+    printf("✅ Parallel stage tests passed!\n\n");
+}
+
+int main() {
+    printf("=== RHelix Pipeline Test Suite ===\n\n");
+
+    test_fused_stages();
+    test_lazy_consumers();
+    test_ownership();
+    test_parallel_stages();
+
+    printf("🎉 All tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,280 @@
+// test_scheduler.c - Test suite for the work-stealing scheduler
+#include "scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+static Scheduler* sched;
+
+// Fork-join fib with no serial cutoff: thousands of tiny nested tasks
+typedef struct {
+    int n;
+    long result;
+} FibArgs;
+
+static void fib_task(void* p) {
+    FibArgs* a = (FibArgs*)p;
+    if (a->n < 2) {
+        a->result = a->n;
+        return;
+    }
+    FibArgs left = { a->n - 1, 0 };
+    FibArgs right = { a->n - 2, 0 };
+    TaskGroup group;
+    sched_group_init(&group);
+    sched_spawn(sched, &group, fib_task, &left);
+    fib_task(&right);
+    sched_wait(sched, &group);
+    a->result = left.result + right.result;
+}
+
+void test_fork_join() {
+    printf("Testing fork-join...\n");
+
+    sched_reset_stats(sched);
+    FibArgs args = { 20, 0 };
+    sched_run(sched, fib_task, &args);
+    assert(args.result == 6765);
+
+    SchedStats stats;
+    sched_get_stats(sched, &stats);
+    // fib(20) spawns fib(21) - 1 = 10945 children, plus the root
+    assert(stats.tasks_run == 10946);
+    assert(stats.injected == 1);
+    printf("✓ fib(20) = %ld over %lu tasks, %lu steals\n",
+           args.result, stats.tasks_run, stats.steals);
+
+    printf("✅ Fork-join tests passed!\n\n");
+}
+
+// Many independent children in one group, waited for from the root task
+typedef struct {
+    atomic_long* counter;
+    int amount;
+} AddArgs;
+
+static void add_task(void* p) {
+    AddArgs* a = (AddArgs*)p;
+    atomic_fetch_add(a->counter, a->amount);
+}
+
+typedef struct {
+    int count;
+    atomic_long counter;
+} FanOut;
+
+static void fan_out(void* p) {
+    FanOut* f = (FanOut*)p;
+    AddArgs* args = (AddArgs*)malloc(sizeof(AddArgs) * f->count);
+    TaskGroup group;
+    sched_group_init(&group);
+    for (int i = 0; i < f->count; i++) {
+        args[i].counter = &f->counter;
+        args[i].amount = i + 1;
+        sched_spawn(sched, &group, add_task, &args[i]);
+    }
+    sched_wait(sched, &group);
+    free(args);
+}
+
+void test_wide_groups() {
+    printf("Testing wide task groups...\n");
+
+    // More children than the initial deque capacity forces it to grow
+    FanOut f = { 5000, 0 };
+    sched_run(sched, fan_out, &f);
+    assert(atomic_load(&f.counter) == 5000L * 5001 / 2);
+    printf("✓ 5000 children in one group, deque grew\n");
+
+    // Spawn and wait from a thread outside the pool
+    AddArgs args[64];
+    atomic_long counter = 0;
+    TaskGroup group;
+    sched_group_init(&group);
+    for (int i = 0; i < 64; i++) {
+        args[i].counter = &counter;
+        args[i].amount = 1;
+        sched_spawn(sched, &group, add_task, &args[i]);
+    }
+    sched_wait(sched, &group);
+    assert(atomic_load(&counter) == 64);
+    assert(sched_current_worker() == -1);
+    printf("✓ External spawn goes through the injection queue\n");
+
+    printf("✅ Wide group tests passed!\n\n");
+}
+
+// parallel_for must cover every index exactly once
+typedef struct {
+    unsigned char* hits;
+    long max_chunk;
+    atomic_long chunks;
+} CoverArgs;
+
+static void cover_range(long lo, long hi, void* p) {
+    CoverArgs* c = (CoverArgs*)p;
+    assert(hi - lo <= c->max_chunk);
+    for (long i = lo; i < hi; i++) c->hits[i]++;
+    atomic_fetch_add(&c->chunks, 1);
+}
+
+static void nested_for(long lo, long hi, void* p) {
+    CoverArgs* c = (CoverArgs*)p;
+    // Inner loop over a row: parallel_for from inside a worker
+    for (long row = lo; row < hi; row++) {
+        CoverArgs inner = { c->hits + row * 100, 100, 0 };
+        sched_parallel_for(sched, 0, 100, 10, cover_range, &inner);
+        assert(atomic_load(&inner.chunks) >= 10);
+    }
+}
+
+void test_parallel_for() {
+    printf("Testing parallel for...\n");
+
+    long n = 100000;
+    unsigned char* hits = (unsigned char*)calloc(n, 1);
+    CoverArgs c = { hits, 1000, 0 };
+    sched_parallel_for(sched, 0, n, 1000, cover_range, &c);
+    for (long i = 0; i < n; i++) assert(hits[i] == 1);
+    assert(atomic_load(&c.chunks) >= n / 1000);
+    printf("✓ %ld indices covered once in %ld chunks\n", n, atomic_load(&c.chunks));
+
+    // Automatic grain, odd bounds
+    CoverArgs a = { hits, n, 0 };
+    sched_parallel_for(sched, 7, 99991, 0, cover_range, &a);
+    for (long i = 0; i < n; i++) assert(hits[i] == ((i >= 7 && i < 99991) ? 2 : 1));
+    sched_parallel_for(sched, 10, 10, 0, cover_range, &a);  // Empty range
+    printf("✓ Automatic grain and empty ranges\n");
+
+    // Nested loops
+    unsigned char* grid = (unsigned char*)calloc(100 * 100, 1);
+    CoverArgs outer = { grid, 1, 0 };
+    sched_parallel_for(sched, 0, 100, 1, nested_for, &outer);
+    for (long i = 0; i < 100 * 100; i++) assert(grid[i] == 1);
+    printf("✓ Nested parallel for\n");
+
+    free(grid);
+    free(hits);
+    printf("✅ Parallel for tests passed!\n\n");
+}
+
+// Sum reducer
+static void sum_init(void* acc, void* arg) {
+    (void)arg;
+    *(long*)acc = 0;
+}
+
+static void sum_combine(void* into, const void* from, void* arg) {
+    (void)arg;
+    *(long*)into += *(const long*)from;
+}
+
+static void sum_range(long lo, long hi, void* acc, void* arg) {
+    (void)arg;
+    for (long i = lo; i < hi; i++) *(long*)acc += i;
+}
+
+// Order-sensitive reducer: each accumulator records the contiguous span
+// it covers, and combining anything but neighbours in order is an error.
+typedef struct {
+    long first;
+    long last;
+    bool ordered;
+} Span;
+
+static void span_init(void* acc, void* arg) {
+    (void)arg;
+    Span* s = (Span*)acc;
+    s->first = -1;
+    s->last = -1;
+    s->ordered = true;
+}
+
+static void span_combine(void* into, const void* from, void* arg) {
+    (void)arg;
+    Span* a = (Span*)into;
+    const Span* b = (const Span*)from;
+    if (b->first < 0) return;
+    if (a->first < 0) {
+        *a = *b;
+        return;
+    }
+    a->ordered = a->ordered && b->ordered && a->last + 1 == b->first;
+    a->last = b->last;
+}
+
+static void span_range(long lo, long hi, void* acc, void* arg) {
+    Span chunk = { lo, hi - 1, true };
+    span_combine(acc, &chunk, arg);
+}
+
+void test_parallel_reduce() {
+    printf("Testing parallel reduce...\n");
+
+    SchedReducer sum = { sizeof(long), sum_init, sum_combine };
+    long total = -1;
+    sched_reset_stats(sched);
+    sched_parallel_reduce(sched, 0, 1000000, 0, sum_range, &sum, &total, NULL);
+    assert(total == 999999L * 1000000 / 2);
+    SchedStats stats;
+    sched_get_stats(sched, &stats);
+    printf("✓ Sum of 1M ints with lazy splitting: %lu tasks, %lu steals\n",
+           stats.tasks_run, stats.steals);
+
+    SchedReducer span = { sizeof(Span), span_init, span_combine };
+    Span covered;
+    sched_parallel_reduce(sched, 5, 200005, 16, span_range, &span, &covered, NULL);
+    assert(covered.ordered && covered.first == 5 && covered.last == 200004);
+    printf("✓ Partial results combine in iteration order\n");
+
+    sched_parallel_reduce(sched, 3, 3, 0, sum_range, &sum, &total, NULL);
+    assert(total == 0);
+    printf("✓ Empty range yields the identity\n");
+
+    printf("✅ Parallel reduce tests passed!\n\n");
+}
+
+void test_pool_sizes() {
+    printf("Testing pool sizes...\n");
+
+    // A single worker still completes nested fork-join by helping
+    Scheduler* saved = sched;
+    sched = sched_create(1);
+    assert(sched_worker_count(sched) == 1);
+    FibArgs args = { 15, 0 };
+    sched_run(sched, fib_task, &args);
+    assert(args.result == 610);
+    SchedStats stats;
+    sched_get_stats(sched, &stats);
+    assert(stats.steals == 0);
+    sched_destroy(sched);
+    printf("✓ One worker, no steals\n");
+
+    sched = sched_create(0);
+    assert(sched_worker_count(sched) >= 1);
+    printf("✓ Default pool has %d workers\n", sched_worker_count(sched));
+    sched_destroy(sched);
+
+    sched = saved;
+    printf("✅ Pool size tests passed!\n\n");
+}
+
+int main() {
+    printf("=== RHelix Scheduler Test Suite ===\n\n");
+
+    // Oversubscribe on purpose so steals happen even on small machines
+    sched = sched_create(4);
+    assert(sched_worker_count(sched) == 4);
+
+    test_fork_join();
+    test_wide_groups();
+    test_parallel_for();
+    test_parallel_reduce();
+    test_pool_sizes();
+
+    sched_destroy(sched);
+
+    printf("🎉 All tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,471 @@
+// value.c - Slow paths for NaN-boxed runtime values
+#include "value.h"
+#include "container.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+Value value_int(MemoryManager* mm, int64_t i) {
+    if (value_int_fits(i)) return value_small_int(i);
+
+    // Box it: an OBJ_TYPE_INT object holding the full int64_t
+    Object* obj = mm_alloc(mm, sizeof(int64_t));
+    if (!obj) return value_none();
+    OBJ_SET_TYPE(obj, OBJ_TYPE_INT);
+    *(int64_t*)MM_OBJECT_DATA(obj) = i;
+    return value_object(obj);
+}
+
+static bool is_boxed_int(Value v) {
+    return value_is_object(v) && OBJ_TYPE(value_as_object(v)) == OBJ_TYPE_INT;
+}
+
+bool value_is_int(Value v) {
+    return value_is_small_int(v) || is_boxed_int(v);
+}
+
+int64_t value_as_int(Value v) {
+    if (value_is_small_int(v)) return value_as_small_int(v);
+    return *(int64_t*)MM_OBJECT_DATA(value_as_object(v));
+}
+
+ValueKind value_kind(Value v) {
+    switch (value_tag(v)) {
+        case VALUE_TAG_INT:  return VALUE_INT;
+        case VALUE_TAG_BOOL: return VALUE_BOOL;
+        case VALUE_TAG_NONE: return VALUE_NONE;
+        case VALUE_TAG_OBJECT:
+            return is_boxed_int(v) ? VALUE_INT : VALUE_OBJECT;
+        default:
+            return VALUE_FLOAT;
+    }
+}
+
+bool value_truthy(Value v) {
+    switch (value_kind(v)) {
+        case VALUE_FLOAT:  return value_as_float(v) != 0.0;
+        case VALUE_INT:    return value_as_int(v) != 0;
+        case VALUE_BOOL:   return value_as_bool(v);
+        case VALUE_NONE:   return false;
+        case VALUE_OBJECT:
+            if (value_is_string(v)) return value_string_length(v) != 0;
+            if (value_is_list(v)) return list_length(v) != 0;
+            if (value_is_dict(v)) return dict_length(v) != 0;
+            return true;
+    }
+    return false;
+}
+
+static bool is_number(Value v) {
+    return value_is_float(v) || value_is_int(v);
+}
+
+static double to_double(Value v) {
+    return value_is_float(v) ? value_as_float(v) : (double)value_as_int(v);
+}
+
+bool value_equals(Value a, Value b) {
+    if (a.bits == b.bits) return !(value_is_float(a) && isnan(value_as_float(a)));
+    if (value_is_int(a) && value_is_int(b)) return value_as_int(a) == value_as_int(b);
+    if (is_number(a) && is_number(b)) return to_double(a) == to_double(b);
+    if (value_is_string(a) && value_is_string(b)) {
+        StringData* x = VALUE_STRING_DATA(value_as_object(a));
+        StringData* y = VALUE_STRING_DATA(value_as_object(b));
+        return x->length == y->length && x->hash == y->hash &&
+               memcmp(x->chars, y->chars, x->length) == 0;
+    }
+    return false;
+}
+
+// SplitMix64 finalizer: spreads ints that differ in low bits only
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+uint64_t value_hash(Value v) {
+    if (value_is_string(v)) return VALUE_STRING_DATA(value_as_object(v))->hash;
+    if (value_is_int(v)) return mix64((uint64_t)value_as_int(v));
+    if (value_is_float(v)) {
+        // Integral floats hash like the int they equal
+        double d = value_as_float(v);
+        if (d >= -9223372036854775808.0 && d < 9223372036854775808.0 &&
+            d == (double)(int64_t)d) {
+            return mix64((uint64_t)(int64_t)d);
+        }
+    }
+    return mix64(v.bits);  // Everything else is equal only to itself
+}
+
+// Shared slow path. Int results that overflow int64 fall back to float;
+// there are no arbitrary-precision ints.
+static Value arith(MemoryManager* mm, Value a, Value b, char op) {
+    if (!is_number(a) || !is_number(b)) return value_none();
+
+    if (value_is_int(a) && value_is_int(b)) {
+        int64_t x = value_as_int(a), y = value_as_int(b), r;
+        bool overflow;
+        switch (op) {
+            case '+': overflow = __builtin_add_overflow(x, y, &r); break;
+            case '-': overflow = __builtin_sub_overflow(x, y, &r); break;
+            default:  overflow = __builtin_mul_overflow(x, y, &r); break;
+        }
+        if (!overflow) return value_int(mm, r);
+    }
+
+    double x = to_double(a), y = to_double(b);
+    switch (op) {
+        case '+': return value_float(x + y);
+        case '-': return value_float(x - y);
+        default:  return value_float(x * y);
+    }
+}
+
+Value value_add_slow(MemoryManager* mm, Value a, Value b) { return arith(mm, a, b, '+'); }
+Value value_sub_slow(MemoryManager* mm, Value a, Value b) { return arith(mm, a, b, '-'); }
+Value value_mul_slow(MemoryManager* mm, Value a, Value b) { return arith(mm, a, b, '*'); }
+
+// ============================================================
+// Strings and the immortal value cache
+// ============================================================
+
+#define VALUE_CACHE_CHUNK_SIZE  (16 * 1024)
+#define INTERN_MIN_CAPACITY     64
+
+struct ValueCache {
+    MemoryManager* mm;
+    Arena* arena;            // Chunk currently receiving immortal objects
+    bool preallocating;      // In value_cache_create: chunks are uncharged
+    Object* empty;           // ""
+    Object* bytes[256];      // Every single-byte string
+    Object** interned;       // Open addressing; NULL marks an empty slot
+    size_t intern_capacity;  // Power of two
+    size_t intern_count;
+    size_t string_count;     // All immortal strings, cached and interned
+};
+
+// Names every program touches, interned up front
+static const char* const preinterned_names[] = {
+    "self", "__init__", "print", "len", "range", "append", "keys", "values", "items"
+};
+
+static uint64_t string_hash(const char* chars, size_t length) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char)chars[i];
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+static void string_fill(Object* obj, const char* chars, size_t length, uint64_t hash) {
+    OBJ_SET_TYPE(obj, OBJ_TYPE_STRING);
+    StringData* str = VALUE_STRING_DATA(obj);
+    str->length = length;
+    str->hash = hash;
+    memcpy(str->chars, chars, length);
+    str->chars[length] = '\0';
+}
+
+// Immortal string carved from the cache's arenas. Arena objects use the
+// large-object layout so mm_object_size still works on them.
+static Object* immortal_string(ValueCache* cache, const char* chars, size_t length,
+                               uint64_t hash) {
+    size_t payload = sizeof(StringData) + length + 1;
+    size_t bytes = sizeof(LargeObjectHeader) + sizeof(Object) + payload;
+    char* p = cache->arena ? (char*)mm_arena_alloc(cache->arena, bytes) : NULL;
+    if (!p) {
+        size_t chunk = bytes > VALUE_CACHE_CHUNK_SIZE ? bytes : VALUE_CACHE_CHUNK_SIZE;
+        Arena* arena = cache->preallocating ? mm_arena_create_uncharged(cache->mm, chunk)
+                                            : mm_arena_create(cache->mm, chunk);
+        if (!arena) return NULL;
+        cache->arena = arena;
+        p = (char*)mm_arena_alloc(arena, bytes);
+    }
+
+    Object* obj = (Object*)(p + sizeof(LargeObjectHeader));
+    LargeObjectHeader* large = MM_LARGE_HEADER(obj);
+    large->size = payload;
+    large->offset = sizeof(LargeObjectHeader);
+    obj->ref_count = 1;
+    obj->flags = OBJ_IMMORTAL | OBJ_ARENA;
+    obj->size_class = MM_SIZE_CLASS_LARGE;
+    obj->reserved = 0;
+    string_fill(obj, chars, length, hash);
+    cache->string_count++;
+    return obj;
+}
+
+static size_t intern_find(const ValueCache* cache, const char* chars, size_t length,
+                          uint64_t hash) {
+    size_t mask = cache->intern_capacity - 1;
+    size_t i = (size_t)hash & mask;
+    for (;;) {
+        Object* obj = cache->interned[i];
+        if (!obj) return i;
+        StringData* str = VALUE_STRING_DATA(obj);
+        if (str->hash == hash && str->length == length &&
+            memcmp(str->chars, chars, length) == 0) {
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static bool intern_grow(ValueCache* cache) {
+    size_t new_cap = cache->intern_capacity ? cache->intern_capacity * 2 : INTERN_MIN_CAPACITY;
+    Object** slots = (Object**)calloc(new_cap, sizeof(Object*));
+    if (!slots) return false;
+
+    Object** old = cache->interned;
+    size_t old_cap = cache->intern_capacity;
+    cache->interned = slots;
+    cache->intern_capacity = new_cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (!old[i]) continue;
+        StringData* str = VALUE_STRING_DATA(old[i]);
+        slots[intern_find(cache, str->chars, str->length, str->hash)] = old[i];
+    }
+    free(old);
+    return true;
+}
+
+static Object* intern(ValueCache* cache, const char* chars, size_t length) {
+    if (length == 0) return cache->empty;
+    if (length == 1) return cache->bytes[(unsigned char)chars[0]];
+
+    // Keep the load factor at or below 1/2
+    if ((cache->intern_count + 1) * 2 > cache->intern_capacity && !intern_grow(cache)) {
+        return NULL;
+    }
+    uint64_t hash = string_hash(chars, length);
+    size_t i = intern_find(cache, chars, length, hash);
+    if (!cache->interned[i]) {
+        Object* obj = immortal_string(cache, chars, length, hash);
+        if (!obj) return NULL;
+        cache->interned[i] = obj;
+        cache->intern_count++;
+    }
+    return cache->interned[i];
+}
+
+ValueCache* value_cache_create(MemoryManager* mm) {
+    ValueCache* cache = (ValueCache*)calloc(1, sizeof(ValueCache));
+    if (!cache) return NULL;
+    cache->mm = mm;
+
+    // What every manager preallocates stays outside its limits; strings
+    // interned later are charged like any arena
+    cache->preallocating = true;
+    cache->empty = immortal_string(cache, "", 0, string_hash("", 0));
+    bool ok = cache->empty != NULL;
+    for (int c = 0; ok && c < 256; c++) {
+        char ch = (char)c;
+        cache->bytes[c] = immortal_string(cache, &ch, 1, string_hash(&ch, 1));
+        ok = cache->bytes[c] != NULL;
+    }
+    size_t n = sizeof(preinterned_names) / sizeof(preinterned_names[0]);
+    for (size_t i = 0; ok && i < n; i++) {
+        ok = intern(cache, preinterned_names[i], strlen(preinterned_names[i])) != NULL;
+    }
+    if (!ok) {
+        // Arenas already created belong to the manager and go with it
+        value_cache_destroy(cache);
+        return NULL;
+    }
+    cache->preallocating = false;
+    return cache;
+}
+
+void value_cache_destroy(ValueCache* cache) {
+    if (!cache) return;
+    free(cache->interned);
+    free(cache);
+}
+
+size_t value_cache_string_count(MemoryManager* mm) {
+    return mm->value_cache->string_count;
+}
+
+size_t value_cache_interned_count(MemoryManager* mm) {
+    return mm->value_cache->intern_count;
+}
+
+Value value_string(MemoryManager* mm, const char* chars, size_t length) {
+    ValueCache* cache = mm->value_cache;
+    if (length == 0) return value_object(cache->empty);
+    if (length == 1) return value_object(cache->bytes[(unsigned char)chars[0]]);
+
+    if (length > SIZE_MAX - sizeof(StringData) - 1) return value_none();
+    Object* obj = mm_alloc(mm, sizeof(StringData) + length + 1);
+    if (!obj) return value_none();
+    string_fill(obj, chars, length, string_hash(chars, length));
+    return value_object(obj);
+}
+
+Value value_intern(MemoryManager* mm, const char* chars, size_t length) {
+    Object* obj = intern(mm->value_cache, chars, length);
+    return obj ? value_object(obj) : value_none();
+}
+
+bool value_is_string(Value v) {
+    return value_is_object(v) && OBJ_TYPE(value_as_object(v)) == OBJ_TYPE_STRING;
+}
+
+const char* value_string_chars(Value v) {
+    return VALUE_STRING_DATA(value_as_object(v))->chars;
+}
+
+size_t value_string_length(Value v) {
+    return VALUE_STRING_DATA(value_as_object(v))->length;
+}
+
+// ============================================================
+// Closures and cells
+// ============================================================
+
+Value value_closure(MemoryManager* mm, int32_t function, const Value* captures,
+                    int32_t count) {
+    Object* obj = mm_alloc(mm, sizeof(ClosureData) + sizeof(Value) * (size_t)count);
+    if (!obj) {
+        for (int32_t i = 0; i < count; i++) value_release(mm, captures[i]);
+        return value_none();
+    }
+    OBJ_SET_TYPE(obj, OBJ_TYPE_FUNCTION);
+    ClosureData* d = VALUE_CLOSURE_DATA(obj);
+    d->function = function;
+    d->capture_count = count;
+    if (count > 0) memcpy(d->captures, captures, sizeof(Value) * (size_t)count);
+    return value_object(obj);
+}
+
+bool value_is_closure(Value v) {
+    return value_is_object(v) && OBJ_TYPE(value_as_object(v)) == OBJ_TYPE_FUNCTION;
+}
+
+Value value_cell(MemoryManager* mm, Value contents) {
+    Object* obj = mm_alloc(mm, sizeof(Value));
+    if (!obj) {
+        value_release(mm, contents);
+        return value_none();
+    }
+    OBJ_SET_TYPE(obj, OBJ_TYPE_CELL);
+    *(Value*)MM_OBJECT_DATA(obj) = contents;
+    return value_object(obj);
+}
+
+bool value_is_cell(Value v) {
+    return value_is_object(v) && OBJ_TYPE(value_as_object(v)) == OBJ_TYPE_CELL;
+}
+
+Value value_cell_get(Value cell) {
+    return *(Value*)MM_OBJECT_DATA(value_as_object(cell));
+}
+
+void value_cell_set(MemoryManager* mm, Value cell, Value contents) {
+    Value* slot = (Value*)MM_OBJECT_DATA(value_as_object(cell));
+    Value old = *slot;
+    *slot = contents;
+    value_release(mm, old);
+}
+
+static void closure_finalize(MemoryManager* mm, Object* obj) {
+    ClosureData* d = VALUE_CLOSURE_DATA(obj);
+    for (int32_t i = 0; i < d->capture_count; i++) value_release(mm, d->captures[i]);
+}
+
+static void cell_finalize(MemoryManager* mm, Object* obj) {
+    value_release(mm, *(Value*)MM_OBJECT_DATA(obj));
+}
+
+void closure_register(MemoryManager* mm) {
+    mm_set_finalizer(mm, OBJ_TYPE_FUNCTION, closure_finalize);
+    mm_set_finalizer(mm, OBJ_TYPE_CELL, cell_finalize);
+}
+
+// Shortest "%.*g" that reads back as the same double, with ".0" appended
+// to integral values so floats never print like ints.
+static void print_float(double d) {
+    if (isnan(d)) { printf("nan"); return; }
+    if (isinf(d)) { printf(d > 0 ? "inf" : "-inf"); return; }
+
+    char buf[32];
+    for (int precision = 1; precision <= 17; precision++) {
+        snprintf(buf, sizeof(buf), "%.*g", precision, d);
+        if (strtod(buf, NULL) == d) break;
+    }
+    printf("%s", buf);
+    if (!strpbrk(buf, ".e")) printf(".0");
+}
+
+static void print_value(Value v, bool quote_strings);
+
+// Element 'i' of a container array, straight from its layout
+static void print_element(ContainerLayout layout, const void* items, size_t i) {
+    switch (layout) {
+        case LAYOUT_INT: printf("%lld", (long long)((const int64_t*)items)[i]); break;
+        case LAYOUT_FLOAT: print_float(((const double*)items)[i]); break;
+        default: print_value(((const Value*)items)[i], true); break;
+    }
+}
+
+// Strings inside containers print quoted, as the language shows them
+static void print_value(Value v, bool quote_strings) {
+    switch (value_kind(v)) {
+        case VALUE_FLOAT: print_float(value_as_float(v)); break;
+        case VALUE_INT:   printf("%lld", (long long)value_as_int(v)); break;
+        case VALUE_BOOL:  printf(value_as_bool(v) ? "True" : "False"); break;
+        case VALUE_NONE:  printf("None"); break;
+        case VALUE_OBJECT: {
+            if (value_is_string(v)) {
+                if (quote_strings) printf("'");
+                fwrite(value_string_chars(v), 1, value_string_length(v), stdout);
+                if (quote_strings) printf("'");
+                break;
+            }
+            if (value_is_list(v)) {
+                ListData* d = list_data(v);
+                printf("[");
+                for (size_t i = 0; i < d->length; i++) {
+                    if (i > 0) printf(", ");
+                    print_element(d->layout, d->items, i);
+                }
+                printf("]");
+                break;
+            }
+            if (value_is_dict(v)) {
+                DictData* d = dict_data(v);
+                printf("{");
+                for (size_t i = 0; i < d->length; i++) {
+                    if (i > 0) printf(", ");
+                    print_value(d->keys[i], true);
+                    printf(": ");
+                    print_element(d->layout, d->values, i);
+                }
+                printf("}");
+                break;
+            }
+            Object* obj = value_as_object(v);
+            if (value_is_closure(v)) {
+                printf("<closure #%d (%d captures)>", (int)VALUE_CLOSURE_DATA(obj)->function,
+                       (int)VALUE_CLOSURE_DATA(obj)->capture_count);
+                break;
+            }
+            if (value_is_cell(v)) {
+                printf("<cell ");
+                print_value(value_cell_get(v), true);
+                printf(">");
+                break;
+            }
+            printf("<object type=%u at %p>", (unsigned)OBJ_TYPE(obj), (void*)obj);
+            break;
+        }
+    }
+}
+
+void value_print(Value v) {
+    print_value(v, false);
+}
@@ -0,0 +1,270 @@
+// value.h - Runtime value representation
+//
+// A Value is 64 bits, NaN-boxed. Every double is stored as itself, except
+// that NaNs are canonicalized to the positive quiet NaN. The negative
+// quiet-NaN space above that (top 16 bits 0xFFF9..0xFFFC) holds everything
+// else:
+//
+//   0xFFF9 | 48-bit signed int      immediate int
+//   0xFFFA | 0 or 1                 bool
+//   0xFFFB | 0                      None
+//   0xFFFC | 48-bit Object*         heap object (refcounted)
+//
+// Ints, floats, bools and None therefore never allocate. Strings, lists,
+// dicts, functions and instances live on the heap and carry their kind in
+// the object header's type id. Ints outside the 48-bit range are boxed as
+// OBJ_TYPE_INT objects holding an int64_t, so arithmetic stays exact up
+// to the int64 range.
+
+#ifndef VALUE_H
+#define VALUE_H
+
+#include "memory_manager.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+_Static_assert(sizeof(void*) == 8, "NaN-boxing needs 64-bit pointers");
+
+typedef struct {
+    uint64_t bits;
+} Value;
+
+// Heap object kinds, stored with OBJ_SET_TYPE
+typedef enum {
+    OBJ_TYPE_UNTYPED = 0,
+    OBJ_TYPE_INT,            // Boxed int outside the immediate range
+    OBJ_TYPE_STRING,
+    OBJ_TYPE_LIST,
+    OBJ_TYPE_DICT,
+    OBJ_TYPE_FUNCTION,       // Closure record, see below
+    OBJ_TYPE_INSTANCE,
+    OBJ_TYPE_CELL            // Shared box for a variable a closure captures mutably
+} ObjectType;
+
+typedef enum {
+    VALUE_FLOAT,
+    VALUE_INT,               // Immediate or boxed
+    VALUE_BOOL,
+    VALUE_NONE,
+    VALUE_OBJECT             // Any other heap object
+} ValueKind;
+
+#define VALUE_TAG_SHIFT     48
+#define VALUE_PAYLOAD_MASK  0x0000FFFFFFFFFFFFull
+#define VALUE_TAG_INT       0xFFF9ull
+#define VALUE_TAG_BOOL      0xFFFAull
+#define VALUE_TAG_NONE      0xFFFBull
+#define VALUE_TAG_OBJECT    0xFFFCull
+#define VALUE_CANONICAL_NAN 0x7FF8000000000000ull
+
+#define VALUE_INT_MAX  (((int64_t)1 << 47) - 1)
+#define VALUE_INT_MIN  (-((int64_t)1 << 47))
+
+#define VALUE_NONE_BITS  (VALUE_TAG_NONE << VALUE_TAG_SHIFT)
+#define VALUE_TRUE_BITS  ((VALUE_TAG_BOOL << VALUE_TAG_SHIFT) | 1)
+#define VALUE_FALSE_BITS (VALUE_TAG_BOOL << VALUE_TAG_SHIFT)
+
+static inline uint64_t value_tag(Value v) {
+    return v.bits >> VALUE_TAG_SHIFT;
+}
+
+// === Type tests ===
+static inline bool value_is_float(Value v)  { return value_tag(v) < VALUE_TAG_INT; }
+static inline bool value_is_small_int(Value v) { return value_tag(v) == VALUE_TAG_INT; }
+static inline bool value_is_bool(Value v)   { return value_tag(v) == VALUE_TAG_BOOL; }
+static inline bool value_is_none(Value v)   { return v.bits == VALUE_NONE_BITS; }
+static inline bool value_is_object(Value v) { return value_tag(v) == VALUE_TAG_OBJECT; }
+
+// === Constructors that never allocate ===
+static inline Value value_none(void) {
+    Value v = { VALUE_NONE_BITS };
+    return v;
+}
+
+static inline Value value_bool(bool b) {
+    Value v = { b ? VALUE_TRUE_BITS : VALUE_FALSE_BITS };
+    return v;
+}
+
+static inline Value value_float(double d) {
+    Value v;
+    if (d != d) {
+        v.bits = VALUE_CANONICAL_NAN;
+    } else {
+        memcpy(&v.bits, &d, sizeof(d));
+    }
+    return v;
+}
+
+static inline bool value_int_fits(int64_t i) {
+    return i >= VALUE_INT_MIN && i <= VALUE_INT_MAX;
+}
+
+// Caller guarantees value_int_fits(i)
+static inline Value value_small_int(int64_t i) {
+    Value v = { (VALUE_TAG_INT << VALUE_TAG_SHIFT) | ((uint64_t)i & VALUE_PAYLOAD_MASK) };
+    return v;
+}
+
+// Wrap a heap object. Ownership of the caller's reference moves into the Value.
+static inline Value value_object(Object* obj) {
+    Value v = { (VALUE_TAG_OBJECT << VALUE_TAG_SHIFT) | (uint64_t)(uintptr_t)obj };
+    return v;
+}
+
+// === Accessors (caller checks the kind first) ===
+static inline double value_as_float(Value v) {
+    double d;
+    memcpy(&d, &v.bits, sizeof(d));
+    return d;
+}
+
+static inline int64_t value_as_small_int(Value v) {
+    // Sign-extend the 48-bit payload
+    return (int64_t)(v.bits << 16) >> 16;
+}
+
+static inline bool value_as_bool(Value v) {
+    return (v.bits & 1) != 0;
+}
+
+static inline Object* value_as_object(Value v) {
+    return (Object*)(uintptr_t)(v.bits & VALUE_PAYLOAD_MASK);
+}
+
+// === Reference counting: no-ops for immediates ===
+static inline void value_retain(Value v) {
+    if (value_is_object(v)) mm_retain(value_as_object(v));
+}
+
+static inline void value_release(MemoryManager* mm, Value v) {
+    if (value_is_object(v)) mm_release(mm, value_as_object(v));
+}
+
+// === Out-of-line operations (value.c) ===
+
+// Any int64: immediate when it fits in 48 bits, boxed otherwise. A boxed
+// result is a new reference; on allocation failure the result is None.
+Value value_int(MemoryManager* mm, int64_t i);
+
+ValueKind value_kind(Value v);
+bool value_is_int(Value v);                    // Immediate or boxed
+int64_t value_as_int(Value v);                 // Caller checks value_is_int
+bool value_truthy(Value v);
+bool value_equals(Value a, Value b);           // Numeric equality across int/float
+uint64_t value_hash(Value v);                  // Equal values hash alike (1 and 1.0 too)
+
+// Arithmetic on ints and floats (ints promote to float when mixed).
+// Non-numeric operands yield None. Results may be boxed ints, which the
+// caller owns.
+Value value_add_slow(MemoryManager* mm, Value a, Value b);
+Value value_sub_slow(MemoryManager* mm, Value a, Value b);
+Value value_mul_slow(MemoryManager* mm, Value a, Value b);
+
+// Fast paths for the common immediate cases. Sums and differences of two
+// 48-bit ints cannot overflow int64, so only the range check remains.
+static inline Value value_add(MemoryManager* mm, Value a, Value b) {
+    if (value_is_small_int(a) && value_is_small_int(b)) {
+        int64_t r = value_as_small_int(a) + value_as_small_int(b);
+        if (value_int_fits(r)) return value_small_int(r);
+    } else if (value_is_float(a) && value_is_float(b)) {
+        return value_float(value_as_float(a) + value_as_float(b));
+    }
+    return value_add_slow(mm, a, b);
+}
+
+static inline Value value_sub(MemoryManager* mm, Value a, Value b) {
+    if (value_is_small_int(a) && value_is_small_int(b)) {
+        int64_t r = value_as_small_int(a) - value_as_small_int(b);
+        if (value_int_fits(r)) return value_small_int(r);
+    } else if (value_is_float(a) && value_is_float(b)) {
+        return value_float(value_as_float(a) - value_as_float(b));
+    }
+    return value_sub_slow(mm, a, b);
+}
+
+static inline Value value_mul(MemoryManager* mm, Value a, Value b) {
+    if (value_is_float(a) && value_is_float(b)) {
+        return value_float(value_as_float(a) * value_as_float(b));
+    }
+    return value_mul_slow(mm, a, b);
+}
+
+// === Strings ===
+
+// Payload of an OBJ_TYPE_STRING object
+typedef struct {
+    size_t length;
+    uint64_t hash;           // FNV-1a of the bytes
+    char chars[];            // NUL-terminated
+} StringData;
+
+#define VALUE_STRING_DATA(obj) ((StringData*)MM_OBJECT_DATA(obj))
+
+// New string value. The empty string and every single-byte string come
+// from the manager's immortal cache and are never allocated; anything
+// longer is a fresh refcounted object (None on allocation failure).
+Value value_string(MemoryManager* mm, const char* chars, size_t length);
+
+// Interned string: one immortal object per distinct content for the
+// lifetime of the manager. For identifiers, attribute names and other
+// strings that repeat; never for unbounded runtime data.
+Value value_intern(MemoryManager* mm, const char* chars, size_t length);
+
+bool value_is_string(Value v);
+const char* value_string_chars(Value v);      // Caller checks value_is_string
+size_t value_string_length(Value v);
+
+// === Closures ===
+//
+// A closure is one flat record: the index of its function and its
+// captured values, sized exactly at creation. Variables the closure only
+// reads are copied in by value; a variable its defining function rebinds
+// is shared through an OBJ_TYPE_CELL, which the record holds instead.
+
+// Payload of an OBJ_TYPE_FUNCTION object
+typedef struct {
+    int32_t function;        // Index of the function in its module
+    int32_t capture_count;
+    Value captures[];        // Owned references
+} ClosureData;
+
+#define VALUE_CLOSURE_DATA(obj) ((ClosureData*)MM_OBJECT_DATA(obj))
+
+// New closure over 'count' captures, in one allocation. The closure takes
+// over the caller's references to the captures; on allocation failure
+// they are released and the result is None.
+Value value_closure(MemoryManager* mm, int32_t function, const Value* captures,
+                    int32_t count);
+bool value_is_closure(Value v);
+
+// New cell holding 'contents', whose reference it takes over (None on
+// allocation failure, with 'contents' released).
+Value value_cell(MemoryManager* mm, Value contents);
+bool value_is_cell(Value v);
+
+// The contents of a cell (borrowed), and replacing them: the cell takes
+// over 'contents' and releases what it held.
+Value value_cell_get(Value cell);
+void value_cell_set(MemoryManager* mm, Value cell, Value contents);
+
+// Install the finalizers that release captures and cell contents. Done by
+// mm_create.
+void closure_register(MemoryManager* mm);
+
+// === Immortal value cache ===
+//
+// Built by mm_create and torn down by mm_destroy. Cached objects are
+// marked OBJ_IMMORTAL, so mm_retain / mm_release return immediately,
+// and live in the manager's arenas rather than the counted heap. Small
+// ints, bools and None need no cache: they are immediate Values.
+ValueCache* value_cache_create(MemoryManager* mm);
+void value_cache_destroy(ValueCache* cache);
+size_t value_cache_string_count(MemoryManager* mm);
+size_t value_cache_interned_count(MemoryManager* mm);
+
+// Print a value the way the language would show it
+void value_print(Value v);
+
+#endif // VALUE_H